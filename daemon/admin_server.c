@@ -86,6 +86,7 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
     size_t freeWorkers;
     size_t nPrioWorkers;
     size_t jobQueueDepth;
+    size_t jobQueueWait;
     virTypedParameterPtr tmpparams = NULL;
 
     virCheckFlags(0, -1);
@@ -93,7 +94,8 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
     if (virNetServerGetThreadPoolParameters(srv, &minWorkers, &maxWorkers,
                                             &nWorkers, &freeWorkers,
                                             &nPrioWorkers,
-                                            &jobQueueDepth) < 0) {
+                                            &jobQueueDepth,
+                                            &jobQueueWait) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Unable to retrieve threadpool parameters"));
         goto cleanup;
@@ -129,6 +131,11 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
                               jobQueueDepth) < 0)
         goto cleanup;
 
+    if (virTypedParamsAddUInt(&tmpparams, nparams,
+                              &maxparams, VIR_THREADPOOL_JOB_QUEUE_WAIT,
+                              jobQueueWait) < 0)
+        goto cleanup;
+
     *params = tmpparams;
     tmpparams = NULL;
     ret = 0;
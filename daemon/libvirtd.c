@@ -53,6 +53,7 @@
 #include "remote.h"
 #include "virhook.h"
 #include "viraudit.h"
+#include "virmetrics.h"
 #include "virstring.h"
 #include "locking/lock_manager.h"
 #include "viraccessmanager.h"
@@ -768,6 +769,14 @@ daemonSetupLogging(struct daemonConfig *config,
         VIR_FREE(tmp);
     }
 
+    /*
+     * Hand the final set of outputs over to the async writer thread
+     * once everything above has settled
+     */
+    if (config->log_async &&
+        virLogSetAsync(true) < 0)
+        goto error;
+
     return 0;
 
  error:
@@ -850,6 +859,13 @@ static void daemonReloadHandler(virNetDaemonPtr dmn ATTRIBUTE_UNUSED,
         VIR_WARN("Error while reloading drivers");
 }
 
+static void daemonMetricsDumpHandler(virNetDaemonPtr dmn ATTRIBUTE_UNUSED,
+                                     siginfo_t *sig ATTRIBUTE_UNUSED,
+                                     void *opaque ATTRIBUTE_UNUSED)
+{
+    virMetricsDump();
+}
+
 static int daemonSetupSignals(virNetDaemonPtr dmn)
 {
     if (virNetDaemonAddSignalHandler(dmn, SIGINT, daemonShutdownHandler, NULL) < 0)
@@ -860,6 +876,8 @@ static int daemonSetupSignals(virNetDaemonPtr dmn)
         return -1;
     if (virNetDaemonAddSignalHandler(dmn, SIGHUP, daemonReloadHandler, NULL) < 0)
         return -1;
+    if (virNetDaemonAddSignalHandler(dmn, SIGUSR2, daemonMetricsDumpHandler, NULL) < 0)
+        return -1;
     return 0;
 }
 
@@ -988,6 +1006,11 @@ static void daemonRunStateInit(void *opaque)
 #endif
     /* Only now accept clients from network */
     virNetDaemonUpdateServices(dmn, true);
+
+    /* Autostart is deliberately kicked off only once the daemon is
+     * fully open for business, so a long row of domains or pools to
+     * start does not extend the API outage during daemon restarts */
+    virStateAutoStart();
  cleanup:
     daemonInhibitCallback(false, dmn);
     virObjectUnref(dmn);
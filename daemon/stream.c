@@ -25,6 +25,7 @@
 
 #include "stream.h"
 #include "remote.h"
+#include "libvirt_internal.h"
 #include "viralloc.h"
 #include "virlog.h"
 #include "virnetserverclient.h"
@@ -52,6 +53,11 @@ struct daemonClientStream {
     virNetMessagePtr rx;
     bool tx;
 
+    /* the client requested sparse stream */
+    bool allowSkip;
+    /* how much data is left to read until the next hole */
+    size_t dataLen;
+
     daemonClientStreamPtr next;
 };
 
@@ -285,7 +291,8 @@ daemonStreamFilter(virNetServerClientPtr client ATTRIBUTE_UNUSED,
 
     virMutexLock(&stream->priv->lock);
 
-    if (msg->header.type != VIR_NET_STREAM)
+    if (msg->header.type != VIR_NET_STREAM &&
+        msg->header.type != VIR_NET_STREAM_HOLE)
         goto cleanup;
 
     if (!virNetServerProgramMatches(stream->prog, msg))
@@ -321,13 +328,14 @@ daemonClientStream *
 daemonCreateClientStream(virNetServerClientPtr client,
                          virStreamPtr st,
                          virNetServerProgramPtr prog,
-                         virNetMessageHeaderPtr header)
+                         virNetMessageHeaderPtr header,
+                         bool allowSkip)
 {
     daemonClientStream *stream;
     daemonClientPrivatePtr priv = virNetServerClientGetPrivateData(client);
 
-    VIR_DEBUG("client=%p, proc=%d, serial=%u, st=%p",
-              client, header->proc, header->serial, st);
+    VIR_DEBUG("client=%p, proc=%d, serial=%u, st=%p, allowSkip=%d",
+              client, header->proc, header->serial, st, allowSkip);
 
     if (VIR_ALLOC(stream) < 0)
         return NULL;
@@ -339,6 +347,7 @@ daemonCreateClientStream(virNetServerClientPtr client,
     stream->serial = header->serial;
     stream->filterID = -1;
     stream->st = st;
+    stream->allowSkip = allowSkip;
 
     return stream;
 }
@@ -557,6 +566,60 @@ daemonStreamHandleWriteData(virNetServerClientPtr client,
 }
 
 
+/*
+ * Process an incoming stream hole packet.
+ *
+ * Returns:
+ *   -1  if fatal error occurred
+ *    0  if message was fully processed
+ */
+static int
+daemonStreamHandleHole(virNetServerClientPtr client,
+                       daemonClientStream *stream,
+                       virNetMessagePtr msg)
+{
+    int ret;
+    virNetStreamHole data;
+
+    VIR_DEBUG("client=%p, stream=%p, proc=%d, serial=%u",
+              client, stream, msg->header.proc, msg->header.serial);
+
+    /* Let's check if the client plays nicely and advertised
+     * usage of sparse stream upfront. */
+    if (!stream->allowSkip) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("Unexpected stream hole"));
+        return -1;
+    }
+
+    if (virNetMessageDecodePayload(msg,
+                                   (xdrproc_t) xdr_virNetStreamHole,
+                                   &data) < 0)
+        return -1;
+
+    ret = virStreamSendHole(stream->st, data.length, data.flags);
+
+    if (ret < 0) {
+        virNetMessageError rerr;
+
+        memset(&rerr, 0, sizeof(rerr));
+
+        VIR_INFO("Stream send hole failed");
+        stream->closed = true;
+        virStreamEventRemoveCallback(stream->st);
+        virStreamAbort(stream->st);
+
+        ret = virNetServerProgramSendReplyError(stream->prog,
+                                                client,
+                                                msg,
+                                                &rerr,
+                                                &msg->header);
+    }
+
+    return ret;
+}
+
+
 /*
  * Process a finish handshake from the client.
  *
@@ -672,7 +735,10 @@ daemonStreamHandleWrite(virNetServerClientPtr client,
             break;
 
         case VIR_NET_CONTINUE:
-            ret = daemonStreamHandleWriteData(client, stream, msg);
+            if (msg->header.type == VIR_NET_STREAM_HOLE)
+                ret = daemonStreamHandleHole(client, stream, msg);
+            else
+                ret = daemonStreamHandleWriteData(client, stream, msg);
             break;
 
         case VIR_NET_ERROR:
@@ -757,6 +823,56 @@ daemonStreamHandleRead(virNetServerClientPtr client,
     if (!(msg = virNetMessageNew(false)))
         goto cleanup;
 
+    if (stream->allowSkip && stream->dataLen == 0) {
+        int inData = 0;
+        long long length = 0;
+
+        /* We want to send some data to the client. But we might be
+         * in a hole. If that's the case announce the hole size to
+         * the client and seek past it, instead of transmitting the
+         * zeroes. If we are in a data section, remember how much
+         * data is left so reads don't cross into the next hole. */
+        if (virStreamInData(stream->st, &inData, &length) < 0) {
+            if (virNetServerProgramSendStreamError(remoteProgram,
+                                                   client,
+                                                   msg,
+                                                   &rerr,
+                                                   stream->procedure,
+                                                   stream->serial) < 0)
+                goto cleanup;
+            msg = NULL;
+            goto done;
+        }
+
+        if (!inData && length) {
+            stream->tx = false;
+            msg->cb = daemonStreamMessageFinished;
+            msg->opaque = stream;
+            stream->refs++;
+            if (virNetServerProgramSendStreamHole(remoteProgram,
+                                                  client,
+                                                  msg,
+                                                  stream->procedure,
+                                                  stream->serial,
+                                                  length,
+                                                  0) < 0)
+                goto cleanup;
+            msg = NULL;
+
+            /* We have successfully sent stream skip to the other
+             * side. To keep the streams in sync seek locally too. */
+            virStreamSendHole(stream->st, length, 0);
+            /* We're done with this call */
+            goto done;
+        }
+
+        stream->dataLen = length;
+    }
+
+    if (stream->allowSkip &&
+        bufferLen > stream->dataLen)
+        bufferLen = stream->dataLen;
+
     rv = virStreamRecv(stream->st, buffer, bufferLen);
     if (rv == -2) {
         /* Should never get this, since we're only called when we know
@@ -774,20 +890,37 @@ daemonStreamHandleRead(virNetServerClientPtr client,
         stream->tx = false;
         if (rv == 0)
             stream->recvEOF = true;
+        if (stream->allowSkip)
+            stream->dataLen -= rv;
 
         msg->cb = daemonStreamMessageFinished;
         msg->opaque = stream;
         stream->refs++;
-        if (virNetServerProgramSendStreamData(remoteProgram,
-                                              client,
-                                              msg,
-                                              stream->procedure,
-                                              stream->serial,
-                                              buffer, rv) < 0)
-            goto cleanup;
+        if (rv) {
+            /* Ownership of @buffer passes to the message so it can
+             * be written straight to the socket without copying */
+            rv = virNetServerProgramSendStreamData(remoteProgram,
+                                                   client,
+                                                   msg,
+                                                   stream->procedure,
+                                                   stream->serial,
+                                                   buffer, rv);
+            buffer = NULL;
+            if (rv < 0)
+                goto cleanup;
+        } else {
+            if (virNetServerProgramSendStreamData(remoteProgram,
+                                                  client,
+                                                  msg,
+                                                  stream->procedure,
+                                                  stream->serial,
+                                                  buffer, 0) < 0)
+                goto cleanup;
+        }
         msg = NULL;
     }
 
+ done:
     ret = 0;
  cleanup:
     VIR_FREE(buffer);
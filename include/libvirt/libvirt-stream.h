@@ -45,6 +45,23 @@ int virStreamRecv(virStreamPtr st,
                   char *data,
                   size_t nbytes);
 
+typedef enum {
+    VIR_STREAM_RECV_STOP_AT_HOLE = (1 << 0),
+} virStreamRecvFlagsValues;
+
+int virStreamRecvFlags(virStreamPtr st,
+                       char *data,
+                       size_t nbytes,
+                       unsigned int flags);
+
+int virStreamSendHole(virStreamPtr st,
+                      long long length,
+                      unsigned int flags);
+
+int virStreamRecvHole(virStreamPtr st,
+                      long long *length,
+                      unsigned int flags);
+
 
 /**
  * virStreamSourceFunc:
@@ -79,6 +96,55 @@ int virStreamSendAll(virStreamPtr st,
                      virStreamSourceFunc handler,
                      void *opaque);
 
+/**
+ * virStreamSourceHoleFunc:
+ * @st: the stream object
+ * @inData: are we in data section
+ * @length: how long is the section we are currently in
+ * @opaque: optional application provided data
+ *
+ * The virStreamSourceHoleFunc callback is used together with
+ * the virStreamSparseSendAll function for libvirt to know when
+ * to pause plain stream transfer and how big of a hole to
+ * transfer instead.
+ *
+ * The callback is expected to update @inData and @length with
+ * the description of the stream section the transfer is
+ * currently in: non-zero @inData means data follow, zero means
+ * a hole. In both cases @length is then set to the number of
+ * bytes remaining in the current section.
+ *
+ * Returns 0 on success, -1 upon error
+ */
+typedef int (*virStreamSourceHoleFunc)(virStreamPtr st,
+                                       int *inData,
+                                       long long *length,
+                                       void *opaque);
+
+/**
+ * virStreamSourceSkipFunc:
+ * @st: the stream object
+ * @length: stream hole size
+ * @opaque: optional application provided data
+ *
+ * This callback is used together with the virStreamSparseSendAll
+ * to skip holes in the underlying file as reported by
+ * virStreamSourceHoleFunc. The callback may be invoked multiple
+ * times and is expected to move the file pointer by @length
+ * bytes (e.g. using lseek() with SEEK_CUR).
+ *
+ * Returns 0 on success, -1 upon error
+ */
+typedef int (*virStreamSourceSkipFunc)(virStreamPtr st,
+                                       long long length,
+                                       void *opaque);
+
+int virStreamSparseSendAll(virStreamPtr st,
+                           virStreamSourceFunc handler,
+                           virStreamSourceHoleFunc holeHandler,
+                           virStreamSourceSkipFunc skipHandler,
+                           void *opaque);
+
 /**
  * virStreamSinkFunc:
  *
@@ -112,6 +178,29 @@ int virStreamRecvAll(virStreamPtr st,
                      virStreamSinkFunc handler,
                      void *opaque);
 
+/**
+ * virStreamSinkHoleFunc:
+ * @st: the stream object
+ * @length: stream hole size
+ * @opaque: optional application provided data
+ *
+ * This callback is used together with the virStreamSparseRecvAll
+ * function for libvirt to handle holes in the incoming stream.
+ * The application is expected to skip and/or zero out @length
+ * bytes in the file that the stream is being written into
+ * (e.g. using lseek() and ftruncate()).
+ *
+ * Returns 0 on success, -1 upon error
+ */
+typedef int (*virStreamSinkHoleFunc)(virStreamPtr st,
+                                     long long length,
+                                     void *opaque);
+
+int virStreamSparseRecvAll(virStreamPtr st,
+                           virStreamSinkFunc handler,
+                           virStreamSinkHoleFunc holeHandler,
+                           void *opaque);
+
 typedef enum {
     VIR_STREAM_EVENT_READABLE  = (1 << 0),
     VIR_STREAM_EVENT_WRITABLE  = (1 << 1),
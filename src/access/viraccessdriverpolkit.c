@@ -22,12 +22,16 @@
 
 #include "viraccessdriverpolkit.h"
 #include "viralloc.h"
+#include "virbuffer.h"
 #include "vircommand.h"
+#include "virhash.h"
 #include "virlog.h"
 #include "virprocess.h"
 #include "virerror.h"
 #include "virpolkit.h"
 #include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_ACCESS
 
@@ -46,9 +50,71 @@ struct _virAccessDriverPolkitPrivate {
     bool ignore;
 };
 
+/* How long a polkit decision may be served from memory.  Kept short
+ * on purpose: within the window a policy change is not picked up, but
+ * a burst of identical checks - e.g. one per domain during a bulk
+ * stats call - collapses into a single D-Bus round trip. */
+#define VIR_ACCESS_DRIVER_POLKIT_CACHE_TTL_MS 1000
+
+typedef struct _virAccessDriverPolkitDecision virAccessDriverPolkitDecision;
+typedef virAccessDriverPolkitDecision *virAccessDriverPolkitDecisionPtr;
+
+struct _virAccessDriverPolkitDecision {
+    unsigned long long fetched; /* ms timestamp of the polkitd query */
+    int result;                 /* 1 == allowed, 0 == denied */
+};
+
+static virMutex virAccessDriverPolkitCacheLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virAccessDriverPolkitCache;
+
+/* Key covering everything that can influence the decision: the
+ * action, the caller's identity and the object attributes. */
+static char *
+virAccessDriverPolkitCacheKey(const char *actionid,
+                              pid_t pid,
+                              unsigned long long startTime,
+                              uid_t uid,
+                              const char **attrs)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+
+    virBufferAsprintf(&buf, "%s|%lld|%llu|%u",
+                      actionid, (long long) pid, startTime,
+                      (unsigned int) uid);
+
+    while (attrs && attrs[0] && attrs[1]) {
+        virBufferAsprintf(&buf, "|%s=%s", attrs[0], attrs[1]);
+        attrs += 2;
+    }
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+/* virHashSearcher selecting entries whose TTL has lapsed.  Such an
+ * entry can only be served again if the very same process re-asks the
+ * same question, so dropping it costs at most one D-Bus round trip */
+static int
+virAccessDriverPolkitCacheExpired(const void *payload,
+                                  const void *name ATTRIBUTE_UNUSED,
+                                  const void *data)
+{
+    const virAccessDriverPolkitDecision *entry = payload;
+    unsigned long long now = *(const unsigned long long *)data;
+
+    return now - entry->fetched > VIR_ACCESS_DRIVER_POLKIT_CACHE_TTL_MS;
+}
+
 
 static void virAccessDriverPolkitCleanup(virAccessManagerPtr manager ATTRIBUTE_UNUSED)
 {
+    virMutexLock(&virAccessDriverPolkitCacheLock);
+    virHashFree(virAccessDriverPolkitCache);
+    virAccessDriverPolkitCache = NULL;
+    virMutexUnlock(&virAccessDriverPolkitCacheLock);
 }
 
 
@@ -119,6 +185,9 @@ virAccessDriverPolkitCheck(virAccessManagerPtr manager ATTRIBUTE_UNUSED,
                            const char **attrs)
 {
     char *actionid = NULL;
+    char *key = NULL;
+    virAccessDriverPolkitDecisionPtr entry;
+    unsigned long long now;
     int ret = -1;
     pid_t pid;
     uid_t uid;
@@ -137,6 +206,24 @@ virAccessDriverPolkitCheck(virAccessManagerPtr manager ATTRIBUTE_UNUSED,
     VIR_DEBUG("Check action '%s' for process '%lld' time %lld uid %d",
               actionid, (long long) pid, startTime, uid);
 
+    if (!(key = virAccessDriverPolkitCacheKey(actionid, pid,
+                                              startTime, uid, attrs)))
+        goto cleanup;
+
+    if (virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    virMutexLock(&virAccessDriverPolkitCacheLock);
+    if (virAccessDriverPolkitCache &&
+        (entry = virHashLookup(virAccessDriverPolkitCache, key)) &&
+        now - entry->fetched <= VIR_ACCESS_DRIVER_POLKIT_CACHE_TTL_MS) {
+        ret = entry->result;
+        virMutexUnlock(&virAccessDriverPolkitCacheLock);
+        VIR_DEBUG("Cached decision %d for action '%s'", ret, actionid);
+        goto cleanup;
+    }
+    virMutexUnlock(&virAccessDriverPolkitCacheLock);
+
     rv = virPolkitCheckAuth(actionid,
                             pid,
                             startTime,
@@ -154,7 +241,37 @@ virAccessDriverPolkitCheck(virAccessManagerPtr manager ATTRIBUTE_UNUSED,
         }
     }
 
+    /* Remember definite decisions; caching is best effort and must
+     * not turn an answered check into a failure */
+    if (ret >= 0) {
+        virMutexLock(&virAccessDriverPolkitCacheLock);
+        if (!virAccessDriverPolkitCache)
+            virAccessDriverPolkitCache = virHashCreate(32, virHashValueFree);
+        if (virAccessDriverPolkitCache) {
+            if ((entry = virHashLookup(virAccessDriverPolkitCache, key))) {
+                entry->fetched = now;
+                entry->result = ret;
+            } else if (VIR_ALLOC_QUIET(entry) >= 0) {
+                /* Keys embed the caller's pid and start time, so
+                 * entries for exited clients can never hit again;
+                 * sweep expired entries on every insert to stop the
+                 * table growing with client churn */
+                virHashRemoveSet(virAccessDriverPolkitCache,
+                                 virAccessDriverPolkitCacheExpired,
+                                 &now);
+                entry->fetched = now;
+                entry->result = ret;
+                if (virHashAddEntry(virAccessDriverPolkitCache,
+                                    key, entry) < 0)
+                    VIR_FREE(entry);
+            }
+        }
+        virMutexUnlock(&virAccessDriverPolkitCacheLock);
+        virResetLastError();
+    }
+
  cleanup:
+    VIR_FREE(key);
     VIR_FREE(actionid);
     return ret;
 }
@@ -21,6 +21,7 @@
  *
  */
 #include <config.h>
+#include <sys/stat.h>
 #include <sys/utsname.h>
 
 #include "viralloc.h"
@@ -132,11 +133,87 @@ virBhyveDomainCapsBuild(const char *emulatorbin,
     return caps;
 }
 
+/* The flags a binary supports only change when the binary itself does,
+ * so probe results can be remembered across daemon restarts keyed on
+ * the binary's mtime.  Cache files hold "<mtime> <flags>". */
+static char *
+virBhyveCapsCachePath(const char *name)
+{
+    char *path;
+
+    ignore_value(virAsprintf(&path, "%s/%s.caps", BHYVE_CACHE_DIR, name));
+    return path;
+}
+
+static int
+virBhyveCapsCacheLoad(const char *binary, const char *name,
+                      unsigned int *flags)
+{
+    char *path = NULL;
+    char *content = NULL;
+    char *next;
+    struct stat sb;
+    unsigned long long mtime;
+    int ret = -1;
+
+    if (stat(binary, &sb) < 0)
+        goto cleanup;
+
+    if (!(path = virBhyveCapsCachePath(name)))
+        goto cleanup;
+
+    if (virFileReadAllQuiet(path, 1024, &content) < 0)
+        goto cleanup;
+
+    if (virStrToLong_ull(content, &next, 10, &mtime) < 0 ||
+        *next != ' ' ||
+        virStrToLong_ui(next + 1, NULL, 10, flags) < 0)
+        goto cleanup;
+
+    /* A binary update invalidates the cached flags */
+    if (mtime != (unsigned long long) sb.st_mtime)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(content);
+    VIR_FREE(path);
+    return ret;
+}
+
+static void
+virBhyveCapsCacheSave(const char *binary, const char *name,
+                      unsigned int flags)
+{
+    char *path = NULL;
+    char *content = NULL;
+    struct stat sb;
+
+    if (stat(binary, &sb) < 0)
+        return;
+
+    if (!(path = virBhyveCapsCachePath(name)) ||
+        virAsprintf(&content, "%llu %u\n",
+                    (unsigned long long) sb.st_mtime, flags) < 0)
+        goto cleanup;
+
+    /* Failure to save merely means re-probing on the next start */
+    if (virFileMakePath(BHYVE_CACHE_DIR) < 0 ||
+        virFileWriteStr(path, content, 0600) < 0)
+        VIR_WARN("Failed to save capabilities cache %s", path);
+
+ cleanup:
+    VIR_FREE(content);
+    VIR_FREE(path);
+}
+
 int
 virBhyveProbeGrubCaps(virBhyveGrubCapsFlags *caps)
 {
     char *binary, *help;
     virCommandPtr cmd;
+    unsigned int flags;
     int ret, exit;
 
     ret = 0;
@@ -150,6 +227,11 @@ virBhyveProbeGrubCaps(virBhyveGrubCapsFlags *caps)
     if (!virFileIsExecutable(binary))
         goto out;
 
+    if (virBhyveCapsCacheLoad(binary, "grub-bhyve", &flags) == 0) {
+        *caps = flags;
+        goto out;
+    }
+
     cmd = virCommandNew(binary);
     virCommandAddArg(cmd, "--help");
     virCommandSetOutputBuffer(cmd, &help);
@@ -161,6 +243,8 @@ virBhyveProbeGrubCaps(virBhyveGrubCapsFlags *caps)
     if (strstr(help, "--cons-dev") != NULL)
         *caps |= BHYVE_GRUB_CAP_CONSDEV;
 
+    virBhyveCapsCacheSave(binary, "grub-bhyve", *caps);
+
  out:
     VIR_FREE(help);
     virCommandFree(cmd);
@@ -171,7 +255,7 @@ virBhyveProbeGrubCaps(virBhyveGrubCapsFlags *caps)
 int
 virBhyveProbeCaps(unsigned int *caps)
 {
-    char *binary, *help;
+    char *binary, *help = NULL;
     virCommandPtr cmd = NULL;
     int ret = 0, exit;
 
@@ -181,6 +265,9 @@ virBhyveProbeCaps(unsigned int *caps)
     if (!virFileIsExecutable(binary))
         goto out;
 
+    if (virBhyveCapsCacheLoad(binary, "bhyve", caps) == 0)
+        goto out;
+
     cmd = virCommandNew(binary);
     virCommandAddArg(cmd, "-h");
     virCommandSetErrorBuffer(cmd, &help);
@@ -192,6 +279,8 @@ virBhyveProbeCaps(unsigned int *caps)
     if (strstr(help, "-u:") != NULL)
         *caps |= BHYVE_CAP_RTC_UTC;
 
+    virBhyveCapsCacheSave(binary, "bhyve", *caps);
+
  out:
     VIR_FREE(help);
     virCommandFree(cmd);
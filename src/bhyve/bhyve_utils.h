@@ -33,6 +33,7 @@
 # define BHYVE_CONFIG_DIR       SYSCONFDIR "/libvirt/bhyve"
 # define BHYVE_STATE_DIR        LOCALSTATEDIR "/run/libvirt/bhyve"
 # define BHYVE_LOG_DIR          LOCALSTATEDIR "/log/libvirt/bhyve"
+# define BHYVE_CACHE_DIR        LOCALSTATEDIR "/cache/libvirt/bhyve"
 
 struct _bhyveConn {
     virMutex lock;
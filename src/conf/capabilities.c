@@ -77,6 +77,11 @@ virCapabilitiesNew(virArch hostarch,
     if (!(caps = virObjectNew(virCapsClass)))
         return NULL;
 
+    if (virMutexInit(&caps->lock) < 0) {
+        virObjectUnref(caps);
+        return NULL;
+    }
+
     caps->host.arch = hostarch;
     caps->host.offlineMigrate = offlineMigrate;
     caps->host.liveMigrate = liveMigrate;
@@ -224,6 +229,9 @@ virCapabilitiesDispose(void *object)
     VIR_FREE(caps->host.netprefix);
     VIR_FREE(caps->host.pagesSize);
     virCPUDefFree(caps->host.cpu);
+
+    VIR_FREE(caps->xmlCache);
+    virMutexDestroy(&caps->lock);
 }
 
 /**
@@ -844,16 +852,8 @@ virCapabilitiesFormatNUMATopology(virBufferPtr buf,
     return 0;
 }
 
-/**
- * virCapabilitiesFormatXML:
- * @caps: capabilities to format
- *
- * Convert the capabilities object into an XML representation
- *
- * Returns the XML document as a string
- */
-char *
-virCapabilitiesFormatXML(virCapsPtr caps)
+static char *
+virCapabilitiesFormatXMLInternal(virCapsPtr caps)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
     size_t i, j, k;
@@ -1057,6 +1057,33 @@ virCapabilitiesFormatXML(virCapsPtr caps)
     return virBufferContentAndReset(&buf);
 }
 
+/**
+ * virCapabilitiesFormatXML:
+ * @caps: capabilities to format
+ *
+ * Convert the capabilities object into an XML representation
+ *
+ * The capabilities object is immutable once it has been handed out by
+ * a driver, and drivers re-probe by building a replacement object, so
+ * the formatted document is cached in @caps and later calls just copy
+ * it out.
+ *
+ * Returns the XML document as a string
+ */
+char *
+virCapabilitiesFormatXML(virCapsPtr caps)
+{
+    char *xml = NULL;
+
+    virMutexLock(&caps->lock);
+    if (!caps->xmlCache)
+        caps->xmlCache = virCapabilitiesFormatXMLInternal(caps);
+    ignore_value(VIR_STRDUP(xml, caps->xmlCache));
+    virMutexUnlock(&caps->lock);
+
+    return xml;
+}
+
 /* get the maximum ID of cpus in the host */
 static unsigned int
 virCapabilitiesGetHostMaxcpu(virCapsPtr caps)
@@ -30,6 +30,7 @@
 # include "virarch.h"
 # include "virmacaddr.h"
 # include "virobject.h"
+# include "virthread.h"
 
 # include <libxml/xpath.h>
 
@@ -191,6 +192,10 @@ struct _virCaps {
     size_t nguests;
     size_t nguests_max;
     virCapsGuestPtr *guests;
+
+    /* lazily formatted capabilities document, protected by @lock */
+    virMutex lock;
+    char *xmlCache;
 };
 
 typedef struct _virCapsDomainData virCapsDomainData;
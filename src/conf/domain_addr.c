@@ -23,11 +23,16 @@
 
 #include <config.h>
 
+#include <strings.h>
+
 #include "viralloc.h"
 #include "virlog.h"
 #include "virstring.h"
 #include "domain_addr.h"
 
+/* the per-bus slotsInUse bitmap must cover every slot */
+verify(VIR_PCI_ADDRESS_SLOT_LAST < 32);
+
 #define VIR_FROM_THIS VIR_FROM_DOMAIN
 
 VIR_LOG_INIT("conf.domain_addr");
@@ -441,6 +446,7 @@ virDomainPCIAddressReserveAddr(virDomainPCIAddressSetPtr addrs,
             goto cleanup;
         }
         bus->slots[addr->slot] = 0xFF; /* reserve all functions of slot */
+        bus->slotsInUse |= 1U << addr->slot;
         VIR_DEBUG("Reserving PCI slot %s (multifunction='off')", addrStr);
     } else {
         if (bus->slots[addr->slot] & (1 << addr->function)) {
@@ -457,6 +463,7 @@ virDomainPCIAddressReserveAddr(virDomainPCIAddressSetPtr addrs,
             goto cleanup;
         }
         bus->slots[addr->slot] |= (1 << addr->function);
+        bus->slotsInUse |= 1U << addr->slot;
         VIR_DEBUG("Reserving PCI address %s", addrStr);
     }
 
@@ -522,7 +529,11 @@ int
 virDomainPCIAddressReleaseAddr(virDomainPCIAddressSetPtr addrs,
                                virPCIDeviceAddressPtr addr)
 {
-    addrs->buses[addr->bus].slots[addr->slot] &= ~(1 << addr->function);
+    virDomainPCIAddressBusPtr bus = &addrs->buses[addr->bus];
+
+    bus->slots[addr->slot] &= ~(1 << addr->function);
+    if (!bus->slots[addr->slot])
+        bus->slotsInUse &= ~(1U << addr->slot);
     return 0;
 }
 
@@ -544,6 +555,7 @@ virDomainPCIAddressReleaseSlot(virDomainPCIAddressSetPtr addrs,
         goto cleanup;
 
     addrs->buses[addr->bus].slots[addr->slot] = 0;
+    addrs->buses[addr->bus].slotsInUse &= ~(1U << addr->slot);
     ret = 0;
  cleanup:
     VIR_FREE(addrStr);
@@ -582,6 +594,34 @@ virDomainPCIAddressSetFree(virDomainPCIAddressSetPtr addrs)
 }
 
 
+/*
+ * Find the first free slot on @bus at or after @slot by doing a
+ * find-first-zero on the bus's slot occupancy bitmap.
+ *
+ * Returns the slot number, or -1 if the bus has no free slot left.
+ */
+static int
+virDomainPCIAddressBusFindFreeSlot(virDomainPCIAddressBusPtr bus,
+                                   size_t slot)
+{
+    uint32_t candidates;
+
+    if (slot < bus->minSlot)
+        slot = bus->minSlot;
+    if (slot > bus->maxSlot)
+        return -1;
+
+    /* every slot in [slot, maxSlot] with no function in use yet */
+    candidates = ~bus->slotsInUse & (~0U << slot);
+    if (bus->maxSlot < VIR_PCI_ADDRESS_SLOT_LAST)
+        candidates &= (1U << (bus->maxSlot + 1)) - 1;
+
+    if (!candidates)
+        return -1;
+
+    return ffs(candidates) - 1;
+}
+
 int
 virDomainPCIAddressGetNextSlot(virDomainPCIAddressSetPtr addrs,
                                virPCIDeviceAddressPtr next_addr,
@@ -622,14 +662,15 @@ virDomainPCIAddressGetNextSlot(virDomainPCIAddressSetPtr addrs,
             VIR_DEBUG("PCI bus %.4x:%.2x is not compatible with the device",
                       a.domain, a.bus);
         } else {
-            while (a.slot <= addrs->buses[a.bus].maxSlot) {
-                if (!virDomainPCIAddressSlotInUse(addrs, &a))
-                    goto success;
+            int slot = virDomainPCIAddressBusFindFreeSlot(&addrs->buses[a.bus],
+                                                          a.slot);
 
-                VIR_DEBUG("PCI slot %.4x:%.2x:%.2x already in use",
-                          a.domain, a.bus, a.slot);
-                a.slot++;
+            if (slot >= 0) {
+                a.slot = slot;
+                goto success;
             }
+            VIR_DEBUG("PCI bus %.4x:%.2x has no free slot left",
+                      a.domain, a.bus);
         }
         if (++a.bus < addrs->nbuses)
             a.slot = addrs->buses[a.bus].minSlot;
@@ -656,14 +697,15 @@ virDomainPCIAddressGetNextSlot(virDomainPCIAddressSetPtr addrs,
                 VIR_DEBUG("PCI bus %.4x:%.2x is not compatible with the device",
                           a.domain, a.bus);
             } else {
-                while (a.slot <= addrs->buses[a.bus].maxSlot) {
-                    if (!virDomainPCIAddressSlotInUse(addrs, &a))
-                        goto success;
+                int slot = virDomainPCIAddressBusFindFreeSlot(&addrs->buses[a.bus],
+                                                              a.slot);
 
-                    VIR_DEBUG("PCI slot %.4x:%.2x:%.2x already in use",
-                              a.domain, a.bus, a.slot);
-                    a.slot++;
+                if (slot >= 0) {
+                    a.slot = slot;
+                    goto success;
                 }
+                VIR_DEBUG("PCI bus %.4x:%.2x has no free slot left",
+                          a.domain, a.bus);
             }
         }
     }
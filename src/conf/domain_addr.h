@@ -79,6 +79,11 @@ typedef struct {
      * bit is set, that function is in use by a device.
      */
     uint8_t slots[VIR_PCI_ADDRESS_SLOT_LAST + 1];
+    /* A bitmap over the slots array for quick find-first-free
+     * lookups; bit N is set whenever slots[N] has any function in
+     * use.
+     */
+    uint32_t slotsInUse;
 } virDomainPCIAddressBus;
 typedef virDomainPCIAddressBus *virDomainPCIAddressBusPtr;
 
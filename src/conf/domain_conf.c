@@ -1315,8 +1315,56 @@ void virDomainLeaseDefFree(virDomainLeaseDefPtr def)
 }
 
 
+/**
+ * virDomainDefArenaAlloc:
+ * @def: domain definition the memory belongs to
+ * @size: number of bytes to allocate
+ *
+ * Allocate zeroed memory living exactly as long as @def; it is
+ * released wholesale by virDomainDefFree with no individual free.
+ * Must not be used for fields that other code frees or reallocates
+ * on its own.
+ *
+ * Returns the allocation, or NULL with the error reported.
+ */
+void *
+virDomainDefArenaAlloc(virDomainDefPtr def, size_t size)
+{
+    if (!def->arena &&
+        !(def->arena = virAllocPoolNew(0)))
+        return NULL;
+
+    return virAllocPoolAlloc(def->arena, size);
+}
+
+
+/**
+ * virDomainDefArenaStrdup:
+ * @def: domain definition the string belongs to
+ * @src: string to duplicate, may be NULL
+ *
+ * Duplicate @src into memory owned by @def's arena. See
+ * virDomainDefArenaAlloc for the ownership rules.
+ *
+ * Returns the copy, or NULL if @src was NULL or on OOM (reported).
+ */
+char *
+virDomainDefArenaStrdup(virDomainDefPtr def, const char *src)
+{
+    if (!src)
+        return NULL;
+
+    if (!def->arena &&
+        !(def->arena = virAllocPoolNew(0)))
+        return NULL;
+
+    return virAllocPoolStrdup(def->arena, src);
+}
+
+
 static virDomainVcpuDefPtr
-virDomainVcpuDefNew(virDomainXMLOptionPtr xmlopt)
+virDomainVcpuDefNew(virDomainDefPtr def,
+                    virDomainXMLOptionPtr xmlopt)
 {
     virObjectPtr priv = NULL;
     virDomainVcpuDefPtr ret = NULL;
@@ -1325,7 +1373,7 @@ virDomainVcpuDefNew(virDomainXMLOptionPtr xmlopt)
         !(priv = xmlopt->privateData.vcpuNew()))
         goto cleanup;
 
-    if (VIR_ALLOC(ret) < 0)
+    if (!(ret = virDomainDefArenaAlloc(def, sizeof(*ret))))
         goto cleanup;
 
     ret->privateData = priv;
@@ -1338,7 +1386,8 @@ virDomainVcpuDefNew(virDomainXMLOptionPtr xmlopt)
 
 
 static void
-virDomainVcpuDefFree(virDomainVcpuDefPtr info)
+virDomainVcpuDefFree(virDomainDefPtr def,
+                     virDomainVcpuDefPtr info)
 {
     if (!info)
         return;
@@ -1346,7 +1395,7 @@ virDomainVcpuDefFree(virDomainVcpuDefPtr info)
     virBitmapFree(info->cpumask);
     info->cpumask = NULL;
     virObjectUnref(info->privateData);
-    VIR_FREE(info);
+    virAllocPoolRecycle(def->arena, info, sizeof(*info));
 }
 
 
@@ -1366,12 +1415,12 @@ virDomainDefSetVcpusMax(virDomainDefPtr def,
             return -1;
 
         for (i = oldmax; i < def->maxvcpus; i++) {
-            if (!(def->vcpus[i] = virDomainVcpuDefNew(xmlopt)))
+            if (!(def->vcpus[i] = virDomainVcpuDefNew(def, xmlopt)))
                 return -1;
         }
     } else {
         for (i = maxvcpus; i < def->maxvcpus; i++)
-            virDomainVcpuDefFree(def->vcpus[i]);
+            virDomainVcpuDefFree(def, def->vcpus[i]);
 
         VIR_SHRINK_N(def->vcpus, def->maxvcpus, def->maxvcpus - maxvcpus);
     }
@@ -2576,6 +2625,7 @@ virDomainLoaderDefFree(virDomainLoaderDefPtr loader)
 
 void virDomainDefFree(virDomainDefPtr def)
 {
+    virAllocPoolPtr arena;
     size_t i;
 
     if (!def)
@@ -2584,7 +2634,7 @@ void virDomainDefFree(virDomainDefPtr def)
     virDomainResourceDefFree(def->resource);
 
     for (i = 0; i < def->maxvcpus; i++)
-        virDomainVcpuDefFree(def->vcpus[i]);
+        virDomainVcpuDefFree(def, def->vcpus[i]);
     VIR_FREE(def->vcpus);
 
     /* hostdevs must be freed before nets (or any future "intelligent
@@ -2744,7 +2794,9 @@ void virDomainDefFree(virDomainDefPtr def)
 
     xmlFreeNode(def->metadata);
 
+    arena = def->arena;
     VIR_FREE(def);
+    virAllocPoolFree(arena);
 }
 
 static void virDomainObjDispose(void *obj)
@@ -2760,6 +2812,7 @@ static void virDomainObjDispose(void *obj)
         (dom->privateDataFreeFunc)(dom->privateData);
 
     virDomainSnapshotObjListFree(dom->snapshots);
+    VIR_FREE(dom->statusXMLCache);
 }
 
 virDomainObjPtr
@@ -2835,7 +2888,7 @@ virDomainDefNewFull(const char *name,
         return NULL;
 
     if (VIR_STRDUP(def->name, name) < 0) {
-        VIR_FREE(def);
+        virDomainDefFree(def);
         return NULL;
     }
 
@@ -8740,6 +8793,7 @@ virDomainActualNetDefParseXML(xmlNodePtr node,
     xmlNodePtr bandwidth_node = NULL;
     xmlNodePtr vlanNode;
     xmlNodePtr virtPortNode;
+    xmlNodePtr source_node;
     char *type = NULL;
     char *mode = NULL;
     char *addrtype = NULL;
@@ -8828,9 +8882,10 @@ virDomainActualNetDefParseXML(xmlNodePtr node,
          * passed in as a string, since it is in a different place in
          * NetDef vs HostdevDef.
          */
-        addrtype = virXPathString("string(./source/address/@type)", ctxt);
+        source_node = virXMLChildNode(node, "source");
+        addrtype = virXMLChildPropString(source_node, "address", "type");
         /* if not explicitly stated, source/vendor implies usb device */
-        if (!addrtype && virXPathNode("./source/vendor", ctxt) &&
+        if (!addrtype && virXMLChildNode(source_node, "vendor") &&
             VIR_STRDUP(addrtype, "usb") < 0)
             goto error;
         hostdev->mode = VIR_DOMAIN_HOSTDEV_MODE_SUBSYS;
@@ -8942,6 +8997,7 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
     virDomainNetDefPtr def;
     virDomainHostdevDefPtr hostdev;
     xmlNodePtr cur;
+    xmlNodePtr source_node;
     char *macaddr = NULL;
     char *type = NULL;
     char *network = NULL;
@@ -9097,11 +9153,8 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
                 address = virXMLPropString(cur, "address");
                 port = virXMLPropString(cur, "port");
                 if (!localaddr && def->type == VIR_DOMAIN_NET_TYPE_UDP) {
-                    xmlNodePtr tmpnode = ctxt->node;
-                    ctxt->node = cur;
-                    localaddr = virXPathString("string(./local/@address)", ctxt);
-                    localport = virXPathString("string(./local/@port)", ctxt);
-                    ctxt->node = tmpnode;
+                    localaddr = virXMLChildPropString(cur, "local", "address");
+                    localport = virXMLChildPropString(cur, "local", "port");
                 }
             } else if (!ifname &&
                        xmlStrEqual(cur->name, BAD_CAST "target")) {
@@ -9405,9 +9458,10 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
          * passed in as a string, since it is in a different place in
          * NetDef vs HostdevDef.
          */
-        addrtype = virXPathString("string(./source/address/@type)", ctxt);
+        source_node = virXMLChildNode(node, "source");
+        addrtype = virXMLChildPropString(source_node, "address", "type");
         /* if not explicitly stated, source/vendor implies usb device */
-        if (!addrtype && virXPathNode("./source/vendor", ctxt) &&
+        if (!addrtype && virXMLChildNode(source_node, "vendor") &&
             VIR_STRDUP(addrtype, "usb") < 0)
             goto error;
         hostdev->mode = VIR_DOMAIN_HOSTDEV_MODE_SUBSYS;
@@ -9466,6 +9520,10 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
 
     if (def->type != VIR_DOMAIN_NET_TYPE_HOSTDEV &&
         STREQ_NULLABLE(def->model, "virtio")) {
+        xmlNodePtr driver_node = virXMLChildNode(node, "driver");
+        xmlNodePtr host_node = virXMLChildNode(driver_node, "host");
+        xmlNodePtr guest_node = virXMLChildNode(driver_node, "guest");
+
         if (backend != NULL) {
             if ((val = virDomainNetBackendTypeFromString(backend)) < 0 ||
                 val == VIR_DOMAIN_NET_BACKEND_TYPE_DEFAULT) {
@@ -9517,7 +9575,7 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
             if (q > 1)
                 def->driver.virtio.queues = q;
         }
-        if ((str = virXPathString("string(./driver/host/@csum)", ctxt))) {
+        if ((str = virXMLPropString(host_node, "csum"))) {
             if ((val = virTristateSwitchTypeFromString(str)) <= 0) {
                 virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
                                _("unknown host csum mode '%s'"),
@@ -9527,7 +9585,7 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
             def->driver.virtio.host.csum = val;
         }
         VIR_FREE(str);
-        if ((str = virXPathString("string(./driver/host/@gso)", ctxt))) {
+        if ((str = virXMLPropString(host_node, "gso"))) {
             if ((val = virTristateSwitchTypeFromString(str)) <= 0) {
                 virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
                                _("unknown host gso mode '%s'"),
@@ -9537,7 +9595,7 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
             def->driver.virtio.host.gso = val;
         }
         VIR_FREE(str);
-        if ((str = virXPathString("string(./driver/host/@tso4)", ctxt))) {
+        if ((str = virXMLPropString(host_node, "tso4"))) {
             if ((val = virTristateSwitchTypeFromString(str)) <= 0) {
                 virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
                                _("unknown host tso4 mode '%s'"),
@@ -9547,7 +9605,7 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
             def->driver.virtio.host.tso4 = val;
         }
         VIR_FREE(str);
-        if ((str = virXPathString("string(./driver/host/@tso6)", ctxt))) {
+        if ((str = virXMLPropString(host_node, "tso6"))) {
             if ((val = virTristateSwitchTypeFromString(str)) <= 0) {
                 virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
                                _("unknown host tso6 mode '%s'"),
@@ -9557,7 +9615,7 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
             def->driver.virtio.host.tso6 = val;
         }
         VIR_FREE(str);
-        if ((str = virXPathString("string(./driver/host/@ecn)", ctxt))) {
+        if ((str = virXMLPropString(host_node, "ecn"))) {
             if ((val = virTristateSwitchTypeFromString(str)) <= 0) {
                 virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
                                _("unknown host ecn mode '%s'"),
@@ -9567,7 +9625,7 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
             def->driver.virtio.host.ecn = val;
         }
         VIR_FREE(str);
-        if ((str = virXPathString("string(./driver/host/@ufo)", ctxt))) {
+        if ((str = virXMLPropString(host_node, "ufo"))) {
             if ((val = virTristateSwitchTypeFromString(str)) <= 0) {
                 virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
                                _("unknown host ufo mode '%s'"),
@@ -9577,7 +9635,7 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
             def->driver.virtio.host.ufo = val;
         }
         VIR_FREE(str);
-        if ((str = virXPathString("string(./driver/host/@mrg_rxbuf)", ctxt))) {
+        if ((str = virXMLPropString(host_node, "mrg_rxbuf"))) {
             if ((val = virTristateSwitchTypeFromString(str)) <= 0) {
                 virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
                                _("unknown host mrg_rxbuf mode '%s'"),
@@ -9587,7 +9645,7 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
             def->driver.virtio.host.mrg_rxbuf = val;
         }
         VIR_FREE(str);
-        if ((str = virXPathString("string(./driver/guest/@csum)", ctxt))) {
+        if ((str = virXMLPropString(guest_node, "csum"))) {
             if ((val = virTristateSwitchTypeFromString(str)) <= 0) {
                 virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
                                _("unknown guest csum mode '%s'"),
@@ -9597,7 +9655,7 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
             def->driver.virtio.guest.csum = val;
         }
         VIR_FREE(str);
-        if ((str = virXPathString("string(./driver/guest/@tso4)", ctxt))) {
+        if ((str = virXMLPropString(guest_node, "tso4"))) {
             if ((val = virTristateSwitchTypeFromString(str)) <= 0) {
                 virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
                                _("unknown guest tso4 mode '%s'"),
@@ -9607,7 +9665,7 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
             def->driver.virtio.guest.tso4 = val;
         }
         VIR_FREE(str);
-        if ((str = virXPathString("string(./driver/guest/@tso6)", ctxt))) {
+        if ((str = virXMLPropString(guest_node, "tso6"))) {
             if ((val = virTristateSwitchTypeFromString(str)) <= 0) {
                 virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
                                _("unknown guest tso6 mode '%s'"),
@@ -9617,7 +9675,7 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
             def->driver.virtio.guest.tso6 = val;
         }
         VIR_FREE(str);
-        if ((str = virXPathString("string(./driver/guest/@ecn)", ctxt))) {
+        if ((str = virXMLPropString(guest_node, "ecn"))) {
             if ((val = virTristateSwitchTypeFromString(str)) <= 0) {
                 virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
                                _("unknown guest ecn mode '%s'"),
@@ -9627,7 +9685,7 @@ virDomainNetDefParseXML(virDomainXMLOptionPtr xmlopt,
             def->driver.virtio.guest.ecn = val;
         }
         VIR_FREE(str);
-        if ((str = virXPathString("string(./driver/guest/@ufo)", ctxt))) {
+        if ((str = virXMLPropString(guest_node, "ufo"))) {
             if ((val = virTristateSwitchTypeFromString(str)) <= 0) {
                 virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
                                _("unknown guest ufo mode '%s'"),
@@ -19924,7 +19982,7 @@ virDomainDiskBackingStoreFormat(virBufferPtr buf,
 }
 
 
-static int
+int
 virDomainDiskDefFormat(virBufferPtr buf,
                        virDomainDiskDefPtr def,
                        unsigned int flags)
@@ -24165,9 +24223,29 @@ virDomainSaveStatus(virDomainXMLOptionPtr xmlopt,
     if (!(xml = virDomainObjFormat(xmlopt, obj, caps, flags)))
         goto cleanup;
 
+    /* Guest events often trigger several saves in a row without
+     * actually changing the status; skip rewriting the file when the
+     * document matches what was last written and is still there */
+    if (statusDir &&
+        obj->statusXMLCache &&
+        STREQ(obj->statusXMLCache, xml)) {
+        char *statusFile = virDomainConfigFile(statusDir, obj->def->name);
+        bool skip = statusFile && virFileExists(statusFile);
+
+        VIR_FREE(statusFile);
+        if (skip) {
+            ret = 0;
+            goto cleanup;
+        }
+    }
+
     if (virDomainSaveXML(statusDir, obj->def, xml))
         goto cleanup;
 
+    VIR_FREE(obj->statusXMLCache);
+    obj->statusXMLCache = xml;
+    xml = NULL;
+
     ret = 0;
  cleanup:
     VIR_FREE(xml);
@@ -24519,7 +24597,12 @@ virDomainDefCopy(virDomainDefPtr src,
     char *xml;
     virDomainDefPtr ret;
     unsigned int format_flags = VIR_DOMAIN_DEF_FORMAT_SECURE;
+    /* @src went through the post-parse machinery when it was first
+     * created, so the formatted XML always carries the resolved os
+     * type/arch/machine; skip the capabilities lookup that would only
+     * re-derive them on the way back in */
     unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                               VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
                                VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
 
     if (migratable)
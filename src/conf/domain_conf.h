@@ -45,6 +45,7 @@
 # include "virnetdevvportprofile.h"
 # include "virnetdevbandwidth.h"
 # include "virnetdevvlan.h"
+# include "viralloc.h"
 # include "virobject.h"
 # include "device_conf.h"
 # include "virbitmap.h"
@@ -2272,6 +2273,12 @@ struct _virDomainDef {
 
     /* Application-specific custom metadata */
     xmlNodePtr metadata;
+
+    /* Arena owning small allocations tied to the lifetime of this
+     * def; released wholesale by virDomainDefFree. Allocate from it
+     * via virDomainDefArenaAlloc/virDomainDefArenaStrdup only for
+     * memory that is never individually freed elsewhere. */
+    virAllocPoolPtr arena;
 };
 
 
@@ -2338,6 +2345,10 @@ struct _virDomainObj {
 
     unsigned long long original_memlock; /* Original RLIMIT_MEMLOCK, zero if no
                                           * restore will be required later */
+
+    char *statusXMLCache; /* status XML as last written by
+                           * virDomainSaveStatus, used to skip
+                           * rewriting an unchanged file */
 };
 
 typedef bool (*virDomainObjListACLFilter)(virConnectPtr conn,
@@ -2570,6 +2581,11 @@ virDomainDefPtr virDomainDefNewFull(const char *name,
                                     const unsigned char *uuid,
                                     int id);
 
+void *virDomainDefArenaAlloc(virDomainDefPtr def, size_t size)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+char *virDomainDefArenaStrdup(virDomainDefPtr def, const char *src)
+    ATTRIBUTE_NONNULL(1);
+
 void virDomainObjAssignDef(virDomainObjPtr domain,
                            virDomainDefPtr def,
                            bool live,
@@ -2719,6 +2735,10 @@ int virDomainDiskSourceFormat(virBufferPtr buf,
                               int policy,
                               unsigned int flags);
 
+int virDomainDiskDefFormat(virBufferPtr buf,
+                           virDomainDiskDefPtr def,
+                           unsigned int flags);
+
 int virDomainNetDefFormat(virBufferPtr buf,
                           virDomainNetDefPtr def,
                           char *prefix,
@@ -2245,3 +2245,44 @@ virDomainQemuMonitorEventStateRegisterID(virConnectPtr conn,
                                          data, freecb,
                                          false, callbackID, false);
 }
+
+
+/**
+ * virDomainEventStateIsEnabled:
+ * @state: object event state
+ * @eventID: ID of the event type to check
+ *
+ * Check whether any consumer is registered for domain events of the
+ * given type, allowing drivers to skip building events that would
+ * only be thrown away.
+ *
+ * Returns true if the event type has at least one consumer
+ */
+bool
+virDomainEventStateIsEnabled(virObjectEventStatePtr state,
+                             int eventID)
+{
+    if (virDomainEventsInitialize() < 0)
+        return true;
+
+    return virObjectEventStateIsEnabled(state, virDomainEventClass, eventID);
+}
+
+
+/**
+ * virDomainQemuMonitorEventStateIsEnabled:
+ * @state: object event state
+ *
+ * Same as virDomainEventStateIsEnabled, but checking for consumers
+ * of raw qemu monitor events.
+ *
+ * Returns true if at least one consumer is registered
+ */
+bool
+virDomainQemuMonitorEventStateIsEnabled(virObjectEventStatePtr state)
+{
+    if (virDomainEventsInitialize() < 0)
+        return true;
+
+    return virObjectEventStateIsEnabled(state, virDomainQemuMonitorEventClass, 0);
+}
@@ -302,4 +302,11 @@ virDomainQemuMonitorEventNew(int id,
                              const char *details)
     ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3) ATTRIBUTE_NONNULL(4);
 
+bool
+virDomainEventStateIsEnabled(virObjectEventStatePtr state,
+                             int eventID);
+
+bool
+virDomainQemuMonitorEventStateIsEnabled(virObjectEventStatePtr state);
+
 #endif
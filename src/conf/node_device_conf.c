@@ -92,11 +92,55 @@ int virNodeDeviceHasCap(const virNodeDeviceObj *dev, const char *cap)
 }
 
 
+/* Index a device in the lookup tables. The tables are only a cache in
+ * front of the flat array and lookups fall back to a linear scan on a
+ * miss, so failure to index (OOM) is silently ignored. */
+static void
+virNodeDeviceObjIndexAdd(virNodeDeviceObjListPtr devs,
+                         virNodeDeviceObjPtr device)
+{
+    if (!devs->names &&
+        !(devs->names = virHashCreate(50, NULL)))
+        virResetLastError();
+    if (devs->names &&
+        virHashUpdateEntry(devs->names, device->def->name, device) < 0)
+        virResetLastError();
+
+    if (!device->def->sysfs_path)
+        return;
+
+    if (!devs->sysfsPaths &&
+        !(devs->sysfsPaths = virHashCreate(50, NULL)))
+        virResetLastError();
+    if (devs->sysfsPaths &&
+        virHashUpdateEntry(devs->sysfsPaths,
+                           device->def->sysfs_path, device) < 0)
+        virResetLastError();
+}
+
+static void
+virNodeDeviceObjIndexRemove(virNodeDeviceObjListPtr devs,
+                            virNodeDeviceObjPtr device)
+{
+    if (devs->names)
+        ignore_value(virHashRemoveEntry(devs->names, device->def->name));
+    if (devs->sysfsPaths && device->def->sysfs_path)
+        ignore_value(virHashRemoveEntry(devs->sysfsPaths,
+                                        device->def->sysfs_path));
+}
+
 virNodeDeviceObjPtr
 virNodeDeviceFindBySysfsPath(virNodeDeviceObjListPtr devs,
                              const char *sysfs_path)
 {
     size_t i;
+    virNodeDeviceObjPtr device;
+
+    if (devs->sysfsPaths &&
+        (device = virHashLookup(devs->sysfsPaths, sysfs_path))) {
+        virNodeDeviceObjLock(device);
+        return device;
+    }
 
     for (i = 0; i < devs->count; i++) {
         virNodeDeviceObjLock(devs->objs[i]);
@@ -115,6 +159,13 @@ virNodeDeviceObjPtr virNodeDeviceFindByName(virNodeDeviceObjListPtr devs,
                                             const char *name)
 {
     size_t i;
+    virNodeDeviceObjPtr device;
+
+    if (devs->names &&
+        (device = virHashLookup(devs->names, name))) {
+        virNodeDeviceObjLock(device);
+        return device;
+    }
 
     for (i = 0; i < devs->count; i++) {
         virNodeDeviceObjLock(devs->objs[i]);
@@ -171,6 +222,10 @@ void virNodeDeviceObjListFree(virNodeDeviceObjListPtr devs)
         virNodeDeviceObjFree(devs->objs[i]);
     VIR_FREE(devs->objs);
     devs->count = 0;
+    virHashFree(devs->names);
+    devs->names = NULL;
+    virHashFree(devs->sysfsPaths);
+    devs->sysfsPaths = NULL;
 }
 
 virNodeDeviceObjPtr virNodeDeviceAssignDef(virNodeDeviceObjListPtr devs,
@@ -179,8 +234,10 @@ virNodeDeviceObjPtr virNodeDeviceAssignDef(virNodeDeviceObjListPtr devs,
     virNodeDeviceObjPtr device;
 
     if ((device = virNodeDeviceFindByName(devs, def->name))) {
+        virNodeDeviceObjIndexRemove(devs, device);
         virNodeDeviceDefFree(device->def);
         device->def = def;
+        virNodeDeviceObjIndexAdd(devs, device);
         return device;
     }
 
@@ -201,6 +258,7 @@ virNodeDeviceObjPtr virNodeDeviceAssignDef(virNodeDeviceObjListPtr devs,
         return NULL;
     }
     device->def = def;
+    virNodeDeviceObjIndexAdd(devs, device);
 
     return device;
 
@@ -217,6 +275,7 @@ void virNodeDeviceObjRemove(virNodeDeviceObjListPtr devs,
         virNodeDeviceObjLock(*dev);
         if (devs->objs[i] == *dev) {
             virNodeDeviceObjUnlock(*dev);
+            virNodeDeviceObjIndexRemove(devs, devs->objs[i]);
             virNodeDeviceObjFree(devs->objs[i]);
             *dev = NULL;
 
@@ -29,6 +29,7 @@
 # include "virbitmap.h"
 # include "virutil.h"
 # include "virthread.h"
+# include "virhash.h"
 # include "virpci.h"
 # include "device_conf.h"
 # include "object_event.h"
@@ -221,6 +222,12 @@ typedef virNodeDeviceObjList *virNodeDeviceObjListPtr;
 struct _virNodeDeviceObjList {
     size_t count;
     virNodeDeviceObjPtr *objs;
+
+    /* name -> virNodeDeviceObjPtr and sysfs_path -> virNodeDeviceObjPtr
+     * caches in front of @objs; lookups fall back to a linear scan when
+     * an entry is missing, so the tables are maintained best effort */
+    virHashTablePtr names;
+    virHashTablePtr sysfsPaths;
 };
 
 typedef struct _virNodeDeviceDriverState virNodeDeviceDriverState;
@@ -146,6 +146,10 @@ static const struct int_map chain_priorities[] = {
 static virRWLock updateLock;
 static bool initialized;
 
+/* incremented on every write lock acquisition; lets consumers holding
+ * the read lock detect whether filter definitions may have changed */
+static unsigned long long updateGeneration;
+
 void
 virNWFilterReadLockFilterUpdates(void)
 {
@@ -156,6 +160,20 @@ void
 virNWFilterWriteLockFilterUpdates(void)
 {
     virRWLockWrite(&updateLock);
+    updateGeneration++;
+}
+
+/**
+ * virNWFilterGetUpdateGeneration:
+ *
+ * Returns a generation number that changes whenever the filter update
+ * write lock has been taken. Callers must hold the update lock (read
+ * or write) for the returned value to be meaningful.
+ */
+unsigned long long
+virNWFilterGetUpdateGeneration(void)
+{
+    return updateGeneration;
 }
 
 void
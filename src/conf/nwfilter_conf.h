@@ -649,6 +649,7 @@ void virNWFilterObjUnlock(virNWFilterObjPtr obj);
 void virNWFilterWriteLockFilterUpdates(void);
 void virNWFilterReadLockFilterUpdates(void);
 void virNWFilterUnlockFilterUpdates(void);
+unsigned long long virNWFilterGetUpdateGeneration(void);
 
 int virNWFilterConfLayerInit(virDomainObjListIterator domUpdateCB, void *opaque);
 void virNWFilterConfLayerShutdown(void);
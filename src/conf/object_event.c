@@ -73,13 +73,17 @@ typedef virObjectEventQueue *virObjectEventQueuePtr;
 struct _virObjectEventState {
     /* The list of domain event callbacks */
     virObjectEventCallbackListPtr callbacks;
-    /* The queue of object events */
+    /* The queue of object events; protected by queueLock so that
+     * submission never contends with dispatch or (de)registration */
     virObjectEventQueuePtr queue;
-    /* Timer for flushing events queue */
+    /* Timer for flushing events queue; changed with both locks held,
+     * so holding either lock is enough to read it */
     int timer;
     /* Flag if we're in process of dispatching */
     bool isDispatching;
+    /* Protects everything but the queue; acquired before queueLock */
     virMutex lock;
+    virMutex queueLock;
 };
 
 static virClassPtr virObjectEventClass;
@@ -548,6 +552,7 @@ virObjectEventStateFree(virObjectEventStatePtr state)
         virEventRemoveTimeout(state->timer);
 
     virMutexDestroy(&state->lock);
+    virMutexDestroy(&state->queueLock);
     VIR_FREE(state);
 }
 
@@ -593,6 +598,14 @@ virObjectEventStateNew(void)
         goto error;
     }
 
+    if (virMutexInit(&state->queueLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to initialize queue mutex"));
+        virMutexDestroy(&state->lock);
+        VIR_FREE(state);
+        goto error;
+    }
+
     if (VIR_ALLOC(state->callbacks) < 0)
         goto error;
 
@@ -768,13 +781,14 @@ virObjectEventStateQueueRemote(virObjectEventStatePtr state,
                                virObjectEventPtr event,
                                int remoteID)
 {
+    virMutexLock(&state->queueLock);
+
     if (state->timer < 0) {
+        virMutexUnlock(&state->queueLock);
         virObjectUnref(event);
         return;
     }
 
-    virObjectEventStateLock(state);
-
     event->remoteID = remoteID;
     if (virObjectEventQueuePush(state->queue, event) < 0) {
         VIR_DEBUG("Error adding event to queue");
@@ -783,7 +797,7 @@ virObjectEventStateQueueRemote(virObjectEventStatePtr state,
 
     if (state->queue->count == 1)
         virEventUpdateTimeout(state->timer, 0);
-    virObjectEventStateUnlock(state);
+    virMutexUnlock(&state->queueLock);
 }
 
 
@@ -809,16 +823,19 @@ virObjectEventStateFlush(virObjectEventStatePtr state)
 {
     virObjectEventQueue tempQueue;
 
-    virObjectEventStateLock(state);
-    state->isDispatching = true;
-
-    /* Copy the queue, so we're reentrant safe when dispatchFunc drops the
-     * driver lock */
+    /* Grab the whole batch with only the queue lock held, so that
+     * event submission never waits on a dispatch in progress */
+    virMutexLock(&state->queueLock);
     tempQueue.count = state->queue->count;
     tempQueue.events = state->queue->events;
     state->queue->count = 0;
     state->queue->events = NULL;
-    virEventUpdateTimeout(state->timer, -1);
+    if (state->timer != -1)
+        virEventUpdateTimeout(state->timer, -1);
+    virMutexUnlock(&state->queueLock);
+
+    virObjectEventStateLock(state);
+    state->isDispatching = true;
 
     virObjectEventStateQueueDispatch(state,
                                      &tempQueue,
@@ -885,15 +902,23 @@ virObjectEventStateRegisterID(virConnectPtr conn,
 
     virObjectEventStateLock(state);
 
-    if ((state->callbacks->count == 0) &&
-        (state->timer == -1) &&
-        (state->timer = virEventAddTimeout(-1,
-                                           virObjectEventTimer,
-                                           state,
-                                           NULL)) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("could not initialize domain event timer"));
-        goto cleanup;
+    if (state->callbacks->count == 0 &&
+        state->timer == -1) {
+        int timer;
+
+        virMutexLock(&state->queueLock);
+        if ((timer = virEventAddTimeout(-1,
+                                        virObjectEventTimer,
+                                        state,
+                                        NULL)) >= 0)
+            state->timer = timer;
+        virMutexUnlock(&state->queueLock);
+
+        if (timer < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("could not initialize domain event timer"));
+            goto cleanup;
+        }
     }
 
     ret = virObjectEventCallbackListAddID(conn, state->callbacks,
@@ -905,8 +930,10 @@ virObjectEventStateRegisterID(virConnectPtr conn,
     if (ret == -1 &&
         state->callbacks->count == 0 &&
         state->timer != -1) {
+        virMutexLock(&state->queueLock);
         virEventRemoveTimeout(state->timer);
         state->timer = -1;
+        virMutexUnlock(&state->queueLock);
     }
 
  cleanup:
@@ -944,9 +971,11 @@ virObjectEventStateDeregisterID(virConnectPtr conn,
 
     if (state->callbacks->count == 0 &&
         state->timer != -1) {
+        virMutexLock(&state->queueLock);
         virEventRemoveTimeout(state->timer);
         state->timer = -1;
         virObjectEventQueueClear(state->queue);
+        virMutexUnlock(&state->queueLock);
     }
 
     virObjectEventStateUnlock(state);
@@ -1073,3 +1102,44 @@ virObjectEventStateSetRemote(virConnectPtr conn,
     }
     virObjectEventStateUnlock(state);
 }
+
+
+/**
+ * virObjectEventStateIsEnabled:
+ * @state: object event state
+ * @klass: the class of the event to check for
+ * @eventID: the event ID to check for
+ *
+ * Check whether any callback is registered for events of the given
+ * class and ID, so emitters can skip constructing and queueing events
+ * that nobody would receive.
+ *
+ * Returns true if at least one consumer is registered
+ */
+bool
+virObjectEventStateIsEnabled(virObjectEventStatePtr state,
+                             virClassPtr klass,
+                             int eventID)
+{
+    size_t i;
+    bool enabled = false;
+
+    if (!state)
+        return false;
+
+    virObjectEventStateLock(state);
+    for (i = 0; i < state->callbacks->count; i++) {
+        virObjectEventCallbackPtr cb = state->callbacks->callbacks[i];
+
+        if (cb->deleted)
+            continue;
+
+        if (cb->klass == klass && cb->eventID == eventID) {
+            enabled = true;
+            break;
+        }
+    }
+    virObjectEventStateUnlock(state);
+
+    return enabled;
+}
@@ -91,4 +91,10 @@ virObjectEventStateSetRemote(virConnectPtr conn,
                              int remoteID)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 
+bool
+virObjectEventStateIsEnabled(virObjectEventStatePtr state,
+                             virClassPtr klass,
+                             int eventID)
+    ATTRIBUTE_NONNULL(2);
+
 #endif
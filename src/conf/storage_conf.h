@@ -28,6 +28,7 @@
 # include "virstorageencryption.h"
 # include "virstoragefile.h"
 # include "virbitmap.h"
+# include "virhash.h"
 # include "virthread.h"
 # include "device_conf.h"
 # include "node_device_conf.h"
@@ -276,6 +277,9 @@ struct _virStoragePoolObj {
     virStoragePoolDefPtr newDef;
 
     virStorageVolDefList volumes;
+
+    /* inotify watch on the pool's target directory, -1 if unwatched */
+    int inotifyWd;
 };
 
 typedef struct _virStoragePoolObjList virStoragePoolObjList;
@@ -300,6 +304,12 @@ struct _virStorageDriverState {
 
     /* Immutable pointer, self-locking APIs */
     virObjectEventStatePtr storageEventState;
+
+    /* inotify based incremental refresh of directory backed pools */
+    int inotifyFD;
+    int inotifyWatch;
+    virMutex inotifyLock;
+    virHashTablePtr inotifyPools; /* inotify wd -> pool name */
 };
 
 typedef struct _virStoragePoolSourceList virStoragePoolSourceList;
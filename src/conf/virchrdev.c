@@ -26,6 +26,12 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
+#ifndef WIN32
+# include <sys/socket.h>
+#endif
+#ifdef HAVE_CFMAKERAW
+# include <termios.h>
+#endif
 
 #include "virchrdev.h"
 #include "virhash.h"
@@ -37,17 +43,31 @@
 #include "virlog.h"
 #include "virerror.h"
 #include "virfile.h"
+#include "virobject.h"
 #include "virstring.h"
+#include "virutil.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
 VIR_LOG_INIT("conf.chrdev");
 
+/* default amount of recent console output replayed to a newly
+ * attached console client */
+#define VIR_CHRDEV_SCROLLBACK_DEFAULT (64 * 1024)
+
+/* chunk size for relaying data between the device and its clients */
+#define VIR_CHRDEV_HUB_BUF_SIZE 4096
+
+/* stop reading client input once this much output for the device has
+ * accumulated; reading is resumed when the device drains the backlog */
+#define VIR_CHRDEV_HUB_PENDING_MAX (256 * 1024)
+
 /* structure holding information about character devices
  * open in a given domain */
 struct _virChrdevs {
     virMutex lock;
     virHashTablePtr hash;
+    size_t scrollback; /* ring buffer size for console hubs */
 };
 
 typedef struct _virChrdevStreamInfo virChrdevStreamInfo;
@@ -57,6 +77,557 @@ struct _virChrdevStreamInfo {
     char *path;
 };
 
+typedef struct _virChrdevHubClient virChrdevHubClient;
+typedef virChrdevHubClient *virChrdevHubClientPtr;
+struct _virChrdevHubClient {
+    virStreamPtr st;
+    int fd;       /* hub side of the relay socket pair, -1 once hung up */
+    int watch;    /* event watch on @fd, -1 if none */
+    bool writer;  /* input from this client is relayed to the device */
+};
+
+/* A console hub owns the character device and relays its output to
+ * any number of attached client streams, so that attaching a console
+ * viewer does not steal data from the streams already connected. Each
+ * client talks to the hub over a socket pair; only a single client at
+ * a time (the writer) may send input to the device.
+ *
+ * For device types that are not multiplexed the hub merely records
+ * the one exclusive stream in @passthrough and the original direct
+ * connection semantics apply.
+ */
+typedef struct _virChrdevHub virChrdevHub;
+typedef virChrdevHub *virChrdevHubPtr;
+struct _virChrdevHub {
+    virObjectLockable parent;
+
+    char *path;                /* device path; key of the hash entry */
+
+    int fd;                    /* the character device, -1 if not hubbed */
+    int watch;                 /* event watch on @fd, -1 if none */
+
+    virStreamPtr passthrough;  /* exclusive stream for non-hubbed devices */
+
+    char *ring;                /* scrollback of recent device output */
+    size_t ringSize;
+    size_t ringStart;          /* offset of the oldest byte */
+    size_t ringLen;
+
+    char *pending;             /* batched outbound data for the device */
+    size_t pendingLen;
+
+    virChrdevHubClientPtr *clients;
+    size_t nclients;
+};
+
+static virClassPtr virChrdevHubClass;
+static void virChrdevHubDispose(void *obj);
+
+static int virChrdevHubOnceInit(void)
+{
+    if (!(virChrdevHubClass = virClassNew(virClassForObjectLockable(),
+                                          "virChrdevHub",
+                                          sizeof(virChrdevHub),
+                                          virChrdevHubDispose)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virChrdevHub)
+
+static void virChrdevHubDispose(void *obj)
+{
+    virChrdevHubPtr hub = obj;
+
+    virObjectUnref(hub->passthrough);
+    VIR_FORCE_CLOSE(hub->fd);
+    VIR_FREE(hub->clients);
+    VIR_FREE(hub->ring);
+    VIR_FREE(hub->pending);
+    VIR_FREE(hub->path);
+}
+
+/**
+ * Detach a single client stream from a hub. Closes the relay socket
+ * and drops the reference on the stream. Called with the hub locked.
+ *
+ * @hub The console hub
+ * @st Stream of the client to detach
+ */
+static void virChrdevHubRemoveClient(virChrdevHubPtr hub,
+                                     virStreamPtr st)
+{
+    size_t i;
+
+    for (i = 0; i < hub->nclients; i++) {
+        virChrdevHubClientPtr client = hub->clients[i];
+
+        if (client->st != st)
+            continue;
+
+        if (client->watch >= 0)
+            virEventRemoveHandle(client->watch);
+        VIR_FORCE_CLOSE(client->fd);
+        virObjectUnref(client->st);
+        VIR_FREE(client);
+        VIR_DELETE_ELEMENT(hub->clients, i, hub->nclients);
+        break;
+    }
+}
+
+/**
+ * Stop all relaying done by a hub: drop the device watch, close the
+ * device and detach all remaining clients. Closing the relay sockets
+ * makes the client streams see EOF so they shut down on their own.
+ * Idempotent; called with the hub locked.
+ *
+ * @hub The console hub
+ */
+static void virChrdevHubShutdown(virChrdevHubPtr hub)
+{
+    while (hub->nclients)
+        virChrdevHubRemoveClient(hub, hub->clients[0]->st);
+
+    if (hub->watch >= 0) {
+        virEventRemoveHandle(hub->watch);
+        hub->watch = -1;
+    }
+    VIR_FORCE_CLOSE(hub->fd);
+    hub->pendingLen = 0;
+}
+
+#ifndef WIN32
+/**
+ * Append device output to the scrollback ring buffer, overwriting the
+ * oldest data once the buffer is full. Called with the hub locked.
+ */
+static void virChrdevHubRingAppend(virChrdevHubPtr hub,
+                                   const char *buf,
+                                   size_t len)
+{
+    size_t pos;
+    size_t first;
+
+    if (len >= hub->ringSize) {
+        /* only the newest ringSize bytes can be kept */
+        memcpy(hub->ring, buf + len - hub->ringSize, hub->ringSize);
+        hub->ringStart = 0;
+        hub->ringLen = hub->ringSize;
+        return;
+    }
+
+    pos = (hub->ringStart + hub->ringLen) % hub->ringSize;
+    first = MIN(len, hub->ringSize - pos);
+    memcpy(hub->ring + pos, buf, first);
+    if (len > first)
+        memcpy(hub->ring, buf + first, len - first);
+
+    if (hub->ringLen + len > hub->ringSize) {
+        hub->ringStart = (pos + len) % hub->ringSize;
+        hub->ringLen = hub->ringSize;
+    } else {
+        hub->ringLen += len;
+    }
+}
+
+/**
+ * Replay the scrollback contents into the relay socket of a freshly
+ * attached client. Best effort: if the socket buffer can't take the
+ * whole backlog the rest is skipped rather than blocking the hub.
+ */
+static void virChrdevHubRingReplay(virChrdevHubPtr hub,
+                                   int fd)
+{
+    size_t head = MIN(hub->ringLen, hub->ringSize - hub->ringStart);
+
+    if (head &&
+        write(fd, hub->ring + hub->ringStart, head) < (ssize_t) head)
+        return;
+
+    if (hub->ringLen > head)
+        ignore_value(write(fd, hub->ring, hub->ringLen - head));
+}
+
+/**
+ * Queue client input for the device. The data is written out in one
+ * batch the next time the device reports it is writable.
+ */
+static int virChrdevHubQueueOutput(virChrdevHubPtr hub,
+                                   const char *buf,
+                                   size_t len)
+{
+    if (VIR_REALLOC_N(hub->pending, hub->pendingLen + len) < 0)
+        return -1;
+
+    memcpy(hub->pending + hub->pendingLen, buf, len);
+    hub->pendingLen += len;
+
+    virEventUpdateHandle(hub->watch,
+                         VIR_EVENT_HANDLE_READABLE |
+                         VIR_EVENT_HANDLE_WRITABLE);
+    return 0;
+}
+
+/**
+ * I/O event handler for the character device itself. Fans out new
+ * output to all attached clients and flushes batched client input.
+ */
+static void virChrdevHubDeviceEvent(int watch,
+                                    int fd,
+                                    int events,
+                                    void *opaque)
+{
+    virChrdevHubPtr hub = opaque;
+    char buf[VIR_CHRDEV_HUB_BUF_SIZE];
+    bool failed = false;
+    ssize_t got;
+    size_t i;
+
+    virObjectLock(hub);
+
+    if (watch != hub->watch || fd != hub->fd) {
+        virObjectUnlock(hub);
+        return;
+    }
+
+    if (events & VIR_EVENT_HANDLE_WRITABLE && hub->pendingLen) {
+        /* write the whole accumulated batch with a single syscall */
+        got = write(fd, hub->pending, hub->pendingLen);
+        if (got < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                failed = true;
+        } else {
+            memmove(hub->pending, hub->pending + got, hub->pendingLen - got);
+            hub->pendingLen -= got;
+
+            if (hub->pendingLen < VIR_CHRDEV_HUB_PENDING_MAX) {
+                /* resume reading input from clients */
+                for (i = 0; i < hub->nclients; i++) {
+                    if (hub->clients[i]->watch >= 0)
+                        virEventUpdateHandle(hub->clients[i]->watch,
+                                             VIR_EVENT_HANDLE_READABLE);
+                }
+            }
+        }
+
+        if (!failed)
+            virEventUpdateHandle(hub->watch,
+                                 VIR_EVENT_HANDLE_READABLE |
+                                 (hub->pendingLen ?
+                                  VIR_EVENT_HANDLE_WRITABLE : 0));
+    }
+
+    if (events & VIR_EVENT_HANDLE_READABLE) {
+        got = read(fd, buf, sizeof(buf));
+        if (got > 0) {
+            virChrdevHubRingAppend(hub, buf, got);
+
+            for (i = 0; i < hub->nclients; i++) {
+                if (hub->clients[i]->fd < 0)
+                    continue;
+                /* a client that doesn't keep up loses data, just as
+                 * it would on a PTY buffer overrun */
+                ignore_value(write(hub->clients[i]->fd, buf, got));
+            }
+        } else if (got == 0 ||
+                   (errno != EAGAIN && errno != EINTR)) {
+            failed = true;
+        }
+    }
+
+    if (events & (VIR_EVENT_HANDLE_ERROR | VIR_EVENT_HANDLE_HANGUP))
+        failed = true;
+
+    if (failed) {
+        VIR_DEBUG("Console device %s hung up, shutting down hub %p",
+                  hub->path, hub);
+        /* closing the relay sockets makes the client streams see EOF;
+         * the stale hash entry is reaped when the clients close */
+        virChrdevHubShutdown(hub);
+    }
+
+    virObjectUnlock(hub);
+}
+
+/**
+ * I/O event handler for the hub side of a client's relay socket.
+ * Input from the writer client is batched for the device, input from
+ * read-only clients is discarded.
+ */
+static void virChrdevHubClientEvent(int watch,
+                                    int fd,
+                                    int events,
+                                    void *opaque)
+{
+    virChrdevHubPtr hub = opaque;
+    virChrdevHubClientPtr client = NULL;
+    char buf[VIR_CHRDEV_HUB_BUF_SIZE];
+    bool hangup = false;
+    ssize_t got;
+    size_t i;
+
+    virObjectLock(hub);
+
+    for (i = 0; i < hub->nclients; i++) {
+        if (hub->clients[i]->watch == watch) {
+            client = hub->clients[i];
+            break;
+        }
+    }
+
+    if (!client) {
+        virObjectUnlock(hub);
+        return;
+    }
+
+    if (events & VIR_EVENT_HANDLE_READABLE) {
+        got = read(fd, buf, sizeof(buf));
+        if (got > 0) {
+            if (client->writer && hub->fd >= 0) {
+                if (virChrdevHubQueueOutput(hub, buf, got) < 0) {
+                    virResetLastError();
+                } else if (hub->pendingLen >= VIR_CHRDEV_HUB_PENDING_MAX) {
+                    /* device is not draining; stop reading until the
+                     * backlog shrinks to preserve backpressure */
+                    virEventUpdateHandle(client->watch, 0);
+                }
+            }
+            /* input from read-only clients is dropped */
+        } else if (got == 0 ||
+                   (errno != EAGAIN && errno != EINTR)) {
+            hangup = true;
+        }
+    }
+
+    if (events & (VIR_EVENT_HANDLE_ERROR | VIR_EVENT_HANDLE_HANGUP))
+        hangup = true;
+
+    if (hangup) {
+        /* the stream close callback detaches the client fully */
+        virEventRemoveHandle(client->watch);
+        client->watch = -1;
+        VIR_FORCE_CLOSE(client->fd);
+    }
+
+    virObjectUnlock(hub);
+}
+
+/**
+ * Open the character device and set up a hub relaying it: the device
+ * is switched to raw mode and watched for output which is copied into
+ * the scrollback buffer and to all attached clients.
+ *
+ * @devs Device set the hub will belong to (for the scrollback size)
+ * @path Path of the character device
+ *
+ * Returns the new hub object or NULL on error.
+ */
+static virChrdevHubPtr virChrdevHubNewDevice(virChrdevsPtr devs,
+                                             const char *path)
+{
+    virChrdevHubPtr hub;
+# ifdef HAVE_CFMAKERAW
+    struct termios rawattr;
+# endif
+
+    if (virChrdevHubInitialize() < 0)
+        return NULL;
+
+    if (!(hub = virObjectLockableNew(virChrdevHubClass)))
+        return NULL;
+
+    hub->fd = -1;
+    hub->watch = -1;
+
+    if (VIR_STRDUP(hub->path, path) < 0)
+        goto error;
+
+    hub->ringSize = devs->scrollback;
+    if (VIR_ALLOC_N(hub->ring, hub->ringSize) < 0)
+        goto error;
+
+    if ((hub->fd = open(path, O_RDWR | O_NONBLOCK | O_NOCTTY)) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to open console device %s"), path);
+        goto error;
+    }
+
+    if (virSetCloseExec(hub->fd) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to set close-on-exec flag"));
+        goto error;
+    }
+
+# ifdef HAVE_CFMAKERAW
+    if (tcgetattr(hub->fd, &rawattr) < 0) {
+        virReportSystemError(errno,
+                             _("unable to get tty attributes: %s"), path);
+        goto error;
+    }
+
+    cfmakeraw(&rawattr);
+
+    if (tcsetattr(hub->fd, TCSANOW, &rawattr) < 0) {
+        virReportSystemError(errno,
+                             _("unable to set tty attributes: %s"), path);
+        goto error;
+    }
+# endif
+
+    virObjectRef(hub);
+    if ((hub->watch = virEventAddHandle(hub->fd,
+                                        VIR_EVENT_HANDLE_READABLE,
+                                        virChrdevHubDeviceEvent,
+                                        hub,
+                                        virObjectFreeCallback)) < 0) {
+        virObjectUnref(hub);
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unable to watch console device %s"), path);
+        goto error;
+    }
+
+    return hub;
+
+ error:
+    virObjectUnref(hub);
+    return NULL;
+}
+
+/**
+ * Attach a client stream to a hub. The stream is connected to one end
+ * of a fresh socket pair, the scrollback buffer is replayed to it and
+ * the hub starts relaying device output to it. Called with the hub
+ * locked.
+ *
+ * @hub The console hub
+ * @st Stream of the new client
+ * @force On true the new client takes over as the writer, demoting a
+ *        previous writer to read-only; otherwise the client becomes
+ *        the writer only if the hub doesn't have one yet.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int virChrdevHubAddClient(virChrdevHubPtr hub,
+                                 virStreamPtr st,
+                                 bool force)
+{
+    virChrdevHubClientPtr client = NULL;
+    bool haveWriter = false;
+    int sv[2] = {-1, -1};
+    size_t i;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create console relay socket pair"));
+        return -1;
+    }
+
+    if (virSetNonBlock(sv[1]) < 0 ||
+        virSetCloseExec(sv[1]) < 0 ||
+        virSetCloseExec(sv[0]) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to configure console relay socket"));
+        goto error;
+    }
+
+    if (VIR_ALLOC(client) < 0)
+        goto error;
+    client->fd = -1;
+    client->watch = -1;
+
+    /* replay scrollback so the new client sees recent console output */
+    virChrdevHubRingReplay(hub, sv[1]);
+
+    if (virStreamRef(st) < 0)
+        goto error;
+
+    if (virFDStreamOpen(st, sv[0]) < 0) {
+        virObjectUnref(st);
+        goto error;
+    }
+    sv[0] = -1; /* owned by the stream now */
+    client->st = st;
+    client->fd = sv[1];
+    sv[1] = -1;
+
+    for (i = 0; i < hub->nclients; i++) {
+        if (hub->clients[i]->writer) {
+            haveWriter = true;
+            if (force)
+                hub->clients[i]->writer = false;
+        }
+    }
+    client->writer = force || !haveWriter;
+
+    virObjectRef(hub);
+    if ((client->watch = virEventAddHandle(client->fd,
+                                           VIR_EVENT_HANDLE_READABLE,
+                                           virChrdevHubClientEvent,
+                                           hub,
+                                           virObjectFreeCallback)) < 0) {
+        virObjectUnref(hub);
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to watch console relay socket"));
+        goto error;
+    }
+
+    if (VIR_APPEND_ELEMENT(hub->clients, hub->nclients, client) < 0)
+        goto error;
+
+    return 0;
+
+ error:
+    if (client) {
+        if (client->watch >= 0)
+            virEventRemoveHandle(client->watch);
+        if (client->st) {
+            virStreamAbort(client->st);
+            virObjectUnref(client->st);
+        }
+        VIR_FORCE_CLOSE(client->fd);
+    }
+    VIR_FREE(client);
+    VIR_FORCE_CLOSE(sv[0]);
+    VIR_FORCE_CLOSE(sv[1]);
+    return -1;
+}
+#endif /* !WIN32 */
+
+/**
+ * Create a hash entry wrapper around an exclusive device stream for
+ * device types that are not multiplexed.
+ *
+ * @path Path of the character device
+ * @st The exclusive stream; the wrapper takes over the caller's
+ *     reference to it.
+ *
+ * Returns the new hub object or NULL on error.
+ */
+static virChrdevHubPtr virChrdevHubNewPassthrough(const char *path,
+                                                  virStreamPtr st)
+{
+    virChrdevHubPtr hub;
+
+    if (virChrdevHubInitialize() < 0)
+        return NULL;
+
+    if (!(hub = virObjectLockableNew(virChrdevHubClass)))
+        return NULL;
+
+    hub->fd = -1;
+    hub->watch = -1;
+    hub->passthrough = st;
+
+    if (VIR_STRDUP(hub->path, path) < 0) {
+        hub->passthrough = NULL;
+        virObjectUnref(hub);
+        return NULL;
+    }
+
+    return hub;
+}
+
 #ifdef VIR_CHRDEV_LOCK_FILE_PATH
 /**
  * Create a full filename with path to the lock file based on
@@ -211,17 +782,17 @@ static void virChrdevLockFileRemove(const char *dev ATTRIBUTE_UNUSED)
 /**
  * Frees an entry from the hash containing domain's active devices
  *
- * @data Opaque data, struct holding information about the device
+ * @data Opaque data, the hub of the device
  * @name Path of the device.
  */
 static void virChrdevHashEntryFree(void *data,
                                     const void *name)
 {
     const char *dev = name;
-    virStreamPtr st = data;
+    virChrdevHubPtr hub = data;
 
-    /* free stream reference */
-    virObjectUnref(st);
+    /* drop the hash reference on the hub */
+    virObjectUnref(hub);
 
     /* delete lock file */
     virChrdevLockFileRemove(dev);
@@ -241,20 +812,38 @@ static void virChrdevFDStreamCloseCbFree(void *opaque)
 }
 
 /**
- * Callback being called if a FDstream is closed. Frees device entries
- * from data structures and removes lockfiles.
+ * Callback being called if a FDstream is closed. Detaches the stream
+ * from the hub of its device and removes the device entry once the
+ * last stream is gone, together with its lockfile.
  *
  * @st Pointer to stream being closed.
  * @opaque Domain's device information structure.
  */
-static void virChrdevFDStreamCloseCb(virStreamPtr st ATTRIBUTE_UNUSED,
+static void virChrdevFDStreamCloseCb(virStreamPtr st,
                                       void *opaque)
 {
     virChrdevStreamInfoPtr priv = opaque;
+    virChrdevHubPtr hub;
+    bool removeEntry = false;
+
     virMutexLock(&priv->devs->lock);
 
-    /* remove entry from hash */
-    virHashRemoveEntry(priv->devs->hash, priv->path);
+    if ((hub = virHashLookup(priv->devs->hash, priv->path))) {
+        virObjectLock(hub);
+        if (hub->passthrough == st) {
+            removeEntry = true;
+        } else {
+            virChrdevHubRemoveClient(hub, st);
+            if (hub->nclients == 0 && !hub->passthrough) {
+                virChrdevHubShutdown(hub);
+                removeEntry = true;
+            }
+        }
+        virObjectUnlock(hub);
+
+        if (removeEntry)
+            virHashRemoveEntry(priv->devs->hash, priv->path);
+    }
 
     virMutexUnlock(&priv->devs->lock);
 }
@@ -263,9 +852,13 @@ static void virChrdevFDStreamCloseCb(virStreamPtr st ATTRIBUTE_UNUSED,
  * Allocate structures for storing information about active device streams
  * in domain's private data section.
  *
+ * @scrollback Amount of recent console output (in bytes) that is kept
+ *             per device and replayed to newly attached console
+ *             clients; 0 selects the built-in default.
+ *
  * Returns pointer to the allocated structure or NULL on error
  */
-virChrdevsPtr virChrdevAlloc(void)
+virChrdevsPtr virChrdevAlloc(size_t scrollback)
 {
     virChrdevsPtr devs;
     if (VIR_ALLOC(devs) < 0)
@@ -278,6 +871,8 @@ virChrdevsPtr virChrdevAlloc(void)
         return NULL;
     }
 
+    devs->scrollback = scrollback ? scrollback : VIR_CHRDEV_SCROLLBACK_DEFAULT;
+
     /* there will hardly be any devices most of the time, the hash
      * does not have to be huge */
     if (!(devs->hash = virHashCreate(3, virChrdevHashEntryFree)))
@@ -290,15 +885,28 @@ virChrdevsPtr virChrdevAlloc(void)
 }
 
 /**
- * Helper to clear stream callbacks when freeing the hash
+ * Helper to clear stream callbacks and shut down hubs when freeing
+ * the hash
  */
 static int virChrdevFreeClearCallbacks(void *payload,
                                        const void *name ATTRIBUTE_UNUSED,
                                        void *data ATTRIBUTE_UNUSED)
 {
-    virStreamPtr st = payload;
+    virChrdevHubPtr hub = payload;
+    size_t i;
+
+    virObjectLock(hub);
+
+    if (hub->passthrough)
+        virFDStreamSetInternalCloseCb(hub->passthrough, NULL, NULL, NULL);
+
+    /* the device set is going away; make sure no client stream close
+     * callback references it afterwards */
+    for (i = 0; i < hub->nclients; i++)
+        virFDStreamSetInternalCloseCb(hub->clients[i]->st, NULL, NULL, NULL);
 
-    virFDStreamSetInternalCloseCb(st, NULL, NULL, NULL);
+    virChrdevHubShutdown(hub);
+    virObjectUnlock(hub);
     return 0;
 }
 
@@ -322,16 +930,23 @@ void virChrdevFree(virChrdevsPtr devs)
 }
 
 /**
- * Open a device stream for a domain ensuring that other streams are
- * not using the device, nor any lockfiles exist. This ensures that
- * the device stream does not get corrupted due to a race on reading
- * same FD by two processes.
+ * Open a device stream for a domain. PTY devices are multiplexed: the
+ * first client creates a hub that owns the device and any further
+ * client attaches to the same hub, receives a replay of the recent
+ * scrollback and then follows the device output without perturbing
+ * the clients connected earlier. Only one client at a time (the first
+ * one, or the latest one to connect with @force) may write to the
+ * device; input from the others is discarded.
+ *
+ * Other device types keep the historic exclusive semantics where a
+ * second connection is refused unless @force is used.
  *
  * @devs Pointer to private structure holding data about device streams.
  * @source Pointer to private structure holding data about device source.
  * @st Stream the client wishes to use for the device connection.
- * @force On true, close active device streams for the selected character
- *        device before opening this connection.
+ * @force On true, take over the writer role (PTY) or close active
+ *        device streams for the selected character device before
+ *        opening this connection (other device types).
  *
  * Returns 0 on success and st is connected to the selected device and
  * corresponding lock file is created (if configured). Returns -1 on
@@ -343,10 +958,12 @@ int virChrdevOpen(virChrdevsPtr devs,
                   bool force)
 {
     virChrdevStreamInfoPtr cbdata = NULL;
-    virStreamPtr savedStream;
+    virChrdevHubPtr hub;
+    bool useHub = false;
     char *path;
     int ret;
     bool added = false;
+    bool locked = false;
 
     switch (source->type) {
     case VIR_DOMAIN_CHR_TYPE_PTY:
@@ -356,6 +973,9 @@ int virChrdevOpen(virChrdevsPtr devs,
                            _("PTY device is not yet assigned"));
             return -1;
         }
+#ifndef WIN32
+        useHub = true;
+#endif
         break;
     case VIR_DOMAIN_CHR_TYPE_UNIX:
         path = source->data.nix.path;
@@ -369,24 +989,60 @@ int virChrdevOpen(virChrdevsPtr devs,
 
     virMutexLock(&devs->lock);
 
-    if ((savedStream = virHashLookup(devs->hash, path))) {
-        if (!force) {
-             /* entry found, device is busy */
-            virMutexUnlock(&devs->lock);
-            return 1;
-       } else {
-           /* terminate existing connection */
-           /* The internal close callback handler needs to lock devs->lock to
-            * remove the aborted stream from the hash. This would cause a
-            * deadlock as we would try to enter the lock twice from the very
-            * same thread. We need to unregister the callback and abort the
-            * stream manually before we create a new device connection.
-            */
-           virFDStreamSetInternalCloseCb(savedStream, NULL, NULL, NULL);
-           virStreamAbort(savedStream);
-           virHashRemoveEntry(devs->hash, path);
-           /* continue adding a new stream connection */
-       }
+    if ((hub = virHashLookup(devs->hash, path))) {
+        if (useHub && !hub->passthrough) {
+            bool stale;
+
+            virObjectLock(hub);
+            stale = hub->fd < 0;
+            virObjectUnlock(hub);
+
+            if (stale) {
+                /* the device died but some client has not yet closed
+                 * its stream; start from scratch */
+                virHashRemoveEntry(devs->hash, path);
+                hub = NULL;
+            } else {
+                /* attach to the existing hub */
+                if (VIR_ALLOC(cbdata) < 0 ||
+                    VIR_STRDUP(cbdata->path, path) < 0)
+                    goto error;
+                cbdata->devs = devs;
+
+                virObjectLock(hub);
+                ret = virChrdevHubAddClient(hub, st, force);
+                virObjectUnlock(hub);
+                if (ret < 0)
+                    goto error;
+
+                virFDStreamSetInternalCloseCb(st,
+                                              virChrdevFDStreamCloseCb,
+                                              cbdata,
+                                              virChrdevFDStreamCloseCbFree);
+                virMutexUnlock(&devs->lock);
+                return 0;
+            }
+        } else {
+            if (!force) {
+                /* entry found, device is busy */
+                virMutexUnlock(&devs->lock);
+                return 1;
+            }
+            /* terminate existing connection */
+            /* The internal close callback handler needs to lock devs->lock to
+             * remove the aborted stream from the hash. This would cause a
+             * deadlock as we would try to enter the lock twice from the very
+             * same thread. We need to unregister the callback and abort the
+             * stream manually before we create a new device connection.
+             */
+            if (hub->passthrough) {
+                virFDStreamSetInternalCloseCb(hub->passthrough, NULL, NULL, NULL);
+                virStreamAbort(hub->passthrough);
+            }
+            virHashRemoveEntry(devs->hash, path);
+            hub = NULL;
+            /* continue adding a new device connection */
+        }
     }
 
     /* create the lock file */
@@ -394,39 +1050,71 @@ int virChrdevOpen(virChrdevsPtr devs,
         virMutexUnlock(&devs->lock);
         return ret;
     }
+    locked = true;
 
-    /* obtain a reference to the stream */
-    if (virStreamRef(st) < 0) {
-        virMutexUnlock(&devs->lock);
-        return -1;
-    }
-
-    if (VIR_ALLOC(cbdata) < 0)
+    if (VIR_ALLOC(cbdata) < 0 ||
+        VIR_STRDUP(cbdata->path, path) < 0)
         goto error;
+    cbdata->devs = devs;
 
-    if (virHashAddEntry(devs->hash, path, st) < 0)
-        goto error;
-    added = true;
+    if (useHub) {
+#ifndef WIN32
+        if (!(hub = virChrdevHubNewDevice(devs, path)))
+            goto error;
 
-    cbdata->devs = devs;
-    if (VIR_STRDUP(cbdata->path, path) < 0)
-        goto error;
+        if (virHashAddEntry(devs->hash, path, hub) < 0) {
+            virObjectLock(hub);
+            virChrdevHubShutdown(hub);
+            virObjectUnlock(hub);
+            virObjectUnref(hub);
+            hub = NULL;
+            goto error;
+        }
+        added = true;
 
-    /* open the character device */
-    switch (source->type) {
-    case VIR_DOMAIN_CHR_TYPE_PTY:
-        if (virFDStreamOpenPTY(st, path, 0, 0, O_RDWR) < 0)
+        virObjectLock(hub);
+        ret = virChrdevHubAddClient(hub, st, force);
+        virObjectUnlock(hub);
+        if (ret < 0) {
+            virObjectLock(hub);
+            virChrdevHubShutdown(hub);
+            virObjectUnlock(hub);
             goto error;
-        break;
-    case VIR_DOMAIN_CHR_TYPE_UNIX:
-        if (virFDStreamConnectUNIX(st, path, false) < 0)
+        }
+#endif /* !WIN32 */
+    } else {
+        /* obtain a reference to the stream */
+        if (virStreamRef(st) < 0)
             goto error;
-        break;
-    default:
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
-                       _("Unsupported device type '%s'"),
-                       virDomainChrTypeToString(source->type));
-        goto error;
+
+        if (!(hub = virChrdevHubNewPassthrough(path, st))) {
+            virObjectUnref(st);
+            goto error;
+        }
+
+        if (virHashAddEntry(devs->hash, path, hub) < 0) {
+            virObjectUnref(hub);
+            hub = NULL;
+            goto error;
+        }
+        added = true;
+
+        /* open the character device */
+        switch (source->type) {
+        case VIR_DOMAIN_CHR_TYPE_PTY:
+            if (virFDStreamOpenPTY(st, path, 0, 0, O_RDWR) < 0)
+                goto error;
+            break;
+        case VIR_DOMAIN_CHR_TYPE_UNIX:
+            if (virFDStreamConnectUNIX(st, path, false) < 0)
+                goto error;
+            break;
+        default:
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("Unsupported device type '%s'"),
+                           virDomainChrTypeToString(source->type));
+            goto error;
+        }
     }
 
     /* add cleanup callback */
@@ -439,10 +1127,12 @@ int virChrdevOpen(virChrdevsPtr devs,
     return 0;
 
  error:
-    if (added)
+    if (added) {
+        /* removes the lock file as well */
         virHashRemoveEntry(devs->hash, path);
-    else
-        virObjectUnref(st);
+    } else if (locked) {
+        virChrdevLockFileRemove(path);
+    }
 
     if (cbdata)
         VIR_FREE(cbdata->path);
@@ -29,7 +29,7 @@
 typedef struct _virChrdevs virChrdevs;
 typedef virChrdevs *virChrdevsPtr;
 
-virChrdevsPtr virChrdevAlloc(void);
+virChrdevsPtr virChrdevAlloc(size_t scrollback);
 void virChrdevFree(virChrdevsPtr devs);
 
 int virChrdevOpen(virChrdevsPtr devs, virDomainChrSourceDefPtr source,
@@ -24,14 +24,19 @@
 
 #include <config.h>
 
+#include <fnmatch.h>
+
 #include "internal.h"
 #include "datatypes.h"
 #include "virdomainobjlist.h"
 #include "snapshot_conf.h"
 #include "viralloc.h"
+#include "viratomic.h"
 #include "virfile.h"
+#include "virhashcode.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_DOMAIN
 
@@ -41,8 +46,17 @@ static virClassPtr virDomainObjListClass;
 static void virDomainObjListDispose(void *obj);
 
 
-struct _virDomainObjList {
-    virObjectLockable parent;
+/* Number of locking shards the domain object list is split into.
+ * Each domain lives in exactly one shard, chosen from its UUID, and
+ * both its by-UUID and by-name entries are kept there. Lookups only
+ * take a shared lock on a single shard, so iterating one shard never
+ * blocks lookups against the others. */
+#define VIR_DOMAIN_OBJ_LIST_NSHARDS 8
+
+typedef struct _virDomainObjListShard virDomainObjListShard;
+typedef virDomainObjListShard *virDomainObjListShardPtr;
+struct _virDomainObjListShard {
+    virRWLock lock;
 
     /* uuid string -> virDomainObj  mapping
      * for O(1), lockless lookup-by-uuid */
@@ -53,10 +67,28 @@ struct _virDomainObjList {
     virHashTable *objsName;
 };
 
+struct _virDomainObjList {
+    virObject parent;
+
+    virDomainObjListShard shards[VIR_DOMAIN_OBJ_LIST_NSHARDS];
+
+    /* Membership generation, bumped atomically whenever a domain is
+     * inserted into or removed from the shards. Collection caches its
+     * unfiltered snapshot tagged with this, so steady-state listing
+     * of an unchanged host skips iterating the shards entirely */
+    int generation;
+
+    virMutex snapshotLock;
+    virDomainObjPtr *snapshotVms;  /* one reference held per entry */
+    size_t snapshotNvms;
+    int snapshotGeneration;
+    bool snapshotValid;
+};
+
 
 static int virDomainObjListOnceInit(void)
 {
-    if (!(virDomainObjListClass = virClassNew(virClassForObjectLockable(),
+    if (!(virDomainObjListClass = virClassNew(virClassForObject(),
                                               "virDomainObjList",
                                               sizeof(virDomainObjList),
                                               virDomainObjListDispose)))
@@ -67,22 +99,92 @@ static int virDomainObjListOnceInit(void)
 
 VIR_ONCE_GLOBAL_INIT(virDomainObjList)
 
+
+/* Pick the shard holding the domain with the given UUID string */
+static virDomainObjListShardPtr
+virDomainObjListGetShard(virDomainObjListPtr doms,
+                         const char *uuidstr)
+{
+    uint32_t code = virHashCodeGen(uuidstr, strlen(uuidstr), 0);
+
+    return &doms->shards[code % VIR_DOMAIN_OBJ_LIST_NSHARDS];
+}
+
+
+/* Acquire the write lock on every shard, in index order so that
+ * concurrent callers cannot deadlock against each other. Needed by
+ * operations which must check name uniqueness across the whole list */
+static void
+virDomainObjListLockAllWrite(virDomainObjListPtr doms)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_NSHARDS; i++)
+        virRWLockWrite(&doms->shards[i].lock);
+}
+
+
+static void
+virDomainObjListUnlockAll(virDomainObjListPtr doms)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_NSHARDS; i++)
+        virRWLockUnlock(&doms->shards[i].lock);
+}
+
+
+/* The caller must hold locks on all shards */
+static virDomainObjPtr
+virDomainObjListFindByNameAllLocked(virDomainObjListPtr doms,
+                                    const char *name)
+{
+    virDomainObjPtr obj;
+    size_t i;
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_NSHARDS; i++) {
+        if ((obj = virHashLookup(doms->shards[i].objsName, name)))
+            return obj;
+    }
+    return NULL;
+}
+
+
 virDomainObjListPtr virDomainObjListNew(void)
 {
     virDomainObjListPtr doms;
+    size_t i;
 
     if (virDomainObjListInitialize() < 0)
         return NULL;
 
-    if (!(doms = virObjectLockableNew(virDomainObjListClass)))
+    if (!(doms = virObjectNew(virDomainObjListClass)))
         return NULL;
 
-    if (!(doms->objs = virHashCreate(50, virObjectFreeHashData)) ||
-        !(doms->objsName = virHashCreate(50, virObjectFreeHashData))) {
+    if (virMutexInit(&doms->snapshotLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize mutex"));
         virObjectUnref(doms);
         return NULL;
     }
 
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_NSHARDS; i++) {
+        virDomainObjListShardPtr shard = &doms->shards[i];
+
+        if (virRWLockInit(&shard->lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to initialize RW lock"));
+            virObjectUnref(doms);
+            return NULL;
+        }
+
+        if (!(shard->objs = virHashCreateOpen(50, virObjectFreeHashData)) ||
+            !(shard->objsName = virHashCreateOpen(50, virObjectFreeHashData))) {
+            virObjectUnref(doms);
+            return NULL;
+        }
+    }
+
     return doms;
 }
 
@@ -90,9 +192,18 @@ virDomainObjListPtr virDomainObjListNew(void)
 static void virDomainObjListDispose(void *obj)
 {
     virDomainObjListPtr doms = obj;
+    size_t i;
+
+    virObjectListFreeCount(doms->snapshotVms, doms->snapshotNvms);
+    virMutexDestroy(&doms->snapshotLock);
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_NSHARDS; i++) {
+        virDomainObjListShardPtr shard = &doms->shards[i];
 
-    virHashFree(doms->objs);
-    virHashFree(doms->objsName);
+        virHashFree(shard->objs);
+        virHashFree(shard->objsName);
+        virRWLockDestroy(&shard->lock);
+    }
 }
 
 
@@ -118,13 +229,21 @@ virDomainObjListFindByIDInternal(virDomainObjListPtr doms,
                                  bool ref)
 {
     virDomainObjPtr obj;
-    virObjectLock(doms);
-    obj = virHashSearch(doms->objs, virDomainObjListSearchID, &id);
-    if (ref) {
-        virObjectRef(obj);
-        virObjectUnlock(doms);
-    }
-    if (obj) {
+    size_t i;
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_NSHARDS; i++) {
+        virDomainObjListShardPtr shard = &doms->shards[i];
+
+        virRWLockRead(&shard->lock);
+        obj = virHashSearchConst(shard->objs, virDomainObjListSearchID, &id);
+        if (!obj) {
+            virRWLockUnlock(&shard->lock);
+            continue;
+        }
+        if (ref) {
+            virObjectRef(obj);
+            virRWLockUnlock(&shard->lock);
+        }
         virObjectLock(obj);
         if (obj->removing) {
             virObjectUnlock(obj);
@@ -132,10 +251,11 @@ virDomainObjListFindByIDInternal(virDomainObjListPtr doms,
                 virObjectUnref(obj);
             obj = NULL;
         }
+        if (!ref)
+            virRWLockUnlock(&shard->lock);
+        return obj;
     }
-    if (!ref)
-        virObjectUnlock(doms);
-    return obj;
+    return NULL;
 }
 
 virDomainObjPtr
@@ -158,15 +278,17 @@ virDomainObjListFindByUUIDInternal(virDomainObjListPtr doms,
                                    bool ref)
 {
     char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjListShardPtr shard;
     virDomainObjPtr obj;
 
-    virObjectLock(doms);
     virUUIDFormat(uuid, uuidstr);
+    shard = virDomainObjListGetShard(doms, uuidstr);
+    virRWLockRead(&shard->lock);
 
-    obj = virHashLookup(doms->objs, uuidstr);
+    obj = virHashLookup(shard->objs, uuidstr);
     if (ref) {
         virObjectRef(obj);
-        virObjectUnlock(doms);
+        virRWLockUnlock(&shard->lock);
     }
     if (obj) {
         virObjectLock(obj);
@@ -178,7 +300,7 @@ virDomainObjListFindByUUIDInternal(virDomainObjListPtr doms,
         }
     }
     if (!ref)
-        virObjectUnlock(doms);
+        virRWLockUnlock(&shard->lock);
     return obj;
 }
 
@@ -203,26 +325,37 @@ virDomainObjPtr virDomainObjListFindByName(virDomainObjListPtr doms,
                                            const char *name)
 {
     virDomainObjPtr obj;
+    size_t i;
 
-    virObjectLock(doms);
-    obj = virHashLookup(doms->objsName, name);
-    virObjectRef(obj);
-    virObjectUnlock(doms);
-    if (obj) {
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_NSHARDS; i++) {
+        virDomainObjListShardPtr shard = &doms->shards[i];
+
+        virRWLockRead(&shard->lock);
+        obj = virHashLookup(shard->objsName, name);
+        if (!obj) {
+            virRWLockUnlock(&shard->lock);
+            continue;
+        }
+        virObjectRef(obj);
+        virRWLockUnlock(&shard->lock);
         virObjectLock(obj);
         if (obj->removing) {
             virObjectUnlock(obj);
             virObjectUnref(obj);
             obj = NULL;
         }
+        return obj;
     }
-    return obj;
+    return NULL;
 }
 
 
 /*
  * virDomainObjListAddLocked:
  *
+ * The caller must hold the write lock on every shard, since the
+ * name uniqueness check spans the whole list.
+ *
  * If flags & VIR_DOMAIN_OBJ_LIST_ADD_CHECK_LIVE then
  * this will refuse updating an existing def if the
  * current def is Live
@@ -241,14 +374,16 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
 {
     virDomainObjPtr vm;
     char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjListShardPtr shard;
 
     if (oldDef)
         *oldDef = NULL;
 
     virUUIDFormat(def->uuid, uuidstr);
+    shard = virDomainObjListGetShard(doms, uuidstr);
 
     /* See if a VM with matching UUID already exists */
-    if ((vm = virHashLookup(doms->objs, uuidstr))) {
+    if ((vm = virHashLookup(shard->objs, uuidstr))) {
         virObjectLock(vm);
         /* UUID matches, but if names don't match, refuse it */
         if (STRNEQ(vm->def->name, def->name)) {
@@ -281,7 +416,7 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
                               oldDef);
     } else {
         /* UUID does not match, but if a name matches, refuse it */
-        if ((vm = virHashLookup(doms->objsName, def->name))) {
+        if ((vm = virDomainObjListFindByNameAllLocked(doms, def->name))) {
             virObjectLock(vm);
             virUUIDFormat(vm->def->uuid, uuidstr);
             virReportError(VIR_ERR_OPERATION_FAILED,
@@ -295,19 +430,21 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
         vm->def = def;
 
         virUUIDFormat(def->uuid, uuidstr);
-        if (virHashAddEntry(doms->objs, uuidstr, vm) < 0) {
+        if (virHashAddEntry(shard->objs, uuidstr, vm) < 0) {
             virObjectUnref(vm);
             return NULL;
         }
 
-        if (virHashAddEntry(doms->objsName, def->name, vm) < 0) {
-            virHashRemoveEntry(doms->objs, uuidstr);
+        if (virHashAddEntry(shard->objsName, def->name, vm) < 0) {
+            virHashRemoveEntry(shard->objs, uuidstr);
             return NULL;
         }
 
         /* Since domain is in two hash tables, increment the
          * reference counter */
         virObjectRef(vm);
+
+        virAtomicIntInc(&doms->generation);
     }
  cleanup:
     return vm;
@@ -327,9 +464,9 @@ virDomainObjPtr virDomainObjListAdd(virDomainObjListPtr doms,
 {
     virDomainObjPtr ret;
 
-    virObjectLock(doms);
+    virDomainObjListLockAllWrite(doms);
     ret = virDomainObjListAddLocked(doms, def, xmlopt, flags, oldDef);
-    virObjectUnlock(doms);
+    virDomainObjListUnlockAll(doms);
     return ret;
 }
 
@@ -343,19 +480,22 @@ void virDomainObjListRemove(virDomainObjListPtr doms,
                             virDomainObjPtr dom)
 {
     char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjListShardPtr shard;
 
     dom->removing = true;
     virUUIDFormat(dom->def->uuid, uuidstr);
     virObjectRef(dom);
     virObjectUnlock(dom);
 
-    virObjectLock(doms);
+    shard = virDomainObjListGetShard(doms, uuidstr);
+    virRWLockWrite(&shard->lock);
     virObjectLock(dom);
-    virHashRemoveEntry(doms->objs, uuidstr);
-    virHashRemoveEntry(doms->objsName, dom->def->name);
+    virHashRemoveEntry(shard->objs, uuidstr);
+    virHashRemoveEntry(shard->objsName, dom->def->name);
+    virAtomicIntInc(&doms->generation);
     virObjectUnlock(dom);
     virObjectUnref(dom);
-    virObjectUnlock(doms);
+    virRWLockUnlock(&shard->lock);
 }
 
 
@@ -364,9 +504,9 @@ void virDomainObjListRemove(virDomainObjListPtr doms,
  *
  * The caller must hold a lock on dom. Callbacks should not
  * sleep/wait otherwise operations on all domains will be blocked
- * as the callback is called with domains lock hold. Domain lock
- * is dropped/reacquired during this operation thus domain
- * consistency must not rely on this lock solely.
+ * as the callback is called with all list shards write locked.
+ * Domain lock is dropped/reacquired during this operation thus
+ * domain consistency must not rely on this lock solely.
  */
 int
 virDomainObjListRename(virDomainObjListPtr doms,
@@ -378,6 +518,8 @@ virDomainObjListRename(virDomainObjListPtr doms,
 {
     int ret = -1;
     char *old_name = NULL;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjListShardPtr shard;
     int rc;
 
     if (STREQ(dom->def->name, new_name)) {
@@ -389,23 +531,26 @@ virDomainObjListRename(virDomainObjListPtr doms,
     if (VIR_STRDUP(old_name, dom->def->name) < 0)
         return ret;
 
-    /* doms and dom locks must be attained in right order thus relock dom. */
+    /* shard and dom locks must be attained in right order thus relock dom. */
     /* dom reference is touched for the benefit of those callers that
      * hold a lock on dom but not refcount it. */
     virObjectRef(dom);
     virObjectUnlock(dom);
-    virObjectLock(doms);
+    virDomainObjListLockAllWrite(doms);
     virObjectLock(dom);
     virObjectUnref(dom);
 
-    if (virHashLookup(doms->objsName, new_name) != NULL) {
+    if (virDomainObjListFindByNameAllLocked(doms, new_name) != NULL) {
         virReportError(VIR_ERR_OPERATION_INVALID,
                        _("domain with name '%s' already exists"),
                        new_name);
         goto cleanup;
     }
 
-    if (virHashAddEntry(doms->objsName, new_name, dom) < 0)
+    virUUIDFormat(dom->def->uuid, uuidstr);
+    shard = virDomainObjListGetShard(doms, uuidstr);
+
+    if (virHashAddEntry(shard->objsName, new_name, dom) < 0)
         goto cleanup;
 
     /* Okay, this is crazy. virHashAddEntry() does not increment
@@ -414,19 +559,19 @@ virDomainObjListRename(virDomainObjListPtr doms,
     virObjectRef(dom);
 
     rc = callback(dom, new_name, flags, opaque);
-    virHashRemoveEntry(doms->objsName, rc < 0 ? new_name : old_name);
+    virHashRemoveEntry(shard->objsName, rc < 0 ? new_name : old_name);
     if (rc < 0)
         goto cleanup;
 
     ret = 0;
  cleanup:
-    virObjectUnlock(doms);
+    virDomainObjListUnlockAll(doms);
     VIR_FREE(old_name);
     return ret;
 }
 
-/* The caller must hold lock on 'doms' in addition to 'virDomainObjListRemove'
- * requirements
+/* The caller must hold the write lock on the shard owning 'dom', in
+ * addition to 'virDomainObjListRemove' requirements
  *
  * Can be used to remove current element while iterating with
  * virDomainObjListForEach
@@ -435,47 +580,31 @@ void virDomainObjListRemoveLocked(virDomainObjListPtr doms,
                                   virDomainObjPtr dom)
 {
     char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjListShardPtr shard;
 
     virUUIDFormat(dom->def->uuid, uuidstr);
+    shard = virDomainObjListGetShard(doms, uuidstr);
 
-    virHashRemoveEntry(doms->objs, uuidstr);
-    virHashRemoveEntry(doms->objsName, dom->def->name);
+    virHashRemoveEntry(shard->objs, uuidstr);
+    virHashRemoveEntry(shard->objsName, dom->def->name);
+    virAtomicIntInc(&doms->generation);
     virObjectUnlock(dom);
 }
 
 
 static virDomainObjPtr
-virDomainObjListLoadConfig(virDomainObjListPtr doms,
-                           virCapsPtr caps,
-                           virDomainXMLOptionPtr xmlopt,
-                           const char *configDir,
-                           const char *autostartDir,
-                           const char *name,
-                           virDomainLoadConfigNotify notify,
-                           void *opaque)
+virDomainObjListInsertConfigLocked(virDomainObjListPtr doms,
+                                   virDomainXMLOptionPtr xmlopt,
+                                   virDomainDefPtr def,
+                                   int autostart,
+                                   virDomainLoadConfigNotify notify,
+                                   void *opaque)
 {
-    char *configFile = NULL, *autostartLink = NULL;
-    virDomainDefPtr def = NULL;
     virDomainObjPtr dom;
-    int autostart;
     virDomainDefPtr oldDef = NULL;
 
-    if ((configFile = virDomainConfigFile(configDir, name)) == NULL)
-        goto error;
-    if (!(def = virDomainDefParseFile(configFile, caps, xmlopt,
-                                      VIR_DOMAIN_DEF_PARSE_INACTIVE |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE)))
-        goto error;
-
-    if ((autostartLink = virDomainConfigFile(autostartDir, name)) == NULL)
-        goto error;
-
-    if ((autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
-        goto error;
-
     if (!(dom = virDomainObjListAddLocked(doms, def, xmlopt, 0, &oldDef)))
-        goto error;
+        return NULL;
 
     dom->autostart = autostart;
 
@@ -483,73 +612,134 @@ virDomainObjListLoadConfig(virDomainObjListPtr doms,
         (*notify)(dom, oldDef == NULL, opaque);
 
     virDomainDefFree(oldDef);
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
     return dom;
-
- error:
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
-    virDomainDefFree(def);
-    return NULL;
 }
 
 
+/* Insert a parsed status object; @obj must be locked by the caller and
+ * the list takes over the caller's reference on success */
 static virDomainObjPtr
-virDomainObjListLoadStatus(virDomainObjListPtr doms,
-                           const char *statusDir,
-                           const char *name,
-                           virCapsPtr caps,
-                           virDomainXMLOptionPtr xmlopt,
-                           virDomainLoadConfigNotify notify,
-                           void *opaque)
+virDomainObjListInsertStatusLocked(virDomainObjListPtr doms,
+                                   virDomainObjPtr obj,
+                                   virDomainLoadConfigNotify notify,
+                                   void *opaque)
 {
-    char *statusFile = NULL;
-    virDomainObjPtr obj = NULL;
     char uuidstr[VIR_UUID_STRING_BUFLEN];
-
-    if ((statusFile = virDomainConfigFile(statusDir, name)) == NULL)
-        goto error;
-
-    if (!(obj = virDomainObjParseFile(statusFile, caps, xmlopt,
-                                      VIR_DOMAIN_DEF_PARSE_STATUS |
-                                      VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
-                                      VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE)))
-        goto error;
+    virDomainObjListShardPtr shard;
 
     virUUIDFormat(obj->def->uuid, uuidstr);
+    shard = virDomainObjListGetShard(doms, uuidstr);
 
-    if (virHashLookup(doms->objs, uuidstr) != NULL) {
+    if (virHashLookup(shard->objs, uuidstr) != NULL) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("unexpected domain %s already exists"),
                        obj->def->name);
-        goto error;
+        return NULL;
     }
 
-    if (virHashAddEntry(doms->objs, uuidstr, obj) < 0)
-        goto error;
+    if (virHashAddEntry(shard->objs, uuidstr, obj) < 0)
+        return NULL;
 
-    if (virHashAddEntry(doms->objsName, obj->def->name, obj) < 0) {
-        virHashRemoveEntry(doms->objs, uuidstr);
-        goto error;
+    if (virHashAddEntry(shard->objsName, obj->def->name, obj) < 0) {
+        virHashRemoveEntry(shard->objs, uuidstr);
+        return NULL;
     }
 
     /* Since domain is in two hash tables, increment the
      * reference counter */
     virObjectRef(obj);
 
+    virAtomicIntInc(&doms->generation);
+
     if (notify)
         (*notify)(obj, 1, opaque);
 
-    VIR_FREE(statusFile);
     return obj;
+}
 
- error:
-    virObjectUnref(obj);
-    VIR_FREE(statusFile);
-    return NULL;
+
+/* Cap on the threads parsing configs concurrently during
+ * virDomainObjListLoadAllConfigs; parsing is CPU bound so there is no
+ * point going beyond the number of online CPUs */
+#define VIR_DOMAIN_OBJ_LIST_LOAD_MAX_WORKERS 16
+
+struct virDomainObjListLoadEntry {
+    char *name;                 /* file name with the ".xml" stripped */
+    virDomainDefPtr def;        /* parsed config, when !liveStatus */
+    virDomainObjPtr obj;        /* parsed status object, when liveStatus */
+    int autostart;
+};
+
+struct virDomainObjListLoadData {
+    const char *configDir;
+    const char *autostartDir;
+    int liveStatus;
+    virCapsPtr caps;
+    virDomainXMLOptionPtr xmlopt;
+    struct virDomainObjListLoadEntry *entries;
+    size_t nentries;
+    size_t nworkers;
+};
+
+struct virDomainObjListLoadWorker {
+    virThread thread;
+    bool started;
+    size_t first;               /* first entry index; stride is nworkers */
+    struct virDomainObjListLoadData *data;
+};
+
+
+/* Parse the entries first, first + nworkers, first + 2 * nworkers, ...
+ * Each entry is touched by exactly one worker, so the results need no
+ * locking until they are inserted into the list */
+static void
+virDomainObjListLoadWorker(void *opaque)
+{
+    struct virDomainObjListLoadWorker *worker = opaque;
+    struct virDomainObjListLoadData *data = worker->data;
+    size_t i;
+
+    for (i = worker->first; i < data->nentries; i += data->nworkers) {
+        struct virDomainObjListLoadEntry *entry = &data->entries[i];
+        char *file = NULL;
+        char *autostartLink = NULL;
+
+        /* NB: ignoring errors, so one malformed config doesn't
+           kill the whole process */
+        VIR_INFO("Loading config file '%s.xml'", entry->name);
+
+        if (!(file = virDomainConfigFile(data->configDir, entry->name)))
+            continue;
+
+        if (data->liveStatus) {
+            entry->obj = virDomainObjParseFile(file, data->caps, data->xmlopt,
+                                               VIR_DOMAIN_DEF_PARSE_STATUS |
+                                               VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
+                                               VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
+                                               VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
+                                               VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE);
+            /* hand the object over to the main thread unlocked */
+            if (entry->obj)
+                virObjectUnlock(entry->obj);
+        } else {
+            entry->def = virDomainDefParseFile(file, data->caps, data->xmlopt,
+                                               VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                               VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
+                                               VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE);
+
+            if (entry->def &&
+                (autostartLink = virDomainConfigFile(data->autostartDir,
+                                                     entry->name)) &&
+                (entry->autostart = virFileLinkPointsTo(autostartLink,
+                                                        file)) < 0) {
+                virDomainDefFree(entry->def);
+                entry->def = NULL;
+            }
+        }
+
+        VIR_FREE(autostartLink);
+        VIR_FREE(file);
+    }
 }
 
 
@@ -565,6 +755,12 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
 {
     DIR *dir;
     struct dirent *entry;
+    struct virDomainObjListLoadData data = { configDir, autostartDir,
+                                             liveStatus, caps, xmlopt,
+                                             NULL, 0, 0 };
+    struct virDomainObjListLoadWorker *workers = NULL;
+    long ncpus;
+    size_t i;
     int ret = -1;
     int rc;
 
@@ -573,43 +769,100 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
     if ((rc = virDirOpenIfExists(&dir, configDir)) <= 0)
         return rc;
 
-    virObjectLock(doms);
-
-    while ((ret = virDirRead(dir, &entry, configDir)) > 0) {
-        virDomainObjPtr dom;
+    /* Batch the directory scan up front so that the files can be
+     * parsed without the directory handle or the list lock held */
+    while ((rc = virDirRead(dir, &entry, configDir)) > 0) {
+        struct virDomainObjListLoadEntry e = { NULL, NULL, NULL, 0 };
 
         if (!virFileStripSuffix(entry->d_name, ".xml"))
             continue;
 
-        /* NB: ignoring errors, so one malformed config doesn't
-           kill the whole process */
-        VIR_INFO("Loading config file '%s.xml'", entry->d_name);
-        if (liveStatus)
-            dom = virDomainObjListLoadStatus(doms,
-                                             configDir,
-                                             entry->d_name,
-                                             caps,
-                                             xmlopt,
-                                             notify,
-                                             opaque);
-        else
-            dom = virDomainObjListLoadConfig(doms,
-                                             caps,
-                                             xmlopt,
-                                             configDir,
-                                             autostartDir,
-                                             entry->d_name,
-                                             notify,
-                                             opaque);
-        if (dom) {
-            if (!liveStatus)
-                dom->persistent = 1;
+        if (VIR_STRDUP(e.name, entry->d_name) < 0 ||
+            VIR_APPEND_ELEMENT(data.entries, data.nentries, e) < 0) {
+            VIR_FREE(e.name);
+            VIR_DIR_CLOSE(dir);
+            goto cleanup;
+        }
+    }
+    VIR_DIR_CLOSE(dir);
+    if (rc < 0)
+        goto cleanup;
+
+    if (data.nentries == 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    /* Parse everything outside the list lock; the XML parser dominates
+     * the load time, so spread it over the online CPUs while the
+     * workers also overlap the config file I/O */
+    data.nworkers = data.nentries;
+    if ((ncpus = sysconf(_SC_NPROCESSORS_ONLN)) > 0 &&
+        (size_t) ncpus < data.nworkers)
+        data.nworkers = ncpus;
+    if (data.nworkers > VIR_DOMAIN_OBJ_LIST_LOAD_MAX_WORKERS)
+        data.nworkers = VIR_DOMAIN_OBJ_LIST_LOAD_MAX_WORKERS;
+
+    if (VIR_ALLOC_N(workers, data.nworkers) < 0)
+        goto cleanup;
+
+    for (i = 0; i < data.nworkers; i++) {
+        workers[i].first = i;
+        workers[i].data = &data;
+        workers[i].started =
+            virThreadCreate(&workers[i].thread, true,
+                            virDomainObjListLoadWorker, &workers[i]) == 0;
+    }
+
+    for (i = 0; i < data.nworkers; i++) {
+        if (workers[i].started)
+            virThreadJoin(&workers[i].thread);
+        else /* thread creation failed; parse this worker's share inline */
+            virDomainObjListLoadWorker(&workers[i]);
+    }
+
+    /* Only the insertion into the hash tables needs the write lock */
+    virDomainObjListLockAllWrite(doms);
+
+    for (i = 0; i < data.nentries; i++) {
+        struct virDomainObjListLoadEntry *e = &data.entries[i];
+        virDomainObjPtr dom;
+
+        if (liveStatus) {
+            if (!e->obj)
+                continue;
+            virObjectLock(e->obj);
+            if ((dom = virDomainObjListInsertStatusLocked(doms, e->obj,
+                                                          notify, opaque)))
+                e->obj = NULL; /* owned by the list now */
+            else
+                dom = e->obj; /* just needs unlocking */
             virObjectUnlock(dom);
+        } else {
+            if (!e->def)
+                continue;
+            if ((dom = virDomainObjListInsertConfigLocked(doms, xmlopt,
+                                                          e->def,
+                                                          e->autostart,
+                                                          notify, opaque))) {
+                e->def = NULL; /* owned by the domain object now */
+                dom->persistent = 1;
+                virObjectUnlock(dom);
+            }
         }
     }
 
-    VIR_DIR_CLOSE(dir);
-    virObjectUnlock(doms);
+    virDomainObjListUnlockAll(doms);
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < data.nentries; i++) {
+        VIR_FREE(data.entries[i].name);
+        virDomainDefFree(data.entries[i].def);
+        virObjectUnref(data.entries[i].obj);
+    }
+    VIR_FREE(data.entries);
+    VIR_FREE(workers);
     return ret;
 }
 
@@ -653,9 +906,15 @@ virDomainObjListNumOfDomains(virDomainObjListPtr doms,
                              virConnectPtr conn)
 {
     struct virDomainObjListData data = { filter, conn, active, 0 };
-    virObjectLock(doms);
-    virHashForEach(doms->objs, virDomainObjListCount, &data);
-    virObjectUnlock(doms);
+    size_t i;
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_NSHARDS; i++) {
+        virDomainObjListShardPtr shard = &doms->shards[i];
+
+        virRWLockRead(&shard->lock);
+        virHashForEachConst(shard->objs, virDomainObjListCount, &data);
+        virRWLockUnlock(&shard->lock);
+    }
     return data.count;
 }
 
@@ -697,9 +956,15 @@ virDomainObjListGetActiveIDs(virDomainObjListPtr doms,
 {
     struct virDomainIDData data = { filter, conn,
                                     0, maxids, ids };
-    virObjectLock(doms);
-    virHashForEach(doms->objs, virDomainObjListCopyActiveIDs, &data);
-    virObjectUnlock(doms);
+    size_t i;
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_NSHARDS; i++) {
+        virDomainObjListShardPtr shard = &doms->shards[i];
+
+        virRWLockRead(&shard->lock);
+        virHashForEachConst(shard->objs, virDomainObjListCopyActiveIDs, &data);
+        virRWLockUnlock(&shard->lock);
+    }
     return data.numids;
 }
 
@@ -751,9 +1016,14 @@ virDomainObjListGetInactiveNames(virDomainObjListPtr doms,
     struct virDomainNameData data = { filter, conn,
                                       0, 0, maxnames, names };
     size_t i;
-    virObjectLock(doms);
-    virHashForEach(doms->objs, virDomainObjListCopyInactiveNames, &data);
-    virObjectUnlock(doms);
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_NSHARDS; i++) {
+        virDomainObjListShardPtr shard = &doms->shards[i];
+
+        virRWLockRead(&shard->lock);
+        virHashForEachConst(shard->objs, virDomainObjListCopyInactiveNames, &data);
+        virRWLockUnlock(&shard->lock);
+    }
     if (data.oom) {
         for (i = 0; i < data.numnames; i++)
             VIR_FREE(data.names[i]);
@@ -792,9 +1062,17 @@ virDomainObjListForEach(virDomainObjListPtr doms,
     struct virDomainListIterData data = {
         callback, opaque, 0,
     };
-    virObjectLock(doms);
-    virHashForEach(doms->objs, virDomainObjListHelper, &data);
-    virObjectUnlock(doms);
+    size_t i;
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_NSHARDS; i++) {
+        virDomainObjListShardPtr shard = &doms->shards[i];
+
+        /* Write lock, so that callbacks may remove the current
+         * element via virDomainObjListRemoveLocked */
+        virRWLockWrite(&shard->lock);
+        virHashForEach(shard->objs, virDomainObjListHelper, &data);
+        virRWLockUnlock(&shard->lock);
+    }
     return data.ret;
 }
 
@@ -915,6 +1193,47 @@ virDomainObjListFilter(virDomainObjPtr **list,
 }
 
 
+/* Rebuild the cached membership snapshot; the caller must hold
+ * @domlist->snapshotLock. @generation must have been read before
+ * iterating starts, so a domain inserted or removed while we scan the
+ * shards at worst tags the snapshot as already stale, never as newer
+ * than it really is */
+static int
+virDomainObjListSnapshotRebuild(virDomainObjListPtr domlist,
+                                int generation)
+{
+    struct virDomainListData data = { NULL, 0 };
+    size_t nalloc = 0;
+    size_t i;
+
+    virObjectListFreeCount(domlist->snapshotVms, domlist->snapshotNvms);
+    domlist->snapshotVms = NULL;
+    domlist->snapshotNvms = 0;
+    domlist->snapshotValid = false;
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_NSHARDS; i++) {
+        virDomainObjListShardPtr shard = &domlist->shards[i];
+
+        virRWLockRead(&shard->lock);
+        if (VIR_RESIZE_N(data.vms, nalloc, data.nvms,
+                         virHashSize(shard->objs)) < 0) {
+            virRWLockUnlock(&shard->lock);
+            virObjectListFreeCount(data.vms, data.nvms);
+            return -1;
+        }
+        virHashForEachConst(shard->objs, virDomainObjListCollectIterator, &data);
+        virRWLockUnlock(&shard->lock);
+    }
+
+    domlist->snapshotVms = data.vms;
+    domlist->snapshotNvms = data.nvms;
+    domlist->snapshotGeneration = generation;
+    domlist->snapshotValid = true;
+
+    return 0;
+}
+
+
 int
 virDomainObjListCollect(virDomainObjListPtr domlist,
                         virConnectPtr conn,
@@ -924,16 +1243,31 @@ virDomainObjListCollect(virDomainObjListPtr domlist,
                         unsigned int flags)
 {
     struct virDomainListData data = { NULL, 0 };
+    int generation = virAtomicIntGet(&domlist->generation);
+    size_t i;
+
+    virMutexLock(&domlist->snapshotLock);
 
-    virObjectLock(domlist);
-    sa_assert(domlist->objs);
-    if (VIR_ALLOC_N(data.vms, virHashSize(domlist->objs)) < 0) {
-        virObjectUnlock(domlist);
+    if ((!domlist->snapshotValid ||
+         domlist->snapshotGeneration != generation) &&
+        virDomainObjListSnapshotRebuild(domlist, generation) < 0) {
+        virMutexUnlock(&domlist->snapshotLock);
         return -1;
     }
 
-    virHashForEach(domlist->objs, virDomainObjListCollectIterator, &data);
-    virObjectUnlock(domlist);
+    /* Hand out references on the snapshot; domains removed since it
+     * was taken are still safe to touch and are dropped below by the
+     * filter, which skips objects marked as removing */
+    if (domlist->snapshotNvms &&
+        VIR_ALLOC_N(data.vms, domlist->snapshotNvms) < 0) {
+        virMutexUnlock(&domlist->snapshotLock);
+        return -1;
+    }
+    for (i = 0; i < domlist->snapshotNvms; i++)
+        data.vms[i] = virObjectRef(domlist->snapshotVms[i]);
+    data.nvms = domlist->snapshotNvms;
+
+    virMutexUnlock(&domlist->snapshotLock);
 
     virDomainObjListFilter(&data.vms, &data.nvms, conn, filter, flags);
 
@@ -962,17 +1296,19 @@ virDomainObjListConvert(virDomainObjListPtr domlist,
     *nvms = 0;
     *vms = NULL;
 
-    virObjectLock(domlist);
     for (i = 0; i < ndoms; i++) {
         virDomainPtr dom = doms[i];
+        virDomainObjListShardPtr shard;
 
         virUUIDFormat(dom->uuid, uuidstr);
+        shard = virDomainObjListGetShard(domlist, uuidstr);
 
-        if (!(vm = virHashLookup(domlist->objs, uuidstr))) {
+        virRWLockRead(&shard->lock);
+        if (!(vm = virHashLookup(shard->objs, uuidstr))) {
+            virRWLockUnlock(&shard->lock);
             if (skip_missing)
                 continue;
 
-            virObjectUnlock(domlist);
             virReportError(VIR_ERR_NO_DOMAIN,
                            _("no domain with matching uuid '%s' (%s)"),
                            uuidstr, dom->name);
@@ -980,14 +1316,13 @@ virDomainObjListConvert(virDomainObjListPtr domlist,
         }
 
         virObjectRef(vm);
+        virRWLockUnlock(&shard->lock);
 
         if (VIR_APPEND_ELEMENT(*vms, *nvms, vm) < 0) {
-            virObjectUnlock(domlist);
             virObjectUnref(vm);
             goto error;
         }
     }
-    virObjectUnlock(domlist);
 
     sa_assert(*vms);
     virDomainObjListFilter(vms, nvms, conn, filter, flags);
@@ -1003,16 +1338,37 @@ virDomainObjListConvert(virDomainObjListPtr domlist,
 }
 
 
+/**
+ * virDomainObjListExportPage:
+ * @matchName: optional fnmatch() glob the domain name must match
+ * @offset: number of matching domains to skip
+ * @limit: cap on the number of domains returned, 0 for no cap
+ *
+ * Paged variant of virDomainObjListExport. @offset and @limit are
+ * applied after flag, ACL and @matchName filtering, so successive
+ * pages with a fixed filter tile the whole list. Collection iterates
+ * the cached membership snapshot, whose order is stable for as long
+ * as no domain is added or removed, which keeps consecutive pages
+ * coherent on a quiescent host.
+ *
+ * Returns the number of domains placed in @domains, or the total
+ * match count when @domains is NULL (paging is then ignored).
+ */
 int
-virDomainObjListExport(virDomainObjListPtr domlist,
-                       virConnectPtr conn,
-                       virDomainPtr **domains,
-                       virDomainObjListACLFilter filter,
-                       unsigned int flags)
+virDomainObjListExportPage(virDomainObjListPtr domlist,
+                           virConnectPtr conn,
+                           virDomainPtr **domains,
+                           virDomainObjListACLFilter filter,
+                           unsigned int flags,
+                           const char *matchName,
+                           size_t offset,
+                           size_t limit)
 {
     virDomainObjPtr *vms = NULL;
     virDomainPtr *doms = NULL;
     size_t nvms = 0;
+    size_t ndoms = 0;
+    size_t nmatched = 0;
     size_t i;
     int ret = -1;
 
@@ -1020,32 +1376,68 @@ virDomainObjListExport(virDomainObjListPtr domlist,
         return -1;
 
     if (domains) {
-        if (VIR_ALLOC_N(doms, nvms + 1) < 0)
+        size_t ndomsmax = nvms;
+
+        if (limit && limit < ndomsmax)
+            ndomsmax = limit;
+        if (VIR_ALLOC_N(doms, ndomsmax + 1) < 0)
             goto cleanup;
+    }
 
-        for (i = 0; i < nvms; i++) {
-            virDomainObjPtr vm = vms[i];
+    for (i = 0; i < nvms; i++) {
+        virDomainObjPtr vm = vms[i];
 
-            virObjectLock(vm);
+        virObjectLock(vm);
 
-            if (!(doms[i] = virGetDomain(conn, vm->def->name, vm->def->uuid))) {
-                virObjectUnlock(vm);
-                goto cleanup;
-            }
+        if (matchName &&
+            fnmatch(matchName, vm->def->name, 0) != 0) {
+            virObjectUnlock(vm);
+            continue;
+        }
+
+        nmatched++;
 
-            doms[i]->id = vm->def->id;
+        if (!doms ||
+            nmatched <= offset ||
+            (limit && ndoms == limit)) {
+            virObjectUnlock(vm);
+            continue;
+        }
 
+        if (!(doms[ndoms] = virGetDomain(conn, vm->def->name,
+                                         vm->def->uuid))) {
             virObjectUnlock(vm);
+            goto cleanup;
         }
 
+        doms[ndoms]->id = vm->def->id;
+        ndoms++;
+
+        virObjectUnlock(vm);
+    }
+
+    if (domains) {
         *domains = doms;
         doms = NULL;
+        ret = ndoms;
+    } else {
+        ret = nmatched;
     }
 
-    ret = nvms;
-
  cleanup:
     virObjectListFree(doms);
     virObjectListFreeCount(vms, nvms);
     return ret;
 }
+
+
+int
+virDomainObjListExport(virDomainObjListPtr domlist,
+                       virConnectPtr conn,
+                       virDomainPtr **domains,
+                       virDomainObjListACLFilter filter,
+                       unsigned int flags)
+{
+    return virDomainObjListExportPage(domlist, conn, domains,
+                                      filter, flags, NULL, 0, 0);
+}
@@ -146,6 +146,14 @@ int virDomainObjListExport(virDomainObjListPtr doms,
                            virDomainPtr **domains,
                            virDomainObjListACLFilter filter,
                            unsigned int flags);
+int virDomainObjListExportPage(virDomainObjListPtr doms,
+                               virConnectPtr conn,
+                               virDomainPtr **domains,
+                               virDomainObjListACLFilter filter,
+                               unsigned int flags,
+                               const char *matchName,
+                               size_t offset,
+                               size_t limit);
 int virDomainObjListConvert(virDomainObjListPtr domlist,
                             virConnectPtr conn,
                             virDomainPtr *doms,
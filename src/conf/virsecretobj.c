@@ -57,11 +57,11 @@ struct _virSecretObjList {
     /* uuid string -> virSecretObj  mapping
      * for O(1), lockless lookup-by-uuid */
     virHashTable *objs;
-};
 
-struct virSecretSearchData {
-    int usageType;
-    const char *usageID;
+    /* "usageType:usageID" -> virSecretObj mapping for O(1)
+     * lookup-by-usage; secrets with usage type 'none' are not
+     * entered */
+    virHashTable *objsUsage;
 };
 
 
@@ -124,7 +124,8 @@ virSecretObjListNew(void)
     if (!(secrets = virObjectLockableNew(virSecretObjListClass)))
         return NULL;
 
-    if (!(secrets->objs = virHashCreate(50, virObjectFreeHashData))) {
+    if (!(secrets->objs = virHashCreate(50, virObjectFreeHashData)) ||
+        !(secrets->objsUsage = virHashCreate(50, virObjectFreeHashData))) {
         virObjectUnref(secrets);
         return NULL;
     }
@@ -155,6 +156,19 @@ virSecretObjListDispose(void *obj)
     virSecretObjListPtr secrets = obj;
 
     virHashFree(secrets->objs);
+    virHashFree(secrets->objsUsage);
+}
+
+
+/* Build the key the usage index is hashed on */
+static char *
+virSecretObjListUsageKey(int usageType,
+                         const char *usageID)
+{
+    char *key = NULL;
+
+    ignore_value(virAsprintf(&key, "%d:%s", usageType, NULLSTR(usageID)));
+    return key;
 }
 
 
@@ -204,47 +218,6 @@ virSecretObjListFindByUUID(virSecretObjListPtr secrets,
 }
 
 
-static int
-virSecretObjSearchName(const void *payload,
-                       const void *name ATTRIBUTE_UNUSED,
-                       const void *opaque)
-{
-    virSecretObjPtr secret = (virSecretObjPtr) payload;
-    struct virSecretSearchData *data = (struct virSecretSearchData *) opaque;
-    int found = 0;
-
-    virObjectLock(secret);
-
-    if (secret->def->usage_type != data->usageType)
-        goto cleanup;
-
-    switch (data->usageType) {
-    case VIR_SECRET_USAGE_TYPE_NONE:
-    /* never match this */
-        break;
-
-    case VIR_SECRET_USAGE_TYPE_VOLUME:
-        if (STREQ(secret->def->usage.volume, data->usageID))
-            found = 1;
-        break;
-
-    case VIR_SECRET_USAGE_TYPE_CEPH:
-        if (STREQ(secret->def->usage.ceph, data->usageID))
-            found = 1;
-        break;
-
-    case VIR_SECRET_USAGE_TYPE_ISCSI:
-        if (STREQ(secret->def->usage.target, data->usageID))
-            found = 1;
-        break;
-    }
-
- cleanup:
-    virObjectUnlock(secret);
-    return found;
-}
-
-
 /**
  * virSecretObjFindByUsageLocked:
  * @secrets: list of secret objects
@@ -260,13 +233,18 @@ virSecretObjListFindByUsageLocked(virSecretObjListPtr secrets,
                                   int usageType,
                                   const char *usageID)
 {
-    virSecretObjPtr ret = NULL;
-    struct virSecretSearchData data = { .usageType = usageType,
-                                        .usageID = usageID };
+    virSecretObjPtr ret;
+    char *key;
 
-    ret = virHashSearch(secrets->objs, virSecretObjSearchName, &data);
-    if (ret)
-        virObjectRef(ret);
+    /* usage type 'none' never matches anything */
+    if (usageType == VIR_SECRET_USAGE_TYPE_NONE)
+        return NULL;
+
+    if (!(key = virSecretObjListUsageKey(usageType, usageID)))
+        return NULL;
+
+    ret = virObjectRef(virHashLookup(secrets->objsUsage, key));
+    VIR_FREE(key);
     return ret;
 }
 
@@ -319,6 +297,15 @@ virSecretObjListRemove(virSecretObjListPtr secrets,
 
     virObjectLock(secrets);
     virObjectLock(secret);
+    if (secret->def->usage_type != VIR_SECRET_USAGE_TYPE_NONE) {
+        char *usageKey =
+            virSecretObjListUsageKey(secret->def->usage_type,
+                                     virSecretUsageIDForDef(secret->def));
+
+        if (usageKey)
+            virHashRemoveEntry(secrets->objsUsage, usageKey);
+        VIR_FREE(usageKey);
+    }
     virHashRemoveEntry(secrets->objs, uuidstr);
     virObjectUnlock(secret);
     virObjectUnref(secret);
@@ -350,6 +337,7 @@ virSecretObjListAddLocked(virSecretObjListPtr secrets,
     const char *newUsageID = virSecretUsageIDForDef(def);
     char uuidstr[VIR_UUID_STRING_BUFLEN];
     char *configFile = NULL, *base64File = NULL;
+    char *usageKey = NULL;
 
     if (oldDef)
         *oldDef = NULL;
@@ -376,6 +364,34 @@ virSecretObjListAddLocked(virSecretObjListPtr secrets,
             goto cleanup;
         }
 
+        /* move the usage index entry if the usage type changed; the
+         * usage ID is already known to match */
+        if (secret->def->usage_type != def->usage_type) {
+            char *oldKey = NULL;
+            bool ok = true;
+
+            if (secret->def->usage_type != VIR_SECRET_USAGE_TYPE_NONE &&
+                !(oldKey = virSecretObjListUsageKey(secret->def->usage_type,
+                                                    oldUsageID)))
+                ok = false;
+
+            if (ok && def->usage_type != VIR_SECRET_USAGE_TYPE_NONE) {
+                if (!(usageKey = virSecretObjListUsageKey(def->usage_type,
+                                                          newUsageID)) ||
+                    virHashAddEntry(secrets->objsUsage, usageKey, secret) < 0)
+                    ok = false;
+                else
+                    virObjectRef(secret);
+            }
+
+            if (ok && oldKey)
+                virHashRemoveEntry(secrets->objsUsage, oldKey);
+
+            VIR_FREE(oldKey);
+            if (!ok)
+                goto cleanup;
+        }
+
         if (oldDef)
             *oldDef = secret->def;
         else
@@ -409,8 +425,19 @@ virSecretObjListAddLocked(virSecretObjListPtr secrets,
 
         virObjectLock(secret);
 
-        if (virHashAddEntry(secrets->objs, uuidstr, secret) < 0)
+        if (def->usage_type != VIR_SECRET_USAGE_TYPE_NONE) {
+            if (!(usageKey = virSecretObjListUsageKey(def->usage_type,
+                                                      newUsageID)) ||
+                virHashAddEntry(secrets->objsUsage, usageKey, secret) < 0)
+                goto cleanup;
+            virObjectRef(secret);
+        }
+
+        if (virHashAddEntry(secrets->objs, uuidstr, secret) < 0) {
+            if (usageKey)
+                virHashRemoveEntry(secrets->objsUsage, usageKey);
             goto cleanup;
+        }
 
         secret->def = def;
         secret->configFile = configFile;
@@ -427,6 +454,7 @@ virSecretObjListAddLocked(virSecretObjListPtr secrets,
     virSecretObjEndAPI(&secret);
     VIR_FREE(configFile);
     VIR_FREE(base64File);
+    VIR_FREE(usageKey);
     return ret;
 }
 
@@ -705,11 +733,21 @@ int
 virSecretObjSaveConfig(virSecretObjPtr secret)
 {
     char *xml = NULL;
+    char *oldxml = NULL;
     int ret = -1;
 
     if (!(xml = virSecretDefFormat(secret->def)))
         goto cleanup;
 
+    /* Redefining a secret with unchanged attributes is common when
+     * jobs rotate many secret values in a burst; skip the rewrite
+     * and its fsync if the file already has the right content */
+    if (virFileReadAllQuiet(secret->configFile, 1024 * 1024, &oldxml) >= 0 &&
+        STREQ(xml, oldxml)) {
+        ret = 0;
+        goto cleanup;
+    }
+
     if (virFileRewrite(secret->configFile, S_IRUSR | S_IWUSR,
                        virSecretRewriteFile, xml) < 0)
         goto cleanup;
@@ -717,6 +755,7 @@ virSecretObjSaveConfig(virSecretObjPtr secret)
     ret = 0;
 
  cleanup:
+    VIR_FREE(oldxml);
     VIR_FREE(xml);
     return ret;
 }
@@ -32,6 +32,7 @@
 #include "cpu_x86.h"
 #include "virbuffer.h"
 #include "virendian.h"
+#include "virhash.h"
 #include "virstring.h"
 
 #define VIR_FROM_THIS VIR_FROM_CPU
@@ -150,6 +151,13 @@ struct _virCPUx86Map {
     virCPUx86ModelPtr *models;
     size_t nblockers;
     virCPUx86FeaturePtr *migrate_blockers;
+
+    /* name -> element indexes over the arrays above; the hash tables do not
+     * own the elements they point to
+     */
+    virHashTablePtr vendorIndex;
+    virHashTablePtr featureIndex;
+    virHashTablePtr modelIndex;
 };
 
 static virCPUx86MapPtr cpuMap;
@@ -278,21 +286,44 @@ x86DataCpuidNext(virCPUx86DataIteratorPtr iterator)
 }
 
 
+/* Binary search for the leaf matching (eax_in, ecx_in); the array is
+ * kept sorted by virCPUx86DataAddCPUID.  If the leaf is missing and
+ * @pos is non-NULL, the position where it would have to be inserted
+ * is returned in it.
+ */
 static virCPUx86CPUID *
-x86DataCpuid(const virCPUx86Data *data,
-             const virCPUx86CPUID *cpuid)
+x86DataCpuidPos(const virCPUx86Data *data,
+                const virCPUx86CPUID *cpuid,
+                size_t *pos)
 {
-    size_t i;
+    size_t lo = 0;
+    size_t hi = data->len;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = virCPUx86CPUIDSorter(data->data + mid, cpuid);
 
-    for (i = 0; i < data->len; i++) {
-        if (data->data[i].eax_in == cpuid->eax_in &&
-            data->data[i].ecx_in == cpuid->ecx_in)
-            return data->data + i;
+        if (cmp == 0)
+            return data->data + mid;
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
 
+    if (pos)
+        *pos = lo;
     return NULL;
 }
 
+
+static virCPUx86CPUID *
+x86DataCpuid(const virCPUx86Data *data,
+             const virCPUx86CPUID *cpuid)
+{
+    return x86DataCpuidPos(data, cpuid, NULL);
+}
+
 void
 virCPUx86DataClear(virCPUx86Data *data)
 {
@@ -351,16 +382,14 @@ virCPUx86DataAddCPUID(virCPUx86Data *data,
                       const virCPUx86CPUID *cpuid)
 {
     virCPUx86CPUID *existing;
+    size_t pos = 0;
 
-    if ((existing = x86DataCpuid(data, cpuid))) {
+    if ((existing = x86DataCpuidPos(data, cpuid, &pos))) {
         x86cpuidSetBits(existing, cpuid);
     } else {
-        if (VIR_APPEND_ELEMENT_COPY(data->data, data->len,
+        if (VIR_INSERT_ELEMENT_COPY(data->data, pos, data->len,
                                     *((virCPUx86CPUID *)cpuid)) < 0)
             return -1;
-
-        qsort(data->data, data->len,
-              sizeof(virCPUx86CPUID), virCPUx86CPUIDSorter);
     }
 
     return 0;
@@ -626,14 +655,7 @@ static virCPUx86VendorPtr
 x86VendorFind(virCPUx86MapPtr map,
               const char *name)
 {
-    size_t i;
-
-    for (i = 0; i < map->nvendors; i++) {
-        if (STREQ(map->vendors[i]->name, name))
-            return map->vendors[i];
-    }
-
-    return NULL;
+    return virHashLookup(map->vendorIndex, name);
 }
 
 
@@ -707,6 +729,8 @@ x86VendorsLoad(virCPUx86MapPtr map,
         if (!(vendor = x86VendorParse(ctxt, map)))
             return -1;
         map->vendors[map->nvendors++] = vendor;
+        if (virHashAddEntry(map->vendorIndex, vendor->name, vendor) < 0)
+            return -1;
     }
 
     return 0;
@@ -741,14 +765,7 @@ static virCPUx86FeaturePtr
 x86FeatureFind(virCPUx86MapPtr map,
                const char *name)
 {
-    size_t i;
-
-    for (i = 0; i < map->nfeatures; i++) {
-        if (STREQ(map->features[i]->name, name))
-            return map->features[i];
-    }
-
-    return NULL;
+    return virHashLookup(map->featureIndex, name);
 }
 
 
@@ -920,6 +937,8 @@ x86FeaturesLoad(virCPUx86MapPtr map,
         if (!(feature = x86FeatureParse(ctxt, map)))
             return -1;
         map->features[map->nfeatures++] = feature;
+        if (virHashAddEntry(map->featureIndex, feature->name, feature) < 0)
+            return -1;
         if (!feature->migratable &&
             VIR_APPEND_ELEMENT(map->migrate_blockers,
                                map->nblockers,
@@ -1000,14 +1019,7 @@ static virCPUx86ModelPtr
 x86ModelFind(virCPUx86MapPtr map,
              const char *name)
 {
-    size_t i;
-
-    for (i = 0; i < map->nmodels; i++) {
-        if (STREQ(map->models[i]->name, name))
-            return map->models[i];
-    }
-
-    return NULL;
+    return virHashLookup(map->modelIndex, name);
 }
 
 
@@ -1283,6 +1295,8 @@ x86ModelsLoad(virCPUx86MapPtr map,
         if (!(model = x86ModelParse(ctxt, map)))
             return -1;
         map->models[map->nmodels++] = model;
+        if (virHashAddEntry(map->modelIndex, model->name, model) < 0)
+            return -1;
     }
 
     return 0;
@@ -1314,6 +1328,11 @@ x86MapFree(virCPUx86MapPtr map)
      */
     VIR_FREE(map->migrate_blockers);
 
+    /* the indexes only point to the elements freed above */
+    virHashFree(map->vendorIndex);
+    virHashFree(map->featureIndex);
+    virHashFree(map->modelIndex);
+
     VIR_FREE(map);
 }
 
@@ -1350,6 +1369,11 @@ virCPUx86LoadMap(void)
     if (VIR_ALLOC(map) < 0)
         return NULL;
 
+    if (!(map->vendorIndex = virHashCreate(4, NULL)) ||
+        !(map->featureIndex = virHashCreate(128, NULL)) ||
+        !(map->modelIndex = virHashCreate(64, NULL)))
+        goto error;
+
     if (cpuMapLoad("x86", x86MapLoadCallback, map) < 0)
         goto error;
 
@@ -25,6 +25,8 @@
 #  error "Don't include this file directly, only use driver.h"
 # endif
 
+# include "virsecret.h"
+
 enum {
     /* This getValue call is inside libvirt, override the "private" flag.
        This flag cannot be set by outside callers. */
@@ -64,6 +66,19 @@ typedef unsigned char *
 typedef int
 (*virDrvSecretUndefine)(virSecretPtr secret);
 
+/* Internal-only entry point combining the lookup and value fetch into
+ * one driver call, so fetching many secrets during domain startup
+ * needs a single pass through the driver per secret instead of two.
+ * Never exposed on the wire; drivers may leave it NULL, in which case
+ * callers fall back to secretLookupBy* plus secretGetValue. */
+typedef unsigned char *
+(*virDrvSecretLookupGetValue)(virConnectPtr conn,
+                              virSecretLookupTypeDefPtr seclookupdef,
+                              virSecretUsageType usageType,
+                              size_t *value_size,
+                              unsigned int flags,
+                              unsigned int internalFlags);
+
 typedef int
 (*virDrvConnectNumOfSecrets)(virConnectPtr conn);
 
@@ -98,6 +113,7 @@ struct _virSecretDriver {
     virDrvSecretSetValue secretSetValue;
     virDrvSecretGetValue secretGetValue;
     virDrvSecretUndefine secretUndefine;
+    virDrvSecretLookupGetValue secretLookupGetValue;
 };
 
 
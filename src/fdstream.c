@@ -57,6 +57,11 @@ struct virFDStreamData {
     unsigned long long offset;
     unsigned long long length;
 
+    /* the stream was opened for sparse data transfer; the fd
+     * refers to the file itself and not to an I/O helper pipe,
+     * so it can be lseek()-ed over holes */
+    bool sparse;
+
     int watch;
     int events;         /* events the stream callback is subscribed for */
     bool cbRemoved;
@@ -482,9 +487,107 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
 }
 
 
+static int
+virFDStreamSendHole(virStreamPtr st,
+                    long long length,
+                    unsigned int flags)
+{
+    struct virFDStreamData *fdst = st->privateData;
+    off_t off;
+    int oflags;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (!fdst) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "%s", _("stream is not open"));
+        return -1;
+    }
+
+    virMutexLock(&fdst->lock);
+
+    if (!fdst->sparse) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("stream does not have sparse data support"));
+        goto cleanup;
+    }
+
+    if (fdst->length) {
+        if (fdst->length - fdst->offset < length) {
+            virReportSystemError(ENOSPC, "%s",
+                                 _("cannot write to stream"));
+            goto cleanup;
+        }
+        fdst->offset += length;
+    }
+
+    if ((off = lseek(fdst->fd, length, SEEK_CUR)) == (off_t) -1) {
+        virReportSystemError(errno, "%s",
+                             _("unable to seek in stream"));
+        goto cleanup;
+    }
+
+    if ((oflags = fcntl(fdst->fd, F_GETFL)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to get stream flags"));
+        goto cleanup;
+    }
+
+    /* For an incoming stream the lseek() above merely moved the
+     * position; if the hole is trailing the file must also grow
+     * to cover it. For an outgoing stream the seek is all that's
+     * needed to skip over the hole. */
+    if ((oflags & O_ACCMODE) != O_RDONLY &&
+        ftruncate(fdst->fd, off) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to truncate stream file"));
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&fdst->lock);
+    return ret;
+}
+
+
+static int
+virFDStreamInData(virStreamPtr st,
+                  int *inData,
+                  long long *length)
+{
+    struct virFDStreamData *fdst = st->privateData;
+    int ret = -1;
+
+    if (!fdst) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "%s", _("stream is not open"));
+        return -1;
+    }
+
+    virMutexLock(&fdst->lock);
+
+    if (!fdst->sparse) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("stream does not have sparse data support"));
+        goto cleanup;
+    }
+
+    ret = virFileInData(fdst->fd, inData, length);
+
+ cleanup:
+    virMutexUnlock(&fdst->lock);
+    return ret;
+}
+
+
 static virStreamDriver virFDStreamDrv = {
     .streamSend = virFDStreamWrite,
     .streamRecv = virFDStreamRead,
+    .streamSendHole = virFDStreamSendHole,
+    .streamInData = virFDStreamInData,
     .streamFinish = virFDStreamClose,
     .streamAbort = virFDStreamAbort,
     .streamEventAddCallback = virFDStreamAddCallback,
@@ -496,12 +599,13 @@ static int virFDStreamOpenInternal(virStreamPtr st,
                                    int fd,
                                    virCommandPtr cmd,
                                    int errfd,
-                                   unsigned long long length)
+                                   unsigned long long length,
+                                   bool sparse)
 {
     struct virFDStreamData *fdst;
 
-    VIR_DEBUG("st=%p fd=%d cmd=%p errfd=%d length=%llu",
-              st, fd, cmd, errfd, length);
+    VIR_DEBUG("st=%p fd=%d cmd=%p errfd=%d length=%llu sparse=%d",
+              st, fd, cmd, errfd, length, sparse);
 
     if ((st->flags & VIR_STREAM_NONBLOCK) &&
         virSetNonBlock(fd) < 0) {
@@ -516,6 +620,7 @@ static int virFDStreamOpenInternal(virStreamPtr st,
     fdst->cmd = cmd;
     fdst->errfd = errfd;
     fdst->length = length;
+    fdst->sparse = sparse;
     if (virMutexInit(&fdst->lock) < 0) {
         VIR_FREE(fdst);
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -533,7 +638,7 @@ static int virFDStreamOpenInternal(virStreamPtr st,
 int virFDStreamOpen(virStreamPtr st,
                     int fd)
 {
-    return virFDStreamOpenInternal(st, fd, NULL, -1, 0);
+    return virFDStreamOpenInternal(st, fd, NULL, -1, 0, false);
 }
 
 
@@ -579,7 +684,7 @@ int virFDStreamConnectUNIX(virStreamPtr st,
         goto error;
     }
 
-    if (virFDStreamOpenInternal(st, fd, NULL, -1, 0) < 0)
+    if (virFDStreamOpenInternal(st, fd, NULL, -1, 0, false) < 0)
         goto error;
     return 0;
 
@@ -605,7 +710,8 @@ virFDStreamOpenFileInternal(virStreamPtr st,
                             unsigned long long length,
                             int oflags,
                             int mode,
-                            bool forceIOHelper)
+                            bool forceIOHelper,
+                            bool sparse)
 {
     int fd = -1;
     int childfd = -1;
@@ -649,8 +755,12 @@ virFDStreamOpenFileInternal(virStreamPtr st,
      * non-blocking I/O on block devs/regular files. To
      * support those we need to fork a helper process to do
      * the I/O so we just have a fifo. Or use AIO :-(
+     *
+     * Sparse streams are an exception: hole detection needs to
+     * lseek() over the file itself, which is impossible through
+     * the helper's pipe, so those always use the fd directly.
      */
-    if ((st->flags & VIR_STREAM_NONBLOCK) &&
+    if ((st->flags & VIR_STREAM_NONBLOCK) && !sparse &&
         ((!S_ISCHR(sb.st_mode) &&
           !S_ISFIFO(sb.st_mode)) || forceIOHelper)) {
         int fds[2] = { -1, -1 };
@@ -701,7 +811,7 @@ virFDStreamOpenFileInternal(virStreamPtr st,
         VIR_FORCE_CLOSE(childfd);
     }
 
-    if (virFDStreamOpenInternal(st, fd, cmd, errfd, length) < 0)
+    if (virFDStreamOpenInternal(st, fd, cmd, errfd, length, sparse) < 0)
         goto error;
 
     return 0;
@@ -731,7 +841,7 @@ int virFDStreamOpenFile(virStreamPtr st,
     }
     return virFDStreamOpenFileInternal(st, path,
                                        offset, length,
-                                       oflags, 0, false);
+                                       oflags, 0, false, false);
 }
 
 int virFDStreamCreateFile(virStreamPtr st,
@@ -744,7 +854,7 @@ int virFDStreamCreateFile(virStreamPtr st,
     return virFDStreamOpenFileInternal(st, path,
                                        offset, length,
                                        oflags | O_CREAT, mode,
-                                       false);
+                                       false, false);
 }
 
 #ifdef HAVE_CFMAKERAW
@@ -760,7 +870,7 @@ int virFDStreamOpenPTY(virStreamPtr st,
     if (virFDStreamOpenFileInternal(st, path,
                                     offset, length,
                                     oflags | O_CREAT, 0,
-                                    false) < 0)
+                                    false, false) < 0)
         return -1;
 
     fdst = st->privateData;
@@ -797,7 +907,7 @@ int virFDStreamOpenPTY(virStreamPtr st,
     return virFDStreamOpenFileInternal(st, path,
                                        offset, length,
                                        oflags | O_CREAT, 0,
-                                       false);
+                                       false, false);
 }
 #endif /* !HAVE_CFMAKERAW */
 
@@ -805,11 +915,12 @@ int virFDStreamOpenBlockDevice(virStreamPtr st,
                                const char *path,
                                unsigned long long offset,
                                unsigned long long length,
+                               bool sparse,
                                int oflags)
 {
     return virFDStreamOpenFileInternal(st, path,
                                        offset, length,
-                                       oflags, 0, true);
+                                       oflags, 0, true, sparse);
 }
 
 int virFDStreamSetInternalCloseCb(virStreamPtr st,
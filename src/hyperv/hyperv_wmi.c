@@ -36,6 +36,9 @@
 
 #define WS_SERIALIZER_FREE_MEM_WORKS 0
 
+/* How many objects one WS-Man Pull round trip may return */
+#define HYPERV_ENUM_PULL_MAX_ELEMENTS 32
+
 #define ROOT_CIMV2 \
     "http://schemas.microsoft.com/wbem/wsman/1/wmi/root/cimv2/*"
 
@@ -124,6 +127,7 @@ hypervEnumAndPull(hypervPrivate *priv, virBufferPtr query, const char *root,
     WsXmlNodeH node = NULL;
     XML_TYPE_PTR data = NULL;
     hypervObject *object;
+    int item;
 
     if (virBufferCheckError(query) < 0) {
         virBufferFreeAndReset(query);
@@ -147,6 +151,10 @@ hypervEnumAndPull(hypervPrivate *priv, virBufferPtr query, const char *root,
         goto cleanup;
     }
 
+    /* Without this the server returns one object per Pull round trip,
+     * making big inventories latency-bound rather than size-bound */
+    options->max_elements = HYPERV_ENUM_PULL_MAX_ELEMENTS;
+
     filter = filter_create_simple(WSM_WQL_FILTER_DIALECT, query_string);
 
     if (filter == NULL) {
@@ -196,33 +204,38 @@ hypervEnumAndPull(hypervPrivate *priv, virBufferPtr query, const char *root,
             goto cleanup;
         }
 
-        if (ws_xml_get_child(node, 0, resourceUri, className) == NULL)
-            break;
+        /* a batched pull returns up to max_elements items per response */
+        for (item = 0;
+             ws_xml_get_child(node, item, resourceUri, className) != NULL;
+             item++) {
+            data = ws_deserialize(serializerContext, node, serializerInfo,
+                                  className, resourceUri, NULL, item, 0);
 
-        data = ws_deserialize(serializerContext, node, serializerInfo,
-                              className, resourceUri, NULL, 0, 0);
+            if (data == NULL) {
+                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                               _("Could not deserialize pull response item"));
+                goto cleanup;
+            }
 
-        if (data == NULL) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("Could not deserialize pull response item"));
-            goto cleanup;
-        }
+            if (VIR_ALLOC(object) < 0)
+                goto cleanup;
 
-        if (VIR_ALLOC(object) < 0)
-            goto cleanup;
+            object->serializerInfo = serializerInfo;
+            object->data = data;
 
-        object->serializerInfo = serializerInfo;
-        object->data = data;
+            data = NULL;
 
-        data = NULL;
+            if (head == NULL) {
+                head = object;
+            } else {
+                tail->next = object;
+            }
 
-        if (head == NULL) {
-            head = object;
-        } else {
-            tail->next = object;
+            tail = object;
         }
 
-        tail = object;
+        if (item == 0)
+            break;
 
         VIR_FREE(enumContext);
         enumContext = wsmc_get_enum_context(response);
@@ -32,14 +32,41 @@
 #include "interface_driver.h"
 #include "interface_conf.h"
 #include "viralloc.h"
+#include "virlog.h"
 #include "virstring.h"
+#include "virthread.h"
 #include "viraccessapicheck.h"
 #include "virnetdev.h"
 
 #define VIR_FROM_THIS VIR_FROM_INTERFACE
 
+VIR_LOG_INIT("interface.interface_backend_udev");
+
+/* A cached view of one host interface, holding just the attributes
+ * the list and lookup APIs hand back to clients */
+typedef struct _udevIfaceTableEntry udevIfaceTableEntry;
+typedef udevIfaceTableEntry *udevIfaceTableEntryPtr;
+struct _udevIfaceTableEntry {
+    char *name;
+    char *mac;
+    char *operstate;
+};
+
 struct udev_iface_driver {
     struct udev *udev;
+    virMutex lock;
+    /* The udev monitor watching for changes to "net" devices. When
+     * it could be set up, list and lookup calls are served from the
+     * 'ifaces' table below instead of re-enumerating udev and
+     * re-reading sysfs on every request; the monitor callback
+     * invalidates the table whenever an interface appears, vanishes
+     * or changes state. All of these fields are protected by 'lock'.
+     */
+    struct udev_monitor *monitor;
+    int watch;
+    udevIfaceTableEntryPtr ifaces;
+    size_t nifaces;
+    bool ifacesValid;
 };
 
 typedef enum {
@@ -135,16 +162,186 @@ udevGetDevices(struct udev *udev, virUdevStatus status)
     return enumerate;
 }
 
+static void
+udevInterfacesTableFree(udevIfaceTableEntryPtr ifaces, size_t nifaces)
+{
+    size_t i;
+
+    for (i = 0; i < nifaces; i++) {
+        VIR_FREE(ifaces[i].name);
+        VIR_FREE(ifaces[i].mac);
+        VIR_FREE(ifaces[i].operstate);
+    }
+    VIR_FREE(ifaces);
+}
+
+/*
+ * Rebuild the cached interface table from a fresh udev enumeration
+ * unless it is still up to date. The caller must hold driver->lock.
+ *
+ * Returns 1 if the table may be used, 0 if no udev monitor is
+ * watching for changes (so the caller has to fall back to
+ * enumerating udev itself) and -1 on error.
+ */
+static int
+udevInterfacesTableRefresh(void)
+{
+    struct udev *udev;
+    struct udev_enumerate *enumerate = NULL;
+    struct udev_list_entry *devices;
+    struct udev_list_entry *dev_entry;
+    udevIfaceTableEntryPtr ifaces = NULL;
+    size_t nifaces = 0;
+    size_t count = 0;
+    int ret = -1;
+
+    if (driver->watch < 0)
+        return 0;
+
+    if (driver->ifacesValid)
+        return 1;
+
+    udev = udev_ref(driver->udev);
+
+    if (!(enumerate = udevGetDevices(udev, VIR_UDEV_IFACE_ALL))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("failed to get list of interfaces on host"));
+        goto cleanup;
+    }
+
+    udev_enumerate_scan_devices(enumerate);
+    devices = udev_enumerate_get_list_entry(enumerate);
+
+    udev_list_entry_foreach(dev_entry, devices)
+        nifaces++;
+
+    if (nifaces && VIR_ALLOC_N(ifaces, nifaces) < 0)
+        goto cleanup;
+
+    udev_list_entry_foreach(dev_entry, devices) {
+        struct udev_device *dev;
+        const char *path;
+        udevIfaceTableEntryPtr entry = &ifaces[count];
+
+        if (count == nifaces)
+            break;
+
+        path = udev_list_entry_get_name(dev_entry);
+        if (!(dev = udev_device_new_from_syspath(udev, path)))
+            continue;
+
+        if (VIR_STRDUP(entry->name,
+                       udev_device_get_sysname(dev)) < 0 ||
+            VIR_STRDUP(entry->mac,
+                       udev_device_get_sysattr_value(dev, "address")) < 0 ||
+            VIR_STRDUP(entry->operstate,
+                       udev_device_get_sysattr_value(dev, "operstate")) < 0) {
+            udev_device_unref(dev);
+            goto cleanup;
+        }
+        udev_device_unref(dev);
+        count++;
+    }
+
+    VIR_DEBUG("Refreshed interface table with %zu interfaces", count);
+
+    udevInterfacesTableFree(driver->ifaces, driver->nifaces);
+    driver->ifaces = ifaces;
+    driver->nifaces = count;
+    driver->ifacesValid = true;
+    ifaces = NULL;
+    nifaces = 0;
+
+    ret = 1;
+
+ cleanup:
+    udevInterfacesTableFree(ifaces, nifaces);
+    if (enumerate)
+        udev_enumerate_unref(enumerate);
+    udev_unref(udev);
+
+    return ret;
+}
+
+static bool
+udevInterfacesTableEntryMatch(udevIfaceTableEntryPtr entry,
+                              virUdevStatus status)
+{
+    switch (status) {
+        case VIR_UDEV_IFACE_ACTIVE:
+            return STREQ_NULLABLE(entry->operstate, "up");
+
+        case VIR_UDEV_IFACE_INACTIVE:
+            return STREQ_NULLABLE(entry->operstate, "down");
+
+        case VIR_UDEV_IFACE_ALL:
+            break;
+    }
+
+    return true;
+}
+
+static void
+udevInterfaceMonitorEvent(int watch ATTRIBUTE_UNUSED,
+                          int fd ATTRIBUTE_UNUSED,
+                          int events ATTRIBUTE_UNUSED,
+                          void *data ATTRIBUTE_UNUSED)
+{
+    struct udev_device *dev;
+    bool changed = false;
+
+    virMutexLock(&driver->lock);
+
+    /* Drain everything the kernel has queued; the monitor socket is
+     * non-blocking so NULL means the queue is empty. Any event on
+     * the "net" subsystem invalidates the cached table, which is
+     * rebuilt lazily by the next list or lookup call.
+     */
+    while ((dev = udev_monitor_receive_device(driver->monitor))) {
+        udev_device_unref(dev);
+        changed = true;
+    }
+
+    if (changed)
+        driver->ifacesValid = false;
+
+    virMutexUnlock(&driver->lock);
+}
+
 static int
 udevNumOfInterfacesByStatus(virConnectPtr conn, virUdevStatus status,
                             virInterfaceObjListFilter filter)
 {
-    struct udev *udev = udev_ref(driver->udev);
+    struct udev *udev;
     struct udev_enumerate *enumerate = NULL;
     struct udev_list_entry *devices;
     struct udev_list_entry *dev_entry;
     int count = 0;
+    size_t i;
+    int rc;
+
+    /* Serve the request from the cached table if we can */
+    virMutexLock(&driver->lock);
+    if ((rc = udevInterfacesTableRefresh()) != 0) {
+        if (rc < 0) {
+            count = -1;
+        } else {
+            for (i = 0; i < driver->nifaces; i++) {
+                udevIfaceTableEntryPtr entry = &driver->ifaces[i];
+                virInterfaceDef def = { .name = entry->name,
+                                        .mac = entry->mac };
+
+                if (udevInterfacesTableEntryMatch(entry, status) &&
+                    filter(conn, &def))
+                    count++;
+            }
+        }
+        virMutexUnlock(&driver->lock);
+        return count;
+    }
+    virMutexUnlock(&driver->lock);
 
+    udev = udev_ref(driver->udev);
     enumerate = udevGetDevices(udev, status);
 
     if (!enumerate) {
@@ -192,12 +389,48 @@ udevListInterfacesByStatus(virConnectPtr conn,
                            virUdevStatus status,
                            virInterfaceObjListFilter filter)
 {
-    struct udev *udev = udev_ref(driver->udev);
+    struct udev *udev;
     struct udev_enumerate *enumerate = NULL;
     struct udev_list_entry *devices;
     struct udev_list_entry *dev_entry;
     int count = 0;
+    size_t i;
+    int rc;
+
+    /* Serve the request from the cached table if we can */
+    virMutexLock(&driver->lock);
+    if ((rc = udevInterfacesTableRefresh()) != 0) {
+        for (i = 0; rc > 0 && i < driver->nifaces; i++) {
+            udevIfaceTableEntryPtr entry = &driver->ifaces[i];
+            virInterfaceDef def = { .name = entry->name,
+                                    .mac = entry->mac };
+
+            /* Ensure we won't exceed the size of our array */
+            if (count > names_len)
+                break;
+
+            if (!udevInterfacesTableEntryMatch(entry, status) ||
+                !filter(conn, &def))
+                continue;
+
+            if (VIR_STRDUP(names[count], entry->name) < 0) {
+                rc = -1;
+                break;
+            }
+            count++;
+        }
+        virMutexUnlock(&driver->lock);
+
+        if (rc < 0) {
+            while (count > 0)
+                VIR_FREE(names[--count]);
+            return -1;
+        }
+        return count;
+    }
+    virMutexUnlock(&driver->lock);
 
+    udev = udev_ref(driver->udev);
     enumerate = udevGetDevices(udev, status);
 
     if (!enumerate) {
@@ -317,12 +550,56 @@ udevConnectListAllInterfaces(virConnectPtr conn,
     int count = 0;
     int status = 0;
     int ret;
+    size_t i;
+    int rc;
 
     virCheckFlags(VIR_CONNECT_LIST_INTERFACES_FILTERS_ACTIVE, -1);
 
     if (virConnectListAllInterfacesEnsureACL(conn) < 0)
         return -1;
 
+    /* Serve the request from the cached table if we can */
+    virMutexLock(&driver->lock);
+    if ((rc = udevInterfacesTableRefresh()) != 0) {
+        if (rc < 0 ||
+            (ifaces && VIR_ALLOC_N(ifaces_list, driver->nifaces + 1) < 0)) {
+            virMutexUnlock(&driver->lock);
+            return -1;
+        }
+
+        for (i = 0; i < driver->nifaces; i++) {
+            udevIfaceTableEntryPtr entry = &driver->ifaces[i];
+            virInterfaceDef def = { .name = entry->name,
+                                    .mac = entry->mac };
+            bool active = STREQ_NULLABLE(entry->operstate, "up");
+
+            if (!virConnectListAllInterfacesCheckACL(conn, &def))
+                continue;
+
+            /* Filter the results */
+            if (MATCH(VIR_CONNECT_LIST_INTERFACES_FILTERS_ACTIVE) &&
+                !((MATCH(VIR_CONNECT_LIST_INTERFACES_ACTIVE) && active) ||
+                  (MATCH(VIR_CONNECT_LIST_INTERFACES_INACTIVE) && !active)))
+                continue;
+
+            /* If we matched a filter, then add it */
+            if (ifaces)
+                ifaces_list[count] = virGetInterface(conn, entry->name,
+                                                     entry->mac);
+            count++;
+        }
+        virMutexUnlock(&driver->lock);
+
+        /* Trim the array to its final size */
+        if (ifaces) {
+            ignore_value(VIR_REALLOC_N(ifaces_list, count + 1));
+            *ifaces = ifaces_list;
+        }
+
+        return count;
+    }
+    virMutexUnlock(&driver->lock);
+
     /* Grab a udev reference */
     udev = udev_ref(driver->udev);
 
@@ -469,13 +746,51 @@ udevInterfaceLookupByName(virConnectPtr conn, const char *name)
 static virInterfacePtr
 udevInterfaceLookupByMACString(virConnectPtr conn, const char *macstr)
 {
-    struct udev *udev = udev_ref(driver->udev);
+    struct udev *udev;
     struct udev_enumerate *enumerate = NULL;
     struct udev_list_entry *dev_entry;
     struct udev_device *dev;
     virInterfaceDefPtr def = NULL;
     virInterfacePtr ret = NULL;
+    size_t i;
+    int rc;
+
+    /* Serve the request from the cached table if we can */
+    virMutexLock(&driver->lock);
+    if ((rc = udevInterfacesTableRefresh()) != 0) {
+        udevIfaceTableEntryPtr match = NULL;
+        size_t nmatches = 0;
+
+        for (i = 0; rc > 0 && i < driver->nifaces; i++) {
+            if (STREQ_NULLABLE(driver->ifaces[i].mac, macstr)) {
+                match = &driver->ifaces[i];
+                nmatches++;
+            }
+        }
 
+        if (rc < 0) {
+            /* error already reported */
+        } else if (nmatches == 0) {
+            virReportError(VIR_ERR_NO_INTERFACE,
+                           _("couldn't find interface with MAC address '%s'"),
+                           macstr);
+        } else if (nmatches > 1) {
+            virReportError(VIR_ERR_MULTIPLE_INTERFACES,
+                           _("the MAC address '%s' matches multiple interfaces"),
+                           macstr);
+        } else {
+            virInterfaceDef matchdef = { .name = match->name,
+                                         .mac = match->mac };
+
+            if (virInterfaceLookupByMACStringEnsureACL(conn, &matchdef) >= 0)
+                ret = virGetInterface(conn, matchdef.name, matchdef.mac);
+        }
+        virMutexUnlock(&driver->lock);
+        return ret;
+    }
+    virMutexUnlock(&driver->lock);
+
+    udev = udev_ref(driver->udev);
     enumerate = udevGetDevices(udev, VIR_UDEV_IFACE_ALL);
 
     if (!enumerate) {
@@ -1166,6 +1481,14 @@ udevStateInitialize(bool privileged ATTRIBUTE_UNUSED,
     if (VIR_ALLOC(driver) < 0)
         goto cleanup;
 
+    driver->watch = -1;
+
+    if (virMutexInit(&driver->lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to initialize mutex"));
+        goto cleanup;
+    }
+
     driver->udev = udev_new();
     if (!driver->udev) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -1173,6 +1496,31 @@ udevStateInitialize(bool privileged ATTRIBUTE_UNUSED,
         goto cleanup;
     }
 
+    /* Watch for changes to "net" devices so that list and lookup
+     * calls can be served from a cached interface table. This is
+     * best effort; without an event loop (or if the monitor cannot
+     * be set up) every call falls back to enumerating udev.
+     */
+    driver->monitor = udev_monitor_new_from_netlink(driver->udev, "udev");
+    if (driver->monitor &&
+        udev_monitor_filter_add_match_subsystem_devtype(driver->monitor,
+                                                        "net", NULL) == 0 &&
+        udev_monitor_enable_receiving(driver->monitor) == 0) {
+        driver->watch = virEventAddHandle(udev_monitor_get_fd(driver->monitor),
+                                          VIR_EVENT_HANDLE_READABLE,
+                                          udevInterfaceMonitorEvent,
+                                          NULL, NULL);
+    }
+
+    if (driver->watch < 0) {
+        VIR_WARN("Failed to watch udev for interface changes; "
+                 "interface listings will not be cached");
+        if (driver->monitor)
+            udev_monitor_unref(driver->monitor);
+        driver->monitor = NULL;
+        virResetLastError();
+    }
+
     ret = 0;
 
  cleanup:
@@ -1185,7 +1533,15 @@ udevStateCleanup(void)
     if (!driver)
         return -1;
 
+    if (driver->watch >= 0)
+        virEventRemoveHandle(driver->watch);
+    if (driver->monitor)
+        udev_monitor_unref(driver->monitor);
+
+    udevInterfacesTableFree(driver->ifaces, driver->nifaces);
+
     udev_unref(driver->udev);
+    virMutexDestroy(&driver->lock);
 
     VIR_FREE(driver);
     return 0;
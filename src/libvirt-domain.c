@@ -8393,6 +8393,12 @@ virDomainAttachDevice(virDomainPtr domain, const char *xml)
  * into S4 state (also known as hibernation) unless you also modify the
  * persistent domain definition.
  *
+ * If @flags contains VIR_DOMAIN_DEVICE_MODIFY_LIST, @xml is instead a
+ * <devices> element whose children describe several devices; they are
+ * attached under a single job as one transaction, and devices already
+ * attached are rolled back if a later one fails. Not all hypervisor
+ * drivers support this flag.
+ *
  * Returns 0 in case of success, -1 in case of failure.
  */
 int
@@ -8519,6 +8525,12 @@ virDomainDetachDevice(virDomainPtr domain, const char *xml)
  * but shares some specific attributes with one that is present,
  * may lead to unexpected results.
  *
+ * If @flags contains VIR_DOMAIN_DEVICE_MODIFY_LIST, @xml is instead a
+ * <devices> element whose children describe several devices; they are
+ * detached under a single job, and an attempt is made to re-attach
+ * devices already detached if a later one fails. Not all hypervisor
+ * drivers support this flag.
+ *
  * Returns 0 in case of success, -1 in case of failure.
  */
 int
@@ -11467,6 +11479,19 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *                           unsigned long long. It is produced by cpu_cycles
  *                           perf event.
  *
+ * VIR_DOMAIN_STATS_INFO: Return basic domain information and brief
+ * metadata, equivalent to what virDomainGetInfo and the persistence and
+ * autostart accessors report, but for all domains in a single call.
+ * The typed parameter keys are in this format:
+ * "info.maxmem" - the maximum memory in kiB allowed as unsigned long long.
+ * "info.memory" - the memory in kiB used by the domain as unsigned long long.
+ * "info.vcpus" - current number of virtual CPUs as unsigned int.
+ * "info.cputime" - the CPU time used in nanoseconds as unsigned long long,
+ *                  only reported for active domains.
+ * "info.persistent" - whether the domain has a persistent configuration,
+ *                     as a boolean.
+ * "info.autostart" - whether the domain is autostarted, as a boolean.
+ *
  * Note that entire stats groups or individual stat fields may be missing from
  * the output in case they are not supported by the given hypervisor, are not
  * applicable for the current state of the guest domain, or their retrieval
@@ -11483,6 +11508,12 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  * fields for offline domains if the statistics are meaningful only for a
  * running domain.
  *
+ * Passing VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT in @flags means when
+ * libvirt is unable to fetch stats for any of the domains (for whatever
+ * reason) only a subset of statistics is returned for the domain. The
+ * hypervisor may serve values from an internal cache in that case, so
+ * individual fields can be slightly outdated.
+ *
  * Similarly to virConnectListAllDomains, @flags can contain various flags to
  * filter the list of domains to provide stats for.
  *
@@ -745,39 +745,215 @@ virRegisterStateDriver(virStateDriverPtr driver)
  * @callback: callback to invoke to inhibit shutdown of the daemon
  * @opaque: data to pass to @callback
  *
- * Initialize all virtualization drivers. Accomplished in two phases,
- * the first being state and structure initialization followed by any
- * auto start supported by the driver.  This is done to ensure dependencies
- * that some drivers may have on another driver having been initialized
- * will exist, such as the storage driver's need to use the secret driver.
+ * Initialize all virtualization drivers.  This only covers state and
+ * structure initialization; autostarting domains, networks and pools
+ * is done separately by virStateAutoStart once the daemon is ready to
+ * serve clients, since autostart can take a long time and every driver
+ * must be initialized before any of them runs it anyway (such as the
+ * storage driver's need to use the secret driver).
+ *
+ * Drivers without a dependency on each other are initialized
+ * concurrently, so daemon startup is gated by the longest dependency
+ * chain rather than the sum of all drivers.
  *
  * Returns 0 if all succeed, -1 upon any failure.
  */
+
+/* Initialization ordering constraints between the state drivers; any
+ * pair of drivers not connected through this table may be initialized
+ * concurrently.  The nwfilter/network edge is there because both
+ * rebuild iptables rules during init and the iptables commands do not
+ * tolerate concurrent invocations. */
+struct virStateDriverDep {
+    const char *name;
+    const char *deps[8];
+};
+
+/* Driver names as registered: "bridge" is the network driver, "udev"
+ * doubles as the node device and interface drivers, "HAL" and "netcf"
+ * are their alternative backends.  Hypervisor drivers are ordered
+ * after all of the supporting drivers they may call into while
+ * reconnecting to running domains. */
+#define VIR_STATE_SUPPORT_DRIVERS \
+    "bridge", "storage", "secret", "NWFilter", "udev", "HAL", "netcf"
+
+static const struct virStateDriverDep virStateDriverDeps[] = {
+    { "storage", { "secret", NULL } },
+    { "NWFilter", { "bridge", NULL } },
+    { "QEMU", { VIR_STATE_SUPPORT_DRIVERS, NULL } },
+    { "LXC", { VIR_STATE_SUPPORT_DRIVERS, NULL } },
+    { "UML", { VIR_STATE_SUPPORT_DRIVERS, NULL } },
+    { "LIBXL", { VIR_STATE_SUPPORT_DRIVERS, NULL } },
+    { "Xen", { VIR_STATE_SUPPORT_DRIVERS, NULL } },
+    { "bhyve", { VIR_STATE_SUPPORT_DRIVERS, NULL } },
+    { "vz", { VIR_STATE_SUPPORT_DRIVERS, NULL } },
+};
+
+typedef struct _virStateInitData virStateInitData;
+struct _virStateInitData {
+    virStateDriverPtr driver;
+    bool privileged;
+    virStateInhibitCallback callback;
+    void *opaque;
+    int ret;
+};
+
+static void
+virStateInitializeWorker(void *opaque)
+{
+    virStateInitData *data = opaque;
+
+    VIR_DEBUG("Running global init for %s state driver",
+              data->driver->name);
+    data->ret = data->driver->stateInitialize(data->privileged,
+                                              data->callback,
+                                              data->opaque);
+    if (data->ret < 0)
+        VIR_ERROR(_("Initialization of %s state driver failed: %s"),
+                  data->driver->name, virGetLastErrorMessage());
+}
+
+/* Returns true if every registered driver @name depends on has
+ * finished initializing; dependencies on drivers that are not
+ * registered are trivially satisfied. */
+static bool
+virStateDriverDepsDone(const char *name,
+                       const bool *done)
+{
+    size_t i;
+    size_t j;
+    size_t k;
+
+    for (i = 0; i < ARRAY_CARDINALITY(virStateDriverDeps); i++) {
+        if (STRNEQ(virStateDriverDeps[i].name, name))
+            continue;
+
+        for (j = 0; virStateDriverDeps[i].deps[j]; j++) {
+            for (k = 0; k < virStateDriverTabCount; k++) {
+                if (STREQ(virStateDriverTab[k]->name,
+                          virStateDriverDeps[i].deps[j]) &&
+                    !done[k])
+                    return false;
+            }
+        }
+        break;
+    }
+    return true;
+}
+
 int
 virStateInitialize(bool privileged,
                    virStateInhibitCallback callback,
                    void *opaque)
 {
     size_t i;
+    size_t ndone = 0;
+    int ret = -1;
+    bool *done = NULL;
+    bool *launched = NULL;
+    virThread *threads = NULL;
+    virStateInitData *data = NULL;
 
     if (virInitialize() < 0)
         return -1;
 
+    if (VIR_ALLOC_N(done, virStateDriverTabCount) < 0 ||
+        VIR_ALLOC_N(launched, virStateDriverTabCount) < 0 ||
+        VIR_ALLOC_N(threads, virStateDriverTabCount) < 0 ||
+        VIR_ALLOC_N(data, virStateDriverTabCount) < 0)
+        goto cleanup;
+
     for (i = 0; i < virStateDriverTabCount; i++) {
-        if (virStateDriverTab[i]->stateInitialize) {
-            VIR_DEBUG("Running global init for %s state driver",
-                      virStateDriverTab[i]->name);
-            if (virStateDriverTab[i]->stateInitialize(privileged,
-                                                      callback,
-                                                      opaque) < 0) {
-                VIR_ERROR(_("Initialization of %s state driver failed: %s"),
-                          virStateDriverTab[i]->name,
-                          virGetLastErrorMessage());
-                return -1;
+        if (!virStateDriverTab[i]->stateInitialize) {
+            done[i] = true;
+            ndone++;
+        }
+    }
+
+    while (ndone < virStateDriverTabCount) {
+        size_t nlaunched = 0;
+
+        /* launch every driver whose dependencies have completed */
+        for (i = 0; i < virStateDriverTabCount; i++) {
+            if (done[i] ||
+                !virStateDriverDepsDone(virStateDriverTab[i]->name, done))
+                continue;
+
+            data[i].driver = virStateDriverTab[i];
+            data[i].privileged = privileged;
+            data[i].callback = callback;
+            data[i].opaque = opaque;
+            if (virThreadCreate(&threads[i], true,
+                                virStateInitializeWorker, &data[i]) < 0) {
+                /* fall back to initializing in the calling thread */
+                virStateInitializeWorker(&data[i]);
+                if (data[i].ret < 0)
+                    goto cleanup;
+                done[i] = true;
+                ndone++;
+                continue;
             }
+            launched[i] = true;
+            nlaunched++;
+        }
+
+        if (nlaunched == 0 && ndone < virStateDriverTabCount) {
+            /* a cycle in the dependency table; initialize whatever is
+             * left in plain registration order */
+            for (i = 0; i < virStateDriverTabCount; i++) {
+                if (done[i])
+                    continue;
+                data[i].driver = virStateDriverTab[i];
+                data[i].privileged = privileged;
+                data[i].callback = callback;
+                data[i].opaque = opaque;
+                virStateInitializeWorker(&data[i]);
+                if (data[i].ret < 0)
+                    goto cleanup;
+                done[i] = true;
+                ndone++;
+            }
+            break;
+        }
+
+        /* wait for the wave to finish before computing the next one */
+        for (i = 0; i < virStateDriverTabCount; i++) {
+            if (!launched[i])
+                continue;
+            virThreadJoin(&threads[i]);
+            launched[i] = false;
+            done[i] = true;
+            ndone++;
+        }
+
+        for (i = 0; i < virStateDriverTabCount; i++) {
+            if (done[i] && data[i].driver && data[i].ret < 0)
+                goto cleanup;
         }
     }
 
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(done);
+    VIR_FREE(launched);
+    VIR_FREE(threads);
+    VIR_FREE(data);
+    return ret;
+}
+
+
+/**
+ * virStateAutoStart:
+ *
+ * Run each virtualization driver's auto start method.  Must only be
+ * called after virStateInitialize has succeeded.
+ */
+void
+virStateAutoStart(void)
+{
+    size_t i;
+
     for (i = 0; i < virStateDriverTabCount; i++) {
         if (virStateDriverTab[i]->stateAutoStart) {
             VIR_DEBUG("Running global auto start for %s state driver",
@@ -785,7 +961,6 @@ virStateInitialize(bool privileged,
             virStateDriverTab[i]->stateAutoStart();
         }
     }
-    return 0;
 }
 
 
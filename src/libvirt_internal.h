@@ -33,6 +33,7 @@ typedef void (*virStateInhibitCallback)(bool inhibit,
 int virStateInitialize(bool privileged,
                        virStateInhibitCallback inhibit,
                        void *opaque);
+void virStateAutoStart(void);
 int virStateCleanup(void);
 int virStateReload(void);
 int virStateStop(void);
@@ -294,4 +295,8 @@ virTypedParameterValidateSet(virConnectPtr conn,
                              virTypedParameterPtr params,
                              int nparams);
 
+int virStreamInData(virStreamPtr stream,
+                    int *data,
+                    long long *length);
+
 #endif
@@ -198,9 +198,8 @@ libxlCapsInitNuma(libxl_ctx *ctx, virCapsPtr caps)
 }
 
 static int
-libxlCapsInitGuests(libxl_ctx *ctx, virCapsPtr caps)
+libxlCapsInitGuests(const libxl_version_info *ver_info, virCapsPtr caps)
 {
-    const libxl_version_info *ver_info;
     int err;
     regex_t regex;
     char *str, *token;
@@ -213,12 +212,6 @@ libxlCapsInitGuests(libxl_ctx *ctx, virCapsPtr caps)
 
     memset(guest_archs, 0, sizeof(guest_archs));
 
-    if ((ver_info = libxl_get_version_info(ctx)) == NULL) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Failed to get version info from libxenlight"));
-        return -1;
-    }
-
     if (!ver_info->capabilities) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Failed to get capabilities from libxenlight"));
@@ -507,10 +500,20 @@ libxlMakeDomainDeviceHostdevCaps(virDomainCapsDeviceHostdevPtr dev)
 }
 
 virCapsPtr
-libxlMakeCapabilities(libxl_ctx *ctx)
+libxlMakeCapabilities(libxl_ctx *ctx,
+                      const libxl_version_info *ver_info)
 {
     virCapsPtr caps;
 
+    /* The caller usually has the version info at hand already; only
+     * probe the hypervisor again if it does not */
+    if (!ver_info &&
+        (ver_info = libxl_get_version_info(ctx)) == NULL) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Failed to get version info from libxenlight"));
+        return NULL;
+    }
+
 #ifdef LIBXL_HAVE_NO_SUSPEND_RESUME
     if ((caps = virCapabilitiesNew(virArchFromHost(), false, false)) == NULL)
 #else
@@ -524,7 +527,7 @@ libxlMakeCapabilities(libxl_ctx *ctx)
     if (libxlCapsInitNuma(ctx, caps) < 0)
         goto error;
 
-    if (libxlCapsInitGuests(ctx, caps) < 0)
+    if (libxlCapsInitGuests(ver_info, caps) < 0)
         goto error;
 
     return caps;
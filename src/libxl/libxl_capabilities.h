@@ -44,7 +44,8 @@
 
 
 virCapsPtr
-libxlMakeCapabilities(libxl_ctx *ctx);
+libxlMakeCapabilities(libxl_ctx *ctx,
+                      const libxl_version_info *ver_info);
 
 int
 libxlMakeDomainCapabilities(virDomainCapsPtr domCaps,
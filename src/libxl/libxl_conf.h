@@ -31,6 +31,7 @@
 # include "internal.h"
 # include "libvirt_internal.h"
 # include "virdomainobjlist.h"
+# include "virhash.h"
 # include "domain_event.h"
 # include "capabilities.h"
 # include "configmake.h"
@@ -122,6 +123,11 @@ struct _libxlDriverPrivate {
     /* Immutable pointer, self-locking APIs */
     virDomainObjListPtr domains;
 
+    /* Require lock. Maps virttype/arch/machine/emulator keys to
+     * virDomainCapsPtr; domain capabilities only vary with those
+     * inputs until the hypervisor itself changes */
+    virHashTablePtr domainCapsCache;
+
     /* Immutable pointer, immutable object */
     virDomainXMLOptionPtr xmlopt;
 
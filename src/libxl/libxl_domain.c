@@ -216,7 +216,7 @@ libxlDomainObjPrivateAlloc(void)
     if (!(priv = virObjectLockableNew(libxlDomainObjPrivateClass)))
         return NULL;
 
-    if (!(priv->devs = virChrdevAlloc())) {
+    if (!(priv->devs = virChrdevAlloc(0))) {
         virObjectUnref(priv);
         return NULL;
     }
@@ -71,6 +71,14 @@ struct _libxlDomainObjPrivate {
     struct libxlDomainJobObj job;
 
     bool hookRun;  /* true if there was a hook run over this domain */
+
+    /* short-lived cache of libxl_domain_info results so monitoring
+     * sweeps don't hammer xenstore; lifecycle state itself comes from
+     * the event machinery, not from here */
+    unsigned long long infoCacheTime; /* ms, 0 if invalid */
+    unsigned long long cachedCpuTime;
+    unsigned long long cachedMemory;
+    unsigned long long cachedMaxMem;
 };
 
 
@@ -58,6 +58,8 @@
 #include "virsysinfo.h"
 #include "viraccessapicheck.h"
 #include "viratomic.h"
+#include "virthreadpool.h"
+#include "virtime.h"
 #include "virhostdev.h"
 #include "network/bridge_driver.h"
 #include "locking/domain_lock.h"
@@ -76,6 +78,12 @@ VIR_LOG_INIT("libxl.libxl_driver");
 #define LIBXL_NB_TOTAL_CPU_STAT_PARAM 1
 #define LIBXL_NB_TOTAL_BLK_STAT_PARAM 6
 
+/* How long a cached libxl_domain_info result stays valid */
+#define LIBXL_DOMAIN_INFO_CACHE_TTL_MS 1000
+
+/* Upper bound on threads reconnecting to running domains at startup */
+#define LIBXL_RECONNECT_MAX_WORKERS 10
+
 #define HYPERVISOR_CAPABILITIES "/proc/xen/capabilities"
 #define HYPERVISOR_XENSTORED "/dev/xen/xenstored"
 
@@ -449,19 +457,122 @@ libxlReconnectDomain(virDomainObjPtr vm,
  error:
     libxlDomainCleanup(driver, vm);
     if (!vm->persistent) {
-        virDomainObjListRemoveLocked(driver->domains, vm);
+        virDomainObjListRemove(driver->domains, vm);
 
-        /* virDomainObjListRemoveLocked leaves the object unlocked,
+        /* virDomainObjListRemove leaves the object unlocked,
          * lock it again to factorize more code. */
         virObjectLock(vm);
     }
     goto cleanup;
 }
 
+struct libxlReconnectState {
+    libxlDriverPrivatePtr driver;
+    virMutex lock;
+    virCond cond;
+    size_t remaining;
+};
+
+struct libxlReconnectJob {
+    struct libxlReconnectState *state;
+    virDomainObjPtr vm;
+};
+
+static void
+libxlReconnectDomainWorker(void *jobdata, void *opaque ATTRIBUTE_UNUSED)
+{
+    struct libxlReconnectJob *job = jobdata;
+    struct libxlReconnectState *state = job->state;
+
+    ignore_value(libxlReconnectDomain(job->vm, state->driver));
+    virObjectUnref(job->vm);
+
+    virMutexLock(&state->lock);
+    state->remaining--;
+    virCondSignal(&state->cond);
+    virMutexUnlock(&state->lock);
+
+    VIR_FREE(job);
+}
+
 static void
 libxlReconnectDomains(libxlDriverPrivatePtr driver)
 {
-    virDomainObjListForEach(driver->domains, libxlReconnectDomain, driver);
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+    size_t i;
+    virThreadPoolPtr pool = NULL;
+    struct libxlReconnectState state;
+    bool stateInit = false;
+
+    /* Each reconnect probes the hypervisor for the domain's status and
+     * retrieves its saved config, which on a host with many running
+     * domains dominates driver startup time when done serially.  Spread
+     * the work over a bounded pool of workers; each libxl call is
+     * serialized on the domain object lock it takes, so the workers
+     * never touch the same domain concurrently. */
+    if (virDomainObjListCollect(driver->domains, NULL, &vms, &nvms,
+                                NULL, 0) < 0)
+        return;
+
+    if (nvms > 1 && virMutexInit(&state.lock) == 0) {
+        if (virCondInit(&state.cond) < 0) {
+            virMutexDestroy(&state.lock);
+        } else {
+            stateInit = true;
+            state.driver = driver;
+            state.remaining = 0;
+            pool = virThreadPoolNew(0, LIBXL_RECONNECT_MAX_WORKERS, 0,
+                                    libxlReconnectDomainWorker, NULL);
+        }
+    }
+
+    for (i = 0; i < nvms; i++) {
+        struct libxlReconnectJob *job = NULL;
+
+        if (pool && VIR_ALLOC_QUIET(job) == 0) {
+            job->state = &state;
+            job->vm = vms[i];
+
+            virMutexLock(&state.lock);
+            state.remaining++;
+            virMutexUnlock(&state.lock);
+
+            if (virThreadPoolSendJob(pool, 0, job) == 0)
+                continue;
+
+            virMutexLock(&state.lock);
+            state.remaining--;
+            virMutexUnlock(&state.lock);
+            VIR_FREE(job);
+        }
+
+        /* Fall back to reconnecting on this thread */
+        ignore_value(libxlReconnectDomain(vms[i], driver));
+        virObjectUnref(vms[i]);
+    }
+
+    if (pool) {
+        /* Driver initialization continues with loading managed save
+         * images and autostarting domains, which must not race with
+         * reconnection, so wait for the workers here rather than in a
+         * detached thread. */
+        virMutexLock(&state.lock);
+        while (state.remaining > 0) {
+            if (virCondWait(&state.cond, &state.lock) < 0)
+                break;
+        }
+        virMutexUnlock(&state.lock);
+
+        virThreadPoolFree(pool);
+    }
+
+    if (stateInit) {
+        virCondDestroy(&state.cond);
+        virMutexDestroy(&state.lock);
+    }
+
+    VIR_FREE(vms);
 }
 
 static int
@@ -474,6 +585,7 @@ libxlStateCleanup(void)
     virObjectUnref(libxl_driver->config);
     virObjectUnref(libxl_driver->xmlopt);
     virObjectUnref(libxl_driver->domains);
+    virHashFree(libxl_driver->domainCapsCache);
     virObjectUnref(libxl_driver->reservedGraphicsPorts);
     virObjectUnref(libxl_driver->migrationPorts);
     virLockManagerPluginUnref(libxl_driver->lockManager);
@@ -666,6 +778,9 @@ libxlStateInitialize(bool privileged,
     if (!(libxl_driver->domains = virDomainObjListNew()))
         goto error;
 
+    if (!(libxl_driver->domainCapsCache = virHashCreate(5, virObjectFreeHashData)))
+        goto error;
+
     if (!(libxl_driver->hostdevMgr = virHostdevManagerGetDefault()))
         goto error;
 
@@ -733,7 +848,7 @@ libxlStateInitialize(bool privileged,
     if (!libxl_driver->domainEventState)
         goto error;
 
-    if ((cfg->caps = libxlMakeCapabilities(cfg->ctx)) == NULL) {
+    if ((cfg->caps = libxlMakeCapabilities(cfg->ctx, cfg->verInfo)) == NULL) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        "%s", _("cannot create capabilities for libxenlight"));
         goto error;
@@ -1541,12 +1656,15 @@ libxlDomainSetMemoryFlags(virDomainPtr dom, unsigned long newmem,
         /* resize the maximum memory */
 
         if (flags & VIR_DOMAIN_MEM_LIVE) {
+            libxlDomainObjPrivatePtr priv = vm->privateData;
+
             if (libxl_domain_setmaxmem(cfg->ctx, vm->def->id, newmem) < 0) {
                 virReportError(VIR_ERR_INTERNAL_ERROR,
                                _("Failed to set maximum memory for domain '%d'"
                                  " with libxenlight"), vm->def->id);
                 goto endjob;
             }
+            priv->infoCacheTime = 0;
         }
 
         if (flags & VIR_DOMAIN_MEM_CONFIG) {
@@ -1569,6 +1687,7 @@ libxlDomainSetMemoryFlags(virDomainPtr dom, unsigned long newmem,
         }
 
         if (flags & VIR_DOMAIN_MEM_LIVE) {
+            libxlDomainObjPrivatePtr priv = vm->privateData;
             int res;
 
             /* Unlock virDomainObj while ballooning memory */
@@ -1582,6 +1701,7 @@ libxlDomainSetMemoryFlags(virDomainPtr dom, unsigned long newmem,
                                  " with libxenlight"), vm->def->id);
                 goto endjob;
             }
+            priv->infoCacheTime = 0;
         }
 
         if (flags & VIR_DOMAIN_MEM_CONFIG) {
@@ -1635,19 +1755,43 @@ libxlDomainGetInfo(virDomainPtr dom, virDomainInfoPtr info)
         info->memory = vm->def->mem.cur_balloon;
         info->maxMem = virDomainDefGetMemoryTotal(vm->def);
     } else {
-        libxl_dominfo_init(&d_info);
+        libxlDomainObjPrivatePtr priv = vm->privateData;
+        unsigned long long now;
+
+        /* Serve monitoring sweeps from a short-lived cache; a
+         * per-domain libxl_domain_info walks xenstore and 400 domains
+         * polled once a second add up.  State never comes from here,
+         * so staleness is bounded to slightly old cpu/memory counters */
+        if (virTimeMillisNow(&now) < 0)
+            now = 0;
+
+        if (priv->infoCacheTime && now &&
+            now - priv->infoCacheTime < LIBXL_DOMAIN_INFO_CACHE_TTL_MS) {
+            info->cpuTime = priv->cachedCpuTime;
+            info->memory = priv->cachedMemory;
+            info->maxMem = priv->cachedMaxMem;
+        } else {
+            libxl_dominfo_init(&d_info);
 
-        if (libxl_domain_info(cfg->ctx, &d_info, vm->def->id) != 0) {
-            virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("libxl_domain_info failed for domain '%d'"),
-                           vm->def->id);
-            goto cleanup;
-        }
-        info->cpuTime = d_info.cpu_time;
-        info->memory = d_info.current_memkb;
-        info->maxMem = d_info.max_memkb;
+            if (libxl_domain_info(cfg->ctx, &d_info, vm->def->id) != 0) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("libxl_domain_info failed for domain '%d'"),
+                               vm->def->id);
+                goto cleanup;
+            }
+            info->cpuTime = d_info.cpu_time;
+            info->memory = d_info.current_memkb;
+            info->maxMem = d_info.max_memkb;
+
+            libxl_dominfo_dispose(&d_info);
 
-        libxl_dominfo_dispose(&d_info);
+            if (now) {
+                priv->infoCacheTime = now;
+                priv->cachedCpuTime = info->cpuTime;
+                priv->cachedMemory = info->memory;
+                priv->cachedMaxMem = info->maxMem;
+            }
+        }
     }
 
     info->state = virDomainObjGetState(vm, NULL);
@@ -6286,6 +6430,7 @@ libxlConnectGetDomainCapabilities(virConnectPtr conn,
     libxlDriverPrivatePtr driver = conn->privateData;
     libxlDriverConfigPtr cfg;
     char *ret = NULL;
+    char *key = NULL;
     int virttype = VIR_DOMAIN_VIRT_XEN;
     virDomainCapsPtr domCaps = NULL;
     int arch = virArchFromHost(); /* virArch */
@@ -6332,16 +6477,42 @@ libxlConnectGetDomainCapabilities(virConnectPtr conn,
         machine = "xenpv";
     }
 
-    if (!(domCaps = virDomainCapsNew(emulatorbin, machine, arch, virttype)))
+    /* The generated capabilities only depend on the tuple checked
+     * above, so after the first query for a given tuple they can be
+     * served from the cache; entries live until driver shutdown as
+     * they are only invalidated by a hypervisor change */
+    if (virAsprintf(&key, "%s/%s/%s/%s",
+                    virDomainVirtTypeToString(virttype),
+                    virArchToString(arch), machine, emulatorbin) < 0)
         goto cleanup;
 
-    if (libxlMakeDomainCapabilities(domCaps, cfg->firmwares,
-                                    cfg->nfirmwares) < 0)
-        goto cleanup;
+    virMutexLock(&driver->lock);
+    domCaps = virObjectRef(virHashLookup(driver->domainCapsCache, key));
+    virMutexUnlock(&driver->lock);
+
+    if (!domCaps) {
+        if (!(domCaps = virDomainCapsNew(emulatorbin, machine, arch, virttype)))
+            goto cleanup;
+
+        if (libxlMakeDomainCapabilities(domCaps, cfg->firmwares,
+                                        cfg->nfirmwares) < 0)
+            goto cleanup;
+
+        virMutexLock(&driver->lock);
+        if (virHashAddEntry(driver->domainCapsCache, key,
+                            virObjectRef(domCaps)) < 0) {
+            /* Racing queries may have cached the same tuple already;
+             * serving the freshly built copy is still fine */
+            virObjectUnref(domCaps);
+            virResetLastError();
+        }
+        virMutexUnlock(&driver->lock);
+    }
 
     ret = virDomainCapsFormat(domCaps);
 
  cleanup:
+    VIR_FREE(key);
     virObjectUnref(domCaps);
     virObjectUnref(cfg);
     return ret;
@@ -160,8 +160,12 @@ virLockDaemonNew(virLockDaemonConfigPtr config, bool privileged)
         return NULL;
     }
 
+    /* Multiple dispatch workers let an acquisition blocked on slow
+     * storage proceed without stalling requests from other clients;
+     * each client handler serializes on its own mutex and the
+     * lockspaces use fine grained locking */
     if (!(srv = virNetServerNew("virtlockd", 1,
-                                1, 1, 0, config->max_clients,
+                                1, 4, 0, config->max_clients,
                                 config->max_clients, -1, 0,
                                 NULL,
                                 virLockDaemonClientNew,
@@ -97,6 +97,175 @@ virLockSpaceProtocolDispatchAcquireResource(virNetServerPtr server ATTRIBUTE_UNU
 }
 
 
+static int
+virLockSpaceProtocolResourceSorter(const void *a,
+                                   const void *b)
+{
+    const virLockSpaceProtocolResource *resa = a;
+    const virLockSpaceProtocolResource *resb = b;
+    int rc;
+
+    if ((rc = strcmp(resa->path, resb->path)) != 0)
+        return rc;
+
+    return strcmp(resa->name, resb->name);
+}
+
+
+static int
+virLockSpaceProtocolDispatchAcquireResources(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                             virNetServerClientPtr client,
+                                             virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                             virNetMessageErrorPtr rerr,
+                                             virLockSpaceProtocolAcquireResourcesArgs *args)
+{
+    int rv = -1;
+    unsigned int flags = args->flags;
+    virLockDaemonClientPtr priv =
+        virNetServerClientGetPrivateData(client);
+    size_t i;
+    size_t nacquired = 0;
+
+    virMutexLock(&priv->lock);
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (priv->restricted) {
+        virReportError(VIR_ERR_OPERATION_DENIED, "%s",
+                       _("lock manager connection has been restricted"));
+        goto cleanup;
+    }
+
+    if (!priv->ownerId) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("lock owner details have not been registered"));
+        goto cleanup;
+    }
+
+    /* Acquire in a stable global order, so two owners asking for
+     * overlapping sets of resources always contend on the first
+     * common resource instead of each grabbing part of the other's
+     * set before failing */
+    qsort(args->resources.resources_val,
+          args->resources.resources_len,
+          sizeof(args->resources.resources_val[0]),
+          virLockSpaceProtocolResourceSorter);
+
+    for (i = 0; i < args->resources.resources_len; i++) {
+        virLockSpaceProtocolResource *res = &args->resources.resources_val[i];
+        virLockSpacePtr lockspace;
+        unsigned int newFlags = 0;
+
+        if (!(lockspace = virLockDaemonFindLockSpace(lockDaemon, res->path))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Lockspace for path %s does not exist"),
+                           res->path);
+            goto rollback;
+        }
+
+        if (res->flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED)
+            newFlags |= VIR_LOCK_SPACE_ACQUIRE_SHARED;
+        if (res->flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE)
+            newFlags |= VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE;
+
+        if (virLockSpaceAcquireResource(lockspace,
+                                        res->name,
+                                        priv->ownerPid,
+                                        newFlags) < 0)
+            goto rollback;
+
+        nacquired++;
+    }
+
+    rv = 0;
+    goto cleanup;
+
+ rollback:
+    {
+        virErrorPtr err = virSaveLastError();
+
+        while (nacquired--) {
+            virLockSpaceProtocolResource *res =
+                &args->resources.resources_val[nacquired];
+            virLockSpacePtr lockspace =
+                virLockDaemonFindLockSpace(lockDaemon, res->path);
+
+            if (!lockspace ||
+                virLockSpaceReleaseResource(lockspace,
+                                            res->name,
+                                            priv->ownerPid) < 0)
+                VIR_WARN("Unable to release resource %s after failed acquire",
+                         res->name);
+        }
+
+        virSetError(err);
+        virFreeError(err);
+    }
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virMutexUnlock(&priv->lock);
+    return rv;
+}
+
+
+static int
+virLockSpaceProtocolDispatchReleaseResources(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                             virNetServerClientPtr client,
+                                             virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                             virNetMessageErrorPtr rerr,
+                                             virLockSpaceProtocolReleaseResourcesArgs *args)
+{
+    int rv = -1;
+    unsigned int flags = args->flags;
+    virLockDaemonClientPtr priv =
+        virNetServerClientGetPrivateData(client);
+    size_t i;
+
+    virMutexLock(&priv->lock);
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (priv->restricted) {
+        virReportError(VIR_ERR_OPERATION_DENIED, "%s",
+                       _("lock manager connection has been restricted"));
+        goto cleanup;
+    }
+
+    if (!priv->ownerId) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("lock owner details have not been registered"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < args->resources.resources_len; i++) {
+        virLockSpaceProtocolResource *res = &args->resources.resources_val[i];
+        virLockSpacePtr lockspace;
+
+        if (!(lockspace = virLockDaemonFindLockSpace(lockDaemon, res->path))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Lockspace for path %s does not exist"),
+                           res->path);
+            goto cleanup;
+        }
+
+        if (virLockSpaceReleaseResource(lockspace,
+                                        res->name,
+                                        priv->ownerPid) < 0)
+            goto cleanup;
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virMutexUnlock(&priv->lock);
+    return rv;
+}
+
+
 static int
 virLockSpaceProtocolDispatchCreateResource(virNetServerPtr server ATTRIBUTE_UNUSED,
                                            virNetServerClientPtr client,
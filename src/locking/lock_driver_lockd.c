@@ -643,16 +643,15 @@ static int virLockManagerLockDaemonAcquire(virLockManagerPtr lock,
         goto cleanup;
 
     if (!(flags & VIR_LOCK_MANAGER_ACQUIRE_REGISTER_ONLY)) {
-        size_t i;
-        for (i = 0; i < priv->nresources; i++) {
+        if (priv->nresources == 1) {
             virLockSpaceProtocolAcquireResourceArgs args;
 
             memset(&args, 0, sizeof(args));
 
-            if (priv->resources[i].lockspace)
-                args.path = priv->resources[i].lockspace;
-            args.name = priv->resources[i].name;
-            args.flags = priv->resources[i].flags;
+            if (priv->resources[0].lockspace)
+                args.path = priv->resources[0].lockspace;
+            args.name = priv->resources[0].name;
+            args.flags = priv->resources[0].flags;
 
             if (virNetClientProgramCall(program,
                                         client,
@@ -662,6 +661,41 @@ static int virLockManagerLockDaemonAcquire(virLockManagerPtr lock,
                                         (xdrproc_t)xdr_virLockSpaceProtocolAcquireResourceArgs, &args,
                                         (xdrproc_t)xdr_void, NULL) < 0)
                 goto cleanup;
+        } else if (priv->nresources > 1) {
+            /* Carry all resources in one message, so a many-disk
+             * domain needs a single round trip to virtlockd and the
+             * resources are acquired or refused as a unit */
+            virLockSpaceProtocolAcquireResourcesArgs args;
+            size_t i;
+
+            memset(&args, 0, sizeof(args));
+
+            if (VIR_ALLOC_N(args.resources.resources_val,
+                            priv->nresources) < 0)
+                goto cleanup;
+            args.resources.resources_len = priv->nresources;
+
+            for (i = 0; i < priv->nresources; i++) {
+                if (priv->resources[i].lockspace)
+                    args.resources.resources_val[i].path =
+                        priv->resources[i].lockspace;
+                args.resources.resources_val[i].name =
+                    priv->resources[i].name;
+                args.resources.resources_val[i].flags =
+                    priv->resources[i].flags;
+            }
+
+            if (virNetClientProgramCall(program,
+                                        client,
+                                        counter++,
+                                        VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCES,
+                                        0, NULL, NULL, NULL,
+                                        (xdrproc_t)xdr_virLockSpaceProtocolAcquireResourcesArgs, &args,
+                                        (xdrproc_t)xdr_void, NULL) < 0) {
+                VIR_FREE(args.resources.resources_val);
+                goto cleanup;
+            }
+            VIR_FREE(args.resources.resources_val);
         }
     }
 
@@ -700,15 +734,15 @@ static int virLockManagerLockDaemonRelease(virLockManagerPtr lock,
     if (!(client = virLockManagerLockDaemonConnect(lock, &program, &counter)))
         goto cleanup;
 
-    for (i = 0; i < priv->nresources; i++) {
+    if (priv->nresources == 1) {
         virLockSpaceProtocolReleaseResourceArgs args;
 
         memset(&args, 0, sizeof(args));
 
-        if (priv->resources[i].lockspace)
-            args.path = priv->resources[i].lockspace;
-        args.name = priv->resources[i].name;
-        args.flags = priv->resources[i].flags;
+        if (priv->resources[0].lockspace)
+            args.path = priv->resources[0].lockspace;
+        args.name = priv->resources[0].name;
+        args.flags = priv->resources[0].flags;
 
         args.flags &=
             ~(VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED |
@@ -722,6 +756,39 @@ static int virLockManagerLockDaemonRelease(virLockManagerPtr lock,
                                     (xdrproc_t)xdr_virLockSpaceProtocolReleaseResourceArgs, &args,
                                     (xdrproc_t)xdr_void, NULL) < 0)
             goto cleanup;
+    } else if (priv->nresources > 1) {
+        virLockSpaceProtocolReleaseResourcesArgs args;
+
+        memset(&args, 0, sizeof(args));
+
+        if (VIR_ALLOC_N(args.resources.resources_val,
+                        priv->nresources) < 0)
+            goto cleanup;
+        args.resources.resources_len = priv->nresources;
+
+        for (i = 0; i < priv->nresources; i++) {
+            if (priv->resources[i].lockspace)
+                args.resources.resources_val[i].path =
+                    priv->resources[i].lockspace;
+            args.resources.resources_val[i].name =
+                priv->resources[i].name;
+            args.resources.resources_val[i].flags =
+                priv->resources[i].flags &
+                ~(VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED |
+                  VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE);
+        }
+
+        if (virNetClientProgramCall(program,
+                                    client,
+                                    counter++,
+                                    VIR_LOCK_SPACE_PROTOCOL_PROC_RELEASE_RESOURCES,
+                                    0, NULL, NULL, NULL,
+                                    (xdrproc_t)xdr_virLockSpaceProtocolReleaseResourcesArgs, &args,
+                                    (xdrproc_t)xdr_void, NULL) < 0) {
+            VIR_FREE(args.resources.resources_val);
+            goto cleanup;
+        }
+        VIR_FREE(args.resources.resources_val);
     }
 
     rv = 0;
@@ -23,7 +23,9 @@
 #include <config.h>
 
 #include "log_handler.h"
+#include "virbuffer.h"
 #include "virerror.h"
+#include "virevent.h"
 #include "virobject.h"
 #include "virfile.h"
 #include "viralloc.h"
@@ -43,6 +45,17 @@ VIR_LOG_INIT("logging.log_handler");
 
 #define DEFAULT_MODE 0600
 
+/* Interval between timed flushes of buffered log data, which is
+ * also the accounting period for the per-file output rate limit */
+#define VIR_LOG_HANDLER_FLUSH_PERIOD_MS 100
+
+/* Force a flush once this much data is pending for one file */
+#define VIR_LOG_HANDLER_MAX_BUF (64 * 1024)
+
+/* Stop reading from a guest's pipe once it has sent this much in
+ * one period (~1.3 MB/sec), letting the pipe backpressure it */
+#define VIR_LOG_HANDLER_MAX_PERIOD_BYTES (128 * 1024)
+
 typedef struct _virLogHandlerLogFile virLogHandlerLogFile;
 typedef virLogHandlerLogFile *virLogHandlerLogFilePtr;
 
@@ -51,6 +64,10 @@ struct _virLogHandlerLogFile {
     int watch;
     int pipefd; /* Read from QEMU via this */
 
+    virBuffer buffer; /* data read from the pipe, not yet written */
+    size_t periodBytes; /* bytes read in the current rate period */
+    bool paused; /* watch disabled until the next period starts */
+
     char *driver;
     unsigned char domuuid[VIR_UUID_BUFLEN];
     char *domname;
@@ -66,6 +83,8 @@ struct _virLogHandler {
     virLogHandlerLogFilePtr *files;
     size_t nfiles;
 
+    int flushTimer; /* -1 if no event loop is present */
+
     virLogHandlerShutdownInhibitor inhibitor;
     void *opaque;
 };
@@ -88,12 +107,37 @@ virLogHandlerOnceInit(void)
 VIR_ONCE_GLOBAL_INIT(virLogHandler)
 
 
+static int
+virLogHandlerLogFileFlush(virLogHandlerLogFilePtr file)
+{
+    size_t len = virBufferUse(&file->buffer);
+
+    if (virBufferCheckError(&file->buffer) < 0)
+        return -1;
+
+    if (len == 0)
+        return 0;
+
+    if (virRotatingFileWriterAppend(file->file,
+                                    virBufferCurrentContent(&file->buffer),
+                                    len) != (ssize_t)len)
+        return -1;
+
+    virBufferFreeAndReset(&file->buffer);
+    return 0;
+}
+
+
 static void
 virLogHandlerLogFileFree(virLogHandlerLogFilePtr file)
 {
     if (!file)
         return;
 
+    if (file->file)
+        ignore_value(virLogHandlerLogFileFlush(file));
+    virBufferFreeAndReset(&file->buffer);
+
     VIR_FORCE_CLOSE(file->pipefd);
     virRotatingFileWriterFree(file->file);
 
@@ -167,9 +211,29 @@ virLogHandlerDomainLogFileEvent(int watch,
         goto error;
     }
 
-    if (virRotatingFileWriterAppend(logfile->file, buf, len) != len)
+    if (len > 0) {
+        virBufferAdd(&logfile->buffer, buf, len);
+        if (virBufferCheckError(&logfile->buffer) < 0)
+            goto error;
+        logfile->periodBytes += len;
+    }
+
+    /* Without a timer to flush later, or with too much pending,
+     * the data must hit the disk now */
+    if ((handler->flushTimer == -1 ||
+         virBufferUse(&logfile->buffer) >= VIR_LOG_HANDLER_MAX_BUF) &&
+        virLogHandlerLogFileFlush(logfile) < 0)
         goto error;
 
+    if (handler->flushTimer != -1 &&
+        !logfile->paused &&
+        logfile->periodBytes >= VIR_LOG_HANDLER_MAX_PERIOD_BYTES) {
+        VIR_DEBUG("Pausing watch %d after %zu bytes in one period",
+                  logfile->watch, logfile->periodBytes);
+        virEventUpdateHandle(logfile->watch, 0);
+        logfile->paused = true;
+    }
+
     if (events & VIR_EVENT_HANDLE_HANGUP)
         goto error;
 
@@ -183,6 +247,39 @@ virLogHandlerDomainLogFileEvent(int watch,
 }
 
 
+static void
+virLogHandlerFlushTimer(int timer ATTRIBUTE_UNUSED,
+                        void *opaque)
+{
+    virLogHandlerPtr handler = opaque;
+    size_t i;
+
+    virObjectLock(handler);
+
+    i = 0;
+    while (i < handler->nfiles) {
+        virLogHandlerLogFilePtr logfile = handler->files[i];
+
+        if (virLogHandlerLogFileFlush(logfile) < 0) {
+            handler->inhibitor(false, handler->opaque);
+            virLogHandlerLogFileClose(handler, logfile);
+            continue;
+        }
+
+        logfile->periodBytes = 0;
+        if (logfile->paused) {
+            virEventUpdateHandle(logfile->watch,
+                                 VIR_EVENT_HANDLE_READABLE);
+            logfile->paused = false;
+        }
+
+        i++;
+    }
+
+    virObjectUnlock(handler);
+}
+
+
 virLogHandlerPtr
 virLogHandlerNew(bool privileged,
                  size_t max_size,
@@ -204,6 +301,16 @@ virLogHandlerNew(bool privileged,
     handler->inhibitor = inhibitor;
     handler->opaque = opaque;
 
+    /* If there is no event loop registered we quietly fall back
+     * to flushing data as soon as it arrives */
+    if ((handler->flushTimer =
+         virEventAddTimeout(VIR_LOG_HANDLER_FLUSH_PERIOD_MS,
+                            virLogHandlerFlushTimer,
+                            handler, NULL)) < 0) {
+        virResetLastError();
+        handler->flushTimer = -1;
+    }
+
     return handler;
 
  error:
@@ -352,6 +459,9 @@ virLogHandlerDispose(void *obj)
     virLogHandlerPtr handler = obj;
     size_t i;
 
+    if (handler->flushTimer != -1)
+        virEventRemoveTimeout(handler->flushTimer);
+
     for (i = 0; i < handler->nfiles; i++) {
         handler->inhibitor(false, handler->opaque);
         virLogHandlerLogFileFree(handler->files[i]);
@@ -469,6 +579,11 @@ virLogHandlerDomainGetLogFilePosition(virLogHandlerPtr handler,
         goto cleanup;
     }
 
+    /* Push out any buffered data so the reported position
+     * reflects everything the guest has sent */
+    if (virLogHandlerLogFileFlush(file) < 0)
+        goto cleanup;
+
     *inode = virRotatingFileWriterGetINode(file->file);
     *offset = virRotatingFileWriterGetOffset(file->file);
 
@@ -491,11 +606,21 @@ virLogHandlerDomainReadLogFile(virLogHandlerPtr handler,
     virRotatingFileReaderPtr file = NULL;
     char *data = NULL;
     ssize_t got;
+    size_t i;
 
     virCheckFlags(0, NULL);
 
     virObjectLock(handler);
 
+    for (i = 0; i < handler->nfiles; i++) {
+        if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file),
+                  path)) {
+            if (virLogHandlerLogFileFlush(handler->files[i]) < 0)
+                goto error;
+            break;
+        }
+    }
+
     if (!(file = virRotatingFileReaderNew(path, handler->max_backups)))
         goto error;
 
@@ -544,6 +669,10 @@ virLogHandlerDomainAppendLogFile(virLogHandlerPtr handler,
 
     for (i = 0; i < handler->nfiles; i++) {
         if (STREQ(virRotatingFileWriterGetPath(handler->files[i]->file), path)) {
+            /* Keep the appended message ordered after anything
+             * already read from the guest's pipe */
+            if (virLogHandlerLogFileFlush(handler->files[i]) < 0)
+                goto cleanup;
             writer = handler->files[i]->file;
             break;
         }
@@ -894,7 +894,6 @@ static int lxcContainerMountBasicFS(bool userns_enabled,
 {
     size_t i;
     int rc = -1;
-    char* mnt_src = NULL;
     int mnt_mflags;
 
     VIR_DEBUG("Mounting basic filesystems");
@@ -902,6 +901,7 @@ static int lxcContainerMountBasicFS(bool userns_enabled,
     for (i = 0; i < ARRAY_CARDINALITY(lxcBasicMounts); i++) {
         bool bindOverReadonly;
         virLXCBasicMountInfo const *mnt = &lxcBasicMounts[i];
+        const char *mnt_src;
 
         /* When enable userns but disable netns, kernel will
          * forbid us doing a new fresh mount for sysfs.
@@ -909,12 +909,10 @@ static int lxcContainerMountBasicFS(bool userns_enabled,
          */
         if (userns_enabled && netns_disabled &&
             STREQ(mnt->src, "sysfs")) {
-            if (VIR_STRDUP(mnt_src, "/sys") < 0)
-                goto cleanup;
+            mnt_src = "/sys";
             mnt_mflags = MS_NOSUID|MS_NOEXEC|MS_NODEV|MS_RDONLY|MS_BIND;
         } else {
-            if (VIR_STRDUP(mnt_src, mnt->src) < 0)
-                goto cleanup;
+            mnt_src = mnt->src;
             mnt_mflags = mnt->mflags;
         }
 
@@ -936,14 +934,12 @@ static int lxcContainerMountBasicFS(bool userns_enabled,
             if (ret == 0) {
                 VIR_DEBUG("Skipping '%s' which isn't mounted in host",
                           mnt->dst);
-                VIR_FREE(mnt_src);
                 continue;
             }
         }
 
         if (mnt->skipUserNS && userns_enabled) {
             VIR_DEBUG("Skipping due to user ns enablement");
-            VIR_FREE(mnt_src);
             continue;
         }
 
@@ -951,13 +947,11 @@ static int lxcContainerMountBasicFS(bool userns_enabled,
          * missing folder in /proc due to the absence of a kernel feature */
         if (STRPREFIX(mnt_src, "/") && !virFileExists(mnt_src)) {
             VIR_DEBUG("Skipping due to missing source: %s", mnt_src);
-            VIR_FREE(mnt_src);
             continue;
         }
 
         if (mnt->skipNoNetns && netns_disabled) {
             VIR_DEBUG("Skipping due to absence of network namespace");
-            VIR_FREE(mnt_src);
             continue;
         }
 
@@ -996,14 +990,11 @@ static int lxcContainerMountBasicFS(bool userns_enabled,
                                  MS_BIND|MS_REMOUNT|MS_RDONLY);
             goto cleanup;
         }
-
-        VIR_FREE(mnt_src);
     }
 
     rc = 0;
 
  cleanup:
-    VIR_FREE(mnt_src);
     VIR_DEBUG("rc=%d", rc);
     return rc;
 }
@@ -1753,6 +1744,14 @@ static int lxcContainerSetupPivotRoot(virDomainDefPtr vmDef,
     char *sec_mount_options;
     char *stateDir = NULL;
 
+    /* Note: this sequence must be re-executed for every container
+     * start even when many identical containers boot concurrently.
+     * The mounts are assembled inside the container's own private
+     * mount namespace on top of its own rootfs, so the resulting
+     * tree cannot be snapshotted (e.g. via a kept-open namespace fd)
+     * and shared with other containers without also sharing live
+     * mount state, pivot_root results and security labels between
+     * them. */
     VIR_DEBUG("Setup pivot root");
 
     if (!(sec_mount_options = virSecurityManagerGetMountOptions(securityDriver, vmDef)))
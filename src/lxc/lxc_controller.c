@@ -94,10 +94,11 @@ struct _virLXCControllerConsole {
     int epollWatch;
     int epollFd; /* epoll FD for dealing with EOF */
 
+    size_t bufferSize;
     size_t fromHostLen;
-    char fromHostBuf[1024];
+    char *fromHostBuf;
     size_t fromContLen;
-    char fromContBuf[1024];
+    char *fromContBuf;
 
     virNetDaemonPtr daemon;
 };
@@ -248,6 +249,9 @@ static void virLXCControllerConsoleClose(virLXCControllerConsolePtr console)
     if (console->epollWatch != -1)
         virEventRemoveHandle(console->epollWatch);
     VIR_FORCE_CLOSE(console->epollFd);
+
+    VIR_FREE(console->fromHostBuf);
+    VIR_FREE(console->fromContBuf);
 }
 
 
@@ -304,20 +308,54 @@ static void virLXCControllerFree(virLXCControllerPtr ctrl)
 }
 
 
+/* Default size of the relay buffer in each direction. Large enough to
+ * drain a pty in very few read() calls when a container logs heavily
+ * to its console */
+#define LXC_CONSOLE_BUF_SIZE (64 * 1024)
+
+static size_t virLXCControllerConsoleBufferSize(void)
+{
+    const char *env = getenv("LIBVIRT_LXC_CONSOLE_BUFFER_BYTES");
+    unsigned long long size;
+
+    if (!env)
+        return LXC_CONSOLE_BUF_SIZE;
+
+    if (virStrToLong_ullp(env, NULL, 10, &size) < 0 ||
+        size < 1024 || size > 1024 * 1024) {
+        VIR_WARN("Ignoring invalid LIBVIRT_LXC_CONSOLE_BUFFER_BYTES '%s'",
+                 env);
+        return LXC_CONSOLE_BUF_SIZE;
+    }
+
+    return size;
+}
+
+
 static int virLXCControllerAddConsole(virLXCControllerPtr ctrl,
                                       int hostFd)
 {
+    virLXCControllerConsolePtr console;
+
     if (VIR_EXPAND_N(ctrl->consoles, ctrl->nconsoles, 1) < 0)
         return -1;
-    ctrl->consoles[ctrl->nconsoles-1].daemon = ctrl->daemon;
-    ctrl->consoles[ctrl->nconsoles-1].hostFd = hostFd;
-    ctrl->consoles[ctrl->nconsoles-1].hostWatch = -1;
+    console = &ctrl->consoles[ctrl->nconsoles-1];
+    console->daemon = ctrl->daemon;
+    console->hostFd = hostFd;
+    console->hostWatch = -1;
 
-    ctrl->consoles[ctrl->nconsoles-1].contFd = -1;
-    ctrl->consoles[ctrl->nconsoles-1].contWatch = -1;
+    console->contFd = -1;
+    console->contWatch = -1;
 
-    ctrl->consoles[ctrl->nconsoles-1].epollFd = -1;
-    ctrl->consoles[ctrl->nconsoles-1].epollWatch = -1;
+    console->epollFd = -1;
+    console->epollWatch = -1;
+
+    console->bufferSize = virLXCControllerConsoleBufferSize();
+    if (VIR_ALLOC_N(console->fromHostBuf, console->bufferSize) < 0 ||
+        VIR_ALLOC_N(console->fromContBuf, console->bufferSize) < 0) {
+        VIR_FREE(console->fromHostBuf);
+        return -1;
+    }
     return 0;
 }
 
@@ -1043,7 +1081,7 @@ static void virLXCControllerConsoleUpdateWatch(virLXCControllerConsolePtr consol
 
     /* If host console is open, then we can look to read/write */
     if (!console->hostClosed) {
-        if (console->fromHostLen < sizeof(console->fromHostBuf))
+        if (console->fromHostLen < console->bufferSize)
             hostEvents |= VIR_EVENT_HANDLE_READABLE;
         if (console->fromContLen)
             hostEvents |= VIR_EVENT_HANDLE_WRITABLE;
@@ -1051,7 +1089,7 @@ static void virLXCControllerConsoleUpdateWatch(virLXCControllerConsolePtr consol
 
     /* If cont console is open, then we can look to read/write */
     if (!console->contClosed) {
-        if (console->fromContLen < sizeof(console->fromContBuf))
+        if (console->fromContLen < console->bufferSize)
             contEvents |= VIR_EVENT_HANDLE_READABLE;
         if (console->fromHostLen)
             contEvents |= VIR_EVENT_HANDLE_WRITABLE;
@@ -1202,30 +1240,31 @@ static void virLXCControllerConsoleIO(int watch, int fd, int events, void *opaqu
     if (events & VIR_EVENT_HANDLE_READABLE) {
         char *buf;
         size_t *len;
-        size_t avail;
         ssize_t done;
         if (watch == console->hostWatch) {
             buf = console->fromHostBuf;
             len = &console->fromHostLen;
-            avail = sizeof(console->fromHostBuf) - *len;
         } else {
             buf = console->fromContBuf;
             len = &console->fromContLen;
-            avail = sizeof(console->fromContBuf) - *len;
         }
-     reread:
-        done = read(fd, buf + *len, avail);
-        if (done == -1 && errno == EINTR)
-            goto reread;
-        if (done == -1 && errno != EAGAIN) {
-            virReportSystemError(errno, "%s",
-                                 _("Unable to read container pty"));
-            goto error;
-        }
-        if (done > 0) {
+        /* Drain the pty fully in this wakeup rather than coming back
+         * through the event loop for every chunk */
+        while (*len < console->bufferSize) {
+            done = read(fd, buf + *len, console->bufferSize - *len);
+            if (done == -1 && errno == EINTR)
+                continue;
+            if (done == -1 && errno != EAGAIN) {
+                virReportSystemError(errno, "%s",
+                                     _("Unable to read container pty"));
+                goto error;
+            }
+            if (done <= 0) {
+                VIR_DEBUG("Read fd %d done %d errno %d",
+                          fd, (int)done, errno);
+                break;
+            }
             *len += done;
-        } else {
-            VIR_DEBUG("Read fd %d done %d errno %d", fd, (int)done, errno);
         }
     }
 
@@ -1241,20 +1280,22 @@ static void virLXCControllerConsoleIO(int watch, int fd, int events, void *opaqu
             len = &console->fromHostLen;
         }
 
-     rewrite:
-        done = write(fd, buf, *len);
-        if (done == -1 && errno == EINTR)
-            goto rewrite;
-        if (done == -1 && errno != EAGAIN) {
-            virReportSystemError(errno, "%s",
-                                 _("Unable to write to container pty"));
-            goto error;
-        }
-        if (done > 0) {
+        while (*len) {
+            done = write(fd, buf, *len);
+            if (done == -1 && errno == EINTR)
+                continue;
+            if (done == -1 && errno != EAGAIN) {
+                virReportSystemError(errno, "%s",
+                                     _("Unable to write to container pty"));
+                goto error;
+            }
+            if (done <= 0) {
+                VIR_DEBUG("Write fd %d done %d errno %d",
+                          fd, (int)done, errno);
+                break;
+            }
             memmove(buf, buf + done, (*len - done));
             *len -= done;
-        } else {
-            VIR_DEBUG("Write fd %d done %d errno %d", fd, (int)done, errno);
         }
     }
 
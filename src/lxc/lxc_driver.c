@@ -603,6 +603,7 @@ static int lxcDomainGetInfo(virDomainPtr dom,
         info->cpuTime = 0;
         info->memory = vm->def->mem.cur_balloon;
     } else {
+        virCgroupBatchBegin(priv->cgroup);
         if (virCgroupGetCpuacctUsage(priv->cgroup, &(info->cpuTime)) < 0) {
             virReportError(VIR_ERR_OPERATION_FAILED,
                            "%s", _("Cannot read cputime for domain"));
@@ -625,6 +626,8 @@ static int lxcDomainGetInfo(virDomainPtr dom,
     ret = 0;
 
  cleanup:
+    if (vm)
+        virCgroupBatchEnd(priv->cgroup);
     virDomainObjEndAPI(&vm);
     return ret;
 }
@@ -58,6 +58,7 @@
 #include "viralloc.h"
 #include "viruuid.h"
 #include "viriptables.h"
+#include "virfirewall.h"
 #include "virlog.h"
 #include "virdnsmasq.h"
 #include "configmake.h"
@@ -74,6 +75,7 @@
 #include "network_event.h"
 #include "virhook.h"
 #include "virjson.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_NETWORK
 #define MAX_BRIDGE_ID 256
@@ -472,6 +474,120 @@ networkAutostartConfig(virNetworkObjPtr net,
     return ret;
 }
 
+/* Upper bound on networks being brought up at the same time */
+#define NETWORK_AUTOSTART_WORKERS_MAX 10
+
+struct _networkAutostartBarrier {
+    virNetworkDriverStatePtr driver;
+    virMutex lock;
+    virCond cond;
+    size_t nremaining;
+};
+
+static void
+networkAutostartJob(void *jobdata, void *opaque)
+{
+    virNetworkObjPtr net = jobdata;
+    struct _networkAutostartBarrier *barrier = opaque;
+
+    ignore_value(networkAutostartConfig(net, barrier->driver));
+    virObjectUnref(net);
+
+    virMutexLock(&barrier->lock);
+    barrier->nremaining--;
+    virCondSignal(&barrier->cond);
+    virMutexUnlock(&barrier->lock);
+}
+
+struct _networkAutostartList {
+    virNetworkObjPtr *nets;
+    size_t nnets;
+};
+
+static int
+networkCollectAutostart(virNetworkObjPtr net,
+                        void *opaque)
+{
+    struct _networkAutostartList *list = opaque;
+    int ret = 0;
+
+    virObjectLock(net);
+    if (net->autostart && !virNetworkObjIsActive(net)) {
+        if (VIR_APPEND_ELEMENT_COPY(list->nets, list->nnets, net) < 0)
+            ret = -1;
+        else
+            virObjectRef(net);
+    }
+    virObjectUnlock(net);
+    return ret;
+}
+
+/* Start all networks flagged for autostart.  The starts are handed to
+ * a small worker pool so that the dnsmasq/radvd forks and their
+ * daemonization waits overlap instead of being paid one network at a
+ * time.  The jobs need no ordering between each other: every network
+ * creates and owns its bridge, and concurrent firewall updates are
+ * serialized inside virfirewall.  Returns once every network has been
+ * started; anything that could not be queued is started inline. */
+static void
+networkAutostartConfigs(virNetworkDriverStatePtr driver)
+{
+    struct _networkAutostartList list = { NULL, 0 };
+    struct _networkAutostartBarrier barrier;
+    bool barrierInit = false;
+    virThreadPoolPtr pool = NULL;
+    size_t i;
+
+    virNetworkObjListForEach(driver->networks,
+                             networkCollectAutostart, &list);
+    if (!list.nnets)
+        return;
+
+    barrier.driver = driver;
+    barrier.nremaining = 0;
+
+    if (virMutexInit(&barrier.lock) == 0) {
+        if (virCondInit(&barrier.cond) == 0)
+            barrierInit = true;
+        else
+            virMutexDestroy(&barrier.lock);
+    }
+
+    if (barrierInit)
+        pool = virThreadPoolNew(0, NETWORK_AUTOSTART_WORKERS_MAX, 0,
+                                networkAutostartJob, &barrier);
+
+    if (pool) {
+        virMutexLock(&barrier.lock);
+        for (i = 0; i < list.nnets; i++) {
+            barrier.nremaining++;
+            if (virThreadPoolSendJob(pool, 0, list.nets[i]) < 0) {
+                barrier.nremaining--;
+                continue;
+            }
+            list.nets[i] = NULL;
+        }
+        while (barrier.nremaining > 0)
+            ignore_value(virCondWait(&barrier.cond, &barrier.lock));
+        virMutexUnlock(&barrier.lock);
+
+        virThreadPoolFree(pool);
+    }
+
+    if (barrierInit) {
+        virCondDestroy(&barrier.cond);
+        virMutexDestroy(&barrier.lock);
+    }
+
+    for (i = 0; i < list.nnets; i++) {
+        if (!list.nets[i])
+            continue;
+        ignore_value(networkAutostartConfig(list.nets[i], driver));
+        virObjectUnref(list.nets[i]);
+    }
+    VIR_FREE(list.nets);
+}
+
 #if HAVE_FIREWALLD
 static DBusHandlerResult
 firewalld_dbus_filter_bridge(DBusConnection *connection ATTRIBUTE_UNUSED,
@@ -602,6 +718,10 @@ networkStateInitialize(bool privileged,
         goto error;
     }
 
+    if (privileged)
+        virFirewallSetBatchMode(virFileIsExecutable(IPTABLES_RESTORE_PATH) &&
+                                virFileIsExecutable(IP6TABLES_RESTORE_PATH));
+
     /* configuration/state paths are one of
      * ~/.config/libvirt/... (session/unprivileged)
      * /etc/libvirt/... && /var/(run|lib)/libvirt/... (system/privileged).
@@ -735,9 +855,7 @@ networkStateAutoStart(void)
     if (!network_driver)
         return;
 
-    virNetworkObjListForEach(network_driver->networks,
-                             networkAutostartConfig,
-                             network_driver);
+    networkAutostartConfigs(network_driver);
 }
 
 /**
@@ -759,9 +877,7 @@ networkStateReload(void)
                              network_driver->networkAutostartDir);
     networkReloadFirewallRules(network_driver);
     networkRefreshDaemons(network_driver);
-    virNetworkObjListForEach(network_driver->networks,
-                             networkAutostartConfig,
-                             network_driver);
+    networkAutostartConfigs(network_driver);
     return 0;
 }
 
@@ -1294,9 +1410,18 @@ networkDnsmasqConfContents(virNetworkObjPtr network,
      * listening for DHCP, we should write a 0-length hosts
      * file to allow for runtime additions.
      */
-    if (ipv4def || ipv6def)
+    if (ipv4def || ipv6def) {
         virBufferAsprintf(&configbuf, "dhcp-hostsfile=%s\n",
                           dctx->hostsfile->path);
+        /* also watch a directory of per-host files, so that runtime
+         * additions and modifications are picked up without a SIGHUP
+         */
+        if (dnsmasqCapsGet(caps, DNSMASQ_CAPS_DHCP_HOSTSDIR)) {
+            dctx->hostsfile->usedir = true;
+            virBufferAsprintf(&configbuf, "dhcp-hostsdir=%s\n",
+                              dctx->hostsfile->dir);
+        }
+    }
 
     /* Likewise, always create this file and put it on the
      * commandline, to allow for runtime additions.
@@ -1499,6 +1624,7 @@ networkRefreshDhcpDaemon(virNetworkDriverStatePtr driver,
     size_t i;
     virNetworkIPDefPtr ipdef, ipv4def, ipv6def;
     dnsmasqContext *dctx = NULL;
+    dnsmasqCapsPtr dnsmasq_caps = NULL;
 
     /* if no IP addresses specified, nothing to do */
     if (!virNetworkDefGetIPByIndex(network->def, AF_UNSPEC, 0))
@@ -1514,6 +1640,15 @@ networkRefreshDhcpDaemon(virNetworkDriverStatePtr driver,
         goto cleanup;
     }
 
+    /* Reuse the per-host files directory if the running dnsmasq was
+     * started with one; if the directory is missing the daemon
+     * predates --dhcp-hostsdir support and we must not write to it.
+     */
+    dnsmasq_caps = networkGetDnsmasqCaps(driver);
+    if (dnsmasqCapsGet(dnsmasq_caps, DNSMASQ_CAPS_DHCP_HOSTSDIR) &&
+        virFileIsDir(dctx->hostsfile->dir))
+        dctx->hostsfile->usedir = true;
+
     /* Look for first IPv4 address that has dhcp defined.
      * We only support dhcp-host config on one IPv4 subnetwork
      * and on one IPv6 subnetwork.
@@ -1546,8 +1681,20 @@ networkRefreshDhcpDaemon(virNetworkDriverStatePtr driver,
     if ((ret = dnsmasqSave(dctx)) < 0)
         goto cleanup;
 
+    /* dnsmasq notices new and changed per-host files on its own; a
+     * reload is only needed when an entry was removed or the
+     * addn-hosts file changed.
+     */
+    if (dctx->hostsfile->usedir &&
+        !dctx->hostsfile->purged &&
+        !dctx->addnhostsfile->changed) {
+        ret = 0;
+        goto cleanup;
+    }
+
     ret = kill(network->dnsmasqPid, SIGHUP);
  cleanup:
+    virObjectUnref(dnsmasq_caps);
     dnsmasqContextFree(dctx);
     return ret;
 }
@@ -43,6 +43,8 @@
 #include "virpci.h"
 #include "virstring.h"
 #include "virnetdev.h"
+#include "virhostcpu.h"
+#include "virhostdev.h"
 
 #define VIR_FROM_THIS VIR_FROM_NODEDEV
 
@@ -1237,7 +1239,12 @@ static int udevEnumerateDevices(struct udev *udev)
     udev_list_entry_foreach(list_entry,
                             udev_enumerate_get_list_entry(udev_enumerate)) {
 
+        /* Take the driver lock per device rather than around the
+         * whole walk, so udev events and client queries interleave
+         * with a long initial enumeration instead of blocking on it */
+        nodeDeviceLock();
         udevProcessDeviceListEntry(udev, list_entry);
+        nodeDeviceUnlock();
     }
 
  cleanup:
@@ -1299,14 +1306,24 @@ static int nodeStateCleanup(void)
 }
 
 
+/* Maximum number of pending udev events drained per event-loop wakeup.
+ * This bounds how long the driver lock is held when a storage rescan
+ * floods the monitor socket; events beyond the limit stay queued and
+ * trigger another wakeup. */
+#define UDEV_EVENT_BATCH_MAX 256
+
 static void udevEventHandleCallback(int watch ATTRIBUTE_UNUSED,
                                     int fd,
                                     int events ATTRIBUTE_UNUSED,
                                     void *data ATTRIBUTE_UNUSED)
 {
+    struct udev_device *batch[UDEV_EVENT_BATCH_MAX];
     struct udev_device *device = NULL;
     struct udev_monitor *udev_monitor = DRV_STATE_UDEV_MONITOR(driver);
     const char *action = NULL;
+    size_t nbatch = 0;
+    size_t i;
+    size_t j;
     int udev_fd = -1;
 
     nodeDeviceLock();
@@ -1319,28 +1336,59 @@ static void udevEventHandleCallback(int watch ATTRIBUTE_UNUSED,
         goto cleanup;
     }
 
-    device = udev_monitor_receive_device(udev_monitor);
-    if (device == NULL) {
+    /* Drain everything the kernel has queued in a single pass; the
+     * monitor socket is non-blocking so NULL means the queue is empty */
+    while (nbatch < UDEV_EVENT_BATCH_MAX &&
+           (device = udev_monitor_receive_device(udev_monitor)))
+        batch[nbatch++] = device;
+
+    if (nbatch == 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("udev_monitor_receive_device returned NULL"));
         goto cleanup;
     }
 
-    action = udev_device_get_action(device);
-    VIR_DEBUG("udev action: '%s'", action);
+    VIR_DEBUG("Processing batch of %zu udev events", nbatch);
 
-    if (STREQ(action, "add") || STREQ(action, "change")) {
-        udevAddOneDevice(device);
-        goto cleanup;
-    }
+    for (i = 0; i < nbatch; i++) {
+        const char *syspath = udev_device_get_syspath(batch[i]);
 
-    if (STREQ(action, "remove")) {
-        udevRemoveOneDevice(device);
-        goto cleanup;
+        /* Coalesce bursts of add/change/remove for the same device:
+         * a later event for this syspath supersedes the current one
+         * since both add and change resync the full device state */
+        for (j = i + 1; j < nbatch; j++) {
+            if (STREQ_NULLABLE(syspath,
+                               udev_device_get_syspath(batch[j])))
+                break;
+        }
+        if (j < nbatch) {
+            VIR_DEBUG("Skipping superseded udev event for '%s'",
+                      NULLSTR(syspath));
+            continue;
+        }
+
+        action = udev_device_get_action(batch[i]);
+        VIR_DEBUG("udev action: '%s'", action);
+
+        /* Any event on a CPU device (hotplug, online/offline) may change
+         * the host topology; drop the cached copy so it gets probed
+         * again */
+        if (STREQ_NULLABLE(udev_device_get_subsystem(batch[i]), "cpu"))
+            virHostCPUInfoInvalidate();
+
+        /* Ditto for the hostdev manager's PCI device inventory */
+        if (STREQ_NULLABLE(udev_device_get_subsystem(batch[i]), "pci"))
+            virHostdevInvalidatePCICache();
+
+        if (STREQ(action, "add") || STREQ(action, "change"))
+            udevAddOneDevice(batch[i]);
+        else if (STREQ(action, "remove"))
+            udevRemoveOneDevice(batch[i]);
     }
 
  cleanup:
-    udev_device_unref(device);
+    for (i = 0; i < nbatch; i++)
+        udev_device_unref(batch[i]);
     nodeDeviceUnlock();
     return;
 }
@@ -1457,12 +1505,25 @@ static int udevPCITranslateInit(bool privileged ATTRIBUTE_UNUSED)
     return 0;
 }
 
+static void
+nodeStateInitializeEnumerate(void *opaque)
+{
+    struct udev *udev = opaque;
+
+    /* Populate with known devices */
+    if (udevEnumerateDevices(udev) != 0)
+        VIR_WARN("Failed to enumerate host devices: %s",
+                 virGetLastErrorMessage());
+}
+
+
 static int nodeStateInitialize(bool privileged,
                                virStateInhibitCallback callback ATTRIBUTE_UNUSED,
                                void *opaque ATTRIBUTE_UNUSED)
 {
     udevPrivate *priv = NULL;
     struct udev *udev = NULL;
+    virThread enumThread;
     int ret = -1;
 
     if (VIR_ALLOC(priv) < 0)
@@ -1530,10 +1591,16 @@ static int nodeStateInitialize(bool privileged,
     if (udevSetupSystemDev() != 0)
         goto cleanup;
 
-    /* Populate with known devices */
-
-    if (udevEnumerateDevices(udev) != 0)
+    /* Walking the full device tree can take a long time on hosts with
+     * many devices (e.g. large numbers of LUNs), so enumerate in the
+     * background; the udev event watch registered above catches any
+     * device that changes while the walk is still in progress */
+    if (virThreadCreate(&enumThread, false,
+                        nodeStateInitializeEnumerate, udev) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create udev enumeration thread"));
         goto cleanup;
+    }
 
     ret = 0;
 
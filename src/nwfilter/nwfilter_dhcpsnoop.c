@@ -63,6 +63,7 @@
 #include "nwfilter_dhcpsnoop.h"
 #include "nwfilter_ipaddrmap.h"
 #include "virnetdev.h"
+#include "virbuffer.h"
 #include "virfile.h"
 #include "viratomic.h"
 #include "virthreadpool.h"
@@ -80,11 +81,23 @@ VIR_LOG_INIT("nwfilter.nwfilter_dhcpsnoop");
 # define LEASEFILE LEASEFILE_DIR "nwfilter.leases"
 # define TMPLEASEFILE LEASEFILE_DIR "nwfilter.ltmp"
 
+/*
+ * Appends to the lease file are batched: queued records are flushed
+ * once this many of them have accumulated, or once the oldest queued
+ * record has been held back for this many seconds, whichever comes
+ * first.
+ */
+# define SNOOP_LEASE_FILE_FLUSH_MAX_RECORDS  64
+# define SNOOP_LEASE_FILE_FLUSH_TIMEOUT      3 /* seconds */
+
 struct virNWFilterSnoopState {
-    /* lease file */
+    /* lease file; pending records are protected by snoopLock */
     int                  leaseFD;
     int                  nLeases; /* number of active leases */
     int                  wLeases; /* number of written leases */
+    virBuffer            pendingLeases; /* records not yet written */
+    size_t               nPendingLeases;
+    time_t               oldestPending; /* when the oldest record was queued */
     int                  nThreads; /* number of running threads */
     /* thread management */
     virHashTablePtr      snoopReqs;
@@ -296,6 +309,8 @@ static void virNWFilterSnoopReqUnlock(virNWFilterSnoopReqPtr req);
 
 static void virNWFilterSnoopLeaseFileLoad(void);
 static void virNWFilterSnoopLeaseFileSave(virNWFilterSnoopIPLeasePtr ipl);
+static void virNWFilterSnoopLeaseFileFlush(void);
+static void virNWFilterSnoopLeaseFileTimedFlush(void);
 
 /* local variables */
 static struct virNWFilterSnoopState virNWFilterSnoopState = {
@@ -1436,6 +1451,9 @@ virNWFilterDHCPSnoopThread(void *req0)
 
         virNWFilterSnoopReqLeaseTimerRun(req);
 
+        /* push out lease file records that have been held back */
+        virNWFilterSnoopLeaseFileTimedFlush();
+
         /*
          * Check whether we were cancelled or whether
          * a previously submitted job failed.
@@ -1756,45 +1774,28 @@ virNWFilterSnoopLeaseFileOpen(void)
 }
 
 /*
- * Write a single lease to the given file.
- *
+ * Format a single lease as a lease file record into the given buffer.
  */
 static int
-virNWFilterSnoopLeaseFileWrite(int lfd, const char *ifkey,
-                               virNWFilterSnoopIPLeasePtr ipl)
+virNWFilterSnoopLeaseFileFormat(virBufferPtr buf, const char *ifkey,
+                                virNWFilterSnoopIPLeasePtr ipl)
 {
-    char *lbuf = NULL;
     char *ipstr, *dhcpstr;
-    int len;
-    int ret = 0;
+    int ret = -1;
 
     ipstr = virSocketAddrFormat(&ipl->ipAddress);
     dhcpstr = virSocketAddrFormat(&ipl->ipServer);
 
-    if (!dhcpstr || !ipstr) {
-        ret = -1;
+    if (!dhcpstr || !ipstr)
         goto cleanup;
-    }
 
     /* time intf ip dhcpserver */
-    len = virAsprintf(&lbuf, "%u %s %s %s\n", ipl->timeout,
+    virBufferAsprintf(buf, "%u %s %s %s\n", ipl->timeout,
                       ifkey, ipstr, dhcpstr);
 
-    if (len < 0) {
-        ret = -1;
-        goto cleanup;
-    }
-
-    if (safewrite(lfd, lbuf, len) != len) {
-        virReportSystemError(errno, "%s", _("lease file write failed"));
-        ret = -1;
-        goto cleanup;
-    }
-
-    ignore_value(fsync(lfd));
+    ret = virBufferCheckError(buf);
 
  cleanup:
-    VIR_FREE(lbuf);
     VIR_FREE(dhcpstr);
     VIR_FREE(ipstr);
 
@@ -1802,7 +1803,54 @@ virNWFilterSnoopLeaseFileWrite(int lfd, const char *ifkey,
 }
 
 /*
- * Append a single lease to the end of the lease file.
+ * Append all queued lease records to the lease file with a single
+ * write and fsync.
+ * Call this function with the SnoopLock held.
+ */
+static void
+virNWFilterSnoopLeaseFileFlush(void)
+{
+    ssize_t len = virBufferUse(&virNWFilterSnoopState.pendingLeases);
+
+    if (len == 0)
+        return;
+
+    if (virNWFilterSnoopState.leaseFD < 0)
+        virNWFilterSnoopLeaseFileOpen();
+
+    if (safewrite(virNWFilterSnoopState.leaseFD,
+                  virBufferCurrentContent(&virNWFilterSnoopState.pendingLeases),
+                  len) != len)
+        virReportSystemError(errno, "%s", _("lease file write failed"));
+    else
+        ignore_value(fsync(virNWFilterSnoopState.leaseFD));
+
+    virBufferFreeAndReset(&virNWFilterSnoopState.pendingLeases);
+    virNWFilterSnoopState.nPendingLeases = 0;
+}
+
+/*
+ * Flush the queued lease records once the oldest of them has been
+ * held back for longer than SNOOP_LEASE_FILE_FLUSH_TIMEOUT seconds.
+ * Called periodically from the per-interface snoop threads.
+ */
+static void
+virNWFilterSnoopLeaseFileTimedFlush(void)
+{
+    virNWFilterSnoopLock();
+
+    if (virNWFilterSnoopState.nPendingLeases &&
+        time(NULL) - virNWFilterSnoopState.oldestPending >=
+        SNOOP_LEASE_FILE_FLUSH_TIMEOUT)
+        virNWFilterSnoopLeaseFileFlush();
+
+    virNWFilterSnoopUnlock();
+}
+
+/*
+ * Queue a single lease for appending to the end of the lease file.
+ * Queued records are written out in batches so that a burst of DHCP
+ * traffic does not cause one write and fsync per lease.
  * To keep a limited number of dead leases, re-read the lease
  * file if the threshold of active leases versus written ones
  * exceeds a threshold.
@@ -1814,11 +1862,20 @@ virNWFilterSnoopLeaseFileSave(virNWFilterSnoopIPLeasePtr ipl)
 
     virNWFilterSnoopLock();
 
-    if (virNWFilterSnoopState.leaseFD < 0)
-        virNWFilterSnoopLeaseFileOpen();
-    if (virNWFilterSnoopLeaseFileWrite(virNWFilterSnoopState.leaseFD,
-                                       req->ifkey, ipl) < 0)
+    if (virNWFilterSnoopLeaseFileFormat(&virNWFilterSnoopState.pendingLeases,
+                                        req->ifkey, ipl) < 0) {
+        /* the buffer is unusable now; drop the queued records */
+        virBufferFreeAndReset(&virNWFilterSnoopState.pendingLeases);
+        virNWFilterSnoopState.nPendingLeases = 0;
         goto err_exit;
+    }
+
+    if (virNWFilterSnoopState.nPendingLeases++ == 0)
+        virNWFilterSnoopState.oldestPending = time(NULL);
+
+    if (virNWFilterSnoopState.nPendingLeases >=
+        SNOOP_LEASE_FILE_FLUSH_MAX_RECORDS)
+        virNWFilterSnoopLeaseFileFlush();
 
     /* keep dead leases at < ~95% of file size */
     if (virAtomicIntInc(&virNWFilterSnoopState.wLeases) >=
@@ -1861,7 +1918,7 @@ virNWFilterSnoopPruneIter(const void *payload,
 }
 
 /*
- * Iterator to write all leases of a single request to a file.
+ * Iterator to format all leases of a single request into a buffer.
  * Call this function with the SnoopLock held.
  */
 static int
@@ -1870,14 +1927,14 @@ virNWFilterSnoopSaveIter(void *payload,
                          void *data)
 {
     virNWFilterSnoopReqPtr req = payload;
-    int tfd = *(int *)data;
+    virBufferPtr buf = data;
     virNWFilterSnoopIPLeasePtr ipl;
 
     /* protect req->start */
     virNWFilterSnoopReqLock(req);
 
     for (ipl = req->start; ipl; ipl = ipl->next)
-        ignore_value(virNWFilterSnoopLeaseFileWrite(tfd, req->ifkey, ipl));
+        ignore_value(virNWFilterSnoopLeaseFileFormat(buf, req->ifkey, ipl));
 
     virNWFilterSnoopReqUnlock(req);
     return 0;
@@ -1891,6 +1948,8 @@ virNWFilterSnoopSaveIter(void *payload,
 static void
 virNWFilterSnoopLeaseFileRefresh(void)
 {
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    ssize_t len;
     int tfd;
 
     if (virFileMakePathWithMode(LEASEFILE_DIR, 0700) < 0) {
@@ -1914,9 +1973,25 @@ virNWFilterSnoopLeaseFileRefresh(void)
                          virNWFilterSnoopPruneIter, NULL);
         /* now save them */
         virHashForEach(virNWFilterSnoopState.snoopReqs,
-                       virNWFilterSnoopSaveIter, (void *)&tfd);
+                       virNWFilterSnoopSaveIter, &buf);
+    }
+
+    if (virBufferCheckError(&buf) < 0) {
+        /* assuming the old lease file is still better, skip the renaming */
+        VIR_FORCE_CLOSE(tfd);
+        goto skip_rename;
     }
 
+    /* write all records with a single write and fsync */
+    len = virBufferUse(&buf);
+    if (len &&
+        safewrite(tfd, virBufferCurrentContent(&buf), len) != len) {
+        virReportSystemError(errno, _("unable to write %s"), TMPLEASEFILE);
+        VIR_FORCE_CLOSE(tfd);
+        goto skip_rename;
+    }
+    ignore_value(fsync(tfd));
+
     if (VIR_CLOSE(tfd) < 0) {
         virReportSystemError(errno, _("unable to close %s"), TMPLEASEFILE);
         /* assuming the old lease file is still better, skip the renaming */
@@ -1931,6 +2006,11 @@ virNWFilterSnoopLeaseFileRefresh(void)
     virAtomicIntSet(&virNWFilterSnoopState.wLeases, 0);
 
  skip_rename:
+    /* the rewrite supersedes any still queued records */
+    virBufferFreeAndReset(&virNWFilterSnoopState.pendingLeases);
+    virNWFilterSnoopState.nPendingLeases = 0;
+
+    virBufferFreeAndReset(&buf);
     virNWFilterSnoopLeaseFileOpen();
 }
 
@@ -1949,6 +2029,9 @@ virNWFilterSnoopLeaseFileLoad(void)
     /* protect the lease file */
     virNWFilterSnoopLock();
 
+    /* push out queued records before re-reading the file */
+    virNWFilterSnoopLeaseFileFlush();
+
     fp = fopen(LEASEFILE, "r");
     time(&now);
     while (fp && fgets(line, sizeof(line), fp)) {
@@ -2189,6 +2272,7 @@ virNWFilterDHCPSnoopShutdown(void)
 
     virNWFilterSnoopLock();
 
+    virNWFilterSnoopLeaseFileFlush();
     virNWFilterSnoopLeaseFileClose();
     virHashFree(virNWFilterSnoopState.ifnameToKey);
     virHashFree(virNWFilterSnoopState.snoopReqs);
@@ -45,6 +45,7 @@
 #include "configmake.h"
 #include "intprops.h"
 #include "virstring.h"
+#include "virthread.h"
 #include "virfirewall.h"
 
 #define VIR_FROM_THIS VIR_FROM_NWFILTER
@@ -3389,6 +3390,99 @@ ebtablesGetSubChainInsts(virHashTablePtr chains,
 
 }
 
+/* Cache of the most recently applied firewall build per interface.
+ * Rendering the full filter tree into a virFirewall object repeats
+ * identical formatting work whenever a filter is re-instantiated with
+ * unchanged definitions and variable bindings (IP learning, DHCP
+ * snooping, domain restarts), so the last successful build is kept
+ * and replayed when its fingerprint still matches.  The build is
+ * self-contained - it starts by tearing down any temporary chains -
+ * so it can be replayed regardless of the current chain state. */
+static virMutex ebiptablesRuleCacheLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr ebiptablesRuleCache; /* ifname -> entry */
+
+typedef struct _ebiptablesRuleCacheEntry ebiptablesRuleCacheEntry;
+typedef ebiptablesRuleCacheEntry *ebiptablesRuleCacheEntryPtr;
+struct _ebiptablesRuleCacheEntry {
+    char *key;
+    virFirewallPtr fw;
+};
+
+static void
+ebiptablesRuleCacheEntryFree(void *payload,
+                             const void *name ATTRIBUTE_UNUSED)
+{
+    ebiptablesRuleCacheEntryPtr entry = payload;
+
+    if (!entry)
+        return;
+
+    VIR_FREE(entry->key);
+    virFirewallFree(entry->fw);
+    VIR_FREE(entry);
+}
+
+static int
+ebiptablesRuleCacheVarSort(const virHashKeyValuePair *a,
+                           const virHashKeyValuePair *b)
+{
+    return strcmp(a->key, b->key);
+}
+
+/*
+ * Build a fingerprint of the rule definitions and variable bindings
+ * that the rendered commands depend on.  The definition pointers are
+ * only stable while no filter update has taken place, so the update
+ * generation is folded in to invalidate the cache across redefines.
+ */
+static char *
+ebiptablesRuleCacheKey(virNWFilterRuleInstPtr *rules,
+                       size_t nrules)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i, j;
+    unsigned int k;
+
+    virBufferAsprintf(&buf, "gen=%llu", virNWFilterGetUpdateGeneration());
+
+    for (i = 0; i < nrules; i++) {
+        virHashKeyValuePairPtr items;
+
+        virBufferAsprintf(&buf, "|%p", rules[i]->def);
+
+        if (!(items = virHashGetItems(rules[i]->vars->hashTable,
+                                      ebiptablesRuleCacheVarSort))) {
+            virBufferFreeAndReset(&buf);
+            return NULL;
+        }
+
+        for (j = 0; items[j].key; j++) {
+            const virNWFilterVarValue *val = items[j].value;
+            unsigned int card = virNWFilterVarValueGetCardinality(val);
+
+            virBufferAsprintf(&buf, ";%s=", (const char *)items[j].key);
+            for (k = 0; k < card; k++)
+                virBufferAsprintf(&buf, "%s%s", k ? "," : "",
+                                  NULLSTR(virNWFilterVarValueGetNthValue(val, k)));
+        }
+        VIR_FREE(items);
+    }
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
+
+static void
+ebiptablesRuleCacheRemove(const char *ifname)
+{
+    virMutexLock(&ebiptablesRuleCacheLock);
+    if (ebiptablesRuleCache)
+        ignore_value(virHashRemoveEntry(ebiptablesRuleCache, ifname));
+    virMutexUnlock(&ebiptablesRuleCacheLock);
+}
+
 static int
 ebiptablesApplyNewRules(const char *ifname,
                         virNWFilterRuleInstPtr *rules,
@@ -3404,11 +3498,33 @@ ebiptablesApplyNewRules(const char *ifname,
     char *errmsg = NULL;
     struct ebtablesSubChainInst **subchains = NULL;
     size_t nsubchains = 0;
+    char *cacheKey = NULL;
     int ret = -1;
 
     if (!chains_in_set || !chains_out_set)
         goto cleanup;
 
+    if (ebiptablesRuleCache &&
+        (cacheKey = ebiptablesRuleCacheKey(rules, nrules))) {
+        ebiptablesRuleCacheEntryPtr entry;
+        virFirewallPtr cachedfw = NULL;
+
+        virMutexLock(&ebiptablesRuleCacheLock);
+        if ((entry = virHashLookup(ebiptablesRuleCache, ifname)) &&
+            STREQ(entry->key, cacheKey))
+            cachedfw = entry->fw;
+        virMutexUnlock(&ebiptablesRuleCacheLock);
+
+        /* rule application and teardown are serialized per interface
+         * by the caller, so the cached build cannot be freed while it
+         * is being replayed */
+        if (cachedfw) {
+            VIR_DEBUG("Replaying cached ruleset for '%s'", ifname);
+            ret = virFirewallApply(cachedfw);
+            goto cleanup;
+        }
+    }
+
     if (nrules)
         qsort(rules, nrules, sizeof(rules[0]),
               virNWFilterRuleInstSortPtr);
@@ -3593,6 +3709,28 @@ ebiptablesApplyNewRules(const char *ifname,
 
     ret = 0;
 
+    /* remember the successfully applied build for later replay */
+    if (cacheKey) {
+        ebiptablesRuleCacheEntryPtr entry;
+
+        if (VIR_ALLOC(entry) == 0) {
+            entry->key = cacheKey;
+            entry->fw = fw;
+
+            virMutexLock(&ebiptablesRuleCacheLock);
+            if (ebiptablesRuleCache &&
+                virHashUpdateEntry(ebiptablesRuleCache, ifname, entry) == 0) {
+                cacheKey = NULL;
+                fw = NULL;
+            } else {
+                VIR_FREE(entry);
+            }
+            virMutexUnlock(&ebiptablesRuleCacheLock);
+        }
+        /* failing to cache must not fail the instantiation */
+        virResetLastError();
+    }
+
  cleanup:
     for (i = 0; i < nsubchains; i++)
         VIR_FREE(subchains[i]);
@@ -3601,6 +3739,7 @@ ebiptablesApplyNewRules(const char *ifname,
     virHashFree(chains_in_set);
     virHashFree(chains_out_set);
 
+    VIR_FREE(cacheKey);
     VIR_FREE(errmsg);
     return ret;
 }
@@ -3682,6 +3821,8 @@ ebiptablesAllTeardown(const char *ifname)
     virFirewallPtr fw = virFirewallNew();
     int ret = -1;
 
+    ebiptablesRuleCacheRemove(ifname);
+
     virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
 
     ebiptablesTearNewRulesFW(fw, ifname);
@@ -3822,6 +3963,13 @@ ebiptablesDriverInit(bool privileged)
     if (ebiptablesDriverProbeStateMatch() < 0)
         return -1;
 
+    virFirewallSetBatchMode(virFileIsExecutable(IPTABLES_RESTORE_PATH) &&
+                            virFileIsExecutable(IP6TABLES_RESTORE_PATH));
+
+    if (!(ebiptablesRuleCache = virHashCreate(10,
+                                              ebiptablesRuleCacheEntryFree)))
+        return -1;
+
     ebiptables_driver.flags = TECHDRV_FLAG_INITIALIZED;
 
     return 0;
@@ -3831,5 +3979,10 @@ ebiptablesDriverInit(bool privileged)
 static void
 ebiptablesDriverShutdown(void)
 {
+    virMutexLock(&ebiptablesRuleCacheLock);
+    virHashFree(ebiptablesRuleCache);
+    ebiptablesRuleCache = NULL;
+    virMutexUnlock(&ebiptablesRuleCacheLock);
+
     ebiptables_driver.flags = 0;
 }
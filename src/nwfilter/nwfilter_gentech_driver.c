@@ -69,6 +69,11 @@ static virNWFilterTechDriverPtr filter_tech_drivers[] = {
  * XXX better long term solution is to make virNWFilterObjList use a
  * hash table as is done for virDomainObjList. You can then get
  * lockless lookup of objects by name.
+ *
+ * Only the resolution of filters into rule instances runs under this
+ * mutex; applying the resolved rules to an interface happens outside
+ * of it, serialized per interface via virNWFilterLockIface, so that
+ * unrelated interfaces can apply their rules in parallel.
  */
 static virMutex updateMutex;
 
@@ -609,13 +614,19 @@ virNWFilterDetermineMissingVarsRec(virNWFilterDefPtr filter,
  *  the filter and its subfilters.
  * @forceWithPendingReq: Ignore the check whether a pending learn request
  *  is active; 'true' only when the rules are applied late
+ * @inst: filled with the resolved rule instances; on success the caller
+ *  owns the contents and must reset them with virNWFilterInstReset
+ * @doApply: set to true if the resolved rules should be applied to the
+ *  interface
  *
  * Returns 0 on success, a value otherwise.
  *
- * Instantiate a filter by instantiating the filter itself along with
- * all its subfilters in a depth-first traversal of the tree of referenced
- * filters. The name of the interface to which the rules belong must be
- * provided. Apply the values of variables as needed.
+ * Resolve a filter into rule instances by visiting the filter itself
+ * along with all its subfilters in a depth-first traversal of the tree
+ * of referenced filters. The name of the interface to which the rules
+ * belong must be provided. Apply the values of variables as needed.
+ * The rules are not applied here; the caller is expected to do that
+ * via the tech driver once the filter update lock has been dropped.
  *
  * Call this function while holding the NWFilter filter update lock
  */
@@ -628,13 +639,13 @@ virNWFilterInstantiate(const unsigned char *vmuuid ATTRIBUTE_UNUSED,
                        const char *linkdev,
                        virNWFilterHashTablePtr vars,
                        enum instCase useNewFilter, bool *foundNewFilter,
-                       bool teardownOld,
                        const virMacAddr *macaddr,
                        virNWFilterDriverStatePtr driver,
-                       bool forceWithPendingReq)
+                       bool forceWithPendingReq,
+                       virNWFilterInstPtr inst,
+                       bool *doApply)
 {
     int rc;
-    virNWFilterInst inst;
     bool instantiate = true;
     char *buf;
     virNWFilterVarValuePtr lv;
@@ -643,8 +654,6 @@ virNWFilterInstantiate(const unsigned char *vmuuid ATTRIBUTE_UNUSED,
 
     virNWFilterHashTablePtr missing_vars = virNWFilterHashTableCreate(0);
 
-    memset(&inst, 0, sizeof(inst));
-
     if (!missing_vars) {
         rc = -1;
         goto err_exit;
@@ -713,7 +722,7 @@ virNWFilterInstantiate(const unsigned char *vmuuid ATTRIBUTE_UNUSED,
                               filter,
                               vars,
                               useNewFilter, foundNewFilter,
-                              &inst);
+                              inst);
 
     if (rc < 0)
         goto err_exit;
@@ -727,27 +736,11 @@ virNWFilterInstantiate(const unsigned char *vmuuid ATTRIBUTE_UNUSED,
         break;
     }
 
-    if (instantiate) {
-        if (virNWFilterLockIface(ifname) < 0)
-            goto err_exit;
-
-        rc = techdriver->applyNewRules(ifname, inst.rules, inst.nrules);
-
-        if (teardownOld && rc == 0)
-            techdriver->tearOldRules(ifname);
-
-        if (rc == 0 && (virNetDevValidateConfig(ifname, NULL, ifindex) <= 0)) {
-            virResetLastError();
-            /* interface changed/disppeared */
-            techdriver->allTeardown(ifname);
-            rc = -1;
-        }
-
-        virNWFilterUnlockIface(ifname);
-    }
+    *doApply = instantiate;
 
  err_exit:
-    virNWFilterInstReset(&inst);
+    if (rc < 0)
+        virNWFilterInstReset(inst);
     virNWFilterHashTableFree(missing_vars);
 
     return rc;
@@ -768,12 +761,50 @@ virNWFilterInstantiate(const unsigned char *vmuuid ATTRIBUTE_UNUSED,
 
 
 /*
- * Call this function while holding the NWFilter filter update lock
+ * Apply the rules resolved into @inst to @ifname. Must be called
+ * without the global update mutex held; the per-interface lock
+ * serializes against concurrent teardown. The caller must hold the
+ * filter update rwlock (read or write) so that the filter
+ * definitions the rule instances reference stay valid.
+ */
+static int
+virNWFilterInstApplyRules(virNWFilterTechDriverPtr techdriver,
+                          const char *ifname,
+                          int ifindex,
+                          bool teardownOld,
+                          virNWFilterInstPtr inst)
+{
+    int rc;
+
+    if (virNWFilterLockIface(ifname) < 0)
+        return -1;
+
+    rc = techdriver->applyNewRules(ifname, inst->rules, inst->nrules);
+
+    if (teardownOld && rc == 0)
+        techdriver->tearOldRules(ifname);
+
+    if (rc == 0 && (virNetDevValidateConfig(ifname, NULL, ifindex) <= 0)) {
+        virResetLastError();
+        /* interface changed/disppeared */
+        techdriver->allTeardown(ifname);
+        rc = -1;
+    }
+
+    virNWFilterUnlockIface(ifname);
+
+    return rc;
+}
+
+
+/*
+ * Call this function while holding the NWFilter filter update lock;
+ * the resolved rules are returned in @inst for the caller to apply
+ * once the lock has been dropped.
  */
 static int
 __virNWFilterInstantiateFilter(virNWFilterDriverStatePtr driver,
                                const unsigned char *vmuuid,
-                               bool teardownOld,
                                const char *ifname,
                                int ifindex,
                                const char *linkdev,
@@ -782,7 +813,9 @@ __virNWFilterInstantiateFilter(virNWFilterDriverStatePtr driver,
                                virNWFilterHashTablePtr filterparams,
                                enum instCase useNewFilter,
                                bool forceWithPendingReq,
-                               bool *foundNewFilter)
+                               bool *foundNewFilter,
+                               virNWFilterInstPtr inst,
+                               bool *doApply)
 {
     int rc;
     const char *drvname = EBIPTABLES_DRIVER_ID;
@@ -869,10 +902,11 @@ __virNWFilterInstantiateFilter(virNWFilterDriverStatePtr driver,
                                 linkdev,
                                 vars,
                                 useNewFilter, foundNewFilter,
-                                teardownOld,
                                 macaddr,
                                 driver,
-                                forceWithPendingReq);
+                                forceWithPendingReq,
+                                inst,
+                                doApply);
 
     virNWFilterHashTableFree(vars);
 
@@ -900,9 +934,13 @@ _virNWFilterInstantiateFilter(virNWFilterDriverStatePtr driver,
     const char *linkdev = (net->type == VIR_DOMAIN_NET_TYPE_DIRECT)
                           ? net->data.direct.linkdev
                           : NULL;
+    virNWFilterInst inst;
+    bool doApply = false;
     int ifindex;
     int rc;
 
+    memset(&inst, 0, sizeof(inst));
+
     virMutexLock(&updateMutex);
 
     /* after grabbing the filter update lock check for the interface; if
@@ -919,7 +957,6 @@ _virNWFilterInstantiateFilter(virNWFilterDriverStatePtr driver,
 
     rc = __virNWFilterInstantiateFilter(driver,
                                         vmuuid,
-                                        teardownOld,
                                         net->ifname,
                                         ifindex,
                                         linkdev,
@@ -928,11 +965,26 @@ _virNWFilterInstantiateFilter(virNWFilterDriverStatePtr driver,
                                         net->filterparams,
                                         useNewFilter,
                                         false,
-                                        foundNewFilter);
+                                        foundNewFilter,
+                                        &inst,
+                                        &doApply);
 
  cleanup:
     virMutexUnlock(&updateMutex);
 
+    /* apply the rules outside the global update mutex so that
+     * unrelated interfaces can instantiate their filters in
+     * parallel; rule application only touches this interface's
+     * chains and is serialized by the per-interface lock */
+    if (rc == 0 && doApply)
+        rc = virNWFilterInstApplyRules(virNWFilterTechDriverForName(EBIPTABLES_DRIVER_ID),
+                                       net->ifname,
+                                       ifindex,
+                                       teardownOld,
+                                       &inst);
+
+    virNWFilterInstReset(&inst);
+
     return rc;
 }
 
@@ -949,13 +1001,16 @@ virNWFilterInstantiateFilterLate(virNWFilterDriverStatePtr driver,
 {
     int rc;
     bool foundNewFilter = false;
+    virNWFilterInst inst;
+    bool doApply = false;
+
+    memset(&inst, 0, sizeof(inst));
 
     virNWFilterReadLockFilterUpdates();
     virMutexLock(&updateMutex);
 
     rc = __virNWFilterInstantiateFilter(driver,
                                         vmuuid,
-                                        true,
                                         ifname,
                                         ifindex,
                                         linkdev,
@@ -964,8 +1019,23 @@ virNWFilterInstantiateFilterLate(virNWFilterDriverStatePtr driver,
                                         filterparams,
                                         INSTANTIATE_ALWAYS,
                                         true,
-                                        &foundNewFilter);
+                                        &foundNewFilter,
+                                        &inst,
+                                        &doApply);
+
+    virMutexUnlock(&updateMutex);
+
+    if (rc == 0 && doApply)
+        rc = virNWFilterInstApplyRules(virNWFilterTechDriverForName(EBIPTABLES_DRIVER_ID),
+                                       ifname,
+                                       ifindex,
+                                       true,
+                                       &inst);
+
+    virNWFilterInstReset(&inst);
+
     if (rc < 0) {
+        virMutexLock(&updateMutex);
         /* something went wrong... 'DOWN' the interface */
         if ((virNetDevValidateConfig(ifname, NULL, ifindex) <= 0) ||
             (virNetDevSetOnline(ifname, false) < 0)) {
@@ -973,10 +1043,10 @@ virNWFilterInstantiateFilterLate(virNWFilterDriverStatePtr driver,
             /* assuming interface disappeared... */
             _virNWFilterTeardownFilter(ifname);
         }
+        virMutexUnlock(&updateMutex);
     }
 
     virNWFilterUnlockFilterUpdates();
-    virMutexUnlock(&updateMutex);
 
     return rc;
 }
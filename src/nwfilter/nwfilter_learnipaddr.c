@@ -30,6 +30,7 @@
 #endif
 
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 
 #include <arpa/inet.h>
@@ -48,6 +49,7 @@
 #include "virnetdev.h"
 #include "virerror.h"
 #include "virthread.h"
+#include "virthreadpool.h"
 #include "conf/nwfilter_params.h"
 #include "conf/domain_conf.h"
 #include "nwfilter_gentech_driver.h"
@@ -137,6 +139,44 @@ struct _virNWFilterIfaceLock {
 static bool threadsTerminate;
 
 
+#ifdef HAVE_LIBPCAP
+
+/*
+ * All pending learn requests are serviced by a single capture engine
+ * thread which polls one non-blocking pcap handle per interface.
+ * Instantiating the filters once an address has been learned is
+ * handed off to a small bounded pool of worker threads so that a
+ * slow rule instantiation does not hold up packet capturing on the
+ * other interfaces.
+ */
+# define LEARN_WORKERS_MAX 4
+
+typedef struct _virNWFilterLearnCapture virNWFilterLearnCapture;
+typedef virNWFilterLearnCapture *virNWFilterLearnCapturePtr;
+struct _virNWFilterLearnCapture {
+    virNWFilterIPAddrLearnReqPtr req;
+    pcap_t *handle;
+    int fd; /* selectable descriptor of @handle */
+};
+
+/* open captures; only ever touched by the capture engine thread */
+static virNWFilterLearnCapturePtr *learnCaptures;
+static size_t nlearnCaptures;
+
+/* requests registered but not yet picked up by the engine thread;
+ * protected by pendingLearnReqLock */
+static virNWFilterIPAddrLearnReqPtr *learnNewReqs;
+static size_t nlearnNewReqs;
+
+static virThread learnEngineThread;
+static bool learnEngineRunning;
+static bool learnEngineQuit;
+
+static virThreadPoolPtr learnWorkerPool;
+
+#endif /* HAVE_LIBPCAP */
+
+
 int
 virNWFilterLockIface(const char *ifname)
 {
@@ -235,6 +275,13 @@ virNWFilterRegisterLearnReq(virNWFilterIPAddrLearnReqPtr req)
     if (!virHashLookup(pendingLearnReq, ifindex_str))
         res = virHashAddEntry(pendingLearnReq, ifindex_str, req);
 
+    /* queue the request for pickup by the capture engine thread */
+    if (res == 0 &&
+        VIR_APPEND_ELEMENT_COPY(learnNewReqs, nlearnNewReqs, req) < 0) {
+        virHashSteal(pendingLearnReq, ifindex_str);
+        res = -1;
+    }
+
     virMutexUnlock(&pendingLearnReqLock);
 
     return res;
@@ -362,41 +409,276 @@ procDHCPOpts(struct dhcp *dhcp, int dhcp_opts_len,
 
 
 /**
- * learnIPAddressThread
- * arg: pointer to virNWFilterIPAddrLearnReq structure
+ * virNWFilterLearnDecodePacket
+ * @req: the learn request the packet was captured for
+ * @header: the pcap header of the captured packet
+ * @packet: the captured packet
  *
- * Learn the IP address being used on an interface. Use ARP Request and
- * Reply messages, DHCP offers and the first IP packet being sent from
- * the VM to detect the IP address it is using. Detects only one IP address
- * per interface (IP aliasing not supported). The method on how the
- * IP address is detected can be chosen through flags. DETECT_DHCP will
- * require that the IP address is detected from a DHCP OFFER, DETECT_STATIC
- * will require that the IP address was taken from an ARP packet or an IPv4
+ * Inspect a single captured packet and try to extract the IP address
+ * the VM is using from it. Use ARP Request and Reply messages, DHCP
+ * offers and the first IP packet being sent from the VM to detect the
+ * IP address it is using. Detects only one IP address per interface
+ * (IP aliasing not supported). The method on how the IP address is
+ * detected can be chosen through flags. DETECT_DHCP will require that
+ * the IP address is detected from a DHCP OFFER, DETECT_STATIC will
+ * require that the IP address was taken from an ARP packet or an IPv4
  * packet. Both flags can be set at the same time.
+ *
+ * Returns the detected IPv4 address in network byte order, 0 if the
+ * packet did not reveal one.
  */
-static void
-learnIPAddressThread(void *arg)
+static uint32_t
+virNWFilterLearnDecodePacket(virNWFilterIPAddrLearnReqPtr req,
+                             struct pcap_pkthdr *header,
+                             const u_char *packet)
 {
-    char errbuf[PCAP_ERRBUF_SIZE] = {0};
-    pcap_t *handle = NULL;
-    struct bpf_program fp;
-    struct pcap_pkthdr header;
-    const u_char *packet;
     struct ether_header *ether_hdr;
     struct ether_vlan_header *vlan_hdr;
-    virNWFilterIPAddrLearnReqPtr req = arg;
     uint32_t vmaddr = 0, bcastaddr = 0;
     unsigned int ethHdrSize;
+    int dhcp_opts_len;
+    uint16_t etherType;
+    enum howDetect howDetected = 0;
+
+    if (header->len < sizeof(struct ether_header))
+        return 0;
+
+    ether_hdr = (struct ether_header*)packet;
+
+    switch (ntohs(ether_hdr->ether_type)) {
+
+    case ETHERTYPE_IP:
+        ethHdrSize = sizeof(struct ether_header);
+        etherType = ntohs(ether_hdr->ether_type);
+        break;
+
+    case ETHERTYPE_VLAN:
+        ethHdrSize = sizeof(struct ether_vlan_header);
+        vlan_hdr = (struct ether_vlan_header *)packet;
+        if (ntohs(vlan_hdr->ether_type) != ETHERTYPE_IP ||
+            header->len < ethHdrSize)
+            return 0;
+        etherType = ntohs(vlan_hdr->ether_type);
+        break;
+
+    default:
+        return 0;
+    }
+
+    if (virMacAddrCmpRaw(&req->macaddr, ether_hdr->ether_shost) == 0) {
+        /* packets from the VM */
+
+        if (etherType == ETHERTYPE_IP &&
+            (header->len >= ethHdrSize +
+                            sizeof(struct iphdr))) {
+            VIR_WARNINGS_NO_CAST_ALIGN
+            struct iphdr *iphdr = (struct iphdr*)(packet +
+                                                  ethHdrSize);
+            VIR_WARNINGS_RESET
+            vmaddr = iphdr->saddr;
+            /* skip mcast addresses (224.0.0.0 - 239.255.255.255),
+             * class E (240.0.0.0 - 255.255.255.255, includes eth.
+             * bcast) and zero address in DHCP Requests */
+            if ((ntohl(vmaddr) & 0xe0000000) == 0xe0000000 ||
+                vmaddr == 0)
+                return 0;
+
+            howDetected = DETECT_STATIC;
+        } else if (etherType == ETHERTYPE_ARP &&
+                   (header->len >= ethHdrSize +
+                                   sizeof(struct f_arphdr))) {
+            VIR_WARNINGS_NO_CAST_ALIGN
+            struct f_arphdr *arphdr = (struct f_arphdr*)(packet +
+                                                 ethHdrSize);
+            VIR_WARNINGS_RESET
+            switch (ntohs(arphdr->arphdr.ar_op)) {
+            case ARPOP_REPLY:
+                vmaddr = arphdr->ar_sip;
+                howDetected = DETECT_STATIC;
+            break;
+            case ARPOP_REQUEST:
+                vmaddr = arphdr->ar_tip;
+                howDetected = DETECT_STATIC;
+            break;
+            }
+        }
+    } else if (virMacAddrCmpRaw(&req->macaddr,
+                                ether_hdr->ether_dhost) == 0 ||
+               /* allow Broadcast replies from DHCP server */
+               virMacAddrIsBroadcastRaw(ether_hdr->ether_dhost)) {
+        /* packets to the VM */
+        if (etherType == ETHERTYPE_IP &&
+            (header->len >= ethHdrSize +
+                            sizeof(struct iphdr))) {
+            VIR_WARNINGS_NO_CAST_ALIGN
+            struct iphdr *iphdr = (struct iphdr*)(packet +
+                                                  ethHdrSize);
+            VIR_WARNINGS_RESET
+            if ((iphdr->protocol == IPPROTO_UDP) &&
+                (header->len >= ethHdrSize +
+                                iphdr->ihl * 4 +
+                                sizeof(struct udphdr))) {
+                VIR_WARNINGS_NO_CAST_ALIGN
+                struct udphdr *udphdr = (struct udphdr *)
+                                  ((char *)iphdr + iphdr->ihl * 4);
+                VIR_WARNINGS_RESET
+                if (ntohs(udphdr->source) == 67 &&
+                    ntohs(udphdr->dest)   == 68 &&
+                    header->len >= ethHdrSize +
+                                   iphdr->ihl * 4 +
+                                   sizeof(struct udphdr) +
+                                   sizeof(struct dhcp)) {
+                    struct dhcp *dhcp = (struct dhcp *)
+                                ((char *)udphdr + sizeof(udphdr));
+                    if (dhcp->op == 2 /* BOOTREPLY */ &&
+                        virMacAddrCmpRaw(
+                                &req->macaddr,
+                                &dhcp->chaddr[0]) == 0) {
+                        dhcp_opts_len = header->len -
+                            (ethHdrSize + iphdr->ihl * 4 +
+                             sizeof(struct udphdr) +
+                             sizeof(struct dhcp));
+                        procDHCPOpts(dhcp, dhcp_opts_len,
+                                     &vmaddr,
+                                     &bcastaddr,
+                                     &howDetected);
+                    }
+                }
+            }
+        }
+    }
+
+    if (vmaddr && (req->howDetect & howDetected) == 0)
+        vmaddr = 0;
+
+    return vmaddr;
+}
+
+
+/*
+ * Finish a learn request for which no address could be learned:
+ * report the error where appropriate, restrict the interface's
+ * traffic and drop the request.
+ * Runs in the capture engine thread which also locked the interface.
+ */
+static void
+virNWFilterLearnReqFail(virNWFilterIPAddrLearnReqPtr req, bool showError)
+{
+    if (showError)
+        virReportSystemError(req->status,
+                             _("encountered an error on interface %s "
+                               "index %d"),
+                             req->ifname, req->ifindex);
+
+    req->techdriver->applyDropAllRules(req->ifname);
+    virNWFilterUnlockIface(req->ifname);
+
+    virNWFilterDeregisterLearnReq(req->ifindex);
+    virNWFilterIPAddrLearnReqFree(req);
+}
+
+
+/*
+ * Apply the filters for a request whose IP address has been learned.
+ * Runs in the bounded worker pool; the interface was already unlocked
+ * by the capture engine thread.
+ */
+static void
+virNWFilterLearnApplyWorker(void *jobdata, void *opaque ATTRIBUTE_UNUSED)
+{
+    virNWFilterIPAddrLearnReqPtr req = jobdata;
+    virSocketAddr sa;
+    char *inetaddr;
+    int ret;
+
+    sa.len = sizeof(sa.data.inet4);
+    sa.data.inet4.sin_family = AF_INET;
+    sa.data.inet4.sin_addr.s_addr = req->vmaddr;
+
+    if ((inetaddr = virSocketAddrFormat(&sa)) != NULL) {
+        if (virNWFilterIPAddrMapAddIPAddr(req->ifname, inetaddr) < 0) {
+            VIR_ERROR(_("Failed to add IP address %s to IP address "
+                      "cache for interface %s"), inetaddr, req->ifname);
+        }
+
+        ret = virNWFilterInstantiateFilterLate(req->driver,
+                                               NULL,
+                                               req->ifname,
+                                               req->ifindex,
+                                               req->linkdev,
+                                               &req->macaddr,
+                                               req->filtername,
+                                               req->filterparams);
+        VIR_DEBUG("Result from applying firewall rules on "
+                  "%s with IP addr %s : %d", req->ifname, inetaddr, ret);
+    }
+
+    virNWFilterDeregisterLearnReq(req->ifindex);
+    virNWFilterIPAddrLearnReqFree(req);
+}
+
+
+/*
+ * Finish a learn request whose IP address has been learned: unlock
+ * the interface and hand the rule instantiation to the worker pool.
+ * Runs in the capture engine thread.
+ */
+static void
+virNWFilterLearnReqSubmit(virNWFilterIPAddrLearnReqPtr req)
+{
+    /* It is necessary to unlock interface here to avoid updateMutex and
+     * interface ordering deadlocks. Otherwise we are going to
+     * instantiate the filter, which will try to lock updateMutex, and
+     * some other thread instantiating a filter in parallel is holding
+     * updateMutex and is trying to lock interface, both will deadlock.
+     * Also it is safe to unlock interface here because we stopped
+     * capturing and applied necessary rules on the interface, while
+     * instantiating a new filter doesn't require a locked interface.*/
+    virNWFilterUnlockIface(req->ifname);
+
+    if (virThreadPoolSendJob(learnWorkerPool, 0, req) < 0) {
+        /* fall back to instantiating the filter right here */
+        virResetLastError();
+        virNWFilterLearnApplyWorker(req, NULL);
+    }
+}
+
+
+/*
+ * Stop capturing for the request at the given index and remove it
+ * from the poll set. Runs in the capture engine thread.
+ */
+static void
+virNWFilterLearnCaptureRemove(size_t idx)
+{
+    virNWFilterLearnCapturePtr capture = learnCaptures[idx];
+
+    pcap_close(capture->handle);
+    VIR_FREE(capture);
+    VIR_DELETE_ELEMENT(learnCaptures, idx, nlearnCaptures);
+}
+
+
+/*
+ * Start capturing on the interface of a newly registered learn
+ * request: lock the interface, apply the restrictive rules and open
+ * a non-blocking pcap handle whose descriptor the engine can poll.
+ * On failure the request is finished with an error.
+ * Runs in the capture engine thread.
+ */
+static void
+virNWFilterLearnSetupCapture(virNWFilterIPAddrLearnReqPtr req)
+{
+    char errbuf[PCAP_ERRBUF_SIZE] = {0};
+    pcap_t *handle = NULL;
+    struct bpf_program fp;
     char *listen_if = (strlen(req->linkdev) != 0) ? req->linkdev
                                                   : req->ifname;
-    int dhcp_opts_len;
     char macaddr[VIR_MAC_STRING_BUFLEN];
     virBuffer buf = VIR_BUFFER_INITIALIZER;
     char *filter = NULL;
-    uint16_t etherType;
-    bool showError = true;
-    enum howDetect howDetected = 0;
-    virNWFilterTechDriverPtr techdriver = req->techdriver;
+    virNWFilterLearnCapturePtr capture = NULL;
+    int fd;
 
     if (virNWFilterLockIface(req->ifname) < 0)
        goto err_no_lock;
@@ -407,7 +689,7 @@ learnIPAddressThread(void *arg)
     if (virNetDevValidateConfig(req->ifname, NULL, req->ifindex) <= 0) {
         virResetLastError();
         req->status = ENODEV;
-        goto done;
+        goto err_exit;
     }
 
     handle = pcap_open_live(listen_if, BUFSIZ, 0, PKT_TIMEOUT_MS, errbuf);
@@ -415,26 +697,26 @@ learnIPAddressThread(void *arg)
     if (handle == NULL) {
         VIR_DEBUG("Couldn't open device %s: %s", listen_if, errbuf);
         req->status = ENODEV;
-        goto done;
+        goto err_exit;
     }
 
     virMacAddrFormat(&req->macaddr, macaddr);
 
     switch (req->howDetect) {
     case DETECT_DHCP:
-        if (techdriver->applyDHCPOnlyRules(req->ifname,
-                                           &req->macaddr,
-                                           NULL, false) < 0) {
+        if (req->techdriver->applyDHCPOnlyRules(req->ifname,
+                                                &req->macaddr,
+                                                NULL, false) < 0) {
             req->status = EINVAL;
-            goto done;
+            goto err_exit;
         }
         virBufferAddLit(&buf, "src port 67 and dst port 68");
         break;
     default:
-        if (techdriver->applyBasicRules(req->ifname,
-                                        &req->macaddr) < 0) {
+        if (req->techdriver->applyBasicRules(req->ifname,
+                                             &req->macaddr) < 0) {
             req->status = EINVAL;
-            goto done;
+            goto err_exit;
         }
         virBufferAsprintf(&buf, "ether host %s or ether dst ff:ff:ff:ff:ff:ff",
                           macaddr);
@@ -442,7 +724,7 @@ learnIPAddressThread(void *arg)
 
     if (virBufferError(&buf)) {
         req->status = ENOMEM;
-        goto done;
+        goto err_exit;
     }
 
     filter = virBufferContentAndReset(&buf);
@@ -450,212 +732,205 @@ learnIPAddressThread(void *arg)
     if (pcap_compile(handle, &fp, filter, 1, 0) != 0) {
         VIR_DEBUG("Couldn't compile filter '%s'", filter);
         req->status = EINVAL;
-        goto done;
+        goto err_exit;
     }
 
     if (pcap_setfilter(handle, &fp) != 0) {
         VIR_DEBUG("Couldn't set filter '%s'", filter);
         req->status = EINVAL;
         pcap_freecode(&fp);
-        goto done;
+        goto err_exit;
     }
 
     pcap_freecode(&fp);
 
-    while (req->status == 0 && vmaddr == 0) {
-        packet = pcap_next(handle, &header);
+    if (pcap_setnonblock(handle, 1, errbuf) < 0 ||
+        (fd = pcap_get_selectable_fd(handle)) < 0) {
+        VIR_DEBUG("Couldn't get a pollable descriptor for device %s: %s",
+                  listen_if, errbuf);
+        req->status = EINVAL;
+        goto err_exit;
+    }
 
-        if (!packet) {
+    if (VIR_ALLOC(capture) < 0) {
+        req->status = ENOMEM;
+        goto err_exit;
+    }
 
-            if (threadsTerminate || req->terminate) {
-                req->status = ECANCELED;
-                showError = false;
-                break;
-            }
+    capture->req = req;
+    capture->handle = handle;
+    capture->fd = fd;
 
-            /* check whether VM's dev is still there */
-            if (virNetDevValidateConfig(req->ifname, NULL, req->ifindex) <= 0) {
-                virResetLastError();
-                req->status = ENODEV;
-                showError = false;
-                break;
-            }
-            continue;
-        }
+    if (VIR_APPEND_ELEMENT_COPY(learnCaptures, nlearnCaptures,
+                                capture) < 0) {
+        VIR_FREE(capture);
+        req->status = ENOMEM;
+        goto err_exit;
+    }
 
-        if (header.len >= sizeof(struct ether_header)) {
-            ether_hdr = (struct ether_header*)packet;
+    VIR_FREE(filter);
 
-            switch (ntohs(ether_hdr->ether_type)) {
+    return;
 
-            case ETHERTYPE_IP:
-                ethHdrSize = sizeof(struct ether_header);
-                etherType = ntohs(ether_hdr->ether_type);
-                break;
+ err_exit:
+    if (handle)
+        pcap_close(handle);
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(filter);
 
-            case ETHERTYPE_VLAN:
-                ethHdrSize = sizeof(struct ether_vlan_header);
-                vlan_hdr = (struct ether_vlan_header *)packet;
-                if (ntohs(vlan_hdr->ether_type) != ETHERTYPE_IP ||
-                    header.len < ethHdrSize)
-                    continue;
-                etherType = ntohs(vlan_hdr->ether_type);
-                break;
+    virNWFilterLearnReqFail(req, true);
+
+    return;
+
+ err_no_lock:
+    virNWFilterDeregisterLearnReq(req->ifindex);
+
+    virNWFilterIPAddrLearnReqFree(req);
+}
+
+
+/*
+ * Pick up the requests that were registered since the last poll
+ * cycle and start capturing on their interfaces.
+ * Runs in the capture engine thread.
+ */
+static void
+virNWFilterLearnPickupNewReqs(void)
+{
+    virNWFilterIPAddrLearnReqPtr *reqs;
+    size_t nreqs;
+    size_t i;
+
+    virMutexLock(&pendingLearnReqLock);
+
+    reqs = learnNewReqs;
+    nreqs = nlearnNewReqs;
+    learnNewReqs = NULL;
+    nlearnNewReqs = 0;
+
+    virMutexUnlock(&pendingLearnReqLock);
+
+    for (i = 0; i < nreqs; i++)
+        virNWFilterLearnSetupCapture(reqs[i]);
+
+    VIR_FREE(reqs);
+}
+
+
+/**
+ * virNWFilterLearnThreadRun
+ *
+ * The capture engine thread: multiplexes the packet capturing for
+ * all pending learn requests over a single poll() loop instead of
+ * spawning one capture thread per interface.
+ */
+static void
+virNWFilterLearnThreadRun(void *arg ATTRIBUTE_UNUSED)
+{
+    struct pollfd *fds = NULL;
+    size_t nfds = 0;
+
+    while (!learnEngineQuit) {
+        size_t npolled;
+        size_t i, ci;
+
+        virNWFilterLearnPickupNewReqs();
+
+        if (nlearnCaptures == 0) {
+            usleep((PKT_TIMEOUT_MS * 1000) / 3);
+            continue;
+        }
 
-            default:
+        if (nfds < nlearnCaptures) {
+            if (VIR_REALLOC_N(fds, nlearnCaptures) < 0) {
+                usleep((PKT_TIMEOUT_MS * 1000) / 3);
                 continue;
             }
+            nfds = nlearnCaptures;
+        }
 
-            if (virMacAddrCmpRaw(&req->macaddr, ether_hdr->ether_shost) == 0) {
-                /* packets from the VM */
-
-                if (etherType == ETHERTYPE_IP &&
-                    (header.len >= ethHdrSize +
-                                   sizeof(struct iphdr))) {
-                    VIR_WARNINGS_NO_CAST_ALIGN
-                    struct iphdr *iphdr = (struct iphdr*)(packet +
-                                                          ethHdrSize);
-                    VIR_WARNINGS_RESET
-                    vmaddr = iphdr->saddr;
-                    /* skip mcast addresses (224.0.0.0 - 239.255.255.255),
-                     * class E (240.0.0.0 - 255.255.255.255, includes eth.
-                     * bcast) and zero address in DHCP Requests */
-                    if ((ntohl(vmaddr) & 0xe0000000) == 0xe0000000 ||
-                        vmaddr == 0) {
-                        vmaddr = 0;
-                        continue;
-                    }
+        npolled = nlearnCaptures;
+        for (i = 0; i < npolled; i++) {
+            fds[i].fd = learnCaptures[i]->fd;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+
+        if (poll(fds, npolled, PKT_TIMEOUT_MS) < 0 &&
+            errno != EAGAIN && errno != EINTR) {
+            char ebuf[1024];
+            VIR_WARN("poll on pcap descriptors failed: %s",
+                     virStrerror(errno, ebuf, sizeof(ebuf)));
+        }
+
+        ci = 0;
+        for (i = 0; i < npolled; i++) {
+            virNWFilterLearnCapturePtr capture = learnCaptures[ci];
+            virNWFilterIPAddrLearnReqPtr req = capture->req;
+            bool finished = false;
+            bool showError = true;
 
-                    howDetected = DETECT_STATIC;
-                } else if (etherType == ETHERTYPE_ARP &&
-                           (header.len >= ethHdrSize +
-                                          sizeof(struct f_arphdr))) {
-                    VIR_WARNINGS_NO_CAST_ALIGN
-                    struct f_arphdr *arphdr = (struct f_arphdr*)(packet +
-                                                         ethHdrSize);
-                    VIR_WARNINGS_RESET
-                    switch (ntohs(arphdr->arphdr.ar_op)) {
-                    case ARPOP_REPLY:
-                        vmaddr = arphdr->ar_sip;
-                        howDetected = DETECT_STATIC;
-                    break;
-                    case ARPOP_REQUEST:
-                        vmaddr = arphdr->ar_tip;
-                        howDetected = DETECT_STATIC;
-                    break;
+            if (threadsTerminate || req->terminate) {
+                req->status = ECANCELED;
+                showError = false;
+                finished = true;
+            } else if (fds[i].revents & (POLLHUP | POLLERR)) {
+                virResetLastError();
+                req->status = ENODEV;
+                showError = false;
+                finished = true;
+            } else if (fds[i].revents & POLLIN) {
+                /* process all buffered packets */
+                while (!finished) {
+                    struct pcap_pkthdr header;
+                    const u_char *packet;
+
+                    packet = pcap_next(capture->handle, &header);
+                    if (!packet)
+                        break;
+
+                    req->vmaddr = virNWFilterLearnDecodePacket(req, &header,
+                                                               packet);
+                    if (req->vmaddr) {
+                        req->status = 0;
+                        finished = true;
                     }
                 }
-            } else if (virMacAddrCmpRaw(&req->macaddr,
-                                        ether_hdr->ether_dhost) == 0 ||
-                       /* allow Broadcast replies from DHCP server */
-                       virMacAddrIsBroadcastRaw(ether_hdr->ether_dhost)) {
-                /* packets to the VM */
-                if (etherType == ETHERTYPE_IP &&
-                    (header.len >= ethHdrSize +
-                                   sizeof(struct iphdr))) {
-                    VIR_WARNINGS_NO_CAST_ALIGN
-                    struct iphdr *iphdr = (struct iphdr*)(packet +
-                                                          ethHdrSize);
-                    VIR_WARNINGS_RESET
-                    if ((iphdr->protocol == IPPROTO_UDP) &&
-                        (header.len >= ethHdrSize +
-                                       iphdr->ihl * 4 +
-                                       sizeof(struct udphdr))) {
-                        VIR_WARNINGS_NO_CAST_ALIGN
-                        struct udphdr *udphdr = (struct udphdr *)
-                                          ((char *)iphdr + iphdr->ihl * 4);
-                        VIR_WARNINGS_RESET
-                        if (ntohs(udphdr->source) == 67 &&
-                            ntohs(udphdr->dest)   == 68 &&
-                            header.len >= ethHdrSize +
-                                          iphdr->ihl * 4 +
-                                          sizeof(struct udphdr) +
-                                          sizeof(struct dhcp)) {
-                            struct dhcp *dhcp = (struct dhcp *)
-                                        ((char *)udphdr + sizeof(udphdr));
-                            if (dhcp->op == 2 /* BOOTREPLY */ &&
-                                virMacAddrCmpRaw(
-                                        &req->macaddr,
-                                        &dhcp->chaddr[0]) == 0) {
-                                dhcp_opts_len = header.len -
-                                    (ethHdrSize + iphdr->ihl * 4 +
-                                     sizeof(struct udphdr) +
-                                     sizeof(struct dhcp));
-                                procDHCPOpts(dhcp, dhcp_opts_len,
-                                             &vmaddr,
-                                             &bcastaddr,
-                                             &howDetected);
-                            }
-                        }
-                    }
+            } else {
+                /* idle; check whether VM's dev is still there */
+                if (virNetDevValidateConfig(req->ifname, NULL,
+                                            req->ifindex) <= 0) {
+                    virResetLastError();
+                    req->status = ENODEV;
+                    showError = false;
+                    finished = true;
                 }
             }
-        }
-        if (vmaddr && (req->howDetect & howDetected) == 0) {
-            vmaddr = 0;
-            howDetected = 0;
-        }
-    } /* while */
-
- done:
-    VIR_FREE(filter);
-
-    if (handle)
-        pcap_close(handle);
 
-    if (req->status == 0) {
-        int ret;
-        virSocketAddr sa;
-        sa.len = sizeof(sa.data.inet4);
-        sa.data.inet4.sin_family = AF_INET;
-        sa.data.inet4.sin_addr.s_addr = vmaddr;
-        char *inetaddr;
-
-        /* It is necessary to unlock interface here to avoid updateMutex and
-         * interface ordering deadlocks. Otherwise we are going to
-         * instantiate the filter, which will try to lock updateMutex, and
-         * some other thread instantiating a filter in parallel is holding
-         * updateMutex and is trying to lock interface, both will deadlock.
-         * Also it is safe to unlock interface here because we stopped
-         * capturing and applied necessary rules on the interface, while
-         * instantiating a new filter doesn't require a locked interface.*/
-        virNWFilterUnlockIface(req->ifname);
-
-        if ((inetaddr = virSocketAddrFormat(&sa)) != NULL) {
-            if (virNWFilterIPAddrMapAddIPAddr(req->ifname, inetaddr) < 0) {
-                VIR_ERROR(_("Failed to add IP address %s to IP address "
-                          "cache for interface %s"), inetaddr, req->ifname);
+            if (!finished) {
+                ci++;
+                continue;
             }
 
-            ret = virNWFilterInstantiateFilterLate(req->driver,
-                                                   NULL,
-                                                   req->ifname,
-                                                   req->ifindex,
-                                                   req->linkdev,
-                                                   &req->macaddr,
-                                                   req->filtername,
-                                                   req->filterparams);
-            VIR_DEBUG("Result from applying firewall rules on "
-                      "%s with IP addr %s : %d", req->ifname, inetaddr, ret);
+            virNWFilterLearnCaptureRemove(ci);
+
+            if (req->status == 0 && req->vmaddr != 0)
+                virNWFilterLearnReqSubmit(req);
+            else
+                virNWFilterLearnReqFail(req, showError);
         }
-    } else {
-        if (showError)
-            virReportSystemError(req->status,
-                                 _("encountered an error on interface %s "
-                                   "index %d"),
-                                 req->ifname, req->ifindex);
-
-        techdriver->applyDropAllRules(req->ifname);
-        virNWFilterUnlockIface(req->ifname);
     }
 
-    VIR_DEBUG("pcap thread terminating for interface %s", req->ifname);
-
+    /* cancel whatever is still pending */
+    while (nlearnCaptures) {
+        virNWFilterIPAddrLearnReqPtr req = learnCaptures[0]->req;
 
- err_no_lock:
-    virNWFilterDeregisterLearnReq(req->ifindex);
+        req->status = ECANCELED;
+        virNWFilterLearnCaptureRemove(0);
+        virNWFilterLearnReqFail(req, false);
+    }
 
-    virNWFilterIPAddrLearnReqFree(req);
+    VIR_FREE(fds);
 }
 
 
@@ -674,11 +949,11 @@ learnIPAddressThread(void *arg)
  *              IP address; must choose any of the available flags
  *
  * Instruct to learn the IP address being used on a given interface (ifname).
- * Unless there already is a thread attempting to learn the IP address
- * being used on the interface, a thread is started that will listen on
- * the traffic being sent on the interface (or link device) with the
- * MAC address that is provided. Will then launch the application of the
- * firewall rules on the interface.
+ * Unless there already is a request to learn the IP address being used
+ * on the interface, the request is handed to the capture engine thread
+ * which will listen on the traffic being sent on the interface (or link
+ * device) with the MAC address that is provided. Will then launch the
+ * application of the firewall rules on the interface.
  */
 int
 virNWFilterLearnIPAddress(virNWFilterTechDriverPtr techdriver,
@@ -692,7 +967,6 @@ virNWFilterLearnIPAddress(virNWFilterTechDriverPtr techdriver,
                           enum howDetect howDetect)
 {
     int rc;
-    virThread thread;
     virNWFilterIPAddrLearnReqPtr req = NULL;
     virNWFilterHashTablePtr ht = NULL;
 
@@ -749,16 +1023,8 @@ virNWFilterLearnIPAddress(virNWFilterTechDriverPtr techdriver,
     if (rc < 0)
         goto err_free_req;
 
-    if (virThreadCreate(&thread,
-                        false,
-                        learnIPAddressThread,
-                        req) != 0)
-        goto err_dereg_req;
-
     return 0;
 
- err_dereg_req:
-    virNWFilterDeregisterLearnReq(ifindex);
  err_free_ht:
     virNWFilterHashTableFree(ht);
  err_free_req:
@@ -813,6 +1079,25 @@ virNWFilterLearnInit(void)
         return -1;
     }
 
+#ifdef HAVE_LIBPCAP
+    learnEngineQuit = false;
+
+    if (!(learnWorkerPool = virThreadPoolNew(0, LEARN_WORKERS_MAX, 0,
+                                             virNWFilterLearnApplyWorker,
+                                             NULL))) {
+        virNWFilterLearnShutdown();
+        return -1;
+    }
+
+    if (virThreadCreate(&learnEngineThread, true,
+                        virNWFilterLearnThreadRun, NULL) < 0) {
+        virNWFilterLearnShutdown();
+        return -1;
+    }
+
+    learnEngineRunning = true;
+#endif /* HAVE_LIBPCAP */
+
     return 0;
 }
 
@@ -841,6 +1126,18 @@ virNWFilterLearnShutdown(void)
 
     virNWFilterLearnThreadsTerminate(false);
 
+#ifdef HAVE_LIBPCAP
+    if (learnEngineRunning) {
+        learnEngineQuit = true;
+        virThreadJoin(&learnEngineThread);
+        learnEngineRunning = false;
+    }
+
+    /* waits for the remaining jobs to finish */
+    virThreadPoolFree(learnWorkerPool);
+    learnWorkerPool = NULL;
+#endif /* HAVE_LIBPCAP */
+
     virHashFree(pendingLearnReq);
     pendingLearnReq = NULL;
 
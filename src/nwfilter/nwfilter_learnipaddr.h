@@ -49,6 +49,7 @@ struct _virNWFilterIPAddrLearnReq {
     enum howDetect howDetect;
 
     int status;
+    uint32_t vmaddr; /* learned IPv4 address in network byte order */
     volatile bool terminate;
 };
 
@@ -51,9 +51,56 @@
 #include "virfile.h"
 #include "vircommand.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_OPENVZ
 
+/* 1 MB sanity limit, container configs are tiny */
+#define OPENVZ_CONF_FILE_SIZE_MAX (1024 * 1024)
+
+/* Loading one domain looks up around ten parameters plus the UUID,
+ * and each lookup used to re-open and re-read the same config file.
+ * Keep the most recently read config in memory instead; enumeration
+ * handles containers one at a time, so a single slot suffices. */
+static virMutex openvzConfCacheLock = VIR_MUTEX_INITIALIZER;
+static char *openvzConfCachePath;
+static char *openvzConfCacheContent;
+
+/* Return the content of @conf_file, from cache when it is the file
+ * read last time.  Caller must hold openvzConfCacheLock and is not
+ * allowed to keep the pointer past unlocking it. */
+static const char *
+openvzConfCacheAcquire(const char *conf_file)
+{
+    if (openvzConfCachePath && STREQ(openvzConfCachePath, conf_file))
+        return openvzConfCacheContent;
+
+    VIR_FREE(openvzConfCachePath);
+    VIR_FREE(openvzConfCacheContent);
+
+    if (virFileReadAll(conf_file, OPENVZ_CONF_FILE_SIZE_MAX,
+                       &openvzConfCacheContent) < 0)
+        return NULL;
+
+    if (VIR_STRDUP(openvzConfCachePath, conf_file) < 0) {
+        VIR_FREE(openvzConfCacheContent);
+        return NULL;
+    }
+
+    return openvzConfCacheContent;
+}
+
+/* Forget any cached config content; must be called whenever a config
+ * file is (re)written */
+static void
+openvzConfCacheInvalidate(void)
+{
+    virMutexLock(&openvzConfCacheLock);
+    VIR_FREE(openvzConfCachePath);
+    VIR_FREE(openvzConfCacheContent);
+    virMutexUnlock(&openvzConfCacheLock);
+}
+
 static char *openvzLocateConfDir(void);
 static int openvzGetVPSUUID(int vpsid, char *uuidstr, size_t len);
 static int openvzAssignUUIDs(void);
@@ -683,6 +730,8 @@ openvzWriteConfigParam(const char * conf_file, const char *param, const char *va
     if (rename(temp_file, conf_file) < 0)
         goto error;
 
+    openvzConfCacheInvalidate();
+
     VIR_FREE(line);
 
     return 0;
@@ -720,41 +769,52 @@ openvzWriteVPSConfigParam(int vpsid, const char *param, const char *value)
 int
 openvzReadConfigParam(const char *conf_file, const char *param, char **value)
 {
-    char *line = NULL;
-    size_t line_size = 0;
-    FILE *fp;
+    const char *content;
+    const char *line;
+    const char *sf;
     int err = 0;
-    char *sf, *token, *saveptr = NULL;
 
-    fp = fopen(conf_file, "r");
-    if (fp == NULL)
+    virMutexLock(&openvzConfCacheLock);
+
+    if (!(content = openvzConfCacheAcquire(conf_file))) {
+        virMutexUnlock(&openvzConfCacheLock);
         return -1;
+    }
 
     VIR_FREE(*value);
-    while (1) {
-        if (getline(&line, &line_size, fp) < 0) {
-            err = !feof(fp);
-            break;
-        }
-
-        if (!(sf = STRSKIP(line, param)))
-            continue;
-
-        if (*sf++ != '=')
-            continue;
-
-        saveptr = NULL;
-        if ((token = strtok_r(sf, "\"\t\n", &saveptr)) != NULL) {
-            VIR_FREE(*value);
-            if (VIR_STRDUP(*value, token) < 0) {
-                err = 1;
-                break;
+    line = content;
+    while (*line) {
+        const char *eol = strchrnul(line, '\n');
+
+        if ((sf = STRSKIP(line, param)) && *sf == '=' && sf < eol) {
+            const char *start;
+            const char *end;
+
+            sf++;
+
+            /* mimic strtok(sf, "\"\t\n"): skip leading delimiters,
+             * then take everything up to the next one on this line */
+            start = sf;
+            while (start < eol && (*start == '"' || *start == '\t'))
+                start++;
+            end = start;
+            while (end < eol && *end != '"' && *end != '\t')
+                end++;
+
+            if (end > start) {
+                VIR_FREE(*value);
+                if (VIR_STRNDUP(*value, start, end - start) < 0) {
+                    err = 1;
+                    break;
+                }
+                /* keep going - last entry wins */
             }
-            /* keep going - last entry wins */
         }
+
+        line = *eol == '\n' ? eol + 1 : eol;
     }
-    VIR_FREE(line);
-    VIR_FORCE_FCLOSE(fp);
+
+    virMutexUnlock(&openvzConfCacheLock);
 
     return err ? -1 : *value ? 1 : 0;
 }
@@ -858,6 +918,8 @@ openvzCopyDefaultConfig(int vpsid)
     if (openvz_copyfile(default_conf_file, conf_file)<0)
         goto cleanup;
 
+    openvzConfCacheInvalidate();
+
     ret = 0;
  cleanup:
     VIR_FREE(confdir);
@@ -936,47 +998,47 @@ static int
 openvzGetVPSUUID(int vpsid, char *uuidstr, size_t len)
 {
     char *conf_file;
-    char *line = NULL;
-    size_t line_size = 0;
-    char *saveptr = NULL;
-    char *uuidbuf;
-    char *iden;
-    FILE *fp;
+    const char *content;
+    const char *line;
     int retval = -1;
 
     if (openvzLocateConfFile(vpsid, &conf_file, "conf") < 0)
         return -1;
 
-    fp = fopen(conf_file, "r");
-    if (fp == NULL)
+    virMutexLock(&openvzConfCacheLock);
+
+    if (!(content = openvzConfCacheAcquire(conf_file)))
         goto cleanup;
 
-    while (1) {
-        if (getline(&line, &line_size, fp) < 0) {
-            if (feof(fp)) { /* EOF, UUID was not found */
-                uuidstr[0] = 0;
-                break;
-            } else {
-                goto cleanup;
-            }
-        }
+    uuidstr[0] = 0; /* in case the UUID is not found */
+    line = content;
+    while (*line) {
+        const char *eol = strchrnul(line, '\n');
+        const char *uuidbuf;
 
-        iden = strtok_r(line, " ", &saveptr);
-        uuidbuf = strtok_r(NULL, "\n", &saveptr);
+        if (STRPREFIX(line, "#UUID: ")) {
+            char *uuid = NULL;
 
-        if (iden != NULL && uuidbuf != NULL && STREQ(iden, "#UUID:")) {
-            if (virStrcpy(uuidstr, uuidbuf, len) == NULL) {
+            uuidbuf = line + strlen("#UUID: ");
+            if (VIR_STRNDUP(uuid, uuidbuf, eol - uuidbuf) < 0)
+                goto cleanup;
+
+            if (virStrcpy(uuidstr, uuid, len) == NULL) {
                 virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("invalid uuid %s"), uuidbuf);
+                               _("invalid uuid %s"), uuid);
+                VIR_FREE(uuid);
                 goto cleanup;
             }
+            VIR_FREE(uuid);
             break;
         }
+
+        line = *eol == '\n' ? eol + 1 : eol;
     }
+
     retval = 0;
  cleanup:
-    VIR_FREE(line);
-    VIR_FORCE_FCLOSE(fp);
+    virMutexUnlock(&openvzConfCacheLock);
     VIR_FREE(conf_file);
 
     return retval;
@@ -1014,6 +1076,8 @@ openvzSetDefinedUUID(int vpsid, unsigned char *uuid)
         if ((fprintf(fp, "\n#UUID: %s\n", uuidstr) < 0) ||
             (VIR_FCLOSE(fp) == EOF))
             goto cleanup;
+
+        openvzConfCacheInvalidate();
     }
 
     ret = 0;
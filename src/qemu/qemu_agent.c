@@ -81,6 +81,9 @@ struct _qemuAgentMessage {
      * fatal error occurred on the monitor channel
      */
     bool finished;
+
+    /* Next message in the agent's queue */
+    qemuAgentMessagePtr next;
 };
 
 
@@ -99,9 +102,11 @@ struct _qemuAgent {
 
     qemuAgentCallbacksPtr cb;
 
-    /* If there's a command being processed this will be
-     * non-NULL */
-    qemuAgentMessagePtr msg;
+    /* FIFO queue of commands awaiting transmission and replies. The
+     * guest agent protocol carries no IDs, so incoming replies are
+     * matched to queued messages in order of submission */
+    qemuAgentMessagePtr msgHead;
+    qemuAgentMessagePtr msgTail;
 
     /* Buffer incoming data ready for Agent monitor
      * code to process & find message boundaries */
@@ -301,10 +306,62 @@ qemuAgentIOProcessEvent(qemuAgentPtr mon,
     return 0;
 }
 
+/* Find the message the next incoming reply belongs to: the oldest
+ * queued message which has been fully transmitted and is still
+ * waiting. Returns NULL if nothing is awaiting a reply. */
+static qemuAgentMessagePtr
+qemuAgentMessageAwaitingReply(qemuAgentPtr mon)
+{
+    qemuAgentMessagePtr msg;
+
+    for (msg = mon->msgHead; msg; msg = msg->next) {
+        if (!msg->finished && msg->txOffset == msg->txLength)
+            return msg;
+    }
+    return NULL;
+}
+
+
+static void
+qemuAgentMessageQueueRemove(qemuAgentPtr mon,
+                            qemuAgentMessagePtr msg)
+{
+    qemuAgentMessagePtr *prev = &mon->msgHead;
+
+    while (*prev && *prev != msg)
+        prev = &(*prev)->next;
+    if (!*prev)
+        return;
+
+    *prev = msg->next;
+    msg->next = NULL;
+
+    if (mon->msgTail == msg) {
+        qemuAgentMessagePtr tail = mon->msgHead;
+
+        while (tail && tail->next)
+            tail = tail->next;
+        mon->msgTail = tail;
+    }
+}
+
+
+/* Mark all queued messages finished so their waiters wake up and
+ * find mon->lastError / !mon->running; used when the agent channel
+ * breaks down */
+static void
+qemuAgentMessageQueueAbort(qemuAgentPtr mon)
+{
+    qemuAgentMessagePtr msg;
+
+    for (msg = mon->msgHead; msg; msg = msg->next)
+        msg->finished = 1;
+}
+
+
 static int
 qemuAgentIOProcessLine(qemuAgentPtr mon,
-                       const char *line,
-                       qemuAgentMessagePtr msg)
+                       const char *line)
 {
     virJSONValuePtr obj = NULL;
     int ret = -1;
@@ -327,6 +384,8 @@ qemuAgentIOProcessLine(qemuAgentPtr mon,
         ret = qemuAgentIOProcessEvent(mon, obj);
     } else if (virJSONValueObjectHasKey(obj, "error") == 1 ||
                virJSONValueObjectHasKey(obj, "return") == 1) {
+        qemuAgentMessagePtr msg = qemuAgentMessageAwaitingReply(mon);
+
         if (msg) {
             msg->rxObject = obj;
             msg->finished = 1;
@@ -362,8 +421,7 @@ qemuAgentIOProcessLine(qemuAgentPtr mon,
 
 static int qemuAgentIOProcessData(qemuAgentPtr mon,
                                   char *data,
-                                  size_t len,
-                                  qemuAgentMessagePtr msg)
+                                  size_t len)
 {
     int used = 0;
     size_t i = 0;
@@ -384,7 +442,7 @@ static int qemuAgentIOProcessData(qemuAgentPtr mon,
             int got = nl - (data + used);
             for (i = 0; i < strlen(LINE_ENDING); i++)
                 data[used + got + i] = '\0';
-            if (qemuAgentIOProcessLine(mon, data + used, msg) < 0)
+            if (qemuAgentIOProcessLine(mon, data + used) < 0)
                 return -1;
             used += got + strlen(LINE_ENDING);
         } else {
@@ -404,20 +462,15 @@ static int
 qemuAgentIOProcess(qemuAgentPtr mon)
 {
     int len;
-    qemuAgentMessagePtr msg = NULL;
-
-    /* See if there's a message ready for reply; that is,
-     * one that has completed writing all its data.
-     */
-    if (mon->msg && mon->msg->txOffset == mon->msg->txLength)
-        msg = mon->msg;
+    qemuAgentMessagePtr msg;
 
 #if DEBUG_IO
 # if DEBUG_RAW_IO
-    char *str1 = qemuAgentEscapeNonPrintable(msg ? msg->txBuffer : "");
+    char *str1 = qemuAgentEscapeNonPrintable(mon->msgHead ?
+                                             mon->msgHead->txBuffer : "");
     char *str2 = qemuAgentEscapeNonPrintable(mon->buffer);
-    VIR_ERROR(_("Process %zu %p %p [[[%s]]][[[%s]]]"),
-              mon->bufferOffset, mon->msg, msg, str1, str2);
+    VIR_ERROR(_("Process %zu %p [[[%s]]][[[%s]]]"),
+              mon->bufferOffset, mon->msgHead, str1, str2);
     VIR_FREE(str1);
     VIR_FREE(str2);
 # else
@@ -426,8 +479,7 @@ qemuAgentIOProcess(qemuAgentPtr mon)
 #endif
 
     len = qemuAgentIOProcessData(mon,
-                                 mon->buffer, mon->bufferOffset,
-                                 msg);
+                                 mon->buffer, mon->bufferOffset);
 
     if (len < 0)
         return -1;
@@ -442,8 +494,12 @@ qemuAgentIOProcess(qemuAgentPtr mon)
 #if DEBUG_IO
     VIR_DEBUG("Process done %zu used %d", mon->bufferOffset, len);
 #endif
-    if (msg && msg->finished)
-        virCondBroadcast(&mon->notify);
+    for (msg = mon->msgHead; msg; msg = msg->next) {
+        if (msg->finished) {
+            virCondBroadcast(&mon->notify);
+            break;
+        }
+    }
     return len;
 }
 
@@ -484,15 +540,21 @@ qemuAgentIOConnect(qemuAgentPtr mon)
 static int
 qemuAgentIOWrite(qemuAgentPtr mon)
 {
+    qemuAgentMessagePtr msg;
     int done;
 
-    /* If no active message, or fully transmitted, then no-op */
-    if (!mon->msg || mon->msg->txOffset == mon->msg->txLength)
+    /* Find the oldest queued message with data left to transmit;
+     * messages are written out strictly in submission order */
+    for (msg = mon->msgHead; msg; msg = msg->next) {
+        if (msg->txOffset < msg->txLength)
+            break;
+    }
+    if (!msg)
         return 0;
 
     done = safewrite(mon->fd,
-                     mon->msg->txBuffer + mon->msg->txOffset,
-                     mon->msg->txLength - mon->msg->txOffset);
+                     msg->txBuffer + msg->txOffset,
+                     msg->txLength - msg->txOffset);
 
     if (done < 0) {
         if (errno == EAGAIN)
@@ -502,7 +564,7 @@ qemuAgentIOWrite(qemuAgentPtr mon)
                              _("Unable to write to monitor"));
         return -1;
     }
-    mon->msg->txOffset += done;
+    msg->txOffset += done;
     return done;
 }
 
@@ -565,10 +627,16 @@ static void qemuAgentUpdateWatch(qemuAgentPtr mon)
         VIR_EVENT_HANDLE_ERROR;
 
     if (mon->lastError.code == VIR_ERR_OK) {
+        qemuAgentMessagePtr msg;
+
         events |= VIR_EVENT_HANDLE_READABLE;
 
-        if (mon->msg && mon->msg->txOffset < mon->msg->txLength)
-            events |= VIR_EVENT_HANDLE_WRITABLE;
+        for (msg = mon->msgHead; msg; msg = msg->next) {
+            if (msg->txOffset < msg->txLength) {
+                events |= VIR_EVENT_HANDLE_WRITABLE;
+                break;
+            }
+        }
     }
 
     virEventUpdateHandle(mon->watch, events);
@@ -667,11 +735,11 @@ qemuAgentIO(int watch, int fd, int events, void *opaque)
         }
 
         VIR_DEBUG("Error on monitor %s", NULLSTR(mon->lastError.message));
-        /* If IO process resulted in an error & we have a message,
-         * then wakeup that waiter */
-        if (mon->msg && !mon->msg->finished) {
-            mon->msg->finished = 1;
-            virCondSignal(&mon->notify);
+        /* If IO process resulted in an error & we have queued
+         * messages, then wakeup all the waiters */
+        if (mon->msgHead) {
+            qemuAgentMessageQueueAbort(mon);
+            virCondBroadcast(&mon->notify);
         }
     }
 
@@ -686,7 +754,7 @@ qemuAgentIO(int watch, int fd, int events, void *opaque)
         virDomainObjPtr vm = mon->vm;
 
         /* Make sure anyone waiting wakes up now */
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
         virObjectUnlock(mon);
         virObjectUnref(mon);
         VIR_DEBUG("Triggering EOF callback");
@@ -697,7 +765,7 @@ qemuAgentIO(int watch, int fd, int events, void *opaque)
         virDomainObjPtr vm = mon->vm;
 
         /* Make sure anyone waiting wakes up now */
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
         virObjectUnlock(mon);
         virObjectUnref(mon);
         VIR_DEBUG("Triggering error callback");
@@ -800,9 +868,9 @@ qemuAgentNotifyCloseLocked(qemuAgentPtr mon)
 
         /* If there is somebody waiting for a message
          * wake him up. No message will arrive anyway. */
-        if (mon->msg && !mon->msg->finished) {
-            mon->msg->finished = 1;
-            virCondSignal(&mon->notify);
+        if (mon->msgHead) {
+            qemuAgentMessageQueueAbort(mon);
+            virCondBroadcast(&mon->notify);
         }
     }
 }
@@ -888,10 +956,41 @@ static int qemuAgentSend(qemuAgentPtr mon,
         then = now + seconds * 1000ull;
     }
 
-    mon->msg = msg;
+    /* Commands completed by an out-of-band event never produce a
+     * reply, so the FIFO reply matching breaks down if anything else
+     * is in flight alongside them; let such commands (and their
+     * guest-sync) have the queue to themselves */
+    while (mon->await_event != QEMU_AGENT_EVENT_NONE && mon->msgHead) {
+        VIR_DEBUG("Waiting for agent queue to drain");
+        if ((then && virCondWaitUntil(&mon->notify, &mon->parent.lock, then) < 0) ||
+            (!then && virCondWait(&mon->notify, &mon->parent.lock) < 0)) {
+            if (errno == ETIMEDOUT) {
+                virReportError(VIR_ERR_AGENT_UNRESPONSIVE, "%s",
+                               _("Guest agent not available for now"));
+                ret = -2;
+            } else {
+                virReportSystemError(errno, "%s",
+                                     _("Unable to wait on agent monitor "
+                                       "condition"));
+            }
+            return ret;
+        }
+
+        if (mon->lastError.code != VIR_ERR_OK) {
+            virSetError(&mon->lastError);
+            return -1;
+        }
+    }
+
+    msg->next = NULL;
+    if (mon->msgTail)
+        mon->msgTail->next = msg;
+    else
+        mon->msgHead = msg;
+    mon->msgTail = msg;
     qemuAgentUpdateWatch(mon);
 
-    while (!mon->msg->finished) {
+    while (!msg->finished) {
         if ((then && virCondWaitUntil(&mon->notify, &mon->parent.lock, then) < 0) ||
             (!then && virCondWait(&mon->notify, &mon->parent.lock) < 0)) {
             if (errno == ETIMEDOUT) {
@@ -917,7 +1016,9 @@ static int qemuAgentSend(qemuAgentPtr mon,
     ret = 0;
 
  cleanup:
-    mon->msg = NULL;
+    qemuAgentMessageQueueRemove(mon, msg);
+    /* wake up anyone waiting for the queue to drain */
+    virCondBroadcast(&mon->notify);
     qemuAgentUpdateWatch(mon);
 
     return ret;
@@ -1162,6 +1263,14 @@ qemuAgentCommand(qemuAgentPtr mon,
     }
 
  cleanup:
+    /* The command expecting the event may have failed before the
+     * event arrived; don't leave the stale expectation behind to
+     * block the queue for everybody else */
+    if (await_event && mon->await_event != QEMU_AGENT_EVENT_NONE) {
+        mon->await_event = QEMU_AGENT_EVENT_NONE;
+        virCondBroadcast(&mon->notify);
+    }
+
     VIR_FREE(cmdstr);
     VIR_FREE(msg.txBuffer);
 
@@ -1234,11 +1343,12 @@ void qemuAgentNotifyEvent(qemuAgentPtr mon,
     VIR_DEBUG("mon=%p event=%d await_event=%d", mon, event, mon->await_event);
     if (mon->await_event == event) {
         mon->await_event = QEMU_AGENT_EVENT_NONE;
-        /* somebody waiting for this event, wake him up. */
-        if (mon->msg && !mon->msg->finished) {
-            mon->msg->finished = 1;
-            virCondSignal(&mon->notify);
-        }
+        /* somebody waiting for this event, wake him up; event
+         * completed commands hold the queue exclusively, so the
+         * head is the command the event belongs to */
+        if (mon->msgHead && !mon->msgHead->finished)
+            mon->msgHead->finished = 1;
+        virCondBroadcast(&mon->notify);
     }
 }
 
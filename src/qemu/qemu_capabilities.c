@@ -342,6 +342,8 @@ VIR_ENUM_IMPL(virQEMUCaps, QEMU_CAPS_LAST,
               "smm",
               "virtio-pci-disable-legacy",
               "query-hotpluggable-cpus",
+
+              "query-dump", /* 235 */
     );
 
 
@@ -1466,6 +1468,7 @@ struct virQEMUCapsStringFlags virQEMUCapsCommands[] = {
     { "rtc-reset-reinjection", QEMU_CAPS_RTC_RESET_REINJECTION },
     { "migrate-incoming", QEMU_CAPS_INCOMING_DEFER },
     { "query-hotpluggable-cpus", QEMU_CAPS_QUERY_HOTPLUGGABLE_CPUS },
+    { "query-dump", QEMU_CAPS_QUERY_DUMP },
 };
 
 struct virQEMUCapsStringFlags virQEMUCapsMigration[] = {
@@ -2095,7 +2098,10 @@ virQEMUCapsPtr virQEMUCapsNewCopy(virQEMUCapsPtr qemuCaps)
         goto error;
     ret->ncpuDefinitions = qemuCaps->ncpuDefinitions;
     for (i = 0; i < qemuCaps->ncpuDefinitions; i++) {
-        if (VIR_STRDUP(ret->cpuDefinitions[i], qemuCaps->cpuDefinitions[i]) < 0)
+        /* every per-domain copy shares one interned instance of the
+         * model name instead of duplicating it */
+        if (!(ret->cpuDefinitions[i] =
+              virStringIntern(qemuCaps->cpuDefinitions[i])))
             goto error;
     }
 
@@ -2103,8 +2109,12 @@ virQEMUCapsPtr virQEMUCapsNewCopy(virQEMUCapsPtr qemuCaps)
         goto error;
     ret->nmachineTypes = qemuCaps->nmachineTypes;
     for (i = 0; i < qemuCaps->nmachineTypes; i++) {
-        if (VIR_STRDUP(ret->machineTypes[i].name, qemuCaps->machineTypes[i].name) < 0 ||
-            VIR_STRDUP(ret->machineTypes[i].alias, qemuCaps->machineTypes[i].alias) < 0)
+        if (!(ret->machineTypes[i].name =
+              virStringIntern(qemuCaps->machineTypes[i].name)))
+            goto error;
+        if (qemuCaps->machineTypes[i].alias &&
+            !(ret->machineTypes[i].alias =
+              virStringIntern(qemuCaps->machineTypes[i].alias)))
             goto error;
         ret->machineTypes[i].maxCpus = qemuCaps->machineTypes[i].maxCpus;
         ret->machineTypes[i].hotplugCpus = qemuCaps->machineTypes[i].hotplugCpus;
@@ -2130,13 +2140,13 @@ void virQEMUCapsDispose(void *obj)
     size_t i;
 
     for (i = 0; i < qemuCaps->nmachineTypes; i++) {
-        VIR_FREE(qemuCaps->machineTypes[i].name);
-        VIR_FREE(qemuCaps->machineTypes[i].alias);
+        virStringInternRelease(qemuCaps->machineTypes[i].name);
+        virStringInternRelease(qemuCaps->machineTypes[i].alias);
     }
     VIR_FREE(qemuCaps->machineTypes);
 
     for (i = 0; i < qemuCaps->ncpuDefinitions; i++)
-        VIR_FREE(qemuCaps->cpuDefinitions[i]);
+        virStringInternRelease(qemuCaps->cpuDefinitions[i]);
     VIR_FREE(qemuCaps->cpuDefinitions);
 
     virBitmapFree(qemuCaps->flags);
@@ -2885,6 +2895,11 @@ virQEMUCapsLoadCache(virQEMUCapsPtr qemuCaps, const char *filename,
         goto cleanup;
     }
 
+    /* Caches written before the binary path was recorded lack this
+     * element; they can still be matched via their file name */
+    if (!qemuCaps->binary)
+        qemuCaps->binary = virXPathString("string(./binary)", ctxt);
+
     if (virXPathLongLong("string(./qemuctime)", ctxt, &l) < 0) {
         virReportError(VIR_ERR_XML_ERROR, "%s",
                        _("missing qemuctime in QEMU capabilities XML"));
@@ -3106,6 +3121,8 @@ virQEMUCapsFormatCache(virQEMUCapsPtr qemuCaps,
     virBufferAddLit(&buf, "<qemuCaps>\n");
     virBufferAdjustIndent(&buf, 2);
 
+    virBufferEscapeString(&buf, "<binary>%s</binary>\n",
+                          qemuCaps->binary);
     virBufferAsprintf(&buf, "<qemuctime>%llu</qemuctime>\n",
                       (long long) qemuCaps->ctime);
     virBufferAsprintf(&buf, "<selfctime>%llu</selfctime>\n",
@@ -3257,13 +3274,13 @@ virQEMUCapsReset(virQEMUCapsPtr qemuCaps)
     qemuCaps->usedQMP = false;
 
     for (i = 0; i < qemuCaps->ncpuDefinitions; i++)
-        VIR_FREE(qemuCaps->cpuDefinitions[i]);
+        virStringInternRelease(qemuCaps->cpuDefinitions[i]);
     VIR_FREE(qemuCaps->cpuDefinitions);
     qemuCaps->ncpuDefinitions = 0;
 
     for (i = 0; i < qemuCaps->nmachineTypes; i++) {
-        VIR_FREE(qemuCaps->machineTypes[i].name);
-        VIR_FREE(qemuCaps->machineTypes[i].alias);
+        virStringInternRelease(qemuCaps->machineTypes[i].name);
+        virStringInternRelease(qemuCaps->machineTypes[i].alias);
     }
     VIR_FREE(qemuCaps->machineTypes);
     qemuCaps->nmachineTypes = 0;
@@ -3942,6 +3959,78 @@ virQEMUCapsFilterByMachineType(virQEMUCapsPtr qemuCaps,
 }
 
 
+/* Pre-populate the cache with all still valid capabilities files left
+ * behind by an earlier daemon, so that a restart with unchanged QEMU
+ * binaries does not re-probe any of them on first use */
+static void
+virQEMUCapsCachePreload(virQEMUCapsCachePtr cache)
+{
+    char *capsdir = NULL;
+    char *capsfile = NULL;
+    DIR *dir = NULL;
+    struct dirent *ent;
+
+    if (virAsprintf(&capsdir, "%s/capabilities", cache->cacheDir) < 0)
+        goto cleanup;
+
+    if (virDirOpenIfExists(&dir, capsdir) <= 0)
+        goto cleanup;
+
+    while (virDirRead(dir, &ent, capsdir) > 0) {
+        virQEMUCapsPtr qemuCaps;
+        time_t qemuctime;
+        time_t selfctime;
+        unsigned long selfvers;
+        struct stat sb;
+
+        if (!virFileHasSuffix(ent->d_name, ".xml"))
+            continue;
+
+        VIR_FREE(capsfile);
+        if (virAsprintf(&capsfile, "%s/%s", capsdir, ent->d_name) < 0)
+            break;
+
+        if (!(qemuCaps = virQEMUCapsNew()))
+            break;
+
+        if (virQEMUCapsLoadCache(qemuCaps, capsfile, &qemuctime,
+                                 &selfctime, &selfvers) < 0 ||
+            !qemuCaps->binary) {
+            VIR_DEBUG("Not preloading '%s': %s",
+                      capsfile, virGetLastErrorMessage());
+            virResetLastError();
+            virObjectUnref(qemuCaps);
+            continue;
+        }
+
+        if (selfctime != virGetSelfLastChanged() ||
+            selfvers != LIBVIR_VERSION_NUMBER ||
+            stat(qemuCaps->binary, &sb) < 0 ||
+            qemuctime != sb.st_ctime) {
+            VIR_DEBUG("Not preloading outdated '%s' for '%s'",
+                      capsfile, qemuCaps->binary);
+            virObjectUnref(qemuCaps);
+            continue;
+        }
+
+        qemuCaps->ctime = sb.st_ctime;
+
+        /* The hash table owns the reference created above */
+        if (virHashAddEntry(cache->binaries, qemuCaps->binary, qemuCaps) < 0) {
+            virObjectUnref(qemuCaps);
+            continue;
+        }
+
+        VIR_DEBUG("Preloaded caps %p for '%s'", qemuCaps, qemuCaps->binary);
+    }
+
+ cleanup:
+    VIR_DIR_CLOSE(dir);
+    VIR_FREE(capsfile);
+    VIR_FREE(capsdir);
+}
+
+
 virQEMUCapsCachePtr
 virQEMUCapsCacheNew(const char *libDir,
                     const char *cacheDir,
@@ -3953,9 +4042,9 @@ virQEMUCapsCacheNew(const char *libDir,
     if (VIR_ALLOC(cache) < 0)
         return NULL;
 
-    if (virMutexInit(&cache->lock) < 0) {
+    if (virRWLockInit(&cache->lock) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Unable to initialize mutex"));
+                       _("Unable to initialize RW lock"));
         VIR_FREE(cache);
         return NULL;
     }
@@ -3970,6 +4059,9 @@ virQEMUCapsCacheNew(const char *libDir,
     cache->runUid = runUid;
     cache->runGid = runGid;
 
+    if (cacheDir)
+        virQEMUCapsCachePreload(cache);
+
     return cache;
 
  error:
@@ -3988,7 +4080,22 @@ virQEMUCapsCacheLookup(virQEMUCapsCachePtr cache, const char *binary)
     if (qemuTestCapsName)
         binary = qemuTestCapsName;
 
-    virMutexLock(&cache->lock);
+    /* Fast path: concurrent lookups of valid cached entries only
+     * need the read lock */
+    virRWLockRead(&cache->lock);
+    ret = virHashLookup(cache->binaries, binary);
+    if (ret && virQEMUCapsIsValid(ret)) {
+        VIR_DEBUG("Returning caps %p for %s", ret, binary);
+        virObjectRef(ret);
+        virRWLockUnlock(&cache->lock);
+        return ret;
+    }
+    virRWLockUnlock(&cache->lock);
+
+    /* Cache miss or stale entry; retry with the write lock held
+     * since the hash table needs updating. Repeat the lookup as
+     * another thread may have repopulated the entry meanwhile */
+    virRWLockWrite(&cache->lock);
     ret = virHashLookup(cache->binaries, binary);
     if (ret &&
         !virQEMUCapsIsValid(ret)) {
@@ -4014,7 +4121,7 @@ virQEMUCapsCacheLookup(virQEMUCapsCachePtr cache, const char *binary)
     }
     VIR_DEBUG("Returning caps %p for %s", ret, binary);
     virObjectRef(ret);
-    virMutexUnlock(&cache->lock);
+    virRWLockUnlock(&cache->lock);
     return ret;
 }
 
@@ -4057,19 +4164,19 @@ virQEMUCapsCacheLookupByArch(virQEMUCapsCachePtr cache,
     virArch target;
     struct virQEMUCapsSearchData data = { .arch = arch };
 
-    virMutexLock(&cache->lock);
-    ret = virHashSearch(cache->binaries, virQEMUCapsCompareArch, &data);
+    virRWLockRead(&cache->lock);
+    ret = virHashSearchConst(cache->binaries, virQEMUCapsCompareArch, &data);
     if (!ret) {
         /* If the first attempt at finding capabilities has failed, try
          * again using the QEMU target as lookup key instead */
         target = virQEMUCapsFindTarget(virArchFromHost(), data.arch);
         if (target != data.arch) {
             data.arch = target;
-            ret = virHashSearch(cache->binaries, virQEMUCapsCompareArch, &data);
+            ret = virHashSearchConst(cache->binaries, virQEMUCapsCompareArch, &data);
         }
     }
     virObjectRef(ret);
-    virMutexUnlock(&cache->lock);
+    virRWLockUnlock(&cache->lock);
 
     VIR_DEBUG("Returning caps %p for arch %s", ret, virArchToString(arch));
 
@@ -4086,7 +4193,7 @@ virQEMUCapsCacheFree(virQEMUCapsCachePtr cache)
     VIR_FREE(cache->libDir);
     VIR_FREE(cache->cacheDir);
     virHashFree(cache->binaries);
-    virMutexDestroy(&cache->lock);
+    virRWLockDestroy(&cache->lock);
     VIR_FREE(cache);
 }
 
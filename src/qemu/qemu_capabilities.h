@@ -376,6 +376,9 @@ typedef enum {
     QEMU_CAPS_VIRTIO_PCI_DISABLE_LEGACY, /* virtio-*pci.disable-legacy */
     QEMU_CAPS_QUERY_HOTPLUGGABLE_CPUS, /* qmp command query-hotpluggable-cpus */
 
+    /* 235 */
+    QEMU_CAPS_QUERY_DUMP, /* qmp command query-dump, dump-guest-memory detach */
+
     QEMU_CAPS_LAST /* this must always be the last item */
 } virQEMUCapsFlags;
 
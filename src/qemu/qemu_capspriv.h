@@ -29,7 +29,7 @@
 # define __QEMU_CAPSPRIV_H__
 
 struct _virQEMUCapsCache {
-    virMutex lock;
+    virRWLock lock;
     virHashTablePtr binaries;
     char *libDir;
     char *cacheDir;
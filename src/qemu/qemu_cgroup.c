@@ -982,6 +982,10 @@ qemuSetupCgroup(virQEMUDriverPtr driver,
     if (!priv->cgroup)
         return 0;
 
+    /* The initial setup writes many parameters in a row; batch them so
+     * each one is a single openat() relative to the controller dir */
+    virCgroupBatchBegin(priv->cgroup);
+
     if (qemuSetupDevicesCgroup(driver, vm) < 0)
         goto cleanup;
 
@@ -999,6 +1003,7 @@ qemuSetupCgroup(virQEMUDriverPtr driver,
 
     ret = 0;
  cleanup:
+    virCgroupBatchEnd(priv->cgroup);
     return ret;
 }
 
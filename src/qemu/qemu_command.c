@@ -41,6 +41,9 @@
 #include "virstring.h"
 #include "virtime.h"
 #include "viruuid.h"
+#include "vircrypto.h"
+#include "virhash.h"
+#include "virthread.h"
 #include "domain_nwfilter.h"
 #include "domain_addr.h"
 #include "domain_audit.h"
@@ -2078,6 +2081,149 @@ qemuBuildDriveDevStr(const virDomainDef *def,
 }
 
 
+/* Cache of generated -drive/-device argument strings. Boot storms of
+ * many domains cloned from the same template rebuild identical disk
+ * fragments over and over; remembering them keyed by the disk XML and
+ * the emulator identity avoids re-running the formatters each time.
+ */
+typedef struct _qemuDiskFragment qemuDiskFragment;
+typedef qemuDiskFragment *qemuDiskFragmentPtr;
+struct _qemuDiskFragment {
+    char *drivestr;
+    char *devstr;
+};
+
+#define QEMU_DISK_FRAGMENT_CACHE_SIZE 1024
+
+static virMutex qemuDiskFragmentCacheLock;
+static virHashTablePtr qemuDiskFragmentCache;
+
+static void
+qemuDiskFragmentFree(void *payload,
+                     const void *name ATTRIBUTE_UNUSED)
+{
+    qemuDiskFragmentPtr frag = payload;
+
+    VIR_FREE(frag->drivestr);
+    VIR_FREE(frag->devstr);
+    VIR_FREE(frag);
+}
+
+static int
+qemuDiskFragmentCacheOnceInit(void)
+{
+    if (virMutexInit(&qemuDiskFragmentCacheLock) < 0)
+        return -1;
+
+    if (!(qemuDiskFragmentCache = virHashCreate(256, qemuDiskFragmentFree)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(qemuDiskFragmentCache)
+
+/* Build the cache key for @disk. The formatted XML covers everything
+ * the disk def contributes to the fragments; the alias, boot settings
+ * and emulator version/arch are appended since they influence the
+ * strings without appearing in the disk XML, as are the parts of the
+ * domain def the device string depends on - the machine type (CCW vs
+ * PCI virtio variants and similar) and the model of the controller
+ * the disk attaches to, so two domains whose disk XML is identical
+ * but which plug it into different controllers never share an entry.
+ * Returns NULL on error; callers simply skip the cache in that case.
+ */
+static char *
+qemuDiskFragmentCacheKey(const virDomainDef *def,
+                         virDomainDiskDefPtr disk,
+                         bool bootable,
+                         unsigned int bootindex,
+                         virQEMUCapsPtr qemuCaps)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *data = NULL;
+    char *key = NULL;
+    int contmodel = -1;
+
+    if (qemuDiskFragmentCacheInitialize() < 0)
+        return NULL;
+
+    if (disk->bus == VIR_DOMAIN_DISK_BUS_SCSI)
+        contmodel = virDomainDeviceFindControllerModel(def, &disk->info,
+                                                       VIR_DOMAIN_CONTROLLER_TYPE_SCSI);
+
+    if (virDomainDiskDefFormat(&buf, disk,
+                               VIR_DOMAIN_DEF_FORMAT_SECURE |
+                               VIR_DOMAIN_DEF_FORMAT_STATUS) < 0)
+        goto cleanup;
+
+    virBufferAsprintf(&buf, "alias=%s;boot=%d;bootindex=%u;ver=%u;arch=%s;"
+                      "machine=%s;contmodel=%d;",
+                      NULLSTR(disk->info.alias), bootable, bootindex,
+                      virQEMUCapsGetVersion(qemuCaps),
+                      virArchToString(virQEMUCapsGetArch(qemuCaps)),
+                      NULLSTR(def->os.machine), contmodel);
+
+    if (virBufferCheckError(&buf) < 0)
+        goto cleanup;
+
+    data = virBufferContentAndReset(&buf);
+    ignore_value(virCryptoHashString(VIR_CRYPTO_HASH_SHA256, data, &key));
+
+ cleanup:
+    VIR_FREE(data);
+    virBufferFreeAndReset(&buf);
+    return key;
+}
+
+static void
+qemuDiskFragmentCacheLookup(const char *key,
+                            char **drivestr,
+                            char **devstr)
+{
+    qemuDiskFragmentPtr frag;
+
+    virMutexLock(&qemuDiskFragmentCacheLock);
+    if ((frag = virHashLookup(qemuDiskFragmentCache, key)) &&
+        (VIR_STRDUP_QUIET(*drivestr, frag->drivestr) < 0 ||
+         VIR_STRDUP_QUIET(*devstr, frag->devstr) < 0)) {
+        /* treat OOM as a cache miss */
+        VIR_FREE(*drivestr);
+        VIR_FREE(*devstr);
+    }
+    virMutexUnlock(&qemuDiskFragmentCacheLock);
+}
+
+static void
+qemuDiskFragmentCacheStore(const char *key,
+                           const char *drivestr,
+                           const char *devstr)
+{
+    qemuDiskFragmentPtr frag = NULL;
+
+    virMutexLock(&qemuDiskFragmentCacheLock);
+    if (virHashSize(qemuDiskFragmentCache) >= QEMU_DISK_FRAGMENT_CACHE_SIZE ||
+        virHashLookup(qemuDiskFragmentCache, key))
+        goto cleanup;
+
+    if (VIR_ALLOC_QUIET(frag) < 0 ||
+        VIR_STRDUP_QUIET(frag->drivestr, drivestr) < 0 ||
+        VIR_STRDUP_QUIET(frag->devstr, devstr) < 0 ||
+        virHashAddEntry(qemuDiskFragmentCache, key, frag) < 0)
+        goto error;
+    frag = NULL;
+
+ cleanup:
+    virMutexUnlock(&qemuDiskFragmentCacheLock);
+    return;
+
+ error:
+    if (frag)
+        qemuDiskFragmentFree(frag, NULL);
+    goto cleanup;
+}
+
+
 static int
 qemuBuildDiskDriveCommandLine(virCommandPtr cmd,
                               const virDomainDef *def,
@@ -2110,7 +2256,9 @@ qemuBuildDiskDriveCommandLine(virCommandPtr cmd,
     }
 
     for (i = 0; i < def->ndisks; i++) {
-        char *optstr;
+        char *optstr = NULL;
+        char *devstr = NULL;
+        char *cacheKey = NULL;
         unsigned int bootindex = 0;
         bool driveBoot = false;
         virDomainDiskDefPtr disk = def->disks[i];
@@ -2156,15 +2304,26 @@ qemuBuildDiskDriveCommandLine(virCommandPtr cmd,
         if (qemuBuildDiskSecinfoCommandLine(cmd, encinfo) < 0)
             return -1;
 
+        /* The FDC fragments are split between -global and the fdc_opts
+         * buffer depending on the machine type, so leave them out of
+         * the cache rather than model that */
+        if (disk->bus != VIR_DOMAIN_DISK_BUS_FDC &&
+            (cacheKey = qemuDiskFragmentCacheKey(def, disk, driveBoot,
+                                                 bootindex, qemuCaps)))
+            qemuDiskFragmentCacheLookup(cacheKey, &optstr, &devstr);
+
         virCommandAddArg(cmd, "-drive");
 
-        if (!(optstr = qemuBuildDriveStr(disk, driveBoot, qemuCaps)))
+        if (!optstr &&
+            !(optstr = qemuBuildDriveStr(disk, driveBoot, qemuCaps))) {
+            VIR_FREE(cacheKey);
             return -1;
+        }
         virCommandAddArg(cmd, optstr);
-        VIR_FREE(optstr);
 
         if (qemuDiskBusNeedsDeviceArg(disk->bus)) {
             if (disk->bus == VIR_DOMAIN_DISK_BUS_FDC) {
+                VIR_FREE(optstr);
                 if (virAsprintf(&optstr, "drive%c=drive-%s",
                                 disk->info.addr.drive.unit ? 'B' : 'A',
                                 disk->info.alias) < 0)
@@ -2196,13 +2355,22 @@ qemuBuildDiskDriveCommandLine(virCommandPtr cmd,
             } else {
                 virCommandAddArg(cmd, "-device");
 
-                if (!(optstr = qemuBuildDriveDevStr(def, disk, bootindex,
-                                                    qemuCaps)))
+                if (!devstr &&
+                    !(devstr = qemuBuildDriveDevStr(def, disk, bootindex,
+                                                    qemuCaps))) {
+                    VIR_FREE(optstr);
+                    VIR_FREE(cacheKey);
                     return -1;
-                virCommandAddArg(cmd, optstr);
-                VIR_FREE(optstr);
+                }
+                virCommandAddArg(cmd, devstr);
             }
         }
+
+        if (cacheKey)
+            qemuDiskFragmentCacheStore(cacheKey, optstr, devstr);
+        VIR_FREE(cacheKey);
+        VIR_FREE(optstr);
+        VIR_FREE(devstr);
     }
     /* Newer Q35 machine types require an explicit FDC controller */
     virBufferTrim(&fdc_opts, ",", -1);
@@ -74,6 +74,14 @@ VIR_LOG_INIT("qemu.qemu_conf");
 #define QEMU_MIGRATION_PORT_MIN 49152
 #define QEMU_MIGRATION_PORT_MAX 49215
 
+/* Default chunk size for copying tunnelled migration data between the
+ * QEMU pipe and the stream to the destination */
+#define QEMU_MIGRATION_TUNNEL_BUF_SIZE (1024 * 1024)
+/* Keep the configured chunk comfortably below the 16MB RPC message
+ * limit so a full chunk always fits in a single stream packet */
+#define QEMU_MIGRATION_TUNNEL_BUF_MIN (64 * 1024)
+#define QEMU_MIGRATION_TUNNEL_BUF_MAX (8 * 1024 * 1024)
+
 static virClassPtr virQEMUDriverConfigClass;
 static void virQEMUDriverConfigDispose(void *obj);
 
@@ -94,14 +102,19 @@ VIR_ONCE_GLOBAL_INIT(virQEMUConfig)
 
 
 static void
-qemuDriverLock(virQEMUDriverPtr driver)
+qemuDriverLockRead(virQEMUDriverPtr driver)
 {
-    virMutexLock(&driver->lock);
+    virRWLockRead(&driver->lock);
+}
+static void
+qemuDriverLockWrite(virQEMUDriverPtr driver)
+{
+    virRWLockWrite(&driver->lock);
 }
 static void
 qemuDriverUnlock(virQEMUDriverPtr driver)
 {
-    virMutexUnlock(&driver->lock);
+    virRWLockUnlock(&driver->lock);
 }
 
 void qemuDomainCmdlineDefFree(qemuDomainCmdlineDefPtr def)
@@ -261,6 +274,8 @@ virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged)
     cfg->migrationPortMin = QEMU_MIGRATION_PORT_MIN;
     cfg->migrationPortMax = QEMU_MIGRATION_PORT_MAX;
 
+    cfg->migrationTunnelBufferSize = QEMU_MIGRATION_TUNNEL_BUF_SIZE;
+
     /* For privileged driver, try and find hugetlbfs mounts automatically.
      * Non-privileged driver requires admin to create a dir for the
      * user, chown it, and then let user configure it manually. */
@@ -551,6 +566,19 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
         goto cleanup;
     }
 
+    if (virConfGetValueUInt(conf, "migration_tunnel_buffer_size",
+                            &cfg->migrationTunnelBufferSize) < 0)
+        goto cleanup;
+    if (cfg->migrationTunnelBufferSize < QEMU_MIGRATION_TUNNEL_BUF_MIN ||
+        cfg->migrationTunnelBufferSize > QEMU_MIGRATION_TUNNEL_BUF_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("%s: migration_tunnel_buffer_size: size must be "
+                         "between %d and %d"),
+                       filename, QEMU_MIGRATION_TUNNEL_BUF_MIN,
+                       QEMU_MIGRATION_TUNNEL_BUF_MAX);
+        goto cleanup;
+    }
+
     if (virConfGetValueString(conf, "user", &user) < 0)
         goto cleanup;
     if (user && virGetUserID(user, &cfg->user) < 0)
@@ -749,7 +777,7 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
 virQEMUDriverConfigPtr virQEMUDriverGetConfig(virQEMUDriverPtr driver)
 {
     virQEMUDriverConfigPtr conf;
-    qemuDriverLock(driver);
+    qemuDriverLockRead(driver);
     conf = virObjectRef(driver->config);
     qemuDriverUnlock(driver);
     return conf;
@@ -856,11 +884,11 @@ virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
         if ((caps = virQEMUDriverCreateCapabilities(driver)) == NULL)
             return NULL;
 
-        qemuDriverLock(driver);
+        qemuDriverLockWrite(driver);
         virObjectUnref(driver->caps);
         driver->caps = caps;
     } else {
-        qemuDriverLock(driver);
+        qemuDriverLockRead(driver);
     }
 
     if (driver->caps->nguests == 0 && !refresh) {
@@ -1098,7 +1126,7 @@ qemuAddSharedDisk(virQEMUDriverPtr driver,
         !virStorageSourceIsBlockLocal(disk->src))
         return 0;
 
-    qemuDriverLock(driver);
+    qemuDriverLockWrite(driver);
 
     if (qemuCheckSharedDisk(driver->sharedDevices, disk) < 0)
         goto cleanup;
@@ -1170,7 +1198,7 @@ qemuAddSharedHostdev(virQEMUDriverPtr driver,
     if (!(key = qemuGetSharedDeviceKey(dev_path)))
         goto cleanup;
 
-    qemuDriverLock(driver);
+    qemuDriverLockWrite(driver);
     ret = qemuSharedDeviceEntryInsert(driver, key, name);
     qemuDriverUnlock(driver);
 
@@ -1245,7 +1273,7 @@ qemuRemoveSharedDisk(virQEMUDriverPtr driver,
         !virStorageSourceIsBlockLocal(disk->src))
         return 0;
 
-    qemuDriverLock(driver);
+    qemuDriverLockWrite(driver);
 
     if (!(key = qemuGetSharedDeviceKey(virDomainDiskGetSource(disk))))
         goto cleanup;
@@ -1279,7 +1307,7 @@ qemuRemoveSharedHostdev(virQEMUDriverPtr driver,
     if (!(key = qemuGetSharedDeviceKey(dev_path)))
         goto cleanup;
 
-    qemuDriverLock(driver);
+    qemuDriverLockWrite(driver);
     ret = qemuSharedDeviceEntryRemove(driver, key, name);
     qemuDriverUnlock(driver);
 
@@ -73,7 +73,7 @@ typedef virQEMUDriverConfig *virQEMUDriverConfigPtr;
  * being released while they use it.
  *
  * eg
- *  qemuDriverLock(driver);
+ *  qemuDriverLockRead(driver);
  *  virQEMUDriverConfigPtr cfg = virObjectRef(driver->config);
  *  qemuDriverUnlock(driver);
  *
@@ -177,6 +177,7 @@ struct _virQEMUDriverConfig {
     char *migrationAddress;
     unsigned int migrationPortMin;
     unsigned int migrationPortMax;
+    unsigned int migrationTunnelBufferSize;
 
     bool logTimestamp;
     bool stdioLogD;
@@ -187,7 +188,10 @@ struct _virQEMUDriverConfig {
 
 /* Main driver state */
 struct _virQEMUDriver {
-    virMutex lock;
+    /* Read-write lock; the hot read-mostly accessors (config,
+     * capabilities) only need the read side, so concurrent API
+     * calls don't serialize on a single mutex */
+    virRWLock lock;
 
     /* Require lock to get reference on 'config',
      * then lockless thereafter */
@@ -196,6 +200,9 @@ struct _virQEMUDriver {
     /* Immutable pointer, self-locking APIs */
     virThreadPoolPtr workerPool;
 
+    /* Immutable after qemuStateInitialize; -1 when unregistered */
+    int statsPollTimer;
+
     /* Atomic increment only */
     int lastvmid;
 
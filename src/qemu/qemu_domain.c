@@ -41,10 +41,12 @@
 #include "domain_addr.h"
 #include "domain_event.h"
 #include "virtime.h"
+#include "virtypedparam.h"
 #include "virstoragefile.h"
 #include "virstring.h"
 #include "virthreadjob.h"
 #include "viratomic.h"
+#include "virmetrics.h"
 #include "virprocess.h"
 #include "vircrypto.h"
 #include "secret_util.h"
@@ -203,6 +205,7 @@ qemuDomainObjResetJob(qemuDomainObjPrivatePtr priv)
     job->owner = 0;
     job->ownerAPI = NULL;
     job->started = 0;
+    job->queryHolders = 0;
 }
 
 static void
@@ -424,6 +427,12 @@ qemuDomainJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
                                 stats->ram_iteration) < 0)
         goto error;
 
+    if (stats->ram_postcopy_reqs &&
+        virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                VIR_DOMAIN_JOB_MEMORY_POSTCOPY_REQS,
+                                stats->ram_postcopy_reqs) < 0)
+        goto error;
+
     if (virTypedParamsAddULLong(&par, &npar, &maxpar,
                                 VIR_DOMAIN_JOB_DISK_TOTAL,
                                 stats->disk_total) < 0 ||
@@ -665,6 +674,136 @@ qemuDomainMasterKeyRemove(qemuDomainObjPrivatePtr priv)
 }
 
 
+/* qemuDomainStatsCacheStore:
+ * @vm: locked domain object
+ * @params: freshly collected bulk stats
+ * @nparams: number of typed parameters in @params
+ * @groups: bitmap of VIR_DOMAIN_STATS_* groups @params covers
+ *
+ * Replaces the cached bulk stats of @vm with a copy of @params so
+ * that subsequent NOWAIT queries can be served without querying the
+ * monitor.
+ *
+ * Returns 0 on success, -1 on failure (the old cache is dropped).
+ */
+int
+qemuDomainStatsCacheStore(virDomainObjPtr vm,
+                          virTypedParameterPtr params,
+                          int nparams,
+                          unsigned int groups)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    unsigned long long now;
+
+    virTypedParamsFree(priv->statsParams, priv->statsNParams);
+    priv->statsParams = NULL;
+    priv->statsNParams = 0;
+    priv->statsGroups = 0;
+    priv->statsUpdated = 0;
+
+    if (virTypedParamsCopy(&priv->statsParams, params, nparams) < 0)
+        return -1;
+
+    if (virTimeMillisNow(&now) < 0) {
+        virTypedParamsFree(priv->statsParams, nparams);
+        priv->statsParams = NULL;
+        return -1;
+    }
+
+    priv->statsNParams = nparams;
+    priv->statsGroups = groups;
+    priv->statsUpdated = now;
+    return 0;
+}
+
+
+/* qemuDomainStatsCacheInvalidate:
+ * @vm: locked domain object
+ *
+ * Marks the cached bulk stats of @vm as stale, typically because a
+ * guest event changed some of the values they contain. The cache is
+ * kept around until refreshed so NOWAIT queries degrade to slightly
+ * outdated data rather than none at all.
+ */
+void
+qemuDomainStatsCacheInvalidate(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    priv->statsUpdated = 0;
+}
+
+
+/* qemuDomainXMLCacheInvalidate:
+ * @vm: locked domain object
+ *
+ * Drops the formatted XML remembered from the last GetXMLDesc call.
+ * Called whenever a modifying job ends or a guest event touches the
+ * definition, since the cached string may no longer match it.
+ */
+void
+qemuDomainXMLCacheInvalidate(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    VIR_FREE(priv->xmlDescCache);
+}
+
+
+/* qemuDomainBlockJobInfoCacheInvalidate:
+ * @vm: locked domain object
+ *
+ * Drops the query-block-jobs data remembered from the last
+ * GetBlockJobInfo call. Called whenever a block job event arrives or
+ * a job control API changes what the next poll should report.
+ */
+void
+qemuDomainBlockJobInfoCacheInvalidate(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    virHashFree(priv->blockJobInfoCache);
+    priv->blockJobInfoCache = NULL;
+    priv->blockJobInfoUpdated = 0;
+}
+
+
+/* qemuDomainBlockStatsCacheInvalidate:
+ * @vm: locked domain object
+ *
+ * Drops the query-blockstats data remembered from the last block
+ * statistics query. Called whenever hotplug or a block job changes
+ * which device an alias refers to.
+ */
+void
+qemuDomainBlockStatsCacheInvalidate(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    virHashFree(priv->blockStatsCache);
+    priv->blockStatsCache = NULL;
+    priv->blockStatsCacheNStats = 0;
+    priv->blockStatsUpdated = 0;
+}
+
+
+/* qemuDomainMemoryStatsCacheInvalidate:
+ * @vm: locked domain object
+ *
+ * Drops the balloon memory stats remembered from the last query.
+ * Called whenever a balloon event arrives or the stats period is
+ * reprogrammed.
+ */
+void
+qemuDomainMemoryStatsCacheInvalidate(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    priv->memStatsCacheNStats = 0;
+    priv->memStatsUpdated = 0;
+}
+
+
 /* qemuDomainMasterKeyCreate:
  * @vm: Pointer to the domain object
  *
@@ -1312,7 +1451,7 @@ qemuDomainObjPrivateAlloc(void)
         goto error;
     }
 
-    if (!(priv->devs = virChrdevAlloc()))
+    if (!(priv->devs = virChrdevAlloc(0)))
         goto error;
 
     priv->migMaxBandwidth = QEMU_DOMAIN_MIG_BANDWIDTH_MAX;
@@ -1359,6 +1498,11 @@ qemuDomainObjPrivateFree(void *data)
     VIR_FREE(priv->channelTargetDir);
     qemuDomainMasterKeyFree(priv);
 
+    virTypedParamsFree(priv->statsParams, priv->statsNParams);
+    VIR_FREE(priv->xmlDescCache);
+    virHashFree(priv->blockJobInfoCache);
+    virHashFree(priv->blockStatsCache);
+
     VIR_FREE(priv);
 }
 
@@ -2892,6 +3036,7 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     qemuDomainObjPrivatePtr priv = obj->privateData;
     unsigned long long now;
     unsigned long long then;
+    unsigned long long waitStart;
     bool nested = job == QEMU_JOB_ASYNC_NESTED;
     bool async = job == QEMU_JOB_ASYNC;
     virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
@@ -2917,6 +3062,7 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     }
 
     priv->jobs_queued++;
+    waitStart = now;
     then = now + QEMU_JOB_WAIT_TIME;
 
  retry:
@@ -2932,6 +3078,12 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     }
 
     while (priv->job.active) {
+        /* Query jobs don't change the VM state and only talk to the
+         * monitor, which has its own lock; let them share a slot rather
+         * than queue behind each other */
+        if (job == QEMU_JOB_QUERY &&
+            priv->job.active == QEMU_JOB_QUERY)
+            break;
         VIR_DEBUG("Waiting for job (vm=%p name=%s)", obj, obj->def->name);
         if (virCondWaitUntil(&priv->job.cond, &obj->parent.lock, then) < 0)
             goto error;
@@ -2942,9 +3094,19 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     if (!nested && !qemuDomainNestedJobAllowed(priv, job))
         goto retry;
 
+    if (job == QEMU_JOB_QUERY &&
+        priv->job.active == QEMU_JOB_QUERY) {
+        priv->job.queryHolders++;
+        VIR_DEBUG("Joined shared query job (holders=%d vm=%p name=%s)",
+                  priv->job.queryHolders, obj, obj->def->name);
+        virObjectUnref(cfg);
+        return 0;
+    }
+
     qemuDomainObjResetJob(priv);
 
     ignore_value(virTimeMillisNow(&now));
+    virMetricsRecord(VIR_METRICS_QEMU_JOB_WAIT, now - waitStart);
 
     if (job != QEMU_JOB_ASYNC) {
         VIR_DEBUG("Started job: %s (async=%s vm=%p name=%s)",
@@ -2955,6 +3117,8 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
         priv->job.owner = virThreadSelfID();
         priv->job.ownerAPI = virThreadJobGet();
         priv->job.started = now;
+        if (job == QEMU_JOB_QUERY)
+            priv->job.queryHolders = 1;
     } else {
         VIR_DEBUG("Started async job: %s (vm=%p name=%s)",
                   qemuDomainAsyncJobTypeToString(asyncJob),
@@ -3106,6 +3270,16 @@ qemuDomainObjEndJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
               qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
               obj, obj->def->name);
 
+    if (job == QEMU_JOB_QUERY &&
+        --priv->job.queryHolders > 0) {
+        VIR_DEBUG("Query job still shared by %d threads (vm=%p name=%s)",
+                  priv->job.queryHolders, obj, obj->def->name);
+        return;
+    }
+
+    if (job != QEMU_JOB_QUERY)
+        qemuDomainXMLCacheInvalidate(obj);
+
     qemuDomainObjResetJob(priv);
     if (qemuDomainTrackJob(job))
         qemuDomainObjSaveJob(driver, obj);
@@ -3123,6 +3297,7 @@ qemuDomainObjEndAsyncJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
               qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
               obj, obj->def->name);
 
+    qemuDomainXMLCacheInvalidate(obj);
     qemuDomainObjResetAsyncJob(priv);
     qemuDomainObjSaveJob(driver, obj);
     virCondBroadcast(&priv->job.asyncCond);
@@ -5511,7 +5686,11 @@ qemuDomainUpdateCurrentMemorySize(virQEMUDriverPtr driver,
     /* if no balloning is available, the current size equals to the current
      * full memory size */
     if (!virDomainDefHasMemballoon(vm->def)) {
-        vm->def->mem.cur_balloon = virDomainDefGetMemoryTotal(vm->def);
+        balloon = virDomainDefGetMemoryTotal(vm->def);
+        if (balloon != vm->def->mem.cur_balloon) {
+            vm->def->mem.cur_balloon = balloon;
+            qemuDomainXMLCacheInvalidate(vm);
+        }
         return 0;
     }
 
@@ -5544,7 +5723,10 @@ qemuDomainUpdateCurrentMemorySize(virQEMUDriverPtr driver,
         if (ret < 0)
             return -1;
 
-        vm->def->mem.cur_balloon = balloon;
+        if (balloon != vm->def->mem.cur_balloon) {
+            vm->def->mem.cur_balloon = balloon;
+            qemuDomainXMLCacheInvalidate(vm);
+        }
     }
 
     return 0;
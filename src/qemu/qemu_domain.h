@@ -127,6 +127,8 @@ struct qemuDomainJobObj {
     unsigned long long owner;           /* Thread id which set current job */
     const char *ownerAPI;               /* The API which owns the job */
     unsigned long long started;         /* When the current job started */
+    int queryHolders;                   /* Number of threads sharing an
+                                         * active QEMU_JOB_QUERY job */
 
     virCond asyncCond;                  /* Use to coordinate with async jobs */
     qemuDomainAsyncJob asyncJob;        /* Currently active async job */
@@ -232,6 +234,42 @@ struct _qemuDomainObjPrivate {
     /* private XML) - need to restore at process reconnect */
     uint8_t *masterKey;
     size_t masterKeyLen;
+
+    /* Cached bulk stats, served to NOWAIT queries and kept fresh by
+     * the background poller and guest events; statsUpdated is zeroed
+     * whenever an event makes the cached values suspect */
+    virTypedParameterPtr statsParams;
+    int statsNParams;
+    unsigned int statsGroups;        /* VIR_DOMAIN_STATS_* covered */
+    unsigned long long statsUpdated; /* ms timestamp of last refresh */
+
+    /* Cached query-block-jobs result, keyed by device alias, so
+     * clients polling job progress do not each cost a monitor
+     * roundtrip; dropped whenever a block job event or a job control
+     * API makes the values suspect */
+    virHashTablePtr blockJobInfoCache;
+    unsigned long long blockJobInfoUpdated; /* ms timestamp of last refresh */
+
+    /* Cached query-blockstats result, keyed by device alias, so a
+     * sweep reading every disk's stats costs one monitor command;
+     * dropped whenever hotplug or a block job changes the set of
+     * devices the aliases describe */
+    virHashTablePtr blockStatsCache;
+    int blockStatsCacheNStats;
+    unsigned long long blockStatsUpdated; /* ms timestamp of last refresh */
+
+    /* Cached balloon memory stats. The guest refreshes them only once
+     * per stats period anyway, so queries arriving faster than that
+     * are served from here instead of the monitor; dropped on balloon
+     * events and period changes */
+    virDomainMemoryStatStruct memStatsCache[VIR_DOMAIN_MEMORY_STAT_NR];
+    int memStatsCacheNStats;
+    unsigned long long memStatsUpdated; /* ms timestamp of last refresh */
+
+    /* Formatted domain XML as last handed out by GetXMLDesc, dropped
+     * whenever a job or guest event may have changed the definition */
+    char *xmlDescCache;
+    unsigned int xmlDescCacheFlags;
 };
 
 /* Type of domain secret */
@@ -357,6 +395,7 @@ typedef enum {
     QEMU_PROCESS_EVENT_SERIAL_CHANGED,
     QEMU_PROCESS_EVENT_BLOCK_JOB,
     QEMU_PROCESS_EVENT_MONITOR_EOF,
+    QEMU_PROCESS_EVENT_REFRESH_STATS,
 
     QEMU_PROCESS_EVENT_LAST
 } qemuProcessEventType;
@@ -690,6 +729,21 @@ int qemuDomainMasterKeyCreate(virDomainObjPtr vm);
 
 void qemuDomainMasterKeyRemove(qemuDomainObjPrivatePtr priv);
 
+int qemuDomainStatsCacheStore(virDomainObjPtr vm,
+                              virTypedParameterPtr params,
+                              int nparams,
+                              unsigned int groups);
+
+void qemuDomainStatsCacheInvalidate(virDomainObjPtr vm);
+
+void qemuDomainXMLCacheInvalidate(virDomainObjPtr vm);
+
+void qemuDomainBlockJobInfoCacheInvalidate(virDomainObjPtr vm);
+
+void qemuDomainBlockStatsCacheInvalidate(virDomainObjPtr vm);
+
+void qemuDomainMemoryStatsCacheInvalidate(virDomainObjPtr vm);
+
 void qemuDomainSecretDiskDestroy(virDomainDiskDefPtr disk)
     ATTRIBUTE_NONNULL(1);
 
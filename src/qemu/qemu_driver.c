@@ -53,6 +53,7 @@
 #include "qemu_cgroup.h"
 #include "qemu_hostdev.h"
 #include "qemu_hotplug.h"
+#include "qemu_interface.h"
 #include "qemu_monitor.h"
 #include "qemu_process.h"
 #include "qemu_migration.h"
@@ -124,6 +125,23 @@ VIR_LOG_INIT("qemu.qemu_driver");
 
 #define QEMU_GUEST_VCPU_MAX_ID 4096
 
+/* How often the background poller refreshes the per-domain stats
+ * caches, in seconds */
+#define QEMU_DOMAIN_STATS_POLL_INTERVAL 15
+
+/* How long a cached query-block-jobs result keeps serving
+ * virDomainGetBlockJobInfo polls, in ms */
+#define QEMU_BLOCK_JOB_INFO_CACHE_TTL 1000
+
+/* How long a cached query-blockstats result keeps serving block
+ * statistics queries, in ms */
+#define QEMU_BLOCK_STATS_CACHE_TTL 1000
+
+/* How long cached balloon memory stats keep serving queries when the
+ * domain has no stats period programmed, in ms; with a period set the
+ * period itself bounds the cache lifetime */
+#define QEMU_MEMORY_STATS_CACHE_TTL 1000
+
 #define QEMU_NB_BLKIO_PARAM  6
 
 #define QEMU_NB_BANDWIDTH_PARAM 7
@@ -138,6 +156,11 @@ static void processGuestPanicEvent(virQEMUDriverPtr driver,
 
 static void qemuProcessEventHandler(void *data, void *opaque);
 
+static void processRefreshStatsEvent(virQEMUDriverPtr driver,
+                                     virDomainObjPtr vm);
+
+static void qemuDomainStatsPollTimer(int timer, void *opaque);
+
 static int qemuStateCleanup(void);
 
 static int qemuDomainObjStart(virConnectPtr conn,
@@ -447,6 +470,73 @@ qemuSecurityInit(virQEMUDriverPtr driver)
 }
 
 
+/* Cap on the threads parsing snapshot metadata concurrently in
+ * qemuDomainSnapshotLoad; snapshot-heavy domains easily carry
+ * hundreds of metadata files */
+#define QEMU_SNAPSHOT_LOAD_MAX_WORKERS 16
+
+struct qemuDomainSnapshotLoadEntry {
+    char *fullpath;
+    virDomainSnapshotDefPtr def;
+};
+
+struct qemuDomainSnapshotLoadData {
+    virCapsPtr caps;
+    unsigned int flags;
+    struct qemuDomainSnapshotLoadEntry *entries;
+    size_t nentries;
+    size_t nworkers;
+};
+
+struct qemuDomainSnapshotLoadWorker {
+    virThread thread;
+    bool started;
+    size_t first;               /* first entry index; stride is nworkers */
+    struct qemuDomainSnapshotLoadData *data;
+};
+
+
+/* Read and parse the snapshot files first, first + nworkers, ...
+ * Each entry is touched by exactly one worker, so the parsed
+ * definitions need no locking until they are assigned to the domain */
+static void
+qemuDomainSnapshotLoadWorker(void *opaque)
+{
+    struct qemuDomainSnapshotLoadWorker *worker = opaque;
+    struct qemuDomainSnapshotLoadData *data = worker->data;
+    size_t i;
+
+    for (i = worker->first; i < data->nentries; i += data->nworkers) {
+        struct qemuDomainSnapshotLoadEntry *entry = &data->entries[i];
+        char *xmlStr;
+
+        /* NB: ignoring errors, so one malformed config doesn't
+           kill the whole process */
+        VIR_INFO("Loading snapshot file '%s'", entry->fullpath);
+
+        if (virFileReadAll(entry->fullpath, 1024*1024*1, &xmlStr) < 0) {
+            /* Nothing we can do here, skip this one */
+            virReportSystemError(errno,
+                                 _("Failed to read snapshot file %s"),
+                                 entry->fullpath);
+            continue;
+        }
+
+        entry->def = virDomainSnapshotDefParseString(xmlStr, data->caps,
+                                                     qemu_driver->xmlopt,
+                                                     data->flags);
+        if (entry->def == NULL) {
+            /* Nothing we can do here, skip this one */
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to parse snapshot XML from file '%s'"),
+                           entry->fullpath);
+        }
+
+        VIR_FREE(xmlStr);
+    }
+}
+
+
 static int
 qemuDomainSnapshotLoad(virDomainObjPtr vm,
                        void *data)
@@ -455,18 +545,20 @@ qemuDomainSnapshotLoad(virDomainObjPtr vm,
     char *snapDir = NULL;
     DIR *dir = NULL;
     struct dirent *entry;
-    char *xmlStr;
-    char *fullpath;
-    virDomainSnapshotDefPtr def = NULL;
     virDomainSnapshotObjPtr snap = NULL;
     virDomainSnapshotObjPtr current = NULL;
-    unsigned int flags = (VIR_DOMAIN_SNAPSHOT_PARSE_REDEFINE |
-                          VIR_DOMAIN_SNAPSHOT_PARSE_DISKS |
-                          VIR_DOMAIN_SNAPSHOT_PARSE_INTERNAL);
+    struct qemuDomainSnapshotLoadData load = { NULL, 0, NULL, 0, 0 };
+    struct qemuDomainSnapshotLoadWorker *workers = NULL;
+    long ncpus;
+    size_t i;
     int ret = -1;
     virCapsPtr caps = NULL;
     int direrr;
 
+    load.flags = (VIR_DOMAIN_SNAPSHOT_PARSE_REDEFINE |
+                  VIR_DOMAIN_SNAPSHOT_PARSE_DISKS |
+                  VIR_DOMAIN_SNAPSHOT_PARSE_INTERNAL);
+
     virObjectLock(vm);
     if (virAsprintf(&snapDir, "%s/%s", baseDir, vm->def->name) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -478,6 +570,7 @@ qemuDomainSnapshotLoad(virDomainObjPtr vm,
 
     if (!(caps = virQEMUDriverGetCapabilities(qemu_driver, false)))
         goto cleanup;
+    load.caps = caps;
 
     VIR_INFO("Scanning for snapshots for domain %s in %s", vm->def->name,
              snapDir);
@@ -485,55 +578,67 @@ qemuDomainSnapshotLoad(virDomainObjPtr vm,
     if (virDirOpenIfExists(&dir, snapDir) <= 0)
         goto cleanup;
 
+    /* Batch the directory scan up front so the metadata files can be
+     * read and parsed in parallel */
     while ((direrr = virDirRead(dir, &entry, NULL)) > 0) {
-        /* NB: ignoring errors, so one malformed config doesn't
-           kill the whole process */
-        VIR_INFO("Loading snapshot file '%s'", entry->d_name);
+        struct qemuDomainSnapshotLoadEntry e = { NULL, NULL };
 
-        if (virAsprintf(&fullpath, "%s/%s", snapDir, entry->d_name) < 0) {
+        if (virAsprintf(&e.fullpath, "%s/%s", snapDir, entry->d_name) < 0 ||
+            VIR_APPEND_ELEMENT(load.entries, load.nentries, e) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("Failed to allocate memory for path"));
+            VIR_FREE(e.fullpath);
             continue;
         }
+    }
+    if (direrr < 0)
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Failed to fully read directory %s"),
+                       snapDir);
 
-        if (virFileReadAll(fullpath, 1024*1024*1, &xmlStr) < 0) {
-            /* Nothing we can do here, skip this one */
-            virReportSystemError(errno,
-                                 _("Failed to read snapshot file %s"),
-                                 fullpath);
-            VIR_FREE(fullpath);
-            continue;
+    if (load.nentries) {
+        load.nworkers = load.nentries;
+        if ((ncpus = sysconf(_SC_NPROCESSORS_ONLN)) > 0 &&
+            (size_t) ncpus < load.nworkers)
+            load.nworkers = ncpus;
+        if (load.nworkers > QEMU_SNAPSHOT_LOAD_MAX_WORKERS)
+            load.nworkers = QEMU_SNAPSHOT_LOAD_MAX_WORKERS;
+
+        if (VIR_ALLOC_N(workers, load.nworkers) < 0)
+            goto cleanup;
+
+        for (i = 0; i < load.nworkers; i++) {
+            workers[i].first = i;
+            workers[i].data = &load;
+            workers[i].started =
+                virThreadCreate(&workers[i].thread, true,
+                                qemuDomainSnapshotLoadWorker,
+                                &workers[i]) == 0;
         }
 
-        def = virDomainSnapshotDefParseString(xmlStr, caps,
-                                              qemu_driver->xmlopt,
-                                              flags);
-        if (def == NULL) {
-            /* Nothing we can do here, skip this one */
-            virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("Failed to parse snapshot XML from file '%s'"),
-                           fullpath);
-            VIR_FREE(fullpath);
-            VIR_FREE(xmlStr);
-            continue;
+        for (i = 0; i < load.nworkers; i++) {
+            if (workers[i].started)
+                virThreadJoin(&workers[i].thread);
+            else /* thread creation failed; parse the share inline */
+                qemuDomainSnapshotLoadWorker(&workers[i]);
         }
+    }
+
+    for (i = 0; i < load.nentries; i++) {
+        if (!load.entries[i].def)
+            continue;
 
-        snap = virDomainSnapshotAssignDef(vm->snapshots, def);
+        snap = virDomainSnapshotAssignDef(vm->snapshots,
+                                          load.entries[i].def);
         if (snap == NULL) {
-            virDomainSnapshotDefFree(def);
+            virDomainSnapshotDefFree(load.entries[i].def);
         } else if (snap->def->current) {
             current = snap;
             if (!vm->current_snapshot)
                 vm->current_snapshot = snap;
         }
-
-        VIR_FREE(fullpath);
-        VIR_FREE(xmlStr);
+        load.entries[i].def = NULL;
     }
-    if (direrr < 0)
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Failed to fully read directory %s"),
-                       snapDir);
 
     if (vm->current_snapshot != current) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -560,6 +665,12 @@ qemuDomainSnapshotLoad(virDomainObjPtr vm,
 
     ret = 0;
  cleanup:
+    for (i = 0; i < load.nentries; i++) {
+        VIR_FREE(load.entries[i].fullpath);
+        virDomainSnapshotDefFree(load.entries[i].def);
+    }
+    VIR_FREE(load.entries);
+    VIR_FREE(workers);
     VIR_DIR_CLOSE(dir);
     VIR_FREE(snapDir);
     virObjectUnref(caps);
@@ -631,9 +742,9 @@ qemuStateInitialize(bool privileged,
     if (VIR_ALLOC(qemu_driver) < 0)
         return -1;
 
-    if (virMutexInit(&qemu_driver->lock) < 0) {
+    if (virRWLockInit(&qemu_driver->lock) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("cannot initialize mutex"));
+                       _("cannot initialize driver lock"));
         VIR_FREE(qemu_driver);
         return -1;
     }
@@ -641,6 +752,8 @@ qemuStateInitialize(bool privileged,
     qemu_driver->inhibitCallback = callback;
     qemu_driver->inhibitOpaque = opaque;
 
+    qemu_driver->statsPollTimer = -1;
+
     qemu_driver->privileged = privileged;
 
     if (!(qemu_driver->domains = virDomainObjListNew()))
@@ -926,6 +1039,14 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->workerPool)
         goto error;
 
+    /* Keep the per-domain stats caches warm; not having the timer
+     * only means NOWAIT stats queries may serve older data */
+    if ((qemu_driver->statsPollTimer =
+         virEventAddTimeout(QEMU_DOMAIN_STATS_POLL_INTERVAL * 1000,
+                            qemuDomainStatsPollTimer,
+                            qemu_driver, NULL)) < 0)
+        VIR_DEBUG("Failed to register the stats poll timer");
+
     virObjectUnref(conn);
 
     virNWFilterRegisterCallbackDriver(&qemuCallbackDriver);
@@ -1069,6 +1190,8 @@ qemuStateCleanup(void)
         return -1;
 
     virNWFilterUnRegisterCallbackDriver(&qemuCallbackDriver);
+    if (qemu_driver->statsPollTimer != -1)
+        virEventRemoveTimeout(qemu_driver->statsPollTimer);
     virObjectUnref(qemu_driver->config);
     virObjectUnref(qemu_driver->hostdevMgr);
     virHashFree(qemu_driver->sharedDevices);
@@ -1093,12 +1216,14 @@ qemuStateCleanup(void)
 
     ebtablesContextFree(qemu_driver->ebtables);
 
+    qemuInterfacePoolShutdown();
+
     /* Free domain callback list */
     virObjectEventStateFree(qemu_driver->domainEventState);
 
     virLockManagerPluginUnref(qemu_driver->lockManager);
 
-    virMutexDestroy(&qemu_driver->lock);
+    virRWLockDestroy(&qemu_driver->lock);
     virThreadPoolFree(qemu_driver->workerPool);
     VIR_FREE(qemu_driver);
 
@@ -1387,67 +1512,6 @@ qemuGetSchedInfo(unsigned long long *cpuWait,
 }
 
 
-static int
-qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
-                   pid_t pid, int tid)
-{
-    char *proc;
-    FILE *pidinfo;
-    unsigned long long usertime = 0, systime = 0;
-    long rss = 0;
-    int cpu = 0;
-    int ret;
-
-    /* In general, we cannot assume pid_t fits in int; but /proc parsing
-     * is specific to Linux where int works fine.  */
-    if (tid)
-        ret = virAsprintf(&proc, "/proc/%d/task/%d/stat", (int) pid, tid);
-    else
-        ret = virAsprintf(&proc, "/proc/%d/stat", (int) pid);
-    if (ret < 0)
-        return -1;
-
-    pidinfo = fopen(proc, "r");
-    VIR_FREE(proc);
-
-    /* See 'man proc' for information about what all these fields are. We're
-     * only interested in a very few of them */
-    if (!pidinfo ||
-        fscanf(pidinfo,
-               /* pid -> stime */
-               "%*d (%*[^)]) %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu"
-               /* cutime -> endcode */
-               "%*d %*d %*d %*d %*d %*d %*u %*u %ld %*u %*u %*u"
-               /* startstack -> processor */
-               "%*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*d %d",
-               &usertime, &systime, &rss, &cpu) != 4) {
-        VIR_WARN("cannot parse process status data");
-    }
-
-    /* We got jiffies
-     * We want nanoseconds
-     * _SC_CLK_TCK is jiffies per second
-     * So calculate thus....
-     */
-    if (cpuTime)
-        *cpuTime = 1000ull * 1000ull * 1000ull * (usertime + systime)
-            / (unsigned long long)sysconf(_SC_CLK_TCK);
-    if (lastCpu)
-        *lastCpu = cpu;
-
-    if (vm_rss)
-        *vm_rss = rss * virGetSystemPageSizeKB();
-
-
-    VIR_DEBUG("Got status for %d/%d user=%llu sys=%llu cpu=%d rss=%ld",
-              (int) pid, tid, usertime, systime, cpu, rss);
-
-    VIR_FORCE_FCLOSE(pidinfo);
-
-    return 0;
-}
-
-
 static int
 qemuDomainHelperGetVcpus(virDomainObjPtr vm,
                          virVcpuInfoPtr info,
@@ -1456,8 +1520,11 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
                          unsigned char *cpumaps,
                          int maplen)
 {
+    virProcessTaskStatPtr taskstats = NULL;
+    size_t ntaskstats = 0;
     size_t ncpuinfo = 0;
     size_t i;
+    int ret = -1;
 
     if (maxinfo == 0)
         return 0;
@@ -1468,9 +1535,19 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
         return -1;
     }
 
-    if (info)
+    if (info) {
         memset(info, 0, sizeof(*info) * maxinfo);
 
+        /* Snapshot the stats of all of qemu's threads in one pass over
+         * its /proc task directory rather than re-opening a stat file
+         * per vCPU thread */
+        if (virProcessGetTaskStats(vm->pid, &taskstats, &ntaskstats) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("cannot get vCPU placement & pCPU time"));
+            return -1;
+        }
+    }
+
     if (cpumaps)
         memset(cpumaps, 0, sizeof(*cpumaps) * maxinfo);
 
@@ -1483,15 +1560,28 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
             continue;
 
         if (info) {
+            size_t j;
+
             vcpuinfo->number = i;
             vcpuinfo->state = VIR_VCPU_RUNNING;
 
-            if (qemuGetProcessInfo(&vcpuinfo->cpuTime,
-                                   &vcpuinfo->cpu, NULL,
-                                   vm->pid, vcpupid) < 0) {
+            for (j = 0; j < ntaskstats; j++) {
+                if (taskstats[j].tid == vcpupid) {
+                    vcpuinfo->cpuTime = taskstats[j].cpuTime;
+                    vcpuinfo->cpu = taskstats[j].lastCpu;
+                    break;
+                }
+            }
+
+            /* Fall back to a direct read for a thread the directory
+             * scan did not see */
+            if (j == ntaskstats &&
+                virProcessGetStatInfo(&vcpuinfo->cpuTime,
+                                      &vcpuinfo->cpu, NULL,
+                                      vm->pid, vcpupid) < 0) {
                 virReportSystemError(errno, "%s",
                                      _("cannot get vCPU placement & pCPU time"));
-                return -1;
+                goto cleanup;
             }
         }
 
@@ -1500,7 +1590,7 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
             virBitmapPtr map = NULL;
 
             if (!(map = virProcessGetAffinity(vcpupid)))
-                return -1;
+                goto cleanup;
 
             virBitmapToDataBuf(map, cpumap, maplen);
             virBitmapFree(map);
@@ -1508,13 +1598,17 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
 
         if (cpuwait) {
             if (qemuGetSchedInfo(&(cpuwait[ncpuinfo]), vm->pid, vcpupid) < 0)
-                return -1;
+                goto cleanup;
         }
 
         ncpuinfo++;
     }
 
-    return ncpuinfo;
+    ret = ncpuinfo;
+
+ cleanup:
+    VIR_FREE(taskstats);
+    return ret;
 }
 
 
@@ -2474,6 +2568,7 @@ static int qemuDomainSetMemoryStatsPeriod(virDomainPtr dom, int period,
         }
 
         def->memballoon->period = period;
+        qemuDomainMemoryStatsCacheInvalidate(vm);
         if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
             goto endjob;
     }
@@ -2554,24 +2649,11 @@ static int qemuDomainSendKey(virDomainPtr domain,
 
     virCheckFlags(0, -1);
 
-    /* translate the keycode to RFB for qemu driver */
-    if (codeset != VIR_KEYCODE_SET_RFB) {
-        size_t i;
-        int keycode;
-
-        for (i = 0; i < nkeycodes; i++) {
-            keycode = virKeycodeValueTranslate(codeset, VIR_KEYCODE_SET_RFB,
-                                               keycodes[i]);
-            if (keycode < 0) {
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("cannot translate keycode %u of %s codeset to rfb keycode"),
-                               keycodes[i],
-                               virKeycodeSetTypeToString(codeset));
-                return -1;
-            }
-            keycodes[i] = keycode;
-        }
-    }
+    /* translate the keycodes to RFB for qemu driver */
+    if (codeset != VIR_KEYCODE_SET_RFB &&
+        virKeycodeValueTranslateMany(codeset, VIR_KEYCODE_SET_RFB,
+                                     keycodes, nkeycodes) < 0)
+        return -1;
 
     if (!(vm = qemuDomObjFromDomain(domain)))
         goto cleanup;
@@ -2640,7 +2722,7 @@ qemuDomainGetInfo(virDomainPtr dom,
     }
 
     if (virDomainObjIsActive(vm)) {
-        if (qemuGetProcessInfo(&(info->cpuTime), NULL, NULL, vm->pid, 0) < 0) {
+        if (virProcessGetStatInfo(&(info->cpuTime), NULL, NULL, vm->pid, 0) < 0) {
             virReportError(VIR_ERR_OPERATION_FAILED, "%s",
                            _("cannot read cputime for domain"));
             goto cleanup;
@@ -2833,13 +2915,54 @@ qemuDomainSaveHeader(int fd, const char *path, const char *xml,
     return ret;
 }
 
+/* Return the name of a multithreaded implementation of the given
+ * compression format if one is installed, or NULL otherwise.  Both
+ * produce output the single threaded tool can read back and vice
+ * versa, so the image format recorded in the save header does not
+ * change.  */
+static const char *
+qemuCompressParallelProgram(int compress)
+{
+    const char *prog = NULL;
+    char *path;
+
+    switch ((virQEMUSaveFormat) compress) {
+    case QEMU_SAVE_FORMAT_GZIP:
+        prog = "pigz";
+        break;
+    case QEMU_SAVE_FORMAT_BZIP2:
+        prog = "pbzip2";
+        break;
+    case QEMU_SAVE_FORMAT_RAW:
+    case QEMU_SAVE_FORMAT_XZ:
+    case QEMU_SAVE_FORMAT_LZOP:
+    case QEMU_SAVE_FORMAT_LAST:
+        return NULL;
+    }
+
+    if (!(path = virFindFileInPath(prog)))
+        return NULL;
+
+    VIR_FREE(path);
+    return prog;
+}
+
 /* Given a virQEMUSaveFormat compression level, return the name
  * of the program to run, or NULL if no program is needed.  */
 static const char *
 qemuCompressProgramName(int compress)
 {
-    return (compress == QEMU_SAVE_FORMAT_RAW ? NULL :
-            qemuSaveCompressionTypeToString(compress));
+    const char *parallel;
+
+    if (compress == QEMU_SAVE_FORMAT_RAW)
+        return NULL;
+
+    /* Saving pushes the whole guest memory through one compressor, so
+     * spread it over all cores whenever a parallel tool is around */
+    if ((parallel = qemuCompressParallelProgram(compress)))
+        return parallel;
+
+    return qemuSaveCompressionTypeToString(compress);
 }
 
 static virCommandPtr
@@ -2847,6 +2970,7 @@ qemuCompressGetCommand(virQEMUSaveFormat compression)
 {
     virCommandPtr ret = NULL;
     const char *prog = qemuSaveCompressionTypeToString(compression);
+    const char *parallel;
 
     if (!prog) {
         virReportError(VIR_ERR_OPERATION_FAILED,
@@ -2855,6 +2979,11 @@ qemuCompressGetCommand(virQEMUSaveFormat compression)
         return NULL;
     }
 
+    /* pbzip2 only decompresses its own multi-stream files in parallel,
+     * which is exactly what the save side now produces */
+    if ((parallel = qemuCompressParallelProgram(compression)))
+        prog = parallel;
+
     ret = virCommandNew(prog);
     virCommandAddArg(ret, "-dc");
 
@@ -3484,11 +3613,66 @@ qemuDomainManagedSaveRemove(virDomainPtr dom, unsigned int flags)
     return ret;
 }
 
+/* Poll a detached dump-guest-memory for completion.  The monitor is
+ * only held for the duration of each query-dump call, so other APIs
+ * (including progress queries) stay responsive while QEMU writes the
+ * dump out. */
+static int
+qemuDumpWaitForCompletion(virQEMUDriverPtr driver,
+                          virDomainObjPtr vm,
+                          qemuDomainAsyncJob asyncJob)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainJobInfoPtr jobInfo = priv->job.current;
+    qemuMonitorDumpStats stats;
+    int rc;
+
+    if (jobInfo)
+        jobInfo->type = VIR_DOMAIN_JOB_UNBOUNDED;
+
+    for (;;) {
+        struct timespec ts = { .tv_sec = 0, .tv_nsec = 100 * 1000 * 1000ull };
+
+        if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
+            return -1;
+        rc = qemuMonitorQueryDump(priv->mon, &stats);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
+            return -1;
+
+        if (jobInfo) {
+            jobInfo->stats.ram_total = stats.total;
+            jobInfo->stats.ram_transferred = stats.completed;
+            jobInfo->stats.ram_remaining = stats.total - stats.completed;
+        }
+
+        if (stats.status == QEMU_MONITOR_DUMP_STATUS_COMPLETED)
+            return 0;
+
+        if (stats.status != QEMU_MONITOR_DUMP_STATUS_ACTIVE) {
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           _("memory-only dump failed in state '%s'"),
+                           NULLSTR(qemuMonitorDumpStatusTypeToString(stats.status)));
+            return -1;
+        }
+
+        virObjectUnlock(vm);
+        nanosleep(&ts, NULL);
+        virObjectLock(vm);
+
+        if (!virDomainObjIsActive(vm)) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("guest unexpectedly quit"));
+            return -1;
+        }
+    }
+}
+
 static int qemuDumpToFd(virQEMUDriverPtr driver, virDomainObjPtr vm,
                         int fd, qemuDomainAsyncJob asyncJob,
                         const char *dumpformat)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
+    bool detach = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_QUERY_DUMP);
     int ret = -1;
 
     if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DUMP_GUEST_MEMORY)) {
@@ -3501,7 +3685,10 @@ static int qemuDumpToFd(virQEMUDriverPtr driver, virDomainObjPtr vm,
                                           fd) < 0)
         return -1;
 
-    VIR_FREE(priv->job.current);
+    /* With a detached dump we keep the job info around so the dump
+     * progress can be watched via virDomainGetJobInfo */
+    if (!detach)
+        VIR_FREE(priv->job.current);
     priv->job.dump_memory_only = true;
 
     if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
@@ -3520,11 +3707,14 @@ static int qemuDumpToFd(virQEMUDriverPtr driver, virDomainObjPtr vm,
         }
     }
 
-    ret = qemuMonitorDumpToFd(priv->mon, fd, dumpformat);
+    ret = qemuMonitorDumpToFd(priv->mon, fd, dumpformat, detach);
 
  cleanup:
     ignore_value(qemuDomainObjExitMonitor(driver, vm));
 
+    if (ret == 0 && detach)
+        ret = qemuDumpWaitForCompletion(driver, vm, asyncJob);
+
     return ret;
 }
 
@@ -4550,15 +4740,63 @@ processMonitorEOFEvent(virQEMUDriverPtr driver,
 }
 
 
+/* Best effort: move the worker thread handling this event onto the
+ * CPUs of the domain's own NUMA nodes, so the event is processed close
+ * to the memory of the VM it concerns.  The worker's original mask is
+ * returned through @origmask so the caller can restore it once the
+ * event has been handled; on any failure no pinning happens and
+ * @origmask is left NULL.
+ */
+static void
+qemuProcessEventPinWorker(virQEMUDriverPtr driver,
+                          virDomainObjPtr vm,
+                          virBitmapPtr *origmask)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virBitmapPtr nodeset = NULL;
+    virBitmapPtr cpumap = NULL;
+    virCapsPtr caps = NULL;
+
+    *origmask = NULL;
+
+    if (!vm->def ||
+        !(nodeset = virDomainNumatuneGetNodeset(vm->def->numa,
+                                                priv->autoNodeset, -1)))
+        return;
+
+    if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
+        goto cleanup;
+
+    if (!(cpumap = virCapabilitiesGetCpusForNodemask(caps, nodeset)) ||
+        virBitmapIsAllClear(cpumap))
+        goto cleanup;
+
+    if (!(*origmask = virProcessGetAffinity(virThreadSelfID())))
+        goto cleanup;
+
+    if (virProcessSetAffinity(virThreadSelfID(), cpumap) < 0) {
+        virBitmapFree(*origmask);
+        *origmask = NULL;
+    }
+
+ cleanup:
+    virResetLastError();
+    virBitmapFree(cpumap);
+    virObjectUnref(caps);
+}
+
+
 static void qemuProcessEventHandler(void *data, void *opaque)
 {
     struct qemuProcessEvent *processEvent = data;
     virDomainObjPtr vm = processEvent->vm;
     virQEMUDriverPtr driver = opaque;
+    virBitmapPtr origmask = NULL;
 
     VIR_DEBUG("vm=%p, event=%d", vm, processEvent->eventType);
 
     virObjectLock(vm);
+    qemuProcessEventPinWorker(driver, vm, &origmask);
 
     switch (processEvent->eventType) {
     case QEMU_PROCESS_EVENT_WATCHDOG:
@@ -4586,12 +4824,23 @@ static void qemuProcessEventHandler(void *data, void *opaque)
     case QEMU_PROCESS_EVENT_MONITOR_EOF:
         processMonitorEOFEvent(driver, vm);
         break;
+    case QEMU_PROCESS_EVENT_REFRESH_STATS:
+        processRefreshStatsEvent(driver, vm);
+        break;
     case QEMU_PROCESS_EVENT_LAST:
         break;
     }
 
     virDomainObjEndAPI(&vm);
     VIR_FREE(processEvent);
+
+    /* Give the worker its original placement back before it picks up
+     * an event for some other VM */
+    if (origmask) {
+        if (virProcessSetAffinity(virThreadSelfID(), origmask) < 0)
+            virResetLastError();
+        virBitmapFree(origmask);
+    }
 }
 
 
@@ -6912,6 +7161,7 @@ static char
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
     virDomainObjPtr vm;
+    qemuDomainObjPrivatePtr priv;
     char *ret = NULL;
 
     /* Flags checked by virDomainDefFormat */
@@ -6928,7 +7178,22 @@ static char
     if ((flags & VIR_DOMAIN_XML_MIGRATABLE))
         flags |= QEMU_DOMAIN_FORMAT_LIVE_FLAGS;
 
-    ret = qemuDomainFormatXML(driver, vm, flags);
+    priv = vm->privateData;
+
+    /* Serve the previously formatted document if the definition was not
+     * touched since, avoiding a rather expensive re-format */
+    if (priv->xmlDescCache &&
+        priv->xmlDescCacheFlags == flags) {
+        ignore_value(VIR_STRDUP(ret, priv->xmlDescCache));
+        goto cleanup;
+    }
+
+    if (!(ret = qemuDomainFormatXML(driver, vm, flags)))
+        goto cleanup;
+
+    VIR_FREE(priv->xmlDescCache);
+    if (VIR_STRDUP_QUIET(priv->xmlDescCache, ret) > 0)
+        priv->xmlDescCacheFlags = flags;
 
  cleanup:
     virDomainObjEndAPI(&vm);
@@ -7259,6 +7524,7 @@ qemuDomainDefineXMLFlags(virConnectPtr conn,
 
     virObjectRef(vm);
     def = NULL;
+    qemuDomainXMLCacheInvalidate(vm);
     if (qemuDomainHasBlockjob(vm, true)) {
         virReportError(VIR_ERR_BLOCK_COPY_ACTIVE, "%s",
                        _("domain has active block job"));
@@ -7545,8 +7811,10 @@ qemuDomainAttachDeviceLive(virDomainObjPtr vm,
         qemuDomainEventQueue(driver, event);
     }
 
-    if (ret == 0)
+    if (ret == 0) {
+        qemuDomainBlockStatsCacheInvalidate(vm);
         ret = qemuDomainUpdateDeviceList(driver, vm, QEMU_ASYNC_JOB_NONE);
+    }
 
     return ret;
 }
@@ -7627,8 +7895,10 @@ qemuDomainDetachDeviceLive(virDomainObjPtr vm,
         break;
     }
 
-    if (ret == 0)
+    if (ret == 0) {
+        qemuDomainBlockStatsCacheInvalidate(vm);
         ret = qemuDomainUpdateDeviceList(driver, vm, QEMU_ASYNC_JOB_NONE);
+    }
 
     return ret;
 }
@@ -8069,12 +8339,78 @@ qemuDomainDetachDeviceConfig(virDomainDefPtr vmdef,
     return 0;
 }
 
+/* Saved state needed to revert a device update applied directly to
+ * the persistent definition, so a failure to save the config doesn't
+ * leave the in-memory definition out of sync with the disk copy. */
+typedef struct _qemuDomainDeviceUpdateUndo qemuDomainDeviceUpdateUndo;
+typedef qemuDomainDeviceUpdateUndo *qemuDomainDeviceUpdateUndoPtr;
+struct _qemuDomainDeviceUpdateUndo {
+    virDomainDeviceType type;       /* VIR_DOMAIN_DEVICE_NONE if unused */
+    virDomainDiskDefPtr disk;       /* disk whose fields were changed */
+    virStorageSourcePtr oldSrc;
+    int oldCacheMode;
+    int oldStartupPolicy;
+    virDomainGraphicsDefPtr oldGraphics;
+    virDomainNetDefPtr oldNet;
+    int pos;
+};
+
+
+/* The update succeeded; release whatever the undo record kept alive */
+static void
+qemuDomainDeviceUpdateUndoCommit(qemuDomainDeviceUpdateUndoPtr undo)
+{
+    switch (undo->type) {
+    case VIR_DOMAIN_DEVICE_DISK:
+        virStorageSourceFree(undo->oldSrc);
+        break;
+    case VIR_DOMAIN_DEVICE_GRAPHICS:
+        virDomainGraphicsDefFree(undo->oldGraphics);
+        break;
+    case VIR_DOMAIN_DEVICE_NET:
+        virDomainNetDefFree(undo->oldNet);
+        break;
+    default:
+        break;
+    }
+    memset(undo, 0, sizeof(*undo));
+}
+
+
+/* Put the replaced device state back into @vmdef */
+static void
+qemuDomainDeviceUpdateUndoRollback(virDomainDefPtr vmdef,
+                                   qemuDomainDeviceUpdateUndoPtr undo)
+{
+    switch (undo->type) {
+    case VIR_DOMAIN_DEVICE_DISK:
+        virStorageSourceFree(undo->disk->src);
+        undo->disk->src = undo->oldSrc;
+        undo->disk->cachemode = undo->oldCacheMode;
+        undo->disk->startupPolicy = undo->oldStartupPolicy;
+        break;
+    case VIR_DOMAIN_DEVICE_GRAPHICS:
+        virDomainGraphicsDefFree(vmdef->graphics[undo->pos]);
+        vmdef->graphics[undo->pos] = undo->oldGraphics;
+        break;
+    case VIR_DOMAIN_DEVICE_NET:
+        virDomainNetDefFree(vmdef->nets[undo->pos]);
+        vmdef->nets[undo->pos] = undo->oldNet;
+        break;
+    default:
+        break;
+    }
+    memset(undo, 0, sizeof(*undo));
+}
+
+
 static int
 qemuDomainUpdateDeviceConfig(virDomainDefPtr vmdef,
                              virDomainDeviceDefPtr dev,
                              virCapsPtr caps,
                              unsigned int parse_flags,
-                             virDomainXMLOptionPtr xmlopt)
+                             virDomainXMLOptionPtr xmlopt,
+                             qemuDomainDeviceUpdateUndoPtr undo)
 {
     virDomainDiskDefPtr orig, disk;
     virDomainGraphicsDefPtr newGraphics;
@@ -8099,10 +8435,18 @@ qemuDomainUpdateDeviceConfig(virDomainDefPtr vmdef,
          * Update 'orig'
          * We allow updating src/type//driverType/cachemode/
          */
+        if (undo) {
+            undo->type = dev->type;
+            undo->disk = orig;
+            undo->oldSrc = orig->src;
+            undo->oldCacheMode = orig->cachemode;
+            undo->oldStartupPolicy = orig->startupPolicy;
+        } else {
+            virStorageSourceFree(orig->src);
+        }
+
         orig->cachemode = disk->cachemode;
         orig->startupPolicy = disk->startupPolicy;
-
-        virStorageSourceFree(orig->src);
         orig->src = disk->src;
         disk->src = NULL;
         break;
@@ -8117,7 +8461,13 @@ qemuDomainUpdateDeviceConfig(virDomainDefPtr vmdef,
             return -1;
         }
 
-        virDomainGraphicsDefFree(vmdef->graphics[pos]);
+        if (undo) {
+            undo->type = dev->type;
+            undo->pos = pos;
+            undo->oldGraphics = vmdef->graphics[pos];
+        } else {
+            virDomainGraphicsDefFree(vmdef->graphics[pos]);
+        }
 
         vmdef->graphics[pos] = newGraphics;
         dev->data.graphics = NULL;
@@ -8128,7 +8478,13 @@ qemuDomainUpdateDeviceConfig(virDomainDefPtr vmdef,
         if ((pos = virDomainNetFindIdx(vmdef, net)) < 0)
             return -1;
 
-        virDomainNetDefFree(vmdef->nets[pos]);
+        if (undo) {
+            undo->type = dev->type;
+            undo->pos = pos;
+            undo->oldNet = vmdef->nets[pos];
+        } else {
+            virDomainNetDefFree(vmdef->nets[pos]);
+        }
 
         vmdef->nets[pos] = net;
         dev->data.net = NULL;
@@ -8261,6 +8617,169 @@ qemuDomainAttachDeviceLiveAndConfig(virConnectPtr conn,
     return ret;
 }
 
+static int qemuDomainDetachDeviceLiveAndConfig(virQEMUDriverPtr driver,
+                                               virDomainObjPtr vm,
+                                               const char *xml,
+                                               unsigned int flags);
+
+/* Split a <devices> element into the XML strings of its children so
+ * each can be fed through the existing single-device code paths. */
+static int
+qemuDomainDeviceListParse(const char *xml,
+                          char ***devxmls,
+                          size_t *ndevxmls)
+{
+    xmlDocPtr doc = NULL;
+    xmlXPathContextPtr ctxt = NULL;
+    xmlNodePtr node;
+    char **list = NULL;
+    size_t nlist = 0;
+    int ret = -1;
+
+    if (!(doc = virXMLParseStringCtxt(xml, _("(device_list)"), &ctxt)))
+        goto cleanup;
+
+    if (!xmlStrEqual(ctxt->node->name, BAD_CAST "devices")) {
+        virReportError(VIR_ERR_XML_ERROR,
+                       _("expected <devices> element, found <%s>"),
+                       ctxt->node->name);
+        goto cleanup;
+    }
+
+    for (node = ctxt->node->children; node; node = node->next) {
+        char *devxml;
+
+        if (node->type != XML_ELEMENT_NODE)
+            continue;
+
+        if (!(devxml = virXMLNodeToString(doc, node)))
+            goto cleanup;
+
+        if (VIR_APPEND_ELEMENT(list, nlist, devxml) < 0) {
+            VIR_FREE(devxml);
+            goto cleanup;
+        }
+    }
+
+    if (nlist == 0) {
+        virReportError(VIR_ERR_XML_ERROR, "%s",
+                       _("no devices found in device list XML"));
+        goto cleanup;
+    }
+
+    *devxmls = list;
+    *ndevxmls = nlist;
+    list = NULL;
+    nlist = 0;
+    ret = 0;
+
+ cleanup:
+    virStringFreeListCount(list, nlist);
+    xmlXPathFreeContext(ctxt);
+    xmlFreeDoc(doc);
+    return ret;
+}
+
+
+static int
+qemuDomainAttachDeviceListLiveAndConfig(virConnectPtr conn,
+                                        virDomainObjPtr vm,
+                                        virQEMUDriverPtr driver,
+                                        const char *xml,
+                                        unsigned int flags)
+{
+    char **devxmls = NULL;
+    size_t ndevxmls = 0;
+    size_t i;
+    int ret = -1;
+
+    if (qemuDomainDeviceListParse(xml, &devxmls, &ndevxmls) < 0)
+        return -1;
+
+    for (i = 0; i < ndevxmls; i++) {
+        if (qemuDomainAttachDeviceLiveAndConfig(conn, vm, driver,
+                                                devxmls[i], flags) < 0)
+            goto rollback;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virStringFreeListCount(devxmls, ndevxmls);
+    return ret;
+
+ rollback:
+    /* Detach whatever was attached before the failure so the
+     * transaction leaves no partial state behind; this is best
+     * effort and keeps the original error */
+    if (i > 0) {
+        virErrorPtr orig_err = virSaveLastError();
+
+        while (i--) {
+            if (qemuDomainDetachDeviceLiveAndConfig(driver, vm,
+                                                    devxmls[i], flags) < 0)
+                VIR_WARN("unable to roll back attach of device %zu "
+                         "on domain %s", i, vm->def->name);
+        }
+
+        if (orig_err) {
+            virSetError(orig_err);
+            virFreeError(orig_err);
+        }
+    }
+    goto cleanup;
+}
+
+
+static int
+qemuDomainDetachDeviceListLiveAndConfig(virQEMUDriverPtr driver,
+                                        virConnectPtr conn,
+                                        virDomainObjPtr vm,
+                                        const char *xml,
+                                        unsigned int flags)
+{
+    char **devxmls = NULL;
+    size_t ndevxmls = 0;
+    size_t i;
+    int ret = -1;
+
+    if (qemuDomainDeviceListParse(xml, &devxmls, &ndevxmls) < 0)
+        return -1;
+
+    for (i = 0; i < ndevxmls; i++) {
+        if (qemuDomainDetachDeviceLiveAndConfig(driver, vm,
+                                                devxmls[i], flags) < 0)
+            goto rollback;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virStringFreeListCount(devxmls, ndevxmls);
+    return ret;
+
+ rollback:
+    /* Guests may already have noticed the removals, so putting the
+     * devices back is inherently best effort */
+    if (i > 0) {
+        virErrorPtr orig_err = virSaveLastError();
+
+        while (i--) {
+            if (qemuDomainAttachDeviceLiveAndConfig(conn, vm, driver,
+                                                    devxmls[i], flags) < 0)
+                VIR_WARN("unable to re-attach device %zu "
+                         "on domain %s", i, vm->def->name);
+        }
+
+        if (orig_err) {
+            virSetError(orig_err);
+            virFreeError(orig_err);
+        }
+    }
+    goto cleanup;
+}
+
+
 static int
 qemuDomainAttachDeviceFlags(virDomainPtr dom,
                             const char *xml,
@@ -8284,8 +8803,15 @@ qemuDomainAttachDeviceFlags(virDomainPtr dom,
     if (virDomainObjUpdateModificationImpact(vm, &flags) < 0)
         goto endjob;
 
-    if (qemuDomainAttachDeviceLiveAndConfig(dom->conn, vm, driver, xml, flags) < 0)
-        goto endjob;
+    if (flags & VIR_DOMAIN_DEVICE_MODIFY_LIST) {
+        if (qemuDomainAttachDeviceListLiveAndConfig(dom->conn, vm, driver, xml,
+                                                    flags & ~VIR_DOMAIN_DEVICE_MODIFY_LIST) < 0)
+            goto endjob;
+    } else {
+        if (qemuDomainAttachDeviceLiveAndConfig(dom->conn, vm, driver, xml,
+                                                flags) < 0)
+            goto endjob;
+    }
 
     ret = 0;
 
@@ -8312,6 +8838,8 @@ static int qemuDomainUpdateDeviceFlags(virDomainPtr dom,
     virQEMUDriverPtr driver = dom->conn->privateData;
     virDomainObjPtr vm = NULL;
     virDomainDefPtr vmdef = NULL;
+    virDomainDefPtr persistentDef = NULL;
+    qemuDomainDeviceUpdateUndo undo = { .type = VIR_DOMAIN_DEVICE_NONE };
     virDomainDeviceDefPtr dev = NULL, dev_copy = NULL;
     bool force = (flags & VIR_DOMAIN_DEVICE_MODIFY_FORCE) != 0;
     int ret = -1;
@@ -8369,19 +8897,42 @@ static int qemuDomainUpdateDeviceFlags(virDomainPtr dom,
         goto endjob;
 
     if (flags & VIR_DOMAIN_AFFECT_CONFIG) {
-        /* Make a copy for updated domain. */
-        vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt);
-        if (!vmdef)
-            goto endjob;
+        if (flags & VIR_DOMAIN_AFFECT_LIVE) {
+            /* Make a copy for updated domain. */
+            vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt);
+            if (!vmdef)
+                goto endjob;
 
-        if (virDomainDefCompatibleDevice(vmdef, dev,
-                                         VIR_DOMAIN_DEVICE_ACTION_UPDATE) < 0)
-            goto endjob;
+            if (virDomainDefCompatibleDevice(vmdef, dev,
+                                             VIR_DOMAIN_DEVICE_ACTION_UPDATE) < 0)
+                goto endjob;
 
-        if ((ret = qemuDomainUpdateDeviceConfig(vmdef, dev, caps,
-                                                parse_flags,
-                                                driver->xmlopt)) < 0)
-            goto endjob;
+            if ((ret = qemuDomainUpdateDeviceConfig(vmdef, dev, caps,
+                                                    parse_flags,
+                                                    driver->xmlopt, NULL)) < 0)
+                goto endjob;
+        } else {
+            /* A config-only update touches exactly one device, so
+             * patch the stored definition in place rather than paying
+             * for a format + re-parse round trip of the whole domain;
+             * the undo record reverts the swap if anything fails */
+            if (!(persistentDef = virDomainObjGetPersistentDef(caps,
+                                                               driver->xmlopt,
+                                                               vm)))
+                goto endjob;
+
+            if (virDomainDefCompatibleDevice(persistentDef, dev,
+                                             VIR_DOMAIN_DEVICE_ACTION_UPDATE) < 0)
+                goto endjob;
+
+            if ((ret = qemuDomainUpdateDeviceConfig(persistentDef, dev, caps,
+                                                    parse_flags,
+                                                    driver->xmlopt,
+                                                    &undo)) < 0) {
+                qemuDomainDeviceUpdateUndoRollback(persistentDef, &undo);
+                goto endjob;
+            }
+        }
     }
 
     if (flags & VIR_DOMAIN_AFFECT_LIVE) {
@@ -8404,10 +8955,18 @@ static int qemuDomainUpdateDeviceFlags(virDomainPtr dom,
 
     /* Finally, if no error until here, we can save config. */
     if (flags & VIR_DOMAIN_AFFECT_CONFIG) {
-        ret = virDomainSaveConfig(cfg->configDir, driver->caps, vmdef);
-        if (!ret) {
-            virDomainObjAssignDef(vm, vmdef, false, NULL);
-            vmdef = NULL;
+        if (vmdef) {
+            ret = virDomainSaveConfig(cfg->configDir, driver->caps, vmdef);
+            if (!ret) {
+                virDomainObjAssignDef(vm, vmdef, false, NULL);
+                vmdef = NULL;
+            }
+        } else {
+            if ((ret = virDomainSaveConfig(cfg->configDir, driver->caps,
+                                           persistentDef)) < 0)
+                qemuDomainDeviceUpdateUndoRollback(persistentDef, &undo);
+            else
+                qemuDomainDeviceUpdateUndoCommit(&undo);
         }
     }
 
@@ -8543,8 +9102,14 @@ qemuDomainDetachDeviceFlags(virDomainPtr dom,
     if (virDomainObjUpdateModificationImpact(vm, &flags) < 0)
         goto endjob;
 
-    if (qemuDomainDetachDeviceLiveAndConfig(driver, vm, xml, flags) < 0)
-        goto endjob;
+    if (flags & VIR_DOMAIN_DEVICE_MODIFY_LIST) {
+        if (qemuDomainDetachDeviceListLiveAndConfig(driver, dom->conn, vm, xml,
+                                                    flags & ~VIR_DOMAIN_DEVICE_MODIFY_LIST) < 0)
+            goto endjob;
+    } else {
+        if (qemuDomainDetachDeviceLiveAndConfig(driver, vm, xml, flags) < 0)
+            goto endjob;
+    }
 
     ret = 0;
 
@@ -10668,6 +11233,7 @@ qemuDomainBlocksStatsGather(virQEMUDriverPtr driver,
     virHashTablePtr blockstats = NULL;
     qemuBlockStatsPtr stats;
     int nstats;
+    unsigned long long now;
     char *diskAlias = NULL;
     int ret = -1;
 
@@ -10687,16 +11253,33 @@ qemuDomainBlocksStatsGather(virQEMUDriverPtr driver,
             goto cleanup;
     }
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    nstats = qemuMonitorGetAllBlockStatsInfo(priv->mon, &blockstats, false);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0 || nstats < 0)
+    /* Refresh the cached query-blockstats data when it has gone
+     * stale; a sweep over every disk of the domain is then served by
+     * a single monitor command */
+    if (virTimeMillisNow(&now) < 0)
         goto cleanup;
 
+    if (!priv->blockStatsUpdated ||
+        now - priv->blockStatsUpdated >= QEMU_BLOCK_STATS_CACHE_TTL) {
+        qemuDomainObjEnterMonitor(driver, vm);
+        nstats = qemuMonitorGetAllBlockStatsInfo(priv->mon, &blockstats, false);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0 || nstats < 0)
+            goto cleanup;
+
+        virHashFree(priv->blockStatsCache);
+        priv->blockStatsCache = blockstats;
+        blockstats = NULL;
+        priv->blockStatsCacheNStats = nstats;
+        priv->blockStatsUpdated = now;
+    } else {
+        nstats = priv->blockStatsCacheNStats;
+    }
+
     if (VIR_ALLOC(*retstats) < 0)
         goto cleanup;
 
     if (diskAlias) {
-        if (!(stats = virHashLookup(blockstats, diskAlias))) {
+        if (!(stats = virHashLookup(priv->blockStatsCache, diskAlias))) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("cannot find statistics for device '%s'"), diskAlias);
             goto cleanup;
@@ -10704,7 +11287,8 @@ qemuDomainBlocksStatsGather(virQEMUDriverPtr driver,
 
         **retstats = *stats;
     } else {
-        virHashForEach(blockstats, qemuDomainBlockStatsGatherTotals, *retstats);
+        virHashForEach(priv->blockStatsCache,
+                       qemuDomainBlockStatsGatherTotals, *retstats);
     }
 
     ret = nstats;
@@ -11209,6 +11793,9 @@ qemuDomainMemoryStatsInternal(virQEMUDriverPtr driver,
                               unsigned int nr_stats)
 
 {
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    unsigned long long now;
+    unsigned long long ttl;
     int ret = -1;
     long rss;
 
@@ -11220,19 +11807,46 @@ qemuDomainMemoryStatsInternal(virQEMUDriverPtr driver,
 
     if (vm->def->memballoon &&
         vm->def->memballoon->model == VIR_DOMAIN_MEMBALLOON_MODEL_VIRTIO) {
-        qemuDomainObjEnterMonitor(driver, vm);
-        ret = qemuMonitorGetMemoryStats(qemuDomainGetMonitor(vm),
-                                        vm->def->memballoon, stats, nr_stats);
-        if (qemuDomainObjExitMonitor(driver, vm) < 0)
-            ret = -1;
+        if (virTimeMillisNow(&now) < 0)
+            return -1;
 
-        if (ret < 0 || ret >= nr_stats)
+        /* the guest pushes fresh stats only once per period, so
+         * polling the monitor faster than that returns stale data
+         * anyway; with no period set fall back to a short window */
+        if (vm->def->memballoon->period > 0)
+            ttl = vm->def->memballoon->period * 1000ULL;
+        else
+            ttl = QEMU_MEMORY_STATS_CACHE_TTL;
+
+        if (!priv->memStatsUpdated || now - priv->memStatsUpdated >= ttl) {
+            virDomainMemoryStatStruct cur[VIR_DOMAIN_MEMORY_STAT_NR];
+            int nr;
+
+            qemuDomainObjEnterMonitor(driver, vm);
+            nr = qemuMonitorGetMemoryStats(qemuDomainGetMonitor(vm),
+                                           vm->def->memballoon, cur,
+                                           VIR_DOMAIN_MEMORY_STAT_NR);
+            if (qemuDomainObjExitMonitor(driver, vm) < 0)
+                nr = -1;
+
+            if (nr < 0)
+                return nr;
+
+            memcpy(priv->memStatsCache, cur, nr * sizeof(*cur));
+            priv->memStatsCacheNStats = nr;
+            priv->memStatsUpdated = now;
+        }
+
+        ret = MIN((unsigned int) priv->memStatsCacheNStats, nr_stats);
+        memcpy(stats, priv->memStatsCache, ret * sizeof(*stats));
+
+        if (ret >= nr_stats)
             return ret;
     } else {
         ret = 0;
     }
 
-    if (qemuGetProcessInfo(NULL, NULL, &rss, vm->pid, 0) < 0) {
+    if (virProcessGetStatInfo(NULL, NULL, &rss, vm->pid, 0) < 0) {
         virReportError(VIR_ERR_OPERATION_FAILED, "%s",
                        _("cannot get RSS for domain"));
     } else {
@@ -11618,11 +12232,8 @@ qemuDomainGetBlockInfo(virDomainPtr dom,
     }
 
     qemuDomainObjEnterMonitor(driver, vm);
-    rc = qemuMonitorGetAllBlockStatsInfo(qemuDomainGetMonitor(vm),
-                                         &stats, false);
-    if (rc >= 0)
-        rc = qemuMonitorBlockStatsUpdateCapacity(qemuDomainGetMonitor(vm),
-                                                 stats, false);
+    rc = qemuMonitorGetAllBlockStatsWithCapacity(qemuDomainGetMonitor(vm),
+                                                 &stats, false);
 
     if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
         goto endjob;
@@ -14000,115 +14611,314 @@ qemuDomainSnapshotPrepare(virConnectPtr conn,
 }
 
 
-/* The domain is expected to hold monitor lock.  */
-static int
-qemuDomainSnapshotCreateSingleDiskActive(virQEMUDriverPtr driver,
-                                         virDomainObjPtr vm,
-                                         virDomainSnapshotDiskDefPtr snap,
-                                         virDomainDiskDefPtr disk,
-                                         virDomainDiskDefPtr persistDisk,
-                                         virJSONValuePtr actions,
-                                         bool reuse,
-                                         qemuDomainAsyncJob asyncJob)
+/* Cap on the threads preparing snapshot overlay images concurrently;
+ * the work is mostly storage I/O so a small pool is enough */
+#define QEMU_SNAPSHOT_PREPARE_MAX_WORKERS 8
+
+typedef struct _qemuDomainSnapshotDiskData qemuDomainSnapshotDiskData;
+typedef qemuDomainSnapshotDiskData *qemuDomainSnapshotDiskDataPtr;
+struct _qemuDomainSnapshotDiskData {
+    virDomainSnapshotDiskDefPtr snapdisk; /* NULL when the disk is skipped */
+    virDomainDiskDefPtr disk;
+    virDomainDiskDefPtr persistDisk;
+    virStorageSourcePtr src;        /* new overlay source for the live def */
+    virStorageSourcePtr persistSrc; /* ditto for the persistent def */
+    char *device;
+    char *source;
+    bool initialized; /* @src was initialized in the storage driver */
+    bool created;     /* @src was created and needs unlinking on failure */
+};
+
+
+static void
+qemuDomainSnapshotDiskDataFree(qemuDomainSnapshotDiskDataPtr data,
+                               size_t ndata)
 {
-    qemuDomainObjPrivatePtr priv = vm->privateData;
-    virStorageSourcePtr newDiskSrc = NULL;
-    virStorageSourcePtr persistDiskSrc = NULL;
-    char *device = NULL;
-    char *source = NULL;
-    const char *formatStr = NULL;
-    int ret = -1, rc;
-    bool need_unlink = false;
+    size_t i;
 
-    if (snap->snapshot != VIR_DOMAIN_SNAPSHOT_LOCATION_EXTERNAL) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("unexpected code path"));
-        return -1;
+    if (!data)
+        return;
+
+    for (i = 0; i < ndata; i++) {
+        qemuDomainSnapshotDiskDataPtr dd = &data[i];
+
+        /* @src is cleared once its ownership moved to the domain
+         * definition, so anything left here is an unused overlay */
+        if (dd->src) {
+            if (dd->created && virStorageFileUnlink(dd->src) < 0)
+                VIR_WARN("unable to remove just-created %s", dd->src->path);
+            if (dd->initialized)
+                virStorageFileDeinit(dd->src);
+            virStorageSourceFree(dd->src);
+        }
+        virStorageSourceFree(dd->persistSrc);
+        VIR_FREE(dd->device);
+        VIR_FREE(dd->source);
     }
+    VIR_FREE(data);
+}
 
-    if (!(device = qemuAliasFromDisk(disk)))
-        goto cleanup;
 
-    if (!(newDiskSrc = virStorageSourceCopy(snap->src, false)))
-        goto cleanup;
+/* Prepare the overlay image of one disk: copy and chain the new
+ * source, initialize it in the storage driver and pre-create the
+ * image file so it can be labelled before qemu opens it. Only reads
+ * the domain definition, so multiple disks can be prepared
+ * concurrently. */
+static int
+qemuDomainSnapshotDiskPrepareOne(virQEMUDriverPtr driver,
+                                 virDomainObjPtr vm,
+                                 qemuDomainSnapshotDiskDataPtr dd,
+                                 bool reuse)
+{
+    if (!(dd->device = qemuAliasFromDisk(dd->disk)))
+        return -1;
 
-    if (virStorageSourceInitChainElement(newDiskSrc, disk->src, false) < 0)
-        goto cleanup;
+    if (!(dd->src = virStorageSourceCopy(dd->snapdisk->src, false)))
+        return -1;
 
-    if (qemuDomainStorageFileInit(driver, vm, newDiskSrc) < 0)
-        goto cleanup;
+    if (virStorageSourceInitChainElement(dd->src, dd->disk->src, false) < 0)
+        return -1;
 
-    if (qemuGetDriveSourceString(newDiskSrc, NULL, &source) < 0)
-        goto cleanup;
+    if (qemuDomainStorageFileInit(driver, vm, dd->src) < 0)
+        return -1;
+    dd->initialized = true;
 
-    if (persistDisk) {
-        if (!(persistDiskSrc = virStorageSourceCopy(snap->src, false)))
-            goto cleanup;
+    if (qemuGetDriveSourceString(dd->src, NULL, &dd->source) < 0)
+        return -1;
 
-        if (virStorageSourceInitChainElement(persistDiskSrc, persistDisk->src,
-                                             false) < 0)
-            goto cleanup;
+    if (dd->persistDisk) {
+        if (!(dd->persistSrc = virStorageSourceCopy(dd->snapdisk->src, false)))
+            return -1;
+
+        if (virStorageSourceInitChainElement(dd->persistSrc,
+                                             dd->persistDisk->src, false) < 0)
+            return -1;
     }
 
     /* pre-create the image file so that we can label it before handing it to qemu */
-    if (!reuse && newDiskSrc->type != VIR_STORAGE_TYPE_BLOCK) {
-        if (virStorageFileCreate(newDiskSrc) < 0) {
+    if (!reuse && dd->src->type != VIR_STORAGE_TYPE_BLOCK) {
+        if (virStorageFileCreate(dd->src) < 0) {
             virReportSystemError(errno, _("failed to create image file '%s'"),
-                                 source);
-            goto cleanup;
+                                 dd->source);
+            return -1;
         }
-        need_unlink = true;
+        dd->created = true;
     }
 
+    return 0;
+}
+
+
+struct qemuDomainSnapshotPrepareState {
+    virQEMUDriverPtr driver;
+    virDomainObjPtr vm;
+    bool reuse;
+    virMutex lock;
+    virCond cond;
+    size_t remaining;
+    virErrorPtr err;
+};
+
+
+static void
+qemuDomainSnapshotDiskPrepareWorker(void *jobdata, void *opaque)
+{
+    struct qemuDomainSnapshotPrepareState *state = opaque;
+    qemuDomainSnapshotDiskDataPtr dd = jobdata;
+    bool failed = false;
+
+    if (qemuDomainSnapshotDiskPrepareOne(state->driver, state->vm, dd,
+                                         state->reuse) < 0)
+        failed = true;
+
+    virMutexLock(&state->lock);
+    if (failed && !state->err)
+        state->err = virSaveLastError();
+    state->remaining--;
+    virCondSignal(&state->cond);
+    virMutexUnlock(&state->lock);
+}
+
+
+/*
+ * Prepare the overlay images of every disk taking part in the
+ * snapshot. The per-disk work - storage driver initialization and
+ * image file creation, each potentially a slow network round trip -
+ * is independent between disks, so it is spread over a worker pool;
+ * labelling, the monitor commands and the definition updates stay
+ * with the caller.
+ *
+ * The caller must hold the lock on @vm and keep its definition
+ * unchanged until this function returns.
+ *
+ * Returns the per-disk data array on success, NULL on failure with
+ * the first error reported.
+ */
+static qemuDomainSnapshotDiskDataPtr
+qemuDomainSnapshotDiskDataCollect(virQEMUDriverPtr driver,
+                                  virDomainObjPtr vm,
+                                  virDomainSnapshotObjPtr snap,
+                                  bool reuse)
+{
+    qemuDomainSnapshotDiskDataPtr data;
+    struct qemuDomainSnapshotPrepareState state = { .driver = driver,
+                                                    .vm = vm,
+                                                    .reuse = reuse };
+    virThreadPoolPtr pool = NULL;
+    size_t njobs = 0;
+    size_t i;
+
+    if (VIR_ALLOC_N(data, snap->def->ndisks) < 0)
+        return NULL;
+
+    for (i = 0; i < snap->def->ndisks; i++) {
+        qemuDomainSnapshotDiskDataPtr dd = &data[i];
+
+        if (snap->def->disks[i].snapshot == VIR_DOMAIN_SNAPSHOT_LOCATION_NONE)
+            continue;
+
+        if (snap->def->disks[i].snapshot !=
+            VIR_DOMAIN_SNAPSHOT_LOCATION_EXTERNAL) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("unexpected code path"));
+            goto error;
+        }
+
+        dd->snapdisk = &snap->def->disks[i];
+        dd->disk = vm->def->disks[i];
+        if (vm->newDef)
+            dd->persistDisk = virDomainDiskByName(vm->newDef,
+                                                  vm->def->disks[i]->dst,
+                                                  false);
+        njobs++;
+    }
+
+    /* A single disk gains nothing from the pool */
+    if (njobs <= 1)
+        goto serial;
+
+    if (virMutexInit(&state.lock) < 0)
+        goto serial;
+    if (virCondInit(&state.cond) < 0) {
+        virMutexDestroy(&state.lock);
+        goto serial;
+    }
+
+    if (!(pool = virThreadPoolNew(0, MIN(njobs,
+                                         QEMU_SNAPSHOT_PREPARE_MAX_WORKERS),
+                                  0, qemuDomainSnapshotDiskPrepareWorker,
+                                  &state))) {
+        virResetLastError();
+        virCondDestroy(&state.cond);
+        virMutexDestroy(&state.lock);
+        goto serial;
+    }
+
+    for (i = 0; i < snap->def->ndisks; i++) {
+        if (!data[i].snapdisk)
+            continue;
+
+        virMutexLock(&state.lock);
+        state.remaining++;
+        virMutexUnlock(&state.lock);
+
+        if (virThreadPoolSendJob(pool, 0, &data[i]) < 0) {
+            virResetLastError();
+            qemuDomainSnapshotDiskPrepareWorker(&data[i], &state);
+        }
+    }
+
+    virMutexLock(&state.lock);
+    while (state.remaining > 0) {
+        if (virCondWait(&state.cond, &state.lock) < 0)
+            break;
+    }
+    virMutexUnlock(&state.lock);
+
+    virThreadPoolFree(pool);
+    virCondDestroy(&state.cond);
+    virMutexDestroy(&state.lock);
+
+    if (state.err) {
+        virSetError(state.err);
+        virFreeError(state.err);
+        goto error;
+    }
+
+    return data;
+
+ serial:
+    for (i = 0; i < snap->def->ndisks; i++) {
+        if (!data[i].snapdisk)
+            continue;
+        if (qemuDomainSnapshotDiskPrepareOne(driver, vm, &data[i],
+                                             reuse) < 0)
+            goto error;
+    }
+    return data;
+
+ error:
+    qemuDomainSnapshotDiskDataFree(data, snap->def->ndisks);
+    return NULL;
+}
+
+
+/* The domain is expected to hold monitor lock.  */
+static int
+qemuDomainSnapshotCreateSingleDiskActive(virQEMUDriverPtr driver,
+                                         virDomainObjPtr vm,
+                                         qemuDomainSnapshotDiskDataPtr dd,
+                                         virJSONValuePtr actions,
+                                         bool reuse,
+                                         qemuDomainAsyncJob asyncJob)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    const char *formatStr = NULL;
+    int ret = -1, rc;
+
     /* set correct security, cgroup and locking options on the new image */
-    if (qemuDomainDiskChainElementPrepare(driver, vm, newDiskSrc, false) < 0) {
-        qemuDomainDiskChainElementRevoke(driver, vm, newDiskSrc);
-        goto cleanup;
+    if (qemuDomainDiskChainElementPrepare(driver, vm, dd->src, false) < 0) {
+        qemuDomainDiskChainElementRevoke(driver, vm, dd->src);
+        return -1;
     }
 
     /* create the actual snapshot */
-    if (newDiskSrc->format)
-        formatStr = virStorageFileFormatTypeToString(newDiskSrc->format);
+    if (dd->src->format)
+        formatStr = virStorageFileFormatTypeToString(dd->src->format);
 
     /* The monitor is only accessed if qemu doesn't support transactions.
      * Otherwise the following monitor command only constructs the command.
      */
     if (!actions &&
         qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
-        goto cleanup;
+        return -1;
 
-    ret = rc = qemuMonitorDiskSnapshot(priv->mon, actions, device, source,
-                                       formatStr, reuse);
+    ret = rc = qemuMonitorDiskSnapshot(priv->mon, actions, dd->device,
+                                       dd->source, formatStr, reuse);
     if (!actions) {
         if (qemuDomainObjExitMonitor(driver, vm) < 0)
             ret = -1;
     }
 
-    virDomainAuditDisk(vm, disk->src, snap->src, "snapshot", rc >= 0);
+    virDomainAuditDisk(vm, dd->disk->src, dd->snapdisk->src, "snapshot",
+                       rc >= 0);
     if (ret < 0)
-        goto cleanup;
+        return ret;
 
-    /* Update vm in place to match changes.  */
-    need_unlink = false;
+    /* Update vm in place to match changes; the new sources now belong
+     * to the definition, including the created image file */
+    dd->created = false;
 
-    newDiskSrc->backingStore = disk->src;
-    disk->src = newDiskSrc;
-    newDiskSrc = NULL;
+    dd->src->backingStore = dd->disk->src;
+    dd->disk->src = dd->src;
+    dd->src = NULL;
 
-    if (persistDisk) {
-        persistDiskSrc->backingStore = persistDisk->src;
-        persistDisk->src = persistDiskSrc;
-        persistDiskSrc = NULL;
+    if (dd->persistDisk) {
+        dd->persistSrc->backingStore = dd->persistDisk->src;
+        dd->persistDisk->src = dd->persistSrc;
+        dd->persistSrc = NULL;
     }
 
- cleanup:
-    if (need_unlink && virStorageFileUnlink(newDiskSrc))
-        VIR_WARN("unable to unlink just-created %s", source);
-    virStorageFileDeinit(newDiskSrc);
-    virStorageSourceFree(newDiskSrc);
-    virStorageSourceFree(persistDiskSrc);
-    VIR_FREE(device);
-    VIR_FREE(source);
     return ret;
 }
 
@@ -14162,6 +14972,7 @@ qemuDomainSnapshotCreateDiskActive(virQEMUDriverPtr driver,
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
     virJSONValuePtr actions = NULL;
+    qemuDomainSnapshotDiskDataPtr diskdata = NULL;
     bool do_transaction = false;
     int ret = 0;
     size_t i;
@@ -14188,26 +14999,29 @@ qemuDomainSnapshotCreateDiskActive(virQEMUDriverPtr driver,
 
     cfg = virQEMUDriverGetConfig(driver);
 
-    /* No way to roll back if first disk succeeds but later disks
-     * fail, unless we have transaction support.
+    /* Prepare the overlay images of all disks up front, in parallel;
+     * nothing visible to qemu or the definition changes yet.
      * Based on earlier qemuDomainSnapshotPrepare, all
      * disks in this list are now either SNAPSHOT_NO, or
      * SNAPSHOT_EXTERNAL with a valid file name and qcow2 format.  */
-    for (i = 0; i < snap->def->ndisks; i++) {
-        virDomainDiskDefPtr persistDisk = NULL;
+    if (!(diskdata = qemuDomainSnapshotDiskDataCollect(driver, vm, snap,
+                                                       reuse))) {
+        virJSONValueFree(actions);
+        ret = -1;
+        goto cleanup;
+    }
 
-        if (snap->def->disks[i].snapshot == VIR_DOMAIN_SNAPSHOT_LOCATION_NONE)
+    /* No way to roll back if first disk succeeds but later disks
+     * fail, unless we have transaction support.  */
+    for (i = 0; i < snap->def->ndisks; i++) {
+        if (!diskdata[i].snapdisk)
             continue;
-        if (vm->newDef &&
-            (persistDisk = virDomainDiskByName(vm->newDef,
-                                               vm->def->disks[i]->dst,
-                                               false)))
+        if (diskdata[i].persistDisk)
             persist = true;
 
         ret = qemuDomainSnapshotCreateSingleDiskActive(driver, vm,
-                                                       &snap->def->disks[i],
-                                                       vm->def->disks[i],
-                                                       persistDisk, actions,
+                                                       &diskdata[i],
+                                                       actions,
                                                        reuse, asyncJob);
         if (ret < 0)
             break;
@@ -14234,20 +15048,12 @@ qemuDomainSnapshotCreateDiskActive(virQEMUDriverPtr driver,
             /* Transaction failed; undo the changes to vm.  */
             bool need_unlink = !(flags & VIR_DOMAIN_SNAPSHOT_CREATE_REUSE_EXT);
             while (i-- > 0) {
-                virDomainDiskDefPtr persistDisk = NULL;
-
-                if (snap->def->disks[i].snapshot ==
-                    VIR_DOMAIN_SNAPSHOT_LOCATION_NONE)
+                if (!diskdata[i].snapdisk)
                     continue;
-                if (vm->newDef &&
-                    (persistDisk = virDomainDiskByName(vm->newDef,
-                                                       vm->def->disks[i]->dst,
-                                                       false)))
-                    persist = true;
 
                 qemuDomainSnapshotUndoSingleDiskActive(driver, vm,
                                                        vm->def->disks[i],
-                                                       persistDisk,
+                                                       diskdata[i].persistDisk,
                                                        need_unlink);
             }
         }
@@ -14272,6 +15078,9 @@ qemuDomainSnapshotCreateDiskActive(virQEMUDriverPtr driver,
                                             vm->newDef) < 0))
             ret = -1;
     }
+
+ cleanup:
+    qemuDomainSnapshotDiskDataFree(diskdata, snap->def->ndisks);
     virObjectUnref(cfg);
 
     return ret;
@@ -16163,6 +16972,7 @@ qemuDomainBlockPullCommon(virQEMUDriverPtr driver,
         goto endjob;
 
     QEMU_DOMAIN_DISK_PRIVATE(disk)->blockjob = true;
+    qemuDomainBlockJobInfoCacheInvalidate(vm);
 
  endjob:
     qemuDomainObjEndJob(driver, vm);
@@ -16251,6 +17061,8 @@ qemuDomainBlockJobAbort(virDomainPtr dom,
                 disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_NONE;
             goto endjob;
         }
+
+        qemuDomainBlockJobInfoCacheInvalidate(vm);
     }
 
     /* If we have made changes to XML due to a copy job, make a best
@@ -16309,15 +17121,20 @@ qemuDomainGetBlockJobInfo(virDomainPtr dom,
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
     virDomainObjPtr vm;
+    qemuDomainObjPrivatePtr priv;
     virDomainDiskDefPtr disk;
     int ret = -1;
     qemuMonitorBlockJobInfo rawInfo;
+    qemuMonitorBlockJobInfoPtr cachedInfo;
+    unsigned long long now;
 
     virCheckFlags(VIR_DOMAIN_BLOCK_JOB_INFO_BANDWIDTH_BYTES, -1);
 
     if (!(vm = qemuDomObjFromDomain(dom)))
         return -1;
 
+    priv = vm->privateData;
+
     if (virDomainGetBlockJobInfoEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
@@ -16340,13 +17157,35 @@ qemuDomainGetBlockJobInfo(virDomainPtr dom,
         goto endjob;
     }
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    ret = qemuMonitorGetBlockJobInfo(qemuDomainGetMonitor(vm),
-                                     disk->info.alias, &rawInfo);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
-    if (ret <= 0)
+    /* Refresh the cached query-block-jobs data when it has gone
+     * stale; polling clients watching job progress are then served
+     * from the cache instead of each costing a monitor roundtrip */
+    if (virTimeMillisNow(&now) < 0)
+        goto endjob;
+
+    if (!priv->blockJobInfoUpdated ||
+        now - priv->blockJobInfoUpdated >= QEMU_BLOCK_JOB_INFO_CACHE_TTL) {
+        virHashTablePtr all;
+
+        qemuDomainObjEnterMonitor(driver, vm);
+        all = qemuMonitorGetAllBlockJobInfo(qemuDomainGetMonitor(vm));
+        if (qemuDomainObjExitMonitor(driver, vm) < 0 || !all) {
+            virHashFree(all);
+            goto endjob;
+        }
+
+        virHashFree(priv->blockJobInfoCache);
+        priv->blockJobInfoCache = all;
+        priv->blockJobInfoUpdated = now;
+    }
+
+    if (!(cachedInfo = virHashLookup(priv->blockJobInfoCache,
+                                     disk->info.alias))) {
+        ret = 0;
         goto endjob;
+    }
+    rawInfo = *cachedInfo;
+    ret = 1;
 
     info->cur = rawInfo.cur;
     info->end = rawInfo.end;
@@ -16450,6 +17289,9 @@ qemuDomainBlockJobSetSpeed(virDomainPtr dom,
     if (qemuDomainObjExitMonitor(driver, vm) < 0)
         ret = -1;
 
+    if (ret == 0)
+        qemuDomainBlockJobInfoCacheInvalidate(vm);
+
  endjob:
     qemuDomainObjEndJob(driver, vm);
 
@@ -16631,6 +17473,8 @@ qemuDomainBlockCopyCommon(virDomainObjPtr vm,
         goto endjob;
     }
 
+    qemuDomainBlockJobInfoCacheInvalidate(vm);
+
     /* Update vm in place to match changes.  */
     need_unlink = false;
     disk->mirror = mirror;
@@ -17027,8 +17871,10 @@ qemuDomainBlockCommit(virDomainPtr dom,
         goto endjob;
     }
 
-    if (ret == 0)
+    if (ret == 0) {
         QEMU_DOMAIN_DISK_PRIVATE(disk)->blockjob = true;
+        qemuDomainBlockJobInfoCacheInvalidate(vm);
+    }
 
     if (mirror) {
         if (ret == 0) {
@@ -18868,8 +19714,9 @@ qemuDomainGetStatsVcpu(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
     }
 
     for (i = 0; i < virDomainDefGetVcpus(dom->def); i++) {
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "vcpu.%u.state", cpuinfo[i].number);
+        if (virTypedParamsComposeField(param_name, "vcpu",
+                                       cpuinfo[i].number, "state") < 0)
+            goto cleanup;
         if (virTypedParamsAddInt(&record->params,
                                  &record->nparams,
                                  maxparams,
@@ -18881,16 +19728,18 @@ qemuDomainGetStatsVcpu(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
         if (!virDomainObjIsActive(dom))
             continue;
 
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "vcpu.%u.time", cpuinfo[i].number);
+        if (virTypedParamsComposeField(param_name, "vcpu",
+                                       cpuinfo[i].number, "time") < 0)
+            goto cleanup;
         if (virTypedParamsAddULLong(&record->params,
                                     &record->nparams,
                                     maxparams,
                                     param_name,
                                     cpuinfo[i].cpuTime) < 0)
             goto cleanup;
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "vcpu.%u.wait", cpuinfo[i].number);
+        if (virTypedParamsComposeField(param_name, "vcpu",
+                                       cpuinfo[i].number, "wait") < 0)
+            goto cleanup;
         if (virTypedParamsAddULLong(&record->params,
                                     &record->nparams,
                                     maxparams,
@@ -18910,7 +19759,8 @@ qemuDomainGetStatsVcpu(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
 #define QEMU_ADD_COUNT_PARAM(record, maxparams, type, count) \
 do { \
     char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "%s.count", type); \
+    if (virTypedParamsComposeField(param_name, type, -1, "count") < 0) \
+        goto cleanup; \
     if (virTypedParamsAddUInt(&(record)->params, \
                               &(record)->nparams, \
                               maxparams, \
@@ -18922,8 +19772,8 @@ do { \
 #define QEMU_ADD_NAME_PARAM(record, maxparams, type, subtype, num, name) \
 do { \
     char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "%s.%zu.%s", type, num, subtype); \
+    if (virTypedParamsComposeField(param_name, type, num, subtype) < 0) \
+        goto cleanup; \
     if (virTypedParamsAddString(&(record)->params, \
                                 &(record)->nparams, \
                                 maxparams, \
@@ -18935,8 +19785,8 @@ do { \
 #define QEMU_ADD_NET_PARAM(record, maxparams, num, name, value) \
 do { \
     char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "net.%zu.%s", num, name); \
+    if (virTypedParamsComposeField(param_name, "net", num, name) < 0) \
+        return -1; \
     if (value >= 0 && virTypedParamsAddULLong(&(record)->params, \
                                               &(record)->nparams, \
                                               maxparams, \
@@ -19004,8 +19854,9 @@ qemuDomainGetStatsInterface(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
 #define QEMU_ADD_BLOCK_PARAM_UI(record, maxparams, num, name, value) \
     do {                                                             \
         char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];               \
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,           \
-                 "block.%zu.%s", num, name);                         \
+        if (virTypedParamsComposeField(param_name, "block",          \
+                                       num, name) < 0)               \
+            goto cleanup;                                            \
         if (virTypedParamsAddUInt(&(record)->params,                 \
                                   &(record)->nparams,                \
                                   maxparams,                         \
@@ -19018,8 +19869,8 @@ qemuDomainGetStatsInterface(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
 #define QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, num, name, value) \
 do { \
     char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "block.%zu.%s", num, name); \
+    if (virTypedParamsComposeField(param_name, "block", num, name) < 0) \
+        goto cleanup; \
     if (value >= 0 && virTypedParamsAddULLong(&(record)->params, \
                                               &(record)->nparams, \
                                               maxparams, \
@@ -19031,8 +19882,8 @@ do { \
 #define QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, num, name, value) \
 do { \
     char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "block.%zu.%s", num, name); \
+    if (virTypedParamsComposeField(param_name, "block", num, name) < 0) \
+        goto cleanup; \
     if (virTypedParamsAddULLong(&(record)->params, \
                                 &(record)->nparams, \
                                 maxparams, \
@@ -19179,11 +20030,8 @@ qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
 
     if (HAVE_JOB(privflags) && virDomainObjIsActive(dom)) {
         qemuDomainObjEnterMonitor(driver, dom);
-        rc = qemuMonitorGetAllBlockStatsInfo(priv->mon, &stats,
-                                             visitBacking);
-        if (rc >= 0)
-            ignore_value(qemuMonitorBlockStatsUpdateCapacity(priv->mon, stats,
-                                                             visitBacking));
+        rc = qemuMonitorGetAllBlockStatsWithCapacity(priv->mon, &stats,
+                                                     visitBacking);
         if (qemuDomainObjExitMonitor(driver, dom) < 0)
             goto cleanup;
 
@@ -19243,8 +20091,9 @@ qemuDomainGetStatsPerfOneEvent(virPerfPtr perf,
     if (virPerfReadEvent(perf, type, &value) < 0)
         return -1;
 
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "perf.%s",
-             virPerfEventTypeToString(type));
+    if (virTypedParamsComposeField(param_name, "perf", -1,
+                                   virPerfEventTypeToString(type)) < 0)
+        return -1;
 
     if (virTypedParamsAddULLong(&record->params,
                                 &record->nparams,
@@ -19282,6 +20131,65 @@ qemuDomainGetStatsPerf(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
     return ret;
 }
 
+static int
+qemuDomainGetStatsInfo(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
+                       virDomainObjPtr dom,
+                       virDomainStatsRecordPtr record,
+                       int *maxparams,
+                       unsigned int privflags ATTRIBUTE_UNUSED)
+{
+    unsigned long long cpuTime = 0;
+
+    if (virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "info.maxmem",
+                                virDomainDefGetMemoryTotal(dom->def)) < 0)
+        return -1;
+
+    if (virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "info.memory",
+                                dom->def->mem.cur_balloon) < 0)
+        return -1;
+
+    if (virTypedParamsAddUInt(&record->params,
+                              &record->nparams,
+                              maxparams,
+                              "info.vcpus",
+                              virDomainDefGetVcpus(dom->def)) < 0)
+        return -1;
+
+    /* CPU time is only available for running domains; don't fail the
+     * whole record if the kernel stats are temporarily unreadable */
+    if (virDomainObjIsActive(dom) &&
+        virProcessGetStatInfo(&cpuTime, NULL, NULL, dom->pid, 0) == 0 &&
+        virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "info.cputime",
+                                cpuTime) < 0)
+        return -1;
+
+    if (virTypedParamsAddBoolean(&record->params,
+                                 &record->nparams,
+                                 maxparams,
+                                 "info.persistent",
+                                 dom->persistent) < 0)
+        return -1;
+
+    if (virTypedParamsAddBoolean(&record->params,
+                                 &record->nparams,
+                                 maxparams,
+                                 "info.autostart",
+                                 dom->autostart) < 0)
+        return -1;
+
+    return 0;
+}
+
+
 typedef int
 (*qemuDomainGetStatsFunc)(virQEMUDriverPtr driver,
                           virDomainObjPtr dom,
@@ -19303,6 +20211,7 @@ static struct qemuDomainGetStatsWorker qemuDomainGetStatsWorkers[] = {
     { qemuDomainGetStatsInterface, VIR_DOMAIN_STATS_INTERFACE, false },
     { qemuDomainGetStatsBlock, VIR_DOMAIN_STATS_BLOCK, true },
     { qemuDomainGetStatsPerf, VIR_DOMAIN_STATS_PERF, false },
+    { qemuDomainGetStatsInfo, VIR_DOMAIN_STATS_INFO, false },
     { NULL, 0, false }
 };
 
@@ -19349,6 +20258,140 @@ qemuDomainGetStatsNeedMonitor(unsigned int stats)
 }
 
 
+/* Refresh the cached bulk stats of @vm; called from the worker pool
+ * with @vm locked and ref'd by the caller */
+static void
+processRefreshStatsEvent(virQEMUDriverPtr driver,
+                         virDomainObjPtr vm)
+{
+    virDomainStatsRecordPtr tmp = NULL;
+    unsigned int stats = 0;
+    int maxparams = 0;
+    size_t i;
+
+    if (qemuDomainGetStatsCheckSupport(&stats, false) < 0)
+        return;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+        return;
+
+    if (!virDomainObjIsActive(vm))
+        goto endjob;
+
+    if (VIR_ALLOC(tmp) < 0)
+        goto endjob;
+
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
+        if (stats & qemuDomainGetStatsWorkers[i].stats &&
+            qemuDomainGetStatsWorkers[i].func(driver, vm, tmp, &maxparams,
+                                              QEMU_DOMAIN_STATS_HAVE_JOB) < 0)
+            goto endjob;
+    }
+
+    ignore_value(qemuDomainStatsCacheStore(vm, tmp->params, tmp->nparams,
+                                           stats));
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+    if (tmp) {
+        virTypedParamsFree(tmp->params, tmp->nparams);
+        VIR_FREE(tmp);
+    }
+}
+
+
+static int
+qemuDomainStatsPollEnqueue(virDomainObjPtr vm,
+                           void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    struct qemuProcessEvent *processEvent = NULL;
+    unsigned long long now;
+
+    if (!virDomainObjIsActive(vm))
+        return 0;
+
+    if (virTimeMillisNow(&now) < 0)
+        return 0;
+
+    /* Skip domains whose cache was refreshed recently enough, e.g. by
+     * a monitoring client doing full stats queries */
+    if (priv->statsUpdated &&
+        now - priv->statsUpdated < QEMU_DOMAIN_STATS_POLL_INTERVAL * 1000)
+        return 0;
+
+    if (VIR_ALLOC(processEvent) < 0)
+        return 0;
+
+    processEvent->eventType = QEMU_PROCESS_EVENT_REFRESH_STATS;
+    processEvent->vm = vm;
+
+    virObjectRef(vm);
+    if (virThreadPoolSendJob(driver->workerPool, 0, processEvent) < 0) {
+        ignore_value(virObjectUnref(vm));
+        VIR_FREE(processEvent);
+    }
+
+    return 0;
+}
+
+
+static void
+qemuDomainStatsPollTimer(int timer ATTRIBUTE_UNUSED,
+                         void *opaque)
+{
+    virQEMUDriverPtr driver = opaque;
+
+    virDomainObjListForEach(driver->domains, qemuDomainStatsPollEnqueue,
+                            driver);
+}
+
+
+/* Try to satisfy a NOWAIT stats query for @dom from the cache kept in
+ * the domain private data.
+ *
+ * Returns 1 when @record was filled from the cache, 0 when the cache
+ * cannot serve the requested stats groups and -1 on failure.
+ */
+static int
+qemuDomainGetStatsFromCache(virConnectPtr conn,
+                            virDomainObjPtr dom,
+                            unsigned int stats,
+                            virDomainStatsRecordPtr *record)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    virDomainStatsRecordPtr tmp = NULL;
+    int ret = -1;
+
+    if (!priv->statsParams ||
+        priv->statsGroups != stats)
+        return 0;
+
+    if (VIR_ALLOC(tmp) < 0)
+        return -1;
+
+    if (virTypedParamsCopy(&tmp->params, priv->statsParams,
+                           priv->statsNParams) < 0)
+        goto cleanup;
+    tmp->nparams = priv->statsNParams;
+
+    if (!(tmp->dom = virGetDomain(conn, dom->def->name, dom->def->uuid)))
+        goto cleanup;
+
+    *record = tmp;
+    tmp = NULL;
+    ret = 1;
+
+ cleanup:
+    if (tmp) {
+        virTypedParamsFree(tmp->params, tmp->nparams);
+        VIR_FREE(tmp);
+    }
+    return ret;
+}
+
+
 static int
 qemuDomainGetStats(virConnectPtr conn,
                    virDomainObjPtr dom,
@@ -19356,14 +20399,32 @@ qemuDomainGetStats(virConnectPtr conn,
                    virDomainStatsRecordPtr *record,
                    unsigned int flags)
 {
+    qemuDomainObjPrivatePtr priv = dom->privateData;
     int maxparams = 0;
     virDomainStatsRecordPtr tmp;
     size_t i;
+    int estimate;
     int ret = -1;
 
     if (VIR_ALLOC(tmp) < 0)
         goto cleanup;
 
+    /* Preallocate the typed parameter array: the workers add a
+     * handful of fields per vcpu, disk and interface, so sizing the
+     * array up front avoids reallocating and copying it repeatedly
+     * while the record is assembled */
+    estimate = 32 +
+               virDomainDefGetVcpusMax(dom->def) * 3 +
+               dom->def->ndisks * 24 +
+               dom->def->nnets * 10;
+    if (virTypedParamsReserve(&tmp->params, &tmp->nparams,
+                              &maxparams, estimate) < 0)
+        goto cleanup;
+
+    /* Several of the workers read a bunch of cgroup parameters; keep
+     * the controller directory fds cached across the whole record */
+    virCgroupBatchBegin(priv->cgroup);
+
     for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
         if (stats & qemuDomainGetStatsWorkers[i].stats) {
             if (qemuDomainGetStatsWorkers[i].func(conn->privateData, dom, tmp,
@@ -19380,6 +20441,7 @@ qemuDomainGetStats(virConnectPtr conn,
     ret = 0;
 
  cleanup:
+    virCgroupBatchEnd(priv->cgroup);
     if (tmp) {
         virTypedParamsFree(tmp->params, tmp->nparams);
         VIR_FREE(tmp);
@@ -19403,6 +20465,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     size_t nvms;
     virDomainStatsRecordPtr *tmpstats = NULL;
     bool enforce = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
+    bool nowait = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT);
     int nstats = 0;
     size_t i;
     int ret = -1;
@@ -19415,6 +20478,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT |
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING |
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS, -1);
 
@@ -19444,14 +20508,31 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
 
     for (i = 0; i < nvms; i++) {
         virDomainStatsRecordPtr tmp = NULL;
+        int rv;
         domflags = 0;
         vm = vms[i];
 
         virObjectLock(vm);
 
-        if (HAVE_JOB(privflags) &&
-            qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) == 0)
+        if (nowait && !(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)) {
+            /* Serve the cache when it covers the requested groups;
+             * the cache never includes backing chains, and domains
+             * without a usable cache degrade to whatever can be
+             * collected without a job */
+            if ((rv = qemuDomainGetStatsFromCache(conn, vm, stats,
+                                                  &tmp)) < 0) {
+                virObjectUnlock(vm);
+                goto cleanup;
+            }
+            if (rv > 0) {
+                tmpstats[nstats++] = tmp;
+                virObjectUnlock(vm);
+                continue;
+            }
+        } else if (HAVE_JOB(privflags) &&
+                   qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) == 0) {
             domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+        }
         /* else: without a job it's still possible to gather some data */
 
         if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
@@ -19464,9 +20545,17 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
             goto cleanup;
         }
 
-        if (tmp)
+        if (tmp) {
             tmpstats[nstats++] = tmp;
 
+            /* Full collections also refresh the cache for later
+             * NOWAIT queries */
+            if (HAVE_JOB(domflags) &&
+                !(domflags & QEMU_DOMAIN_STATS_BACKING))
+                ignore_value(qemuDomainStatsCacheStore(vm, tmp->params,
+                                                       tmp->nparams, stats));
+        }
+
         if (HAVE_JOB(domflags))
             qemuDomainObjEndJob(driver, vm);
 
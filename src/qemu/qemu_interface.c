@@ -30,8 +30,11 @@
 #include "qemu_interface.h"
 #include "passfd.h"
 #include "viralloc.h"
+#include "virfile.h"
 #include "virlog.h"
+#include "virmacaddr.h"
 #include "virstring.h"
+#include "virthread.h"
 #include "virnetdev.h"
 #include "virnetdevtap.h"
 #include "virnetdevmacvlan.h"
@@ -394,6 +397,421 @@ qemuCreateInBridgePortWithHelper(virQEMUDriverConfigPtr cfg,
 }
 
 
+/* Pool of pre-provisioned TAP devices and vhost-net fds. Creating a
+ * TAP device and enslaving it to a bridge costs several netlink and
+ * ioctl round trips per NIC and they all serialize inside process
+ * startup, which hurts most when many domains boot at once. The pool
+ * keeps a few ready-made TAP devices per recently used bridge plus a
+ * stack of opened vhost-net fds; domain startup claims from the pool
+ * and only has to set the per-domain MAC address, while a background
+ * thread replenishes what was taken. */
+
+/* ready TAP devices kept per bridge */
+#define QEMU_INTERFACE_TAP_POOL_PER_BRIDGE 2
+/* overall cap on pooled TAP devices */
+#define QEMU_INTERFACE_TAP_POOL_MAX 16
+/* number of bridges the pool keeps provisioned */
+#define QEMU_INTERFACE_TAP_POOL_BRIDGES_MAX 8
+/* opened vhost-net fds kept ready */
+#define QEMU_INTERFACE_VHOST_POOL_SIZE 8
+
+typedef struct _qemuInterfacePooledTap qemuInterfacePooledTap;
+typedef qemuInterfacePooledTap *qemuInterfacePooledTapPtr;
+struct _qemuInterfacePooledTap {
+    char *brname;
+    char *ifname;
+    int tapfd;
+    unsigned int flags;    /* virNetDevTapCreateFlags used at creation */
+};
+
+typedef struct _qemuInterfacePoolBridge qemuInterfacePoolBridge;
+struct _qemuInterfacePoolBridge {
+    char *brname;
+    unsigned int flags;
+};
+
+static struct {
+    virMutex lock;
+    bool shuttingDown;
+    bool replenishing;     /* background replenish thread is running */
+    bool vhostBroken;      /* opening /dev/vhost-net failed, stop trying */
+
+    qemuInterfacePooledTapPtr taps[QEMU_INTERFACE_TAP_POOL_MAX];
+    size_t ntaps;
+
+    qemuInterfacePoolBridge bridges[QEMU_INTERFACE_TAP_POOL_BRIDGES_MAX];
+    size_t nbridges;
+
+    int vhostfds[QEMU_INTERFACE_VHOST_POOL_SIZE];
+    size_t nvhostfds;
+} qemuInterfacePool;
+
+static int qemuInterfacePoolOnceInit(void)
+{
+    if (virMutexInit(&qemuInterfacePool.lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize interface pool mutex"));
+        return -1;
+    }
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(qemuInterfacePool)
+
+static void
+qemuInterfacePooledTapFree(qemuInterfacePooledTapPtr tap)
+{
+    if (!tap)
+        return;
+
+    /* a non-persistent TAP device disappears with its fd */
+    VIR_FORCE_CLOSE(tap->tapfd);
+    VIR_FREE(tap->ifname);
+    VIR_FREE(tap->brname);
+    VIR_FREE(tap);
+}
+
+/* count pooled TAP devices for @brname; caller holds the pool lock */
+static size_t
+qemuInterfacePoolCountTaps(const char *brname)
+{
+    size_t count = 0;
+    size_t i;
+
+    for (i = 0; i < qemuInterfacePool.ntaps; i++) {
+        if (STREQ(qemuInterfacePool.taps[i]->brname, brname))
+            count++;
+    }
+
+    return count;
+}
+
+/* drop @brname from the list of provisioned bridges, e.g. after the
+ * bridge went away; caller holds the pool lock */
+static void
+qemuInterfacePoolForgetBridge(const char *brname)
+{
+    size_t i;
+
+    for (i = 0; i < qemuInterfacePool.nbridges; i++) {
+        if (STRNEQ(qemuInterfacePool.bridges[i].brname, brname))
+            continue;
+
+        VIR_FREE(qemuInterfacePool.bridges[i].brname);
+        if (i < qemuInterfacePool.nbridges - 1)
+            qemuInterfacePool.bridges[i] =
+                qemuInterfacePool.bridges[qemuInterfacePool.nbridges - 1];
+        qemuInterfacePool.nbridges--;
+        return;
+    }
+}
+
+static void
+qemuInterfacePoolReplenishWorker(void *opaque ATTRIBUTE_UNUSED)
+{
+    for (;;) {
+        char *brname = NULL;
+        unsigned int flags = 0;
+        bool needVhost = false;
+        size_t i;
+
+        virMutexLock(&qemuInterfacePool.lock);
+
+        if (qemuInterfacePool.shuttingDown) {
+            qemuInterfacePool.replenishing = false;
+            virMutexUnlock(&qemuInterfacePool.lock);
+            return;
+        }
+
+        /* find a bridge below its target */
+        for (i = 0; i < qemuInterfacePool.nbridges; i++) {
+            qemuInterfacePoolBridge *br = &qemuInterfacePool.bridges[i];
+
+            if (qemuInterfacePool.ntaps >= QEMU_INTERFACE_TAP_POOL_MAX)
+                break;
+
+            if (qemuInterfacePoolCountTaps(br->brname) >=
+                QEMU_INTERFACE_TAP_POOL_PER_BRIDGE)
+                continue;
+
+            if (VIR_STRDUP_QUIET(brname, br->brname) < 0)
+                break;
+            flags = br->flags;
+            break;
+        }
+
+        if (!brname &&
+            !qemuInterfacePool.vhostBroken &&
+            qemuInterfacePool.nvhostfds < QEMU_INTERFACE_VHOST_POOL_SIZE)
+            needVhost = true;
+
+        if (!brname && !needVhost) {
+            qemuInterfacePool.replenishing = false;
+            virMutexUnlock(&qemuInterfacePool.lock);
+            return;
+        }
+
+        virMutexUnlock(&qemuInterfacePool.lock);
+
+        if (brname) {
+            qemuInterfacePooledTapPtr tap = NULL;
+            char *ifname = NULL;
+            int tapfd = -1;
+            virMacAddr mac;
+            /* placeholder address; the real one is set at claim time.
+             * CreateInBridgePort flips the first byte to 0xFE so idle
+             * pooled devices never win bridge MAC selection */
+            static const unsigned char prefix[VIR_MAC_PREFIX_BUFLEN] =
+                { 0x52, 0x54, 0x00 };
+
+            virMacAddrGenerate(prefix, &mac);
+
+            if (VIR_STRDUP_QUIET(ifname, VIR_NET_GENERATED_PREFIX "%d") < 0 ||
+                virNetDevTapCreateInBridgePort(brname, &ifname, &mac,
+                                               NULL, NULL, &tapfd, 1,
+                                               NULL, NULL, flags) < 0) {
+                virResetLastError();
+                /* creating for this bridge doesn't work (it may have
+                 * been torn down); stop provisioning it */
+                virMutexLock(&qemuInterfacePool.lock);
+                qemuInterfacePoolForgetBridge(brname);
+                virMutexUnlock(&qemuInterfacePool.lock);
+                VIR_FREE(ifname);
+                VIR_FREE(brname);
+                continue;
+            }
+
+            if (VIR_ALLOC_QUIET(tap) < 0) {
+                VIR_FORCE_CLOSE(tapfd);
+                VIR_FREE(ifname);
+                VIR_FREE(brname);
+                continue;
+            }
+
+            tap->brname = brname;
+            tap->ifname = ifname;
+            tap->tapfd = tapfd;
+            tap->flags = flags;
+
+            virMutexLock(&qemuInterfacePool.lock);
+            if (qemuInterfacePool.shuttingDown ||
+                qemuInterfacePool.ntaps >= QEMU_INTERFACE_TAP_POOL_MAX ||
+                qemuInterfacePoolCountTaps(tap->brname) >=
+                QEMU_INTERFACE_TAP_POOL_PER_BRIDGE) {
+                qemuInterfacePooledTapFree(tap);
+            } else {
+                qemuInterfacePool.taps[qemuInterfacePool.ntaps++] = tap;
+            }
+            virMutexUnlock(&qemuInterfacePool.lock);
+        } else if (needVhost) {
+            int fd = open("/dev/vhost-net", O_RDWR);
+
+            virMutexLock(&qemuInterfacePool.lock);
+            if (fd < 0) {
+                qemuInterfacePool.vhostBroken = true;
+            } else if (qemuInterfacePool.shuttingDown ||
+                       qemuInterfacePool.nvhostfds >=
+                       QEMU_INTERFACE_VHOST_POOL_SIZE) {
+                VIR_FORCE_CLOSE(fd);
+            } else {
+                qemuInterfacePool.vhostfds[qemuInterfacePool.nvhostfds++] = fd;
+            }
+            virMutexUnlock(&qemuInterfacePool.lock);
+        }
+    }
+}
+
+/* start the replenish thread unless it is already running; caller
+ * holds the pool lock */
+static void
+qemuInterfacePoolKickReplenish(void)
+{
+    virThread thread;
+
+    if (qemuInterfacePool.replenishing || qemuInterfacePool.shuttingDown)
+        return;
+
+    qemuInterfacePool.replenishing = true;
+    if (virThreadCreate(&thread, false,
+                        qemuInterfacePoolReplenishWorker, NULL) < 0)
+        qemuInterfacePool.replenishing = false;
+}
+
+/**
+ * qemuInterfacePoolNoteBridge:
+ * @brname: bridge a domain interface was just connected to
+ * @flags: virNetDevTapCreateFlags the connection used
+ *
+ * Remember @brname as worth provisioning and top the pool up in the
+ * background. The pool learns the set of bridges from actual use, so
+ * no configuration is needed and idle bridges don't hold devices.
+ */
+static void
+qemuInterfacePoolNoteBridge(const char *brname,
+                            unsigned int flags)
+{
+    size_t i;
+
+    if (qemuInterfacePoolInitialize() < 0) {
+        virResetLastError();
+        return;
+    }
+
+    virMutexLock(&qemuInterfacePool.lock);
+
+    for (i = 0; i < qemuInterfacePool.nbridges; i++) {
+        if (STREQ(qemuInterfacePool.bridges[i].brname, brname) &&
+            qemuInterfacePool.bridges[i].flags == flags)
+            goto kick;
+    }
+
+    if (qemuInterfacePool.nbridges < QEMU_INTERFACE_TAP_POOL_BRIDGES_MAX) {
+        if (VIR_STRDUP_QUIET(qemuInterfacePool.bridges[qemuInterfacePool.nbridges].brname,
+                             brname) < 0)
+            goto cleanup;
+        qemuInterfacePool.bridges[qemuInterfacePool.nbridges].flags = flags;
+        qemuInterfacePool.nbridges++;
+    }
+
+ kick:
+    qemuInterfacePoolKickReplenish();
+ cleanup:
+    virMutexUnlock(&qemuInterfacePool.lock);
+}
+
+/**
+ * qemuInterfacePoolClaimTap:
+ * @brname: bridge the interface must be connected to
+ * @flags: required virNetDevTapCreateFlags
+ * @guestmac: MAC address of the domain interface
+ * @ifname: filled with the name of the claimed device
+ * @tapfd: filled with the fd of the claimed device
+ *
+ * Try to satisfy a TAP device request from the pool. Only the MAC
+ * address needs to be set on a claimed device; everything else was
+ * done when it was provisioned.
+ *
+ * Returns 0 when a device was claimed, 1 when the pool has no
+ * matching device and the caller should create one the regular way.
+ */
+static int
+qemuInterfacePoolClaimTap(const char *brname,
+                          unsigned int flags,
+                          const virMacAddr *guestmac,
+                          char **ifname,
+                          int *tapfd)
+{
+    qemuInterfacePooledTapPtr tap = NULL;
+    virMacAddr tapmac;
+    size_t i;
+
+    /* the FE-prefix trick below cannot work for such guest MACs;
+     * the regular code path reports the error */
+    if (guestmac->addr[0] == 0xFE)
+        return 1;
+
+    if (qemuInterfacePoolInitialize() < 0) {
+        virResetLastError();
+        return 1;
+    }
+
+    virMutexLock(&qemuInterfacePool.lock);
+    for (i = 0; i < qemuInterfacePool.ntaps; i++) {
+        if (STREQ(qemuInterfacePool.taps[i]->brname, brname) &&
+            qemuInterfacePool.taps[i]->flags == flags) {
+            tap = qemuInterfacePool.taps[i];
+            qemuInterfacePool.taps[i] =
+                qemuInterfacePool.taps[--qemuInterfacePool.ntaps];
+            break;
+        }
+    }
+    virMutexUnlock(&qemuInterfacePool.lock);
+
+    if (!tap)
+        return 1;
+
+    virMacAddrSet(&tapmac, guestmac);
+    tapmac.addr[0] = 0xFE; /* Discourage bridge from using TAP dev MAC */
+
+    if (virNetDevSetMAC(tap->ifname, &tapmac) < 0) {
+        /* something is wrong with the pooled device; throw it away
+         * and have the caller build a fresh one */
+        virResetLastError();
+        qemuInterfacePooledTapFree(tap);
+        return 1;
+    }
+
+    VIR_DEBUG("Claimed pooled tap %s on bridge %s", tap->ifname, brname);
+
+    VIR_FREE(*ifname);
+    *ifname = tap->ifname;
+    tap->ifname = NULL;
+    *tapfd = tap->tapfd;
+    tap->tapfd = -1;
+    qemuInterfacePooledTapFree(tap);
+
+    return 0;
+}
+
+/* Take a pre-opened vhost-net fd from the pool if one is ready.
+ * Returns true when @fd was filled in. */
+static bool
+qemuInterfacePoolClaimVhost(int *fd)
+{
+    bool claimed = false;
+
+    if (qemuInterfacePoolInitialize() < 0) {
+        virResetLastError();
+        return false;
+    }
+
+    virMutexLock(&qemuInterfacePool.lock);
+    if (qemuInterfacePool.nvhostfds) {
+        *fd = qemuInterfacePool.vhostfds[--qemuInterfacePool.nvhostfds];
+        claimed = true;
+        qemuInterfacePoolKickReplenish();
+    }
+    virMutexUnlock(&qemuInterfacePool.lock);
+
+    return claimed;
+}
+
+/**
+ * qemuInterfacePoolShutdown:
+ *
+ * Release all pre-provisioned TAP devices and vhost-net fds and stop
+ * replenishing. Called on driver cleanup.
+ */
+void
+qemuInterfacePoolShutdown(void)
+{
+    size_t i;
+
+    if (qemuInterfacePoolInitialize() < 0) {
+        virResetLastError();
+        return;
+    }
+
+    virMutexLock(&qemuInterfacePool.lock);
+    qemuInterfacePool.shuttingDown = true;
+
+    for (i = 0; i < qemuInterfacePool.ntaps; i++)
+        qemuInterfacePooledTapFree(qemuInterfacePool.taps[i]);
+    qemuInterfacePool.ntaps = 0;
+
+    for (i = 0; i < qemuInterfacePool.nvhostfds; i++)
+        VIR_FORCE_CLOSE(qemuInterfacePool.vhostfds[i]);
+    qemuInterfacePool.nvhostfds = 0;
+
+    for (i = 0; i < qemuInterfacePool.nbridges; i++)
+        VIR_FREE(qemuInterfacePool.bridges[i].brname);
+    qemuInterfacePool.nbridges = 0;
+
+    virMutexUnlock(&qemuInterfacePool.lock);
+}
+
+
 /* qemuInterfaceEthernetConnect:
  * @def: the definition of the VM
  * @driver: qemu driver data
@@ -540,7 +958,23 @@ qemuInterfaceBridgeConnect(virDomainDefPtr def,
         tap_create_flags |= VIR_NETDEV_TAP_CREATE_VNET_HDR;
 
     if (virQEMUDriverIsPrivileged(driver)) {
-        if (virNetDevTapCreateInBridgePort(brname, &net->ifname, &net->mac,
+        /* plain single-queue connections to a bridge carry no
+         * per-domain state besides the MAC address and can be
+         * satisfied from the pre-provisioned device pool */
+        bool poolable = template_ifname &&
+                        !net->backend.tap &&
+                        *tapfdSize == 1 &&
+                        !virDomainNetGetActualVirtPortProfile(net) &&
+                        !virDomainNetGetActualVlan(net);
+        bool pooled = false;
+
+        if (poolable &&
+            qemuInterfacePoolClaimTap(brname, tap_create_flags, &net->mac,
+                                      &net->ifname, tapfd) == 0)
+            pooled = true;
+
+        if (!pooled &&
+            virNetDevTapCreateInBridgePort(brname, &net->ifname, &net->mac,
                                            def->uuid, tunpath, tapfd, *tapfdSize,
                                            virDomainNetGetActualVirtPortProfile(net),
                                            virDomainNetGetActualVlan(net),
@@ -548,6 +982,10 @@ qemuInterfaceBridgeConnect(virDomainDefPtr def,
             virDomainAuditNetDevice(def, net, tunpath, false);
             goto cleanup;
         }
+
+        if (poolable)
+            qemuInterfacePoolNoteBridge(brname, tap_create_flags);
+
         if (virDomainNetGetActualBridgeMACTableManager(net)
             == VIR_NETWORK_BRIDGE_MAC_TABLE_MANAGER_LIBVIRT) {
             /* libvirt is managing the FDB of the bridge this device
@@ -669,6 +1107,10 @@ qemuInterfaceOpenVhostNet(virDomainDefPtr def,
     }
 
     for (i = 0; i < *vhostfdSize; i++) {
+        /* a pre-opened fd from the pool is as good as a fresh one */
+        if (!net->backend.vhost && qemuInterfacePoolClaimVhost(&vhostfd[i]))
+            continue;
+
         vhostfd[i] = open(vhostnet_path, O_RDWR);
 
         /* If the config says explicitly to use vhost and we couldn't open it,
@@ -58,4 +58,6 @@ int qemuInterfaceOpenVhostNet(virDomainDefPtr def,
                               virQEMUCapsPtr qemuCaps,
                               int *vhostfd,
                               size_t *vhostfdSize);
+
+void qemuInterfacePoolShutdown(void);
 #endif /* __QEMU_INTERFACE_H__ */
@@ -1749,7 +1749,8 @@ qemuMigrationStartNBDServer(virQEMUDriverPtr driver,
     int ret = -1;
     qemuDomainObjPrivatePtr priv = vm->privateData;
     unsigned short port = 0;
-    char *diskAlias = NULL;
+    char **diskAliases = NULL;
+    size_t naliases = 0;
     size_t i;
 
     if (nbdPort < 0 || nbdPort > USHRT_MAX) {
@@ -1758,6 +1759,11 @@ qemuMigrationStartNBDServer(virQEMUDriverPtr driver,
         return -1;
     }
 
+    /* Resolve all exports up front so the monitor only needs to be
+     * entered once for the server start and every disk */
+    if (VIR_ALLOC_N(diskAliases, vm->def->ndisks) < 0)
+        return -1;
+
     for (i = 0; i < vm->def->ndisks; i++) {
         virDomainDiskDefPtr disk = vm->def->disks[i];
 
@@ -1765,35 +1771,42 @@ qemuMigrationStartNBDServer(virQEMUDriverPtr driver,
         if (!qemuMigrateDisk(disk, nmigrate_disks, migrate_disks))
             continue;
 
-        VIR_FREE(diskAlias);
-        if (!(diskAlias = qemuAliasFromDisk(disk)))
+        if (!(diskAliases[naliases] = qemuAliasFromDisk(disk)))
             goto cleanup;
+        naliases++;
+    }
 
-        if (qemuDomainObjEnterMonitorAsync(driver, vm,
-                                           QEMU_ASYNC_JOB_MIGRATION_IN) < 0)
-            goto cleanup;
+    if (naliases == 0) {
+        priv->nbdPort = 0;
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (nbdPort)
+        port = nbdPort;
+    else if (virPortAllocatorAcquire(driver->migrationPorts, &port) < 0)
+        goto cleanup;
 
-        if (port == 0) {
-            if (nbdPort)
-                port = nbdPort;
-            else if (virPortAllocatorAcquire(driver->migrationPorts, &port) < 0)
-                goto exit_monitor;
+    if (qemuDomainObjEnterMonitorAsync(driver, vm,
+                                       QEMU_ASYNC_JOB_MIGRATION_IN) < 0)
+        goto cleanup;
 
-            if (qemuMonitorNBDServerStart(priv->mon, listenAddr, port) < 0)
-                goto exit_monitor;
-        }
+    if (qemuMonitorNBDServerStart(priv->mon, listenAddr, port) < 0)
+        goto exit_monitor;
 
-        if (qemuMonitorNBDServerAdd(priv->mon, diskAlias, true) < 0)
+    for (i = 0; i < naliases; i++) {
+        if (qemuMonitorNBDServerAdd(priv->mon, diskAliases[i], true) < 0)
             goto exit_monitor;
-        if (qemuDomainObjExitMonitor(driver, vm) < 0)
-            goto cleanup;
     }
 
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        goto cleanup;
+
     priv->nbdPort = port;
     ret = 0;
 
  cleanup:
-    VIR_FREE(diskAlias);
+    virStringFreeListCount(diskAliases, naliases);
     if (ret < 0 && nbdPort == 0)
         virPortAllocatorRelease(driver->migrationPorts, port);
     return ret;
@@ -2753,6 +2766,14 @@ qemuMigrationCompleted(virQEMUDriverPtr driver,
 }
 
 
+/* Time with no decrease in remaining memory before a migration is
+ * considered stalled */
+#define QEMU_MIGRATION_STALL_TIMEOUT (30 * 1000ull)
+
+/* How often to sample migration stats while watching a post-copy
+ * enabled migration for the switchover point */
+#define QEMU_MIGRATION_POSTCOPY_CHECK_INTERVAL 1000ull
+
 /* Returns 0 on success, -2 when migration needs to be cancelled, or -1 when
  * QEMU reports failed migration.
  */
@@ -2766,6 +2787,10 @@ qemuMigrationWaitForCompletion(virQEMUDriverPtr driver,
     qemuDomainObjPrivatePtr priv = vm->privateData;
     qemuDomainJobInfoPtr jobInfo = priv->job.current;
     bool events = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_EVENT);
+    unsigned long long lowestRemaining = 0;
+    unsigned long long lastProgress = 0;
+    bool warnedStall = false;
+    bool switchedPostCopy = false;
     int rv;
 
     flags |= QEMU_MIGRATION_COMPLETED_UPDATE_STATS;
@@ -2776,8 +2801,72 @@ qemuMigrationWaitForCompletion(virQEMUDriverPtr driver,
         if (rv < 0)
             return rv;
 
+        /* Track the low-water mark of remaining memory to spot a
+         * migration whose dirtying rate outruns the transfer rate.
+         * Once pre-copy has made no progress for a while either hand
+         * over to post-copy (when the caller enabled it) or flag the
+         * stall for the operator. */
+        if (jobInfo->stats.status == QEMU_MONITOR_MIGRATION_STATUS_ACTIVE) {
+            unsigned long long remaining = jobInfo->stats.ram_remaining;
+            unsigned long long now;
+
+            if (virTimeMillisNow(&now) < 0)
+                return -2;
+
+            if (lastProgress == 0 ||
+                lowestRemaining == 0 ||
+                remaining < lowestRemaining) {
+                lowestRemaining = remaining;
+                lastProgress = now;
+            } else if (now - lastProgress > QEMU_MIGRATION_STALL_TIMEOUT) {
+                if (flags & QEMU_MIGRATION_COMPLETED_POSTCOPY &&
+                    !switchedPostCopy) {
+                    VIR_INFO("Migration of domain %s is not converging "
+                             "(%llu bytes of memory remain); "
+                             "switching to post-copy",
+                             vm->def->name, remaining);
+                    if (qemuDomainObjEnterMonitorAsync(driver, vm,
+                                                       asyncJob) < 0)
+                        return -2;
+                    rv = qemuMonitorMigrateStartPostCopy(priv->mon);
+                    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+                        return -2;
+                    if (rv < 0)
+                        VIR_WARN("Unable to switch migration of domain %s "
+                                 "to post-copy", vm->def->name);
+                    switchedPostCopy = true;
+                } else if (!warnedStall) {
+                    VIR_WARN("Migration of domain %s is not converging: "
+                             "%llu bytes of memory still remain; consider "
+                             "VIR_MIGRATE_AUTO_CONVERGE or VIR_MIGRATE_POSTCOPY",
+                             vm->def->name, remaining);
+                    warnedStall = true;
+                }
+                lastProgress = now;
+            }
+        }
+
         if (events) {
-            if (virDomainObjWait(vm) < 0) {
+            if (flags & QEMU_MIGRATION_COMPLETED_POSTCOPY &&
+                !switchedPostCopy) {
+                /* The stall tracker needs periodic stats, which the
+                 * migration events do not carry; wake up regularly and
+                 * refresh them from query-migrate */
+                unsigned long long now;
+
+                if (virTimeMillisNow(&now) < 0)
+                    return -2;
+
+                rv = virDomainObjWaitUntil(vm, now +
+                                           QEMU_MIGRATION_POSTCOPY_CHECK_INTERVAL);
+                if (rv < 0) {
+                    jobInfo->type = VIR_DOMAIN_JOB_FAILED;
+                    return -2;
+                }
+                if (rv == 1 &&
+                    qemuMigrationUpdateJobStatus(driver, vm, asyncJob) < 0)
+                    return -2;
+            } else if (virDomainObjWait(vm) < 0) {
                 jobInfo->type = VIR_DOMAIN_JOB_FAILED;
                 return -2;
             }
@@ -4358,8 +4447,6 @@ struct _qemuMigrationSpec {
     } fwd;
 };
 
-#define TUNNEL_SEND_BUF_SIZE 65536
-
 typedef struct _qemuMigrationIOThread qemuMigrationIOThread;
 typedef qemuMigrationIOThread *qemuMigrationIOThreadPtr;
 struct _qemuMigrationIOThread {
@@ -4369,6 +4456,7 @@ struct _qemuMigrationIOThread {
     virError err;
     int wakeupRecvFD;
     int wakeupSendFD;
+    size_t bufferSize;
 };
 
 static void qemuMigrationIOFunc(void *arg)
@@ -4382,7 +4470,7 @@ static void qemuMigrationIOFunc(void *arg)
     VIR_DEBUG("Running migration tunnel; stream=%p, sock=%d",
               data->st, data->sock);
 
-    if (VIR_ALLOC_N(buffer, TUNNEL_SEND_BUF_SIZE) < 0)
+    if (VIR_ALLOC_N(buffer, data->bufferSize) < 0)
         goto abrt;
 
     fds[0].fd = data->sock;
@@ -4434,7 +4522,7 @@ static void qemuMigrationIOFunc(void *arg)
         if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
             int nbytes;
 
-            nbytes = saferead(data->sock, buffer, TUNNEL_SEND_BUF_SIZE);
+            nbytes = saferead(data->sock, buffer, data->bufferSize);
             if (nbytes > 0) {
                 if (virStreamSend(data->st, buffer, nbytes) < 0)
                     goto error;
@@ -4482,7 +4570,8 @@ static void qemuMigrationIOFunc(void *arg)
 
 static qemuMigrationIOThreadPtr
 qemuMigrationStartTunnel(virStreamPtr st,
-                         int sock)
+                         int sock,
+                         size_t bufferSize)
 {
     qemuMigrationIOThreadPtr io = NULL;
     int wakeupFD[2] = { -1, -1 };
@@ -4500,6 +4589,7 @@ qemuMigrationStartTunnel(virStreamPtr st,
     io->sock = sock;
     io->wakeupRecvFD = wakeupFD[0];
     io->wakeupSendFD = wakeupFD[1];
+    io->bufferSize = bufferSize;
 
     if (virThreadCreate(&io->thread, true,
                         qemuMigrationIOFunc,
@@ -4826,7 +4916,12 @@ qemuMigrationRun(virQEMUDriverPtr driver,
     }
 
     if (spec->fwdType != MIGRATION_FWD_DIRECT) {
-        if (!(iothread = qemuMigrationStartTunnel(spec->fwd.stream, fd)))
+        virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+        size_t bufferSize = cfg->migrationTunnelBufferSize;
+
+        virObjectUnref(cfg);
+        if (!(iothread = qemuMigrationStartTunnel(spec->fwd.stream, fd,
+                                                  bufferSize)))
             goto cancel;
         /* If we've created a tunnel, then the 'fd' will be closed in the
          * qemuMigrationIOFunc as data->sock.
@@ -5618,6 +5713,112 @@ static virConnectAuth virConnectAuthConfig = {
 };
 
 
+/* Pool of idle destination connections kept between consecutive
+ * peer-to-peer migrations, so evacuating many domains to the same host
+ * pays the connection handshake and feature negotiation only once.
+ * A pooled connection is owned by exactly one migration at a time. */
+#define QEMU_MIGRATION_CONN_CACHE_MAX 4
+#define QEMU_MIGRATION_CONN_CACHE_TTL 30
+
+typedef struct _qemuMigrationConnCacheEntry qemuMigrationConnCacheEntry;
+struct _qemuMigrationConnCacheEntry {
+    char *uri;
+    virConnectPtr conn;
+    time_t lastUsed;
+    bool p2p;
+    bool v3proto;
+    bool useParams;
+    int offline; /* -1 if not probed yet */
+};
+
+static virMutex qemuMigrationConnCacheLock = VIR_MUTEX_INITIALIZER;
+static qemuMigrationConnCacheEntry
+    qemuMigrationConnCache[QEMU_MIGRATION_CONN_CACHE_MAX];
+
+
+static virConnectPtr
+qemuMigrationConnCacheGet(const char *uri,
+                          bool *p2p,
+                          bool *v3proto,
+                          bool *useParams,
+                          int *offline)
+{
+    virConnectPtr conns[QEMU_MIGRATION_CONN_CACHE_MAX];
+    size_t nconns = 0;
+    virConnectPtr ret = NULL;
+    time_t now = time(NULL);
+    size_t i;
+
+    virMutexLock(&qemuMigrationConnCacheLock);
+    for (i = 0; i < QEMU_MIGRATION_CONN_CACHE_MAX; i++) {
+        qemuMigrationConnCacheEntry *entry = &qemuMigrationConnCache[i];
+
+        if (!entry->conn)
+            continue;
+
+        if (now - entry->lastUsed > QEMU_MIGRATION_CONN_CACHE_TTL) {
+            /* Closing a connection does remote I/O; do it after
+             * dropping the lock */
+            conns[nconns++] = entry->conn;
+            entry->conn = NULL;
+            VIR_FREE(entry->uri);
+            continue;
+        }
+
+        if (!ret && STREQ(entry->uri, uri)) {
+            ret = entry->conn;
+            *p2p = entry->p2p;
+            *v3proto = entry->v3proto;
+            *useParams = entry->useParams;
+            *offline = entry->offline;
+            entry->conn = NULL;
+            VIR_FREE(entry->uri);
+        }
+    }
+    virMutexUnlock(&qemuMigrationConnCacheLock);
+
+    for (i = 0; i < nconns; i++)
+        virObjectUnref(conns[i]);
+
+    VIR_DEBUG("uri=%s conn=%p", uri, ret);
+    return ret;
+}
+
+
+/* Takes ownership of the caller's reference to @conn, whether or not
+ * the connection ends up in the pool */
+static void
+qemuMigrationConnCachePut(const char *uri,
+                          virConnectPtr conn,
+                          bool p2p,
+                          bool v3proto,
+                          bool useParams,
+                          int offline)
+{
+    qemuMigrationConnCacheEntry *free_entry = NULL;
+    size_t i;
+
+    virMutexLock(&qemuMigrationConnCacheLock);
+    for (i = 0; i < QEMU_MIGRATION_CONN_CACHE_MAX && !free_entry; i++) {
+        if (!qemuMigrationConnCache[i].conn)
+            free_entry = &qemuMigrationConnCache[i];
+    }
+
+    if (free_entry && VIR_STRDUP_QUIET(free_entry->uri, uri) > 0) {
+        free_entry->conn = conn;
+        free_entry->lastUsed = time(NULL);
+        free_entry->p2p = p2p;
+        free_entry->v3proto = v3proto;
+        free_entry->useParams = useParams;
+        free_entry->offline = offline;
+        conn = NULL;
+    }
+    virMutexUnlock(&qemuMigrationConnCacheLock);
+
+    virObjectUnref(conn);
+}
+
+
 static int doPeer2PeerMigrate(virQEMUDriverPtr driver,
                               virConnectPtr sconn,
                               virDomainObjPtr vm,
@@ -5639,11 +5840,13 @@ static int doPeer2PeerMigrate(virQEMUDriverPtr driver,
 {
     int ret = -1;
     virConnectPtr dconn = NULL;
-    bool p2p;
+    bool p2p = false;
     virErrorPtr orig_err = NULL;
     bool offline = false;
+    int offlineCap = -1;
+    bool dconnReused = false;
     virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
-    bool useParams;
+    bool useParams = false;
 
     VIR_DEBUG("driver=%p, sconn=%p, vm=%p, xmlin=%s, dconnuri=%s, uri=%s, "
               "graphicsuri=%s, listenAddress=%s, nmigrate_disks=%zu, "
@@ -5680,7 +5883,18 @@ static int doPeer2PeerMigrate(virQEMUDriverPtr driver,
      */
 
     qemuDomainObjEnterRemote(vm);
-    dconn = virConnectOpenAuth(dconnuri, &virConnectAuthConfig, 0);
+    if ((dconn = qemuMigrationConnCacheGet(dconnuri, &p2p, v3proto,
+                                           &useParams, &offlineCap))) {
+        if (virConnectIsAlive(dconn) == 1) {
+            dconnReused = true;
+        } else {
+            virObjectUnref(dconn);
+            dconn = NULL;
+            virResetLastError();
+        }
+    }
+    if (!dconn)
+        dconn = virConnectOpenAuth(dconnuri, &virConnectAuthConfig, 0);
     qemuDomainObjExitRemote(vm);
     if (dconn == NULL) {
         virReportError(VIR_ERR_OPERATION_FAILED,
@@ -5690,7 +5904,8 @@ static int doPeer2PeerMigrate(virQEMUDriverPtr driver,
         return -1;
     }
 
-    if (virConnectSetKeepAlive(dconn, cfg->keepAliveInterval,
+    if (!dconnReused &&
+        virConnectSetKeepAlive(dconn, cfg->keepAliveInterval,
                                cfg->keepAliveCount) < 0)
         goto cleanup;
 
@@ -5699,21 +5914,30 @@ static int doPeer2PeerMigrate(virQEMUDriverPtr driver,
         goto cleanup;
     }
 
-    qemuDomainObjEnterRemote(vm);
-    p2p = VIR_DRV_SUPPORTS_FEATURE(dconn->driver, dconn,
-                                   VIR_DRV_FEATURE_MIGRATION_P2P);
-        /* v3proto reflects whether the caller used Perform3, but with
-         * p2p migrate, regardless of whether Perform2 or Perform3
-         * were used, we decide protocol based on what target supports
-         */
-    *v3proto = VIR_DRV_SUPPORTS_FEATURE(dconn->driver, dconn,
-                                        VIR_DRV_FEATURE_MIGRATION_V3);
-    useParams = VIR_DRV_SUPPORTS_FEATURE(dconn->driver, dconn,
-                                         VIR_DRV_FEATURE_MIGRATION_PARAMS);
-    if (flags & VIR_MIGRATE_OFFLINE)
-        offline = VIR_DRV_SUPPORTS_FEATURE(dconn->driver, dconn,
-                                           VIR_DRV_FEATURE_MIGRATION_OFFLINE);
-    qemuDomainObjExitRemote(vm);
+    if (!dconnReused) {
+        qemuDomainObjEnterRemote(vm);
+        p2p = VIR_DRV_SUPPORTS_FEATURE(dconn->driver, dconn,
+                                       VIR_DRV_FEATURE_MIGRATION_P2P);
+            /* v3proto reflects whether the caller used Perform3, but with
+             * p2p migrate, regardless of whether Perform2 or Perform3
+             * were used, we decide protocol based on what target supports
+             */
+        *v3proto = VIR_DRV_SUPPORTS_FEATURE(dconn->driver, dconn,
+                                            VIR_DRV_FEATURE_MIGRATION_V3);
+        useParams = VIR_DRV_SUPPORTS_FEATURE(dconn->driver, dconn,
+                                             VIR_DRV_FEATURE_MIGRATION_PARAMS);
+        qemuDomainObjExitRemote(vm);
+    }
+
+    if (flags & VIR_MIGRATE_OFFLINE) {
+        if (offlineCap == -1) {
+            qemuDomainObjEnterRemote(vm);
+            offlineCap = VIR_DRV_SUPPORTS_FEATURE(dconn->driver, dconn,
+                                                  VIR_DRV_FEATURE_MIGRATION_OFFLINE);
+            qemuDomainObjExitRemote(vm);
+        }
+        offline = offlineCap == 1;
+    }
 
     if (!p2p) {
         virReportError(VIR_ERR_OPERATION_FAILED, "%s",
@@ -5766,7 +5990,13 @@ static int doPeer2PeerMigrate(virQEMUDriverPtr driver,
     orig_err = virSaveLastError();
     qemuDomainObjEnterRemote(vm);
     virConnectUnregisterCloseCallback(dconn, qemuMigrationConnectionClosed);
-    virObjectUnref(dconn);
+    /* Keep the connection around for the next migration to the same
+     * destination, but only when this one ended cleanly */
+    if (ret == 0)
+        qemuMigrationConnCachePut(dconnuri, dconn, p2p, *v3proto,
+                                  useParams, offlineCap);
+    else
+        virObjectUnref(dconn);
     qemuDomainObjExitRemote(vm);
     if (orig_err) {
         virSetError(orig_err);
@@ -43,6 +43,7 @@
 #include "virprobe.h"
 #include "virstring.h"
 #include "virtime.h"
+#include "virmetrics.h"
 
 #ifdef WITH_DTRACE_PROBES
 # include "libvirt_qemu_probes.h"
@@ -162,6 +163,10 @@ static int qemuMonitorOnceInit(void)
 VIR_ONCE_GLOBAL_INIT(qemuMonitor)
 
 
+VIR_ENUM_IMPL(qemuMonitorDumpStatus,
+              QEMU_MONITOR_DUMP_STATUS_LAST,
+              "none", "active", "completed", "failed")
+
 VIR_ENUM_IMPL(qemuMonitorMigrationStatus,
               QEMU_MONITOR_MIGRATION_STATUS_LAST,
               "inactive", "setup",
@@ -745,7 +750,7 @@ qemuMonitorIO(int watch, int fd, int events, void *opaque)
          * then wakeup that waiter */
         if (mon->msg && !mon->msg->finished) {
             mon->msg->finished = 1;
-            virCondSignal(&mon->notify);
+            virCondBroadcast(&mon->notify);
         }
     }
 
@@ -759,7 +764,7 @@ qemuMonitorIO(int watch, int fd, int events, void *opaque)
         virDomainObjPtr vm = mon->vm;
 
         /* Make sure anyone waiting wakes up now */
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
         virObjectUnlock(mon);
         VIR_DEBUG("Triggering EOF callback");
         (eofNotify)(mon, vm, mon->callbackOpaque);
@@ -769,7 +774,7 @@ qemuMonitorIO(int watch, int fd, int events, void *opaque)
         virDomainObjPtr vm = mon->vm;
 
         /* Make sure anyone waiting wakes up now */
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
         virObjectUnlock(mon);
         VIR_DEBUG("Triggering error callback");
         (errorNotify)(mon, vm, mon->callbackOpaque);
@@ -963,7 +968,7 @@ qemuMonitorClose(qemuMonitorPtr mon)
             }
         }
         mon->msg->finished = 1;
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
     }
 
     /* Propagate existing monitor error in case the current thread has no
@@ -992,6 +997,8 @@ qemuMonitorSend(qemuMonitorPtr mon,
                 qemuMonitorMessagePtr msg)
 {
     int ret = -1;
+    unsigned long long start = 0;
+    unsigned long long end;
 
     /* Check whether qemu quit unexpectedly */
     if (mon->lastError.code != VIR_ERR_OK) {
@@ -1001,6 +1008,24 @@ qemuMonitorSend(qemuMonitorPtr mon,
         return -1;
     }
 
+    /* Query jobs share the domain job slot, so several threads can
+     * arrive here concurrently; the monitor protocol only supports a
+     * single in-flight command, so queue for the message slot instead
+     * of overwriting an earlier sender's message */
+    while (mon->msg) {
+        if (virCondWait(&mon->notify, &mon->parent.lock) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to wait on monitor condition"));
+            return -1;
+        }
+        if (mon->lastError.code != VIR_ERR_OK) {
+            VIR_DEBUG("Monitor error arrived while queued for send: %s",
+                      NULLSTR(mon->lastError.message));
+            virSetError(&mon->lastError);
+            return -1;
+        }
+    }
+
     mon->msg = msg;
     qemuMonitorUpdateWatch(mon);
 
@@ -1008,6 +1033,9 @@ qemuMonitorSend(qemuMonitorPtr mon,
           "mon=%p msg=%s fd=%d",
           mon, mon->msg->txBuffer, mon->msg->txFD);
 
+    if (virTimeMillisNowRaw(&start) < 0)
+        start = 0;
+
     while (!mon->msg->finished) {
         if (virCondWait(&mon->notify, &mon->parent.lock) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -1016,6 +1044,9 @@ qemuMonitorSend(qemuMonitorPtr mon,
         }
     }
 
+    if (start && virTimeMillisNowRaw(&end) == 0)
+        virMetricsRecord(VIR_METRICS_QEMU_MONITOR_SEND, end - start);
+
     if (mon->lastError.code != VIR_ERR_OK) {
         VIR_DEBUG("Send command resulted in error %s",
                   NULLSTR(mon->lastError.message));
@@ -1028,6 +1059,8 @@ qemuMonitorSend(qemuMonitorPtr mon,
  cleanup:
     mon->msg = NULL;
     qemuMonitorUpdateWatch(mon);
+    /* Wake any threads queued for the message slot */
+    virCondBroadcast(&mon->notify);
 
     return ret;
 }
@@ -2139,6 +2172,59 @@ qemuMonitorGetAllBlockStatsInfo(qemuMonitorPtr mon,
 }
 
 
+/**
+ * qemuMonitorGetAllBlockStatsWithCapacity:
+ * @mon: monitor object
+ * @ret_stats: pointer that is filled with a hash table containing the stats
+ * @backingChain: recurse into the backing chain of devices
+ *
+ * Like qemuMonitorGetAllBlockStatsInfo followed by
+ * qemuMonitorBlockStatsUpdateCapacity, but on the JSON monitor both
+ * queries are written in one batch so the caller pays for a single
+ * monitor roundtrip. The text monitor cannot report image capacity,
+ * so there the stats are returned without it.
+ *
+ * Returns < 0 on error, count of supported block stats fields on success.
+ */
+int
+qemuMonitorGetAllBlockStatsWithCapacity(qemuMonitorPtr mon,
+                                        virHashTablePtr *ret_stats,
+                                        bool backingChain)
+{
+    int ret = -1;
+    VIR_DEBUG("ret_stats=%p, backing=%d", ret_stats, backingChain);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    if (!(*ret_stats = virHashCreate(10, virHashValueFree)))
+        goto error;
+
+    if (mon->json) {
+        ret = qemuMonitorJSONGetAllBlockStatsAndCapacity(mon, *ret_stats,
+                                                         backingChain);
+    } else {
+         if (backingChain) {
+             virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                            _("text monitor doesn't support block stats for "
+                              "backing chain members"));
+             goto error;
+         }
+
+         ret = qemuMonitorTextGetAllBlockStatsInfo(mon, *ret_stats);
+    }
+
+    if (ret < 0)
+        goto error;
+
+    return ret;
+
+ error:
+    virHashFree(*ret_stats);
+    *ret_stats = NULL;
+    return -1;
+}
+
+
 /* Updates "stats" to fill virtual and physical size of the image */
 int
 qemuMonitorBlockStatsUpdateCapacity(qemuMonitorPtr mon,
@@ -2610,17 +2696,28 @@ qemuMonitorGetDumpGuestMemoryCapability(qemuMonitorPtr mon,
 
 
 int
-qemuMonitorDumpToFd(qemuMonitorPtr mon, int fd, const char *dumpformat)
+qemuMonitorQueryDump(qemuMonitorPtr mon,
+                     qemuMonitorDumpStats *stats)
+{
+    QEMU_CHECK_MONITOR_JSON(mon);
+
+    return qemuMonitorJSONQueryDump(mon, stats);
+}
+
+
+int
+qemuMonitorDumpToFd(qemuMonitorPtr mon, int fd, const char *dumpformat,
+                    bool detach)
 {
     int ret;
-    VIR_DEBUG("fd=%d dumpformat=%s", fd, dumpformat);
+    VIR_DEBUG("fd=%d dumpformat=%s detach=%d", fd, dumpformat, detach);
 
     QEMU_CHECK_MONITOR_JSON(mon);
 
     if (qemuMonitorSendFileHandle(mon, "dump", fd) < 0)
         return -1;
 
-    ret = qemuMonitorJSONDump(mon, "fd:dump", dumpformat);
+    ret = qemuMonitorJSONDump(mon, "fd:dump", dumpformat, detach);
 
     if (ret < 0) {
         if (qemuMonitorCloseFileHandle(mon, "dump") < 0)
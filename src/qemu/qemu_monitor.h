@@ -60,6 +60,13 @@ struct _qemuMonitorMessage {
     int rxLength;
     /* Used by the JSON monitor to hold reply / error */
     void *rxObject;
+    /* Used by the JSON monitor when several commands were written to
+     * txBuffer in one batch: replies collected so far in arrival
+     * order, and how many are still outstanding before the sender
+     * gets woken up */
+    void **rxObjects;
+    size_t nrxObjects;
+    size_t rxPending;
 
     /* True if rxBuffer / rxObject are ready, or a
      * fatal error occurred on the monitor channel
@@ -492,6 +499,11 @@ int qemuMonitorBlockStatsUpdateCapacity(qemuMonitorPtr mon,
                                         bool backingChain)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 
+int qemuMonitorGetAllBlockStatsWithCapacity(qemuMonitorPtr mon,
+                                            virHashTablePtr *ret_stats,
+                                            bool backingChain)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
 int qemuMonitorBlockResize(qemuMonitorPtr mon,
                            const char *dev_name,
                            unsigned long long size);
@@ -607,6 +619,7 @@ struct _qemuMonitorMigrationStats {
     unsigned long long ram_normal_bytes;
     unsigned long long ram_dirty_rate;
     unsigned long long ram_iteration;
+    unsigned long long ram_postcopy_reqs;
 
     unsigned long long disk_transferred;
     unsigned long long disk_remaining;
@@ -680,9 +693,31 @@ int qemuMonitorMigrateCancel(qemuMonitorPtr mon);
 int qemuMonitorGetDumpGuestMemoryCapability(qemuMonitorPtr mon,
                                             const char *capability);
 
+typedef enum {
+    QEMU_MONITOR_DUMP_STATUS_NONE,
+    QEMU_MONITOR_DUMP_STATUS_ACTIVE,
+    QEMU_MONITOR_DUMP_STATUS_COMPLETED,
+    QEMU_MONITOR_DUMP_STATUS_FAILED,
+
+    QEMU_MONITOR_DUMP_STATUS_LAST,
+} qemuMonitorDumpStatus;
+
+VIR_ENUM_DECL(qemuMonitorDumpStatus)
+
+typedef struct _qemuMonitorDumpStats qemuMonitorDumpStats;
+struct _qemuMonitorDumpStats {
+    int status; /* qemuMonitorDumpStatus */
+    unsigned long long completed; /* bytes written */
+    unsigned long long total; /* total expected bytes */
+};
+
+int qemuMonitorQueryDump(qemuMonitorPtr mon,
+                         qemuMonitorDumpStats *stats);
+
 int qemuMonitorDumpToFd(qemuMonitorPtr mon,
                         int fd,
-                        const char *dumpformat);
+                        const char *dumpformat,
+                        bool detach);
 
 int qemuMonitorGraphicsRelocate(qemuMonitorPtr mon,
                                 int type,
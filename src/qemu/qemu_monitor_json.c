@@ -190,7 +190,7 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
 
     VIR_DEBUG("Line [%s]", line);
 
-    if (!(obj = virJSONValueFromString(line)))
+    if (!(obj = virJSONValueFromStringArena(line)))
         goto cleanup;
 
     if (obj->type != VIR_JSON_TYPE_OBJECT) {
@@ -209,7 +209,13 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
                virJSONValueObjectHasKey(obj, "return") == 1) {
         PROBE(QEMU_MONITOR_RECV_REPLY,
               "mon=%p reply=%s", mon, line);
-        if (msg) {
+        if (msg && msg->rxObjects && msg->rxPending) {
+            msg->rxObjects[msg->nrxObjects++] = obj;
+            if (--msg->rxPending == 0)
+                msg->finished = 1;
+            obj = NULL;
+            ret = 0;
+        } else if (msg && !msg->rxObjects) {
             msg->rxObject = obj;
             msg->finished = 1;
             obj = NULL;
@@ -328,6 +334,121 @@ qemuMonitorJSONCommand(qemuMonitorPtr mon,
     return qemuMonitorJSONCommandWithFd(mon, cmd, -1, reply);
 }
 
+
+/* Writes @ncmds commands into the monitor in one buffer and waits for
+ * all of their replies with a single wakeup, saving one monitor
+ * roundtrip per extra command. The commands must be independent of
+ * each other; qemu executes them in order even if an earlier one
+ * fails, so errors are only reported via the individual replies.
+ *
+ * @replies must point to an array of @ncmds NULL pointers; on success
+ * each element holds the reply to the corresponding command.
+ */
+static int
+qemuMonitorJSONCommandBatch(qemuMonitorPtr mon,
+                            virJSONValuePtr *cmds,
+                            virJSONValuePtr *replies,
+                            size_t ncmds)
+{
+    int ret = -1;
+    qemuMonitorMessage msg;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char **ids = NULL;
+    char *cmdstr = NULL;
+    size_t i;
+
+    if (ncmds == 0)
+        return 0;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.txFD = -1;
+
+    if (VIR_ALLOC_N(ids, ncmds) < 0 ||
+        VIR_ALLOC_N(msg.rxObjects, ncmds) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ncmds; i++) {
+        if (!(ids[i] = qemuMonitorNextCommandID(mon)))
+            goto cleanup;
+        if (virJSONValueObjectAppendString(cmds[i], "id", ids[i]) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to append command 'id' string"));
+            goto cleanup;
+        }
+        if (!(cmdstr = virJSONValueToString(cmds[i], false)))
+            goto cleanup;
+        virBufferAsprintf(&buf, "%s\r\n", cmdstr);
+        VIR_FREE(cmdstr);
+    }
+
+    if (virBufferCheckError(&buf) < 0)
+        goto cleanup;
+
+    msg.txLength = virBufferUse(&buf);
+    msg.txBuffer = virBufferContentAndReset(&buf);
+    msg.rxPending = ncmds;
+
+    VIR_DEBUG("Send batch of %zu commands '%s'", ncmds, msg.txBuffer);
+
+    if (qemuMonitorSend(mon, &msg) < 0)
+        goto cleanup;
+
+    if (msg.nrxObjects != ncmds) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Missing monitor reply object"));
+        goto cleanup;
+    }
+
+    /* Correlate the replies with the commands via their 'id'; fall
+     * back to the arrival order for replies lacking one */
+    for (i = 0; i < ncmds; i++) {
+        virJSONValuePtr obj = msg.rxObjects[i];
+        const char *id = virJSONValueObjectGetString(obj, "id");
+        size_t slot = i;
+
+        if (id) {
+            for (slot = 0; slot < ncmds; slot++) {
+                if (STREQ(id, ids[slot]))
+                    break;
+            }
+        }
+
+        if (slot == ncmds || replies[slot]) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unexpected 'id' '%s' in monitor batch reply"),
+                           NULLSTR(id));
+            goto cleanup;
+        }
+
+        replies[slot] = obj;
+        msg.rxObjects[i] = NULL;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (ret < 0) {
+        for (i = 0; i < ncmds; i++) {
+            virJSONValueFree(replies[i]);
+            replies[i] = NULL;
+        }
+    }
+    if (msg.rxObjects) {
+        for (i = 0; i < msg.nrxObjects; i++)
+            virJSONValueFree(msg.rxObjects[i]);
+        VIR_FREE(msg.rxObjects);
+    }
+    if (ids) {
+        for (i = 0; i < ncmds; i++)
+            VIR_FREE(ids[i]);
+        VIR_FREE(ids);
+    }
+    VIR_FREE(cmdstr);
+    VIR_FREE(msg.txBuffer);
+    virBufferFreeAndReset(&buf);
+    return ret;
+}
+
 /* Ignoring OOM in this method, since we're already reporting
  * a more important error
  *
@@ -1936,28 +2057,17 @@ qemuMonitorJSONGetOneBlockStatsInfo(virJSONValuePtr dev,
 }
 
 
-int
-qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
-                                    virHashTablePtr hash,
-                                    bool backingChain)
+static int
+qemuMonitorJSONGetAllBlockStatsInfoReply(virJSONValuePtr reply,
+                                         virHashTablePtr hash,
+                                         bool backingChain)
 {
     int ret = -1;
     int nstats = 0;
     int rc;
     size_t i;
-    virJSONValuePtr cmd;
-    virJSONValuePtr reply = NULL;
     virJSONValuePtr devices;
 
-    if (!(cmd = qemuMonitorJSONMakeCommand("query-blockstats", NULL)))
-        return -1;
-
-    if ((rc = qemuMonitorJSONCommand(mon, cmd, &reply)) < 0)
-        goto cleanup;
-
-    if (qemuMonitorJSONCheckError(cmd, reply) < 0)
-        goto cleanup;
-
     if (!(devices = virJSONValueObjectGetArray(reply, "return"))) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("blockstats reply was missing device list"));
@@ -1994,6 +2104,31 @@ qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
 
     ret = nstats;
 
+ cleanup:
+    return ret;
+}
+
+
+int
+qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
+                                    virHashTablePtr hash,
+                                    bool backingChain)
+{
+    int ret = -1;
+    virJSONValuePtr cmd;
+    virJSONValuePtr reply = NULL;
+
+    if (!(cmd = qemuMonitorJSONMakeCommand("query-blockstats", NULL)))
+        return -1;
+
+    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONCheckError(cmd, reply) < 0)
+        goto cleanup;
+
+    ret = qemuMonitorJSONGetAllBlockStatsInfoReply(reply, hash, backingChain);
+
  cleanup:
     virJSONValueFree(cmd);
     virJSONValueFree(reply);
@@ -2050,27 +2185,15 @@ qemuMonitorJSONBlockStatsUpdateCapacityOne(virJSONValuePtr image,
 }
 
 
-int
-qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
-                                        virHashTablePtr stats,
-                                        bool backingChain)
+static int
+qemuMonitorJSONBlockStatsUpdateCapacityReply(virJSONValuePtr reply,
+                                             virHashTablePtr stats,
+                                             bool backingChain)
 {
     int ret = -1;
-    int rc;
     size_t i;
-    virJSONValuePtr cmd;
-    virJSONValuePtr reply = NULL;
     virJSONValuePtr devices;
 
-    if (!(cmd = qemuMonitorJSONMakeCommand("query-block", NULL)))
-        return -1;
-
-    if ((rc = qemuMonitorJSONCommand(mon, cmd, &reply)) < 0)
-        goto cleanup;
-
-    if (qemuMonitorJSONCheckError(cmd, reply) < 0)
-        goto cleanup;
-
     if (!(devices = virJSONValueObjectGetArray(reply, "return"))) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("query-block reply was missing device list"));
@@ -2110,6 +2233,32 @@ qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
 
     ret = 0;
 
+ cleanup:
+    return ret;
+}
+
+
+int
+qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
+                                        virHashTablePtr stats,
+                                        bool backingChain)
+{
+    int ret = -1;
+    virJSONValuePtr cmd;
+    virJSONValuePtr reply = NULL;
+
+    if (!(cmd = qemuMonitorJSONMakeCommand("query-block", NULL)))
+        return -1;
+
+    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONCheckError(cmd, reply) < 0)
+        goto cleanup;
+
+    ret = qemuMonitorJSONBlockStatsUpdateCapacityReply(reply, stats,
+                                                       backingChain);
+
  cleanup:
     virJSONValueFree(cmd);
     virJSONValueFree(reply);
@@ -2117,6 +2266,45 @@ qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
 }
 
 
+int
+qemuMonitorJSONGetAllBlockStatsAndCapacity(qemuMonitorPtr mon,
+                                           virHashTablePtr hash,
+                                           bool backingChain)
+{
+    int ret = -1;
+    size_t i;
+    virJSONValuePtr cmds[2] = { NULL, NULL };
+    virJSONValuePtr replies[2] = { NULL, NULL };
+
+    if (!(cmds[0] = qemuMonitorJSONMakeCommand("query-blockstats", NULL)) ||
+        !(cmds[1] = qemuMonitorJSONMakeCommand("query-block", NULL)))
+        goto cleanup;
+
+    if (qemuMonitorJSONCommandBatch(mon, cmds, replies,
+                                    ARRAY_CARDINALITY(cmds)) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONCheckError(cmds[0], replies[0]) < 0 ||
+        qemuMonitorJSONCheckError(cmds[1], replies[1]) < 0)
+        goto cleanup;
+
+    if ((ret = qemuMonitorJSONGetAllBlockStatsInfoReply(replies[0], hash,
+                                                        backingChain)) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONBlockStatsUpdateCapacityReply(replies[1], hash,
+                                                     backingChain) < 0)
+        ret = -1;
+
+ cleanup:
+    for (i = 0; i < ARRAY_CARDINALITY(cmds); i++) {
+        virJSONValueFree(cmds[i]);
+        virJSONValueFree(replies[i]);
+    }
+    return ret;
+}
+
+
 /* Return 0 on success, -1 on failure, or -2 if not supported.  Size
  * is in bytes.  */
 int qemuMonitorJSONBlockResize(qemuMonitorPtr mon,
@@ -2753,6 +2941,8 @@ qemuMonitorJSONGetMigrationStatsReply(virJSONValuePtr reply,
                                                       &stats->ram_dirty_rate));
         ignore_value(virJSONValueObjectGetNumberUlong(ram, "dirty-sync-count",
                                                       &stats->ram_iteration));
+        ignore_value(virJSONValueObjectGetNumberUlong(ram, "postcopy-requests",
+                                                      &stats->ram_postcopy_reqs));
 
         disk = virJSONValueObjectGetObject(ret, "disk");
         if (disk) {
@@ -2988,10 +3178,57 @@ qemuMonitorJSONGetDumpGuestMemoryCapability(qemuMonitorPtr mon,
     return ret;
 }
 
+int
+qemuMonitorJSONQueryDump(qemuMonitorPtr mon,
+                         qemuMonitorDumpStats *stats)
+{
+    int ret = -1;
+    virJSONValuePtr cmd = NULL;
+    virJSONValuePtr reply = NULL;
+    virJSONValuePtr result;
+    const char *statusstr;
+
+    if (!(cmd = qemuMonitorJSONMakeCommand("query-dump", NULL)))
+        return -1;
+
+    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONCheckError(cmd, reply) < 0)
+        goto cleanup;
+
+    result = virJSONValueObjectGetObject(reply, "return");
+
+    if (!(statusstr = virJSONValueObjectGetString(result, "status"))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("incomplete result, failed to get status"));
+        goto cleanup;
+    }
+
+    if ((stats->status = qemuMonitorDumpStatusTypeFromString(statusstr)) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unknown dump status '%s'"), statusstr);
+        goto cleanup;
+    }
+
+    ignore_value(virJSONValueObjectGetNumberUlong(result, "completed",
+                                                  &stats->completed));
+    ignore_value(virJSONValueObjectGetNumberUlong(result, "total",
+                                                  &stats->total));
+
+    ret = 0;
+ cleanup:
+    virJSONValueFree(cmd);
+    virJSONValueFree(reply);
+    return ret;
+}
+
+
 int
 qemuMonitorJSONDump(qemuMonitorPtr mon,
                     const char *protocol,
-                    const char *dumpformat)
+                    const char *dumpformat,
+                    bool detach)
 {
     int ret = -1;
     virJSONValuePtr cmd = NULL;
@@ -3002,11 +3239,13 @@ qemuMonitorJSONDump(qemuMonitorPtr mon,
                                          "b:paging", false,
                                          "s:protocol", protocol,
                                          "s:format", dumpformat,
+                                         "B:detach", detach,
                                          NULL);
     } else {
         cmd = qemuMonitorJSONMakeCommand("dump-guest-memory",
                                          "b:paging", false,
                                          "s:protocol", protocol,
+                                         "B:detach", detach,
                                          NULL);
     }
 
@@ -69,6 +69,7 @@
 #include "viratomic.h"
 #include "virnuma.h"
 #include "virstring.h"
+#include "virthreadpool.h"
 #include "virhostdev.h"
 #include "secret_util.h"
 #include "storage/storage_driver.h"
@@ -618,6 +619,10 @@ qemuProcessHandleEvent(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
 
     VIR_DEBUG("vm=%p", vm);
 
+    /* Don't bother building events nobody subscribed to */
+    if (!virDomainQemuMonitorEventStateIsEnabled(driver->domainEventState))
+        return 0;
+
     virObjectLock(vm);
     event = virDomainQemuMonitorEventNew(vm->def->id, vm->def->name,
                                          vm->def->uuid, eventName,
@@ -830,12 +835,15 @@ qemuProcessHandleRTCChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
          */
         offset += vm->def->clock.data.variable.adjustment0;
         vm->def->clock.data.variable.adjustment = offset;
+        qemuDomainXMLCacheInvalidate(vm);
 
         if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
            VIR_WARN("unable to save domain status with RTC change");
     }
 
-    event = virDomainEventRTCChangeNewFromObj(vm, offset);
+    if (virDomainEventStateIsEnabled(driver->domainEventState,
+                                     VIR_DOMAIN_EVENT_ID_RTC_CHANGE))
+        event = virDomainEventRTCChangeNewFromObj(vm, offset);
 
     virObjectUnlock(vm);
 
@@ -936,8 +944,15 @@ qemuProcessHandleIOError(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
         devAlias = "";
     }
 
-    ioErrorEvent = virDomainEventIOErrorNewFromObj(vm, srcPath, devAlias, action);
-    ioErrorEvent2 = virDomainEventIOErrorReasonNewFromObj(vm, srcPath, devAlias, action, reason);
+    if (virDomainEventStateIsEnabled(driver->domainEventState,
+                                     VIR_DOMAIN_EVENT_ID_IO_ERROR))
+        ioErrorEvent = virDomainEventIOErrorNewFromObj(vm, srcPath, devAlias,
+                                                       action);
+    if (virDomainEventStateIsEnabled(driver->domainEventState,
+                                     VIR_DOMAIN_EVENT_ID_IO_ERROR_REASON))
+        ioErrorEvent2 = virDomainEventIOErrorReasonNewFromObj(vm, srcPath,
+                                                              devAlias, action,
+                                                              reason);
 
     if (action == VIR_DOMAIN_EVENT_IO_ERROR_PAUSE &&
         virDomainObjGetState(vm, NULL) == VIR_DOMAIN_RUNNING) {
@@ -992,6 +1007,10 @@ qemuProcessHandleBlockJob(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
         goto error;
     diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
 
+    qemuDomainStatsCacheInvalidate(vm);
+    qemuDomainBlockJobInfoCacheInvalidate(vm);
+    qemuDomainBlockStatsCacheInvalidate(vm);
+
     if (diskPriv->blockJobSync) {
         /* We have a SYNC API waiting for this event, dispatch it back */
         diskPriv->blockJobType = type;
@@ -1138,6 +1157,7 @@ qemuProcessHandleTrayChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
             disk->tray_status = VIR_DOMAIN_DISK_TRAY_OPEN;
         else if (reason == VIR_DOMAIN_EVENT_TRAY_CHANGE_CLOSE)
             disk->tray_status = VIR_DOMAIN_DISK_TRAY_CLOSED;
+        qemuDomainXMLCacheInvalidate(vm);
 
         if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
             VIR_WARN("Unable to save status on vm %s after tray moved event",
@@ -1250,6 +1270,9 @@ qemuProcessHandleBalloonChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     VIR_DEBUG("Updating balloon from %lld to %lld kb",
               vm->def->mem.cur_balloon, actual);
     vm->def->mem.cur_balloon = actual;
+    qemuDomainStatsCacheInvalidate(vm);
+    qemuDomainXMLCacheInvalidate(vm);
+    qemuDomainMemoryStatsCacheInvalidate(vm);
 
     if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
         VIR_WARN("unable to save domain status with balloon change");
@@ -3205,11 +3228,43 @@ qemuDomainPerfRestart(virDomainObjPtr vm)
     return 0;
 }
 
+/* Upper bound on how many domains are reconnected concurrently; more
+ * workers mostly pile up on the monitor sockets without making the
+ * daemon responsive any earlier */
+#define QEMU_PROCESS_RECONNECT_MAX_WORKERS 16
+
+struct qemuProcessReconnectProgress {
+    virMutex lock;
+    virCond cond;
+    bool sealed;                /* all reconnect jobs have been queued */
+    size_t total;
+    size_t remaining;
+    virThreadPoolPtr pool;
+};
+
 struct qemuProcessReconnectData {
     virConnectPtr conn;
     virQEMUDriverPtr driver;
     virDomainObjPtr obj;
+    struct qemuProcessReconnectProgress *progress;
 };
+
+
+static void
+qemuProcessReconnectDone(struct qemuProcessReconnectProgress *progress,
+                         const char *name)
+{
+    if (!progress)
+        return;
+
+    virMutexLock(&progress->lock);
+    progress->remaining--;
+    VIR_INFO("Finished reconnecting to domain '%s': "
+             "%zu of %zu domains left",
+             name, progress->remaining, progress->total);
+    virCondSignal(&progress->cond);
+    virMutexUnlock(&progress->lock);
+}
 /*
  * Open an existing VM's monitor, re-detect VCPU threads
  * and re-reserve the security labels in use
@@ -3238,6 +3293,7 @@ qemuProcessReconnect(void *opaque)
     struct qemuProcessReconnectData *data = opaque;
     virQEMUDriverPtr driver = data->driver;
     virDomainObjPtr obj = data->obj;
+    struct qemuProcessReconnectProgress *progress = data->progress;
     qemuDomainObjPrivatePtr priv;
     virConnectPtr conn = data->conn;
     struct qemuDomainJobObj oldjob;
@@ -3271,8 +3327,6 @@ qemuProcessReconnect(void *opaque)
     if (qemuDomainMasterKeyReadFile(priv) < 0)
         goto error;
 
-    virNWFilterReadLockFilterUpdates();
-
     VIR_DEBUG("Reconnect monitor to %p '%s'", obj, obj->def->name);
 
     /* XXX check PID liveliness & EXE path */
@@ -3363,8 +3417,15 @@ qemuProcessReconnect(void *opaque)
     if (qemuProcessNotifyNets(obj->def) < 0)
         goto error;
 
-    if (qemuProcessFiltersInstantiate(obj->def))
+    /* Hold the filter update lock only while instantiating the
+     * filters, so that concurrent reconnects don't block pending
+     * filter updates for the whole monitor re-synchronization */
+    virNWFilterReadLockFilterUpdates();
+    if (qemuProcessFiltersInstantiate(obj->def)) {
+        virNWFilterUnlockFilterUpdates();
         goto error;
+    }
+    virNWFilterUnlockFilterUpdates();
 
     if (qemuProcessRefreshDisks(driver, obj, QEMU_ASYNC_JOB_NONE) < 0)
         goto error;
@@ -3424,10 +3485,10 @@ qemuProcessReconnect(void *opaque)
         qemuDomainObjEndJob(driver, obj);
     if (!virDomainObjIsActive(obj))
         qemuDomainRemoveInactive(driver, obj);
+    qemuProcessReconnectDone(progress, obj->def->name);
     virDomainObjEndAPI(&obj);
     virObjectUnref(conn);
     virObjectUnref(cfg);
-    virNWFilterUnlockFilterUpdates();
     return;
 
  error:
@@ -3455,6 +3516,12 @@ qemuProcessReconnect(void *opaque)
     goto cleanup;
 }
 
+static void
+qemuProcessReconnectWorker(void *jobdata, void *opaque ATTRIBUTE_UNUSED)
+{
+    qemuProcessReconnect(jobdata);
+}
+
 static int
 qemuProcessReconnectHelper(virDomainObjPtr obj,
                            void *opaque)
@@ -3462,6 +3529,7 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
     virThread thread;
     struct qemuProcessReconnectData *src = opaque;
     struct qemuProcessReconnectData *data;
+    struct qemuProcessReconnectProgress *progress = src->progress;
 
     /* If the VM was inactive, we don't need to reconnect */
     if (!obj->pid)
@@ -3484,10 +3552,27 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
      */
     virObjectRef(data->conn);
 
-    if (virThreadCreate(&thread, false, qemuProcessReconnect, data) < 0) {
+    /* Account for the job before queueing it; it may start (and thus
+     * report completion) before we get a chance to do so afterwards */
+    if (progress) {
+        virMutexLock(&progress->lock);
+        progress->total++;
+        progress->remaining++;
+        virMutexUnlock(&progress->lock);
+    }
+
+    if (progress ? virThreadPoolSendJob(progress->pool, 0, data) < 0
+                 : virThreadCreate(&thread, false,
+                                   qemuProcessReconnect, data) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Could not create thread. QEMU initialization "
                          "might be incomplete"));
+        if (progress) {
+            virMutexLock(&progress->lock);
+            progress->total--;
+            progress->remaining--;
+            virMutexUnlock(&progress->lock);
+        }
         /* We can't spawn a thread and thus connect to monitor. Kill qemu.
          * It's safe to call qemuProcessStop without a job here since there
          * is no thread that could be doing anything else with the same domain
@@ -3506,6 +3591,28 @@ qemuProcessReconnectHelper(virDomainObjPtr obj,
     return 0;
 }
 
+/* Waits for all queued reconnect jobs to finish, then tears down the
+ * worker pool and the progress tracker */
+static void
+qemuProcessReconnectAwait(void *opaque)
+{
+    struct qemuProcessReconnectProgress *progress = opaque;
+
+    virMutexLock(&progress->lock);
+    while (!progress->sealed || progress->remaining > 0)
+        ignore_value(virCondWait(&progress->cond, &progress->lock));
+    virMutexUnlock(&progress->lock);
+
+    if (progress->total)
+        VIR_INFO("Finished reconnecting to all %zu domains",
+                 progress->total);
+
+    virThreadPoolFree(progress->pool);
+    virCondDestroy(&progress->cond);
+    virMutexDestroy(&progress->lock);
+    VIR_FREE(progress);
+}
+
 /**
  * qemuProcessReconnectAll
  *
@@ -3516,7 +3623,42 @@ void
 qemuProcessReconnectAll(virConnectPtr conn, virQEMUDriverPtr driver)
 {
     struct qemuProcessReconnectData data = {.conn = conn, .driver = driver};
+    struct qemuProcessReconnectProgress *progress = NULL;
+    virThread thread;
+
+    /* Reconnect through a bounded pool of workers so that a host with
+     * many running domains doesn't spawn a thread per domain. If the
+     * pool cannot be set up each domain falls back to its own thread. */
+    if (VIR_ALLOC(progress) == 0) {
+        if (virMutexInit(&progress->lock) < 0) {
+            VIR_FREE(progress);
+        } else if (virCondInit(&progress->cond) < 0) {
+            virMutexDestroy(&progress->lock);
+            VIR_FREE(progress);
+        } else if (!(progress->pool =
+                     virThreadPoolNew(0, QEMU_PROCESS_RECONNECT_MAX_WORKERS,
+                                      0, qemuProcessReconnectWorker, NULL))) {
+            virCondDestroy(&progress->cond);
+            virMutexDestroy(&progress->lock);
+            VIR_FREE(progress);
+        }
+    }
+    data.progress = progress;
+
     virDomainObjListForEach(driver->domains, qemuProcessReconnectHelper, &data);
+
+    if (progress) {
+        virMutexLock(&progress->lock);
+        progress->sealed = true;
+        virCondSignal(&progress->cond);
+        virMutexUnlock(&progress->lock);
+
+        /* The waiter owns @progress from now on; if it can't be
+         * spawned just wait here before letting startup continue */
+        if (virThreadCreate(&thread, false,
+                            qemuProcessReconnectAwait, progress) < 0)
+            qemuProcessReconnectAwait(progress);
+    }
 }
 
 static int
@@ -3608,27 +3750,44 @@ qemuProcessSPICEAllocatePorts(virQEMUDriverPtr driver,
         goto cleanup;
     }
 
-    if (needPort || graphics->data.spice.port == -1) {
-        if (virPortAllocatorAcquire(driver->remotePorts, &port) < 0)
-            goto cleanup;
+    if (graphics->data.spice.port == -1)
+        needPort = true;
 
-        graphics->data.spice.port = port;
+    if (graphics->data.spice.tlsPort == -1)
+        needTLSPort = true;
 
-        if (!graphics->data.spice.autoport)
-            graphics->data.spice.portReserved = true;
+    if (needTLSPort && !cfg->spiceTLS) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("Auto allocation of spice TLS port requested "
+                         "but spice TLS is disabled in qemu.conf"));
+        goto cleanup;
     }
 
-    if (needTLSPort || graphics->data.spice.tlsPort == -1) {
-        if (!cfg->spiceTLS) {
-            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                           _("Auto allocation of spice TLS port requested "
-                             "but spice TLS is disabled in qemu.conf"));
+    if (needPort && needTLSPort) {
+        unsigned short ports[2];
+
+        /* grab both ports in one pass over the allocator */
+        if (virPortAllocatorAcquireGroup(driver->remotePorts, ports, 2) < 0)
             goto cleanup;
-        }
 
+        port = ports[0];
+        tlsPort = ports[1];
+    } else if (needPort) {
+        if (virPortAllocatorAcquire(driver->remotePorts, &port) < 0)
+            goto cleanup;
+    } else if (needTLSPort) {
         if (virPortAllocatorAcquire(driver->remotePorts, &tlsPort) < 0)
             goto cleanup;
+    }
+
+    if (needPort) {
+        graphics->data.spice.port = port;
+
+        if (!graphics->data.spice.autoport)
+            graphics->data.spice.portReserved = true;
+    }
 
+    if (needTLSPort) {
         graphics->data.spice.tlsPort = tlsPort;
 
         if (!graphics->data.spice.autoport)
@@ -5770,8 +5929,10 @@ void qemuProcessStop(virQEMUDriverPtr driver,
     virErrorPtr orig_err;
     virDomainDefPtr def;
     virNetDevVPortProfilePtr vport = NULL;
+    virNetDevOpenvswitchBatchPtr ovsbatch = NULL;
     size_t i;
     char *timestamp;
+    char *hookxml = NULL;
     virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
     VIR_DEBUG("Shutting down vm=%p name=%s id=%d pid=%llu, "
@@ -5878,13 +6039,16 @@ void qemuProcessStop(virQEMUDriverPtr driver,
 
     /* now that we know it's stopped call the hook if present */
     if (virHookPresent(VIR_HOOK_DRIVER_QEMU)) {
-        char *xml = qemuDomainDefFormatXML(driver, vm->def, 0);
+        /* Formatted once and shared with the "release" hook below;
+         * neither script's exit status can stop the operation anyway,
+         * so both invocations are queued for the asynchronous hook
+         * runner instead of being waited for */
+        hookxml = qemuDomainDefFormatXML(driver, vm->def, 0);
 
-        /* we can't stop the operation even if the script raised an error */
-        ignore_value(virHookCall(VIR_HOOK_DRIVER_QEMU, vm->def->name,
-                                 VIR_HOOK_QEMU_OP_STOPPED, VIR_HOOK_SUBOP_END,
-                                 NULL, xml, NULL));
-        VIR_FREE(xml);
+        ignore_value(virHookCallAsync(VIR_HOOK_DRIVER_QEMU, vm->def->name,
+                                      VIR_HOOK_QEMU_OP_STOPPED,
+                                      VIR_HOOK_SUBOP_END,
+                                      NULL, hookxml));
     }
 
     /* Reset Security Labels unless caller don't want us to */
@@ -5916,6 +6080,11 @@ void qemuProcessStop(virQEMUDriverPtr driver,
     qemuHostdevReAttachDomainDevices(driver, vm->def);
 
     def = vm->def;
+    if (def->nnets) {
+        /* batch the OVS port removals of all interfaces into a
+         * single ovs-vsctl invocation */
+        ovsbatch = virNetDevOpenvswitchBatchNew();
+    }
     for (i = 0; i < def->nnets; i++) {
         virDomainNetDefPtr net = def->nets[i];
         vport = virDomainNetGetActualVirtPortProfile(net);
@@ -5950,9 +6119,14 @@ void qemuProcessStop(virQEMUDriverPtr driver,
             if (vport->virtPortType == VIR_NETDEV_VPORT_PROFILE_MIDONET) {
                 ignore_value(virNetDevMidonetUnbindPort(vport));
             } else if (vport->virtPortType == VIR_NETDEV_VPORT_PROFILE_OPENVSWITCH) {
-                ignore_value(virNetDevOpenvswitchRemovePort(
-                                 virDomainNetGetActualBridgeName(net),
-                                 net->ifname));
+                if (ovsbatch) {
+                    ignore_value(virNetDevOpenvswitchBatchRemovePort(
+                                     ovsbatch, net->ifname));
+                } else {
+                    ignore_value(virNetDevOpenvswitchRemovePort(
+                                     virDomainNetGetActualBridgeName(net),
+                                     net->ifname));
+                }
             }
         }
 
@@ -5960,6 +6134,11 @@ void qemuProcessStop(virQEMUDriverPtr driver,
         virDomainNetRemoveHostdev(def, net);
         networkReleaseActualDevice(vm->def, net);
     }
+    if (ovsbatch) {
+        ignore_value(virNetDevOpenvswitchBatchCommit(ovsbatch));
+        virNetDevOpenvswitchBatchFree(ovsbatch);
+        ovsbatch = NULL;
+    }
 
  retry:
     if ((ret = qemuRemoveCgroup(vm)) < 0) {
@@ -6030,13 +6209,13 @@ void qemuProcessStop(virQEMUDriverPtr driver,
 
     /* The "release" hook cleans up additional resources */
     if (virHookPresent(VIR_HOOK_DRIVER_QEMU)) {
-        char *xml = qemuDomainDefFormatXML(driver, vm->def, 0);
+        if (!hookxml)
+            hookxml = qemuDomainDefFormatXML(driver, vm->def, 0);
 
-        /* we can't stop the operation even if the script raised an error */
-        virHookCall(VIR_HOOK_DRIVER_QEMU, vm->def->name,
-                    VIR_HOOK_QEMU_OP_RELEASE, VIR_HOOK_SUBOP_END,
-                    NULL, xml, NULL);
-        VIR_FREE(xml);
+        ignore_value(virHookCallAsync(VIR_HOOK_DRIVER_QEMU, vm->def->name,
+                                      VIR_HOOK_QEMU_OP_RELEASE,
+                                      VIR_HOOK_SUBOP_END,
+                                      NULL, hookxml));
     }
 
     if (vm->newDef) {
@@ -6051,6 +6230,7 @@ void qemuProcessStop(virQEMUDriverPtr driver,
         qemuDomainObjEndJob(driver, vm);
 
  cleanup:
+    VIR_FREE(hookxml);
     if (orig_err) {
         virSetError(orig_err);
         virFreeError(orig_err);
@@ -77,6 +77,11 @@ VIR_LOG_INIT("remote.remote_driver");
 static bool inside_daemon;
 
 struct private_data {
+    /* Protects the fields below between API entry points. The lock is
+     * NOT held while a call is waiting on the wire (see callFull), so
+     * any number of threads can have RPCs in flight on one connection
+     * concurrently; virNetClient matches replies to callers by serial
+     * number and hands the socket between waiting threads itself. */
     virMutex lock;
 
     virNetClientPtr client;
@@ -129,6 +134,10 @@ static int callFull(virConnectPtr conn, struct private_data *priv,
                     int proc_nr,
                     xdrproc_t args_filter, char *args,
                     xdrproc_t ret_filter, char *ret);
+static int callBatch(virConnectPtr conn, struct private_data *priv,
+                     unsigned int flags,
+                     size_t ncalls,
+                     virNetClientProgramBatchCallPtr calls);
 static int remoteAuthenticate(virConnectPtr conn, struct private_data *priv,
                               virConnectAuthPtr auth, const char *authtype);
 #if WITH_SASL
@@ -616,22 +625,6 @@ remoteClientCloseFunc(virNetClientPtr client ATTRIBUTE_UNUSED,
                                     reason);
 }
 
-static bool
-remoteConnectSupportsFeatureUnlocked(virConnectPtr conn,
-                                     struct private_data *priv,
-                                     int feature)
-{
-    remote_connect_supports_feature_args args = { feature };
-    remote_connect_supports_feature_ret ret = { 0 };
-    int rc;
-
-    rc = call(conn, priv, 0, REMOTE_PROC_CONNECT_SUPPORTS_FEATURE,
-              (xdrproc_t)xdr_remote_connect_supports_feature_args, (char *) &args,
-              (xdrproc_t)xdr_remote_connect_supports_feature_ret, (char *) &ret);
-
-    return rc != -1 && ret.supported;
-}
-
 /* helper macro to ease extraction of arguments from the URI */
 #define EXTRACT_URI_ARG_STR(ARG_NAME, ARG_VAR)          \
     if (STRCASEEQ(var->name, ARG_NAME)) {               \
@@ -1102,24 +1095,49 @@ doRemoteOpen(virConnectPtr conn,
     if (remoteAuthenticate(conn, priv, auth, authtype) == -1)
         goto failed;
 
-    if (virNetClientKeepAliveIsSupported(priv->client)) {
-        priv->serverKeepAlive = remoteConnectSupportsFeatureUnlocked(conn,
-                                    priv, VIR_DRV_FEATURE_PROGRAM_KEEPALIVE);
-        if (!priv->serverKeepAlive) {
-            VIR_INFO("Disabling keepalive protocol since it is not supported"
-                     " by the server");
-        }
-    }
-
-    /* Finally we can call the remote side's open function. */
+    /* Finally we can call the remote side's open function, probing
+     * for the keepalive protocol in the same pipelined flight; the
+     * probe is answered by the RPC layer without needing the
+     * connection open, so the two are independent and pairing them
+     * just saves a round trip. */
     {
         remote_connect_open_args args = { &name, flags };
+        remote_connect_supports_feature_args kaArgs =
+            { VIR_DRV_FEATURE_PROGRAM_KEEPALIVE };
+        remote_connect_supports_feature_ret kaRet = { 0 };
+        virNetClientProgramBatchCall calls[2];
+        size_t ncalls = 0;
+        bool checkKeepAlive = virNetClientKeepAliveIsSupported(priv->client);
+
+        memset(calls, 0, sizeof(calls));
+        calls[ncalls].proc = REMOTE_PROC_CONNECT_OPEN;
+        calls[ncalls].args_filter = (xdrproc_t) xdr_remote_connect_open_args;
+        calls[ncalls].args = (char *) &args;
+        calls[ncalls].ret_filter = (xdrproc_t) xdr_void;
+        ncalls++;
+
+        if (checkKeepAlive) {
+            calls[ncalls].proc = REMOTE_PROC_CONNECT_SUPPORTS_FEATURE;
+            calls[ncalls].args_filter =
+                (xdrproc_t) xdr_remote_connect_supports_feature_args;
+            calls[ncalls].args = (char *) &kaArgs;
+            calls[ncalls].ret_filter =
+                (xdrproc_t) xdr_remote_connect_supports_feature_ret;
+            calls[ncalls].ret = (char *) &kaRet;
+            ncalls++;
+        }
 
         VIR_DEBUG("Trying to open URI %s", name);
-        if (call(conn, priv, 0, REMOTE_PROC_CONNECT_OPEN,
-                 (xdrproc_t) xdr_remote_connect_open_args, (char *) &args,
-                 (xdrproc_t) xdr_void, (char *) NULL) == -1)
+        if (callBatch(conn, priv, 0, ncalls, calls) == -1)
             goto failed;
+
+        if (checkKeepAlive) {
+            priv->serverKeepAlive = kaRet.supported;
+            if (!priv->serverKeepAlive) {
+                VIR_INFO("Disabling keepalive protocol since it is not"
+                         " supported by the server");
+            }
+        }
     }
 
     /* Now try and find out what URI the daemon used */
@@ -1145,15 +1163,38 @@ doRemoteOpen(virConnectPtr conn,
     if (!(priv->eventState = virObjectEventStateNew()))
         goto failed;
 
-    priv->serverEventFilter = remoteConnectSupportsFeatureUnlocked(conn,
-                                priv, VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK);
+    /* Probe both optional features in a single pipelined flight to
+     * save a round trip; as with the individual probes, any failure
+     * just means the feature is treated as unsupported.
+     */
+    {
+        remote_connect_supports_feature_args eventArgs =
+            { VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK };
+        remote_connect_supports_feature_ret eventRet = { 0 };
+        remote_connect_supports_feature_args closeArgs =
+            { VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK };
+        remote_connect_supports_feature_ret closeRet = { 0 };
+        virNetClientProgramBatchCall feats[] = {
+            { REMOTE_PROC_CONNECT_SUPPORTS_FEATURE, 0,
+              (xdrproc_t) xdr_remote_connect_supports_feature_args, (char *) &eventArgs,
+              (xdrproc_t) xdr_remote_connect_supports_feature_ret, (char *) &eventRet },
+            { REMOTE_PROC_CONNECT_SUPPORTS_FEATURE, 0,
+              (xdrproc_t) xdr_remote_connect_supports_feature_args, (char *) &closeArgs,
+              (xdrproc_t) xdr_remote_connect_supports_feature_ret, (char *) &closeRet },
+        };
+
+        if (callBatch(conn, priv, 0,
+                      ARRAY_CARDINALITY(feats), feats) != -1) {
+            priv->serverEventFilter = eventRet.supported;
+            priv->serverCloseCallback = closeRet.supported;
+        }
+    }
+
     if (!priv->serverEventFilter) {
         VIR_INFO("Avoiding server event filtering since it is not "
                  "supported by the server");
     }
 
-    priv->serverCloseCallback = remoteConnectSupportsFeatureUnlocked(conn,
-                                    priv, VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK);
     if (!priv->serverCloseCallback) {
         VIR_INFO("Close callback registering isn't supported "
                  "by the remote side.");
@@ -5406,15 +5447,19 @@ remoteStreamSend(virStreamPtr st,
 
 
 static int
-remoteStreamRecv(virStreamPtr st,
-                 char *data,
-                 size_t nbytes)
+remoteStreamRecvFlags(virStreamPtr st,
+                      char *data,
+                      size_t nbytes,
+                      unsigned int flags)
 {
-    VIR_DEBUG("st=%p data=%p nbytes=%zu", st, data, nbytes);
+    VIR_DEBUG("st=%p data=%p nbytes=%zu flags=%x",
+              st, data, nbytes, flags);
     struct private_data *priv = st->conn->privateData;
     virNetClientStreamPtr privst = st->privateData;
     int rv;
 
+    virCheckFlags(VIR_STREAM_RECV_STOP_AT_HOLE, -1);
+
     if (virNetClientStreamRaiseError(privst))
         return -1;
 
@@ -5426,7 +5471,8 @@ remoteStreamRecv(virStreamPtr st,
                                       priv->client,
                                       data,
                                       nbytes,
-                                      (st->flags & VIR_STREAM_NONBLOCK));
+                                      (st->flags & VIR_STREAM_NONBLOCK),
+                                      flags);
 
     VIR_DEBUG("Done %d", rv);
 
@@ -5436,6 +5482,73 @@ remoteStreamRecv(virStreamPtr st,
     return rv;
 }
 
+
+static int
+remoteStreamRecv(virStreamPtr st,
+                 char *data,
+                 size_t nbytes)
+{
+    return remoteStreamRecvFlags(st, data, nbytes, 0);
+}
+
+
+static int
+remoteStreamSendHole(virStreamPtr st,
+                     long long length,
+                     unsigned int flags)
+{
+    VIR_DEBUG("st=%p length=%lld flags=%x", st, length, flags);
+    struct private_data *priv = st->conn->privateData;
+    virNetClientStreamPtr privst = st->privateData;
+    int rv;
+
+    if (virNetClientStreamRaiseError(privst))
+        return -1;
+
+    remoteDriverLock(priv);
+    priv->localUses++;
+    remoteDriverUnlock(priv);
+
+    rv = virNetClientStreamSendHole(privst,
+                                    priv->client,
+                                    length,
+                                    flags);
+
+    remoteDriverLock(priv);
+    priv->localUses--;
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static int
+remoteStreamRecvHole(virStreamPtr st,
+                     long long *length,
+                     unsigned int flags)
+{
+    struct private_data *priv = st->conn->privateData;
+    virNetClientStreamPtr privst = st->privateData;
+    int rv;
+
+    VIR_DEBUG("st=%p length=%p flags=%x", st, length, flags);
+
+    virCheckFlags(0, -1);
+
+    if (virNetClientStreamRaiseError(privst))
+        return -1;
+
+    remoteDriverLock(priv);
+    priv->localUses++;
+    remoteDriverUnlock(priv);
+
+    rv = virNetClientStreamRecvHole(priv->client, privst, length);
+
+    remoteDriverLock(priv);
+    priv->localUses--;
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
 struct remoteStreamCallbackData {
     virStreamPtr st;
     virStreamEventCallback cb;
@@ -5608,7 +5721,10 @@ remoteStreamAbort(virStreamPtr st)
 
 static virStreamDriver remoteStreamDrv = {
     .streamRecv = remoteStreamRecv,
+    .streamRecvFlags = remoteStreamRecvFlags,
     .streamSend = remoteStreamSend,
+    .streamSendHole = remoteStreamSendHole,
+    .streamRecvHole = remoteStreamRecvHole,
     .streamFinish = remoteStreamFinish,
     .streamAbort = remoteStreamAbort,
     .streamEventAddCallback = remoteStreamEventAddCallback,
@@ -6399,7 +6515,12 @@ callFull(virConnectPtr conn ATTRIBUTE_UNUSED,
 
     /* Unlock, so that if we get any async events/stream data
      * while processing the RPC, we don't deadlock when our
-     * callbacks for those are invoked
+     * callbacks for those are invoked.
+     *
+     * This is also what makes parallel calls from multiple threads
+     * over a single connection work: only the serial assignment above
+     * is serialized, while the wire wait below is not, and the client
+     * dispatches each reply to the thread owning that serial.
      */
     remoteDriverUnlock(priv);
     rv = virNetClientProgramCall(prog,
@@ -6432,6 +6553,48 @@ call(virConnectPtr conn,
                     ret_filter, ret);
 }
 
+/*
+ * Issue a set of independent method calls as one pipelined flight,
+ * costing a single wire round trip for the whole batch. The serial
+ * numbers in @calls are filled in here; args/rets must be prepared
+ * by the caller as for call().
+ */
+static int
+callBatch(virConnectPtr conn ATTRIBUTE_UNUSED,
+          struct private_data *priv,
+          unsigned int flags,
+          size_t ncalls,
+          virNetClientProgramBatchCallPtr calls)
+{
+    int rv;
+    virNetClientProgramPtr prog;
+    virNetClientPtr client = priv->client;
+    size_t i;
+
+    if (flags & REMOTE_CALL_QEMU)
+        prog = priv->qemuProgram;
+    else if (flags & REMOTE_CALL_LXC)
+        prog = priv->lxcProgram;
+    else
+        prog = priv->remoteProgram;
+
+    for (i = 0; i < ncalls; i++)
+        calls[i].serial = priv->counter++;
+
+    priv->localUses++;
+
+    /* Unlock, so that if we get any async events/stream data
+     * while processing the RPC, we don't deadlock when our
+     * callbacks for those are invoked
+     */
+    remoteDriverUnlock(priv);
+    rv = virNetClientProgramCallBatch(prog, client, ncalls, calls);
+    remoteDriverLock(priv);
+    priv->localUses--;
+
+    return rv;
+}
+
 
 static int
 remoteDomainGetInterfaceParameters(virDomainPtr domain,
@@ -44,7 +44,7 @@ struct _virKeepAlive {
     unsigned int countToDeath;
     time_t lastPacketReceived;
     time_t intervalStart;
-    int timer;
+    bool registered;
 
     virKeepAliveSendFunc sendCB;
     virKeepAliveDeadFunc deadCB;
@@ -53,11 +53,33 @@ struct _virKeepAlive {
 };
 
 
+/* All active keepalive objects share a single event loop timer which
+ * ticks at the shortest interval found among them. With many mostly
+ * idle connections this avoids waking the event loop once per client;
+ * the price is that a ping may be delayed by up to one tick, which is
+ * harmless since intervals are counted in seconds anyway.
+ */
+struct _virKeepAliveWheel {
+    virMutex lock;
+    virKeepAlivePtr *kas;
+    size_t nkas;
+    int timer;
+    int period;
+};
+
+static struct _virKeepAliveWheel virKeepAliveWheel = {
+    .timer = -1,
+};
+
+
 static virClassPtr virKeepAliveClass;
 static void virKeepAliveDispose(void *obj);
 
 static int virKeepAliveOnceInit(void)
 {
+    if (virMutexInit(&virKeepAliveWheel.lock) < 0)
+        return -1;
+
     if (!(virKeepAliveClass = virClassNew(virClassForObjectLockable(),
                                           "virKeepAlive",
                                           sizeof(virKeepAlive),
@@ -125,8 +147,7 @@ virKeepAliveTimerInternal(virKeepAlivePtr ka,
         return false;
 
     if (now - ka->intervalStart < ka->interval) {
-        timeval = ka->interval - (now - ka->intervalStart);
-        virEventUpdateTimeout(ka->timer, timeval * 1000);
+        /* Not due yet; the shared timer will tick again soon enough */
         return false;
     }
 
@@ -146,22 +167,23 @@ virKeepAliveTimerInternal(virKeepAlivePtr ka,
         ka->countToDeath--;
         ka->intervalStart = now;
         *msg = virKeepAliveMessage(ka, KEEPALIVE_PROC_PING);
-        virEventUpdateTimeout(ka->timer, ka->interval * 1000);
         return false;
     }
 }
 
 
 static void
-virKeepAliveTimer(int timer ATTRIBUTE_UNUSED, void *opaque)
+virKeepAliveTick(virKeepAlivePtr ka)
 {
-    virKeepAlivePtr ka = opaque;
     virNetMessagePtr msg = NULL;
     bool dead;
     void *client;
 
     virObjectLock(ka);
 
+    if (!ka->registered)
+        goto cleanup;
+
     client = ka->client;
     dead = virKeepAliveTimerInternal(ka, &msg);
 
@@ -186,6 +208,133 @@ virKeepAliveTimer(int timer ATTRIBUTE_UNUSED, void *opaque)
 }
 
 
+static void
+virKeepAliveWheelTimer(int timer ATTRIBUTE_UNUSED,
+                       void *opaque ATTRIBUTE_UNUSED)
+{
+    virKeepAlivePtr *kas = NULL;
+    size_t nkas = 0;
+    size_t i;
+
+    /* Grab a referenced snapshot of the registered objects so that
+     * the per-object callbacks run without the wheel lock held
+     */
+    virMutexLock(&virKeepAliveWheel.lock);
+    if (virKeepAliveWheel.nkas &&
+        VIR_ALLOC_N(kas, virKeepAliveWheel.nkas) == 0) {
+        nkas = virKeepAliveWheel.nkas;
+        for (i = 0; i < nkas; i++)
+            kas[i] = virObjectRef(virKeepAliveWheel.kas[i]);
+    }
+    virMutexUnlock(&virKeepAliveWheel.lock);
+
+    for (i = 0; i < nkas; i++) {
+        virKeepAliveTick(kas[i]);
+        virObjectUnref(kas[i]);
+    }
+    VIR_FREE(kas);
+}
+
+
+/* Recompute the shared tick length as the shortest interval of all
+ * registered objects. Intervals are fixed once an object is
+ * registered, so reading them without the object lock is fine.
+ *
+ * The caller is expected to hold the wheel lock.
+ */
+static void
+virKeepAliveWheelUpdate(void)
+{
+    size_t i;
+    int period = 0;
+
+    for (i = 0; i < virKeepAliveWheel.nkas; i++) {
+        int interval = virKeepAliveWheel.kas[i]->interval;
+        if (period == 0 || interval < period)
+            period = interval;
+    }
+
+    if (period == virKeepAliveWheel.period)
+        return;
+
+    virKeepAliveWheel.period = period;
+    if (virKeepAliveWheel.timer >= 0)
+        virEventUpdateTimeout(virKeepAliveWheel.timer, period * 1000);
+}
+
+
+/* Called with @ka locked */
+static int
+virKeepAliveRegister(virKeepAlivePtr ka)
+{
+    int ret = -1;
+
+    virMutexLock(&virKeepAliveWheel.lock);
+
+    if (VIR_APPEND_ELEMENT_COPY(virKeepAliveWheel.kas,
+                                virKeepAliveWheel.nkas, ka) < 0)
+        goto cleanup;
+
+    if (virKeepAliveWheel.timer < 0) {
+        virKeepAliveWheel.timer = virEventAddTimeout(ka->interval * 1000,
+                                                     virKeepAliveWheelTimer,
+                                                     NULL, NULL);
+        if (virKeepAliveWheel.timer < 0) {
+            virKeepAliveWheel.nkas--;
+            goto cleanup;
+        }
+        virKeepAliveWheel.period = ka->interval;
+    } else {
+        virKeepAliveWheelUpdate();
+    }
+
+    /* the wheel now has another reference to this object */
+    virObjectRef(ka);
+    ka->registered = true;
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virKeepAliveWheel.lock);
+    return ret;
+}
+
+
+/* Called with @ka locked. Returns true if @ka was registered; the
+ * caller must then drop the wheel's reference once @ka is unlocked.
+ */
+static bool
+virKeepAliveUnregister(virKeepAlivePtr ka)
+{
+    size_t i;
+    bool found = false;
+
+    virMutexLock(&virKeepAliveWheel.lock);
+
+    for (i = 0; i < virKeepAliveWheel.nkas; i++) {
+        if (virKeepAliveWheel.kas[i] == ka) {
+            VIR_DELETE_ELEMENT(virKeepAliveWheel.kas, i,
+                               virKeepAliveWheel.nkas);
+            found = true;
+            break;
+        }
+    }
+
+    if (found) {
+        if (virKeepAliveWheel.nkas == 0) {
+            virEventRemoveTimeout(virKeepAliveWheel.timer);
+            virKeepAliveWheel.timer = -1;
+            virKeepAliveWheel.period = 0;
+        } else {
+            virKeepAliveWheelUpdate();
+        }
+        ka->registered = false;
+    }
+
+    virMutexUnlock(&virKeepAliveWheel.lock);
+    return found;
+}
+
+
 virKeepAlivePtr
 virKeepAliveNew(int interval,
                 unsigned int count,
@@ -207,7 +356,6 @@ virKeepAliveNew(int interval,
     ka->interval = interval;
     ka->count = count;
     ka->countToDeath = count;
-    ka->timer = -1;
     ka->client = client;
     ka->sendCB = sendCB;
     ka->deadCB = deadCB;
@@ -245,7 +393,7 @@ virKeepAliveStart(virKeepAlivePtr ka,
 
     virObjectLock(ka);
 
-    if (ka->timer >= 0) {
+    if (ka->registered) {
         VIR_DEBUG("Keepalive messages already enabled");
         ret = 0;
         goto cleanup;
@@ -285,13 +433,9 @@ virKeepAliveStart(virKeepAlivePtr ka,
     else
         timeout = ka->interval - delay;
     ka->intervalStart = now - (ka->interval - timeout);
-    ka->timer = virEventAddTimeout(timeout * 1000, virKeepAliveTimer,
-                                   ka, virObjectFreeCallback);
-    if (ka->timer < 0)
+    if (virKeepAliveRegister(ka) < 0)
         goto cleanup;
 
-    /* the timer now has another reference to this object */
-    virObjectRef(ka);
     ret = 0;
 
  cleanup:
@@ -303,18 +447,21 @@ virKeepAliveStart(virKeepAlivePtr ka,
 void
 virKeepAliveStop(virKeepAlivePtr ka)
 {
+    bool registered;
+
     virObjectLock(ka);
 
     PROBE(RPC_KEEPALIVE_STOP,
           "ka=%p client=%p",
           ka, ka->client);
 
-    if (ka->timer > 0) {
-        virEventRemoveTimeout(ka->timer);
-        ka->timer = -1;
-    }
+    registered = virKeepAliveUnregister(ka);
 
     virObjectUnlock(ka);
+
+    /* drop the wheel's reference outside of our own lock */
+    if (registered)
+        virObjectUnref(ka);
 }
 
 
@@ -409,9 +556,6 @@ virKeepAliveCheckMessage(virKeepAlivePtr ka,
         }
     }
 
-    if (ka->timer >= 0)
-        virEventUpdateTimeout(ka->timer, ka->interval * 1000);
-
     virObjectUnlock(ka);
 
     return ret;
@@ -59,6 +59,9 @@ struct _virNetClientCall {
     bool expectReply;
     bool nonBlock;
     bool haveThread;
+    /* Call belongs to a batch; completed calls stay on the wait
+     * queue until the submitting thread collects their replies */
+    bool batch;
 
     virCond cond;
 
@@ -266,6 +269,13 @@ virNetClientKeepAliveStart(virNetClientPtr client,
 
     virObjectLock(client);
     ret = virKeepAliveStart(client->keepalive, interval, count);
+
+    /* For TCP transports additionally offload liveness probing to the
+     * kernel; a dead transport is then torn down even if the daemon
+     * never gets around to sending an application level ping */
+    if (ret == 0 && interval > 0 &&
+        virNetSocketSetTCPKeepAlive(client->sock, interval, count) < 0)
+        ret = -1;
     virObjectUnlock(client);
 
     return ret;
@@ -987,12 +997,11 @@ virNetClientCallDispatchReply(virNetClientPtr client)
         return -1;
     }
 
-    if (VIR_REALLOC_N(thecall->msg->buffer, client->msg.bufferLength) < 0)
+    if (virNetMessageSetBufferSize(thecall->msg, client->msg.bufferLength) < 0)
         return -1;
 
     memcpy(thecall->msg->buffer, client->msg.buffer, client->msg.bufferLength);
     memcpy(&thecall->msg->header, &client->msg.header, sizeof(client->msg.header));
-    thecall->msg->bufferLength = client->msg.bufferLength;
     thecall->msg->bufferOffset = client->msg.bufferOffset;
 
     thecall->msg->nfds = client->msg.nfds;
@@ -1147,6 +1156,7 @@ virNetClientCallDispatch(virNetClientPtr client)
         return virNetClientCallDispatchMessage(client);
 
     case VIR_NET_STREAM: /* Stream protocol */
+    case VIR_NET_STREAM_HOLE: /* Sparse stream protocol */
         return virNetClientCallDispatchStream(client);
 
     default:
@@ -1233,8 +1243,8 @@ virNetClientIOReadMessage(virNetClientPtr client)
 
     /* Start by reading length word */
     if (client->msg.bufferLength == 0) {
-        client->msg.bufferLength = 4;
-        if (VIR_ALLOC_N(client->msg.buffer, client->msg.bufferLength) < 0)
+        if (virNetMessageSetBufferSize(&client->msg,
+                                       VIR_NET_MESSAGE_LEN_MAX) < 0)
             return -ENOMEM;
     }
 
@@ -1314,7 +1324,7 @@ virNetClientIOHandleInput(virNetClientPtr client)
                 }
 
                 ret = virNetClientCallDispatch(client);
-                virNetMessageClear(&client->msg);
+                virNetMessageReset(&client->msg);
                 /*
                  * We've completed one call, but we don't want to
                  * spin around the loop forever if there are many
@@ -1366,6 +1376,13 @@ static bool virNetClientIOEventLoopRemoveDone(virNetClientCallPtr call,
     if (call->mode != VIR_NET_CLIENT_MODE_COMPLETE)
         return false;
 
+    /* Completed batch calls without a thread must stay in the queue
+     * so their reply messages survive until the thread which sent
+     * the batch gets around to collecting them
+     */
+    if (call->batch && !call->haveThread)
+        return false;
+
     /*
      * ...if the call being removed from the list
      * still has a thread, then wake that thread up,
@@ -1409,6 +1426,15 @@ virNetClientIOEventLoopRemoveAll(virNetClientCallPtr call,
     if (call == thiscall)
         return false;
 
+    /* Batched calls are owned by the thread which sent the batch;
+     * just unlink them and let it detect the failure when it
+     * collects the replies
+     */
+    if (call->batch) {
+        VIR_DEBUG("Unlinking batched call %p", call);
+        return true;
+    }
+
     VIR_DEBUG("Removing call %p", call);
     virCondDestroy(&call->cond);
     VIR_FREE(call->msg);
@@ -2012,6 +2038,110 @@ int virNetClientSendWithReply(virNetClientPtr client,
 }
 
 
+/*
+ * @msgs: an array of @nmsgs messages allocated on heap or stack
+ *
+ * Send a set of independent calls in a single pipelined flight and
+ * wait for all of the replies synchronously. All the messages are
+ * transmitted back-to-back before any reply is waited for, so the
+ * whole batch costs one wire round trip instead of one per call.
+ * Replies are matched to messages by serial number, so the order in
+ * which the server completes them does not matter.
+ *
+ * The caller is responsible for free'ing each message if it was
+ * allocated on the heap
+ *
+ * Returns 0 on success (all replies received), -1 on failure. On
+ * failure some of the messages may nonetheless contain valid replies
+ * and others may not; none of them should be trusted.
+ */
+int virNetClientSendBatch(virNetClientPtr client,
+                          virNetMessagePtr *msgs,
+                          size_t nmsgs)
+{
+    virNetClientCallPtr *calls = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (nmsgs == 0)
+        return 0;
+
+    virObjectLock(client);
+
+    if (!client->sock || client->wantClose) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("client socket is closed"));
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(calls, nmsgs) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nmsgs; i++) {
+        PROBE(RPC_CLIENT_MSG_TX_QUEUE,
+              "client=%p len=%zu prog=%u vers=%u proc=%u type=%u status=%u serial=%u",
+              client, msgs[i]->bufferLength,
+              msgs[i]->header.prog, msgs[i]->header.vers, msgs[i]->header.proc,
+              msgs[i]->header.type, msgs[i]->header.status, msgs[i]->header.serial);
+
+        if (!(calls[i] = virNetClientCallNew(msgs[i], true, false)))
+            goto cleanup;
+        calls[i]->batch = true;
+    }
+
+    /* Queue the satellite calls first, so whichever thread ends up
+     * with the buck transmits the entire batch in one flight. The
+     * last call is the one this thread drives the I/O with.
+     */
+    for (i = 0; i < nmsgs - 1; i++)
+        virNetClientCallQueue(&client->waitDispatch, calls[i]);
+
+    calls[nmsgs - 1]->haveThread = true;
+    if (virNetClientIO(client, calls[nmsgs - 1]) < 0)
+        goto cleanup;
+
+    /* Collect any replies which had not yet arrived when our own
+     * call completed, taking over dispatch for each still
+     * outstanding call in turn.
+     */
+    for (i = 0; i < nmsgs - 1; i++) {
+        if (calls[i]->mode == VIR_NET_CLIENT_MODE_COMPLETE)
+            continue;
+
+        if (!client->sock || client->wantClose) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("client socket is closed"));
+            goto cleanup;
+        }
+
+        /* virNetClientIO requeues the call, so take it off the list
+         * first to avoid corrupting it */
+        virNetClientCallRemove(&client->waitDispatch, calls[i]);
+        calls[i]->haveThread = true;
+        if (virNetClientIO(client, calls[i]) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (calls) {
+        for (i = 0; i < nmsgs; i++) {
+            if (!calls[i])
+                continue;
+            /* Calls which completed without ever having a thread are
+             * still linked on the wait queue; unlink before freeing */
+            virNetClientCallRemove(&client->waitDispatch, calls[i]);
+            virCondDestroy(&calls[i]->cond);
+            VIR_FREE(calls[i]);
+        }
+        VIR_FREE(calls);
+    }
+    virObjectUnlock(client);
+    return ret;
+}
+
+
 /*
  * @msg: a message allocated on heap or stack
  *
@@ -98,6 +98,10 @@ void virNetClientRemoveStream(virNetClientPtr client,
 int virNetClientSendWithReply(virNetClientPtr client,
                               virNetMessagePtr msg);
 
+int virNetClientSendBatch(virNetClientPtr client,
+                          virNetMessagePtr *msgs,
+                          size_t nmsgs);
+
 int virNetClientSendNoReply(virNetClientPtr client,
                             virNetMessagePtr msg);
 
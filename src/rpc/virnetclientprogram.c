@@ -402,3 +402,103 @@ int virNetClientProgramCall(virNetClientProgramPtr prog,
     }
     return -1;
 }
+
+
+/*
+ * @calls: array of @ncalls calls to make
+ *
+ * Issue all the calls in @calls as a single pipelined flight,
+ * costing one wire round trip for the whole batch, and decode
+ * each reply into the corresponding @ret. Each entry must carry
+ * a unique serial number. FD passing is not supported for
+ * batched calls.
+ *
+ * Returns 0 if every call succeeded, -1 on failure. On failure
+ * none of the @ret structures should be trusted.
+ */
+int virNetClientProgramCallBatch(virNetClientProgramPtr prog,
+                                 virNetClientPtr client,
+                                 size_t ncalls,
+                                 virNetClientProgramBatchCallPtr calls)
+{
+    virNetMessagePtr *msgs = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (ncalls == 0)
+        return 0;
+
+    if (VIR_ALLOC_N(msgs, ncalls) < 0)
+        return -1;
+
+    for (i = 0; i < ncalls; i++) {
+        if (!(msgs[i] = virNetMessageNew(false)))
+            goto cleanup;
+
+        msgs[i]->header.prog = prog->program;
+        msgs[i]->header.vers = prog->version;
+        msgs[i]->header.status = VIR_NET_OK;
+        msgs[i]->header.type = VIR_NET_CALL;
+        msgs[i]->header.serial = calls[i].serial;
+        msgs[i]->header.proc = calls[i].proc;
+
+        if (virNetMessageEncodeHeader(msgs[i]) < 0)
+            goto cleanup;
+
+        if (virNetMessageEncodePayload(msgs[i],
+                                       calls[i].args_filter,
+                                       calls[i].args) < 0)
+            goto cleanup;
+    }
+
+    if (virNetClientSendBatch(client, msgs, ncalls) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ncalls; i++) {
+        virNetMessagePtr msg = msgs[i];
+
+        if (msg->header.type != VIR_NET_REPLY) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unexpected message type %d"), msg->header.type);
+            goto cleanup;
+        }
+        if (msg->header.proc != calls[i].proc) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unexpected message proc %d != %d"),
+                           msg->header.proc, calls[i].proc);
+            goto cleanup;
+        }
+        if (msg->header.serial != calls[i].serial) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unexpected message serial %d != %d"),
+                           msg->header.serial, calls[i].serial);
+            goto cleanup;
+        }
+
+        switch (msg->header.status) {
+        case VIR_NET_OK:
+            if (virNetMessageDecodePayload(msg,
+                                           calls[i].ret_filter,
+                                           calls[i].ret) < 0)
+                goto cleanup;
+            break;
+
+        case VIR_NET_ERROR:
+            virNetClientProgramDispatchError(prog, msg);
+            goto cleanup;
+
+        default:
+            virReportError(VIR_ERR_RPC,
+                           _("Unexpected message status %d"), msg->header.status);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ncalls; i++)
+        virNetMessageFree(msgs[i]);
+    VIR_FREE(msgs);
+    return ret;
+}
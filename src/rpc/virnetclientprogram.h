@@ -81,6 +81,22 @@ int virNetClientProgramCall(virNetClientProgramPtr prog,
                             xdrproc_t args_filter, void *args,
                             xdrproc_t ret_filter, void *ret);
 
+typedef struct _virNetClientProgramBatchCall virNetClientProgramBatchCall;
+typedef virNetClientProgramBatchCall *virNetClientProgramBatchCallPtr;
+
+struct _virNetClientProgramBatchCall {
+    int proc;
+    unsigned serial;
+    xdrproc_t args_filter;
+    void *args;
+    xdrproc_t ret_filter;
+    void *ret;
+};
+
+int virNetClientProgramCallBatch(virNetClientProgramPtr prog,
+                                 virNetClientPtr client,
+                                 size_t ncalls,
+                                 virNetClientProgramBatchCallPtr calls);
 
 
 #endif /* __VIR_NET_CLIENT_PROGRAM_H__ */
@@ -52,6 +52,11 @@ struct _virNetClientStream {
     virNetMessagePtr rx;
     bool incomingEOF;
 
+    /* Size of the hole at the head of the incoming stream, as
+     * decoded from a VIR_NET_STREAM_HOLE packet. The data is
+     * all zeroes and was never put on the wire */
+    long long holeLength;
+
     virNetClientStreamEventCallback cb;
     void *cbOpaque;
     virFreeCallback cbFree;
@@ -86,7 +91,7 @@ virNetClientStreamEventTimerUpdate(virNetClientStreamPtr st)
 
     VIR_DEBUG("Check timer rx=%p cbEvents=%d", st->rx, st->cbEvents);
 
-    if (((st->rx || st->incomingEOF) &&
+    if (((st->rx || st->holeLength || st->incomingEOF) &&
          (st->cbEvents & VIR_STREAM_EVENT_READABLE)) ||
         (st->cbEvents & VIR_STREAM_EVENT_WRITABLE)) {
         VIR_DEBUG("Enabling event timer");
@@ -108,7 +113,7 @@ virNetClientStreamEventTimer(int timer ATTRIBUTE_UNUSED, void *opaque)
 
     if (st->cb &&
         (st->cbEvents & VIR_STREAM_EVENT_READABLE) &&
-        (st->rx || st->incomingEOF))
+        (st->rx || st->holeLength || st->incomingEOF))
         events |= VIR_STREAM_EVENT_READABLE;
     if (st->cb &&
         (st->cbEvents & VIR_STREAM_EVENT_WRITABLE))
@@ -267,6 +272,8 @@ int virNetClientStreamQueuePacket(virNetClientStreamPtr st,
                                   virNetMessagePtr msg)
 {
     virNetMessagePtr tmp_msg;
+    char *buffer;
+    size_t bufferCapacity;
 
     VIR_DEBUG("Incoming stream message: stream=%p message=%p", st, msg);
 
@@ -279,11 +286,16 @@ int virNetClientStreamQueuePacket(virNetClientStreamPtr st,
     /* Copy header */
     memcpy(&tmp_msg->header, &msg->header, sizeof(msg->header));
 
-    /* Steal message buffer */
+    /* Swap message buffers; tmp_msg may own a recycled buffer,
+     * which @msg can then reuse for the next incoming packet */
+    buffer = tmp_msg->buffer;
+    bufferCapacity = tmp_msg->bufferCapacity;
     tmp_msg->buffer = msg->buffer;
+    tmp_msg->bufferCapacity = msg->bufferCapacity;
     tmp_msg->bufferLength = msg->bufferLength;
     tmp_msg->bufferOffset = msg->bufferOffset;
-    msg->buffer = NULL;
+    msg->buffer = buffer;
+    msg->bufferCapacity = bufferCapacity;
     msg->bufferLength = msg->bufferOffset = 0;
 
     virObjectLock(st);
@@ -350,19 +362,64 @@ int virNetClientStreamSendPacket(virNetClientStreamPtr st,
     return -1;
 }
 
+/*
+ * Decodes the VIR_NET_STREAM_HOLE packet at the head of the
+ * incoming queue and accounts its size into @st->holeLength.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+virNetClientStreamHandleHole(virNetClientStreamPtr st)
+{
+    virNetMessagePtr msg;
+    virNetStreamHole data;
+    int ret = -1;
+
+    msg = st->rx;
+    memset(&data, 0, sizeof(data));
+
+    /* We should not be called unless there's a VIR_NET_STREAM_HOLE
+     * message at the head of the queue. But doesn't hurt to check */
+    if (!msg || msg->header.type != VIR_NET_STREAM_HOLE) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unexpected stream hole"));
+        goto cleanup;
+    }
+
+    if (virNetMessageDecodePayload(msg,
+                                   (xdrproc_t) xdr_virNetStreamHole,
+                                   &data) < 0)
+        goto cleanup;
+
+    st->holeLength += data.length;
+    ret = 0;
+
+ cleanup:
+    if (msg) {
+        virNetMessageQueueServe(&st->rx);
+        virNetMessageFree(msg);
+    }
+    return ret;
+}
+
+
 int virNetClientStreamRecvPacket(virNetClientStreamPtr st,
                                  virNetClientPtr client,
                                  char *data,
                                  size_t nbytes,
-                                 bool nonblock)
+                                 bool nonblock,
+                                 unsigned int flags)
 {
     int rv = -1;
     size_t want;
 
-    VIR_DEBUG("st=%p client=%p data=%p nbytes=%zu nonblock=%d",
-              st, client, data, nbytes, nonblock);
+    VIR_DEBUG("st=%p client=%p data=%p nbytes=%zu nonblock=%d flags=%x",
+              st, client, data, nbytes, nonblock, flags);
+
+    virCheckFlags(VIR_STREAM_RECV_STOP_AT_HOLE, -1);
+
     virObjectLock(st);
-    if (!st->rx && !st->incomingEOF) {
+    if (!st->rx && !st->holeLength && !st->incomingEOF) {
         virNetMessagePtr msg;
         int ret;
 
@@ -392,12 +449,49 @@ int virNetClientStreamRecvPacket(virNetClientStreamPtr st,
             goto cleanup;
     }
 
-    VIR_DEBUG("After IO rx=%p", st->rx);
+    VIR_DEBUG("After IO rx=%p holeLength=%lld", st->rx, st->holeLength);
     want = nbytes;
-    while (want && st->rx) {
+    while (want) {
         virNetMessagePtr msg = st->rx;
         size_t len = want;
 
+        if (!st->holeLength &&
+            msg &&
+            msg->header.type == VIR_NET_STREAM_HOLE) {
+            /* Handle a hole at the head of the queue. This
+             * merely updates @holeLength; the hole is then dealt
+             * with in the next iteration. */
+            if (virNetClientStreamHandleHole(st) < 0)
+                goto cleanup;
+            continue;
+        }
+
+        if (st->holeLength) {
+            if (flags & VIR_STREAM_RECV_STOP_AT_HOLE) {
+                /* Don't mix data and hole in one call. If any
+                 * data was copied already, report that; the
+                 * hole is reported on the next call. */
+                if (want != nbytes)
+                    break;
+
+                rv = -3;
+                goto cleanup;
+            }
+
+            /* The caller doesn't care about holes. Simulate the
+             * zeroes that were never sent over the wire. */
+            if (len > st->holeLength)
+                len = st->holeLength;
+
+            memset(data + (nbytes - want), 0, len);
+            want -= len;
+            st->holeLength -= len;
+            continue;
+        }
+
+        if (!msg)
+            break;
+
         if (len > msg->bufferLength - msg->bufferOffset)
             len = msg->bufferLength - msg->bufferOffset;
 
@@ -423,6 +517,69 @@ int virNetClientStreamRecvPacket(virNetClientStreamPtr st,
 }
 
 
+int virNetClientStreamSendHole(virNetClientStreamPtr st,
+                               virNetClientPtr client,
+                               long long length,
+                               unsigned int flags)
+{
+    virNetMessagePtr msg;
+    virNetStreamHole data;
+    int ret = -1;
+
+    VIR_DEBUG("st=%p client=%p length=%lld flags=%x",
+              st, client, length, flags);
+
+    virCheckFlags(0, -1);
+
+    memset(&data, 0, sizeof(data));
+    data.length = length;
+
+    if (!(msg = virNetMessageNew(false)))
+        return -1;
+
+    virObjectLock(st);
+
+    msg->header.prog = virNetClientProgramGetProgram(st->prog);
+    msg->header.vers = virNetClientProgramGetVersion(st->prog);
+    msg->header.status = VIR_NET_CONTINUE;
+    msg->header.type = VIR_NET_STREAM_HOLE;
+    msg->header.serial = st->serial;
+    msg->header.proc = st->proc;
+
+    virObjectUnlock(st);
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    if (virNetMessageEncodePayload(msg,
+                                   (xdrproc_t) xdr_virNetStreamHole,
+                                   &data) < 0)
+        goto cleanup;
+
+    /* Hole packets are async fire&forget, just like data packets */
+    if (virNetClientSendNoReply(client, msg) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virNetMessageFree(msg);
+    return ret;
+}
+
+
+int virNetClientStreamRecvHole(virNetClientPtr client ATTRIBUTE_UNUSED,
+                               virNetClientStreamPtr st,
+                               long long *length)
+{
+    virObjectLock(st);
+    *length = st->holeLength;
+    st->holeLength = 0;
+    virObjectUnlock(st);
+    return 0;
+}
+
+
 int virNetClientStreamEventAddCallback(virNetClientStreamPtr st,
                                        int events,
                                        virNetClientStreamEventCallback cb,
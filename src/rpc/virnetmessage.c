@@ -28,6 +28,7 @@
 #include "virerror.h"
 #include "virlog.h"
 #include "virfile.h"
+#include "virthread.h"
 #include "virutil.h"
 #include "virstring.h"
 
@@ -35,12 +36,35 @@
 
 VIR_LOG_INIT("rpc.netmessage");
 
+/* Every RPC call allocates at least two messages, so rather than
+ * handing each buffer straight back to the allocator keep a small
+ * free list of messages together with their payload buffers. Only
+ * buffers up to the standard initial size are retained; oversized
+ * (stream transfer) buffers are freed so the cache stays bounded. */
+#define VIR_NET_MESSAGE_CACHE_MAX 16
+#define VIR_NET_MESSAGE_CACHE_BUFFER_MAX \
+    (VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX)
+
+static virMutex virNetMessageCacheLock = VIR_MUTEX_INITIALIZER;
+static virNetMessagePtr virNetMessageCache; /* chained via ->next */
+static size_t virNetMessageCacheCount;
+
 virNetMessagePtr virNetMessageNew(bool tracked)
 {
     virNetMessagePtr msg;
 
-    if (VIR_ALLOC(msg) < 0)
+    virMutexLock(&virNetMessageCacheLock);
+    if ((msg = virNetMessageCache)) {
+        virNetMessageCache = msg->next;
+        virNetMessageCacheCount--;
+    }
+    virMutexUnlock(&virNetMessageCacheLock);
+
+    if (msg) {
+        msg->next = NULL;
+    } else if (VIR_ALLOC(msg) < 0) {
         return NULL;
+    }
 
     msg->tracked = tracked;
     VIR_DEBUG("msg=%p tracked=%d", msg, tracked);
@@ -49,6 +73,33 @@ virNetMessagePtr virNetMessageNew(bool tracked)
 }
 
 
+/**
+ * virNetMessageSetBufferSize:
+ * @msg: message to prepare
+ * @length: required payload buffer size in bytes
+ *
+ * Declare that @msg's buffer holds @length bytes, growing the
+ * underlying allocation only when the capacity left over from an
+ * earlier use of the buffer is too small. All sizing of message
+ * buffers must go through this function, since anything allocating
+ * into msg->buffer directly would disagree with the recorded
+ * capacity.
+ *
+ * Returns 0 on success, -1 on OOM
+ */
+int
+virNetMessageSetBufferSize(virNetMessagePtr msg, size_t length)
+{
+    if (length > msg->bufferCapacity) {
+        if (VIR_REALLOC_N(msg->buffer, length) < 0)
+            return -1;
+        msg->bufferCapacity = length;
+    }
+    msg->bufferLength = length;
+    return 0;
+}
+
+
 void
 virNetMessageClearPayload(virNetMessagePtr msg)
 {
@@ -63,7 +114,11 @@ virNetMessageClearPayload(virNetMessagePtr msg)
 
     msg->bufferOffset = 0;
     msg->bufferLength = 0;
+    msg->bufferCapacity = 0;
     VIR_FREE(msg->buffer);
+
+    msg->extPayloadLength = 0;
+    VIR_FREE(msg->extPayload);
 }
 
 
@@ -79,6 +134,29 @@ void virNetMessageClear(virNetMessagePtr msg)
 }
 
 
+/* Like virNetMessageClear, but keeps the payload buffer allocation
+ * around for the next message instead of freeing it */
+void virNetMessageReset(virNetMessagePtr msg)
+{
+    bool tracked = msg->tracked;
+    char *buffer = msg->buffer;
+    size_t bufferCapacity = msg->bufferCapacity;
+    size_t i;
+
+    VIR_DEBUG("msg=%p nfds=%zu", msg, msg->nfds);
+
+    for (i = 0; i < msg->nfds; i++)
+        VIR_FORCE_CLOSE(msg->fds[i]);
+    VIR_FREE(msg->fds);
+    VIR_FREE(msg->extPayload);
+
+    memset(msg, 0, sizeof(*msg));
+    msg->tracked = tracked;
+    msg->buffer = buffer;
+    msg->bufferCapacity = bufferCapacity;
+}
+
+
 void virNetMessageFree(virNetMessagePtr msg)
 {
     if (!msg)
@@ -89,8 +167,29 @@ void virNetMessageFree(virNetMessagePtr msg)
     if (msg->cb)
         msg->cb(msg, msg->opaque);
 
-    virNetMessageClearPayload(msg);
-    VIR_FREE(msg);
+    /* Oversized buffers are dropped, normal sized ones are kept for
+     * the next message using this cache slot */
+    if (msg->bufferCapacity > VIR_NET_MESSAGE_CACHE_BUFFER_MAX) {
+        msg->bufferCapacity = 0;
+        VIR_FREE(msg->buffer);
+    }
+
+    virNetMessageReset(msg);
+    msg->tracked = false;
+
+    virMutexLock(&virNetMessageCacheLock);
+    if (virNetMessageCacheCount < VIR_NET_MESSAGE_CACHE_MAX) {
+        msg->next = virNetMessageCache;
+        virNetMessageCache = msg;
+        virNetMessageCacheCount++;
+        msg = NULL;
+    }
+    virMutexUnlock(&virNetMessageCacheLock);
+
+    if (msg) {
+        VIR_FREE(msg->buffer);
+        VIR_FREE(msg);
+    }
 }
 
 void virNetMessageQueuePush(virNetMessagePtr *queue, virNetMessagePtr msg)
@@ -153,8 +252,7 @@ int virNetMessageDecodeLength(virNetMessagePtr msg)
 
     /* Extend our declared buffer length and carry
        on reading the header + payload */
-    msg->bufferLength += len;
-    if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    if (virNetMessageSetBufferSize(msg, msg->bufferLength + len) < 0)
         goto cleanup;
 
     VIR_DEBUG("Got length, now need %zu total (%u more)",
@@ -230,11 +328,15 @@ int virNetMessageEncodeHeader(virNetMessagePtr msg)
     int ret = -1;
     unsigned int len = 0;
 
-    msg->bufferLength = VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX;
-    if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    if (virNetMessageSetBufferSize(msg, VIR_NET_MESSAGE_INITIAL +
+                                   VIR_NET_MESSAGE_LEN_MAX) < 0)
         return ret;
     msg->bufferOffset = 0;
 
+    /* Discard any stale payload from a previous use of this message */
+    msg->extPayloadLength = 0;
+    VIR_FREE(msg->extPayload);
+
     /* Format the header. */
     xdrmem_create(&xdr,
                   msg->buffer,
@@ -367,9 +469,7 @@ int virNetMessageEncodePayload(virNetMessagePtr msg,
 
         xdr_destroy(&xdr);
 
-        msg->bufferLength = newlen + VIR_NET_MESSAGE_LEN_MAX;
-
-        if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+        if (virNetMessageSetBufferSize(msg, newlen + VIR_NET_MESSAGE_LEN_MAX) < 0)
             goto error;
 
         xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
@@ -451,9 +551,7 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
             return -1;
         }
 
-        msg->bufferLength = msg->bufferOffset + len;
-
-        if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+        if (virNetMessageSetBufferSize(msg, msg->bufferOffset + len) < 0)
             return -1;
 
         VIR_DEBUG("Increased message buffer length = %zu", msg->bufferLength);
@@ -482,6 +580,57 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
 }
 
 
+/*
+ * Attach @data as the message payload without copying it into
+ * msg->buffer; it will be sent on the wire straight after the
+ * encoded header with a scatter-gather write. @data must be
+ * heap allocated and ownership always transfers to @msg, even
+ * on failure, so large payloads can flow from their producer
+ * to the socket with no intermediate copy.
+ */
+int virNetMessageEncodePayloadZeroCopy(virNetMessagePtr msg,
+                                       char *data,
+                                       size_t len)
+{
+    XDR xdr;
+    unsigned int msglen;
+
+    if ((msg->bufferOffset + len) >
+        (VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX)) {
+        virReportError(VIR_ERR_RPC,
+                       _("Stream data too long to send "
+                         "(%zu bytes needed, %zu bytes available)"),
+                       len,
+                       VIR_NET_MESSAGE_MAX +
+                       VIR_NET_MESSAGE_LEN_MAX -
+                       msg->bufferOffset);
+        VIR_FREE(data);
+        return -1;
+    }
+
+    /* Re-encode the length word to cover the detached payload too. */
+    VIR_DEBUG("Encode length as %zu", msg->bufferOffset + len);
+    xdrmem_create(&xdr, msg->buffer, VIR_NET_MESSAGE_HEADER_XDR_LEN, XDR_ENCODE);
+    msglen = msg->bufferOffset + len;
+    if (!xdr_u_int(&xdr, &msglen)) {
+        virReportError(VIR_ERR_RPC, "%s", _("Unable to encode message length"));
+        goto error;
+    }
+    xdr_destroy(&xdr);
+
+    msg->bufferLength = msg->bufferOffset;
+    msg->bufferOffset = 0;
+    msg->extPayload = data;
+    msg->extPayloadLength = len;
+    return 0;
+
+ error:
+    xdr_destroy(&xdr);
+    VIR_FREE(data);
+    return -1;
+}
+
+
 int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
 {
     XDR xdr;
@@ -36,8 +36,15 @@ struct _virNetMessage {
 
     char *buffer; /* Initially VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX */
                   /* Maximum   VIR_NET_MESSAGE_MAX     + VIR_NET_MESSAGE_LEN_MAX */
+    size_t bufferCapacity; /* allocated size of @buffer; may exceed
+                            * @bufferLength when the buffer is reused */
     size_t bufferLength;
-    size_t bufferOffset;
+    size_t bufferOffset; /* on TX ranges over @buffer and @extPayload */
+
+    /* Optional payload owned by the message, sent on the wire
+     * straight after @buffer instead of being copied into it */
+    char *extPayload;
+    size_t extPayloadLength;
 
     virNetMessageHeader header;
 
@@ -58,8 +65,13 @@ void virNetMessageClearPayload(virNetMessagePtr msg);
 
 void virNetMessageClear(virNetMessagePtr);
 
+void virNetMessageReset(virNetMessagePtr msg);
+
 void virNetMessageFree(virNetMessagePtr msg);
 
+int virNetMessageSetBufferSize(virNetMessagePtr msg, size_t length)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+
 virNetMessagePtr virNetMessageQueueServe(virNetMessagePtr *queue)
     ATTRIBUTE_NONNULL(1);
 void virNetMessageQueuePush(virNetMessagePtr *queue,
@@ -85,6 +97,10 @@ int virNetMessageDecodePayload(virNetMessagePtr msg,
 int virNetMessageEncodeNumFDs(virNetMessagePtr msg);
 int virNetMessageDecodeNumFDs(virNetMessagePtr msg);
 
+int virNetMessageEncodePayloadZeroCopy(virNetMessagePtr msg,
+                                       char *data,
+                                       size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
                                   const char *buf,
                                   size_t len)
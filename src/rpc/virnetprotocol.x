@@ -108,6 +108,10 @@ const VIR_NET_MESSAGE_NUM_FDS_MAX = 32;
  *         server message: stream had an error
  *         client message: client aborted the stream
  *
+ *  - type == VIR_NET_STREAM_HOLE
+ *     * VIR_NET_CONTINUE
+ *         description of the hole that occurred in the stream
+ *
  * Payload varies according to type and status:
  *
  *  - type == VIR_NET_CALL
@@ -143,6 +147,10 @@ const VIR_NET_MESSAGE_NUM_FDS_MAX = 32;
  *     * status == VIR_NET_ERROR
  *          remote_error    Error information
  *
+ *  - type == VIR_NET_STREAM_HOLE
+ *     * status == VIR_NET_CONTINUE
+ *          virNetStreamHole   hole description
+ *
  */
 enum virNetMessageType {
     /* client -> server. args from a method call */
@@ -156,7 +164,11 @@ enum virNetMessageType {
     /* client -> server. args from a method call, with passed FDs */
     VIR_NET_CALL_WITH_FDS = 4,
     /* server -> client. reply/error from a method call, with passed FDs */
-    VIR_NET_REPLY_WITH_FDS = 5
+    VIR_NET_REPLY_WITH_FDS = 5,
+    /* either direction. stream hole packet. Carries a
+     * virNetStreamHole describing a section of the stream
+     * that is all zeroes and was not transmitted */
+    VIR_NET_STREAM_HOLE = 6
 };
 
 enum virNetMessageStatus {
@@ -236,3 +248,12 @@ struct virNetMessageError {
     int int2;
     virNetMessageNetwork net; /* unused */
 };
+
+/* Payload of a VIR_NET_STREAM_HOLE message. Describes a section
+ * of the stream that contains no data (is all zeroes) and thus
+ * is not transmitted over the wire.
+ */
+struct virNetStreamHole {
+    hyper length;           /* Size of the hole in bytes */
+    unsigned int flags;     /* Unused, pass 0 */
+};
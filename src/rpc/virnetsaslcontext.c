@@ -47,6 +47,17 @@ struct _virNetSASLSession {
     sasl_conn_t *conn;
     size_t maxbufsize;
     sasl_callback_t *callbacks;
+
+    /* Each direction has its own lock and a persistent output buffer
+     * which is grown on demand and reused for every message, so that
+     * encoding and decoding don't contend on the session lock and
+     * don't churn the allocator on busy connections */
+    virMutex encodeLock;
+    char *encodeBuf;
+    size_t encodeBufAlloc;
+    virMutex decodeLock;
+    char *decodeBuf;
+    size_t decodeBufAlloc;
 };
 
 
@@ -178,6 +189,13 @@ virNetSASLSessionPtr virNetSASLSessionNewClient(virNetSASLContextPtr ctxt ATTRIB
     if (!(sasl = virObjectLockableNew(virNetSASLSessionClass)))
         return NULL;
 
+    if (virMutexInit(&sasl->encodeLock) < 0 ||
+        virMutexInit(&sasl->decodeLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to initialize mutex"));
+        goto cleanup;
+    }
+
     /* Arbitrary size for amount of data we can encode in a single block */
     sasl->maxbufsize = 1 << 16;
 
@@ -214,6 +232,13 @@ virNetSASLSessionPtr virNetSASLSessionNewServer(virNetSASLContextPtr ctxt ATTRIB
     if (!(sasl = virObjectLockableNew(virNetSASLSessionClass)))
         return NULL;
 
+    if (virMutexInit(&sasl->encodeLock) < 0 ||
+        virMutexInit(&sasl->decodeLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to initialize mutex"));
+        goto cleanup;
+    }
+
     /* Arbitrary size for amount of data we can encode in a single block */
     sasl->maxbufsize = 1 << 16;
 
@@ -603,34 +628,55 @@ ssize_t virNetSASLSessionEncode(virNetSASLSessionPtr sasl,
 {
     unsigned inlen = inputLen;
     unsigned outlen = 0;
+    const char *saslout;
+    size_t maxbufsize;
     int err;
     ssize_t ret = -1;
 
+    /* Only hold the session lock long enough to read the negotiated
+     * buffer size; the cipher work is serialized by the direction
+     * specific lock so the two directions don't block each other */
     virObjectLock(sasl);
-    if (inputLen > sasl->maxbufsize) {
+    maxbufsize = sasl->maxbufsize;
+    virObjectUnlock(sasl);
+
+    if (inputLen > maxbufsize) {
         virReportSystemError(EINVAL,
                              _("SASL data length %zu too long, max %zu"),
-                             inputLen, sasl->maxbufsize);
-        goto cleanup;
+                             inputLen, maxbufsize);
+        return -1;
     }
 
+    virMutexLock(&sasl->encodeLock);
     err = sasl_encode(sasl->conn,
                       input,
                       inlen,
-                      output,
+                      &saslout,
                       &outlen);
-    *outputlen = outlen;
-
     if (err != SASL_OK) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("failed to encode SASL data: %d (%s)"),
                        err, sasl_errstring(err, NULL, NULL));
         goto cleanup;
     }
+
+    /* Stash the result in the session owned buffer; the buffer only
+     * ever grows to the negotiated maximum and is reused for all
+     * subsequent messages */
+    if (sasl->encodeBufAlloc < outlen) {
+        if (VIR_REALLOC_N(sasl->encodeBuf, outlen) < 0)
+            goto cleanup;
+        sasl->encodeBufAlloc = outlen;
+    }
+    if (outlen)
+        memcpy(sasl->encodeBuf, saslout, outlen);
+
+    *output = sasl->encodeBuf;
+    *outputlen = outlen;
     ret = 0;
 
  cleanup:
-    virObjectUnlock(sasl);
+    virMutexUnlock(&sasl->encodeLock);
     return ret;
 }
 
@@ -642,33 +688,49 @@ ssize_t virNetSASLSessionDecode(virNetSASLSessionPtr sasl,
 {
     unsigned inlen = inputLen;
     unsigned outlen = 0;
+    const char *saslout;
+    size_t maxbufsize;
     int err;
     ssize_t ret = -1;
 
     virObjectLock(sasl);
-    if (inputLen > sasl->maxbufsize) {
+    maxbufsize = sasl->maxbufsize;
+    virObjectUnlock(sasl);
+
+    if (inputLen > maxbufsize) {
         virReportSystemError(EINVAL,
                              _("SASL data length %zu too long, max %zu"),
-                             inputLen, sasl->maxbufsize);
-        goto cleanup;
+                             inputLen, maxbufsize);
+        return -1;
     }
 
+    virMutexLock(&sasl->decodeLock);
     err = sasl_decode(sasl->conn,
                       input,
                       inlen,
-                      output,
+                      &saslout,
                       &outlen);
-    *outputlen = outlen;
     if (err != SASL_OK) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("failed to decode SASL data: %d (%s)"),
                        err, sasl_errstring(err, NULL, NULL));
         goto cleanup;
     }
+
+    if (sasl->decodeBufAlloc < outlen) {
+        if (VIR_REALLOC_N(sasl->decodeBuf, outlen) < 0)
+            goto cleanup;
+        sasl->decodeBufAlloc = outlen;
+    }
+    if (outlen)
+        memcpy(sasl->decodeBuf, saslout, outlen);
+
+    *output = sasl->decodeBuf;
+    *outputlen = outlen;
     ret = 0;
 
  cleanup:
-    virObjectUnlock(sasl);
+    virMutexUnlock(&sasl->decodeLock);
     return ret;
 }
 
@@ -678,5 +740,9 @@ void virNetSASLSessionDispose(void *obj)
 
     if (sasl->conn)
         sasl_dispose(&sasl->conn);
+    VIR_FREE(sasl->encodeBuf);
+    VIR_FREE(sasl->decodeBuf);
+    virMutexDestroy(&sasl->encodeLock);
+    virMutexDestroy(&sasl->decodeLock);
     VIR_FREE(sasl->callbacks);
 }
@@ -52,6 +52,8 @@ struct _virNetServer {
     char *name;
 
     virThreadPoolPtr workers;
+    size_t clientJobLimit;              /* Max outstanding worker jobs
+                                         * per client, 0 for no limit */
 
     char *mdnsGroupName;
     virNetServerMDNSPtr mdns;
@@ -158,10 +160,53 @@ static int virNetServerProcessMsg(virNetServerPtr srv,
     return ret;
 }
 
+/* Hand @msg over to the worker pool on behalf of @client.
+ * The srv must be locked when this is called.
+ */
+static int virNetServerSubmitJob(virNetServerPtr srv,
+                                 virNetServerClientPtr client,
+                                 virNetMessagePtr msg)
+{
+    virNetServerProgramPtr prog = NULL;
+    virNetServerJobPtr job;
+    unsigned int priority = 0;
+    size_t i;
+    int ret;
+
+    for (i = 0; i < srv->nprograms; i++) {
+        if (virNetServerProgramMatches(srv->programs[i], msg)) {
+            prog = srv->programs[i];
+            break;
+        }
+    }
+
+    if (VIR_ALLOC(job) < 0)
+        return -1;
+
+    job->client = client;
+    job->msg = msg;
+
+    if (prog) {
+        virObjectRef(prog);
+        job->prog = prog;
+        priority = virNetServerProgramGetPriority(prog, msg->header.proc);
+    }
+
+    ret = virThreadPoolSendJob(srv->workers, priority, job);
+
+    if (ret < 0) {
+        VIR_FREE(job);
+        virObjectUnref(prog);
+    }
+
+    return ret;
+}
+
 static void virNetServerHandleJob(void *jobOpaque, void *opaque)
 {
     virNetServerPtr srv = opaque;
     virNetServerJobPtr job = jobOpaque;
+    virNetMessagePtr deferred;
 
     VIR_DEBUG("server=%p client=%p message=%p prog=%p",
               srv, job->client, job->msg, job->prog);
@@ -169,12 +214,35 @@ static void virNetServerHandleJob(void *jobOpaque, void *opaque)
     if (virNetServerProcessMsg(srv, job->client, job->prog, job->msg) < 0)
         goto error;
 
+    /* Retiring this job may release a message the client had parked
+     * at its quota; the deferred message carries the reference on
+     * the client taken when it was originally dispatched */
+    if ((deferred = virNetServerClientJobEnd(job->client))) {
+        int rc;
+
+        virObjectLock(srv);
+        rc = virNetServerSubmitJob(srv, job->client, deferred);
+        virObjectUnlock(srv);
+
+        if (rc < 0) {
+            virNetMessageFree(deferred);
+            virNetServerClientClose(job->client);
+            virObjectUnref(job->client);
+        }
+    }
+
     virObjectUnref(job->prog);
     virObjectUnref(job->client);
     VIR_FREE(job);
     return;
 
  error:
+    if ((deferred = virNetServerClientJobEnd(job->client))) {
+        /* Drop the parked message along with the client reference
+         * it carried; the client is being closed anyway */
+        virNetMessageFree(deferred);
+        virObjectUnref(job->client);
+    }
     virObjectUnref(job->prog);
     virNetMessageFree(job->msg);
     virNetServerClientClose(job->client);
@@ -187,44 +255,41 @@ static int virNetServerDispatchNewMessage(virNetServerClientPtr client,
                                           void *opaque)
 {
     virNetServerPtr srv = opaque;
-    virNetServerProgramPtr prog = NULL;
-    unsigned int priority = 0;
-    size_t i;
     int ret = -1;
 
     VIR_DEBUG("server=%p client=%p message=%p",
               srv, client, msg);
 
     virObjectLock(srv);
-    for (i = 0; i < srv->nprograms; i++) {
-        if (virNetServerProgramMatches(srv->programs[i], msg)) {
-            prog = srv->programs[i];
-            break;
-        }
-    }
 
     if (srv->workers) {
-        virNetServerJobPtr job;
-
-        if (VIR_ALLOC(job) < 0)
+        /* Fairness: a client already at its job quota has the
+         * message parked instead; virNetServerHandleJob resubmits
+         * it when one of the client's jobs retires */
+        if (virNetServerClientJobBegin(client, msg,
+                                       srv->clientJobLimit) > 0) {
+            ret = 0;
             goto cleanup;
-
-        job->client = client;
-        job->msg = msg;
-
-        if (prog) {
-            virObjectRef(prog);
-            job->prog = prog;
-            priority = virNetServerProgramGetPriority(prog, msg->header.proc);
         }
 
-        ret = virThreadPoolSendJob(srv->workers, priority, job);
-
+        ret = virNetServerSubmitJob(srv, client, msg);
         if (ret < 0) {
-            VIR_FREE(job);
-            virObjectUnref(prog);
+            /* Nothing can be parked yet - this thread is the only
+             * producer and the quota check just passed - so this
+             * merely retires the job slot we took above */
+            virNetMessageFree(virNetServerClientJobEnd(client));
         }
     } else {
+        virNetServerProgramPtr prog = NULL;
+        size_t i;
+
+        for (i = 0; i < srv->nprograms; i++) {
+            if (virNetServerProgramMatches(srv->programs[i], msg)) {
+                prog = srv->programs[i];
+                break;
+            }
+        }
+
         ret = virNetServerProcessMsg(srv, client, prog, msg);
     }
 
@@ -368,6 +433,9 @@ virNetServerPtr virNetServerNew(const char *name,
                                           srv)))
         goto error;
 
+    /* Let no single client occupy more than half the worker pool */
+    srv->clientJobLimit = (max_workers + 1) / 2;
+
     if (VIR_STRDUP(srv->name, name) < 0)
         goto error;
 
@@ -905,7 +973,8 @@ virNetServerGetThreadPoolParameters(virNetServerPtr srv,
                                     size_t *nWorkers,
                                     size_t *freeWorkers,
                                     size_t *nPrioWorkers,
-                                    size_t *jobQueueDepth)
+                                    size_t *jobQueueDepth,
+                                    size_t *jobQueueWait)
 {
     virObjectLock(srv);
 
@@ -915,6 +984,7 @@ virNetServerGetThreadPoolParameters(virNetServerPtr srv,
     *nWorkers = virThreadPoolGetCurrentWorkers(srv->workers);
     *nPrioWorkers = virThreadPoolGetPriorityWorkers(srv->workers);
     *jobQueueDepth = virThreadPoolGetJobQueueDepth(srv->workers);
+    *jobQueueWait = virThreadPoolGetJobQueueWait(srv->workers);
 
     virObjectUnlock(srv);
     return 0;
@@ -931,6 +1001,8 @@ virNetServerSetThreadPoolParameters(virNetServerPtr srv,
     virObjectLock(srv);
     ret = virThreadPoolSetParameters(srv->workers, minWorkers,
                                      maxWorkers, prioWorkers);
+    if (ret == 0 && maxWorkers >= 0)
+        srv->clientJobLimit = ((size_t)maxWorkers + 1) / 2;
     virObjectUnlock(srv);
 
     return ret;
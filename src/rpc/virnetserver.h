@@ -96,7 +96,8 @@ int virNetServerGetThreadPoolParameters(virNetServerPtr srv,
                                         size_t *nWorkers,
                                         size_t *freeWorkers,
                                         size_t *nPrioWorkers,
-                                        size_t *jobQueueDepth);
+                                        size_t *jobQueueDepth,
+                                        size_t *jobQueueWait);
 
 int virNetServerSetThreadPoolParameters(virNetServerPtr srv,
                                         long long int minWorkers,
@@ -106,6 +106,13 @@ struct _virNetServerClient
      * back to client, including async events */
     virNetMessagePtr tx;
 
+    /* Count of jobs queued or executing in the server worker
+     * pool on behalf of this client */
+    size_t njobs;
+    /* Messages held back from the worker pool because the client
+     * already had its fair share of jobs outstanding */
+    virNetMessagePtr jobsDeferred;
+
     /* Filters to capture messages that would otherwise
      * end up on the 'dx' queue */
     virNetServerClientFilterPtr filters;
@@ -325,8 +332,7 @@ virNetServerClientCheckAccess(virNetServerClientPtr client)
      * indicate this (otherwise the socket is abruptly closed).
      * (NB. The '\1' byte is sent in an encrypted record).
      */
-    confirm->bufferLength = 1;
-    if (VIR_ALLOC_N(confirm->buffer, confirm->bufferLength) < 0) {
+    if (virNetMessageSetBufferSize(confirm, 1) < 0) {
         virNetMessageFree(confirm);
         return -1;
     }
@@ -391,8 +397,7 @@ virNetServerClientNewInternal(unsigned long long id,
     /* Prepare one for packet receive */
     if (!(client->rx = virNetMessageNew(true)))
         goto error;
-    client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-    if (VIR_ALLOC_N(client->rx->buffer, client->rx->bufferLength) < 0)
+    if (virNetMessageSetBufferSize(client->rx, VIR_NET_MESSAGE_LEN_MAX) < 0)
         goto error;
     client->nrequests = 1;
 
@@ -928,10 +933,14 @@ const char *virNetServerClientRemoteAddrStringURI(virNetServerClientPtr client)
 void virNetServerClientDispose(void *obj)
 {
     virNetServerClientPtr client = obj;
+    virNetMessagePtr msg;
 
     PROBE(RPC_SERVER_CLIENT_DISPOSE,
           "client=%p", client);
 
+    while ((msg = virNetMessageQueueServe(&client->jobsDeferred)))
+        virNetMessageFree(msg);
+
     if (client->privateData &&
         client->privateDataFreeFunc)
         client->privateDataFreeFunc(client->privateData);
@@ -1278,9 +1287,8 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client)
             if (!(client->rx = virNetMessageNew(true))) {
                 client->wantClose = true;
             } else {
-                client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-                if (VIR_ALLOC_N(client->rx->buffer,
-                                client->rx->bufferLength) < 0) {
+                if (virNetMessageSetBufferSize(client->rx,
+                                               VIR_NET_MESSAGE_LEN_MAX) < 0) {
                     client->wantClose = true;
                 } else {
                     client->nrequests++;
@@ -1292,6 +1300,11 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client)
 }
 
 
+/* Cap on the scatter-gather segments one write attempt covers; each
+ * queued message contributes its buffer and possibly a detached
+ * payload. Messages beyond the cap go out on the next attempt */
+#define VIR_NET_SERVER_CLIENT_MAX_WRITE_VEC 32
+
 /*
  * Send client->tx using no encoding
  *
@@ -1302,26 +1315,88 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client)
  */
 static ssize_t virNetServerClientWrite(virNetServerClientPtr client)
 {
+    virNetMessagePtr msg = client->tx;
+    size_t totalLength = msg->bufferLength + msg->extPayloadLength;
+    virNetSocketIOVec vec[VIR_NET_SERVER_CLIENT_MAX_WRITE_VEC];
+    size_t nvec = 0;
+    bool batch = msg->nfds == 0;
     ssize_t ret;
+    ssize_t done;
 
-    if (client->tx->bufferLength < client->tx->bufferOffset) {
+    if (totalLength < msg->bufferOffset) {
         virReportError(VIR_ERR_RPC,
                        _("unexpected zero/negative length request %lld"),
-                       (long long int)(client->tx->bufferLength - client->tx->bufferOffset));
+                       (long long int)(totalLength - msg->bufferOffset));
         client->wantClose = true;
         return -1;
     }
 
-    if (client->tx->bufferLength == client->tx->bufferOffset)
+    if (totalLength == msg->bufferOffset)
         return 1;
 
-    ret = virNetSocketWrite(client->sock,
-                            client->tx->buffer + client->tx->bufferOffset,
-                            client->tx->bufferLength - client->tx->bufferOffset);
+    if (msg->bufferOffset < msg->bufferLength) {
+        /* Gather the encoded header and any detached payload
+         * into a single write */
+        vec[nvec].buf = msg->buffer + msg->bufferOffset;
+        vec[nvec].len = msg->bufferLength - msg->bufferOffset;
+        nvec++;
+        if (msg->extPayloadLength) {
+            vec[nvec].buf = msg->extPayload;
+            vec[nvec].len = msg->extPayloadLength;
+            nvec++;
+        }
+    } else {
+        size_t extOffset = msg->bufferOffset - msg->bufferLength;
+        vec[nvec].buf = msg->extPayload + extOffset;
+        vec[nvec].len = msg->extPayloadLength - extOffset;
+        nvec++;
+    }
+
+#if WITH_SASL
+    /* Not while a freshly negotiated SASL layer is waiting to kick
+     * in right after the current message completes */
+    if (client->sasl)
+        batch = false;
+#endif
+
+    if (batch) {
+        /* Gather the untouched messages queued behind the head too,
+         * so a burst of messages - typically events fanned out to a
+         * subscribed client - leaves in one syscall. Stop with a
+         * message carrying FDs: those must be passed over the socket
+         * before any later message's bytes */
+        virNetMessagePtr next;
+
+        for (next = msg->next;
+             next && nvec + 2 <= ARRAY_CARDINALITY(vec);
+             next = next->next) {
+            vec[nvec].buf = next->buffer;
+            vec[nvec].len = next->bufferLength;
+            nvec++;
+            if (next->extPayloadLength) {
+                vec[nvec].buf = next->extPayload;
+                vec[nvec].len = next->extPayloadLength;
+                nvec++;
+            }
+            if (next->nfds)
+                break;
+        }
+    }
+
+    ret = virNetSocketWriteVector(client->sock, vec, nvec);
     if (ret <= 0)
         return ret; /* -1 error, 0 = egain */
 
-    client->tx->bufferOffset += ret;
+    /* Spread the written byte count over the queued messages */
+    done = ret;
+    for (msg = client->tx; msg && done; msg = msg->next) {
+        size_t remain = msg->bufferLength + msg->extPayloadLength -
+            msg->bufferOffset;
+        size_t chunk = MIN((size_t)done, remain);
+
+        msg->bufferOffset += chunk;
+        done -= chunk;
+    }
     return ret;
 }
 
@@ -1334,7 +1409,10 @@ static void
 virNetServerClientDispatchWrite(virNetServerClientPtr client)
 {
     while (client->tx) {
-        if (client->tx->bufferOffset < client->tx->bufferLength) {
+        size_t totalLength = client->tx->bufferLength +
+            client->tx->extPayloadLength;
+
+        if (client->tx->bufferOffset < totalLength) {
             ssize_t ret;
             ret = virNetServerClientWrite(client);
             if (ret < 0) {
@@ -1345,7 +1423,7 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
                 return; /* Would block on write EAGAIN */
         }
 
-        if (client->tx->bufferOffset == client->tx->bufferLength) {
+        if (client->tx->bufferOffset == totalLength) {
             virNetMessagePtr msg;
             size_t i;
 
@@ -1380,9 +1458,9 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
                 if (!client->rx &&
                     client->nrequests < client->nrequests_max) {
                     /* Ready to recv more messages */
-                    virNetMessageClear(msg);
-                    msg->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-                    if (VIR_ALLOC_N(msg->buffer, msg->bufferLength) < 0) {
+                    virNetMessageReset(msg);
+                    if (virNetMessageSetBufferSize(msg,
+                                                   VIR_NET_MESSAGE_LEN_MAX) < 0) {
                         virNetMessageFree(msg);
                         return;
                     }
@@ -1508,6 +1586,66 @@ int virNetServerClientSendMessage(virNetServerClientPtr client,
 }
 
 
+/**
+ * virNetServerClientJobBegin:
+ * @client: client the message came from
+ * @msg: message about to be handed to the worker pool
+ * @limit: max jobs the client may have outstanding, 0 for no limit
+ *
+ * Account for a new worker pool job on behalf of @client. If the
+ * client is already at its quota the message is parked instead, to
+ * be released by virNetServerClientJobEnd when one of the client's
+ * jobs completes, so a single busy client cannot monopolise the
+ * worker pool.
+ *
+ * Returns 1 if @msg was deferred, 0 if the caller should submit it
+ */
+int virNetServerClientJobBegin(virNetServerClientPtr client,
+                               virNetMessagePtr msg,
+                               size_t limit)
+{
+    int ret = 0;
+
+    virObjectLock(client);
+    if (limit && client->njobs >= limit) {
+        VIR_DEBUG("client=%p msg=%p deferred at %zu jobs",
+                  client, msg, client->njobs);
+        virNetMessageQueuePush(&client->jobsDeferred, msg);
+        ret = 1;
+    } else {
+        client->njobs++;
+    }
+    virObjectUnlock(client);
+
+    return ret;
+}
+
+
+/**
+ * virNetServerClientJobEnd:
+ * @client: client whose worker pool job just completed
+ *
+ * Retire a job accounted by virNetServerClientJobBegin. If the
+ * client has messages parked waiting for a job slot the oldest one
+ * is handed back to the caller for submission, keeping the job
+ * count unchanged since the slot passes straight on.
+ *
+ * Returns the next message to submit, or NULL if none is pending
+ */
+virNetMessagePtr virNetServerClientJobEnd(virNetServerClientPtr client)
+{
+    virNetMessagePtr msg;
+
+    virObjectLock(client);
+    msg = virNetMessageQueueServe(&client->jobsDeferred);
+    if (!msg)
+        client->njobs--;
+    virObjectUnlock(client);
+
+    return msg;
+}
+
+
 bool virNetServerClientNeedAuth(virNetServerClientPtr client)
 {
     bool need = false;
@@ -1553,6 +1691,15 @@ virNetServerClientInitKeepAlive(virNetServerClientPtr client,
 
     client->keepalive = ka;
 
+    /* For TCP transports additionally offload liveness probing to the
+     * kernel so unreachable clients are dropped at the transport level
+     * too, without any extra event loop wakeups */
+    if (interval > 0 &&
+        virNetSocketSetTCPKeepAlive(client->sock, interval, count) < 0)
+        goto cleanup;
+
+    ret = 0;
+
  cleanup:
     virObjectUnlock(client);
 
@@ -145,6 +145,11 @@ const char *virNetServerClientRemoteAddrStringURI(virNetServerClientPtr client);
 int virNetServerClientSendMessage(virNetServerClientPtr client,
                                   virNetMessagePtr msg);
 
+int virNetServerClientJobBegin(virNetServerClientPtr client,
+                               virNetMessagePtr msg,
+                               size_t limit);
+virNetMessagePtr virNetServerClientJobEnd(virNetServerClientPtr client);
+
 bool virNetServerClientNeedAuth(virNetServerClientPtr client);
 
 int virNetServerClientGetTransport(virNetServerClientPtr client);
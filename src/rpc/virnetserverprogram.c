@@ -30,10 +30,16 @@
 #include "virerror.h"
 #include "virlog.h"
 #include "virfile.h"
+#include "virmetrics.h"
 #include "virthread.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
+/* Dispatches running longer than this are logged at info level so that
+ * slow procedures can be spotted from the logs without a debugger */
+#define VIR_NET_SERVER_SLOW_DISPATCH_MS 1000
+
 VIR_LOG_INIT("rpc.netserverprogram");
 
 struct _virNetServerProgram {
@@ -378,6 +384,8 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
     virNetMessageError rerr;
     size_t i;
     virIdentityPtr identity = NULL;
+    unsigned long long start = 0;
+    unsigned long long elapsed;
 
     memset(&rerr, 0, sizeof(rerr));
 
@@ -434,8 +442,22 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
      *
      *   'args and 'ret'
      */
+    if (virTimeMillisNowRaw(&start) < 0)
+        start = 0;
+
     rv = (dispatcher->func)(server, client, msg, &rerr, arg, ret);
 
+    if (start &&
+        virTimeMillisNowRaw(&elapsed) == 0) {
+        elapsed -= start;
+        virMetricsRecord(VIR_METRICS_RPC_DISPATCH, elapsed);
+        VIR_DEBUG("Dispatched prog=%u proc=%d in %llums",
+                  prog->program, msg->header.proc, elapsed);
+        if (elapsed >= VIR_NET_SERVER_SLOW_DISPATCH_MS)
+            VIR_INFO("Slow dispatch prog=%u proc=%d took %llums",
+                     prog->program, msg->header.proc, elapsed);
+    }
+
     if (virIdentitySetCurrent(NULL) < 0)
         goto error;
 
@@ -535,7 +557,9 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
         return -1;
 
     if (data && len) {
-        if (virNetMessageEncodePayloadRaw(msg, data, len) < 0)
+        /* Hand the (heap allocated) data buffer over to the message
+         * so it reaches the socket without an intermediate copy */
+        if (virNetMessageEncodePayloadZeroCopy(msg, (char *)data, len) < 0)
             return -1;
 
     } else {
@@ -548,6 +572,43 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
 }
 
 
+int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
+                                      virNetServerClientPtr client,
+                                      virNetMessagePtr msg,
+                                      int procedure,
+                                      unsigned int serial,
+                                      long long length,
+                                      unsigned int flags)
+{
+    virNetStreamHole data;
+
+    VIR_DEBUG("client=%p msg=%p length=%lld", client, msg, length);
+
+    memset(&data, 0, sizeof(data));
+    data.length = length;
+    data.flags = flags;
+
+    /* Return header. We're reusing same message object, so
+     * only need to tweak type/status fields */
+    msg->header.prog = prog->program;
+    msg->header.vers = prog->version;
+    msg->header.proc = procedure;
+    msg->header.type = VIR_NET_STREAM_HOLE;
+    msg->header.serial = serial;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        return -1;
+
+    if (virNetMessageEncodePayload(msg,
+                                   (xdrproc_t) xdr_virNetStreamHole,
+                                   &data) < 0)
+        return -1;
+
+    return virNetServerClientSendMessage(client, msg);
+}
+
+
 void virNetServerProgramDispose(void *obj ATTRIBUTE_UNUSED)
 {
 }
@@ -96,6 +96,8 @@ int virNetServerProgramUnknownError(virNetServerClientPtr client,
                                     virNetMessagePtr msg,
                                     virNetMessageHeaderPtr req);
 
+/* When @len > 0, @data must be heap allocated and ownership
+ * always transfers to @msg, even on failure */
 int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
                                       virNetServerClientPtr client,
                                       virNetMessagePtr msg,
@@ -104,4 +106,12 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
                                       const char *data,
                                       size_t len);
 
+int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
+                                      virNetServerClientPtr client,
+                                      virNetMessagePtr msg,
+                                      int procedure,
+                                      unsigned int serial,
+                                      long long length,
+                                      unsigned int flags);
+
 #endif /* __VIR_NET_SERVER_PROGRAM_H__ */
@@ -0,0 +1,424 @@
+/*
+ * virnetshmring.c: shared memory ring transport for co-located peers
+ *
+ * Copyright (C) 2016 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#ifndef WIN32
+# include <sys/mman.h>
+# include <sys/stat.h>
+# ifdef __linux__
+#  include <sys/syscall.h>
+# endif
+#endif
+
+/* File sealing appeared in Linux 3.17 along with memfd_create; the
+ * constants may be missing from older libc headers */
+#ifndef F_ADD_SEALS
+# define F_LINUX_SPECIFIC_BASE 1024
+# define F_ADD_SEALS (F_LINUX_SPECIFIC_BASE + 9)
+# define F_GET_SEALS (F_LINUX_SPECIFIC_BASE + 10)
+#endif
+#ifndef F_SEAL_SHRINK
+# define F_SEAL_SHRINK 0x0002
+#endif
+#ifndef MFD_CLOEXEC
+# define MFD_CLOEXEC 0x0001U
+# define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+#include "virnetshmring.h"
+#include "viralloc.h"
+#include "viratomic.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+VIR_LOG_INIT("rpc.netshmring");
+
+#define VIR_NET_SHM_RING_MAGIC 0x4c565352 /* LVSR */
+#define VIR_NET_SHM_RING_VERSION 1
+
+/* Each direction is a single producer/single consumer byte ring.
+ * Positions increase monotonically and are reduced modulo the data
+ * area size on access, so an empty ring has head == tail and a full
+ * one has head - tail == size. The pad keeps the two directions on
+ * separate cache lines.
+ */
+typedef struct _virNetSHMRingDir virNetSHMRingDir;
+struct _virNetSHMRingDir {
+    volatile int head;          /* only advanced by the producer */
+    volatile int tail;          /* only advanced by the consumer */
+    char pad[120];
+};
+
+typedef struct _virNetSHMRingHeader virNetSHMRingHeader;
+struct _virNetSHMRingHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int size;          /* data bytes per direction */
+    unsigned int unused;
+    virNetSHMRingDir dir[2];    /* 0: creator to acceptor, 1: reverse */
+};
+
+struct _virNetSHMRing {
+    virObject parent;
+
+    int fd;
+    virNetSHMRingHeader *hdr;
+    size_t mapsize;
+    unsigned int size;          /* validated data-area size per direction;
+                                 * the copy in the shared header stays
+                                 * writable by the peer after validation
+                                 * and must never be read again */
+    char *data[2];
+    bool creator;               /* whether we created the segment */
+};
+
+
+static virClassPtr virNetSHMRingClass;
+static void virNetSHMRingDispose(void *obj);
+
+static int virNetSHMRingOnceInit(void)
+{
+    if (!(virNetSHMRingClass = virClassNew(virClassForObject(),
+                                           "virNetSHMRing",
+                                           sizeof(virNetSHMRing),
+                                           virNetSHMRingDispose)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virNetSHMRing)
+
+
+#ifndef WIN32
+
+static int virNetSHMRingMap(virNetSHMRingPtr ring, size_t size)
+{
+    void *map;
+
+    ring->mapsize = sizeof(virNetSHMRingHeader) + 2 * size;
+
+    map = mmap(NULL, ring->mapsize, PROT_READ | PROT_WRITE,
+               MAP_SHARED, ring->fd, 0);
+    if (map == MAP_FAILED) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to map shared memory ring"));
+        return -1;
+    }
+
+    ring->hdr = map;
+    ring->size = size;
+    ring->data[0] = (char *)map + sizeof(virNetSHMRingHeader);
+    ring->data[1] = ring->data[0] + size;
+    return 0;
+}
+
+
+virNetSHMRingPtr virNetSHMRingNew(size_t size)
+{
+    virNetSHMRingPtr ring;
+    virNetSHMRingHeader hdr;
+
+    if (virNetSHMRingInitialize() < 0)
+        return NULL;
+
+    /* Power of two so positions can wrap via a simple mask */
+    if (size < 4096 || (size & (size - 1))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Invalid shared memory ring size %zu"), size);
+        return NULL;
+    }
+
+    if (!(ring = virObjectNew(virNetSHMRingClass)))
+        return NULL;
+
+    ring->fd = -1;
+    ring->creator = true;
+
+    /* A sealable memfd is mandatory: the acceptor maps memory we
+     * keep an fd to, so it must be able to verify the segment can
+     * never shrink underneath its mapping */
+#if defined(__linux__) && defined(SYS_memfd_create)
+    ring->fd = syscall(SYS_memfd_create, "libvirt-shmring",
+                       MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    errno = ENOSYS;
+#endif
+    if (ring->fd < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create sealable shared memory segment"));
+        goto error;
+    }
+
+    if (ftruncate(ring->fd,
+                  sizeof(virNetSHMRingHeader) + 2 * size) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to size shared memory ring"));
+        goto error;
+    }
+
+    if (fcntl(ring->fd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to seal shared memory ring"));
+        goto error;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = VIR_NET_SHM_RING_MAGIC;
+    hdr.version = VIR_NET_SHM_RING_VERSION;
+    hdr.size = size;
+
+    if (safewrite(ring->fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize shared memory ring"));
+        goto error;
+    }
+
+    if (virNetSHMRingMap(ring, size) < 0)
+        goto error;
+
+    return ring;
+
+ error:
+    virObjectUnref(ring);
+    return NULL;
+}
+
+
+virNetSHMRingPtr virNetSHMRingNewFD(int fd)
+{
+    virNetSHMRingPtr ring;
+    virNetSHMRingHeader hdr;
+    struct stat sb;
+    int seals;
+
+    if (virNetSHMRingInitialize() < 0)
+        return NULL;
+
+    if (!(ring = virObjectNew(virNetSHMRingClass)))
+        return NULL;
+
+    ring->fd = fd;
+    ring->creator = false;
+
+    /* The peer keeps an fd to the memory we are about to map; unless
+     * shrinking is sealed off it could ftruncate the segment later
+     * and turn every access of ours into SIGBUS. F_GET_SEALS fails
+     * with EINVAL on anything that is not a memfd, so this also
+     * rejects plain files */
+    if ((seals = fcntl(fd, F_GET_SEALS)) < 0 ||
+        !(seals & F_SEAL_SHRINK)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Shared memory ring is not sealed against shrinking"));
+        goto error;
+    }
+
+    if (fstat(fd, &sb) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to stat shared memory ring"));
+        goto error;
+    }
+
+    if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        hdr.magic != VIR_NET_SHM_RING_MAGIC ||
+        hdr.version != VIR_NET_SHM_RING_VERSION ||
+        hdr.size < 4096 ||
+        (hdr.size & (hdr.size - 1)) ||
+        (off_t)(sizeof(hdr) + 2 * (unsigned long long)hdr.size) != sb.st_size) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Malformed shared memory ring header"));
+        goto error;
+    }
+
+    if (virNetSHMRingMap(ring, hdr.size) < 0)
+        goto error;
+
+    return ring;
+
+ error:
+    ring->fd = -1; /* caller owns @fd on failure */
+    virObjectUnref(ring);
+    return NULL;
+}
+
+
+int virNetSHMRingGetFD(virNetSHMRingPtr ring)
+{
+    return ring->fd;
+}
+
+
+/* The creator produces into dir[0] and consumes dir[1], the
+ * acceptor the other way around */
+ssize_t virNetSHMRingWrite(virNetSHMRingPtr ring,
+                           const char *buf,
+                           size_t len)
+{
+    virNetSHMRingDir *d = &ring->hdr->dir[ring->creator ? 0 : 1];
+    char *data = ring->data[ring->creator ? 0 : 1];
+    unsigned int size = ring->size;
+    unsigned int head = virAtomicIntGet(&d->head);
+    unsigned int tail = virAtomicIntGet(&d->tail);
+    unsigned int avail = size - (head - tail);
+    unsigned int idx;
+    unsigned int chunk;
+
+    /* head and tail live in memory the peer can scribble on, so any
+     * value derived from them must be clamped before it is used as a
+     * copy bound; idx is masked against our validated size below */
+    if (avail > size)
+        avail = size;
+
+    if (len > avail)
+        len = avail;
+    if (!len)
+        return 0;
+
+    idx = head & (size - 1);
+    chunk = size - idx;
+    if (chunk > len)
+        chunk = len;
+    memcpy(data + idx, buf, chunk);
+    if (chunk < len)
+        memcpy(data, buf + chunk, len - chunk);
+
+    /* Publish the data before moving the head so the consumer never
+     * sees bytes it must not read yet */
+    virAtomicIntSet(&d->head, head + len);
+    return len;
+}
+
+
+ssize_t virNetSHMRingRead(virNetSHMRingPtr ring,
+                          char *buf,
+                          size_t len)
+{
+    virNetSHMRingDir *d = &ring->hdr->dir[ring->creator ? 1 : 0];
+    char *data = ring->data[ring->creator ? 1 : 0];
+    unsigned int size = ring->size;
+    unsigned int head = virAtomicIntGet(&d->head);
+    unsigned int tail = virAtomicIntGet(&d->tail);
+    unsigned int avail = head - tail;
+    unsigned int idx;
+    unsigned int chunk;
+
+    /* a hostile peer can advance head arbitrarily; clamping avail
+     * keeps the copies inside our mapping, at worst handing the
+     * caller bytes the peer controls anyway */
+    if (avail > size)
+        avail = size;
+
+    if (len > avail)
+        len = avail;
+    if (!len)
+        return 0;
+
+    idx = tail & (size - 1);
+    chunk = size - idx;
+    if (chunk > len)
+        chunk = len;
+    memcpy(buf, data + idx, chunk);
+    if (chunk < len)
+        memcpy(buf + chunk, data, len - chunk);
+
+    virAtomicIntSet(&d->tail, tail + len);
+    return len;
+}
+
+
+bool virNetSHMRingHasData(virNetSHMRingPtr ring)
+{
+    virNetSHMRingDir *d = &ring->hdr->dir[ring->creator ? 1 : 0];
+
+    return virAtomicIntGet(&d->head) != virAtomicIntGet(&d->tail);
+}
+
+
+static void virNetSHMRingDispose(void *obj)
+{
+    virNetSHMRingPtr ring = obj;
+
+    if (ring->hdr)
+        munmap(ring->hdr, ring->mapsize);
+    VIR_FORCE_CLOSE(ring->fd);
+}
+
+#else /* WIN32 */
+
+virNetSHMRingPtr virNetSHMRingNew(size_t size ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Shared memory rings are not supported on this platform"));
+    return NULL;
+}
+
+
+virNetSHMRingPtr virNetSHMRingNewFD(int fd ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Shared memory rings are not supported on this platform"));
+    return NULL;
+}
+
+
+int virNetSHMRingGetFD(virNetSHMRingPtr ring ATTRIBUTE_UNUSED)
+{
+    return -1;
+}
+
+
+ssize_t virNetSHMRingWrite(virNetSHMRingPtr ring ATTRIBUTE_UNUSED,
+                           const char *buf ATTRIBUTE_UNUSED,
+                           size_t len ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Shared memory rings are not supported on this platform"));
+    return -1;
+}
+
+
+ssize_t virNetSHMRingRead(virNetSHMRingPtr ring ATTRIBUTE_UNUSED,
+                          char *buf ATTRIBUTE_UNUSED,
+                          size_t len ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Shared memory rings are not supported on this platform"));
+    return -1;
+}
+
+
+bool virNetSHMRingHasData(virNetSHMRingPtr ring ATTRIBUTE_UNUSED)
+{
+    return false;
+}
+
+
+static void virNetSHMRingDispose(void *obj ATTRIBUTE_UNUSED)
+{
+}
+
+#endif /* WIN32 */
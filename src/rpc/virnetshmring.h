@@ -0,0 +1,57 @@
+/*
+ * virnetshmring.h: shared memory ring transport for co-located peers
+ *
+ * Copyright (C) 2016 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VIR_NET_SHM_RING_H__
+# define __VIR_NET_SHM_RING_H__
+
+# include "internal.h"
+# include "virobject.h"
+
+/* Greeting written to the socket by the peer offering a ring,
+ * followed by the ring file descriptor via SCM_RIGHTS */
+# define VIR_NET_SHM_RING_GREETING "LVSHMR\1\n"
+# define VIR_NET_SHM_RING_GREETING_LEN 8
+
+/* Byte sent by the acceptor once the ring is mapped and active */
+# define VIR_NET_SHM_RING_ACK '\2'
+
+/* Default size of each direction's data area */
+# define VIR_NET_SHM_RING_DEFAULT_SIZE (1024 * 1024)
+
+typedef struct _virNetSHMRing virNetSHMRing;
+typedef virNetSHMRing *virNetSHMRingPtr;
+
+virNetSHMRingPtr virNetSHMRingNew(size_t size);
+
+virNetSHMRingPtr virNetSHMRingNewFD(int fd);
+
+int virNetSHMRingGetFD(virNetSHMRingPtr ring);
+
+ssize_t virNetSHMRingWrite(virNetSHMRingPtr ring,
+                           const char *buf,
+                           size_t len);
+
+ssize_t virNetSHMRingRead(virNetSHMRingPtr ring,
+                          char *buf,
+                          size_t len);
+
+bool virNetSHMRingHasData(virNetSHMRingPtr ring);
+
+#endif /* __VIR_NET_SHM_RING_H__ */
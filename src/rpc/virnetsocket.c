@@ -25,6 +25,7 @@
 
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <poll.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <signal.h>
@@ -38,6 +39,10 @@
 # include <netinet/tcp.h>
 #endif
 
+#ifndef WIN32
+# include <sys/uio.h>
+#endif
+
 #ifdef HAVE_SYS_UCRED_H
 # include <sys/ucred.h>
 #endif
@@ -48,6 +53,7 @@
 #endif
 
 #include "virnetsocket.h"
+#include "virnetshmring.h"
 #include "virutil.h"
 #include "viralloc.h"
 #include "virerror.h"
@@ -106,8 +112,20 @@ struct _virNetSocket {
 #if WITH_SSH2
     virNetSSHSessionPtr sshSession;
 #endif
+
+    /* Optional shared memory fast path for co-located peers. Once
+     * negotiated all payload flows through the ring and the socket
+     * only carries single byte wakeup tokens (and passed fds) */
+    virNetSHMRingPtr shmring;
+    int shmAwait;               /* virNetSocketSHMState on accepted sockets */
 };
 
+typedef enum {
+    VIR_NET_SOCKET_SHM_NONE = 0,   /* not expecting a ring offer */
+    VIR_NET_SOCKET_SHM_GREETING,   /* greeting bytes may arrive */
+    VIR_NET_SOCKET_SHM_FD,         /* greeting seen, fd pending */
+} virNetSocketSHMState;
+
 
 static virClassPtr virNetSocketClass;
 static void virNetSocketDispose(void *obj);
@@ -527,6 +545,10 @@ int virNetSocketNewListenFD(int fd,
 }
 
 
+/* Delay before starting a connection attempt to the next resolved
+ * address while earlier attempts are still pending */
+#define VIR_NET_CONNECT_STAGGER_MS 250
+
 int virNetSocketNewConnectTCP(const char *nodename,
                               const char *service,
                               int family,
@@ -539,6 +561,11 @@ int virNetSocketNewConnectTCP(const char *nodename,
     virSocketAddr remoteAddr;
     struct addrinfo *runp;
     int savedErrno = ENOENT;
+    int *pending = NULL;
+    struct pollfd *fds = NULL;
+    size_t npending = 0;
+    size_t naddrs = 0;
+    size_t i;
 
     *retsock = NULL;
 
@@ -558,25 +585,108 @@ int virNetSocketNewConnectTCP(const char *nodename,
         return -1;
     }
 
+    for (runp = ai; runp; runp = runp->ai_next)
+        naddrs++;
+
+    if (VIR_ALLOC_N(pending, naddrs) < 0 ||
+        VIR_ALLOC_N(fds, naddrs) < 0)
+        goto error;
+
+    /* Connect to the resolved addresses in parallel, starting the
+     * next attempt while earlier ones are still in progress; the
+     * first one to complete wins and the rest are abandoned. This
+     * stops a single unreachable address (e.g. a broken IPv6 route)
+     * from delaying fallback to the others by a full TCP timeout. */
     runp = ai;
-    while (runp) {
-        if ((fd = socket(runp->ai_family, runp->ai_socktype,
-                         runp->ai_protocol)) < 0) {
-            virReportSystemError(errno, "%s", _("Unable to create socket"));
-            goto error;
-        }
+    while (fd == -1 && (runp || npending)) {
+        int rc;
+        size_t ncheck;
 
-        if (virSetSockReuseAddr(fd, false) < 0)
-            VIR_WARN("Unable to enable port reuse");
+        if (runp) {
+            int tmpfd;
 
-        if (connect(fd, runp->ai_addr, runp->ai_addrlen) >= 0)
-            break;
+            if ((tmpfd = socket(runp->ai_family, runp->ai_socktype,
+                                runp->ai_protocol)) < 0) {
+                virReportSystemError(errno, "%s",
+                                     _("Unable to create socket"));
+                goto error;
+            }
 
-        savedErrno = errno;
-        VIR_FORCE_CLOSE(fd);
-        runp = runp->ai_next;
+            if (virSetSockReuseAddr(tmpfd, false) < 0)
+                VIR_WARN("Unable to enable port reuse");
+
+            if (virSetNonBlock(tmpfd) < 0) {
+                virReportSystemError(errno, "%s",
+                                     _("Unable to set socket non-blocking"));
+                VIR_FORCE_CLOSE(tmpfd);
+                goto error;
+            }
+
+            rc = connect(tmpfd, runp->ai_addr, runp->ai_addrlen);
+            runp = runp->ai_next;
+            if (rc >= 0) {
+                fd = tmpfd;
+                break;
+            }
+            if (errno == EINPROGRESS) {
+                pending[npending++] = tmpfd;
+            } else {
+                savedErrno = errno;
+                VIR_FORCE_CLOSE(tmpfd);
+                /* Immediate failure, go straight for the next address */
+                continue;
+            }
+        }
+
+        for (i = 0; i < npending; i++) {
+            fds[i].fd = pending[i];
+            fds[i].events = POLLOUT;
+            fds[i].revents = 0;
+        }
+
+        rc = poll(fds, npending, runp ? VIR_NET_CONNECT_STAGGER_MS : -1);
+        if (rc < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            virReportSystemError(errno, "%s",
+                                 _("Unable to poll on sockets"));
+            goto error;
+        }
+        if (rc == 0)
+            continue; /* stagger expired, start the next address */
+
+        ncheck = npending;
+        npending = 0;
+        for (i = 0; i < ncheck; i++) {
+            int tmpfd = fds[i].fd;
+            int soerr = 0;
+            socklen_t slen = sizeof(soerr);
+
+            if (fd != -1) {
+                /* A winner was already found, abandon this attempt */
+                VIR_FORCE_CLOSE(tmpfd);
+                continue;
+            }
+            if (!fds[i].revents) {
+                pending[npending++] = tmpfd;
+                continue;
+            }
+            if (getsockopt(tmpfd, SOL_SOCKET, SO_ERROR, &soerr, &slen) < 0)
+                soerr = errno;
+            if (soerr == 0) {
+                fd = tmpfd;
+            } else {
+                savedErrno = soerr;
+                VIR_FORCE_CLOSE(tmpfd);
+            }
+        }
     }
 
+    /* Abandon any attempts still pending after a winner was found */
+    for (i = 0; i < npending; i++)
+        VIR_FORCE_CLOSE(pending[i]);
+    npending = 0;
+
     if (fd == -1) {
         virReportSystemError(savedErrno,
                              _("unable to connect to server at '%s:%s'"),
@@ -584,6 +694,13 @@ int virNetSocketNewConnectTCP(const char *nodename,
         goto error;
     }
 
+    /* Callers expect a blocking socket until they opt out themselves */
+    if (virSetBlocking(fd, true) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to set socket blocking"));
+        goto error;
+    }
+
     localAddr.len = sizeof(localAddr.data);
     if (getsockname(fd, &localAddr.data.sa, &localAddr.len) < 0) {
         virReportSystemError(errno, "%s", _("Unable to get local socket name"));
@@ -600,17 +717,61 @@ int virNetSocketNewConnectTCP(const char *nodename,
         goto error;
 
     freeaddrinfo(ai);
+    VIR_FREE(pending);
+    VIR_FREE(fds);
 
     return 0;
 
  error:
+    for (i = 0; i < npending; i++)
+        VIR_FORCE_CLOSE(pending[i]);
     freeaddrinfo(ai);
+    VIR_FREE(pending);
+    VIR_FREE(fds);
     VIR_FORCE_CLOSE(fd);
     return -1;
 }
 
 
+/* Both ends must opt in explicitly; a ring offer sent to a daemon
+ * which does not expect one would be parsed as RPC garbage
+ */
+static bool virNetSocketSHMRingEnabled(void)
+{
+    const char *env = virGetEnvBlockSUID("LIBVIRT_SHM_RING");
+
+    return env && STRNEQ(env, "0");
+}
+
+
 #ifdef HAVE_SYS_UN_H
+/* Offer the daemon a shared memory ring over the freshly connected,
+ * still blocking socket. The daemon only sends its ack once the ring
+ * is mapped, so on success all subsequent payload may use the ring.
+ */
+static virNetSHMRingPtr virNetSocketSHMRingOffer(int fd)
+{
+    virNetSHMRingPtr ring;
+    char ack = 0;
+
+    if (!(ring = virNetSHMRingNew(VIR_NET_SHM_RING_DEFAULT_SIZE)))
+        return NULL;
+
+    if (safewrite(fd, VIR_NET_SHM_RING_GREETING,
+                  VIR_NET_SHM_RING_GREETING_LEN) != VIR_NET_SHM_RING_GREETING_LEN ||
+        sendfd(fd, virNetSHMRingGetFD(ring)) < 0 ||
+        saferead(fd, &ack, 1) != 1 ||
+        ack != VIR_NET_SHM_RING_ACK) {
+        virReportSystemError(errno, "%s",
+                             _("Failed to negotiate shared memory ring"));
+        virObjectUnref(ring);
+        return NULL;
+    }
+
+    return ring;
+}
+
+
 int virNetSocketNewConnectUNIX(const char *path,
                                bool spawnDaemon,
                                const char *binary,
@@ -623,6 +784,7 @@ int virNetSocketNewConnectUNIX(const char *path,
     virSocketAddr localAddr;
     virSocketAddr remoteAddr;
     char *rundir = NULL;
+    virNetSHMRingPtr ring = NULL;
     int ret = -1;
     bool daemonLaunched = false;
 
@@ -721,9 +883,18 @@ int virNetSocketNewConnectUNIX(const char *path,
         goto cleanup;
     }
 
+    /* Negotiate before virNetSocketNew flips the socket to
+     * non-blocking mode */
+    if (virNetSocketSHMRingEnabled() &&
+        !(ring = virNetSocketSHMRingOffer(fd)))
+        goto cleanup;
+
     if (!(*retsock = virNetSocketNew(&localAddr, &remoteAddr, true, fd, -1, 0)))
         goto cleanup;
 
+    (*retsock)->shmring = ring;
+    ring = NULL;
+
     ret = 0;
 
  cleanup:
@@ -733,6 +904,7 @@ int virNetSocketNewConnectUNIX(const char *path,
     }
     VIR_FREE(lockpath);
     VIR_FREE(rundir);
+    virObjectUnref(ring);
 
     if (ret < 0)
         VIR_FORCE_CLOSE(fd);
@@ -1202,6 +1374,8 @@ void virNetSocketDispose(void *obj)
     virObjectUnref(sock->sshSession);
 #endif
 
+    virObjectUnref(sock->shmring);
+
     VIR_FORCE_CLOSE(sock->fd);
     VIR_FORCE_CLOSE(sock->errfd);
 
@@ -1461,6 +1635,75 @@ int virNetSocketSetBlocking(virNetSocketPtr sock,
 }
 
 
+/* Enable kernel TCP keepalive probes on @sock, so that dead
+ * transports are detected without any application level traffic or
+ * event loop wakeups. @interval is the idle time in seconds before
+ * probing starts as well as the gap between probes, @count is the
+ * number of unanswered probes after which the kernel drops the
+ * connection. This is a no-op for non-TCP sockets.
+ */
+int virNetSocketSetTCPKeepAlive(virNetSocketPtr sock,
+                                int interval,
+                                unsigned int count)
+{
+    int ret = -1;
+    const int on = 1;
+
+    virObjectLock(sock);
+
+    if (sock->localAddr.data.sa.sa_family != AF_INET &&
+        sock->localAddr.data.sa.sa_family != AF_INET6) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (setsockopt(sock->fd, SOL_SOCKET, SO_KEEPALIVE,
+                   &on, sizeof(on)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to enable TCP keepalives"));
+        goto cleanup;
+    }
+
+#ifdef TCP_KEEPIDLE
+    if (interval > 0 &&
+        setsockopt(sock->fd, IPPROTO_TCP, TCP_KEEPIDLE,
+                   &interval, sizeof(interval)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to set TCP keepalive idle time"));
+        goto cleanup;
+    }
+#endif
+
+#ifdef TCP_KEEPINTVL
+    if (interval > 0 &&
+        setsockopt(sock->fd, IPPROTO_TCP, TCP_KEEPINTVL,
+                   &interval, sizeof(interval)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to set TCP keepalive interval"));
+        goto cleanup;
+    }
+#endif
+
+#ifdef TCP_KEEPCNT
+    if (count > 0) {
+        int probes = count;
+        if (setsockopt(sock->fd, IPPROTO_TCP, TCP_KEEPCNT,
+                       &probes, sizeof(probes)) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to set TCP keepalive probe count"));
+            goto cleanup;
+        }
+    }
+#endif
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(sock);
+    return ret;
+}
+
+
 const char *virNetSocketLocalAddrStringSASL(virNetSocketPtr sock)
 {
     return sock->localAddrStrSASL;
@@ -1535,6 +1778,12 @@ bool virNetSocketHasCachedData(virNetSocketPtr sock ATTRIBUTE_UNUSED)
     if (sock->saslDecoded)
         hasCached = true;
 #endif
+
+    /* Ring data is not signalled again once its wakeup token has
+     * been consumed, so partial reads must be resumed from here */
+    if (sock->shmring && virNetSHMRingHasData(sock->shmring))
+        hasCached = true;
+
     virObjectUnlock(sock);
     return hasCached;
 }
@@ -1568,11 +1817,200 @@ bool virNetSocketHasPendingData(virNetSocketPtr sock ATTRIBUTE_UNUSED)
 }
 
 
+#ifndef WIN32
+/* Server side of the ring negotiation, driven from the read path of
+ * accepted UNIX sockets while an offer may still arrive. The offer
+ * is recognized by its greeting prefix; anything else downgrades the
+ * socket to a plain transport for good.
+ *
+ * Returns 1 if the caller should carry on with a normal read,
+ * 0 if negotiation consumed the available data (or would block)
+ * and -1 on error.
+ */
+static ssize_t virNetSocketSHMRingAccept(virNetSocketPtr sock)
+{
+    char ack = VIR_NET_SHM_RING_ACK;
+    ssize_t got;
+
+    if (sock->shmAwait == VIR_NET_SOCKET_SHM_GREETING) {
+        char greeting[VIR_NET_SHM_RING_GREETING_LEN];
+
+        got = recv(sock->fd, greeting, sizeof(greeting), MSG_PEEK);
+        if (got < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                return 0;
+            virReportSystemError(errno, "%s",
+                                 _("Cannot recv data"));
+            return -1;
+        }
+        if (got == 0) {
+            /* Peer hung up; let the caller report EOF */
+            sock->shmAwait = VIR_NET_SOCKET_SHM_NONE;
+            return 1;
+        }
+        if (memcmp(greeting, VIR_NET_SHM_RING_GREETING,
+                   MIN((size_t)got, sizeof(greeting))) != 0) {
+            /* Regular RPC client */
+            sock->shmAwait = VIR_NET_SOCKET_SHM_NONE;
+            return 1;
+        }
+        if ((size_t)got < sizeof(greeting))
+            return 0; /* wait for the rest of the greeting */
+
+        /* Consume the greeting we peeked at */
+        while ((got = recv(sock->fd, greeting, sizeof(greeting), 0)) < 0 &&
+               errno == EINTR)
+            ;
+        if (got != (ssize_t)sizeof(greeting)) {
+            virReportSystemError(errno, "%s",
+                                 _("Cannot recv data"));
+            return -1;
+        }
+        sock->shmAwait = VIR_NET_SOCKET_SHM_FD;
+    }
+
+    if (sock->shmAwait == VIR_NET_SOCKET_SHM_FD) {
+        virNetSHMRingPtr ring;
+        int rfd;
+
+        if ((rfd = recvfd(sock->fd, O_CLOEXEC)) < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                return 0;
+            virReportSystemError(errno, "%s",
+                                 _("Failed to recv file descriptor"));
+            return -1;
+        }
+
+        if (!(ring = virNetSHMRingNewFD(rfd))) {
+            VIR_FORCE_CLOSE(rfd);
+            return -1;
+        }
+
+        /* The peer sends nothing further until it sees the ack, so
+         * this cannot interleave with payload */
+        while ((got = write(sock->fd, &ack, 1)) < 0 && errno == EINTR)
+            ;
+        if (got != 1) {
+            virObjectUnref(ring);
+            virReportSystemError(got < 0 ? errno : EIO, "%s",
+                                 _("Cannot write data"));
+            return -1;
+        }
+
+        VIR_DEBUG("Activated shared memory ring on sock=%p", sock);
+        sock->shmring = ring;
+        sock->shmAwait = VIR_NET_SOCKET_SHM_NONE;
+    }
+
+    return 0;
+}
+
+
+static ssize_t virNetSocketSHMRingReadWire(virNetSocketPtr sock,
+                                           char *buf, size_t len)
+{
+    char tokens[64];
+    bool eof = false;
+    ssize_t got;
+
+    /* Drain the wakeup tokens; the payload itself is in the ring */
+    for (;;) {
+        got = read(sock->fd, tokens, sizeof(tokens));
+        if (got > 0)
+            continue;
+        if (got == 0) {
+            eof = true;
+            break;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN)
+            break;
+        virReportSystemError(errno, "%s",
+                             _("Cannot recv data"));
+        return -1;
+    }
+
+    got = virNetSHMRingRead(sock->shmring, buf, len);
+    if (got > 0) {
+        char token = 'C';
+        ssize_t rc;
+
+        /* Wake a producer that may have backed off on a full ring;
+         * EAGAIN just means unconsumed tokens are already pending */
+        while ((rc = write(sock->fd, &token, 1)) < 0 && errno == EINTR)
+            ;
+        return got;
+    }
+
+    if (eof) {
+        virReportSystemError(EIO, "%s",
+                             _("End of file while reading data"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static ssize_t virNetSocketSHMRingWriteWire(virNetSocketPtr sock,
+                                            const char *buf, size_t len)
+{
+    char token = 'D';
+    ssize_t done;
+    ssize_t rc;
+
+    done = virNetSHMRingWrite(sock->shmring, buf, len);
+    if (done <= 0) {
+        /* Ring full. The socket stays poll-writable the whole time,
+         * so returning 0 straight away would have the event loop spin
+         * calling back into here; instead back off briefly until the
+         * peer signals progress with a credit token, drain the tokens
+         * (payload never travels on the wire, and ring data is
+         * re-flagged via virNetSocketHasCachedData, so consuming them
+         * here loses nothing) and retry once */
+        struct pollfd pfd = { .fd = sock->fd, .events = POLLIN };
+        char tokens[64];
+
+        if (poll(&pfd, 1, 2) > 0 &&
+            read(sock->fd, tokens, sizeof(tokens)) > 0)
+            done = virNetSHMRingWrite(sock->shmring, buf, len);
+
+        if (done <= 0)
+            return 0;
+    }
+
+    /* Wake the peer. EAGAIN is fine since a full socket buffer
+     * means plenty of unconsumed tokens are pending already */
+    while ((rc = write(sock->fd, &token, 1)) < 0 && errno == EINTR)
+        ;
+    if (rc < 0 && errno != EAGAIN) {
+        virReportSystemError(errno, "%s",
+                             _("Cannot write data"));
+        return -1;
+    }
+
+    return done;
+}
+#endif /* !WIN32 */
+
+
 static ssize_t virNetSocketReadWire(virNetSocketPtr sock, char *buf, size_t len)
 {
     char *errout = NULL;
     ssize_t ret;
 
+#ifndef WIN32
+    if (sock->shmAwait != VIR_NET_SOCKET_SHM_NONE) {
+        ret = virNetSocketSHMRingAccept(sock);
+        if (ret <= 0)
+            return ret;
+    }
+
+    if (sock->shmring)
+        return virNetSocketSHMRingReadWire(sock, buf, len);
+#endif
+
 #if WITH_SSH2
     if (sock->sshSession)
         return virNetSocketLibSSH2Read(sock, buf, len);
@@ -1632,6 +2070,11 @@ static ssize_t virNetSocketWriteWire(virNetSocketPtr sock, const char *buf, size
 {
     ssize_t ret;
 
+#ifndef WIN32
+    if (sock->shmring)
+        return virNetSocketSHMRingWriteWire(sock, buf, len);
+#endif
+
 #if WITH_SSH2
     if (sock->sshSession)
         return virNetSocketLibSSH2Write(sock, buf, len);
@@ -1670,6 +2113,91 @@ static ssize_t virNetSocketWriteWire(virNetSocketPtr sock, const char *buf, size
 }
 
 
+/* Cap on the scatter-gather segments handed to writev() in one go;
+ * comfortably below IOV_MAX on every supported platform. Segments
+ * beyond the cap just show up as a short write to the caller */
+#define VIR_NET_SOCKET_MAX_WRITE_VEC 48
+
+/* Write several discontiguous buffers in a single syscall where the
+ * transport allows it, so callers don't have to copy them into
+ * one flat buffer first. Encrypting transports still consume one
+ * buffer at a time; since all callers cope with short writes this
+ * only costs an extra trip through the event loop there.
+ */
+static ssize_t virNetSocketWriteWireVector(virNetSocketPtr sock,
+                                           const virNetSocketIOVec *vec,
+                                           size_t nvec)
+{
+#ifndef WIN32
+    struct iovec iov[VIR_NET_SOCKET_MAX_WRITE_VEC];
+    size_t niov = 0;
+    ssize_t ret;
+#endif
+    size_t first;
+
+    /* Skip leading empty segments so the fallback paths below have
+     * real data to chew on */
+    for (first = 0; first < nvec && !vec[first].len; first++)
+        ;
+    if (first == nvec)
+        return 0;
+
+    if (first + 1 == nvec)
+        return virNetSocketWriteWire(sock, vec[first].buf, vec[first].len);
+
+#ifndef WIN32
+    if (sock->shmring)
+        return virNetSocketWriteWire(sock, vec[first].buf, vec[first].len);
+#endif
+
+#if WITH_SSH2
+    if (sock->sshSession)
+        return virNetSocketLibSSH2Write(sock, vec[first].buf, vec[first].len);
+#endif
+
+#if WITH_GNUTLS
+    if (sock->tlsSession &&
+        virNetTLSSessionGetHandshakeStatus(sock->tlsSession) ==
+        VIR_NET_TLS_HANDSHAKE_COMPLETE)
+        return virNetSocketWriteWire(sock, vec[first].buf, vec[first].len);
+#endif
+
+#ifdef WIN32
+    /* No writev() on winsock */
+    return virNetSocketWriteWire(sock, vec[first].buf, vec[first].len);
+#else
+    for (; first < nvec && niov < ARRAY_CARDINALITY(iov); first++) {
+        if (!vec[first].len)
+            continue;
+        iov[niov].iov_base = (void *)vec[first].buf;
+        iov[niov].iov_len = vec[first].len;
+        niov++;
+    }
+
+ rewrite:
+    ret = writev(sock->fd, iov, niov);
+
+    if (ret < 0) {
+        if (errno == EINTR)
+            goto rewrite;
+        if (errno == EAGAIN)
+            return 0;
+
+        virReportSystemError(errno, "%s",
+                             _("Cannot write data"));
+        return -1;
+    }
+    if (ret == 0) {
+        virReportSystemError(EIO, "%s",
+                             _("End of file while writing data"));
+        return -1;
+    }
+
+    return ret;
+#endif /* !WIN32 */
+}
+
+
 #if WITH_SASL
 static ssize_t virNetSocketReadSASL(virNetSocketPtr sock, char *buf, size_t len)
 {
@@ -1797,6 +2325,57 @@ ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len)
 }
 
 
+/*
+ * Write the logical concatenation of (@buf1, @len1) and
+ * (@buf2, @len2), using a single scatter-gather syscall
+ * when the transport permits.
+ *
+ * Returns the total number of bytes written, which may be
+ * fewer than @len1 + @len2; 0 if it would block; -1 on error
+ */
+ssize_t virNetSocketWritePair(virNetSocketPtr sock,
+                              const char *buf1, size_t len1,
+                              const char *buf2, size_t len2)
+{
+    virNetSocketIOVec vec[] = { { buf1, len1 }, { buf2, len2 } };
+
+    return virNetSocketWriteVector(sock, vec, ARRAY_CARDINALITY(vec));
+}
+
+
+/*
+ * Write the logical concatenation of the @nvec segments in @vec,
+ * using a single scatter-gather syscall when the transport permits.
+ *
+ * Returns the total number of bytes written, which may be fewer
+ * than the sum of the segments; 0 if it would block; -1 on error
+ */
+ssize_t virNetSocketWriteVector(virNetSocketPtr sock,
+                                const virNetSocketIOVec *vec,
+                                size_t nvec)
+{
+    ssize_t ret;
+
+    virObjectLock(sock);
+#if WITH_SASL
+    if (sock->saslSession) {
+        size_t first;
+
+        for (first = 0; first < nvec && !vec[first].len; first++)
+            ;
+        if (first == nvec)
+            ret = 0;
+        else
+            ret = virNetSocketWriteSASL(sock, vec[first].buf,
+                                        vec[first].len);
+    } else
+#endif
+        ret = virNetSocketWriteWireVector(sock, vec, nvec);
+    virObjectUnlock(sock);
+    return ret;
+}
+
+
 /*
  * Returns 1 if an FD was sent, 0 if it would block, -1 on error
  */
@@ -1913,6 +2492,14 @@ int virNetSocketAccept(virNetSocketPtr sock, virNetSocketPtr *clientsock)
                                         fd, -1, 0)))
         goto cleanup;
 
+#ifndef WIN32
+    /* Watch the first bytes from the client for a shared memory
+     * ring greeting; clients not offering one are unaffected */
+    if (virNetSocketSHMRingEnabled() &&
+        remoteAddr.data.sa.sa_family == AF_UNIX)
+        (*clientsock)->shmAwait = VIR_NET_SOCKET_SHM_GREETING;
+#endif
+
     fd = -1;
     ret = 0;
 
@@ -130,8 +130,27 @@ int virNetSocketGetSELinuxContext(virNetSocketPtr sock,
 int virNetSocketSetBlocking(virNetSocketPtr sock,
                             bool blocking);
 
+int virNetSocketSetTCPKeepAlive(virNetSocketPtr sock,
+                                int interval,
+                                unsigned int count);
+
 ssize_t virNetSocketRead(virNetSocketPtr sock, char *buf, size_t len);
 ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len);
+ssize_t virNetSocketWritePair(virNetSocketPtr sock,
+                              const char *buf1, size_t len1,
+                              const char *buf2, size_t len2);
+
+/* Portable stand-in for struct iovec, so callers need not worry
+ * about platforms lacking sys/uio.h */
+typedef struct _virNetSocketIOVec virNetSocketIOVec;
+struct _virNetSocketIOVec {
+    const char *buf;
+    size_t len;
+};
+
+ssize_t virNetSocketWriteVector(virNetSocketPtr sock,
+                                const virNetSocketIOVec *vec,
+                                size_t nvec);
 
 int virNetSocketSendFD(virNetSocketPtr sock, int fd);
 int virNetSocketRecvFD(virNetSocketPtr sock, int *fd);
@@ -66,11 +66,20 @@ struct _virNetTLSContext {
     bool requireValidCert;
     const char *const*x509dnWhitelist;
     char *priority;
+
+    /* Key for issuing session tickets, server side only */
+    gnutls_datum_t ticketKey;
+    bool haveTicketKey;
+
+    /* One-slot cache of resumable session data, client side only */
+    gnutls_datum_t sessionCache;
+    char *sessionCacheHostname;
 };
 
 struct _virNetTLSSession {
     virObjectLockable parent;
 
+    virNetTLSContextPtr ctxt;
     bool handshakeComplete;
 
     bool isServer;
@@ -752,6 +761,16 @@ static virNetTLSContextPtr virNetTLSContextNew(const char *cacert,
 
         gnutls_certificate_set_dh_params(ctxt->x509cred,
                                          ctxt->dhParams);
+
+        /* Generate a key for issuing session tickets, so clients
+         * which cache their ticket can resume a session without
+         * repeating the full key exchange. Failure merely disables
+         * resumption.
+         */
+        if (gnutls_session_ticket_key_generate(&ctxt->ticketKey) == 0)
+            ctxt->haveTicketKey = true;
+        else
+            VIR_WARN("Unable to generate TLS session ticket key");
     }
 
     ctxt->requireValidCert = requireValidCert;
@@ -1149,6 +1168,13 @@ void virNetTLSContextDispose(void *obj)
           "ctxt=%p", ctxt);
 
     VIR_FREE(ctxt->priority);
+    if (ctxt->haveTicketKey) {
+        memset(ctxt->ticketKey.data, 0, ctxt->ticketKey.size);
+        gnutls_free(ctxt->ticketKey.data);
+    }
+    if (ctxt->sessionCache.data)
+        gnutls_free(ctxt->sessionCache.data);
+    VIR_FREE(ctxt->sessionCacheHostname);
     gnutls_dh_params_deinit(ctxt->dhParams);
     gnutls_certificate_free_credentials(ctxt->x509cred);
 }
@@ -1232,8 +1258,33 @@ virNetTLSSessionPtr virNetTLSSessionNew(virNetTLSContextPtr ctxt,
         gnutls_certificate_server_set_request(sess->session, GNUTLS_CERT_REQUEST);
 
         gnutls_dh_set_prime_bits(sess->session, DH_BITS);
+
+        if (ctxt->haveTicketKey &&
+            (err = gnutls_session_ticket_enable_server(sess->session,
+                                                       &ctxt->ticketKey)) != 0)
+            VIR_WARN("Failed to enable TLS session tickets: %s",
+                     gnutls_strerror(err));
+    } else {
+        if ((err = gnutls_session_ticket_enable_client(sess->session)) != 0)
+            VIR_WARN("Failed to enable TLS session tickets: %s",
+                     gnutls_strerror(err));
+
+        /* If we saved a ticket from an earlier session to this host,
+         * offer it so the handshake can skip the key exchange
+         */
+        virObjectLock(ctxt);
+        if (ctxt->sessionCache.data &&
+            STREQ_NULLABLE(ctxt->sessionCacheHostname, hostname) &&
+            (err = gnutls_session_set_data(sess->session,
+                                           ctxt->sessionCache.data,
+                                           ctxt->sessionCache.size)) != 0)
+            VIR_DEBUG("Unable to restore cached TLS session: %s",
+                      gnutls_strerror(err));
+        virObjectUnlock(ctxt);
     }
 
+    sess->ctxt = virObjectRef(ctxt);
+
     gnutls_transport_set_ptr(sess->session, sess);
     gnutls_transport_set_push_function(sess->session,
                                        virNetTLSSessionPush);
@@ -1339,7 +1390,31 @@ int virNetTLSSessionHandshake(virNetTLSSessionPtr sess)
     VIR_DEBUG("Ret=%d", ret);
     if (ret == 0) {
         sess->handshakeComplete = true;
-        VIR_DEBUG("Handshake is complete");
+        VIR_DEBUG("Handshake is complete, resumed=%d",
+                  gnutls_session_is_resumed(sess->session));
+
+        /* Stash the session data in the context, so a later session
+         * to the same host can be resumed, skipping the expensive
+         * key exchange. Failure to save just loses resumption.
+         */
+        if (!sess->isServer && sess->ctxt) {
+            gnutls_datum_t data = { NULL, 0 };
+            char *host = NULL;
+
+            if (gnutls_session_get_data2(sess->session, &data) == 0) {
+                if (VIR_STRDUP_QUIET(host, sess->hostname) < 0) {
+                    gnutls_free(data.data);
+                } else {
+                    virObjectLock(sess->ctxt);
+                    if (sess->ctxt->sessionCache.data)
+                        gnutls_free(sess->ctxt->sessionCache.data);
+                    sess->ctxt->sessionCache = data;
+                    VIR_FREE(sess->ctxt->sessionCacheHostname);
+                    sess->ctxt->sessionCacheHostname = host;
+                    virObjectUnlock(sess->ctxt);
+                }
+            }
+        }
         goto cleanup;
     }
     if (ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN) {
@@ -1415,6 +1490,7 @@ void virNetTLSSessionDispose(void *obj)
     PROBE(RPC_TLS_SESSION_DISPOSE,
           "sess=%p", sess);
 
+    virObjectUnref(sess->ctxt);
     VIR_FREE(sess->x509dname);
     VIR_FREE(sess->hostname);
     gnutls_deinit(sess->session);
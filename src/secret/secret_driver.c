@@ -375,6 +375,69 @@ secretGetValue(virSecretPtr obj,
     return ret;
 }
 
+static unsigned char *
+secretLookupGetValue(virConnectPtr conn,
+                     virSecretLookupTypeDefPtr seclookupdef,
+                     virSecretUsageType usageType,
+                     size_t *value_size,
+                     unsigned int flags,
+                     unsigned int internalFlags)
+{
+    unsigned char *ret = NULL;
+    virSecretObjPtr secret = NULL;
+    virSecretDefPtr def;
+
+    virCheckFlags(0, NULL);
+
+    switch (seclookupdef->type) {
+    case VIR_SECRET_LOOKUP_TYPE_UUID:
+        if (!(secret = virSecretObjListFindByUUID(driver->secrets,
+                                                  seclookupdef->u.uuid))) {
+            char uuidstr[VIR_UUID_STRING_BUFLEN];
+            virUUIDFormat(seclookupdef->u.uuid, uuidstr);
+            virReportError(VIR_ERR_NO_SECRET,
+                           _("no secret with matching uuid '%s'"), uuidstr);
+            goto cleanup;
+        }
+        break;
+
+    case VIR_SECRET_LOOKUP_TYPE_USAGE:
+        if (!(secret = virSecretObjListFindByUsage(driver->secrets,
+                                                   usageType,
+                                                   seclookupdef->u.usage))) {
+            virReportError(VIR_ERR_NO_SECRET,
+                           _("no secret with matching usage '%s'"),
+                           seclookupdef->u.usage);
+            goto cleanup;
+        }
+        break;
+    }
+
+    if (!secret)
+        goto cleanup;
+
+    def = virSecretObjGetDef(secret);
+    if (virSecretGetValueEnsureACL(conn, def) < 0)
+        goto cleanup;
+
+    if ((internalFlags & VIR_SECRET_GET_VALUE_INTERNAL_CALL) == 0 &&
+        def->isprivate) {
+        virReportError(VIR_ERR_INVALID_SECRET, "%s",
+                       _("secret is private"));
+        goto cleanup;
+    }
+
+    if (!(ret = virSecretObjGetValue(secret)))
+        goto cleanup;
+
+    *value_size = virSecretObjGetValueSize(secret);
+
+ cleanup:
+    virSecretObjEndAPI(&secret);
+
+    return ret;
+}
+
 static int
 secretUndefine(virSecretPtr obj)
 {
@@ -491,6 +554,7 @@ static virSecretDriver secretDriver = {
     .secretSetValue = secretSetValue, /* 0.7.1 */
     .secretGetValue = secretGetValue, /* 0.7.1 */
     .secretUndefine = secretUndefine, /* 0.7.1 */
+    .secretLookupGetValue = secretLookupGetValue, /* 2.4.0 */
 };
 
 static virStateDriver stateDriver = {
@@ -57,6 +57,18 @@ virSecretGetSecretString(virConnectPtr conn,
     virSecretPtr sec = NULL;
     int ret = -1;
 
+    /* Prefer the combined entry point where the driver has one; it
+     * fetches the value with a single object lookup and no transient
+     * virSecretPtr */
+    if (conn->secretDriver->secretLookupGetValue) {
+        *secret = conn->secretDriver->secretLookupGetValue(conn,
+                                                           seclookupdef,
+                                                           secretUsageType,
+                                                           secret_size, 0,
+                                                           VIR_SECRET_GET_VALUE_INTERNAL_CALL);
+        return *secret ? 0 : -1;
+    }
+
     switch (seclookupdef->type) {
     case VIR_SECRET_LOOKUP_TYPE_UUID:
         sec = conn->secretDriver->secretLookupByUUID(conn, seclookupdef->u.uuid);
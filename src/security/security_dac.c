@@ -32,12 +32,14 @@
 #include "virerror.h"
 #include "virfile.h"
 #include "viralloc.h"
+#include "virhash.h"
 #include "virlog.h"
 #include "virpci.h"
 #include "virusb.h"
 #include "virscsi.h"
 #include "virstoragefile.h"
 #include "virstring.h"
+#include "virthread.h"
 #include "virutil.h"
 
 #define VIR_FROM_THIS VIR_FROM_SECURITY
@@ -57,6 +59,22 @@ struct _virSecurityDACData {
     bool dynamicOwnership;
     char *baselabel;
     virSecurityManagerDACChownCallback chownCallback;
+
+    /* Journal of the original owners of paths this manager has
+     * relabelled, keyed by path.  Shared paths are refcounted so
+     * the owner is only restored once the last domain using the
+     * path is gone.  Guarded by @ownerJournalLock. */
+    virMutex ownerJournalLock;
+    virHashTablePtr ownerJournal;
+};
+
+typedef struct _virSecurityDACOwnerEntry virSecurityDACOwnerEntry;
+typedef virSecurityDACOwnerEntry *virSecurityDACOwnerEntryPtr;
+
+struct _virSecurityDACOwnerEntry {
+    uid_t uid;   /* owner the path had before we first touched it */
+    gid_t gid;
+    size_t refs; /* number of labels currently held on the path */
 };
 
 typedef struct _virSecurityDACCallbackData virSecurityDACCallbackData;
@@ -191,17 +209,51 @@ virSecurityDACGetImageIds(virSecurityLabelDefPtr seclabel,
  * @uid: user owning the @path
  * @gid: group owning the @path
  *
- * Remember the owner of @path (represented by @uid:@gid).
+ * Remember the owner of @path (represented by @uid:@gid).  If the
+ * path is already recorded - e.g. a base image shared between
+ * domains - only its reference count goes up, keeping the owner
+ * seen by the very first labelling.
  *
  * Returns: 0 on success, -1 on failure
  */
 static int
-virSecurityDACRememberLabel(virSecurityDACDataPtr priv ATTRIBUTE_UNUSED,
-                            const char *path ATTRIBUTE_UNUSED,
-                            uid_t uid ATTRIBUTE_UNUSED,
-                            gid_t gid ATTRIBUTE_UNUSED)
+virSecurityDACRememberLabel(virSecurityDACDataPtr priv,
+                            const char *path,
+                            uid_t uid,
+                            gid_t gid)
 {
-    return 0;
+    virSecurityDACOwnerEntryPtr entry;
+    int ret = -1;
+
+    if (!priv)
+        return 0;
+
+    virMutexLock(&priv->ownerJournalLock);
+
+    if (!priv->ownerJournal &&
+        !(priv->ownerJournal = virHashCreate(64, virHashValueFree)))
+        goto cleanup;
+
+    if ((entry = virHashLookup(priv->ownerJournal, path))) {
+        entry->refs++;
+    } else {
+        if (VIR_ALLOC(entry) < 0)
+            goto cleanup;
+
+        entry->uid = uid;
+        entry->gid = gid;
+        entry->refs = 1;
+
+        if (virHashAddEntry(priv->ownerJournal, path, entry) < 0) {
+            VIR_FREE(entry);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    virMutexUnlock(&priv->ownerJournalLock);
+    return ret;
 }
 
 /**
@@ -216,16 +268,42 @@ virSecurityDACRememberLabel(virSecurityDACDataPtr priv ATTRIBUTE_UNUSED,
  * returned and caller should not relabel the @path.
  *
  * Returns: 1 if @path is still in use (@uid and @gid not touched)
- *          0 if @path should be restored (@uid and @gid set)
+ *          0 if @path should be restored (@uid and @gid set if
+ *            a record existed, left untouched otherwise)
  *         -1 on failure (@uid and @gid not touched)
  */
 static int
-virSecurityDACRecallLabel(virSecurityDACDataPtr priv ATTRIBUTE_UNUSED,
-                          const char *path ATTRIBUTE_UNUSED,
-                          uid_t *uid ATTRIBUTE_UNUSED,
-                          gid_t *gid ATTRIBUTE_UNUSED)
+virSecurityDACRecallLabel(virSecurityDACDataPtr priv,
+                          const char *path,
+                          uid_t *uid,
+                          gid_t *gid)
 {
-    return 0;
+    virSecurityDACOwnerEntryPtr entry;
+    int ret = 0;
+
+    if (!priv)
+        return 0;
+
+    virMutexLock(&priv->ownerJournalLock);
+
+    /* No record (e.g. the daemon restarted since the labels were
+     * set); let the caller fall back to its default restore */
+    if (!priv->ownerJournal ||
+        !(entry = virHashLookup(priv->ownerJournal, path)))
+        goto cleanup;
+
+    if (--entry->refs > 0) {
+        ret = 1;
+        goto cleanup;
+    }
+
+    *uid = entry->uid;
+    *gid = entry->gid;
+    virHashRemoveEntry(priv->ownerJournal, path);
+
+ cleanup:
+    virMutexUnlock(&priv->ownerJournalLock);
+    return ret;
 }
 
 static virSecurityDriverStatus
@@ -235,8 +313,16 @@ virSecurityDACProbe(const char *virtDriver ATTRIBUTE_UNUSED)
 }
 
 static int
-virSecurityDACOpen(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED)
+virSecurityDACOpen(virSecurityManagerPtr mgr)
 {
+    virSecurityDACDataPtr priv = virSecurityManagerGetPrivateData(mgr);
+
+    if (virMutexInit(&priv->ownerJournalLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize mutex"));
+        return -1;
+    }
+
     return 0;
 }
 
@@ -244,6 +330,8 @@ static int
 virSecurityDACClose(virSecurityManagerPtr mgr)
 {
     virSecurityDACDataPtr priv = virSecurityManagerGetPrivateData(mgr);
+    virHashFree(priv->ownerJournal);
+    virMutexDestroy(&priv->ownerJournalLock);
     VIR_FREE(priv->groups);
     VIR_FREE(priv->baselabel);
     return 0;
@@ -889,6 +889,20 @@ virSecuritySELinuxSetFileconHelper(const char *path, char *tcon,
 {
     security_context_t econ;
 
+    /* Check the existing context first; with pre-labelled image
+     * chains (common on shared filesystems and on repeated starts of
+     * the same VM) one getxattr read replaces a far more expensive
+     * setxattr write per path. */
+    if (getfilecon_raw(path, &econ) >= 0) {
+        bool match = STREQ(tcon, econ);
+
+        freecon(econ);
+        if (match) {
+            VIR_DEBUG("SELinux context on '%s' already '%s'", path, tcon);
+            return 0;
+        }
+    }
+
     VIR_INFO("Setting SELinux context on '%s' to '%s'", path, tcon);
 
     if (setfilecon_raw(path, tcon) < 0) {
@@ -963,6 +977,18 @@ virSecuritySELinuxFSetFilecon(int fd, char *tcon)
 {
     security_context_t econ;
 
+    /* As in virSecuritySELinuxSetFileconHelper, a read is much
+     * cheaper than a relabel if there's nothing to change. */
+    if (fgetfilecon_raw(fd, &econ) >= 0) {
+        bool match = STREQ(tcon, econ);
+
+        freecon(econ);
+        if (match) {
+            VIR_DEBUG("SELinux context on fd %d already '%s'", fd, tcon);
+            return 0;
+        }
+    }
+
     VIR_INFO("Setting SELinux context on fd %d to '%s'", fd, tcon);
 
     if (fsetfilecon_raw(fd, tcon) < 0) {
@@ -159,6 +159,9 @@ parserCommand(const char *profile_name, const char cmd)
     int status;
     int ret;
 
+    const char *argv[5];
+    size_t i = 0;
+
     if (strchr("arR", cmd) == NULL) {
         vah_error(NULL, 0, _("invalid flag"));
         return -1;
@@ -172,13 +175,20 @@ parserCommand(const char *profile_name, const char cmd)
         return -1;
     }
 
+    argv[i++] = "/sbin/apparmor_parser";
+    argv[i++] = flag;
+    /* When loading, have the parser keep a cache of the compiled
+     * binary profile, so reloading an unchanged profile skips the
+     * expensive compilation step */
+    if (cmd != 'R')
+        argv[i++] = "-W";
+    argv[i++] = profile;
+    argv[i] = NULL;
+
     if (!virFileExists(profile)) {
         vah_error(NULL, 0, _("profile does not exist"));
         goto cleanup;
     } else {
-        const char * const argv[] = {
-            "/sbin/apparmor_parser", flag, profile, NULL
-        };
         if ((ret = virRun(argv, &status)) != 0 ||
             (WIFEXITED(status) && WEXITSTATUS(status) != 0)) {
             if (ret != 0) {
@@ -207,7 +217,7 @@ parserCommand(const char *profile_name, const char cmd)
  */
 static int
 update_include_file(const char *include_file, const char *included_files,
-                    bool append)
+                    bool append, bool *changed)
 {
     int rc = -1;
     int plen, flen = 0;
@@ -243,6 +253,7 @@ update_include_file(const char *include_file, const char *included_files,
 
     /* only update the disk profile if it is different */
     if (flen > 0 && flen == plen && STREQLEN(existing, pcontent, plen)) {
+        *changed = false;
         rc = 0;
         goto cleanup;
     }
@@ -1319,6 +1330,7 @@ main(int argc, char **argv)
         }
     } else if (ctl->cmd == 'c' || ctl->cmd == 'r') {
         char *included_files = NULL;
+        bool include_changed = true;
 
         if (ctl->cmd == 'c' && virFileExists(profile))
             vah_error(ctl, 1, _("profile exists"));
@@ -1367,7 +1379,8 @@ main(int argc, char **argv)
             rc = 0;
         } else if ((rc = update_include_file(include_file,
                                              included_files,
-                                             ctl->append)) != 0) {
+                                             ctl->append,
+                                             &include_changed)) != 0) {
             goto cleanup;
         }
 
@@ -1395,10 +1408,16 @@ main(int argc, char **argv)
         }
 
         if (rc == 0 && !ctl->dryrun) {
-            if (ctl->cmd == 'c')
+            if (ctl->cmd == 'c') {
                 rc = parserLoad(ctl->uuid);
-            else
+            } else if (!include_changed) {
+                /* The rendered rule set matches what is already on
+                 * disk and loaded, so skip the apparmor_parser run
+                 * entirely */
+                rc = 0;
+            } else {
                 rc = parserReplace(ctl->uuid);
+            }
 
             /* cleanup */
             if (rc != 0) {
@@ -36,6 +36,10 @@
 #include "dirname.h"
 #ifdef __linux__
 # include <sys/ioctl.h>
+# include <sys/sendfile.h>
+# if HAVE_SYS_SYSCALL_H
+#  include <sys/syscall.h>
+# endif
 # include <linux/fs.h>
 # ifndef FS_NOCOW_FL
 #  define FS_NOCOW_FL                     0x00800000 /* Do not cow file */
@@ -66,6 +70,7 @@
 #include "virqemu.h"
 #include "stat-time.h"
 #include "virstring.h"
+#include "virthread.h"
 #include "virxml.h"
 #include "fdstream.h"
 
@@ -178,6 +183,28 @@ btrfsCloneFile(int dest_fd ATTRIBUTE_UNUSED,
 }
 #endif
 
+/*
+ * Let the kernel copy the data between the descriptors without
+ * bouncing it through userspace; on capable file systems this uses
+ * reflinks or server side copy offload.
+ */
+#if defined(__linux__) && HAVE_SYS_SYSCALL_H && defined(SYS_copy_file_range)
+static inline ssize_t
+virStorageBackendCopyFileRange(int infd, int outfd, size_t len)
+{
+    return syscall(SYS_copy_file_range, infd, NULL, outfd, NULL, len, 0);
+}
+#else
+static inline ssize_t
+virStorageBackendCopyFileRange(int infd ATTRIBUTE_UNUSED,
+                               int outfd ATTRIBUTE_UNUSED,
+                               size_t len ATTRIBUTE_UNUSED)
+{
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
 static int ATTRIBUTE_NONNULL(2)
 virStorageBackendCopyToFD(virStorageVolDefPtr vol,
                           virStorageVolDefPtr inputvol,
@@ -236,6 +263,98 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
         }
     }
 
+    /* Even when the user did not ask for a reflink clone explicitly,
+     * try one opportunistically: on file systems with clone support it
+     * completes in O(1) and shares the extents (including any holes)
+     * of the input volume. Any failure just falls through to the
+     * regular copy mechanisms. */
+    if (fstat(inputfd, &st) == 0 &&
+        btrfsCloneFile(fd, inputfd) == 0) {
+        VIR_DEBUG("reflink cloned %lld bytes from '%s'",
+                  (long long) st.st_size, inputvol->target.path);
+        *total -= MIN(*total, (unsigned long long) st.st_size);
+
+        /* the clone truncated the file to the length of the input;
+         * restore the requested capacity */
+        if (vol && (unsigned long long) st.st_size < vol->target.capacity &&
+            ftruncate(fd, vol->target.capacity) < 0) {
+            ret = -errno;
+            virReportSystemError(errno,
+                                 _("cannot extend file '%s'"),
+                                 vol->target.path);
+        }
+        goto cleanup;
+    }
+
+#ifdef __linux__
+    /* When sparse detection is not wanted try copy_file_range() first;
+     * it can clone extents or use copy offload where available. Fall
+     * through to sendfile() if the very first call is rejected.
+     */
+    if (!want_sparse) {
+        bool cfrUsed = false;
+
+        while (*total) {
+            size_t want = (*total > rbytes) ? rbytes : *total;
+            ssize_t done;
+
+            if ((done = virStorageBackendCopyFileRange(inputfd, fd,
+                                                       want)) < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (!cfrUsed)
+                    break;
+                ret = -errno;
+                virReportSystemError(errno,
+                                     _("failed to copy data from '%s'"),
+                                     inputvol->target.path);
+                goto cleanup;
+            }
+            cfrUsed = true;
+            if (done == 0)
+                break; /* EOF before end of requested data */
+            *total -= done;
+        }
+
+        if (cfrUsed)
+            amtread = 0; /* all done; skip the copy loop */
+    }
+
+    /* When sparse detection is not wanted the data can be moved
+     * fd-to-fd by the kernel without bouncing every block through
+     * our buffer. Fall back to the read/write loop below if the
+     * first sendfile() is rejected.
+     */
+    if (!want_sparse && amtread != 0) {
+        bool sendfileUsed = false;
+
+        while (*total) {
+            size_t want = (*total > rbytes) ? rbytes : *total;
+            ssize_t done;
+
+            if ((done = sendfile(fd, inputfd, NULL, want)) < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (!sendfileUsed &&
+                    (errno == EINVAL || errno == ENOSYS))
+                    break;
+                ret = -errno;
+                virReportSystemError(errno,
+                                     _("failed to copy data from '%s'"),
+                                     inputvol->target.path);
+                goto cleanup;
+            }
+            sendfileUsed = true;
+            if (done == 0)
+                break; /* EOF before end of requested data */
+            *total -= done;
+        }
+
+        if (sendfileUsed)
+            amtread = 0; /* all done; skip the copy loop */
+    }
+#endif
+
     while (amtread != 0) {
         int amtleft;
 
@@ -915,17 +1034,29 @@ virStorageBackendQemuImgSupportsCompat(const char *qemuimg)
 static int
 virStorageBackendQEMUImgBackingFormat(const char *qemuimg)
 {
-    /* As of QEMU 0.11 the [-o options] support was added via qemu
-     * commit id '9ea2ea71', so we start with that base and figure
-     * out what else we have */
-    int ret = QEMU_IMG_BACKING_FORMAT_OPTIONS;
-
-    /* QEMU 2.0 changed to using a format that only QEMU 1.1 and newer
-     * understands. Since we still support QEMU 0.12 and newer, we need
-     * to be able to handle the previous format as can be set via a
-     * compat=0.10 option. */
-    if (virStorageBackendQemuImgSupportsCompat(qemuimg))
-        ret = QEMU_IMG_BACKING_FORMAT_OPTIONS_COMPAT;
+    static virMutex lock = VIR_MUTEX_INITIALIZER;
+    static int cached = -1;
+    int ret;
+
+    /* The probe forks qemu-img once per call and its answer only
+     * depends on the installed binary, so compute it once per daemon
+     * run rather than for every volume creation */
+    virMutexLock(&lock);
+    if (cached == -1) {
+        /* As of QEMU 0.11 the [-o options] support was added via qemu
+         * commit id '9ea2ea71', so we start with that base and figure
+         * out what else we have */
+        cached = QEMU_IMG_BACKING_FORMAT_OPTIONS;
+
+        /* QEMU 2.0 changed to using a format that only QEMU 1.1 and newer
+         * understands. Since we still support QEMU 0.12 and newer, we need
+         * to be able to handle the previous format as can be set via a
+         * compat=0.10 option. */
+        if (virStorageBackendQemuImgSupportsCompat(qemuimg))
+            cached = QEMU_IMG_BACKING_FORMAT_OPTIONS_COMPAT;
+    }
+    ret = cached;
+    virMutexUnlock(&lock);
 
     return ret;
 }
@@ -2233,8 +2364,9 @@ virStorageBackendVolUploadLocal(virConnectPtr conn ATTRIBUTE_UNUSED,
     char *target_path = vol->target.path;
     int ret = -1;
     int has_snap = 0;
+    bool sparse = flags & VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM, -1);
     /* if volume has target format VIR_STORAGE_FILE_PLOOP
      * we need to restore DiskDescriptor.xml, according to
      * new contents of volume. This operation will be perfomed
@@ -2259,7 +2391,7 @@ virStorageBackendVolUploadLocal(virConnectPtr conn ATTRIBUTE_UNUSED,
     /* Not using O_CREAT because the file is required to already exist at
      * this point */
     ret = virFDStreamOpenBlockDevice(stream, target_path,
-                                     offset, len, O_WRONLY);
+                                     offset, len, sparse, O_WRONLY);
 
  cleanup:
     VIR_FREE(path);
@@ -2279,8 +2411,9 @@ virStorageBackendVolDownloadLocal(virConnectPtr conn ATTRIBUTE_UNUSED,
     char *target_path = vol->target.path;
     int ret = -1;
     int has_snap = 0;
+    bool sparse = flags & VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM, -1);
     if (vol->target.format == VIR_STORAGE_FILE_PLOOP) {
         has_snap = virStorageBackendPloopHasSnapshots(vol->target.path);
         if (has_snap < 0) {
@@ -2297,7 +2430,7 @@ virStorageBackendVolDownloadLocal(virConnectPtr conn ATTRIBUTE_UNUSED,
     }
 
     ret = virFDStreamOpenBlockDevice(stream, target_path,
-                                     offset, len, O_RDONLY);
+                                     offset, len, sparse, O_RDONLY);
 
  cleanup:
     VIR_FREE(path);
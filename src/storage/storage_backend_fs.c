@@ -51,6 +51,7 @@
 #include "virfile.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -874,9 +875,102 @@ virStorageBackendFileSystemBuild(virConnectPtr conn ATTRIBUTE_UNUSED,
 }
 
 
+/**
+ * virStorageBackendFileSystemProbeVol:
+ * @vol: volume with the name, key and target path already filled in
+ *
+ * Probe the volume's format, capacity, allocation, encryption and
+ * backing store, and classify directory and ploop based volumes.
+ *
+ * Returns 0 on success, -2 if the file should be silently ignored
+ * (eg a non-regular file such as 'lost+found'), -1 on error.
+ */
+int
+virStorageBackendFileSystemProbeVol(virStorageVolDefPtr vol)
+{
+    int err;
+
+    if ((err = virStorageBackendProbeTarget(&vol->target,
+                                            &vol->target.encryption)) < 0) {
+        if (err == -2) {
+            /* Silently ignore non-regular files,
+             * eg 'lost+found', dangling symbolic link */
+            return -2;
+        } else if (err == -3) {
+            /* The backing file is currently unavailable, its format is not
+             * explicitly specified, the probe to auto detect the format
+             * failed: continue with faked RAW format, since AUTO will
+             * break virStorageVolTargetDefFormat() generating the line
+             * <format type='...'/>. */
+        } else {
+            return -1;
+        }
+    }
+
+    /* directory based volume */
+    if (vol->target.format == VIR_STORAGE_FILE_DIR)
+        vol->type = VIR_STORAGE_VOL_DIR;
+
+    if (vol->target.format == VIR_STORAGE_FILE_PLOOP)
+        vol->type = VIR_STORAGE_VOL_PLOOP;
+
+    if (vol->target.backingStore) {
+        ignore_value(virStorageBackendUpdateVolTargetInfo(vol->target.backingStore,
+                                                          false,
+                                                          VIR_STORAGE_VOL_OPEN_DEFAULT, 0));
+        /* If this failed, the backing file is currently unavailable,
+         * the capacity, allocation, owner, group and mode are unknown.
+         * An error message was raised, but we just continue. */
+    }
+
+    return 0;
+}
+
+#define VIR_STORAGE_FS_REFRESH_MAX_WORKERS 16
+
+struct virStorageBackendFSRefreshEntry {
+    virStorageVolDefPtr vol;
+    int err;            /* result of virStorageBackendProbeTarget */
+    virErrorPtr error;  /* saved error for hard probe failures */
+};
+
+struct virStorageBackendFSRefreshData {
+    struct virStorageBackendFSRefreshEntry *entries;
+    size_t nentries;
+    size_t nworkers;
+};
+
+struct virStorageBackendFSRefreshWorker {
+    virThread thread;
+    bool started;
+    size_t first;
+    struct virStorageBackendFSRefreshData *data;
+};
+
+/* Probe every data->nworkers'th volume starting at worker->first. The
+ * volumes are private to this worker until virThreadJoin, so no locking
+ * is needed. */
+static void
+virStorageBackendFileSystemRefreshWorker(void *opaque)
+{
+    struct virStorageBackendFSRefreshWorker *worker = opaque;
+    struct virStorageBackendFSRefreshData *data = worker->data;
+    size_t i;
+
+    for (i = worker->first; i < data->nentries; i += data->nworkers) {
+        struct virStorageBackendFSRefreshEntry *e = &data->entries[i];
+
+        virResetLastError();
+        if ((e->err = virStorageBackendFileSystemProbeVol(e->vol)) == -1)
+            e->error = virSaveLastError();
+    }
+}
+
 /**
  * Iterate over the pool's directory and enumerate all disk images
- * within it. This is non-recursive.
+ * within it. This is non-recursive. The per-volume stat/open/probe
+ * work is spread over a set of worker threads since it is dominated
+ * by I/O latency on large (especially network) pools.
  */
 static int
 virStorageBackendFileSystemRefresh(virConnectPtr conn ATTRIBUTE_UNUSED,
@@ -888,14 +982,18 @@ virStorageBackendFileSystemRefresh(virConnectPtr conn ATTRIBUTE_UNUSED,
     struct stat statbuf;
     virStorageVolDefPtr vol = NULL;
     virStorageSourcePtr target = NULL;
+    struct virStorageBackendFSRefreshData data = { NULL, 0, 0 };
+    struct virStorageBackendFSRefreshWorker *workers = NULL;
+    long nprocs;
     int direrr;
     int fd = -1, ret = -1;
+    size_t i;
 
     if (virDirOpen(&dir, pool->def->target.path) < 0)
         goto cleanup;
 
     while ((direrr = virDirRead(dir, &ent, pool->def->target.path)) > 0) {
-        int err;
+        struct virStorageBackendFSRefreshEntry entry = { NULL, 0, NULL };
 
         if (virStringHasControlChars(ent->d_name)) {
             VIR_WARN("Ignoring file with control characters under '%s'",
@@ -919,48 +1017,61 @@ virStorageBackendFileSystemRefresh(virConnectPtr conn ATTRIBUTE_UNUSED,
         if (VIR_STRDUP(vol->key, vol->target.path) < 0)
             goto cleanup;
 
-        if ((err = virStorageBackendProbeTarget(&vol->target,
-                                                &vol->target.encryption)) < 0) {
-            if (err == -2) {
-                /* Silently ignore non-regular files,
-                 * eg 'lost+found', dangling symbolic link */
-                virStorageVolDefFree(vol);
-                vol = NULL;
-                continue;
-            } else if (err == -3) {
-                /* The backing file is currently unavailable, its format is not
-                 * explicitly specified, the probe to auto detect the format
-                 * failed: continue with faked RAW format, since AUTO will
-                 * break virStorageVolTargetDefFormat() generating the line
-                 * <format type='...'/>. */
-            } else {
-                goto cleanup;
-            }
+        entry.vol = vol;
+        if (VIR_APPEND_ELEMENT(data.entries, data.nentries, entry) < 0)
+            goto cleanup;
+        vol = NULL;
+    }
+    if (direrr < 0)
+        goto cleanup;
+    VIR_DIR_CLOSE(dir);
+    dir = NULL;
+
+    if ((nprocs = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+        nprocs = 1;
+    data.nworkers = MIN(data.nentries, (size_t) nprocs);
+    data.nworkers = MIN(data.nworkers, VIR_STORAGE_FS_REFRESH_MAX_WORKERS);
+
+    if (data.nworkers > 0 &&
+        VIR_ALLOC_N(workers, data.nworkers) < 0)
+        goto cleanup;
+
+    for (i = 0; i < data.nworkers; i++) {
+        workers[i].first = i;
+        workers[i].data = &data;
+        if (virThreadCreate(&workers[i].thread, true,
+                            virStorageBackendFileSystemRefreshWorker,
+                            &workers[i]) < 0) {
+            /* fall back to probing this slice inline */
+            virStorageBackendFileSystemRefreshWorker(&workers[i]);
+        } else {
+            workers[i].started = true;
         }
+    }
 
-        /* directory based volume */
-        if (vol->target.format == VIR_STORAGE_FILE_DIR)
-            vol->type = VIR_STORAGE_VOL_DIR;
+    for (i = 0; i < data.nworkers; i++) {
+        if (workers[i].started)
+            virThreadJoin(&workers[i].thread);
+    }
 
-        if (vol->target.format == VIR_STORAGE_FILE_PLOOP)
-            vol->type = VIR_STORAGE_VOL_PLOOP;
+    for (i = 0; i < data.nentries; i++) {
+        struct virStorageBackendFSRefreshEntry *e = &data.entries[i];
 
-        if (vol->target.backingStore) {
-            ignore_value(virStorageBackendUpdateVolTargetInfo(vol->target.backingStore,
-                                                              false,
-                                                              VIR_STORAGE_VOL_OPEN_DEFAULT, 0));
-            /* If this failed, the backing file is currently unavailable,
-             * the capacity, allocation, owner, group and mode are unknown.
-             * An error message was raised, but we just continue. */
+        if (e->err == -2) {
+            /* non-regular file, silently skipped by the probe */
+            virStorageVolDefFree(e->vol);
+            e->vol = NULL;
+            continue;
+        } else if (e->err < 0) {
+            if (e->error)
+                virSetError(e->error);
+            goto cleanup;
         }
 
-        if (VIR_APPEND_ELEMENT(pool->volumes.objs, pool->volumes.count, vol) < 0)
+        if (VIR_APPEND_ELEMENT(pool->volumes.objs, pool->volumes.count,
+                               e->vol) < 0)
             goto cleanup;
     }
-    if (direrr < 0)
-        goto cleanup;
-    VIR_DIR_CLOSE(dir);
-    vol = NULL;
 
     if (VIR_ALLOC(target))
         goto cleanup;
@@ -1009,6 +1120,12 @@ virStorageBackendFileSystemRefresh(virConnectPtr conn ATTRIBUTE_UNUSED,
     VIR_FORCE_CLOSE(fd);
     virStorageVolDefFree(vol);
     virStorageSourceFree(target);
+    for (i = 0; i < data.nentries; i++) {
+        virStorageVolDefFree(data.entries[i].vol);
+        virFreeError(data.entries[i].error);
+    }
+    VIR_FREE(data.entries);
+    VIR_FREE(workers);
     if (ret < 0)
         virStoragePoolObjClearVols(pool);
     return ret;
@@ -38,6 +38,8 @@ typedef enum {
 } virStoragePoolProbeResult;
 extern virStorageBackend virStorageBackendDirectory;
 
+int virStorageBackendFileSystemProbeVol(virStorageVolDefPtr vol);
+
 extern virStorageFileBackend virStorageFileBackendFile;
 extern virStorageFileBackend virStorageFileBackendBlock;
 #endif /* __VIR_STORAGE_BACKEND_FS_H__ */
@@ -26,10 +26,13 @@
 #include "storage_backend_gluster.h"
 #include "storage_conf.h"
 #include "viralloc.h"
+#include "virbuffer.h"
 #include "virerror.h"
+#include "virhash.h"
 #include "virlog.h"
 #include "virstoragefile.h"
 #include "virstring.h"
+#include "virthread.h"
 #include "viruri.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
@@ -541,11 +544,129 @@ virStorageBackend virStorageBackendGluster = {
 typedef struct _virStorageFileBackendGlusterPriv virStorageFileBackendGlusterPriv;
 typedef virStorageFileBackendGlusterPriv *virStorageFileBackendGlusterPrivPtr;
 
+typedef struct _virStorageFileBackendGlusterConn virStorageFileBackendGlusterConn;
+typedef virStorageFileBackendGlusterConn *virStorageFileBackendGlusterConnPtr;
+
 struct _virStorageFileBackendGlusterPriv {
     glfs_t *vol;
+    virStorageFileBackendGlusterConnPtr conn; /* cache entry owning @vol,
+                                                 NULL if @vol is owned here */
     char *canonpath;
 };
 
+/* Cache of established gluster connections.  Setting up a glfs context
+ * involves fetching the volfile from the server and spawning translator
+ * threads, which easily dominates the cost of the few metadata calls a
+ * backing chain probe makes, so connections are kept for a grace period
+ * after their last user goes away and reused when the same volume is
+ * probed again. */
+#define VIR_STORAGE_GLUSTER_CONN_IDLE_SECONDS 30
+
+struct _virStorageFileBackendGlusterConn {
+    glfs_t *vol;
+    size_t refs;
+    time_t lastUse; /* timestamp of the last release, valid if refs == 0 */
+};
+
+static virMutex virStorageFileBackendGlusterConnLock;
+static virHashTablePtr virStorageFileBackendGlusterConnCache;
+
+static int
+virStorageFileBackendGlusterConnOnceInit(void)
+{
+    if (virMutexInit(&virStorageFileBackendGlusterConnLock) < 0)
+        return -1;
+
+    /* entries are removed and freed manually so that the glfs handles
+     * can be shut down outside of the cache lock */
+    if (!(virStorageFileBackendGlusterConnCache = virHashCreate(10, NULL)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virStorageFileBackendGlusterConn)
+
+
+/* Build the cache key identifying the gluster connection for @src:
+ * the volume name plus every configured volfile server. */
+static char *
+virStorageFileBackendGlusterConnKey(virStorageSourcePtr src)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    virBufferAdd(&buf, src->volume, -1);
+
+    for (i = 0; i < src->nhosts; i++) {
+        virStorageNetHostDefPtr host = src->hosts + i;
+
+        if (host->transport == VIR_STORAGE_NET_HOST_TRANS_UNIX)
+            virBufferAsprintf(&buf, "|unix:%s", NULLSTR(host->socket));
+        else
+            virBufferAsprintf(&buf, "|%s:%s:%s",
+                              virStorageNetHostTransportTypeToString(host->transport),
+                              NULLSTR(host->name), NULLSTR(host->port));
+    }
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+struct virStorageFileBackendGlusterConnExpireData {
+    glfs_t **vols;
+    size_t nvols;
+    time_t now;
+};
+
+static int
+virStorageFileBackendGlusterConnExpire(const void *payload,
+                                       const void *name ATTRIBUTE_UNUSED,
+                                       const void *opaque)
+{
+    virStorageFileBackendGlusterConnPtr conn = (void *) payload;
+    struct virStorageFileBackendGlusterConnExpireData *data = (void *) opaque;
+
+    if (conn->refs > 0 ||
+        data->now - conn->lastUse < VIR_STORAGE_GLUSTER_CONN_IDLE_SECONDS)
+        return 0;
+
+    /* collection failure just postpones the expiry to the next prune */
+    if (VIR_APPEND_ELEMENT(data->vols, data->nvols, conn->vol) < 0)
+        return 0;
+
+    VIR_FREE(conn);
+    return 1;
+}
+
+
+/* Drop cached connections that have been idle for longer than the
+ * grace period.  The glfs handles are shut down after releasing the
+ * cache lock since glfs_fini may block on network traffic. */
+static void
+virStorageFileBackendGlusterConnPrune(void)
+{
+    struct virStorageFileBackendGlusterConnExpireData data = { NULL, 0, 0 };
+    size_t i;
+
+    data.now = time(NULL);
+
+    virMutexLock(&virStorageFileBackendGlusterConnLock);
+    virHashRemoveSet(virStorageFileBackendGlusterConnCache,
+                     virStorageFileBackendGlusterConnExpire, &data);
+    virMutexUnlock(&virStorageFileBackendGlusterConnLock);
+
+    for (i = 0; i < data.nvols; i++) {
+        if (glfs_fini(data.vols[i]) < 0)
+            VIR_DEBUG("shutdown of cached gluster connection failed "
+                      "with errno %d", errno);
+    }
+    VIR_FREE(data.vols);
+}
+
 
 static void
 virStorageFileBackendGlusterDeinit(virStorageSourcePtr src)
@@ -556,8 +677,16 @@ virStorageFileBackendGlusterDeinit(virStorageSourcePtr src)
               src, src->hosts->name, src->hosts->port ? src->hosts->port : "0",
               src->volume, src->path);
 
-    if (priv->vol)
+    if (priv->conn) {
+        virMutexLock(&virStorageFileBackendGlusterConnLock);
+        priv->conn->refs--;
+        priv->conn->lastUse = time(NULL);
+        virMutexUnlock(&virStorageFileBackendGlusterConnLock);
+
+        virStorageFileBackendGlusterConnPrune();
+    } else if (priv->vol) {
         glfs_fini(priv->vol);
+    }
     VIR_FREE(priv->canonpath);
 
     VIR_FREE(priv);
@@ -613,6 +742,8 @@ static int
 virStorageFileBackendGlusterInit(virStorageSourcePtr src)
 {
     virStorageFileBackendGlusterPrivPtr priv = NULL;
+    virStorageFileBackendGlusterConnPtr conn;
+    char *key = NULL;
     size_t i;
 
     if (!src->volume) {
@@ -630,6 +761,30 @@ virStorageFileBackendGlusterInit(virStorageSourcePtr src)
               src, priv, src->volume, src->path,
               (unsigned int)src->drv->uid, (unsigned int)src->drv->gid);
 
+    if (virStorageFileBackendGlusterConnInitialize() == 0 &&
+        (key = virStorageFileBackendGlusterConnKey(src))) {
+        virStorageFileBackendGlusterConnPrune();
+
+        virMutexLock(&virStorageFileBackendGlusterConnLock);
+        if ((conn = virHashLookup(virStorageFileBackendGlusterConnCache,
+                                  key))) {
+            conn->refs++;
+            priv->conn = conn;
+            priv->vol = conn->vol;
+        }
+        virMutexUnlock(&virStorageFileBackendGlusterConnLock);
+
+        if (priv->conn) {
+            VIR_DEBUG("reusing cached gluster connection for volume '%s'",
+                      src->volume);
+            VIR_FREE(key);
+            src->drv->priv = priv;
+            return 0;
+        }
+    } else {
+        virResetLastError();
+    }
+
     if (!(priv->vol = glfs_new(src->volume))) {
         virReportOOMError();
         goto error;
@@ -647,6 +802,26 @@ virStorageFileBackendGlusterInit(virStorageSourcePtr src)
         goto error;
     }
 
+    /* offer the fresh connection for reuse; if another thread won the
+     * race to insert one for the same key this connection simply stays
+     * private and is shut down on deinit */
+    if (key) {
+        if (VIR_ALLOC(conn) == 0) {
+            conn->vol = priv->vol;
+            conn->refs = 1;
+
+            virMutexLock(&virStorageFileBackendGlusterConnLock);
+            if (virHashAddEntry(virStorageFileBackendGlusterConnCache,
+                                key, conn) == 0)
+                priv->conn = conn;
+            else
+                VIR_FREE(conn);
+            virMutexUnlock(&virStorageFileBackendGlusterConnLock);
+        }
+        virResetLastError();
+    }
+
+    VIR_FREE(key);
     src->drv->priv = priv;
 
     return 0;
@@ -655,6 +830,7 @@ virStorageFileBackendGlusterInit(virStorageSourcePtr src)
     if (priv->vol)
         glfs_fini(priv->vol);
     VIR_FREE(priv);
+    VIR_FREE(key);
 
     return -1;
 }
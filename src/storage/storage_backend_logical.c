@@ -26,7 +26,6 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <stdio.h>
-#include <regex.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -78,24 +77,18 @@ virStorageBackendLogicalParseVolExtents(virStorageVolDefPtr vol,
                                         char **const groups)
 {
     int nextents, ret = -1;
-    const char *regex_unit = "(\\S+)\\((\\S+)\\)";
-    char *regex = NULL;
-    regex_t *reg = NULL;
-    regmatch_t *vars = NULL;
-    char *p = NULL;
+    const char *p;
+    char *end;
     size_t i;
-    int err, nvars;
     unsigned long long offset, size, length;
     virStorageVolSourceExtent extent;
 
     memset(&extent, 0, sizeof(extent));
 
-    /* Assume 1 extent (the regex for 'devices' is "(\\S+)") and only
-     * check the 'stripes' field if we have a striped, mirror, or one of
-     * the raid (raid1, raid4, raid5*, raid6*, or raid10) segtypes in which
-     * case the stripes field will denote the number of lv's within the
-     * 'devices' field in order to generate the proper regex to decode
-     * the field
+    /* Assume 1 extent and only check the 'stripes' field if we have a
+     * striped, mirror, or one of the raid (raid1, raid4, raid5*, raid6*,
+     * or raid10) segtypes in which case the stripes field will denote
+     * the number of lv's within the 'devices' field
      */
     nextents = 1;
     if (STREQ(groups[4], VIR_STORAGE_VOL_LOGICAL_SEGTYPE_STRIPED) ||
@@ -120,71 +113,40 @@ virStorageBackendLogicalParseVolExtents(virStorageVolDefPtr vol,
         goto cleanup;
     }
 
-    /* Allocate space for 'nextents' regex_unit strings plus a comma for each */
-    if (VIR_ALLOC_N(regex, nextents * (strlen(regex_unit) + 1) + 1) < 0)
-        goto cleanup;
-    strcat(regex, regex_unit);
-    for (i = 1; i < nextents; i++) {
-        /* "," is the separator of "devices" field */
-        strcat(regex, ",");
-        strcat(regex, regex_unit);
-    }
-
-    if (VIR_ALLOC(reg) < 0)
-        goto cleanup;
-
-    /* Each extent has a "path:offset" pair, and vars[0] will
-     * be the whole matched string.
+    /* The "devices" field is a comma separated list of "path(offset)"
+     * entries.  Walk it directly instead of matching it against a
+     * generated regex, which took time quadratic in the number of
+     * extents of a fragmented LV.
      */
-    nvars = (nextents * 2) + 1;
-    if (VIR_ALLOC_N(vars, nvars) < 0)
-        goto cleanup;
-
-    err = regcomp(reg, regex, REG_EXTENDED);
-    if (err != 0) {
-        char error[100];
-        regerror(err, reg, error, sizeof(error));
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Failed to compile regex %s"),
-                       error);
-        goto cleanup;
-    }
-
-    err = regexec(reg, groups[3], nvars, vars, 0);
-    regfree(reg);
-    if (err != 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("malformed volume extent devices value"));
-        goto cleanup;
-    }
-
     p = groups[3];
-
-    /* vars[0] is skipped */
     for (i = 0; i < nextents; i++) {
-        size_t j;
-        int len;
-        char *offset_str = NULL;
-
-        j = (i * 2) + 1;
-        len = vars[j].rm_eo - vars[j].rm_so;
-        p[vars[j].rm_eo] = '\0';
+        if (i > 0) {
+            /* "," is the separator of the "devices" field */
+            if (*p != ',') {
+                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                               _("malformed volume extent devices value"));
+                goto cleanup;
+            }
+            p++;
+        }
 
-        if (VIR_STRNDUP(extent.path,
-                        p + vars[j].rm_so, len) < 0)
+        if (!(end = strchr(p, '(')) || end == p) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("malformed volume extent devices value"));
             goto cleanup;
+        }
 
-        len = vars[j + 1].rm_eo - vars[j + 1].rm_so;
-        if (VIR_STRNDUP(offset_str, p + vars[j + 1].rm_so, len) < 0)
+        if (VIR_STRNDUP(extent.path, p, end - p) < 0)
             goto cleanup;
 
-        if (virStrToLong_ull(offset_str, NULL, 10, &offset) < 0) {
+        if (virStrToLong_ull(end + 1, &end, 10, &offset) < 0 ||
+            *end != ')') {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("malformed volume extent offset value"));
-            VIR_FREE(offset_str);
             goto cleanup;
         }
-        VIR_FREE(offset_str);
+        p = end + 1;
+
         extent.start = offset * size;
         extent.end = (offset * size) + length;
 
@@ -196,9 +158,6 @@ virStorageBackendLogicalParseVolExtents(virStorageVolDefPtr vol,
     ret = 0;
 
  cleanup:
-    VIR_FREE(regex);
-    VIR_FREE(reg);
-    VIR_FREE(vars);
     VIR_FREE(extent.path);
     return ret;
 }
@@ -34,6 +34,7 @@
 #include "viruuid.h"
 #include "virstring.h"
 #include "virrandom.h"
+#include "virthread.h"
 #include "rados/librados.h"
 #include "rbd/librbd.h"
 #include "secret_util.h"
@@ -378,6 +379,71 @@ volStorageBackendRBDRefreshVolInfo(virStorageVolDefPtr vol,
     return ret;
 }
 
+#define VIR_STORAGE_RBD_REFRESH_MAX_WORKERS 8
+
+struct virStorageBackendRBDRefreshEntry {
+    virStorageVolDefPtr vol;
+    int err;            /* result of volStorageBackendRBDRefreshVolInfo */
+    virErrorPtr error;  /* saved error for failed volumes */
+};
+
+struct virStorageBackendRBDRefreshData {
+    virStoragePoolObjPtr pool;
+    rados_t cluster;
+    struct virStorageBackendRBDRefreshEntry *entries;
+    size_t nentries;
+    size_t nworkers;
+};
+
+struct virStorageBackendRBDRefreshWorker {
+    virThread thread;
+    bool started;
+    size_t first;
+    struct virStorageBackendRBDRefreshData *data;
+};
+
+/* Fetch the image info for every data->nworkers'th volume starting at
+ * worker->first. The cluster handle is thread safe, but each worker
+ * creates its own IO context since those must not be shared between
+ * threads issuing concurrent operations. */
+static void
+virStorageBackendRBDRefreshWorker(void *opaque)
+{
+    struct virStorageBackendRBDRefreshWorker *worker = opaque;
+    struct virStorageBackendRBDRefreshData *data = worker->data;
+    virStorageBackendRBDState ptr;
+    int r;
+    size_t i;
+
+    ptr.cluster = data->cluster;
+    ptr.ioctx = NULL;
+
+    if ((r = rados_ioctx_create(ptr.cluster,
+                                data->pool->def->source.name,
+                                &ptr.ioctx)) < 0) {
+        virReportSystemError(-r,
+                             _("failed to create the RBD IoCTX. "
+                               "Does the pool '%s' exist?"),
+                             data->pool->def->source.name);
+        for (i = worker->first; i < data->nentries; i += data->nworkers) {
+            data->entries[i].err = r;
+            data->entries[i].error = virSaveLastError();
+        }
+        return;
+    }
+
+    for (i = worker->first; i < data->nentries; i += data->nworkers) {
+        struct virStorageBackendRBDRefreshEntry *e = &data->entries[i];
+
+        virResetLastError();
+        if ((e->err = volStorageBackendRBDRefreshVolInfo(e->vol, data->pool,
+                                                         &ptr)) < 0)
+            e->error = virSaveLastError();
+    }
+
+    rados_ioctx_destroy(ptr.ioctx);
+}
+
 static int
 virStorageBackendRBDRefreshPool(virConnectPtr conn,
                                 virStoragePoolObjPtr pool)
@@ -392,6 +458,10 @@ virStorageBackendRBDRefreshPool(virConnectPtr conn,
     ptr.ioctx = NULL;
     struct rados_cluster_stat_t clusterstat;
     struct rados_pool_stat_t poolstat;
+    struct virStorageBackendRBDRefreshData data = { pool, NULL, NULL, 0, 0 };
+    struct virStorageBackendRBDRefreshWorker *workers = NULL;
+    long nprocs;
+    size_t i;
 
     if (virStorageBackendRBDOpenRADOSConn(&ptr, conn, &pool->def->source) < 0)
         goto cleanup;
@@ -399,6 +469,8 @@ virStorageBackendRBDRefreshPool(virConnectPtr conn,
     if (virStorageBackendRBDOpenIoCTX(&ptr, pool) < 0)
         goto cleanup;
 
+    data.cluster = ptr.cluster;
+
     if ((r = rados_cluster_stat(ptr.cluster, &clusterstat)) < 0) {
         virReportSystemError(-r, "%s", _("failed to stat the RADOS cluster"));
         goto cleanup;
@@ -434,6 +506,7 @@ virStorageBackendRBDRefreshPool(virConnectPtr conn,
     }
 
     for (name = names; name < names + max_size;) {
+        struct virStorageBackendRBDRefreshEntry entry = { NULL, 0, NULL };
         virStorageVolDefPtr vol;
 
         if (STREQ(name, ""))
@@ -449,7 +522,42 @@ virStorageBackendRBDRefreshPool(virConnectPtr conn,
 
         name += strlen(name) + 1;
 
-        r = volStorageBackendRBDRefreshVolInfo(vol, pool, &ptr);
+        entry.vol = vol;
+        if (VIR_APPEND_ELEMENT(data.entries, data.nentries, entry) < 0) {
+            virStorageVolDefFree(vol);
+            goto cleanup;
+        }
+    }
+
+    if ((nprocs = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+        nprocs = 1;
+    data.nworkers = MIN(data.nentries, (size_t) nprocs);
+    data.nworkers = MIN(data.nworkers, VIR_STORAGE_RBD_REFRESH_MAX_WORKERS);
+
+    if (data.nworkers > 0 &&
+        VIR_ALLOC_N(workers, data.nworkers) < 0)
+        goto cleanup;
+
+    for (i = 0; i < data.nworkers; i++) {
+        workers[i].first = i;
+        workers[i].data = &data;
+        if (virThreadCreate(&workers[i].thread, true,
+                            virStorageBackendRBDRefreshWorker,
+                            &workers[i]) < 0) {
+            /* fall back to fetching this slice inline */
+            virStorageBackendRBDRefreshWorker(&workers[i]);
+        } else {
+            workers[i].started = true;
+        }
+    }
+
+    for (i = 0; i < data.nworkers; i++) {
+        if (workers[i].started)
+            virThreadJoin(&workers[i].thread);
+    }
+
+    for (i = 0; i < data.nentries; i++) {
+        struct virStorageBackendRBDRefreshEntry *e = &data.entries[i];
 
         /* It could be that a volume has been deleted through a different route
          * then libvirt and that will cause a -ENOENT to be returned.
@@ -460,16 +568,20 @@ virStorageBackendRBDRefreshPool(virConnectPtr conn,
          *
          * Do not error out and simply ignore the volume
          */
-        if (r < 0) {
-            if (r == -ENOENT || r == -ETIMEDOUT)
+        if (e->err < 0) {
+            if (e->err == -ENOENT || e->err == -ETIMEDOUT) {
+                virStorageVolDefFree(e->vol);
+                e->vol = NULL;
                 continue;
+            }
 
-            virStorageVolDefFree(vol);
+            if (e->error)
+                virSetError(e->error);
             goto cleanup;
         }
 
-        if (VIR_APPEND_ELEMENT(pool->volumes.objs, pool->volumes.count, vol) < 0) {
-            virStorageVolDefFree(vol);
+        if (VIR_APPEND_ELEMENT(pool->volumes.objs, pool->volumes.count,
+                               e->vol) < 0) {
             virStoragePoolObjClearVols(pool);
             goto cleanup;
         }
@@ -482,6 +594,12 @@ virStorageBackendRBDRefreshPool(virConnectPtr conn,
 
  cleanup:
     VIR_FREE(names);
+    for (i = 0; i < data.nentries; i++) {
+        virStorageVolDefFree(data.entries[i].vol);
+        virFreeError(data.entries[i].error);
+    }
+    VIR_FREE(data.entries);
+    VIR_FREE(workers);
     virStorageBackendRBDCloseRADOSConn(&ptr);
     return ret;
 }
@@ -35,6 +35,7 @@
 #include "virfile.h"
 #include "vircommand.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -162,7 +163,8 @@ virStorageBackendSCSINewLun(virStoragePoolObjPtr pool,
                             uint32_t bus,
                             uint32_t target,
                             uint32_t lun,
-                            const char *dev)
+                            const char *dev,
+                            virStorageVolDefPtr *retvol)
 {
     virStorageVolDefPtr vol = NULL;
     char *devpath = NULL;
@@ -233,12 +235,7 @@ virStorageBackendSCSINewLun(virStoragePoolObjPtr pool,
     if (!(vol->key = virStorageBackendSCSISerial(vol->target.path)))
         goto cleanup;
 
-    pool->def->capacity += vol->target.capacity;
-    pool->def->allocation += vol->target.allocation;
-
-    if (VIR_APPEND_ELEMENT(pool->volumes.objs, pool->volumes.count, vol) < 0)
-        goto cleanup;
-
+    *retvol = vol;
     vol = NULL;
     retval = 0;
 
@@ -395,7 +392,8 @@ processLU(virStoragePoolObjPtr pool,
           uint32_t host,
           uint32_t bus,
           uint32_t target,
-          uint32_t lun)
+          uint32_t lun,
+          virStorageVolDefPtr *retvol)
 {
     int retval = -1;
     int device_type;
@@ -427,7 +425,7 @@ processLU(virStoragePoolObjPtr pool,
     }
 
     retval = virStorageBackendSCSINewLun(pool, host, bus, target, lun,
-                                         block_device);
+                                         block_device, retvol);
     if (retval < 0) {
         VIR_DEBUG("Failed to create new storage volume for %u:%u:%u:%u",
                   host, bus, target, lun);
@@ -443,6 +441,52 @@ processLU(virStoragePoolObjPtr pool,
 }
 
 
+#define VIR_STORAGE_SCSI_FIND_LUS_MAX_WORKERS 16
+
+struct virStorageBackendSCSILUEntry {
+    uint32_t bus;
+    uint32_t target;
+    uint32_t lun;
+    virStorageVolDefPtr vol;
+    int err;            /* result of processLU */
+    virErrorPtr error;  /* saved error for fatal failures */
+};
+
+struct virStorageBackendSCSILUData {
+    virStoragePoolObjPtr pool;
+    uint32_t scanhost;
+    struct virStorageBackendSCSILUEntry *entries;
+    size_t nentries;
+    size_t nworkers;
+};
+
+struct virStorageBackendSCSILUWorker {
+    virThread thread;
+    bool started;
+    size_t first;
+    struct virStorageBackendSCSILUData *data;
+};
+
+/* Probe every data->nworkers'th LUN starting at worker->first. The
+ * pool object is only read here (target path, type); the built volumes
+ * are handed back through the entries and inserted by the caller. */
+static void
+virStorageBackendSCSIFindLUsWorker(void *opaque)
+{
+    struct virStorageBackendSCSILUWorker *worker = opaque;
+    struct virStorageBackendSCSILUData *data = worker->data;
+    size_t i;
+
+    for (i = worker->first; i < data->nentries; i += data->nworkers) {
+        struct virStorageBackendSCSILUEntry *e = &data->entries[i];
+
+        virResetLastError();
+        if ((e->err = processLU(data->pool, data->scanhost,
+                                e->bus, e->target, e->lun, &e->vol)) == -1)
+            e->error = virSaveLastError();
+    }
+}
+
 int
 virStorageBackendSCSIFindLUs(virStoragePoolObjPtr pool,
                               uint32_t scanhost)
@@ -453,6 +497,10 @@ virStorageBackendSCSIFindLUs(virStoragePoolObjPtr pool,
     DIR *devicedir = NULL;
     struct dirent *lun_dirent = NULL;
     char devicepattern[64];
+    struct virStorageBackendSCSILUData data = { pool, scanhost, NULL, 0, 0 };
+    struct virStorageBackendSCSILUWorker *workers = NULL;
+    long nprocs;
+    size_t i;
     int found = 0;
 
     VIR_DEBUG("Discovering LUs on host %u", scanhost);
@@ -465,7 +513,7 @@ virStorageBackendSCSIFindLUs(virStoragePoolObjPtr pool,
     snprintf(devicepattern, sizeof(devicepattern), "%u:%%u:%%u:%%u\n", scanhost);
 
     while ((retval = virDirRead(devicedir, &lun_dirent, device_path)) > 0) {
-        int rc;
+        struct virStorageBackendSCSILUEntry entry;
 
         if (sscanf(lun_dirent->d_name, devicepattern,
                    &bus, &target, &lun) != 3) {
@@ -474,17 +522,82 @@ virStorageBackendSCSIFindLUs(virStoragePoolObjPtr pool,
 
         VIR_DEBUG("Found possible LU '%s'", lun_dirent->d_name);
 
-        rc = processLU(pool, scanhost, bus, target, lun);
-        if (rc == -1) {
+        memset(&entry, 0, sizeof(entry));
+        entry.bus = bus;
+        entry.target = target;
+        entry.lun = lun;
+        if (VIR_APPEND_ELEMENT(data.entries, data.nentries, entry) < 0) {
             retval = -1;
             break;
         }
-        if (rc == 0)
-            found++;
     }
 
     VIR_DIR_CLOSE(devicedir);
 
+    if (retval < 0)
+        goto cleanup;
+
+    if ((nprocs = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+        nprocs = 1;
+    data.nworkers = MIN(data.nentries, (size_t) nprocs);
+    data.nworkers = MIN(data.nworkers, VIR_STORAGE_SCSI_FIND_LUS_MAX_WORKERS);
+
+    if (data.nworkers > 0 &&
+        VIR_ALLOC_N(workers, data.nworkers) < 0) {
+        retval = -1;
+        goto cleanup;
+    }
+
+    for (i = 0; i < data.nworkers; i++) {
+        workers[i].first = i;
+        workers[i].data = &data;
+        if (virThreadCreate(&workers[i].thread, true,
+                            virStorageBackendSCSIFindLUsWorker,
+                            &workers[i]) < 0) {
+            /* fall back to probing this slice inline */
+            virStorageBackendSCSIFindLUsWorker(&workers[i]);
+        } else {
+            workers[i].started = true;
+        }
+    }
+
+    for (i = 0; i < data.nworkers; i++) {
+        if (workers[i].started)
+            virThreadJoin(&workers[i].thread);
+    }
+
+    for (i = 0; i < data.nentries; i++) {
+        struct virStorageBackendSCSILUEntry *e = &data.entries[i];
+
+        if (e->err == -1) {
+            if (e->error)
+                virSetError(e->error);
+            retval = -1;
+            break;
+        }
+
+        if (e->err != 0)
+            continue;
+
+        pool->def->capacity += e->vol->target.capacity;
+        pool->def->allocation += e->vol->target.allocation;
+
+        if (VIR_APPEND_ELEMENT(pool->volumes.objs, pool->volumes.count,
+                               e->vol) < 0) {
+            retval = -1;
+            break;
+        }
+        found++;
+    }
+
+ cleanup:
+    for (i = 0; i < data.nentries; i++) {
+        virStorageVolDefFree(data.entries[i].vol);
+        virFreeError(data.entries[i].error);
+    }
+    VIR_FREE(data.entries);
+    VIR_FREE(workers);
+
     if (retval < 0)
         return -1;
 
@@ -33,6 +33,9 @@
 #if HAVE_PWD_H
 # include <pwd.h>
 #endif
+#if HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
 #include <errno.h>
 #include <string.h>
 
@@ -44,6 +47,8 @@
 #include "storage_event.h"
 #include "viralloc.h"
 #include "storage_backend.h"
+#include "storage_backend_fs.h"
+#include "virhash.h"
 #include "virlog.h"
 #include "virfile.h"
 #include "fdstream.h"
@@ -60,6 +65,9 @@ static virStorageDriverStatePtr driver;
 
 static int storageStateCleanup(void);
 
+static void storageVolRemoveFromPool(virStoragePoolObjPtr pool,
+                                     virStorageVolDefPtr vol);
+
 typedef struct _virStorageVolStreamInfo virStorageVolStreamInfo;
 typedef virStorageVolStreamInfo *virStorageVolStreamInfoPtr;
 struct _virStorageVolStreamInfo {
@@ -76,6 +84,227 @@ static void storageDriverUnlock(void)
     virMutexUnlock(&driver->lock);
 }
 
+#if HAVE_SYS_INOTIFY_H
+/* Incremental refresh of directory backed pools: each active pool with
+ * a local directory target gets an inotify watch on its target path, so
+ * individual volume creations and deletions are folded into the volume
+ * list as they happen, without a full O(pool-size) rescan. */
+
+static void
+storageInotifyPoolDataFree(void *payload, const void *name ATTRIBUTE_UNUSED)
+{
+    VIR_FREE(payload);
+}
+
+static bool
+storagePoolWatchSupported(virStoragePoolObjPtr pool)
+{
+    return pool->def->type == VIR_STORAGE_POOL_DIR ||
+           pool->def->type == VIR_STORAGE_POOL_FS ||
+           pool->def->type == VIR_STORAGE_POOL_NETFS;
+}
+
+/* Caller must hold the pool object lock */
+static void
+storagePoolWatchRegister(virStoragePoolObjPtr pool)
+{
+    char ebuf[1024];
+    char *key = NULL;
+    char *name = NULL;
+    int wd;
+
+    if (driver->inotifyFD < 0 ||
+        pool->inotifyWd >= 0 ||
+        !storagePoolWatchSupported(pool))
+        return;
+
+    if ((wd = inotify_add_watch(driver->inotifyFD,
+                                pool->def->target.path,
+                                IN_CLOSE_WRITE | IN_MOVED_TO |
+                                IN_DELETE | IN_MOVED_FROM)) < 0) {
+        VIR_WARN("Cannot watch storage pool directory '%s': %s",
+                 pool->def->target.path,
+                 virStrerror(errno, ebuf, sizeof(ebuf)));
+        return;
+    }
+
+    if (virAsprintf(&key, "%d", wd) < 0 ||
+        VIR_STRDUP(name, pool->def->name) < 0)
+        goto error;
+
+    virMutexLock(&driver->inotifyLock);
+    if (virHashUpdateEntry(driver->inotifyPools, key, name) < 0) {
+        virMutexUnlock(&driver->inotifyLock);
+        goto error;
+    }
+    virMutexUnlock(&driver->inotifyLock);
+
+    pool->inotifyWd = wd;
+    VIR_FREE(key);
+    return;
+
+ error:
+    ignore_value(inotify_rm_watch(driver->inotifyFD, wd));
+    VIR_FREE(key);
+    VIR_FREE(name);
+}
+
+/* Caller must hold the pool object lock */
+static void
+storagePoolWatchUnregister(virStoragePoolObjPtr pool)
+{
+    char *key = NULL;
+
+    if (driver->inotifyFD < 0 || pool->inotifyWd < 0)
+        return;
+
+    ignore_value(inotify_rm_watch(driver->inotifyFD, pool->inotifyWd));
+    if (virAsprintf(&key, "%d", pool->inotifyWd) >= 0) {
+        virMutexLock(&driver->inotifyLock);
+        ignore_value(virHashRemoveEntry(driver->inotifyPools, key));
+        virMutexUnlock(&driver->inotifyLock);
+    }
+    pool->inotifyWd = -1;
+    VIR_FREE(key);
+}
+
+static void
+storageInotifyHandleFileEvent(int wd,
+                              uint32_t mask,
+                              const char *name)
+{
+    virStoragePoolObjPtr pool = NULL;
+    virStorageBackendPtr backend;
+    virStorageVolDefPtr voldef;
+    virStorageVolDefPtr vol = NULL;
+    virObjectEventPtr event = NULL;
+    char *key = NULL;
+    char *poolname = NULL;
+
+    if (name[0] == '\0' || virStringHasControlChars(name))
+        return;
+
+    if (virAsprintf(&key, "%d", wd) < 0)
+        return;
+
+    virMutexLock(&driver->inotifyLock);
+    ignore_value(VIR_STRDUP(poolname,
+                            virHashLookup(driver->inotifyPools, key)));
+    virMutexUnlock(&driver->inotifyLock);
+    VIR_FREE(key);
+
+    if (!poolname)
+        return;
+
+    storageDriverLock();
+    pool = virStoragePoolObjFindByName(&driver->pools, poolname);
+    storageDriverUnlock();
+    VIR_FREE(poolname);
+
+    if (!pool)
+        return;
+
+    if (!virStoragePoolObjIsActive(pool) ||
+        pool->asyncjobs > 0 ||
+        !(backend = virStorageBackendForType(pool->def->type)))
+        goto cleanup;
+
+    voldef = virStorageVolDefFindByName(pool, name);
+    if (voldef && (voldef->building || voldef->in_use))
+        goto cleanup;
+
+    if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+        if (!voldef)
+            goto cleanup;
+        storageVolRemoveFromPool(pool, voldef);
+    } else if (voldef) {
+        /* a known volume was rewritten; refresh its metadata and drop
+         * the entry if the file has already vanished again */
+        if (backend->refreshVol &&
+            backend->refreshVol(NULL, pool, voldef) < 0)
+            storageVolRemoveFromPool(pool, voldef);
+    } else {
+        if (VIR_ALLOC(vol) < 0 ||
+            VIR_STRDUP(vol->name, name) < 0 ||
+            virAsprintf(&vol->target.path, "%s/%s",
+                        pool->def->target.path, name) < 0 ||
+            VIR_STRDUP(vol->key, vol->target.path) < 0)
+            goto cleanup;
+
+        vol->type = VIR_STORAGE_VOL_FILE;
+        vol->target.format = VIR_STORAGE_FILE_RAW;
+
+        if (virStorageBackendFileSystemProbeVol(vol) < 0)
+            goto cleanup;
+
+        if (VIR_APPEND_ELEMENT(pool->volumes.objs,
+                               pool->volumes.count, vol) < 0)
+            goto cleanup;
+    }
+
+    event = virStoragePoolEventRefreshNew(pool->def->name, pool->def->uuid);
+
+ cleanup:
+    virStorageVolDefFree(vol);
+    virStoragePoolObjUnlock(pool);
+    if (event)
+        virObjectEventStateQueue(driver->storageEventState, event);
+    virResetLastError();
+}
+
+static void
+storageInotifyEvent(int watch ATTRIBUTE_UNUSED,
+                    int fd,
+                    int events ATTRIBUTE_UNUSED,
+                    void *data ATTRIBUTE_UNUSED)
+{
+    char buf[1024];
+    struct inotify_event e;
+    int got;
+    char *tmp;
+
+ reread:
+    got = read(fd, buf, sizeof(buf));
+    if (got == -1) {
+        if (errno == EINTR)
+            goto reread;
+        return;
+    }
+
+    tmp = buf;
+    while (got) {
+        if (got < sizeof(e))
+            return; /* bad */
+
+        memcpy(&e, tmp, sizeof(e));
+        tmp += sizeof(e);
+        got -= sizeof(e);
+
+        if (got < e.len)
+            return;
+
+        if (e.len > 0)
+            storageInotifyHandleFileEvent(e.wd, e.mask, tmp);
+
+        tmp += e.len;
+        got -= e.len;
+    }
+}
+
+#else /* !HAVE_SYS_INOTIFY_H */
+
+static void
+storagePoolWatchRegister(virStoragePoolObjPtr pool ATTRIBUTE_UNUSED)
+{
+}
+
+static void
+storagePoolWatchUnregister(virStoragePoolObjPtr pool ATTRIBUTE_UNUSED)
+{
+}
+
+#endif /* !HAVE_SYS_INOTIFY_H */
+
 static void
 storagePoolUpdateState(virStoragePoolObjPtr pool)
 {
@@ -123,6 +352,8 @@ storagePoolUpdateState(virStoragePoolObjPtr pool)
     }
 
     pool->active = active;
+    if (active)
+        storagePoolWatchRegister(pool);
     ret = 0;
  error:
     if (ret < 0) {
@@ -203,6 +434,7 @@ storageDriverAutostart(void)
                                pool->def->name, virGetLastErrorMessage());
             } else {
                 pool->active = true;
+                storagePoolWatchRegister(pool);
             }
             VIR_FREE(stateFile);
         }
@@ -235,6 +467,9 @@ storageStateInitialize(bool privileged,
     }
     storageDriverLock();
 
+    driver->inotifyFD = -1;
+    driver->inotifyWatch = -1;
+
     if (privileged) {
         if (VIR_STRDUP(driver->configDir,
                        SYSCONFDIR "/libvirt/storage") < 0 ||
@@ -266,6 +501,26 @@ storageStateInitialize(bool privileged,
         goto error;
     }
 
+#if HAVE_SYS_INOTIFY_H
+    if (virMutexInit(&driver->inotifyLock) < 0)
+        goto error;
+    if (!(driver->inotifyPools = virHashCreate(10, storageInotifyPoolDataFree))) {
+        virMutexDestroy(&driver->inotifyLock);
+        goto error;
+    }
+    if ((driver->inotifyFD = inotify_init()) < 0) {
+        VIR_WARN("Cannot initialize inotify, "
+                 "incremental pool refresh disabled");
+    } else if ((driver->inotifyWatch = virEventAddHandle(driver->inotifyFD,
+                                                         VIR_EVENT_HANDLE_READABLE,
+                                                         storageInotifyEvent,
+                                                         NULL, NULL)) < 0) {
+        VIR_WARN("Cannot watch inotify descriptor, "
+                 "incremental pool refresh disabled");
+        VIR_FORCE_CLOSE(driver->inotifyFD);
+    }
+#endif /* HAVE_SYS_INOTIFY_H */
+
     if (virStoragePoolLoadAllState(&driver->pools,
                                    driver->stateDir) < 0)
         goto error;
@@ -349,6 +604,17 @@ storageStateCleanup(void)
 
     virObjectEventStateFree(driver->storageEventState);
 
+#if HAVE_SYS_INOTIFY_H
+    if (driver->inotifyWatch >= 0)
+        virEventRemoveHandle(driver->inotifyWatch);
+    VIR_FORCE_CLOSE(driver->inotifyFD);
+    if (driver->inotifyPools) {
+        virHashFree(driver->inotifyPools);
+        driver->inotifyPools = NULL;
+        virMutexDestroy(&driver->inotifyLock);
+    }
+#endif /* HAVE_SYS_INOTIFY_H */
+
     /* free inactive pools */
     virStoragePoolObjListFree(&driver->pools);
 
@@ -749,6 +1015,7 @@ storagePoolCreateXML(virConnectPtr conn,
 
     VIR_INFO("Creating storage pool '%s'", pool->def->name);
     pool->active = true;
+    storagePoolWatchRegister(pool);
 
     ret = virGetStoragePool(conn, pool->def->name, pool->def->uuid,
                             NULL, NULL);
@@ -960,6 +1227,7 @@ storagePoolCreate(virStoragePoolPtr obj,
                                             0);
 
     pool->active = true;
+    storagePoolWatchRegister(pool);
     ret = 0;
 
  cleanup:
@@ -1058,6 +1326,7 @@ storagePoolDestroy(virStoragePoolPtr obj)
         backend->stopPool(obj->conn, pool) < 0)
         goto cleanup;
 
+    storagePoolWatchUnregister(pool);
     virStoragePoolObjClearVols(pool);
 
     event = virStoragePoolEventLifecycleNew(pool->def->name,
@@ -1194,6 +1463,7 @@ storagePoolRefresh(virStoragePoolPtr obj,
                                                 pool->def->uuid,
                                                 VIR_STORAGE_POOL_EVENT_STOPPED,
                                                 0);
+        storagePoolWatchUnregister(pool);
         pool->active = false;
 
         if (pool->configFile == NULL) {
@@ -2219,7 +2489,7 @@ storageVolDownload(virStorageVolPtr obj,
     virStorageVolDefPtr vol = NULL;
     int ret = -1;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM, -1);
 
     if (!(vol = virStorageVolDefFromVol(obj, &pool, &backend)))
         return -1;
@@ -2387,7 +2657,7 @@ storageVolUpload(virStorageVolPtr obj,
     virStorageVolStreamInfoPtr cbdata = NULL;
     int ret = -1;
 
-    virCheckFlags(0, -1);
+    virCheckFlags(VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM, -1);
 
     if (!(vol = virStorageVolDefFromVol(obj, &pool, &backend)))
         return -1;
@@ -2555,6 +2825,7 @@ storageVolWipePattern(virStorageVolPtr obj,
     virStorageBackendPtr backend;
     virStoragePoolObjPtr pool = NULL;
     virStorageVolDefPtr vol = NULL;
+    int rc;
     int ret = -1;
 
     virCheckFlags(0, -1);
@@ -2593,7 +2864,20 @@ storageVolWipePattern(virStorageVolPtr obj,
         goto cleanup;
     }
 
-    if (backend->wipeVol(obj->conn, pool, vol, algorithm, flags) < 0)
+    /* Drop the pool lock while the data is wiped, so long running
+     * wipes do not serialize every other operation on the pool; the
+     * in_use/asyncjobs counters keep the volume and the pool busy */
+    pool->asyncjobs++;
+    vol->in_use++;
+    virStoragePoolObjUnlock(pool);
+
+    rc = backend->wipeVol(obj->conn, pool, vol, algorithm, flags);
+
+    virStoragePoolObjLock(pool);
+    vol->in_use--;
+    pool->asyncjobs--;
+
+    if (rc < 0)
         goto cleanup;
 
     if (backend->refreshVol &&
@@ -3177,6 +3461,116 @@ virStorageFileChown(virStorageSourcePtr src,
 }
 
 
+/* Cache of recently read image headers, keyed by the unique identifier
+ * of the image and validated against its ctime and size, so that
+ * re-probing a deep backing chain (eg on every VM start) does not pay
+ * an open+read round trip per layer on network filesystems. */
+#define VIR_STORAGE_FILE_HEADER_CACHE_SIZE 256
+
+struct virStorageFileHeaderCacheEntry {
+    char *buf;
+    ssize_t len;
+    time_t ctime;
+    unsigned long long size;
+};
+
+static virMutex virStorageFileHeaderCacheLock;
+static virHashTablePtr virStorageFileHeaderCache;
+
+static void
+virStorageFileHeaderCacheEntryFree(void *payload,
+                                   const void *name ATTRIBUTE_UNUSED)
+{
+    struct virStorageFileHeaderCacheEntry *entry = payload;
+
+    VIR_FREE(entry->buf);
+    VIR_FREE(entry);
+}
+
+static int
+virStorageFileHeaderCacheOnceInit(void)
+{
+    if (virMutexInit(&virStorageFileHeaderCacheLock) < 0)
+        return -1;
+
+    if (!(virStorageFileHeaderCache =
+          virHashCreate(VIR_STORAGE_FILE_HEADER_CACHE_SIZE,
+                        virStorageFileHeaderCacheEntryFree)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virStorageFileHeaderCache)
+
+/* Read the header of @src, serving it from the header cache when the
+ * file's ctime and size still match the cached copy. Backends without
+ * stat support bypass the cache. Semantics are otherwise identical to
+ * virStorageFileReadHeader. */
+static ssize_t
+virStorageFileReadHeaderCached(virStorageSourcePtr src,
+                               const char *uniqueName,
+                               char **buf)
+{
+    struct virStorageFileHeaderCacheEntry *entry;
+    struct stat st;
+    ssize_t len;
+    bool canCache = false;
+
+    if (virStorageFileHeaderCacheInitialize() == 0 &&
+        virStorageFileStat(src, &st) == 0) {
+        canCache = true;
+
+        virMutexLock(&virStorageFileHeaderCacheLock);
+        if ((entry = virHashLookup(virStorageFileHeaderCache, uniqueName)) &&
+            entry->ctime == st.st_ctime &&
+            entry->size == (unsigned long long)st.st_size) {
+            char *copy;
+
+            if (VIR_ALLOC_N(copy, entry->len) == 0) {
+                memcpy(copy, entry->buf, entry->len);
+                len = entry->len;
+                virMutexUnlock(&virStorageFileHeaderCacheLock);
+                *buf = copy;
+                return len;
+            }
+        }
+        virMutexUnlock(&virStorageFileHeaderCacheLock);
+    }
+
+    if ((len = virStorageFileReadHeader(src, VIR_STORAGE_MAX_HEADER, buf)) < 0)
+        return len;
+
+    if (canCache) {
+        if (VIR_ALLOC(entry) < 0)
+            return len;
+
+        if (VIR_ALLOC_N(entry->buf, len) < 0) {
+            VIR_FREE(entry);
+            return len;
+        }
+
+        memcpy(entry->buf, *buf, len);
+        entry->len = len;
+        entry->ctime = st.st_ctime;
+        entry->size = st.st_size;
+
+        virMutexLock(&virStorageFileHeaderCacheLock);
+        if ((virHashSize(virStorageFileHeaderCache) <
+             VIR_STORAGE_FILE_HEADER_CACHE_SIZE ||
+             virHashLookup(virStorageFileHeaderCache, uniqueName)) &&
+            virHashUpdateEntry(virStorageFileHeaderCache,
+                               uniqueName, entry) == 0)
+            entry = NULL;
+        virMutexUnlock(&virStorageFileHeaderCacheLock);
+
+        if (entry)
+            virStorageFileHeaderCacheEntryFree(entry, NULL);
+    }
+
+    return len;
+}
+
 /* Recursive workhorse for virStorageFileGetMetadata.  */
 static int
 virStorageFileGetMetadataRecurse(virStorageSourcePtr src,
@@ -3235,8 +3629,8 @@ virStorageFileGetMetadataRecurse(virStorageSourcePtr src,
     if (virHashAddEntry(cycle, uniqueName, (void *)1) < 0)
         goto cleanup;
 
-    if ((headerLen = virStorageFileReadHeader(src, VIR_STORAGE_MAX_HEADER,
-                                              &buf)) < 0)
+    if ((headerLen = virStorageFileReadHeaderCached(src, uniqueName,
+                                                    &buf)) < 0)
         goto cleanup;
 
     if (virStorageFileGetMetadataInternal(src, buf, headerLen,
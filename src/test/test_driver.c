@@ -59,6 +59,7 @@
 #include "virtypedparam.h"
 #include "virrandom.h"
 #include "virstring.h"
+#include "viruri.h"
 #include "cpu/cpu.h"
 #include "virauth.h"
 #include "viratomic.h"
@@ -1242,11 +1243,92 @@ testOpenFromFile(virConnectPtr conn, const char *file)
     return VIR_DRV_OPEN_ERROR;
 }
 
+/* Fabricate @ndomains running domains with modest device counts and
+ * varied sizing, so client-side scale behaviour (bulk listing, stats
+ * sweeps) can be exercised without a real hypervisor.  Sizing is
+ * derived deterministically from the index so repeated opens produce
+ * an identical inventory. */
+static int
+testOpenDefaultFabricateDomains(testDriverPtr privconn,
+                                size_t ndomains)
+{
+    size_t i;
+
+    for (i = 0; i < ndomains; i++) {
+        char *xml = NULL;
+        unsigned char uuid[VIR_UUID_BUFLEN];
+        char uuidstr[VIR_UUID_STRING_BUFLEN];
+        virDomainDefPtr def;
+        virDomainObjPtr obj;
+
+        if (virUUIDGenerate(uuid) < 0)
+            return -1;
+        virUUIDFormat(uuid, uuidstr);
+
+        if (virAsprintf(&xml,
+                        "<domain type='test'>"
+                        "  <name>scale-%zu</name>"
+                        "  <uuid>%s</uuid>"
+                        "  <memory unit='KiB'>%zu</memory>"
+                        "  <vcpu>%zu</vcpu>"
+                        "  <os><type>hvm</type></os>"
+                        "  <devices>"
+                        "    <disk type='file' device='disk'>"
+                        "      <source file='/guest/scale-%zu-root.img'/>"
+                        "      <target dev='vda'/>"
+                        "    </disk>"
+                        "    <disk type='file' device='disk'>"
+                        "      <source file='/guest/scale-%zu-data.img'/>"
+                        "      <target dev='vdb'/>"
+                        "    </disk>"
+                        "    <interface type='ethernet'>"
+                        "      <mac address='52:54:10:%02zx:%02zx:%02zx'/>"
+                        "    </interface>"
+                        "    <interface type='ethernet'>"
+                        "      <mac address='52:54:11:%02zx:%02zx:%02zx'/>"
+                        "    </interface>"
+                        "  </devices>"
+                        "</domain>",
+                        i, uuidstr,
+                        (1 + i % 16) * 262144, 1 + i % 8,
+                        i, i,
+                        (i >> 16) & 0x7f, (i >> 8) & 0xff, i & 0xff,
+                        (i >> 16) & 0x7f, (i >> 8) & 0xff, i & 0xff) < 0)
+            return -1;
+
+        def = virDomainDefParseString(xml, privconn->caps, privconn->xmlopt,
+                                      VIR_DOMAIN_DEF_PARSE_INACTIVE);
+        VIR_FREE(xml);
+        if (!def)
+            return -1;
+
+        if (testDomainGenerateIfnames(def) < 0 ||
+            !(obj = virDomainObjListAdd(privconn->domains,
+                                        def,
+                                        privconn->xmlopt,
+                                        0, NULL))) {
+            virDomainDefFree(def);
+            return -1;
+        }
+
+        if (testDomainStartState(privconn, obj,
+                                 VIR_DOMAIN_RUNNING_BOOTED) < 0) {
+            virObjectUnlock(obj);
+            return -1;
+        }
+        obj->persistent = true;
+        virObjectUnlock(obj);
+    }
+
+    return 0;
+}
+
 /* Simultaneous test:///default connections should share the same
  * common state (among other things, this allows testing event
  * detection in one connection for an action caused in another).  */
 static int
-testOpenDefault(virConnectPtr conn)
+testOpenDefault(virConnectPtr conn,
+                size_t ndomains)
 {
     int u;
     testDriverPtr privconn = NULL;
@@ -1294,6 +1376,10 @@ testOpenDefault(virConnectPtr conn)
     if (testOpenParse(privconn, NULL, ctxt) < 0)
         goto error;
 
+    if (ndomains &&
+        testOpenDefaultFabricateDomains(privconn, ndomains) < 0)
+        goto error;
+
     defaultConn = privconn;
 
     xmlXPathFreeContext(ctxt);
@@ -1395,9 +1481,29 @@ static virDrvOpenStatus testConnectOpen(virConnectPtr conn,
         return VIR_DRV_OPEN_ERROR;
     }
 
-    if (STREQ(conn->uri->path, "/default"))
-        ret = testOpenDefault(conn);
-    else
+    if (STREQ(conn->uri->path, "/default")) {
+        unsigned int ndomains = 0;
+        size_t i;
+
+        /* Scale-testing knob: test:///default?domains=N fabricates N
+         * extra domains.  Only the first open of the shared default
+         * connection takes effect; later opens join its state. */
+        for (i = 0; i < conn->uri->paramsCount; i++) {
+            virURIParamPtr param = &conn->uri->params[i];
+
+            if (STRNEQ(param->name, "domains"))
+                continue;
+
+            if (virStrToLong_uip(param->value, NULL, 10, &ndomains) < 0) {
+                virReportError(VIR_ERR_INVALID_ARG,
+                               _("invalid domains parameter '%s'"),
+                               param->value);
+                return VIR_DRV_OPEN_ERROR;
+            }
+        }
+
+        ret = testOpenDefault(conn, ndomains);
+    } else
         ret = testOpenFromFile(conn,
                                conn->uri->path);
 
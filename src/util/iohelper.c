@@ -43,6 +43,133 @@
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
+/* How far ahead of the write position the output file is grown, so
+ * the filesystem hands out extents in large contiguous runs instead
+ * of once per block */
+#define IOHELPER_PREALLOC_EXTENT (16 * 1024 * 1024)
+
+typedef struct _iohelperWriter iohelperWriter;
+struct _iohelperWriter {
+    virMutex lock;
+    virCond cond;
+    virThread thread;
+    int fd;
+    const char *fdname;
+    bool prealloc;              /* grow the file ahead of the writes */
+    unsigned long long allocated;
+    unsigned long long written;
+    /* Block handed over by the reader; len == 0 means the slot is free */
+    char *buf;
+    size_t len;
+    bool eof;
+    int err;                    /* errno of the first failed write */
+};
+
+/* Drains blocks handed over by the reading side, so a disk write and
+ * the read filling the other buffer overlap instead of alternating.
+ * After a write fails the thread keeps consuming and discarding
+ * blocks to keep the producer from blocking forever. */
+static void
+iohelperWriterRun(void *opaque)
+{
+    iohelperWriter *writer = opaque;
+
+    virMutexLock(&writer->lock);
+    for (;;) {
+        char *buf;
+        size_t len;
+        ssize_t rv = 0;
+
+        while (!writer->len && !writer->eof) {
+            if (virCondWait(&writer->cond, &writer->lock) < 0) {
+                if (!writer->err)
+                    writer->err = errno;
+                goto cleanup;
+            }
+        }
+        if (!writer->len && writer->eof)
+            break;
+
+        buf = writer->buf;
+        len = writer->len;
+        virMutexUnlock(&writer->lock);
+
+        if (!writer->err) {
+#ifdef __linux__
+            if (writer->prealloc &&
+                writer->written + len > writer->allocated) {
+                if (fallocate(writer->fd, 0, writer->allocated,
+                              IOHELPER_PREALLOC_EXTENT) == 0)
+                    writer->allocated += IOHELPER_PREALLOC_EXTENT;
+                else /* e.g. EOPNOTSUPP; writes extend the file as before */
+                    writer->prealloc = false;
+            }
+#endif
+            rv = safewrite(writer->fd, buf, len);
+        }
+
+        virMutexLock(&writer->lock);
+        if (rv < 0) {
+            if (!writer->err)
+                writer->err = errno;
+        } else {
+            writer->written += len;
+        }
+        writer->len = 0;
+        virCondSignal(&writer->cond);
+    }
+ cleanup:
+    virMutexUnlock(&writer->lock);
+}
+
+/* Hand one block to the writer thread, waiting for the previous one
+ * to drain first */
+static int
+iohelperWriterSend(iohelperWriter *writer, char *buf, size_t len)
+{
+    int ret = -1;
+
+    virMutexLock(&writer->lock);
+    while (writer->len) {
+        if (virCondWait(&writer->cond, &writer->lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("failed to wait for writer thread"));
+            goto cleanup;
+        }
+    }
+    if (writer->err) {
+        virReportSystemError(writer->err, _("Unable to write %s"),
+                             writer->fdname);
+        goto cleanup;
+    }
+    writer->buf = buf;
+    writer->len = len;
+    virCondSignal(&writer->cond);
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&writer->lock);
+    return ret;
+}
+
+static int
+iohelperWriterFinish(iohelperWriter *writer)
+{
+    virMutexLock(&writer->lock);
+    writer->eof = true;
+    virCondSignal(&writer->cond);
+    virMutexUnlock(&writer->lock);
+
+    virThreadJoin(&writer->thread);
+
+    if (writer->err) {
+        virReportSystemError(writer->err, _("Unable to write %s"),
+                             writer->fdname);
+        return -1;
+    }
+    return 0;
+}
+
 static int
 prepare(const char *path, int oflags, int mode,
         unsigned long long offset)
@@ -86,15 +213,38 @@ runIO(const char *path, int fd, int oflags, unsigned long long length)
     bool direct = O_DIRECT && ((oflags & O_DIRECT) != 0);
     bool shortRead = false; /* true if we hit a short read */
     off_t end = 0;
+    const char *buflenStr;
+    iohelperWriter writer;
+    bool writerStarted = false;
+    int curbuf = 0;
+
+    memset(&writer, 0, sizeof(writer));
+
+    /* The block size may be tuned via the environment we inherit from
+     * the daemon, e.g. to match the stripe size of the storage the
+     * save images live on */
+    if ((buflenStr = getenv("LIBVIRT_IOHELPER_BUFFER_BYTES"))) {
+        unsigned long long val;
+
+        if (virStrToLong_ullp(buflenStr, NULL, 10, &val) == 0) {
+            if (val < (unsigned long long) alignMask + 1)
+                val = alignMask + 1;
+            if (val > 64 * 1024 * 1024)
+                val = 64 * 1024 * 1024;
+            buflen = (val + alignMask) & ~((unsigned long long) alignMask);
+        }
+    }
 
+    /* Two buffers so one can be written out while the other is
+     * being filled */
 #if HAVE_POSIX_MEMALIGN
-    if (posix_memalign(&base, alignMask + 1, buflen)) {
+    if (posix_memalign(&base, alignMask + 1, 2 * buflen)) {
         virReportOOMError();
         goto cleanup;
     }
     buf = base;
 #else
-    if (VIR_ALLOC_N(buf, buflen + alignMask) < 0)
+    if (VIR_ALLOC_N(buf, 2 * buflen + alignMask) < 0)
         goto cleanup;
     base = buf;
     buf = (char *) (((intptr_t) base + alignMask) & ~alignMask);
@@ -136,8 +286,70 @@ runIO(const char *path, int fd, int oflags, unsigned long long length)
         goto cleanup;
     }
 
+#ifdef __linux__
+    /* One side is always a pipe to the parent process, so unless
+     * O_DIRECT imposes its alignment rules we can usually move the
+     * data entirely inside the kernel with splice() instead of
+     * copying every block through our buffer. If the very first
+     * splice is rejected nothing has moved yet, so fall back to
+     * the copy loop below.
+     */
+    if (!direct) {
+        bool spliced = false;
+
+        while (1) {
+            ssize_t got;
+            size_t want = buflen;
+
+            if (length &&
+                (length - total) < want)
+                want = length - total;
+
+            if (want == 0)
+                break; /* End of requested data from client */
+
+            if ((got = splice(fdin, NULL, fdout, NULL, want,
+                              SPLICE_F_MOVE)) < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (!spliced &&
+                    (errno == EINVAL || errno == ENOSYS))
+                    goto fallback;
+                virReportSystemError(errno, _("Unable to splice %s to %s"),
+                                     fdinname, fdoutname);
+                goto cleanup;
+            }
+            spliced = true;
+            if (got == 0)
+                break; /* End of file before end of requested data */
+            total += got;
+        }
+
+        /* Both ways out of the loop mean the transfer is complete */
+        goto fsync;
+    }
+ fallback:
+#endif
+
+    if (virMutexInit(&writer.lock) < 0 ||
+        virCondInit(&writer.cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize writer thread"));
+        goto cleanup;
+    }
+    writer.fd = fdout;
+    writer.fdname = fdoutname;
+    writer.prealloc = direct && fdout == fd;
+    if (virThreadCreate(&writer.thread, true, iohelperWriterRun, &writer) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create writer thread"));
+        goto cleanup;
+    }
+    writerStarted = true;
+
     while (1) {
         ssize_t got;
+        char *block = buf + curbuf * buflen;
 
         if (length &&
             (length - total) < buflen)
@@ -146,7 +358,7 @@ runIO(const char *path, int fd, int oflags, unsigned long long length)
         if (buflen == 0)
             break; /* End of requested data from client */
 
-        if ((got = saferead(fdin, buf, buflen)) < 0) {
+        if ((got = saferead(fdin, block, buflen)) < 0) {
             virReportSystemError(errno, _("Unable to read %s"), fdinname);
             goto cleanup;
         }
@@ -164,19 +376,30 @@ runIO(const char *path, int fd, int oflags, unsigned long long length)
         total += got;
         if (fdout == fd && direct && shortRead) {
             end = total;
-            memset(buf + got, 0, buflen - got);
+            memset(block + got, 0, buflen - got);
             got = (got + alignMask) & ~alignMask;
         }
-        if (safewrite(fdout, buf, got) < 0) {
-            virReportSystemError(errno, _("Unable to write %s"), fdoutname);
+        if (iohelperWriterSend(&writer, block, got) < 0)
             goto cleanup;
-        }
-        if (end && ftruncate(fd, end) < 0) {
-            virReportSystemError(errno, _("Unable to truncate %s"), fdoutname);
-            goto cleanup;
-        }
+        curbuf = !curbuf;
+    }
+
+    writerStarted = false;
+    if (iohelperWriterFinish(&writer) < 0)
+        goto cleanup;
+
+    /* Trim the zero padding of a final short O_DIRECT block and any
+     * preallocation beyond the data we actually wrote */
+    if (writer.allocated > total && !end)
+        end = total;
+    if (end && ftruncate(fd, end) < 0) {
+        virReportSystemError(errno, _("Unable to truncate %s"), fdoutname);
+        goto cleanup;
     }
 
+#ifdef __linux__
+ fsync:
+#endif
     /* Ensure all data is written */
     if (fdatasync(fdout) < 0) {
         if (errno != EINVAL && errno != EROFS) {
@@ -189,6 +412,16 @@ runIO(const char *path, int fd, int oflags, unsigned long long length)
     ret = 0;
 
  cleanup:
+    if (writerStarted) {
+        /* Wake the writer thread up and wait for it before the buffers
+         * it may still reference go away; the original error wins */
+        virMutexLock(&writer.lock);
+        writer.eof = true;
+        virCondSignal(&writer.cond);
+        virMutexUnlock(&writer.lock);
+        virThreadJoin(&writer.thread);
+    }
+
     if (VIR_CLOSE(fd) < 0 &&
         ret == 0) {
         virReportSystemError(errno, _("Unable to close %s"), path);
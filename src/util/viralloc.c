@@ -619,3 +619,215 @@ void virDispose(void *ptrptr,
         *countptr = 0;
     errno = save_errno;
 }
+
+
+/* Size classes served from pool chunks; anything larger gets its
+ * own tracked allocation */
+#define VIR_ALLOC_POOL_NCLASSES 6
+
+static const size_t virAllocPoolClassSizes[VIR_ALLOC_POOL_NCLASSES] = {
+    16, 32, 64, 128, 256, 512,
+};
+
+#define VIR_ALLOC_POOL_DEFAULT_CHUNK 8192
+
+typedef struct _virAllocPoolChunk virAllocPoolChunk;
+struct _virAllocPoolChunk {
+    virAllocPoolChunk *next;
+    size_t used;
+    size_t size;
+    unsigned long long pad;     /* keep the following data 16-byte aligned */
+};
+
+typedef struct _virAllocPoolLarge virAllocPoolLarge;
+struct _virAllocPoolLarge {
+    virAllocPoolLarge *next;
+    unsigned long long pad;     /* keep the following data 16-byte aligned */
+};
+
+struct _virAllocPool {
+    virAllocPoolChunk *chunks;
+    virAllocPoolLarge *large;
+    void *freelists[VIR_ALLOC_POOL_NCLASSES];
+    size_t chunkSize;
+};
+
+
+static ssize_t
+virAllocPoolClass(size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_ALLOC_POOL_NCLASSES; i++) {
+        if (size <= virAllocPoolClassSizes[i])
+            return i;
+    }
+    return -1;
+}
+
+
+/**
+ * virAllocPoolNew:
+ * @chunkSize: size of the chunks backing small allocations,
+ *             or 0 for a sane default
+ *
+ * Allocate a new pool. All memory handed out by the pool stays
+ * owned by it and is released wholesale by virAllocPoolFree.
+ *
+ * Returns the new pool, or NULL with the OOM error reported.
+ */
+virAllocPoolPtr
+virAllocPoolNew(size_t chunkSize)
+{
+    virAllocPoolPtr pool;
+
+    if (VIR_ALLOC(pool) < 0)
+        return NULL;
+
+    pool->chunkSize = chunkSize ? chunkSize : VIR_ALLOC_POOL_DEFAULT_CHUNK;
+    return pool;
+}
+
+
+/**
+ * virAllocPoolAlloc:
+ * @pool: the pool to allocate from
+ * @size: number of bytes needed
+ *
+ * Allocate @size bytes of zeroed memory owned by @pool. Small
+ * requests are rounded up to the nearest size class and bump
+ * allocated from the current chunk, reusing any recycled object of
+ * the same class; larger requests fall back to a tracked direct
+ * allocation. The memory must not be passed to VIR_FREE; it is
+ * released by virAllocPoolFree along with the whole pool.
+ *
+ * Returns the allocated memory, or NULL with the OOM error reported.
+ */
+void *
+virAllocPoolAlloc(virAllocPoolPtr pool, size_t size)
+{
+    virAllocPoolChunk *chunk;
+    ssize_t cls;
+    size_t bytes;
+    void *ret;
+
+    if (size == 0)
+        size = 1;
+
+    if ((cls = virAllocPoolClass(size)) < 0) {
+        virAllocPoolLarge *blk;
+
+        if (VIR_ALLOC_VAR(blk, char, size) < 0)
+            return NULL;
+        blk->next = pool->large;
+        pool->large = blk;
+        return blk + 1;
+    }
+
+    bytes = virAllocPoolClassSizes[cls];
+
+    if (pool->freelists[cls]) {
+        ret = pool->freelists[cls];
+        pool->freelists[cls] = *(void **)ret;
+        memset(ret, 0, bytes);
+        return ret;
+    }
+
+    chunk = pool->chunks;
+    if (!chunk || chunk->size - chunk->used < bytes) {
+        size_t csize = pool->chunkSize;
+
+        if (csize < bytes)
+            csize = bytes;
+        if (VIR_ALLOC_VAR(chunk, char, csize) < 0)
+            return NULL;
+        chunk->size = csize;
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+    }
+
+    /* chunk data starts 16-byte aligned and all class sizes are
+     * multiples of 16, so every returned pointer stays aligned */
+    ret = (char *)(chunk + 1) + chunk->used;
+    chunk->used += bytes;
+    return ret;
+}
+
+
+/**
+ * virAllocPoolStrdup:
+ * @pool: the pool to allocate from
+ * @src: string to duplicate
+ *
+ * Duplicate @src into memory owned by @pool.
+ *
+ * Returns the copy, or NULL if @src was NULL or on OOM (reported).
+ */
+char *
+virAllocPoolStrdup(virAllocPoolPtr pool, const char *src)
+{
+    size_t len;
+    char *ret;
+
+    if (!src)
+        return NULL;
+
+    len = strlen(src) + 1;
+    if (!(ret = virAllocPoolAlloc(pool, len)))
+        return NULL;
+    memcpy(ret, src, len);
+    return ret;
+}
+
+
+/**
+ * virAllocPoolRecycle:
+ * @pool: the pool that owns @ptr
+ * @ptr: object to give back, may be NULL
+ * @size: the size originally requested for @ptr
+ *
+ * Return an object to @pool for reuse by later allocations of the
+ * same size class. This is optional - anything not recycled is
+ * still released by virAllocPoolFree. Oversize allocations are
+ * simply kept until the pool is freed.
+ */
+void
+virAllocPoolRecycle(virAllocPoolPtr pool, void *ptr, size_t size)
+{
+    ssize_t cls;
+
+    if (!ptr)
+        return;
+
+    if ((cls = virAllocPoolClass(size)) < 0)
+        return;
+
+    *(void **)ptr = pool->freelists[cls];
+    pool->freelists[cls] = ptr;
+}
+
+
+/**
+ * virAllocPoolFree:
+ * @pool: the pool to free, may be NULL
+ *
+ * Release every allocation made from @pool and the pool itself.
+ */
+void
+virAllocPoolFree(virAllocPoolPtr pool)
+{
+    if (!pool)
+        return;
+
+    while (pool->chunks) {
+        virAllocPoolChunk *next = pool->chunks->next;
+        VIR_FREE(pool->chunks);
+        pool->chunks = next;
+    }
+    while (pool->large) {
+        virAllocPoolLarge *next = pool->large->next;
+        VIR_FREE(pool->large);
+        pool->large = next;
+    }
+    VIR_FREE(pool);
+}
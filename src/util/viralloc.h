@@ -596,4 +596,29 @@ void virAllocTestInit(void);
 int virAllocTestCount(void);
 void virAllocTestOOM(int n, int m);
 void virAllocTestHook(void (*func)(int, void*), void *data);
+
+/**
+ * virAllocPool:
+ *
+ * A size-class pool allocator for the small fixed-size objects and
+ * strings churned out by hot parsers and the RPC layer. Allocations
+ * are served by bumping a pointer inside larger chunks, optionally
+ * recycled through per-size-class free lists, and the whole pool is
+ * released with a handful of free() calls instead of one per object.
+ *
+ * Pools are not thread safe; the intended usage is one pool per
+ * parsing/serializing job, owned by a single thread.
+ */
+typedef struct _virAllocPool virAllocPool;
+typedef virAllocPool *virAllocPoolPtr;
+
+virAllocPoolPtr virAllocPoolNew(size_t chunkSize);
+void *virAllocPoolAlloc(virAllocPoolPtr pool, size_t size)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+char *virAllocPoolStrdup(virAllocPoolPtr pool, const char *src)
+    ATTRIBUTE_NONNULL(1);
+void virAllocPoolRecycle(virAllocPoolPtr pool, void *ptr, size_t size)
+    ATTRIBUTE_NONNULL(1);
+void virAllocPoolFree(virAllocPoolPtr pool);
+
 #endif /* __VIR_MEMORY_H_ */
@@ -223,6 +223,73 @@ int virBitmapSetBitExpand(virBitmapPtr bitmap, size_t b)
 }
 
 
+/* Set all bits from @start to @last inclusive, filling whole units at
+ * a time rather than looping bit by bit.  Bounds must have been
+ * checked by the caller. */
+static void
+virBitmapSetRangeInternal(virBitmapPtr bitmap, size_t start, size_t last)
+{
+    size_t startUnit = VIR_BITMAP_UNIT_OFFSET(start);
+    size_t lastUnit = VIR_BITMAP_UNIT_OFFSET(last);
+    unsigned long startMask = ~0UL << (start % VIR_BITMAP_BITS_PER_UNIT);
+    unsigned long lastMask = ~0UL >> (VIR_BITMAP_BITS_PER_UNIT - 1 -
+                                      last % VIR_BITMAP_BITS_PER_UNIT);
+    size_t i;
+
+    if (startUnit == lastUnit) {
+        bitmap->map[startUnit] |= startMask & lastMask;
+        return;
+    }
+
+    bitmap->map[startUnit] |= startMask;
+    for (i = startUnit + 1; i < lastUnit; i++)
+        bitmap->map[i] = ~0UL;
+    bitmap->map[lastUnit] |= lastMask;
+}
+
+/**
+ * virBitmapSetRange:
+ * @bitmap: Pointer to bitmap
+ * @start: first bit position to set
+ * @last: last bit position to set
+ *
+ * Set all bits from position @start up to and including @last in @bitmap.
+ *
+ * Returns 0 if the bits are successfully set, -1 on error.
+ */
+int virBitmapSetRange(virBitmapPtr bitmap, size_t start, size_t last)
+{
+    if (last < start || bitmap->max_bit <= last)
+        return -1;
+
+    virBitmapSetRangeInternal(bitmap, start, last);
+    return 0;
+}
+
+/**
+ * virBitmapSetRangeExpand:
+ * @bitmap: Pointer to bitmap
+ * @start: first bit position to set
+ * @last: last bit position to set
+ *
+ * Set all bits from position @start up to and including @last in @bitmap.
+ * Expands the bitmap as necessary so that @last is included in the map.
+ *
+ * Returns 0 if the bits are successfully set, -1 on error.
+ */
+int virBitmapSetRangeExpand(virBitmapPtr bitmap, size_t start, size_t last)
+{
+    if (last < start)
+        return -1;
+
+    if (bitmap->max_bit <= last && virBitmapExpand(bitmap, last) < 0)
+        return -1;
+
+    virBitmapSetRangeInternal(bitmap, start, last);
+    return 0;
+}
+
+
 /**
  * virBitmapClearBit:
  * @bitmap: Pointer to bitmap
@@ -430,7 +497,6 @@ virBitmapParseSeparator(const char *str,
     bool neg = false;
     const char *cur = str;
     char *tmp;
-    size_t i;
     int start, last;
 
     if (!(*bitmap = virBitmapNew(bitmapSize)))
@@ -490,10 +556,8 @@ virBitmapParseSeparator(const char *str,
 
             cur = tmp;
 
-            for (i = start; i <= last; i++) {
-                if (virBitmapSetBit(*bitmap, i) < 0)
-                    goto error;
-            }
+            if (virBitmapSetRange(*bitmap, start, last) < 0)
+                goto error;
 
             virSkipSpaces(&cur);
         }
@@ -565,7 +629,6 @@ virBitmapParseUnlimited(const char *str,
     bool neg = false;
     const char *cur = str;
     char *tmp;
-    size_t i;
     int start, last;
 
     if (!(*bitmap = virBitmapNewEmpty()))
@@ -625,10 +688,8 @@ virBitmapParseUnlimited(const char *str,
 
             cur = tmp;
 
-            for (i = start; i <= last; i++) {
-                if (virBitmapSetBitExpand(*bitmap, i) < 0)
-                    goto error;
-            }
+            if (virBitmapSetRangeExpand(*bitmap, start, last) < 0)
+                goto error;
 
             virSkipSpaces(&cur);
         }
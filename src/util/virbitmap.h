@@ -59,6 +59,15 @@ int virBitmapSetBit(virBitmapPtr bitmap, size_t b)
 int virBitmapSetBitExpand(virBitmapPtr bitmap, size_t b)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 
+/*
+ * Set all bits from position @start up to and including @last
+ */
+int virBitmapSetRange(virBitmapPtr bitmap, size_t start, size_t last)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+
+int virBitmapSetRangeExpand(virBitmapPtr bitmap, size_t start, size_t last)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+
 
 /*
  * Clear bit position @b in @bitmap
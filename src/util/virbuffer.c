@@ -27,6 +27,7 @@
 #include <string.h>
 #include <stdarg.h>
 #include "c-ctype.h"
+#include "ignore-value.h"
 
 #define __VIR_BUFFER_C__
 
@@ -35,6 +36,12 @@
 #include "virerror.h"
 
 
+/* Size of the storage embedded in every virBuffer; short strings are
+ * assembled in place and only spill onto the heap once they outgrow
+ * it.  Must match the array length in the mirror struct in
+ * virbuffer.h. */
+#define VIR_BUFFER_INLINE_SIZE 128
+
 /* If adding more fields, ensure to edit buf.h to match
    the number of fields */
 struct _virBuffer {
@@ -43,6 +50,7 @@ struct _virBuffer {
     unsigned int error; /* errno value, or -1 for usage error */
     int indent;
     char *content;
+    char inlineContent[VIR_BUFFER_INLINE_SIZE];
 };
 
 /**
@@ -55,7 +63,9 @@ struct _virBuffer {
 static void
 virBufferSetError(virBufferPtr buf, int error)
 {
-    VIR_FREE(buf->content);
+    if (buf->content != buf->inlineContent)
+        VIR_FREE(buf->content);
+    buf->content = NULL;
     buf->size = 0;
     buf->use = 0;
     buf->indent = 0;
@@ -117,7 +127,7 @@ virBufferGetIndent(const virBuffer *buf, bool dynamic)
 static int
 virBufferGrow(virBufferPtr buf, unsigned int len)
 {
-    int size;
+    unsigned int size;
 
     if (buf->error)
         return -1;
@@ -125,9 +135,36 @@ virBufferGrow(virBufferPtr buf, unsigned int len)
     if ((len + buf->use) < buf->size)
         return 0;
 
-    size = buf->use + len + 1000;
+    /* A fresh buffer starts out in the embedded storage */
+    if (buf->size == 0 &&
+        len + buf->use < VIR_BUFFER_INLINE_SIZE) {
+        buf->content = buf->inlineContent;
+        buf->size = VIR_BUFFER_INLINE_SIZE;
+        return 0;
+    }
 
-    if (VIR_REALLOC_N_QUIET(buf->content, size) < 0) {
+    /* Double rather than pad by a constant, so that building a large
+     * document costs O(log n) reallocations instead of O(n) */
+    size = buf->size ? buf->size : VIR_BUFFER_INLINE_SIZE;
+    while (size <= len + buf->use) {
+        if (size > UINT_MAX / 2) {
+            virBufferSetError(buf, ENOMEM);
+            return -1;
+        }
+        size *= 2;
+    }
+
+    if (buf->content == buf->inlineContent) {
+        char *newContent;
+
+        if (VIR_ALLOC_N_QUIET(newContent, size) < 0) {
+            virBufferSetError(buf, errno);
+            return -1;
+        }
+        memcpy(newContent, buf->content, buf->use);
+        newContent[buf->use] = '\0';
+        buf->content = newContent;
+    } else if (VIR_REALLOC_N_QUIET(buf->content, size) < 0) {
         virBufferSetError(buf, errno);
         return -1;
     }
@@ -135,6 +172,25 @@ virBufferGrow(virBufferPtr buf, unsigned int len)
     return 0;
 }
 
+/**
+ * virBufferReserve:
+ * @buf: the buffer
+ * @len: number of bytes of free space to guarantee
+ *
+ * Ensure that at least @len bytes can be appended to @buf without
+ * further reallocation, for callers that know the size of the output
+ * in advance.  On allocation failure the buffer error indicator is
+ * set.
+ */
+void
+virBufferReserve(virBufferPtr buf, unsigned int len)
+{
+    if (!buf)
+        return;
+
+    ignore_value(virBufferGrow(buf, len));
+}
+
 /**
  * virBufferAdd:
  * @buf: the buffer to append to
@@ -264,7 +320,18 @@ virBufferContentAndReset(virBufferPtr buf)
         return NULL;
     }
 
-    str = buf->content;
+    if (buf->content == buf->inlineContent) {
+        /* Content still lives in the embedded storage; the caller
+         * expects a heap pointer it can free */
+        if (VIR_ALLOC_N_QUIET(str, buf->use + 1) < 0) {
+            memset(buf, 0, sizeof(*buf));
+            return NULL;
+        }
+        memcpy(str, buf->content, buf->use);
+        str[buf->use] = '\0';
+    } else {
+        str = buf->content;
+    }
     memset(buf, 0, sizeof(*buf));
     return str;
 }
@@ -36,7 +36,7 @@ typedef struct _virBuffer virBuffer;
 typedef virBuffer *virBufferPtr;
 
 # ifndef __VIR_BUFFER_C__
-#  define VIR_BUFFER_INITIALIZER { 0, 0, 0, 0, NULL }
+#  define VIR_BUFFER_INITIALIZER { 0, 0, 0, 0, NULL, "" }
 
 /* This struct must be kept in sync with the real struct
    in the buf.c impl file */
@@ -46,6 +46,7 @@ struct _virBuffer {
     unsigned int c;
     int d;
     char *e;
+    char f[128];
 };
 # endif
 
@@ -71,6 +72,7 @@ int virBufferCheckErrorInternal(const virBuffer *buf,
     virBufferCheckErrorInternal(buf, VIR_FROM_THIS, __FILE__, __FUNCTION__, \
     __LINE__)
 unsigned int virBufferUse(const virBuffer *buf);
+void virBufferReserve(virBufferPtr buf, unsigned int len);
 void virBufferAdd(virBufferPtr buf, const char *str, int len);
 void virBufferAddBuffer(virBufferPtr buf, virBufferPtr toadd);
 void virBufferAddChar(virBufferPtr buf, char c);
@@ -772,6 +772,76 @@ virCgroupGetBlockDevString(const char *path)
 }
 
 
+/* Return the directory fd for @controller cached by
+ * virCgroupBatchBegin, opening it on first use */
+static int
+virCgroupBatchDirFd(virCgroupPtr group,
+                    int controller)
+{
+    if (group->batchFd[controller] == -1) {
+        char *dirpath = NULL;
+
+        if (virCgroupPathOfController(group, controller, "", &dirpath) < 0)
+            return -1;
+
+        group->batchFd[controller] = open(dirpath, O_RDONLY | O_DIRECTORY);
+        if (group->batchFd[controller] < 0) {
+            virReportSystemError(errno,
+                                 _("Unable to open '%s'"), dirpath);
+            VIR_FREE(dirpath);
+            return -1;
+        }
+        VIR_FREE(dirpath);
+    }
+
+    return group->batchFd[controller];
+}
+
+
+/* Write a parameter relative to the directory fd cached by
+ * virCgroupBatchBegin, opening the fd on first use */
+static int
+virCgroupBatchWrite(virCgroupPtr group,
+                    int controller,
+                    const char *key,
+                    const char *value)
+{
+    int dirfd;
+    int fd = -1;
+    int ret = -1;
+
+    if ((dirfd = virCgroupBatchDirFd(group, controller)) < 0)
+        return -1;
+
+    VIR_DEBUG("Set value '%s/%s' to '%s'",
+              virCgroupControllerTypeToString(controller), key, value);
+
+    if ((fd = openat(dirfd, key, O_WRONLY)) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to write to '%s'"), key);
+        return -1;
+    }
+
+    if (safewrite(fd, value, strlen(value)) < 0) {
+        if (errno == EINVAL) {
+            virReportSystemError(errno,
+                                 _("Invalid value '%s' for '%s'"),
+                                 value, key);
+            goto cleanup;
+        }
+        virReportSystemError(errno,
+                             _("Unable to write to '%s'"), key);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    return ret;
+}
+
+
 static int
 virCgroupSetValueStr(virCgroupPtr group,
                      int controller,
@@ -782,6 +852,10 @@ virCgroupSetValueStr(virCgroupPtr group,
     char *keypath = NULL;
     char *tmp = NULL;
 
+    if (group->batching &&
+        controller >= 0 && controller < VIR_CGROUP_CONTROLLER_LAST)
+        return virCgroupBatchWrite(group, controller, key, value);
+
     if (virCgroupPathOfController(group, controller, key, &keypath) < 0)
         return -1;
 
@@ -807,6 +881,50 @@ virCgroupSetValueStr(virCgroupPtr group,
 }
 
 
+/* Read a parameter relative to the directory fd cached by
+ * virCgroupBatchBegin, opening the fd on first use */
+static int
+virCgroupBatchRead(virCgroupPtr group,
+                   int controller,
+                   const char *key,
+                   char **value)
+{
+    int dirfd;
+    int fd = -1;
+    int ret = -1, rc;
+
+    *value = NULL;
+
+    if ((dirfd = virCgroupBatchDirFd(group, controller)) < 0)
+        return -1;
+
+    VIR_DEBUG("Get value '%s/%s'",
+              virCgroupControllerTypeToString(controller), key);
+
+    if ((fd = openat(dirfd, key, O_RDONLY)) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to read from '%s'"), key);
+        return -1;
+    }
+
+    if ((rc = virFileReadHeaderFD(fd, 1024*1024, value)) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to read from '%s'"), key);
+        goto cleanup;
+    }
+
+    /* Terminated with '\n' has sometimes harmful effects to the caller */
+    if (rc > 0 && (*value)[rc - 1] == '\n')
+        (*value)[rc - 1] = '\0';
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    return ret;
+}
+
+
 static int
 virCgroupGetValueStr(virCgroupPtr group,
                      int controller,
@@ -818,6 +936,10 @@ virCgroupGetValueStr(virCgroupPtr group,
 
     *value = NULL;
 
+    if (group->batching &&
+        controller >= 0 && controller < VIR_CGROUP_CONTROLLER_LAST)
+        return virCgroupBatchRead(group, controller, key, value);
+
     if (virCgroupPathOfController(group, controller, key, &keypath) < 0)
         return -1;
 
@@ -850,26 +972,37 @@ virCgroupGetValueForBlkDev(virCgroupPtr group,
 {
     char *prefix = NULL;
     char *str = NULL;
-    char **lines = NULL;
+    const char *cur;
+    virStringToken line;
+    size_t prefixlen;
     int ret = -1;
 
+    *value = NULL;
+
     if (virCgroupGetValueStr(group, controller, key, &str) < 0)
         goto error;
 
     if (!(prefix = virCgroupGetBlockDevString(path)))
         goto error;
 
-    if (!(lines = virStringSplit(str, "\n", -1)))
-        goto error;
-
-    if (VIR_STRDUP(*value, virStringGetFirstWithPrefix(lines, prefix)) < 0)
-        goto error;
+    /* walk the lines in place rather than strduping every line of the
+     * file just to find the one matching device */
+    prefixlen = strlen(prefix);
+    cur = str;
+    while (virStringTokenNext(&cur, '\n', &line)) {
+        if (line.len >= prefixlen &&
+            memcmp(line.start, prefix, prefixlen) == 0) {
+            if (VIR_STRNDUP(*value, line.start + prefixlen,
+                            line.len - prefixlen) < 0)
+                goto error;
+            break;
+        }
+    }
 
     ret = 0;
  error:
     VIR_FREE(str);
     VIR_FREE(prefix);
-    virStringFreeList(lines);
     return ret;
 }
 
@@ -1746,6 +1879,52 @@ virCgroupNewIgnoreError(void)
 }
 
 
+/**
+ * virCgroupBatchBegin:
+ *
+ * @group: The group to switch to batched parameter access
+ *
+ * Make subsequent parameter reads and writes for @group go through a
+ * cached directory fd per controller, cutting the per-access path
+ * construction and traversal.  Intended to bracket bursts such as
+ * initial VM cgroup setup or a stats sweep; must be paired with
+ * virCgroupBatchEnd.
+ */
+void
+virCgroupBatchBegin(virCgroupPtr group)
+{
+    size_t i;
+
+    if (!group || group->batching)
+        return;
+
+    for (i = 0; i < VIR_CGROUP_CONTROLLER_LAST; i++)
+        group->batchFd[i] = -1;
+    group->batching = true;
+}
+
+
+/**
+ * virCgroupBatchEnd:
+ *
+ * @group: The group to switch back to plain parameter writes
+ *
+ * Close the directory fds cached since virCgroupBatchBegin.
+ */
+void
+virCgroupBatchEnd(virCgroupPtr group)
+{
+    size_t i;
+
+    if (!group || !group->batching)
+        return;
+
+    for (i = 0; i < VIR_CGROUP_CONTROLLER_LAST; i++)
+        VIR_FORCE_CLOSE(group->batchFd[i]);
+    group->batching = false;
+}
+
+
 /**
  * virCgroupFree:
  *
@@ -1759,6 +1938,8 @@ virCgroupFree(virCgroupPtr *group)
     if (*group == NULL)
         return;
 
+    virCgroupBatchEnd(*group);
+
     for (i = 0; i < VIR_CGROUP_CONTROLLER_LAST; i++) {
         VIR_FREE((*group)->controllers[i].mountPoint);
         VIR_FREE((*group)->controllers[i].linkPoint);
@@ -4188,6 +4369,20 @@ virCgroupFree(virCgroupPtr *group ATTRIBUTE_UNUSED)
 }
 
 
+void
+virCgroupBatchBegin(virCgroupPtr group ATTRIBUTE_UNUSED)
+{
+    /* Nothing to batch when cgroups are unsupported */
+}
+
+
+void
+virCgroupBatchEnd(virCgroupPtr group ATTRIBUTE_UNUSED)
+{
+    /* Nothing to batch when cgroups are unsupported */
+}
+
+
 bool
 virCgroupHasController(virCgroupPtr cgroup ATTRIBUTE_UNUSED,
                        int controller ATTRIBUTE_UNUSED)
@@ -124,6 +124,9 @@ bool virCgroupNewIgnoreError(void);
 
 void virCgroupFree(virCgroupPtr *group);
 
+void virCgroupBatchBegin(virCgroupPtr group);
+void virCgroupBatchEnd(virCgroupPtr group);
+
 bool virCgroupHasController(virCgroupPtr cgroup, int controller);
 int virCgroupPathOfController(virCgroupPtr group,
                               int controller,
@@ -46,6 +46,13 @@ struct virCgroup {
     char *path;
 
     struct virCgroupController controllers[VIR_CGROUP_CONTROLLER_LAST];
+
+    /* Batch mode set up by virCgroupBatchBegin: parameter writes go via
+     * openat() relative to a cached directory fd per controller instead
+     * of constructing and traversing the full path for each write
+     */
+    bool batching;
+    int batchFd[VIR_CGROUP_CONTROLLER_LAST];
 };
 
 int virCgroupDetectMountsFromFile(virCgroupPtr group,
@@ -28,6 +28,7 @@
 #include "virclosecallbacks.h"
 #include "virlog.h"
 #include "virobject.h"
+#include "virstring.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -40,11 +41,26 @@ struct _virDriverCloseDef {
     virCloseCallback cb;
 };
 
+typedef struct _virCloseCallbacksConnIndex virCloseCallbacksConnIndex;
+typedef virCloseCallbacksConnIndex *virCloseCallbacksConnIndexPtr;
+struct _virCloseCallbacksConnIndex {
+    virConnectPtr conn;
+    char **uuids;       /* UUID strings registered by @conn */
+    size_t nuuids;
+};
+
 struct _virCloseCallbacks {
     virObjectLockable parent;
 
     /* UUID string to qemuDriverCloseDef mapping */
     virHashTablePtr list;
+
+    /* Index of registrations per connection, so that a connection
+     * close only has to visit its own entries instead of walking the
+     * whole table. Only connections with callbacks registered appear
+     * here, which is a handful at most. */
+    virCloseCallbacksConnIndexPtr conns;
+    size_t nconns;
 };
 
 
@@ -91,10 +107,95 @@ static void
 virCloseCallbacksDispose(void *obj)
 {
     virCloseCallbacksPtr closeCallbacks = obj;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < closeCallbacks->nconns; i++) {
+        for (j = 0; j < closeCallbacks->conns[i].nuuids; j++)
+            VIR_FREE(closeCallbacks->conns[i].uuids[j]);
+        VIR_FREE(closeCallbacks->conns[i].uuids);
+    }
+    VIR_FREE(closeCallbacks->conns);
 
     virHashFree(closeCallbacks->list);
 }
 
+/* Add @uuidstr to the index entry of @conn, creating the entry if
+ * @conn has no registrations yet. Caller holds the object lock. */
+static int
+virCloseCallbacksConnIndexAdd(virCloseCallbacksPtr closeCallbacks,
+                              virConnectPtr conn,
+                              const char *uuidstr)
+{
+    virCloseCallbacksConnIndexPtr entry = NULL;
+    char *uuidcpy = NULL;
+    size_t i;
+
+    if (VIR_STRDUP(uuidcpy, uuidstr) < 0)
+        return -1;
+
+    for (i = 0; i < closeCallbacks->nconns; i++) {
+        if (closeCallbacks->conns[i].conn == conn) {
+            entry = &closeCallbacks->conns[i];
+            break;
+        }
+    }
+
+    if (!entry) {
+        if (VIR_EXPAND_N(closeCallbacks->conns, closeCallbacks->nconns, 1) < 0) {
+            VIR_FREE(uuidcpy);
+            return -1;
+        }
+        entry = &closeCallbacks->conns[closeCallbacks->nconns - 1];
+        entry->conn = conn;
+    }
+
+    if (VIR_APPEND_ELEMENT(entry->uuids, entry->nuuids, uuidcpy) < 0) {
+        VIR_FREE(uuidcpy);
+        if (entry->nuuids == 0)
+            VIR_DELETE_ELEMENT(closeCallbacks->conns,
+                               entry - closeCallbacks->conns,
+                               closeCallbacks->nconns);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Drop @uuidstr from the index entry of @conn; the entry itself is
+ * removed once it runs empty. Caller holds the object lock. */
+static void
+virCloseCallbacksConnIndexRemove(virCloseCallbacksPtr closeCallbacks,
+                                 virConnectPtr conn,
+                                 const char *uuidstr)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < closeCallbacks->nconns; i++) {
+        virCloseCallbacksConnIndexPtr entry = &closeCallbacks->conns[i];
+
+        if (entry->conn != conn)
+            continue;
+
+        for (j = 0; j < entry->nuuids; j++) {
+            if (STRNEQ(entry->uuids[j], uuidstr))
+                continue;
+
+            VIR_FREE(entry->uuids[j]);
+            VIR_DELETE_ELEMENT(entry->uuids, j, entry->nuuids);
+            break;
+        }
+
+        if (entry->nuuids == 0) {
+            VIR_FREE(entry->uuids);
+            VIR_DELETE_ELEMENT(closeCallbacks->conns, i,
+                               closeCallbacks->nconns);
+        }
+        return;
+    }
+}
+
 int
 virCloseCallbacksSet(virCloseCallbacksPtr closeCallbacks,
                      virDomainObjPtr vm,
@@ -138,6 +239,10 @@ virCloseCallbacksSet(virCloseCallbacksPtr closeCallbacks,
             VIR_FREE(closeDef);
             goto cleanup;
         }
+        if (virCloseCallbacksConnIndexAdd(closeCallbacks, conn, uuidstr) < 0) {
+            virHashRemoveEntry(closeCallbacks->list, uuidstr);
+            goto cleanup;
+        }
         virObjectRef(vm);
     }
 
@@ -174,6 +279,8 @@ virCloseCallbacksUnset(virCloseCallbacksPtr closeCallbacks,
         goto cleanup;
     }
 
+    virCloseCallbacksConnIndexRemove(closeCallbacks, closeDef->conn, uuidstr);
+
     if (virHashRemoveEntry(closeCallbacks->list, uuidstr) < 0)
         goto cleanup;
 
@@ -249,66 +356,56 @@ struct _virCloseCallbacksList {
     virCloseCallbacksListEntryPtr entries;
 };
 
-struct virCloseCallbacksData {
-    virConnectPtr conn;
-    virCloseCallbacksListPtr list;
-    bool oom;
-};
-
-static int
-virCloseCallbacksGetOne(void *payload,
-                        const void *key,
-                        void *opaque)
-{
-    struct virCloseCallbacksData *data = opaque;
-    virDriverCloseDefPtr closeDef = payload;
-    const char *uuidstr = key;
-    unsigned char uuid[VIR_UUID_BUFLEN];
-
-    if (virUUIDParse(uuidstr, uuid) < 0)
-        return 0;
-
-    VIR_DEBUG("conn=%p, thisconn=%p, uuid=%s, cb=%p",
-              closeDef->conn, data->conn, uuidstr, closeDef->cb);
-
-    if (data->conn != closeDef->conn || !closeDef->cb)
-        return 0;
-
-    if (VIR_EXPAND_N(data->list->entries,
-                     data->list->nentries, 1) < 0) {
-        data->oom = true;
-        return 0;
-    }
-
-    memcpy(data->list->entries[data->list->nentries - 1].uuid,
-           uuid, VIR_UUID_BUFLEN);
-    data->list->entries[data->list->nentries - 1].callback = closeDef->cb;
-    return 0;
-}
-
 static virCloseCallbacksListPtr
 virCloseCallbacksGetForConn(virCloseCallbacksPtr closeCallbacks,
                             virConnectPtr conn)
 {
     virCloseCallbacksListPtr list = NULL;
-    struct virCloseCallbacksData data;
+    virCloseCallbacksConnIndexPtr entry = NULL;
+    size_t i;
 
     if (VIR_ALLOC(list) < 0)
         return NULL;
 
-    data.conn = conn;
-    data.list = list;
-    data.oom = false;
+    /* connections without registered callbacks aren't indexed, so
+     * their close doesn't pay for anybody else's registrations */
+    for (i = 0; i < closeCallbacks->nconns; i++) {
+        if (closeCallbacks->conns[i].conn == conn) {
+            entry = &closeCallbacks->conns[i];
+            break;
+        }
+    }
 
-    virHashForEach(closeCallbacks->list, virCloseCallbacksGetOne, &data);
+    if (!entry)
+        return list;
 
-    if (data.oom) {
-        VIR_FREE(list->entries);
+    if (VIR_ALLOC_N(list->entries, entry->nuuids) < 0) {
         VIR_FREE(list);
-        virReportOOMError();
         return NULL;
     }
 
+    for (i = 0; i < entry->nuuids; i++) {
+        virDriverCloseDefPtr closeDef;
+        unsigned char uuid[VIR_UUID_BUFLEN];
+
+        if (virUUIDParse(entry->uuids[i], uuid) < 0)
+            continue;
+
+        if (!(closeDef = virHashLookup(closeCallbacks->list,
+                                       entry->uuids[i])))
+            continue;
+
+        VIR_DEBUG("conn=%p, uuid=%s, cb=%p",
+                  conn, entry->uuids[i], closeDef->cb);
+
+        if (!closeDef->cb)
+            continue;
+
+        memcpy(list->entries[list->nentries].uuid, uuid, VIR_UUID_BUFLEN);
+        list->entries[list->nentries].callback = closeDef->cb;
+        list->nentries++;
+    }
+
     return list;
 }
 
@@ -331,12 +428,15 @@ virCloseCallbacksRun(virCloseCallbacksPtr closeCallbacks,
 
     virObjectLock(closeCallbacks);
     list = virCloseCallbacksGetForConn(closeCallbacks, conn);
-    if (!list)
+    if (!list) {
+        virObjectUnlock(closeCallbacks);
         return;
+    }
 
     for (i = 0; i < list->nentries; i++) {
         char uuidstr[VIR_UUID_STRING_BUFLEN];
         virUUIDFormat(list->entries[i].uuid, uuidstr);
+        virCloseCallbacksConnIndexRemove(closeCallbacks, conn, uuidstr);
         virHashRemoveEntry(closeCallbacks->list, uuidstr);
     }
     virObjectUnlock(closeCallbacks);
@@ -45,6 +45,7 @@
 #define __VIR_COMMAND_PRIV_H_ALLOW__
 #include "vircommandpriv.h"
 #include "viralloc.h"
+#include "virbitmap.h"
 #include "virerror.h"
 #include "virutil.h"
 #include "virlog.h"
@@ -315,14 +316,16 @@ virFork(void)
         return -1;
     }
 
-    /* Ensure we hold the logging lock, to protect child processes
+    /* Ensure we hold the logging locks, to protect child processes
      * from deadlocking on another thread's inherited mutex state */
     virLogLock();
+    virLogAsyncForkLock();
 
     pid = fork();
     saved_errno = errno; /* save for caller */
 
     /* Unlock for both parent and child process */
+    virLogAsyncForkUnlock();
     virLogUnlock();
 
     if (pid < 0) {
@@ -354,6 +357,10 @@ virFork(void)
         virSetErrorFunc(NULL, NULL);
         virSetErrorLogPriorityFunc(NULL);
 
+        /* The async log writer thread did not survive the fork; drop
+         * the inherited state before virLogReset tries to flush it */
+        virLogAsyncForkReset();
+
         /* Make sure any hook logging is sent to stderr, since child
          * process may close the logfile FDs */
         logprio = virLogGetDefaultPriority();
@@ -404,6 +411,111 @@ getDevNull(int *null)
     return 0;
 }
 
+# ifdef __linux__
+/* On Linux, read the table of opened fds from procfs rather than
+ * iterating over every possible fd up to the rlimit; with raised fd
+ * limits the full walk costs milliseconds per spawn while only a
+ * handful of fds are actually open */
+static int
+virCommandMassCloseGetFDsLinux(virBitmapPtr fds)
+{
+    DIR *dp = NULL;
+    struct dirent *entry;
+    const char *dirName = "/proc/self/fd";
+    int rc;
+    int ret = -1;
+
+    if (virDirOpen(&dp, dirName) < 0)
+        return -1;
+
+    while ((rc = virDirRead(dp, &entry, dirName)) > 0) {
+        int fd;
+
+        if (virStrToLong_i(entry->d_name, NULL, 10, &fd) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("unable to parse FD: %s"),
+                           entry->d_name);
+            goto cleanup;
+        }
+
+        ignore_value(virBitmapSetBit(fds, fd));
+    }
+
+    if (rc < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_DIR_CLOSE(dp);
+    return ret;
+}
+
+# else /* !__linux__ */
+
+static int
+virCommandMassCloseGetFDsGeneric(virBitmapPtr fds)
+{
+    virBitmapSetAll(fds);
+    return 0;
+}
+# endif /* !__linux__ */
+
+static int
+virCommandMassClose(virCommandPtr cmd,
+                    int childin,
+                    int childout,
+                    int childerr)
+{
+    virBitmapPtr fds = NULL;
+    int openmax = sysconf(_SC_OPEN_MAX);
+    ssize_t fd = -1;
+    int ret = -1;
+
+    /* In general, it is not safe to call malloc() between fork() and
+     * exec() because another thread in the parent might have held the
+     * malloc lock at the worst possible time. But this runs via
+     * virFork() from a controlled point, and the error reporting and
+     * logging calls the child makes below allocate already, so one
+     * more allocation does not change the situation. */
+
+    if (openmax < 0) {
+        virReportSystemError(errno, "%s",
+                             _("sysconf(_SC_OPEN_MAX) failed"));
+        return -1;
+    }
+
+    if (!(fds = virBitmapNew(openmax)))
+        return -1;
+
+# ifdef __linux__
+    if (virCommandMassCloseGetFDsLinux(fds) < 0)
+        goto cleanup;
+# else
+    if (virCommandMassCloseGetFDsGeneric(fds) < 0)
+        goto cleanup;
+# endif
+
+    for (fd = virBitmapNextSetBit(fds, 2);
+         fd >= 0;
+         fd = virBitmapNextSetBit(fds, fd)) {
+        if (fd == childin || fd == childout || fd == childerr)
+            continue;
+        if (!virCommandFDIsSet(cmd, fd)) {
+            int tmpfd = fd;
+            VIR_MASS_CLOSE(tmpfd);
+        } else if (virSetInherit(fd, true) < 0) {
+            virReportSystemError(errno, _("failed to preserve fd %zd"), fd);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    virBitmapFree(fds);
+    return ret;
+}
+
+
 /* Ensure that STD is an inheritable copy of FD.  Return 0 on success,
  * -1 on failure.  */
 static int
@@ -473,13 +585,12 @@ static int
 virExec(virCommandPtr cmd)
 {
     pid_t pid;
-    int null = -1, fd, openmax;
+    int null = -1;
     int pipeout[2] = {-1, -1};
     int pipeerr[2] = {-1, -1};
     int childin = cmd->infd;
     int childout = -1;
     int childerr = -1;
-    int tmpfd;
     char *binarystr = NULL;
     const char *binary = NULL;
     int ret;
@@ -588,23 +699,9 @@ virExec(virCommandPtr cmd)
     if (cmd->mask)
         umask(cmd->mask);
     ret = EXIT_CANCELED;
-    openmax = sysconf(_SC_OPEN_MAX);
-    if (openmax < 0) {
-        virReportSystemError(errno,  "%s",
-                             _("sysconf(_SC_OPEN_MAX) failed"));
+
+    if (virCommandMassClose(cmd, childin, childout, childerr) < 0)
         goto fork_error;
-    }
-    for (fd = 3; fd < openmax; fd++) {
-        if (fd == childin || fd == childout || fd == childerr)
-            continue;
-        if (!virCommandFDIsSet(cmd, fd)) {
-            tmpfd = fd;
-            VIR_MASS_CLOSE(tmpfd);
-        } else if (virSetInherit(fd, true) < 0) {
-            virReportSystemError(errno, _("failed to preserve fd %d"), fd);
-            goto fork_error;
-        }
-    }
 
     if (prepareStdFd(childin, STDIN_FILENO) < 0) {
         virReportSystemError(errno,
@@ -37,6 +37,7 @@
 #include "virlog.h"
 #include "viralloc.h"
 #include "virfile.h"
+#include "virhash.h"
 #include "virstring.h"
 #include "configmake.h"
 
@@ -102,6 +103,11 @@ struct _virConf {
     char *filename;
     unsigned int flags;
     virConfEntryPtr entries;
+    /* Maps entry names to the first virConfEntryPtr of that name so
+     * lookups need not walk the whole entry list.  NULL for formats
+     * with case-insensitive settings (VMX) and after an indexing
+     * failure, in which case lookups fall back to the list walk */
+    virHashTablePtr index;
 };
 
 /**
@@ -188,9 +194,39 @@ virConfNew(void)
     ret->filename = NULL;
     ret->flags = 0;
 
+    /* Failing to allocate the index is not fatal, lookups simply
+     * degrade to walking the entry list */
+    ret->index = virHashCreate(10, NULL);
+    virResetLastError();
+
     return ret;
 }
 
+/**
+ * virConfIndexEntry:
+ * @conf: the conf structure
+ * @entry: a named entry that was just linked into @conf
+ *
+ * Record @entry in the lookup index. Keeps the first entry of a given
+ * name, matching what a list walk would find. Any failure drops the
+ * index altogether so it can never disagree with the entry list.
+ */
+static void
+virConfIndexEntry(virConfPtr conf, virConfEntryPtr entry)
+{
+    if (!conf->index || !entry->name)
+        return;
+
+    if (virHashLookup(conf->index, entry->name))
+        return;
+
+    if (virHashAddEntry(conf->index, entry->name, entry) < 0) {
+        virResetLastError();
+        virHashFree(conf->index);
+        conf->index = NULL;
+    }
+}
+
 /**
  * virConfCreate:
  * @filename: the name to report errors
@@ -208,11 +244,18 @@ virConfCreate(const char *filename, unsigned int flags)
         return NULL;
 
     if (VIR_STRDUP(ret->filename, filename) < 0) {
+        virHashFree(ret->index);
         VIR_FREE(ret);
         return NULL;
     }
 
     ret->flags = flags;
+    if (flags & VIR_CONF_FLAG_VMX_FORMAT) {
+        /* VMX settings compare case-insensitively, which the index
+         * cannot honour */
+        virHashFree(ret->index);
+        ret->index = NULL;
+    }
     return ret;
 }
 
@@ -254,6 +297,8 @@ virConfAddEntry(virConfPtr conf, char *name, virConfValuePtr value, char *comm)
             prev = prev->next;
         prev->next = ret;
     }
+
+    virConfIndexEntry(conf, ret);
     return ret;
 }
 
@@ -851,6 +896,7 @@ virConfFree(virConfPtr conf)
         VIR_FREE(tmp);
         tmp = next;
     }
+    virHashFree(conf->index);
     VIR_FREE(conf->filename);
     VIR_FREE(conf);
     return 0;
@@ -874,6 +920,12 @@ virConfGetValue(virConfPtr conf, const char *setting)
     if (conf == NULL)
         return NULL;
 
+    if (conf->index) {
+        if (!(cur = virHashLookup(conf->index, setting)))
+            return NULL;
+        return cur->value;
+    }
+
     cur = conf->entries;
     while (cur != NULL) {
         if ((cur->name != NULL) &&
@@ -1426,6 +1478,7 @@ virConfSetValue(virConfPtr conf,
             cur->next = conf->entries;
             conf->entries = cur;
         }
+        virConfIndexEntry(conf, cur);
     } else {
         virConfFreeValue(cur->value);
         cur->value = value;
@@ -49,37 +49,61 @@ struct virHashInfo {
     { sha256_buffer, SHA256_DIGEST_SIZE },
 };
 
-#define VIR_CRYPTO_LARGEST_DIGEST_SIZE SHA256_DIGEST_SIZE
+verify(VIR_CRYPTO_LARGEST_DIGEST_SIZE == SHA256_DIGEST_SIZE);
 
 verify(ARRAY_CARDINALITY(hashinfo) == VIR_CRYPTO_HASH_LAST);
 
-int
-virCryptoHashString(virCryptoHash hash,
-                    const char *input,
-                    char **output)
+/**
+ * virCryptoHashBuf:
+ * @hash: the hash algorithm to use
+ * @input: the data to hash
+ * @len: length of @input in bytes
+ * @output: buffer of at least VIR_CRYPTO_LARGEST_DIGEST_SIZE bytes
+ *          to hold the raw digest
+ *
+ * Computes the digest of @input straight into a caller provided
+ * buffer, so callers hashing many items in a row avoid one heap
+ * allocation and strlen per item.
+ *
+ * Returns the digest length on success, -1 on error.
+ */
+ssize_t
+virCryptoHashBuf(virCryptoHash hash,
+                 const char *input,
+                 size_t len,
+                 unsigned char *output)
 {
-    unsigned char buf[VIR_CRYPTO_LARGEST_DIGEST_SIZE];
-    size_t hashstrlen;
-    size_t i;
-
     if (hash >= VIR_CRYPTO_HASH_LAST) {
         virReportError(VIR_ERR_INVALID_ARG,
                        _("Unknown crypto hash %d"), hash);
         return -1;
     }
 
-    hashstrlen = (hashinfo[hash].hashlen * 2) + 1;
-
-    if (!(hashinfo[hash].func(input, strlen(input), buf))) {
+    if (!(hashinfo[hash].func(input, len, output))) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Unable to compute hash of data"));
         return -1;
     }
 
-    if (VIR_ALLOC_N(*output, hashstrlen) < 0)
+    return hashinfo[hash].hashlen;
+}
+
+int
+virCryptoHashString(virCryptoHash hash,
+                    const char *input,
+                    char **output)
+{
+    unsigned char buf[VIR_CRYPTO_LARGEST_DIGEST_SIZE];
+    ssize_t hashlen;
+    size_t i;
+
+    if ((hashlen = virCryptoHashBuf(hash, input, strlen(input), buf)) < 0)
+        return -1;
+
+    if (VIR_ALLOC_N(*output, (hashlen * 2) + 1) < 0)
         return -1;
 
-    for (i = 0; i < hashinfo[hash].hashlen; i++) {
+    for (i = 0; i < (size_t)hashlen; i++) {
         (*output)[i * 2] = hex[(buf[i] >> 4) & 0xf];
         (*output)[(i * 2) + 1] = hex[buf[i] & 0xf];
     }
@@ -151,17 +175,14 @@ virCryptoEncryptDataAESgnutls(gnutls_cipher_algorithm_t gnutls_enc_alg,
     gnutls_datum_t iv_buf;
     uint8_t *ciphertext;
     size_t ciphertextlen;
+# ifdef HAVE_GNUTLS_CIPHER_ENCRYPT2
+    size_t bulklen;
+    uint8_t lastblock[16];
+# endif
 
-    /* Allocate a padded buffer, copy in the data */
     ciphertextlen = VIR_ROUND_UP(datalen, 16);
     if (VIR_ALLOC_N(ciphertext, ciphertextlen) < 0)
         return -1;
-    memcpy(ciphertext, data, datalen);
-
-     /* Fill in the padding of the buffer with the size of the padding
-      * which is required for decryption. */
-    for (i = datalen; i < ciphertextlen; i++)
-        ciphertext[i] = ciphertextlen - datalen;
 
     /* Initialize the gnutls cipher */
     enc_key.size = enckeylen;
@@ -178,8 +199,35 @@ virCryptoEncryptDataAESgnutls(gnutls_cipher_algorithm_t gnutls_enc_alg,
         goto error;
     }
 
-    /* Encrypt the data and free the memory for cipher operations */
+# ifdef HAVE_GNUTLS_CIPHER_ENCRYPT2
+    /* Encrypt the aligned bulk of the data straight out of the
+     * caller's buffer; only the final block needs to be staged so
+     * the padding can be appended. The padding bytes hold the size
+     * of the padding, which is required for decryption. */
+    bulklen = datalen & ~(size_t)0xf;
+
+    rc = gnutls_cipher_encrypt2(handle, data, bulklen,
+                                ciphertext, bulklen);
+
+    if (rc >= 0 && bulklen < ciphertextlen) {
+        memcpy(lastblock, data + bulklen, datalen - bulklen);
+        for (i = datalen - bulklen; i < sizeof(lastblock); i++)
+            lastblock[i] = ciphertextlen - datalen;
+
+        rc = gnutls_cipher_encrypt2(handle, lastblock, sizeof(lastblock),
+                                    ciphertext + bulklen,
+                                    ciphertextlen - bulklen);
+        memset(lastblock, 0, sizeof(lastblock));
+    }
+# else
+    /* Copy the data into the padded buffer and encrypt in place */
+    memcpy(ciphertext, data, datalen);
+
+    for (i = datalen; i < ciphertextlen; i++)
+        ciphertext[i] = ciphertextlen - datalen;
+
     rc = gnutls_cipher_encrypt(handle, ciphertext, ciphertextlen);
+# endif
     gnutls_cipher_deinit(handle);
     memset(&enc_key, 0, sizeof(gnutls_datum_t));
     memset(&iv_buf, 0, sizeof(gnutls_datum_t));
@@ -38,6 +38,17 @@ typedef enum {
     VIR_CRYPTO_CIPHER_LAST
 } virCryptoCipher;
 
+/* Length of the longest digest we can produce (SHA256) */
+# define VIR_CRYPTO_LARGEST_DIGEST_SIZE 32
+
+ssize_t
+virCryptoHashBuf(virCryptoHash hash,
+                 const char *input,
+                 size_t len,
+                 unsigned char *output)
+    ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(4)
+    ATTRIBUTE_RETURN_CHECK;
+
 int
 virCryptoHashString(virCryptoHash hash,
                     const char *input,
@@ -52,12 +52,14 @@
 VIR_LOG_INIT("util.dnsmasq");
 
 #define DNSMASQ_HOSTSFILE_SUFFIX "hostsfile"
+#define DNSMASQ_HOSTSDIR_SUFFIX "hostsdir"
 #define DNSMASQ_ADDNHOSTSFILE_SUFFIX "addnhosts"
 
 static void
 dhcphostFree(dnsmasqDhcpHost *host)
 {
     VIR_FREE(host->host);
+    VIR_FREE(host->file);
 }
 
 static void
@@ -173,20 +175,31 @@ addnhostsNew(const char *name,
     return NULL;
 }
 
+/*
+ * Write @content to @path unless the file already contains exactly
+ * @content, so that no-op saves neither bump the file's mtime nor
+ * require a daemon reload.
+ *
+ * Returns 0 if the file was already up to date, 1 if it was written,
+ * a negative errno value on failure.
+ */
 static int
-addnhostsWrite(const char *path,
-               dnsmasqAddnHost *hosts,
-               unsigned int nhosts)
+dnsmasqFileWrite(const char *path,
+                 const char *content)
 {
-    char *tmp;
+    char *existing = NULL;
+    char *tmp = NULL;
     FILE *f;
     bool istmp = true;
-    size_t i, j;
+    int len = strlen(content);
     int rc = 0;
 
-    /* even if there are 0 hosts, create a 0 length file, to allow
-     * for runtime addition.
-     */
+    if (virFileReadAllQuiet(path, len + 1, &existing) == len &&
+        STREQ(existing, content)) {
+        VIR_FREE(existing);
+        return 0;
+    }
+    VIR_FREE(existing);
 
     if (virAsprintf(&tmp, "%s.new", path) < 0)
         return -ENOMEM;
@@ -199,38 +212,14 @@ addnhostsWrite(const char *path,
         }
     }
 
-    for (i = 0; i < nhosts; i++) {
-        if (fputs(hosts[i].ip, f) == EOF || fputc('\t', f) == EOF) {
-            rc = -errno;
-            VIR_FORCE_FCLOSE(f);
-
-            if (istmp)
-                unlink(tmp);
-
-            goto cleanup;
-        }
-
-        for (j = 0; j < hosts[i].nhostnames; j++) {
-            if (fputs(hosts[i].hostnames[j], f) == EOF || fputc('\t', f) == EOF) {
-                rc = -errno;
-                VIR_FORCE_FCLOSE(f);
-
-                if (istmp)
-                    unlink(tmp);
-
-                goto cleanup;
-            }
-        }
-
-        if (fputc('\n', f) == EOF) {
-            rc = -errno;
-            VIR_FORCE_FCLOSE(f);
+    if (fputs(content, f) == EOF) {
+        rc = -errno;
+        VIR_FORCE_FCLOSE(f);
 
-            if (istmp)
-                unlink(tmp);
+        if (istmp)
+            unlink(tmp);
 
-            goto cleanup;
-        }
+        goto cleanup;
     }
 
     if (VIR_FCLOSE(f) == EOF) {
@@ -244,24 +233,60 @@ addnhostsWrite(const char *path,
         goto cleanup;
     }
 
+    rc = 1;
+
  cleanup:
     VIR_FREE(tmp);
 
     return rc;
 }
 
+static int
+addnhostsWrite(const char *path,
+               dnsmasqAddnHost *hosts,
+               unsigned int nhosts)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i, j;
+    int rc;
+
+    /* even if there are 0 hosts, create a 0 length file, to allow
+     * for runtime addition.
+     */
+
+    for (i = 0; i < nhosts; i++) {
+        virBufferAsprintf(&buf, "%s\t", hosts[i].ip);
+        for (j = 0; j < hosts[i].nhostnames; j++)
+            virBufferAsprintf(&buf, "%s\t", hosts[i].hostnames[j]);
+        virBufferAddChar(&buf, '\n');
+    }
+
+    if (virBufferError(&buf)) {
+        virBufferFreeAndReset(&buf);
+        return -ENOMEM;
+    }
+
+    rc = dnsmasqFileWrite(path, virBufferCurrentContent(&buf));
+
+    virBufferFreeAndReset(&buf);
+
+    return rc;
+}
+
 static int
 addnhostsSave(dnsmasqAddnHostsfile *addnhostsfile)
 {
-    int err = addnhostsWrite(addnhostsfile->path, addnhostsfile->hosts,
-                             addnhostsfile->nhosts);
+    int rc = addnhostsWrite(addnhostsfile->path, addnhostsfile->hosts,
+                            addnhostsfile->nhosts);
 
-    if (err < 0) {
-        virReportSystemError(-err, _("cannot write config file '%s'"),
+    if (rc < 0) {
+        virReportSystemError(-rc, _("cannot write config file '%s'"),
                              addnhostsfile->path);
         return -1;
     }
 
+    addnhostsfile->changed = (rc != 0);
+
     return 0;
 }
 
@@ -295,6 +320,7 @@ hostsfileFree(dnsmasqHostsfile *hostsfile)
     }
 
     VIR_FREE(hostsfile->path);
+    VIR_FREE(hostsfile->dir);
 
     VIR_FREE(hostsfile);
 }
@@ -311,6 +337,7 @@ hostsfileAdd(dnsmasqHostsfile *hostsfile,
              bool ipv6)
 {
     char *ipstr = NULL;
+    const char *key;
     if (VIR_REALLOC_N(hostsfile->hosts, hostsfile->nhosts + 1) < 0)
         goto error;
 
@@ -345,6 +372,19 @@ hostsfileAdd(dnsmasqHostsfile *hostsfile,
                         mac, ipstr) < 0)
             goto error;
     }
+
+    /* name of the entry's file below the dhcp-hostsdir; keyed by the
+     * stable part of the entry so that updates overwrite it in place */
+    if (ipv6)
+        key = id ? id : name;
+    else
+        key = mac;
+    if (!key)
+        key = ipstr;
+
+    if (VIR_STRDUP(hostsfile->hosts[hostsfile->nhosts].file, key) < 0)
+        goto error;
+
     VIR_FREE(ipstr);
 
     hostsfile->nhosts++;
@@ -378,6 +418,17 @@ hostsfileNew(const char *name,
 
     if (!(hostsfile->path = virBufferContentAndReset(&buf)))
         goto error;
+
+    virBufferAsprintf(&buf, "%s", config_dir);
+    virBufferEscapeString(&buf, "/%s", name);
+    virBufferAsprintf(&buf, ".%s", DNSMASQ_HOSTSDIR_SUFFIX);
+
+    if (virBufferCheckError(&buf) < 0)
+                goto error;
+
+    if (!(hostsfile->dir = virBufferContentAndReset(&buf)))
+        goto error;
+
     return hostsfile;
 
  error:
@@ -391,61 +442,152 @@ hostsfileWrite(const char *path,
                dnsmasqDhcpHost *hosts,
                unsigned int nhosts)
 {
-    char *tmp;
-    FILE *f;
-    bool istmp = true;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
     size_t i;
-    int rc = 0;
+    int rc;
 
     /* even if there are 0 hosts, create a 0 length file, to allow
      * for runtime addition.
      */
 
-    if (virAsprintf(&tmp, "%s.new", path) < 0)
+    for (i = 0; i < nhosts; i++)
+        virBufferAsprintf(&buf, "%s\n", hosts[i].host);
+
+    if (virBufferError(&buf)) {
+        virBufferFreeAndReset(&buf);
         return -ENOMEM;
+    }
 
-    if (!(f = fopen(tmp, "w"))) {
-        istmp = false;
-        if (!(f = fopen(path, "w"))) {
-            rc = -errno;
+    rc = dnsmasqFileWrite(path, virBufferCurrentContent(&buf));
+
+    virBufferFreeAndReset(&buf);
+
+    return rc < 0 ? rc : 0;
+}
+
+/*
+ * Save the hosts as one file per entry below the dhcp-hostsdir
+ * directory, named after the entry's stable key.  dnsmasq picks up
+ * new and changed files in the directory on its own, so adding or
+ * modifying a single host costs one small file write and no reload;
+ * only removals (flagged in hostsfile->purged) still need a SIGHUP.
+ */
+static int
+hostsfileSaveDir(dnsmasqHostsfile *hostsfile)
+{
+    DIR *dir = NULL;
+    struct dirent *ent;
+    char *path = NULL;
+    char *content = NULL;
+    char *existing = NULL;
+    size_t i;
+    int rc;
+    int ret = -1;
+
+    hostsfile->purged = false;
+
+    if (virFileMakePath(hostsfile->dir) < 0) {
+        virReportSystemError(errno, _("cannot create config directory '%s'"),
+                             hostsfile->dir);
+        return -1;
+    }
+
+    /* remove files belonging to entries that are gone; dnsmasq keeps
+     * the content of a deleted file until the next reload */
+    if (virDirOpen(&dir, hostsfile->dir) < 0)
+        return -1;
+
+    while ((rc = virDirRead(dir, &ent, hostsfile->dir)) > 0) {
+        bool wanted = false;
+
+        for (i = 0; i < hostsfile->nhosts; i++) {
+            if (hostsfile->hosts[i].file &&
+                STREQ(hostsfile->hosts[i].file, ent->d_name)) {
+                wanted = true;
+                break;
+            }
+        }
+
+        if (wanted)
+            continue;
+
+        if (virAsprintf(&path, "%s/%s", hostsfile->dir, ent->d_name) < 0)
+            goto cleanup;
+
+        if (unlink(path) < 0 && errno != ENOENT) {
+            virReportSystemError(errno, _("cannot remove config file '%s'"),
+                                 path);
             goto cleanup;
         }
+
+        hostsfile->purged = true;
+        VIR_FREE(path);
     }
+    if (rc < 0)
+        goto cleanup;
 
-    for (i = 0; i < nhosts; i++) {
-        if (fputs(hosts[i].host, f) == EOF || fputc('\n', f) == EOF) {
-            rc = -errno;
-            VIR_FORCE_FCLOSE(f);
+    for (i = 0; i < hostsfile->nhosts; i++) {
+        int len;
 
-            if (istmp)
-                unlink(tmp);
+        if (!hostsfile->hosts[i].file || !hostsfile->hosts[i].host)
+            continue;
 
+        if (virAsprintf(&path, "%s/%s", hostsfile->dir,
+                        hostsfile->hosts[i].file) < 0 ||
+            virAsprintf(&content, "%s\n", hostsfile->hosts[i].host) < 0)
             goto cleanup;
+
+        /* Write the file in place rather than via a temporary file;
+         * dnsmasq watches the directory and would pick up a visible
+         * temporary file as another hosts file, keeping its content
+         * until the next reload.  Unchanged files are skipped so
+         * dnsmasq is not notified about them at all.
+         */
+        len = strlen(content);
+        if (virFileReadAllQuiet(path, len + 1, &existing) != len ||
+            STRNEQ(existing, content)) {
+            if (virFileWriteStr(path, content, 0644) < 0) {
+                virReportSystemError(errno,
+                                     _("cannot write config file '%s'"),
+                                     path);
+                goto cleanup;
+            }
         }
-    }
 
-    if (VIR_FCLOSE(f) == EOF) {
-        rc = -errno;
-        goto cleanup;
+        VIR_FREE(existing);
+        VIR_FREE(content);
+        VIR_FREE(path);
     }
 
-    if (istmp && rename(tmp, path) < 0) {
-        rc = -errno;
-        unlink(tmp);
+    /* truncate the common hostsfile; the per-host files replace it
+     * and a restarted dnsmasq must not read the entries twice */
+    if ((rc = dnsmasqFileWrite(hostsfile->path, "")) < 0) {
+        virReportSystemError(-rc, _("cannot write config file '%s'"),
+                             hostsfile->path);
         goto cleanup;
     }
 
+    ret = 0;
+
  cleanup:
-    VIR_FREE(tmp);
+    VIR_FREE(existing);
+    VIR_FREE(content);
+    VIR_FREE(path);
+    VIR_DIR_CLOSE(dir);
 
-    return rc;
+    return ret;
 }
 
 static int
 hostsfileSave(dnsmasqHostsfile *hostsfile)
 {
-    int err = hostsfileWrite(hostsfile->path, hostsfile->hosts,
-                             hostsfile->nhosts);
+    int err;
+
+    if (hostsfile->usedir)
+        return hostsfileSaveDir(hostsfile);
+
+    err = hostsfileWrite(hostsfile->path, hostsfile->hosts,
+                         hostsfile->nhosts);
 
     if (err < 0) {
         virReportSystemError(-err, _("cannot write config file '%s'"),
@@ -585,8 +727,12 @@ dnsmasqDelete(const dnsmasqContext *ctx)
 {
     int ret = 0;
 
-    if (ctx->hostsfile)
+    if (ctx->hostsfile) {
         ret = genericFileDelete(ctx->hostsfile->path);
+        if (virFileExists(ctx->hostsfile->dir) &&
+            virFileDeleteTree(ctx->hostsfile->dir) < 0)
+            ret = -1;
+    }
     if (ctx->addnhostsfile)
         ret = genericFileDelete(ctx->addnhostsfile->path);
 
@@ -691,13 +837,18 @@ dnsmasqCapsSetFromBuffer(dnsmasqCapsPtr caps, const char *buf)
     if (strstr(buf, "--ra-param"))
         dnsmasqCapsSet(caps, DNSMASQ_CAPS_RA_PARAM);
 
+    if (strstr(buf, "--dhcp-hostsdir"))
+        dnsmasqCapsSet(caps, DNSMASQ_CAPS_DHCP_HOSTSDIR);
+
     VIR_INFO("dnsmasq version is %d.%d, --bind-dynamic is %spresent, "
-             "SO_BINDTODEVICE is %sin use, --ra-param is %spresent",
+             "SO_BINDTODEVICE is %sin use, --ra-param is %spresent, "
+             "--dhcp-hostsdir is %spresent",
              (int)caps->version / 1000000,
              (int)(caps->version % 1000000) / 1000,
              dnsmasqCapsGet(caps, DNSMASQ_CAPS_BIND_DYNAMIC) ? "" : "NOT ",
              dnsmasqCapsGet(caps, DNSMASQ_CAPS_BINDTODEVICE) ? "" : "NOT ",
-             dnsmasqCapsGet(caps, DNSMASQ_CAPS_RA_PARAM) ? "" : "NOT ");
+             dnsmasqCapsGet(caps, DNSMASQ_CAPS_RA_PARAM) ? "" : "NOT ",
+             dnsmasqCapsGet(caps, DNSMASQ_CAPS_DHCP_HOSTSDIR) ? "" : "NOT ");
     return 0;
 
  fail:
@@ -35,6 +35,13 @@ typedef struct
      */
     char *host;
 
+    /*
+     * Name of the file the entry is saved to below the dhcp-hostsdir
+     * directory; derived from the stable part of the entry (MAC
+     * address, client id or hostname).
+     */
+    char *file;
+
 } dnsmasqDhcpHost;
 
 typedef struct
@@ -42,7 +49,13 @@ typedef struct
     unsigned int     nhosts;
     dnsmasqDhcpHost *hosts;
 
-    char            *path;  /* Absolute path of dnsmasq's hostsfile. */
+    char            *path;   /* Absolute path of dnsmasq's hostsfile. */
+    char            *dir;    /* Absolute path of dnsmasq's dhcp-hostsdir. */
+    bool             usedir; /* Save the hosts as one file each below dir
+                                instead of into the common hostsfile. */
+    bool             purged; /* A stale per-host file was removed during the
+                                last save; dnsmasq needs a SIGHUP to forget
+                                its content. */
 } dnsmasqHostsfile;
 
 typedef struct
@@ -58,7 +71,9 @@ typedef struct
     unsigned int     nhosts;
     dnsmasqAddnHost *hosts;
 
-    char            *path;  /* Absolute path of dnsmasq's hostsfile. */
+    char            *path;    /* Absolute path of dnsmasq's hostsfile. */
+    bool             changed; /* The file's content changed during the
+                                 last save. */
 } dnsmasqAddnHostsfile;
 
 typedef struct
@@ -72,6 +87,7 @@ typedef enum {
    DNSMASQ_CAPS_BIND_DYNAMIC = 0, /* support for --bind-dynamic */
    DNSMASQ_CAPS_BINDTODEVICE = 1, /* uses SO_BINDTODEVICE for --bind-interfaces */
    DNSMASQ_CAPS_RA_PARAM = 2,     /* support for --ra-param */
+   DNSMASQ_CAPS_DHCP_HOSTSDIR = 3, /* support for --dhcp-hostsdir */
 
    DNSMASQ_CAPS_LAST,             /* this must always be the last item */
 } dnsmasqCapsFlags;
@@ -234,18 +234,127 @@ virErrorCopyNew(virErrorPtr err)
 }
 
 
+/* The thread local error object lives inside a larger wrapper that
+ * remembers how big each string allocation is, so raising a new error
+ * can usually reuse the previous buffers instead of paying several
+ * allocations per raise; probe-style code raises and discards errors
+ * in tight loops. A capacity is only trusted while the corresponding
+ * string is non-NULL and nothing outside virRaiseErrorFull replaced
+ * it - every other writer calls virErrorBuffersForget. */
+typedef struct _virErrorBuffers virErrorBuffers;
+typedef virErrorBuffers *virErrorBuffersPtr;
+struct _virErrorBuffers {
+    virError err;               /* must be first, public APIs hand out &err */
+    size_t msgcap;
+    size_t str1cap;
+    size_t str2cap;
+    size_t str3cap;
+};
+
 static virErrorPtr
 virLastErrorObject(void)
 {
-    virErrorPtr err;
-    err = virThreadLocalGet(&virLastErr);
-    if (!err) {
-        if (VIR_ALLOC_QUIET(err) < 0)
+    virErrorBuffersPtr buffers;
+    buffers = virThreadLocalGet(&virLastErr);
+    if (!buffers) {
+        if (VIR_ALLOC_QUIET(buffers) < 0)
             return NULL;
-        if (virThreadLocalSet(&virLastErr, err) < 0)
-            VIR_FREE(err);
+        if (virThreadLocalSet(&virLastErr, buffers) < 0)
+            VIR_FREE(buffers);
     }
-    return err;
+    return &buffers->err;
+}
+
+
+/* Forget the recorded capacities after something other than
+ * virRaiseErrorFull has replaced the strings of the thread
+ * local error object */
+static void
+virErrorBuffersForget(virErrorPtr err)
+{
+    virErrorBuffersPtr buffers = (virErrorBuffersPtr) err;
+
+    buffers->msgcap = 0;
+    buffers->str1cap = 0;
+    buffers->str2cap = 0;
+    buffers->str3cap = 0;
+}
+
+
+/* Replace @*dst with a copy of @src, reusing the old allocation
+ * when it is big enough */
+static void
+virErrorStrcpy(char **dst, size_t *cap, const char *src)
+{
+    size_t len;
+
+    if (*dst == NULL)
+        *cap = 0;
+
+    if (!src) {
+        VIR_FREE(*dst);
+        *cap = 0;
+        return;
+    }
+
+    len = strlen(src) + 1;
+    if (len > *cap) {
+        VIR_FREE(*dst);
+        *cap = 0;
+        if (VIR_ALLOC_N_QUIET(*dst, len) < 0)
+            return;
+        *cap = len;
+    }
+    memcpy(*dst, src, len);
+}
+
+
+/* Format into @*dst, reusing the previous allocation when it is big
+ * enough; drops the message on OOM. The old buffer is never used as
+ * the vsnprintf destination and is only released once formatting is
+ * complete, because the arguments commonly point into it via the
+ * virReportError(..., "%s", virGetLastErrorMessage()) re-raise
+ * idiom */
+static void
+virErrorVformat(char **dst, size_t *cap, const char *fmt, va_list ap)
+{
+    char scratch[1024];
+    char *fresh;
+    va_list cpy;
+    int len;
+
+    if (*dst == NULL)
+        *cap = 0;
+
+    va_copy(cpy, ap);
+    len = vsnprintf(scratch, sizeof(scratch), fmt, cpy);
+    va_end(cpy);
+
+    if (len < 0) {
+        VIR_FREE(*dst);
+        *cap = 0;
+        return;
+    }
+
+    if ((size_t)len < sizeof(scratch) && (size_t)len < *cap) {
+        memcpy(*dst, scratch, len + 1);
+        return;
+    }
+
+    if (VIR_ALLOC_N_QUIET(fresh, len + 1) < 0) {
+        VIR_FREE(*dst);
+        *cap = 0;
+        return;
+    }
+
+    if ((size_t)len < sizeof(scratch))
+        memcpy(fresh, scratch, len + 1);
+    else
+        ignore_value(vsnprintf(fresh, len + 1, fmt, ap));
+
+    VIR_FREE(*dst);
+    *dst = fresh;
+    *cap = len + 1;
 }
 
 
@@ -312,6 +421,7 @@ virSetError(virErrorPtr newerr)
         goto cleanup;
 
     virResetError(err);
+    virErrorBuffersForget(err);
     ret = virCopyError(newerr, err);
  cleanup:
     errno = saved_errno;
@@ -616,8 +726,10 @@ virDispatchError(virConnectPtr conn)
         return;
 
     /* Set a generic error message if none is already set */
-    if (err->code == VIR_ERR_OK)
+    if (err->code == VIR_ERR_OK) {
         virErrorGenericFailure(err);
+        virErrorBuffersForget(err);
+    }
 
     /* Copy the global error to per-connection error if needed */
     if (conn) {
@@ -709,7 +821,7 @@ virRaiseErrorFull(const char *filename,
 {
     int save_errno = errno;
     virErrorPtr to;
-    char *str;
+    virErrorBuffersPtr buffers;
     virLogMetadata meta[] = {
         { .key = "LIBVIRT_DOMAIN", .s = NULL, .iv = domain },
         { .key = "LIBVIRT_CODE", .s = NULL, .iv = code },
@@ -727,22 +839,25 @@ virRaiseErrorFull(const char *filename,
         return; /* Hit OOM allocating thread error object, sod all we can do now */
     }
 
-    virResetError(to);
+    buffers = (virErrorBuffersPtr) to;
 
     if (code == VIR_ERR_OK) {
+        virResetError(to);
         errno = save_errno;
         return;
     }
 
     /*
-     * formats the message; drop message on OOM situations
+     * formats the message into the previous allocation where it
+     * still fits; drop message on OOM situations
      */
     if (fmt == NULL) {
-        ignore_value(VIR_STRDUP_QUIET(str, _("No error message provided")));
+        virErrorStrcpy(&to->message, &buffers->msgcap,
+                       _("No error message provided"));
     } else {
         va_list ap;
         va_start(ap, fmt);
-        ignore_value(virVasprintfQuiet(&str, fmt, ap));
+        virErrorVformat(&to->message, &buffers->msgcap, fmt, ap);
         va_end(ap);
     }
 
@@ -753,13 +868,15 @@ virRaiseErrorFull(const char *filename,
      * Deliberately not setting conn, dom & net fields since
      * they're utterly unsafe
      */
+    to->conn = NULL;
+    to->dom = NULL;
+    to->net = NULL;
     to->domain = domain;
     to->code = code;
-    to->message = str;
     to->level = level;
-    ignore_value(VIR_STRDUP_QUIET(to->str1, str1));
-    ignore_value(VIR_STRDUP_QUIET(to->str2, str2));
-    ignore_value(VIR_STRDUP_QUIET(to->str3, str3));
+    virErrorStrcpy(&to->str1, &buffers->str1cap, str1);
+    virErrorStrcpy(&to->str2, &buffers->str2cap, str2);
+    virErrorStrcpy(&to->str3, &buffers->str3cap, str3);
     to->int1 = int1;
     to->int2 = int2;
 
@@ -807,6 +924,7 @@ void virRaiseErrorObject(const char *filename,
         goto cleanup;
 
     virResetError(err);
+    virErrorBuffersForget(err);
     virCopyError(newerr, err);
     virRaiseErrorLog(filename, funcname, linenr,
                      err, meta);
@@ -30,6 +30,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
 
 #include "virthread.h"
 #include "virlog.h"
@@ -40,6 +43,7 @@
 #include "virerror.h"
 #include "virprobe.h"
 #include "virtime.h"
+#include "virmetrics.h"
 
 #define EVENT_DEBUG(fmt, ...) VIR_DEBUG(fmt, __VA_ARGS__)
 
@@ -81,11 +85,16 @@ struct virEventPollLoop {
     int running;
     virThread leader;
     int wakeupfd[2];
+    int epollfd;
     size_t handlesCount;
     size_t handlesAlloc;
+    /* Number of handles marked as deleted but not yet purged; the
+     * post-dispatch cleanup scan is skipped while this is zero */
+    size_t handlesDeleted;
     struct virEventPollHandle *handles;
     size_t timeoutsCount;
     size_t timeoutsAlloc;
+    size_t timeoutsDeleted;
     struct virEventPollTimeout *timeouts;
 };
 
@@ -98,6 +107,91 @@ static int nextWatch = 1;
 /* Unique ID for the next timer to be registered */
 static int nextTimer = 1;
 
+#ifdef HAVE_SYS_EPOLL_H
+static int
+virEventPollToEpollEvents(int events)
+{
+    int ret = 0;
+    if (events & POLLIN)
+        ret |= EPOLLIN;
+    if (events & POLLOUT)
+        ret |= EPOLLOUT;
+    if (events & POLLERR)
+        ret |= EPOLLERR;
+    if (events & POLLHUP)
+        ret |= EPOLLHUP;
+    return ret;
+}
+
+static int
+virEventPollFromEpollEvents(uint32_t events)
+{
+    int ret = 0;
+    if (events & EPOLLIN)
+        ret |= POLLIN;
+    if (events & EPOLLOUT)
+        ret |= POLLOUT;
+    if (events & EPOLLERR)
+        ret |= POLLERR;
+    if (events & EPOLLHUP)
+        ret |= POLLHUP;
+    return ret;
+}
+
+/*
+ * Refresh the persistent epoll interest set entry for @fd so it
+ * reflects the union of the events wanted by every non-deleted
+ * handle watching that FD. This keeps the kernel-side state in
+ * sync without ever rebuilding it wholesale, so the per-iteration
+ * cost of the event loop no longer grows with the number of
+ * registered handles.
+ *
+ * Must be called with eventLoop.lock held. If the kernel refuses
+ * the update, epoll is disabled and the loop transparently falls
+ * back to the plain poll() implementation.
+ */
+static void virEventPollEpollUpdateFD(int fd)
+{
+    struct epoll_event ev;
+    size_t i;
+    int wanted = 0;
+    int rc;
+
+    if (eventLoop.epollfd < 0)
+        return;
+
+    for (i = 0; i < eventLoop.handlesCount; i++) {
+        if (eventLoop.handles[i].fd == fd &&
+            !eventLoop.handles[i].deleted)
+            wanted |= eventLoop.handles[i].events;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.data.fd = fd;
+    ev.events = virEventPollToEpollEvents(wanted);
+
+    if (wanted)
+        rc = epoll_ctl(eventLoop.epollfd, EPOLL_CTL_MOD, fd, &ev);
+    else
+        rc = epoll_ctl(eventLoop.epollfd, EPOLL_CTL_DEL, fd, NULL);
+
+    if (rc < 0 && errno == ENOENT) {
+        if (wanted)
+            rc = epoll_ctl(eventLoop.epollfd, EPOLL_CTL_ADD, fd, &ev);
+        else
+            rc = 0;
+    }
+
+    if (rc < 0) {
+        char ebuf[1024];
+        VIR_WARN("Unable to update epoll set for fd %d (%s), "
+                 "falling back to poll()",
+                 fd, virStrerror(errno, ebuf, sizeof(ebuf)));
+        VIR_FORCE_CLOSE(eventLoop.epollfd);
+    }
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
 /*
  * Register a callback for monitoring file handle events.
  * NB, it *must* be safe to call this from within a callback
@@ -133,6 +227,10 @@ int virEventPollAddHandle(int fd, int events,
 
     eventLoop.handlesCount++;
 
+#ifdef HAVE_SYS_EPOLL_H
+    virEventPollEpollUpdateFD(fd);
+#endif
+
     virEventPollInterruptLocked();
 
     PROBE(EVENT_POLL_ADD_HANDLE,
@@ -161,6 +259,9 @@ void virEventPollUpdateHandle(int watch, int events)
         if (eventLoop.handles[i].watch == watch) {
             eventLoop.handles[i].events =
                     virEventPollToNativeEvents(events);
+#ifdef HAVE_SYS_EPOLL_H
+            virEventPollEpollUpdateFD(eventLoop.handles[i].fd);
+#endif
             virEventPollInterruptLocked();
             found = true;
             break;
@@ -198,6 +299,10 @@ int virEventPollRemoveHandle(int watch)
         if (eventLoop.handles[i].watch == watch) {
             EVENT_DEBUG("mark delete %zu %d", i, eventLoop.handles[i].fd);
             eventLoop.handles[i].deleted = 1;
+            eventLoop.handlesDeleted++;
+#ifdef HAVE_SYS_EPOLL_H
+            virEventPollEpollUpdateFD(eventLoop.handles[i].fd);
+#endif
             virEventPollInterruptLocked();
             virMutexUnlock(&eventLoop.lock);
             return 0;
@@ -316,6 +421,7 @@ int virEventPollRemoveTimeout(int timer)
 
         if (eventLoop.timeouts[i].timer == timer) {
             eventLoop.timeouts[i].deleted = 1;
+            eventLoop.timeoutsDeleted++;
             virEventPollInterruptLocked();
             virMutexUnlock(&eventLoop.lock);
             return 0;
@@ -514,6 +620,65 @@ static int virEventPollDispatchHandles(int nfds, struct pollfd *fds)
 }
 
 
+#ifdef HAVE_SYS_EPOLL_H
+/* Iterate over the ready list reported by epoll_wait() and dispatch
+ * the handles watching each ready FD. Unlike the poll() variant
+ * there is no rebuilt pollfd array covering every handle; only the
+ * FDs the kernel reported ready are visited.
+ *
+ * This method must cope with new handles being registered
+ * by a callback, and must skip any handles marked as deleted.
+ *
+ * Returns 0 upon success, -1 if an error occurred
+ */
+static int virEventPollDispatchEpollHandles(int nready,
+                                            struct epoll_event *events)
+{
+    size_t i;
+    int n;
+    /* NB, use this now rather than eventLoop.handlesCount, because
+     * new handles might be added on end of list by a callback, and
+     * they can't be part of this ready set */
+    size_t nhandles = eventLoop.handlesCount;
+    VIR_DEBUG("Dispatch %d", nready);
+
+    for (n = 0; n < nready; n++) {
+        int fd = events[n].data.fd;
+        int revents = virEventPollFromEpollEvents(events[n].events);
+
+        for (i = 0; i < nhandles; i++) {
+            if (eventLoop.handles[i].fd != fd ||
+                eventLoop.handles[i].events == 0)
+                continue;
+
+            VIR_DEBUG("i=%zu w=%d", i, eventLoop.handles[i].watch);
+            if (eventLoop.handles[i].deleted) {
+                EVENT_DEBUG("Skip deleted n=%zu w=%d f=%d", i,
+                            eventLoop.handles[i].watch,
+                            eventLoop.handles[i].fd);
+                continue;
+            }
+
+            if (revents) {
+                virEventHandleCallback cb = eventLoop.handles[i].cb;
+                int watch = eventLoop.handles[i].watch;
+                void *opaque = eventLoop.handles[i].opaque;
+                int hEvents = virEventPollFromNativeEvents(revents);
+                PROBE(EVENT_POLL_DISPATCH_HANDLE,
+                      "watch=%d events=%d",
+                      watch, hEvents);
+                virMutexUnlock(&eventLoop.lock);
+                (cb)(watch, fd, hEvents, opaque);
+                virMutexLock(&eventLoop.lock);
+            }
+        }
+    }
+
+    return 0;
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
+
 /* Used post dispatch to actually remove any timers that
  * were previously marked as deleted. This asynchronous
  * cleanup is needed to make dispatch re-entrant safe.
@@ -522,6 +687,10 @@ static void virEventPollCleanupTimeouts(void)
 {
     size_t i;
     size_t gap;
+
+    if (!eventLoop.timeoutsDeleted)
+        return;
+
     VIR_DEBUG("Cleanup %zu", eventLoop.timeoutsCount);
 
     /* Remove deleted entries, shuffling down remaining
@@ -551,6 +720,7 @@ static void virEventPollCleanupTimeouts(void)
                                                     -(i+1)));
         }
         eventLoop.timeoutsCount--;
+        eventLoop.timeoutsDeleted--;
     }
 
     /* Release some memory if we've got a big chunk free */
@@ -571,6 +741,10 @@ static void virEventPollCleanupHandles(void)
 {
     size_t i;
     size_t gap;
+
+    if (!eventLoop.handlesDeleted)
+        return;
+
     VIR_DEBUG("Cleanup %zu", eventLoop.handlesCount);
 
     /* Remove deleted entries, shuffling down remaining
@@ -600,6 +774,7 @@ static void virEventPollCleanupHandles(void)
                                                    -(i+1)));
         }
         eventLoop.handlesCount--;
+        eventLoop.handlesDeleted--;
     }
 
     /* Release some memory if we've got a big chunk free */
@@ -612,6 +787,84 @@ static void virEventPollCleanupHandles(void)
     }
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+/* Maximum number of ready FDs fetched per epoll_wait() call. Any
+ * further ready FDs are simply picked up on the next iteration */
+# define EVENT_EPOLL_MAX_EVENTS 64
+
+/*
+ * Run a single iteration of the event loop using the persistent
+ * epoll interest set, blocking until at least one file handle has
+ * an event, or a timer expires
+ */
+static int virEventPollRunOnceEpoll(void)
+{
+    struct epoll_event events[EVENT_EPOLL_MAX_EVENTS];
+    int ret, timeout;
+    unsigned long long dispatchStart;
+    unsigned long long dispatchEnd;
+
+    virMutexLock(&eventLoop.lock);
+    eventLoop.running = 1;
+    virThreadSelf(&eventLoop.leader);
+
+    virEventPollCleanupTimeouts();
+    virEventPollCleanupHandles();
+
+    if (virEventPollCalculateTimeout(&timeout) < 0)
+        goto error;
+
+    virMutexUnlock(&eventLoop.lock);
+
+ retry:
+    PROBE(EVENT_POLL_RUN,
+          "nhandles=%zu timeout=%d",
+          eventLoop.handlesCount, timeout);
+    ret = epoll_wait(eventLoop.epollfd, events,
+                     EVENT_EPOLL_MAX_EVENTS, timeout);
+    if (ret < 0) {
+        EVENT_DEBUG("Poll got error event %d", errno);
+        if (errno == EINTR || errno == EAGAIN)
+            goto retry;
+        if (errno == EBADF) {
+            /* A callback hit an epoll_ctl() failure and disabled
+             * epoll behind our back; retry with plain poll() */
+            return virEventPollRunOnce();
+        }
+        virReportSystemError(errno, "%s",
+                             _("Unable to poll on file handles"));
+        return -1;
+    }
+    EVENT_DEBUG("Poll got %d event(s)", ret);
+
+    if (virTimeMillisNowRaw(&dispatchStart) < 0)
+        dispatchStart = 0;
+
+    virMutexLock(&eventLoop.lock);
+    if (virEventPollDispatchTimeouts() < 0)
+        goto error;
+
+    if (ret > 0 &&
+        virEventPollDispatchEpollHandles(ret, events) < 0)
+        goto error;
+
+    virEventPollCleanupTimeouts();
+    virEventPollCleanupHandles();
+
+    eventLoop.running = 0;
+    virMutexUnlock(&eventLoop.lock);
+    if (dispatchStart &&
+        virTimeMillisNowRaw(&dispatchEnd) == 0)
+        virMetricsRecord(VIR_METRICS_EVENT_DISPATCH,
+                         dispatchEnd - dispatchStart);
+    return 0;
+
+ error:
+    virMutexUnlock(&eventLoop.lock);
+    return -1;
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
 /*
  * Run a single iteration of the event loop, blocking until
  * at least one file handle has an event, or a timer expires
@@ -620,6 +873,18 @@ int virEventPollRunOnce(void)
 {
     struct pollfd *fds = NULL;
     int ret, timeout, nfds;
+    unsigned long long dispatchStart;
+    unsigned long long dispatchEnd;
+
+#ifdef HAVE_SYS_EPOLL_H
+    bool useEpoll;
+
+    virMutexLock(&eventLoop.lock);
+    useEpoll = eventLoop.epollfd >= 0;
+    virMutexUnlock(&eventLoop.lock);
+    if (useEpoll)
+        return virEventPollRunOnceEpoll();
+#endif
 
     virMutexLock(&eventLoop.lock);
     eventLoop.running = 1;
@@ -649,6 +914,9 @@ int virEventPollRunOnce(void)
     }
     EVENT_DEBUG("Poll got %d event(s)", ret);
 
+    if (virTimeMillisNowRaw(&dispatchStart) < 0)
+        dispatchStart = 0;
+
     virMutexLock(&eventLoop.lock);
     if (virEventPollDispatchTimeouts() < 0)
         goto error;
@@ -662,6 +930,10 @@ int virEventPollRunOnce(void)
 
     eventLoop.running = 0;
     virMutexUnlock(&eventLoop.lock);
+    if (dispatchStart &&
+        virTimeMillisNowRaw(&dispatchEnd) == 0)
+        virMetricsRecord(VIR_METRICS_EVENT_DISPATCH,
+                         dispatchEnd - dispatchStart);
     VIR_FREE(fds);
     return 0;
 
@@ -692,6 +964,15 @@ int virEventPollInit(void)
         return -1;
     }
 
+    eventLoop.epollfd = -1;
+#ifdef HAVE_SYS_EPOLL_H
+    if ((eventLoop.epollfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        char ebuf[1024];
+        VIR_WARN("Unable to create epoll fd (%s), falling back to poll()",
+                 virStrerror(errno, ebuf, sizeof(ebuf)));
+    }
+#endif
+
     if (pipe2(eventLoop.wakeupfd, O_CLOEXEC | O_NONBLOCK) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to setup wakeup pipe"));
@@ -1169,6 +1169,87 @@ safezero_slow(int fd, off_t offset, off_t len)
     return 0;
 }
 
+/* Write the zeroes with O_DIRECT and a large aligned buffer, so that
+ * filling a big preallocated volume does not evict useful data from
+ * the page cache. The unaligned head and tail of the range are small
+ * and are written through the cache once the bulk is done. Returns -2
+ * to request a fallback path, eg when the file system does not
+ * support O_DIRECT. */
+static int
+safezero_direct(int fd, off_t offset, off_t len)
+{
+    void *base = NULL; /* Location to be freed */
+    char *buf = NULL; /* Aligned location within base */
+    size_t buflen = 8 * 1024 * 1024;
+    intptr_t alignMask = 64 * 1024 - 1;
+    off_t start, end, pos;
+    int oflags;
+    int ret = -1;
+
+    if (!O_DIRECT)
+        return -2;
+
+    /* only worth bypassing the cache for large ranges */
+    if (len < (off_t) buflen)
+        return -2;
+
+    start = (offset + alignMask) & ~alignMask;
+    end = (offset + len) & ~alignMask;
+    if (end <= start)
+        return -2;
+
+    if ((oflags = fcntl(fd, F_GETFL)) < 0 ||
+        fcntl(fd, F_SETFL, oflags | O_DIRECT) < 0)
+        return -2;
+
+#if HAVE_POSIX_MEMALIGN
+    if (posix_memalign(&base, alignMask + 1, buflen)) {
+        ret = -2;
+        goto cleanup;
+    }
+    buf = base;
+#else
+    if (VIR_ALLOC_N(buf, buflen + alignMask) < 0) {
+        ret = -2;
+        goto cleanup;
+    }
+    base = buf;
+    buf = (char *) (((intptr_t) base + alignMask) & ~alignMask);
+#endif
+    memset(buf, 0, buflen);
+
+    for (pos = start; pos < end;) {
+        size_t count = MIN(buflen, (size_t) (end - pos));
+        ssize_t written = pwrite(fd, buf, count, pos);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            /* EINVAL on the first write usually means the file system
+             * does not support O_DIRECT at all */
+            if (errno == EINVAL && pos == start)
+                ret = -2;
+            goto cleanup;
+        }
+        pos += written;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (fcntl(fd, F_SETFL, oflags) < 0 && ret == 0)
+        ret = -1;
+
+    /* zero the unaligned head and tail through the page cache */
+    if (ret == 0 && start > offset)
+        ret = safezero_slow(fd, offset, start - offset);
+    if (ret == 0 && offset + len > end)
+        ret = safezero_slow(fd, end, offset + len - end);
+
+    VIR_FREE(base);
+    return ret;
+}
+
 int safezero(int fd, off_t offset, off_t len)
 {
     int ret;
@@ -1180,6 +1261,10 @@ int safezero(int fd, off_t offset, off_t len)
     if (safezero_sys_fallocate(fd, offset, len) == 0)
         return 0;
 
+    ret = safezero_direct(fd, offset, len);
+    if (ret != -2)
+        return ret;
+
     ret = safezero_mmap(fd, offset, len);
     if (ret != -2)
         return ret;
@@ -1268,6 +1353,18 @@ saferead_lim(int fd, size_t max_len, size_t *length)
     size_t alloc = 0;
     size_t size = 0;
     int save_errno;
+    struct stat st;
+
+    /* For a regular file we know how much data to expect, so allocate
+     * the whole buffer up front rather than growing it in BUFSIZ steps
+     * with a realloc/copy each time. The read loop below still copes
+     * with files that change size under us. */
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        (uintmax_t)st.st_size > BUFSIZ) {
+        alloc = MIN((uintmax_t)st.st_size, max_len) + BUFSIZ + 1;
+        if (VIR_ALLOC_N_QUIET(buf, alloc) < 0)
+            alloc = 0; /* fall back to incremental growth */
+    }
 
     for (;;) {
         int count;
@@ -3501,3 +3598,121 @@ int virFileIsSharedFS(const char *path)
                                  VIR_FILE_SHFS_SMB |
                                  VIR_FILE_SHFS_CIFS);
 }
+
+
+/**
+ * virFileInData:
+ * @fd: file to check
+ * @inData: true if current position in the @fd is in data section
+ * @length: amount of bytes until the end of the current section
+ *
+ * With sparse files not every extent has to be physically stored on
+ * the disk. This results in so called data or hole sections.  This
+ * function checks whether the current position in the file @fd is
+ * in a data section (@inData = 1) or in a hole (@inData = 0). Also,
+ * it sets @length to match the number of bytes remaining in the
+ * current section.
+ *
+ * As a special case, there is an implicit hole at the end of any
+ * file. In this case, the function sets @inData = 0, @length = 0.
+ *
+ * Upon its return, the position in the @fd is left unchanged, i.e.
+ * despite this function lseek()-ing back and forth it always
+ * restores the original position in the file.
+ *
+ * NB, @length is type of long long because it corresponds to off_t
+ * the best.
+ *
+ * Returns 0 on success,
+ *        -1 otherwise.
+ */
+int
+virFileInData(int fd,
+              int *inData,
+              long long *length)
+{
+#ifdef SEEK_HOLE
+    int ret = -1;
+    off_t cur, data, hole, end;
+
+    /* Get current position */
+    cur = lseek(fd, 0, SEEK_CUR);
+    if (cur == (off_t) -1) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to get current position in file"));
+        goto cleanup;
+    }
+
+    /* Now try to get data and hole offsets */
+    data = lseek(fd, cur, SEEK_DATA);
+
+    /* There are four options:
+     * 1) data == cur;  @cur is in data
+     * 2) data > cur; @cur is in a hole, next data at @data
+     * 3) data < 0, errno = ENXIO; either @cur is in trailing hole, or @cur is beyond EOF.
+     * 4) data < 0, errno != ENXIO; we learned nothing
+     */
+
+    if (data == (off_t) -1) {
+        /* cases 3 and 4 */
+        if (errno != ENXIO) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to seek to data"));
+            goto cleanup;
+        }
+
+        *inData = 0;
+        /* There are two situations now. There is always an
+         * implicit hole at EOF. However, there might be a
+         * trailing hole just before EOF too. If that's the case
+         * report it. */
+        if ((end = lseek(fd, 0, SEEK_END)) == (off_t) -1) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to seek to EOF"));
+            goto cleanup;
+        }
+        *length = end - cur;
+    } else if (data > cur) {
+        /* case 2 */
+        *inData = 0;
+        *length = data - cur;
+    } else {
+        /* case 1 */
+        *inData = 1;
+
+        /* We don't know where does the next hole start. Let's
+         * find out. Here we get the same 4 possibilities as
+         * described above. */
+        hole = lseek(fd, data, SEEK_HOLE);
+        if (hole == (off_t) -1 || hole == data) {
+            /* cases 1, 3 and 4 */
+            /* Wait a second. The reason why we are here is
+             * because we are in data. But at the same time we
+             * are in a trailing hole? Wut!? Do the best what we
+             * can do here. */
+            virReportSystemError(errno, "%s",
+                                 _("unable to seek to hole"));
+            goto cleanup;
+        } else {
+            /* case 2 */
+            *length = (hole - data);
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    /* At any rate, reposition back to where we started. */
+    if (cur != (off_t) -1 &&
+        lseek(fd, cur, SEEK_SET) == (off_t) -1) {
+        virReportSystemError(errno, "%s",
+                             _("unable to restore position in file"));
+        ret = -1;
+    }
+
+    return ret;
+#else /* !SEEK_HOLE */
+    virReportSystemError(ENOSYS, "%s",
+                         _("sparse files not supported"));
+    return -1;
+#endif /* !SEEK_HOLE */
+}
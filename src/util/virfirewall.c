@@ -108,6 +108,7 @@ static bool iptablesUseLock;
 static bool ip6tablesUseLock;
 static bool ebtablesUseLock;
 static bool lockOverride; /* true to avoid lock probes */
+static bool batchRules; /* true to apply rules via iptables-restore */
 
 void
 virFirewallSetLockOverride(bool avoid)
@@ -115,6 +116,23 @@ virFirewallSetLockOverride(bool avoid)
     lockOverride = avoid;
 }
 
+/**
+ * virFirewallSetBatchMode:
+ * @batch: true to apply eligible rules via the restore tools
+ *
+ * Request that runs of consecutive rules whose output does not feed
+ * a query callback and whose errors are not ignored get rendered
+ * into a single iptables-restore / ip6tables-restore invocation
+ * rather than forking one iptables process per rule. Only honoured
+ * by the direct backend; the caller is responsible for checking
+ * that the restore binaries are available.
+ */
+void
+virFirewallSetBatchMode(bool batch)
+{
+    batchRules = batch;
+}
+
 static void
 virFirewallCheckUpdateLock(bool *lockflag,
                            const char *const*args)
@@ -883,25 +901,243 @@ virFirewallApplyRule(virFirewallPtr firewall,
     return ret;
 }
 
+typedef struct _virFirewallBatchTable virFirewallBatchTable;
+typedef virFirewallBatchTable *virFirewallBatchTablePtr;
+struct _virFirewallBatchTable {
+    char *name;
+    virBuffer rules;
+};
+
+typedef struct _virFirewallBatch virFirewallBatch;
+typedef virFirewallBatch *virFirewallBatchPtr;
+struct _virFirewallBatch {
+    virFirewallBatchTablePtr tables[VIR_FIREWALL_LAYER_LAST];
+    size_t ntables[VIR_FIREWALL_LAYER_LAST];
+};
+
+static const char *
+virFirewallLayerRestoreCommand(virFirewallLayer layer)
+{
+    switch (layer) {
+    case VIR_FIREWALL_LAYER_IPV4:
+        return IPTABLES_RESTORE_PATH;
+    case VIR_FIREWALL_LAYER_IPV6:
+        return IP6TABLES_RESTORE_PATH;
+    case VIR_FIREWALL_LAYER_ETHERNET:
+        /* ebtables-restore only accepts a full table dump,
+         * it cannot replay individual commands */
+    case VIR_FIREWALL_LAYER_LAST:
+        break;
+    }
+    return NULL;
+}
+
+static bool
+virFirewallRuleCanBatch(virFirewallRulePtr rule,
+                        bool ignoreErrors)
+{
+    if (currentBackend != VIR_FIREWALL_BACKEND_DIRECT || !batchRules)
+        return false;
+
+    /* a failing rule aborts the whole restore run, so rules whose
+     * failure must be tolerated are applied individually, as are
+     * rules whose output feeds a query callback */
+    if (ignoreErrors || rule->ignoreErrors || rule->queryCB)
+        return false;
+
+    return virFirewallLayerRestoreCommand(rule->layer) != NULL;
+}
+
+/* Quote @arg the way the restore tools' line parser expects */
+static void
+virFirewallBatchEscapeArg(virBufferPtr buf,
+                          const char *arg)
+{
+    if (*arg && !strpbrk(arg, " \t\"\\")) {
+        virBufferAdd(buf, arg, -1);
+        return;
+    }
+
+    virBufferAddChar(buf, '"');
+    for (; *arg; arg++) {
+        if (*arg == '"' || *arg == '\\')
+            virBufferAddChar(buf, '\\');
+        virBufferAddChar(buf, *arg);
+    }
+    virBufferAddChar(buf, '"');
+}
+
+static int
+virFirewallBatchAddRule(virFirewallBatchPtr batch,
+                        virFirewallRulePtr rule)
+{
+    const char *table = "filter";
+    virFirewallBatchTablePtr tbl = NULL;
+    bool first = true;
+    size_t i;
+
+    for (i = 0; i + 1 < rule->argsLen; i++) {
+        if (STREQ(rule->args[i], "-t") ||
+            STREQ(rule->args[i], "--table")) {
+            table = rule->args[i + 1];
+            break;
+        }
+    }
+
+    for (i = 0; i < batch->ntables[rule->layer]; i++) {
+        if (STREQ(batch->tables[rule->layer][i].name, table)) {
+            tbl = &batch->tables[rule->layer][i];
+            break;
+        }
+    }
+    if (!tbl) {
+        if (VIR_EXPAND_N(batch->tables[rule->layer],
+                         batch->ntables[rule->layer], 1) < 0)
+            return -1;
+        tbl = &batch->tables[rule->layer][batch->ntables[rule->layer] - 1];
+        if (VIR_STRDUP(tbl->name, table) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < rule->argsLen; i++) {
+        /* the table is named by the '*table' header line and the
+         * restore tools take the xtables lock themselves, so drop
+         * the table selection and lock arguments */
+        if ((STREQ(rule->args[i], "-t") ||
+             STREQ(rule->args[i], "--table")) &&
+            i + 1 < rule->argsLen) {
+            i++;
+            continue;
+        }
+        if (STREQ(rule->args[i], "-w"))
+            continue;
+
+        if (!first)
+            virBufferAddChar(&tbl->rules, ' ');
+        virFirewallBatchEscapeArg(&tbl->rules, rule->args[i]);
+        first = false;
+    }
+    virBufferAddChar(&tbl->rules, '\n');
+
+    return virBufferCheckError(&tbl->rules);
+}
+
+static void
+virFirewallBatchReset(virFirewallBatchPtr batch)
+{
+    size_t i, j;
+
+    for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++) {
+        for (j = 0; j < batch->ntables[i]; j++) {
+            VIR_FREE(batch->tables[i][j].name);
+            virBufferFreeAndReset(&batch->tables[i][j].rules);
+        }
+        VIR_FREE(batch->tables[i]);
+        batch->ntables[i] = 0;
+    }
+}
+
+static int
+virFirewallBatchFlush(virFirewallBatchPtr batch)
+{
+    virBuffer input = VIR_BUFFER_INITIALIZER;
+    virCommandPtr cmd = NULL;
+    char *error = NULL;
+    int status;
+    int ret = -1;
+    size_t i, j;
+
+    for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++) {
+        const char *bin = virFirewallLayerRestoreCommand(i);
+
+        if (batch->ntables[i] == 0)
+            continue;
+
+        for (j = 0; j < batch->ntables[i]; j++) {
+            virFirewallBatchTablePtr tbl = &batch->tables[i][j];
+            virBufferAsprintf(&input, "*%s\n", tbl->name);
+            virBufferAddBuffer(&input, &tbl->rules);
+            virBufferAddLit(&input, "COMMIT\n");
+        }
+
+        if (virBufferCheckError(&input) < 0)
+            goto cleanup;
+
+        VIR_INFO("Applying %zu batched tables via %s",
+                 batch->ntables[i], bin);
+
+        cmd = virCommandNewArgList(bin, "--noflush", NULL);
+        virCommandSetInputBuffer(cmd, virBufferCurrentContent(&input));
+        virCommandSetErrorBuffer(cmd, &error);
+
+        if (virCommandRun(cmd, &status) < 0)
+            goto cleanup;
+
+        if (status != 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to apply firewall rules via %s: %s"),
+                           bin, NULLSTR(error));
+            goto cleanup;
+        }
+
+        virCommandFree(cmd);
+        cmd = NULL;
+        VIR_FREE(error);
+        virBufferFreeAndReset(&input);
+    }
+
+    ret = 0;
+ cleanup:
+    virCommandFree(cmd);
+    VIR_FREE(error);
+    virBufferFreeAndReset(&input);
+    virFirewallBatchReset(batch);
+    return ret;
+}
+
 static int
 virFirewallApplyGroup(virFirewallPtr firewall,
                       size_t idx)
 {
     virFirewallGroupPtr group = firewall->groups[idx];
     bool ignoreErrors = (group->actionFlags & VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
+    virFirewallBatch batch;
     size_t i;
+    int ret = -1;
+
+    memset(&batch, 0, sizeof(batch));
 
     VIR_INFO("Starting transaction for firewall=%p group=%p flags=%x",
              firewall, group, group->actionFlags);
     firewall->currentGroup = idx;
     group->addingRollback = false;
     for (i = 0; i < group->naction; i++) {
-        if (virFirewallApplyRule(firewall,
-                                 group->action[i],
-                                 ignoreErrors) < 0)
-            return -1;
+        virFirewallRulePtr rule = group->action[i];
+
+        if (virFirewallRuleCanBatch(rule, ignoreErrors)) {
+            char *str = virFirewallRuleToString(rule);
+            VIR_INFO("Batching rule '%s'", NULLSTR(str));
+            VIR_FREE(str);
+
+            if (virFirewallBatchAddRule(&batch, rule) < 0)
+                goto cleanup;
+            continue;
+        }
+
+        /* preserve ordering around rules that cannot be batched */
+        if (virFirewallBatchFlush(&batch) < 0)
+            goto cleanup;
+
+        if (virFirewallApplyRule(firewall, rule, ignoreErrors) < 0)
+            goto cleanup;
     }
-    return 0;
+    if (virFirewallBatchFlush(&batch) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virFirewallBatchReset(&batch);
+    return ret;
 }
 
 
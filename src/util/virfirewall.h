@@ -108,4 +108,6 @@ int virFirewallApply(virFirewallPtr firewall);
 
 void virFirewallSetLockOverride(bool avoid);
 
+void virFirewallSetBatchMode(bool batch);
+
 #endif /* __VIR_FIREWALL_H__ */
@@ -58,6 +58,21 @@ struct _virHashEntry {
     void *payload;
 };
 
+/*
+ * A single slot of the open addressing variant. Slots live in one
+ * contiguous array and cache the full hash code of their key, so
+ * probing mostly compares integers in adjacent memory and growing
+ * the table never needs to recompute key hashes.
+ */
+typedef struct _virHashOpenSlot virHashOpenSlot;
+typedef virHashOpenSlot *virHashOpenSlotPtr;
+struct _virHashOpenSlot {
+    void *name;                 /* NULL when empty or deleted */
+    void *payload;
+    uint32_t code;              /* cached hash code of 'name' */
+    bool deleted;               /* tombstone left behind by removal */
+};
+
 /*
  * The entire hash table
  */
@@ -70,6 +85,13 @@ struct _virHashTable {
     bool iterating;
     /* Pointer to the current entry during iteration. */
     virHashEntryPtr current;
+    /* True iff this is an open addressing table using 'slots'. */
+    bool open;
+    virHashOpenSlotPtr slots;
+    /* Number of tombstones in 'slots'. */
+    size_t ndeleted;
+    /* Index of the current slot during open table iteration. */
+    size_t currentIdx;
     virHashDataFree dataFree;
     virHashKeyCode keyCode;
     virHashKeyEqual keyEqual;
@@ -202,6 +224,215 @@ virHashTablePtr virHashCreate(ssize_t size, virHashDataFree dataFree)
 }
 
 
+/* Round the requested element count up to a power of two slot
+ * count, leaving the table at most half full to begin with */
+static size_t
+virHashOpenRoundSize(ssize_t size)
+{
+    size_t ret = 16;
+
+    if (size < 0)
+        size = 0;
+    while (ret < (size_t)size * 2)
+        ret *= 2;
+    return ret;
+}
+
+
+/**
+ * virHashCreateOpenFull:
+ * @size: expected number of elements in the hash table
+ * @dataFree: callback to free data
+ * @keyCode: callback to compute hash code
+ * @keyEqual: callback to compare hash keys
+ * @keyCopy: callback to copy hash keys
+ * @keyFree: callback to free keys
+ *
+ * Create a new virHashTablePtr backed by open addressing with
+ * linear probing. Entries are stored in a single contiguous slot
+ * array with the 32-bit hash code cached per slot, instead of
+ * individually allocated chained nodes. The table behaves the same
+ * as one from virHashCreateFull, but is considerably more cache
+ * friendly for lookup heavy workloads.
+ *
+ * Returns the newly created object, or NULL if an error occurred.
+ */
+virHashTablePtr virHashCreateOpenFull(ssize_t size,
+                                      virHashDataFree dataFree,
+                                      virHashKeyCode keyCode,
+                                      virHashKeyEqual keyEqual,
+                                      virHashKeyCopy keyCopy,
+                                      virHashKeyFree keyFree)
+{
+    virHashTablePtr table = NULL;
+
+    if (VIR_ALLOC(table) < 0)
+        return NULL;
+
+    table->seed = virRandomBits(32);
+    table->size = virHashOpenRoundSize(size);
+    table->nbElems = 0;
+    table->open = true;
+    table->dataFree = dataFree;
+    table->keyCode = keyCode;
+    table->keyEqual = keyEqual;
+    table->keyCopy = keyCopy;
+    table->keyFree = keyFree;
+
+    if (VIR_ALLOC_N(table->slots, table->size) < 0) {
+        VIR_FREE(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+
+/**
+ * virHashCreateOpen:
+ * @size: expected number of elements in the hash table
+ * @dataFree: callback to free data
+ *
+ * Create a new virHashTablePtr backed by open addressing, with
+ * string keys. See virHashCreateOpenFull.
+ *
+ * Returns the newly created object, or NULL if an error occurred.
+ */
+virHashTablePtr virHashCreateOpen(ssize_t size, virHashDataFree dataFree)
+{
+    return virHashCreateOpenFull(size,
+                                 dataFree,
+                                 virHashStrCode,
+                                 virHashStrEqual,
+                                 virHashStrCopy,
+                                 virHashStrFree);
+}
+
+
+/* Locate the slot holding @name whose hash code is @code.
+ * Returns the index of the matching occupied slot, or -1 if the key
+ * is absent; in the latter case *insert, if non-NULL, is set to the
+ * first reusable slot on the probe path (or -1 if the table is full)
+ */
+static ssize_t
+virHashOpenFind(const virHashTable *table,
+                const void *name,
+                uint32_t code,
+                ssize_t *insert)
+{
+    size_t mask = table->size - 1;
+    size_t idx = code & mask;
+    ssize_t firstFree = -1;
+    size_t probes;
+
+    for (probes = 0; probes <= mask; probes++, idx = (idx + 1) & mask) {
+        virHashOpenSlotPtr slot = table->slots + idx;
+
+        if (!slot->name) {
+            if (firstFree < 0)
+                firstFree = idx;
+            if (!slot->deleted)
+                break;          /* truly empty, key cannot be further on */
+            continue;
+        }
+        if (slot->code == code && table->keyEqual(slot->name, name))
+            return idx;
+    }
+
+    if (insert)
+        *insert = firstFree;
+    return -1;
+}
+
+
+static int
+virHashOpenGrow(virHashTablePtr table, size_t newsize)
+{
+    virHashOpenSlotPtr old = table->slots;
+    size_t oldsize = table->size;
+    size_t mask = newsize - 1;
+    size_t i;
+
+    if (VIR_ALLOC_N(table->slots, newsize) < 0) {
+        table->slots = old;
+        return -1;
+    }
+    table->size = newsize;
+    table->ndeleted = 0;
+
+    for (i = 0; i < oldsize; i++) {
+        virHashOpenSlotPtr slot = old + i;
+        size_t idx;
+
+        if (!slot->name)
+            continue;
+
+        idx = slot->code & mask;
+        while (table->slots[idx].name)
+            idx = (idx + 1) & mask;
+        table->slots[idx].name = slot->name;
+        table->slots[idx].payload = slot->payload;
+        table->slots[idx].code = slot->code;
+    }
+
+    VIR_FREE(old);
+    return 0;
+}
+
+
+static int
+virHashOpenAddOrUpdate(virHashTablePtr table,
+                       const void *name,
+                       void *userdata,
+                       bool is_update)
+{
+    uint32_t code = table->keyCode(name, table->seed);
+    ssize_t idx, insert;
+    void *new_name;
+
+    /* Keep the occupancy (tombstones included) below 75% so probe
+     * sequences stay short. Failure to grow is not fatal as long as
+     * a free slot remains */
+    if ((table->nbElems + table->ndeleted + 1) * 4 >= table->size * 3)
+        ignore_value(virHashOpenGrow(table, table->size * 2));
+
+    idx = virHashOpenFind(table, name, code, &insert);
+    if (idx >= 0) {
+        if (is_update) {
+            if (table->dataFree)
+                table->dataFree(table->slots[idx].payload,
+                                table->slots[idx].name);
+            table->slots[idx].payload = userdata;
+            return 0;
+        }
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Duplicate key"));
+        return -1;
+    }
+
+    if (insert < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Hash table is full"));
+        return -1;
+    }
+
+    if (!(new_name = table->keyCopy(name)))
+        return -1;
+
+    if (table->slots[insert].deleted) {
+        table->slots[insert].deleted = false;
+        table->ndeleted--;
+    }
+    table->slots[insert].name = new_name;
+    table->slots[insert].payload = userdata;
+    table->slots[insert].code = code;
+
+    table->nbElems++;
+
+    return 0;
+}
+
+
 virHashAtomicPtr
 virHashAtomicNew(ssize_t size,
                  virHashDataFree dataFree)
@@ -309,6 +540,23 @@ virHashFree(virHashTablePtr table)
     if (table == NULL)
         return;
 
+    if (table->open) {
+        for (i = 0; i < table->size; i++) {
+            virHashOpenSlotPtr slot = table->slots + i;
+
+            if (!slot->name)
+                continue;
+            if (table->dataFree)
+                table->dataFree(slot->payload, slot->name);
+            if (table->keyFree)
+                table->keyFree(slot->name);
+        }
+
+        VIR_FREE(table->slots);
+        VIR_FREE(table);
+        return;
+    }
+
     for (i = 0; i < table->size; i++) {
         virHashEntryPtr iter = table->table[i];
         while (iter) {
@@ -342,6 +590,9 @@ virHashAddOrUpdateEntry(virHashTablePtr table, const void *name,
     if (table->iterating)
         virHashIterationError(-1);
 
+    if (table->open)
+        return virHashOpenAddOrUpdate(table, name, userdata, is_update);
+
     key = virHashComputeKey(table, name);
 
     /* Check for duplicate entry */
@@ -448,6 +699,13 @@ virHashLookup(const virHashTable *table, const void *name)
     if (!table || !name)
         return NULL;
 
+    if (table->open) {
+        uint32_t code = table->keyCode(name, table->seed);
+        ssize_t idx = virHashOpenFind(table, name, code, NULL);
+
+        return idx < 0 ? NULL : table->slots[idx].payload;
+    }
+
     key = virHashComputeKey(table, name);
     for (entry = table->table[key]; entry; entry = entry->next) {
         if (table->keyEqual(entry->name, name))
@@ -548,6 +806,30 @@ virHashRemoveEntry(virHashTablePtr table, const void *name)
     if (table == NULL || name == NULL)
         return -1;
 
+    if (table->open) {
+        uint32_t code = table->keyCode(name, table->seed);
+        ssize_t idx = virHashOpenFind(table, name, code, NULL);
+        virHashOpenSlotPtr slot;
+
+        if (idx < 0)
+            return -1;
+
+        if (table->iterating && table->currentIdx != (size_t)idx)
+            virHashIterationError(-1);
+
+        slot = table->slots + idx;
+        if (table->dataFree)
+            table->dataFree(slot->payload, slot->name);
+        if (table->keyFree)
+            table->keyFree(slot->name);
+        slot->name = NULL;
+        slot->payload = NULL;
+        slot->deleted = true;
+        table->ndeleted++;
+        table->nbElems--;
+        return 0;
+    }
+
     nextptr = table->table + virHashComputeKey(table, name);
     for (entry = *nextptr; entry; entry = entry->next) {
         if (table->keyEqual(entry->name, name)) {
@@ -598,6 +880,24 @@ virHashForEach(virHashTablePtr table, virHashIterator iter, void *data)
 
     table->iterating = true;
     table->current = NULL;
+
+    if (table->open) {
+        for (i = 0; i < table->size; i++) {
+            virHashOpenSlotPtr slot = table->slots + i;
+
+            if (!slot->name)
+                continue;
+            table->currentIdx = i;
+            ret = iter(slot->payload, slot->name, data);
+
+            if (ret < 0)
+                goto cleanup;
+        }
+
+        ret = 0;
+        goto cleanup;
+    }
+
     for (i = 0; i < table->size; i++) {
         virHashEntryPtr entry = table->table[i];
         while (entry) {
@@ -620,6 +920,59 @@ virHashForEach(virHashTablePtr table, virHashIterator iter, void *data)
 }
 
 
+/**
+ * virHashForEachConst:
+ * @table: the hash table to process
+ * @iter: callback to process each element
+ * @data: opaque data to pass to the iterator
+ *
+ * Iterates over every element in the hash table, invoking the
+ * 'iter' callback. Unlike virHashForEach this does not touch the
+ * table's iteration bookkeeping, so concurrent readers holding a
+ * shared lock may iterate the same table simultaneously. In exchange
+ * the callback must not modify the table in any way - not even
+ * removing the current element. If @iter fails and returns a
+ * negative value, the evaluation is stopped and -1 is returned.
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int
+virHashForEachConst(const virHashTable *table,
+                    virHashIterator iter,
+                    void *data)
+{
+    size_t i;
+    int ret;
+
+    if (table == NULL || iter == NULL)
+        return -1;
+
+    if (table->open) {
+        for (i = 0; i < table->size; i++) {
+            virHashOpenSlotPtr slot = table->slots + i;
+
+            if (!slot->name)
+                continue;
+            if ((ret = iter(slot->payload, slot->name, data)) < 0)
+                return ret;
+        }
+
+        return 0;
+    }
+
+    for (i = 0; i < table->size; i++) {
+        virHashEntryPtr entry;
+
+        for (entry = table->table[i]; entry; entry = entry->next) {
+            if ((ret = iter(entry->payload, entry->name, data)) < 0)
+                return ret;
+        }
+    }
+
+    return 0;
+}
+
+
 /**
  * virHashRemoveSet
  * @table: the hash table to process
@@ -648,6 +1001,31 @@ virHashRemoveSet(virHashTablePtr table,
 
     table->iterating = true;
     table->current = NULL;
+
+    if (table->open) {
+        for (i = 0; i < table->size; i++) {
+            virHashOpenSlotPtr slot = table->slots + i;
+
+            if (!slot->name)
+                continue;
+            if (iter(slot->payload, slot->name, data)) {
+                count++;
+                if (table->dataFree)
+                    table->dataFree(slot->payload, slot->name);
+                if (table->keyFree)
+                    table->keyFree(slot->name);
+                slot->name = NULL;
+                slot->payload = NULL;
+                slot->deleted = true;
+                table->ndeleted++;
+                table->nbElems--;
+            }
+        }
+        table->iterating = false;
+
+        return count;
+    }
+
     for (i = 0; i < table->size; i++) {
         virHashEntryPtr *nextptr = table->table + i;
 
@@ -725,6 +1103,24 @@ void *virHashSearch(const virHashTable *ctable,
 
     table->iterating = true;
     table->current = NULL;
+
+    if (table->open) {
+        for (i = 0; i < table->size; i++) {
+            virHashOpenSlotPtr slot = table->slots + i;
+
+            if (!slot->name)
+                continue;
+            table->currentIdx = i;
+            if (iter(slot->payload, slot->name, data)) {
+                table->iterating = false;
+                return slot->payload;
+            }
+        }
+        table->iterating = false;
+
+        return NULL;
+    }
+
     for (i = 0; i < table->size; i++) {
         virHashEntryPtr entry;
         for (entry = table->table[i]; entry; entry = entry->next) {
@@ -739,6 +1135,58 @@ void *virHashSearch(const virHashTable *ctable,
     return NULL;
 }
 
+
+/**
+ * virHashSearchConst:
+ * @table: the hash table to search
+ * @iter: an iterator to identify the desired element
+ * @data: extra opaque information passed to the iter
+ *
+ * Iterates over the hash table calling the 'iter' callback
+ * for each element. The first element for which the iter
+ * returns non-zero will be returned by this function.
+ * The elements are processed in a undefined order.
+ *
+ * Unlike virHashSearch this does not touch the table's iteration
+ * bookkeeping, so concurrent readers holding a shared lock may
+ * search the same table simultaneously; in exchange the callback
+ * must not modify the table in any way.
+ */
+void *
+virHashSearchConst(const virHashTable *table,
+                   virHashSearcher iter,
+                   const void *data)
+{
+    size_t i;
+
+    if (table == NULL || iter == NULL)
+        return NULL;
+
+    if (table->open) {
+        for (i = 0; i < table->size; i++) {
+            virHashOpenSlotPtr slot = table->slots + i;
+
+            if (!slot->name)
+                continue;
+            if (iter(slot->payload, slot->name, data))
+                return slot->payload;
+        }
+
+        return NULL;
+    }
+
+    for (i = 0; i < table->size; i++) {
+        virHashEntryPtr entry;
+
+        for (entry = table->table[i]; entry; entry = entry->next) {
+            if (iter(entry->payload, entry->name, data))
+                return entry->payload;
+        }
+    }
+
+    return NULL;
+}
+
 struct getKeysIter
 {
     virHashKeyValuePair *sortArray;
@@ -114,6 +114,14 @@ virHashTablePtr virHashCreateFull(ssize_t size,
                                   virHashKeyEqual keyEqual,
                                   virHashKeyCopy keyCopy,
                                   virHashKeyFree keyFree);
+virHashTablePtr virHashCreateOpen(ssize_t size,
+                                  virHashDataFree dataFree);
+virHashTablePtr virHashCreateOpenFull(ssize_t size,
+                                      virHashDataFree dataFree,
+                                      virHashKeyCode keyCode,
+                                      virHashKeyEqual keyEqual,
+                                      virHashKeyCopy keyCopy,
+                                      virHashKeyFree keyFree);
 void virHashFree(virHashTablePtr table);
 ssize_t virHashSize(const virHashTable *table);
 ssize_t virHashTableSize(const virHashTable *table);
@@ -192,9 +200,13 @@ bool virHashEqual(const virHashTable *table1,
  * Iterators
  */
 int virHashForEach(virHashTablePtr table, virHashIterator iter, void *data);
+int virHashForEachConst(const virHashTable *table, virHashIterator iter,
+                        void *data);
 ssize_t virHashRemoveSet(virHashTablePtr table, virHashSearcher iter, const void *data);
 void *virHashSearch(const virHashTable *table, virHashSearcher iter,
                     const void *data);
+void *virHashSearchConst(const virHashTable *table, virHashSearcher iter,
+                         const void *data);
 
 /* Convenience for when VIR_FREE(value) is sufficient as a data freer.  */
 void virHashValueFree(void *value, const void *name);
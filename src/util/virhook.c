@@ -36,6 +36,8 @@
 #include "virlog.h"
 #include "viralloc.h"
 #include "virfile.h"
+#include "virstring.h"
+#include "virthread.h"
 #include "configmake.h"
 #include "vircommand.h"
 
@@ -204,33 +206,14 @@ virHookPresent(int driver)
     return 1;
 }
 
-/**
- * virHookCall:
- * @driver: the driver number (from virHookDriver enum)
- * @id: an id for the object '-' if non available for example on daemon hooks
- * @op: the operation on the id e.g. VIR_HOOK_QEMU_OP_START
- * @sub_op: a sub_operation, currently unused
- * @extra: optional string information
- * @input: extra input given to the script on stdin
- * @output: optional address of variable to store malloced result buffer
- *
- * Implement a hook call, where the external script for the driver is
- * called with the given information. This is a synchronous call, we wait for
- * execution completion. If @output is non-NULL, *output is guaranteed to be
- * allocated after successful virHookCall, and is best-effort allocated after
- * failed virHookCall; the caller is responsible for freeing *output.
- *
- * Returns: 0 if the execution succeeded, 1 if the script was not found or
- *          invalid parameters, and -1 if script returned an error
- */
-int
-virHookCall(int driver,
-            const char *id,
-            int op,
-            int sub_op,
-            const char *extra,
-            const char *input,
-            char **output)
+static int
+virHookCallRun(int driver,
+               const char *id,
+               int op,
+               int sub_op,
+               const char *extra,
+               const char *input,
+               char **output)
 {
     int ret;
     char *path;
@@ -322,3 +305,221 @@ virHookCall(int driver,
 
     return ret;
 }
+
+/*
+ * Asynchronous hook support. Queued invocations are executed in
+ * order by a single persistent runner thread, so a caller which
+ * does not care about the script's exit status does not have to
+ * wait for the script interpreter to start up and finish.
+ */
+typedef struct _virHookAsyncCall virHookAsyncCall;
+typedef virHookAsyncCall *virHookAsyncCallPtr;
+struct _virHookAsyncCall {
+    virHookAsyncCallPtr next;
+    int driver;
+    char *id;
+    int op;
+    int sub_op;
+    char *extra;
+    char *input;
+};
+
+static virOnceControl virHookRunnerOnce = VIR_ONCE_CONTROL_INITIALIZER;
+static virMutex virHookRunnerLock;
+static virCond virHookRunnerCond;
+static virHookAsyncCallPtr virHookRunnerQueueHead;
+static virHookAsyncCallPtr virHookRunnerQueueTail;
+static bool virHookRunnerBusy;
+static bool virHookRunnerActive;
+
+static void
+virHookAsyncCallFree(virHookAsyncCallPtr call)
+{
+    if (!call)
+        return;
+
+    VIR_FREE(call->id);
+    VIR_FREE(call->extra);
+    VIR_FREE(call->input);
+    VIR_FREE(call);
+}
+
+static void
+virHookRunnerLoop(void *opaque ATTRIBUTE_UNUSED)
+{
+    virMutexLock(&virHookRunnerLock);
+    for (;;) {
+        virHookAsyncCallPtr call;
+
+        while (!virHookRunnerQueueHead) {
+            if (virCondWait(&virHookRunnerCond, &virHookRunnerLock) < 0) {
+                virHookRunnerActive = false;
+                virMutexUnlock(&virHookRunnerLock);
+                return;
+            }
+        }
+
+        call = virHookRunnerQueueHead;
+        virHookRunnerQueueHead = call->next;
+        if (!virHookRunnerQueueHead)
+            virHookRunnerQueueTail = NULL;
+        virHookRunnerBusy = true;
+        virMutexUnlock(&virHookRunnerLock);
+
+        if (virHookCallRun(call->driver, call->id, call->op, call->sub_op,
+                           call->extra, call->input, NULL) < 0)
+            VIR_WARN("Asynchronous hook for driver #%d failed: %s",
+                     call->driver, virGetLastErrorMessage());
+        virHookAsyncCallFree(call);
+
+        virMutexLock(&virHookRunnerLock);
+        virHookRunnerBusy = false;
+        virCondBroadcast(&virHookRunnerCond);
+    }
+}
+
+static void
+virHookRunnerInit(void)
+{
+    virThread thread;
+
+    if (virMutexInit(&virHookRunnerLock) < 0)
+        return;
+
+    if (virCondInit(&virHookRunnerCond) < 0)
+        goto error;
+
+    if (virThreadCreate(&thread, false, virHookRunnerLoop, NULL) < 0)
+        goto error;
+
+    virHookRunnerActive = true;
+    return;
+
+ error:
+    virMutexDestroy(&virHookRunnerLock);
+}
+
+/*
+ * Wait until all queued asynchronous invocations have finished, so
+ * that hook scripts observe the hook points in the order they fired.
+ */
+static void
+virHookRunnerDrain(void)
+{
+    if (!virHookRunnerActive)
+        return;
+
+    virMutexLock(&virHookRunnerLock);
+    while (virHookRunnerQueueHead || virHookRunnerBusy) {
+        if (virCondWait(&virHookRunnerCond, &virHookRunnerLock) < 0)
+            break;
+    }
+    virMutexUnlock(&virHookRunnerLock);
+}
+
+/**
+ * virHookCall:
+ * @driver: the driver number (from virHookDriver enum)
+ * @id: an id for the object '-' if non available for example on daemon hooks
+ * @op: the operation on the id e.g. VIR_HOOK_QEMU_OP_START
+ * @sub_op: a sub_operation, currently unused
+ * @extra: optional string information
+ * @input: extra input given to the script on stdin
+ * @output: optional address of variable to store malloced result buffer
+ *
+ * Implement a hook call, where the external script for the driver is
+ * called with the given information. This is a synchronous call, we wait for
+ * execution completion; any invocations queued earlier with
+ * virHookCallAsync are waited for first. If @output is non-NULL, *output
+ * is guaranteed to be allocated after successful virHookCall, and is
+ * best-effort allocated after failed virHookCall; the caller is
+ * responsible for freeing *output.
+ *
+ * Returns: 0 if the execution succeeded, 1 if the script was not found or
+ *          invalid parameters, and -1 if script returned an error
+ */
+int
+virHookCall(int driver,
+            const char *id,
+            int op,
+            int sub_op,
+            const char *extra,
+            const char *input,
+            char **output)
+{
+    virHookRunnerDrain();
+
+    return virHookCallRun(driver, id, op, sub_op, extra, input, output);
+}
+
+/**
+ * virHookCallAsync:
+ * @driver: the driver number (from virHookDriver enum)
+ * @id: an id for the object '-' if non available for example on daemon hooks
+ * @op: the operation on the id e.g. VIR_HOOK_QEMU_OP_STOPPED
+ * @sub_op: a sub_operation, currently unused
+ * @extra: optional string information
+ * @input: extra input given to the script on stdin
+ *
+ * Queue a hook call for execution by the persistent runner thread
+ * without waiting for its completion; only suitable for hook points
+ * whose exit status the caller ignores. Queued calls are executed in
+ * order, and a subsequent virHookCall waits for the queue to finish
+ * first. If no runner thread can be created the call is executed
+ * synchronously.
+ *
+ * Returns: 0 if the script was queued or executed successfully, 1 if
+ *          the script was not found or invalid parameters, and -1 if
+ *          a synchronously executed script returned an error
+ */
+int
+virHookCallAsync(int driver,
+                 const char *id,
+                 int op,
+                 int sub_op,
+                 const char *extra,
+                 const char *input)
+{
+    virHookAsyncCallPtr call = NULL;
+
+    if ((driver < VIR_HOOK_DRIVER_DAEMON) ||
+        (driver >= VIR_HOOK_DRIVER_LAST))
+        return 1;
+
+    if (virHooksFound == -1)
+        virHookInitialize();
+
+    if ((virHooksFound & (1 << driver)) == 0)
+        return 1;
+
+    if (virOnce(&virHookRunnerOnce, virHookRunnerInit) < 0 ||
+        !virHookRunnerActive)
+        goto sync;
+
+    if (VIR_ALLOC_QUIET(call) < 0)
+        goto sync;
+
+    call->driver = driver;
+    call->op = op;
+    call->sub_op = sub_op;
+
+    if (VIR_STRDUP_QUIET(call->id, id) < 0 ||
+        VIR_STRDUP_QUIET(call->extra, extra) < 0 ||
+        VIR_STRDUP_QUIET(call->input, input) < 0)
+        goto sync;
+
+    virMutexLock(&virHookRunnerLock);
+    if (virHookRunnerQueueTail)
+        virHookRunnerQueueTail->next = call;
+    else
+        virHookRunnerQueueHead = call;
+    virHookRunnerQueueTail = call;
+    virCondBroadcast(&virHookRunnerCond);
+    virMutexUnlock(&virHookRunnerLock);
+
+    return 0;
+
+ sync:
+    virHookAsyncCallFree(call);
+    return virHookCall(driver, id, op, sub_op, extra, input, NULL);
+}
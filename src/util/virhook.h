@@ -107,4 +107,7 @@ int virHookPresent(int driver);
 int virHookCall(int driver, const char *id, int op, int sub_op,
                 const char *extra, const char *input, char **output);
 
+int virHookCallAsync(int driver, const char *id, int op, int sub_op,
+                     const char *extra, const char *input);
+
 #endif /* __VIR_HOOKS_H__ */
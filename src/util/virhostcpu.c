@@ -56,6 +56,7 @@
 #include "virfile.h"
 #include "virtypedparam.h"
 #include "virstring.h"
+#include "virthread.h"
 #include "virnuma.h"
 #include "virlog.h"
 
@@ -65,6 +66,38 @@ VIR_LOG_INIT("util.hostcpu");
 
 #define KVM_DEVICE "/dev/kvm"
 
+/* Host CPU topology is stable unless CPUs are hotplugged, yet gathering it
+ * means reading many small sysfs files per CPU.  Cache the result of the
+ * first probe and hand out copies until the cache is invalidated, either
+ * explicitly (CPU hotplug events) or by a sysfs prefix change in tests.
+ */
+static virMutex virHostCPUInfoLock = VIR_MUTEX_INITIALIZER;
+static struct {
+    bool valid;
+    unsigned int cpus;
+    unsigned int mhz;
+    unsigned int nodes;
+    unsigned int sockets;
+    unsigned int cores;
+    unsigned int threads;
+} virHostCPUInfoCache;
+
+
+/**
+ * virHostCPUInfoInvalidate:
+ *
+ * Drop the cached host CPU topology; the next virHostCPUGetInfo call will
+ * probe the host again.  Should be called whenever a CPU is plugged or
+ * unplugged.
+ */
+void
+virHostCPUInfoInvalidate(void)
+{
+    virMutexLock(&virHostCPUInfoLock);
+    virHostCPUInfoCache.valid = false;
+    virMutexUnlock(&virHostCPUInfoLock);
+}
+
 
 #if defined(__FreeBSD__) || defined(__APPLE__)
 static int
@@ -204,6 +237,8 @@ void virHostCPUSetSysFSSystemPathLinux(const char *path)
         sysfs_system_path = path;
     else
         sysfs_system_path = SYSFS_SYSTEM_PATH;
+
+    virHostCPUInfoInvalidate();
 }
 
 /* Return the positive decimal contents of the given
@@ -952,14 +987,14 @@ virHostCPUParseMapLinux(int max_cpuid, const char *path)
 #endif
 
 
-int
-virHostCPUGetInfo(virArch hostarch ATTRIBUTE_UNUSED,
-                  unsigned int *cpus ATTRIBUTE_UNUSED,
-                  unsigned int *mhz ATTRIBUTE_UNUSED,
-                  unsigned int *nodes ATTRIBUTE_UNUSED,
-                  unsigned int *sockets ATTRIBUTE_UNUSED,
-                  unsigned int *cores ATTRIBUTE_UNUSED,
-                  unsigned int *threads ATTRIBUTE_UNUSED)
+static int
+virHostCPUGetInfoFresh(virArch hostarch ATTRIBUTE_UNUSED,
+                       unsigned int *cpus ATTRIBUTE_UNUSED,
+                       unsigned int *mhz ATTRIBUTE_UNUSED,
+                       unsigned int *nodes ATTRIBUTE_UNUSED,
+                       unsigned int *sockets ATTRIBUTE_UNUSED,
+                       unsigned int *cores ATTRIBUTE_UNUSED,
+                       unsigned int *threads ATTRIBUTE_UNUSED)
 {
 #ifdef __linux__
     int ret = -1;
@@ -1026,6 +1061,46 @@ virHostCPUGetInfo(virArch hostarch ATTRIBUTE_UNUSED,
 }
 
 
+int
+virHostCPUGetInfo(virArch hostarch,
+                  unsigned int *cpus,
+                  unsigned int *mhz,
+                  unsigned int *nodes,
+                  unsigned int *sockets,
+                  unsigned int *cores,
+                  unsigned int *threads)
+{
+    int ret = -1;
+
+    virMutexLock(&virHostCPUInfoLock);
+
+    if (!virHostCPUInfoCache.valid) {
+        if (virHostCPUGetInfoFresh(hostarch,
+                                   &virHostCPUInfoCache.cpus,
+                                   &virHostCPUInfoCache.mhz,
+                                   &virHostCPUInfoCache.nodes,
+                                   &virHostCPUInfoCache.sockets,
+                                   &virHostCPUInfoCache.cores,
+                                   &virHostCPUInfoCache.threads) < 0)
+            goto cleanup;
+        virHostCPUInfoCache.valid = true;
+    }
+
+    *cpus = virHostCPUInfoCache.cpus;
+    *mhz = virHostCPUInfoCache.mhz;
+    *nodes = virHostCPUInfoCache.nodes;
+    *sockets = virHostCPUInfoCache.sockets;
+    *cores = virHostCPUInfoCache.cores;
+    *threads = virHostCPUInfoCache.threads;
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virHostCPUInfoLock);
+    return ret;
+}
+
+
 int
 virHostCPUGetStats(int cpuNum ATTRIBUTE_UNUSED,
                    virNodeCPUStatsPtr params ATTRIBUTE_UNUSED,
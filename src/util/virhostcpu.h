@@ -50,6 +50,7 @@ int virHostCPUGetInfo(virArch hostarch,
                       unsigned int *sockets,
                       unsigned int *cores,
                       unsigned int *threads);
+void virHostCPUInfoInvalidate(void);
 
 int virHostCPUGetKVMMaxVCPUs(void);
 
@@ -40,6 +40,7 @@
 #include "virlog.h"
 #include "virutil.h"
 #include "virnetdev.h"
+#include "virthreadpool.h"
 #include "configmake.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -48,6 +49,8 @@ VIR_LOG_INIT("util.hostdev");
 
 #define HOSTDEV_STATE_DIR LOCALSTATEDIR "/run/libvirt/hostdevmgr"
 
+#define VIR_HOSTDEV_PCI_RESET_MAX_WORKERS 8
+
 static virHostdevManagerPtr manager; /* global hostdev manager, never freed */
 
 static virClassPtr virHostdevManagerClass;
@@ -146,6 +149,7 @@ virHostdevManagerDispose(void *obj)
     virObjectUnref(hostdevMgr->inactivePCIHostdevs);
     virObjectUnref(hostdevMgr->activeUSBHostdevs);
     virObjectUnref(hostdevMgr->activeSCSIHostdevs);
+    virObjectUnref(hostdevMgr->cachedPCIHostdevs);
     VIR_FREE(hostdevMgr->stateDir);
 }
 
@@ -170,6 +174,9 @@ virHostdevManagerNew(void)
     if (!(hostdevMgr->activeSCSIHostdevs = virSCSIDeviceListNew()))
         goto error;
 
+    if (!(hostdevMgr->cachedPCIHostdevs = virPCIDeviceListNew()))
+        goto error;
+
     if (privileged) {
         if (VIR_STRDUP(hostdevMgr->stateDir, HOSTDEV_STATE_DIR) < 0)
             goto error;
@@ -221,8 +228,67 @@ virHostdevManagerGetDefault(void)
     return virObjectRef(manager);
 }
 
+/**
+ * virHostdevInvalidatePCICache:
+ *
+ * Drop all cached host PCI device objects so the next prepare/reattach
+ * re-reads them from sysfs.  Called on udev events for the pci
+ * subsystem; a no-op when the hostdev manager was never instantiated.
+ */
+void
+virHostdevInvalidatePCICache(void)
+{
+    if (!manager)
+        return;
+
+    virObjectLock(manager->cachedPCIHostdevs);
+    while (virPCIDeviceListCount(manager->cachedPCIHostdevs) > 0)
+        virPCIDeviceListDel(manager->cachedPCIHostdevs,
+                            virPCIDeviceListGet(manager->cachedPCIHostdevs, 0));
+    virObjectUnlock(manager->cachedPCIHostdevs);
+}
+
+/* Look up a PCI device in the host inventory, falling back to a fresh
+ * sysfs scan on a cache miss.  The returned device is always a private
+ * copy carrying no per-use state (managed flag, stub driver, usage) */
+static virPCIDevicePtr
+virHostdevPCIDeviceNewCached(virHostdevManagerPtr mgr,
+                             unsigned int domain,
+                             unsigned int bus,
+                             unsigned int slot,
+                             unsigned int function)
+{
+    virPCIDevicePtr cached;
+    virPCIDevicePtr pci = NULL;
+
+    virObjectLock(mgr->cachedPCIHostdevs);
+
+    cached = virPCIDeviceListFindByIDs(mgr->cachedPCIHostdevs,
+                                       domain, bus, slot, function);
+
+    /* The device may have been unplugged since it was cached; checking
+     * for its config file is much cheaper than re-scanning it */
+    if (cached && !virFileExists(virPCIDeviceGetConfigPath(cached))) {
+        virPCIDeviceListDel(mgr->cachedPCIHostdevs, cached);
+        cached = NULL;
+    }
+
+    if (cached) {
+        pci = virPCIDeviceCopy(cached);
+    } else if ((pci = virPCIDeviceNew(domain, bus, slot, function))) {
+        /* The cache is best effort only */
+        if (virPCIDeviceListAddCopy(mgr->cachedPCIHostdevs, pci) < 0)
+            virResetLastError();
+    }
+
+    virObjectUnlock(mgr->cachedPCIHostdevs);
+    return pci;
+}
+
 static virPCIDeviceListPtr
-virHostdevGetPCIHostDeviceList(virDomainHostdevDefPtr *hostdevs, int nhostdevs)
+virHostdevGetPCIHostDeviceList(virHostdevManagerPtr mgr,
+                               virDomainHostdevDefPtr *hostdevs,
+                               int nhostdevs)
 {
     virPCIDeviceListPtr pcidevs;
     size_t i;
@@ -240,8 +306,11 @@ virHostdevGetPCIHostDeviceList(virDomainHostdevDefPtr *hostdevs, int nhostdevs)
         if (hostdev->source.subsys.type != VIR_DOMAIN_HOSTDEV_SUBSYS_TYPE_PCI)
             continue;
 
-        pci = virPCIDeviceNew(pcisrc->addr.domain, pcisrc->addr.bus,
-                              pcisrc->addr.slot, pcisrc->addr.function);
+        pci = virHostdevPCIDeviceNewCached(mgr,
+                                           pcisrc->addr.domain,
+                                           pcisrc->addr.bus,
+                                           pcisrc->addr.slot,
+                                           pcisrc->addr.function);
         if (!pci) {
             virObjectUnref(pcidevs);
             return NULL;
@@ -476,6 +545,173 @@ virHostdevNetConfigRestore(virDomainHostdevDefPtr hostdev,
     return ret;
 }
 
+struct virHostdevPCIResetState {
+    virHostdevManagerPtr mgr;
+    virMutex lock;
+    virCond cond;
+    size_t remaining;
+    virErrorPtr err;
+};
+
+struct virHostdevPCIResetJob {
+    struct virHostdevPCIResetState *state;
+    virPCIDevicePtr *devs; /* borrowed from the caller's device list */
+    size_t ndevs;
+};
+
+static void
+virHostdevPCIResetWorker(void *jobdata, void *opaque ATTRIBUTE_UNUSED)
+{
+    struct virHostdevPCIResetJob *job = jobdata;
+    struct virHostdevPCIResetState *state = job->state;
+    size_t i;
+
+    /* Devices sharing a bus are reset in sequence, because a secondary
+     * bus reset affects every function on the bus */
+    for (i = 0; i < job->ndevs; i++) {
+        VIR_DEBUG("Resetting PCI device %s",
+                  virPCIDeviceGetName(job->devs[i]));
+        if (virPCIDeviceReset(job->devs[i],
+                              state->mgr->activePCIHostdevs,
+                              state->mgr->inactivePCIHostdevs) < 0) {
+            virMutexLock(&state->lock);
+            if (!state->err)
+                state->err = virSaveLastError();
+            virMutexUnlock(&state->lock);
+            break;
+        }
+    }
+
+    virMutexLock(&state->lock);
+    state->remaining--;
+    virCondSignal(&state->cond);
+    virMutexUnlock(&state->lock);
+
+    VIR_FREE(job->devs);
+    VIR_FREE(job);
+}
+
+/*
+ * Reset every device in @pcidevs. Devices on separate buses are fully
+ * independent at this point, so their resets - which can each take
+ * hundreds of milliseconds of mandatory settle time - are issued
+ * concurrently; devices sharing a bus stay serialized with each other.
+ *
+ * The caller must hold the locks on @mgr's active and inactive device
+ * lists, and no device may be added to or removed from them until this
+ * function returns.
+ *
+ * Returns 0 on success, -1 on failure with the first error reported.
+ */
+static int
+virHostdevResetAllPCIDevices(virHostdevManagerPtr mgr,
+                             virPCIDeviceListPtr pcidevs)
+{
+    struct virHostdevPCIResetState state = { .mgr = mgr };
+    struct virHostdevPCIResetJob **jobs = NULL;
+    virThreadPoolPtr pool = NULL;
+    size_t njobs = 0;
+    size_t i, j;
+
+    /* Group the devices by domain:bus; each group becomes one job */
+    for (i = 0; i < virPCIDeviceListCount(pcidevs); i++) {
+        virPCIDevicePtr pci = virPCIDeviceListGet(pcidevs, i);
+        virPCIDeviceAddressPtr addr = virPCIDeviceGetAddress(pci);
+        struct virHostdevPCIResetJob *job = NULL;
+
+        for (j = 0; j < njobs; j++) {
+            virPCIDeviceAddressPtr first =
+                virPCIDeviceGetAddress(jobs[j]->devs[0]);
+
+            if (first->domain == addr->domain && first->bus == addr->bus) {
+                job = jobs[j];
+                break;
+            }
+        }
+
+        if (!job) {
+            if (VIR_ALLOC_QUIET(job) < 0)
+                goto serial;
+            job->state = &state;
+            if (VIR_APPEND_ELEMENT_COPY_QUIET(jobs, njobs, job) < 0) {
+                VIR_FREE(job);
+                goto serial;
+            }
+        }
+
+        if (VIR_APPEND_ELEMENT_COPY_QUIET(job->devs, job->ndevs, pci) < 0)
+            goto serial;
+    }
+
+    /* A single bus gains nothing from the pool */
+    if (njobs <= 1)
+        goto serial;
+
+    if (virMutexInit(&state.lock) < 0)
+        goto serial;
+    if (virCondInit(&state.cond) < 0) {
+        virMutexDestroy(&state.lock);
+        goto serial;
+    }
+
+    if (!(pool = virThreadPoolNew(0, MIN(njobs,
+                                         VIR_HOSTDEV_PCI_RESET_MAX_WORKERS),
+                                  0, virHostdevPCIResetWorker, NULL))) {
+        virResetLastError();
+        virCondDestroy(&state.cond);
+        virMutexDestroy(&state.lock);
+        goto serial;
+    }
+
+    for (i = 0; i < njobs; i++) {
+        virMutexLock(&state.lock);
+        state.remaining++;
+        virMutexUnlock(&state.lock);
+
+        if (virThreadPoolSendJob(pool, 0, jobs[i]) < 0) {
+            virResetLastError();
+            virHostdevPCIResetWorker(jobs[i], NULL);
+        }
+        jobs[i] = NULL; /* the worker frees the job */
+    }
+
+    virMutexLock(&state.lock);
+    while (state.remaining > 0) {
+        if (virCondWait(&state.cond, &state.lock) < 0)
+            break;
+    }
+    virMutexUnlock(&state.lock);
+
+    virThreadPoolFree(pool);
+    virCondDestroy(&state.cond);
+    virMutexDestroy(&state.lock);
+    VIR_FREE(jobs);
+
+    if (state.err) {
+        virSetError(state.err);
+        virFreeError(state.err);
+        return -1;
+    }
+    return 0;
+
+ serial:
+    for (i = 0; i < njobs; i++) {
+        VIR_FREE(jobs[i]->devs);
+        VIR_FREE(jobs[i]);
+    }
+    VIR_FREE(jobs);
+
+    for (i = 0; i < virPCIDeviceListCount(pcidevs); i++) {
+        virPCIDevicePtr pci = virPCIDeviceListGet(pcidevs, i);
+
+        VIR_DEBUG("Resetting PCI device %s", virPCIDeviceGetName(pci));
+        if (virPCIDeviceReset(pci, mgr->activePCIHostdevs,
+                              mgr->inactivePCIHostdevs) < 0)
+            return -1;
+    }
+    return 0;
+}
+
 int
 virHostdevPreparePCIDevices(virHostdevManagerPtr mgr,
                             const char *drv_name,
@@ -497,7 +733,7 @@ virHostdevPreparePCIDevices(virHostdevManagerPtr mgr,
     virObjectLock(mgr->activePCIHostdevs);
     virObjectLock(mgr->inactivePCIHostdevs);
 
-    if (!(pcidevs = virHostdevGetPCIHostDeviceList(hostdevs, nhostdevs)))
+    if (!(pcidevs = virHostdevGetPCIHostDeviceList(mgr, hostdevs, nhostdevs)))
         goto cleanup;
 
     /* Detaching devices from the host involves several steps; each
@@ -611,31 +847,29 @@ virHostdevPreparePCIDevices(virHostdevManagerPtr mgr,
      * been marked as inactive */
 
     /* Step 3: Now that all the PCI hostdevs have been detached, we
-     * can safely reset them */
-    for (i = 0; i < virPCIDeviceListCount(pcidevs); i++) {
-        virPCIDevicePtr pci = virPCIDeviceListGet(pcidevs, i);
-
-        /* We can avoid looking up the actual device here, because performing
-         * a PCI reset on a device doesn't require any information other than
-         * the address, which 'pci' already contains */
-        VIR_DEBUG("Resetting PCI device %s", virPCIDeviceGetName(pci));
-        if (virPCIDeviceReset(pci, mgr->activePCIHostdevs,
-                              mgr->inactivePCIHostdevs) < 0)
-            goto reattachdevs;
-    }
+     * can safely reset them, running independent buses in parallel.
+     * We can avoid looking up the actual devices here, because performing
+     * a PCI reset on a device doesn't require any information other than
+     * the address, which 'pcidevs' already contains */
+    if (virHostdevResetAllPCIDevices(mgr, pcidevs) < 0)
+        goto reattachdevs;
 
     /* Step 4: For SRIOV network devices, Now that we have detached the
-     * the network device, set the netdev config */
+     * the network device, set the netdev config.  VFs sharing a PF also
+     * share one PF probe thanks to the batch */
+    virNetDevVfConfigBatchBegin();
     for (i = 0; i < nhostdevs; i++) {
          virDomainHostdevDefPtr hostdev = hostdevs[i];
          if (!virHostdevIsPCINetDevice(hostdev))
              continue;
          if (virHostdevNetConfigReplace(hostdev, uuid,
                                         mgr->stateDir) < 0) {
+             virNetDevVfConfigBatchEnd();
              goto resetvfnetconfig;
          }
          last_processed_hostdev_vf = i;
     }
+    virNetDevVfConfigBatchEnd();
 
     /* Step 5: Move devices from the inactive list to the active list */
     for (i = 0; i < virPCIDeviceListCount(pcidevs); i++) {
@@ -808,7 +1042,7 @@ virHostdevReAttachPCIDevices(virHostdevManagerPtr mgr,
     virObjectLock(mgr->activePCIHostdevs);
     virObjectLock(mgr->inactivePCIHostdevs);
 
-    if (!(pcidevs = virHostdevGetPCIHostDeviceList(hostdevs, nhostdevs))) {
+    if (!(pcidevs = virHostdevGetPCIHostDeviceList(mgr, hostdevs, nhostdevs))) {
         VIR_ERROR(_("Failed to allocate PCI device list: %s"),
                   virGetLastErrorMessage());
         virResetLastError();
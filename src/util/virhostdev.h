@@ -53,9 +53,15 @@ struct _virHostdevManager {
     virPCIDeviceListPtr inactivePCIHostdevs;
     virUSBDeviceListPtr activeUSBHostdevs;
     virSCSIDeviceListPtr activeSCSIHostdevs;
+
+    /* Host PCI device inventory; avoids re-reading config space and
+     * sysfs attributes on every prepare/reattach.  Invalidated on PCI
+     * udev events via virHostdevInvalidatePCICache */
+    virPCIDeviceListPtr cachedPCIHostdevs;
 };
 
 virHostdevManagerPtr virHostdevManagerGetDefault(void);
+void virHostdevInvalidatePCICache(void);
 int
 virHostdevPreparePCIDevices(virHostdevManagerPtr hostdev_mgr,
                             const char *drv_name,
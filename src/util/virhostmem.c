@@ -49,6 +49,9 @@
 #include "virfile.h"
 #include "virtypedparam.h"
 #include "virstring.h"
+#include "virhash.h"
+#include "virthread.h"
+#include "virtime.h"
 #include "virnuma.h"
 #include "virlog.h"
 
@@ -249,6 +252,115 @@ virHostMemGetStatsLinux(FILE *meminfo,
  cleanup:
     return ret;
 }
+
+
+/* Memory stats are polled every few seconds by each monitoring client;
+ * cache the parsed result for a short while so that concurrent clients
+ * share a single /proc/meminfo (or per-node meminfo) parse.
+ */
+# define HOST_MEM_STATS_TTL_MS 1000
+
+typedef struct _virHostMemStatsCacheEntry virHostMemStatsCacheEntry;
+typedef virHostMemStatsCacheEntry *virHostMemStatsCacheEntryPtr;
+struct _virHostMemStatsCacheEntry {
+    unsigned long long fetched;  /* virTimeMillisNow timestamp of the parse */
+    int nparams;
+    virNodeMemoryStats params[LINUX_NB_MEMORY_STATS_ALL];
+};
+
+static virMutex virHostMemStatsLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virHostMemStatsCache;
+
+static int
+virHostMemGetStatsLinuxCached(int cellNum,
+                              virNodeMemoryStatsPtr params,
+                              int *nparams)
+{
+    char key[32];
+    virHostMemStatsCacheEntryPtr entry;
+    unsigned long long now;
+    int ret = -1;
+
+    snprintf(key, sizeof(key), "%d", cellNum);
+
+    virMutexLock(&virHostMemStatsLock);
+
+    if (virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    if (!virHostMemStatsCache &&
+        !(virHostMemStatsCache = virHashCreate(4, virHashValueFree)))
+        goto cleanup;
+
+    entry = virHashLookup(virHostMemStatsCache, key);
+    if (!entry || now - entry->fetched > HOST_MEM_STATS_TTL_MS) {
+        virHostMemStatsCacheEntryPtr fresh;
+        char *meminfo_path = NULL;
+        FILE *meminfo;
+        int rc;
+
+        if (VIR_ALLOC(fresh) < 0)
+            goto cleanup;
+
+        fresh->nparams = cellNum == VIR_NODE_MEMORY_STATS_ALL_CELLS ?
+                         LINUX_NB_MEMORY_STATS_ALL : LINUX_NB_MEMORY_STATS_CELL;
+        fresh->fetched = now;
+
+        if (cellNum == VIR_NODE_MEMORY_STATS_ALL_CELLS) {
+            if (VIR_STRDUP(meminfo_path, MEMINFO_PATH) < 0) {
+                VIR_FREE(fresh);
+                goto cleanup;
+            }
+        } else {
+            if (virAsprintf(&meminfo_path,
+                            SYSFS_SYSTEM_PATH "/node/node%d/meminfo",
+                            cellNum) < 0) {
+                VIR_FREE(fresh);
+                goto cleanup;
+            }
+        }
+
+        if (!(meminfo = fopen(meminfo_path, "r"))) {
+            virReportSystemError(errno,
+                                 _("cannot open %s"), meminfo_path);
+            VIR_FREE(meminfo_path);
+            VIR_FREE(fresh);
+            goto cleanup;
+        }
+
+        rc = virHostMemGetStatsLinux(meminfo, cellNum,
+                                     fresh->params, &fresh->nparams);
+        VIR_FORCE_FCLOSE(meminfo);
+        VIR_FREE(meminfo_path);
+
+        if (rc < 0 || virHashUpdateEntry(virHostMemStatsCache, key, fresh) < 0) {
+            VIR_FREE(fresh);
+            goto cleanup;
+        }
+
+        entry = fresh;
+    }
+
+    if ((*nparams) == 0) {
+        *nparams = entry->nparams;
+        ret = 0;
+        goto cleanup;
+    }
+
+    if ((*nparams) != entry->nparams) {
+        virReportInvalidArg(nparams,
+                            _("nparams in %s must be %d"),
+                            __FUNCTION__, entry->nparams);
+        goto cleanup;
+    }
+
+    memcpy(params, entry->params, entry->nparams * sizeof(*params));
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virHostMemStatsLock);
+    return ret;
+}
 #endif
 
 
@@ -262,15 +374,9 @@ virHostMemGetStats(int cellNum ATTRIBUTE_UNUSED,
 
 #ifdef __linux__
     {
-        int ret;
-        char *meminfo_path = NULL;
-        FILE *meminfo;
         int max_node;
 
-        if (cellNum == VIR_NODE_MEMORY_STATS_ALL_CELLS) {
-            if (VIR_STRDUP(meminfo_path, MEMINFO_PATH) < 0)
-                return -1;
-        } else {
+        if (cellNum != VIR_NODE_MEMORY_STATS_ALL_CELLS) {
             if ((max_node = virNumaGetMaxNode()) < 0)
                 return -1;
 
@@ -280,25 +386,9 @@ virHostMemGetStats(int cellNum ATTRIBUTE_UNUSED,
                                     __FUNCTION__, max_node);
                 return -1;
             }
-
-            if (virAsprintf(&meminfo_path,
-                            SYSFS_SYSTEM_PATH "/node/node%d/meminfo",
-                            cellNum) < 0)
-                return -1;
         }
-        meminfo = fopen(meminfo_path, "r");
-
-        if (!meminfo) {
-            virReportSystemError(errno,
-                                 _("cannot open %s"), meminfo_path);
-            VIR_FREE(meminfo_path);
-            return -1;
-        }
-        ret = virHostMemGetStatsLinux(meminfo, cellNum, params, nparams);
-        VIR_FORCE_FCLOSE(meminfo);
-        VIR_FREE(meminfo_path);
 
-        return ret;
+        return virHostMemGetStatsLinuxCached(cellNum, params, nparams);
     }
 #elif defined(__FreeBSD__)
     return virHostMemGetStatsFreeBSD(params, nparams);
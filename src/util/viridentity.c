@@ -45,6 +45,20 @@ struct _virIdentity {
     virObject parent;
 
     char *attrs[VIR_IDENTITY_ATTR_LAST];
+
+    /* Memoized numeric forms of the attrs above, populated by the
+     * typed setters during construction.  Attributes can only be set
+     * once and identities are immutable once shared, so the getters
+     * can read these without locking; attributes set through the
+     * generic virIdentitySetAttr fall back to parsing the string. */
+    bool uidCached;
+    uid_t uid;
+    bool gidCached;
+    gid_t gid;
+    bool pidCached;
+    pid_t pid;
+    bool ptimeCached;
+    unsigned long long ptime;
 };
 
 static virClassPtr virIdentityClass;
@@ -332,6 +346,11 @@ int virIdentityGetUNIXUserID(virIdentityPtr ident,
     int val;
     const char *userid;
 
+    if (ident->uidCached) {
+        *uid = ident->uid;
+        return 0;
+    }
+
     *uid = -1;
     if (virIdentityGetAttr(ident,
                            VIR_IDENTITY_ATTR_UNIX_USER_ID,
@@ -364,6 +383,11 @@ int virIdentityGetUNIXGroupID(virIdentityPtr ident,
     int val;
     const char *groupid;
 
+    if (ident->gidCached) {
+        *gid = ident->gid;
+        return 0;
+    }
+
     *gid = -1;
     if (virIdentityGetAttr(ident,
                            VIR_IDENTITY_ATTR_UNIX_GROUP_ID,
@@ -388,6 +412,11 @@ int virIdentityGetUNIXProcessID(virIdentityPtr ident,
     unsigned long long val;
     const char *processid;
 
+    if (ident->pidCached) {
+        *pid = ident->pid;
+        return 0;
+    }
+
     *pid = 0;
     if (virIdentityGetAttr(ident,
                            VIR_IDENTITY_ATTR_UNIX_PROCESS_ID,
@@ -410,6 +439,12 @@ int virIdentityGetUNIXProcessTime(virIdentityPtr ident,
                                   unsigned long long *timestamp)
 {
     const char *processtime;
+
+    if (ident->ptimeCached) {
+        *timestamp = ident->ptime;
+        return 0;
+    }
+
     if (virIdentityGetAttr(ident,
                            VIR_IDENTITY_ATTR_UNIX_PROCESS_TIME,
                            &processtime) < 0)
@@ -472,6 +507,10 @@ int virIdentitySetUNIXUserID(virIdentityPtr ident,
                              VIR_IDENTITY_ATTR_UNIX_USER_ID,
                              val);
     VIR_FREE(val);
+    if (ret == 0) {
+        ident->uid = uid;
+        ident->uidCached = true;
+    }
     return ret;
 }
 
@@ -496,6 +535,10 @@ int virIdentitySetUNIXGroupID(virIdentityPtr ident,
                              VIR_IDENTITY_ATTR_UNIX_GROUP_ID,
                              val);
     VIR_FREE(val);
+    if (ret == 0) {
+        ident->gid = gid;
+        ident->gidCached = true;
+    }
     return ret;
 }
 
@@ -511,6 +554,10 @@ int virIdentitySetUNIXProcessID(virIdentityPtr ident,
                              VIR_IDENTITY_ATTR_UNIX_PROCESS_ID,
                              val);
     VIR_FREE(val);
+    if (ret == 0) {
+        ident->pid = pid;
+        ident->pidCached = true;
+    }
     return ret;
 }
 
@@ -526,6 +573,10 @@ int virIdentitySetUNIXProcessTime(virIdentityPtr ident,
                              VIR_IDENTITY_ATTR_UNIX_PROCESS_TIME,
                              val);
     VIR_FREE(val);
+    if (ret == 0) {
+        ident->ptime = timestamp;
+        ident->ptimeCached = true;
+    }
     return ret;
 }
 
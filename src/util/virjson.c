@@ -65,9 +65,97 @@ struct _virJSONParser {
     virJSONParserStatePtr state;
     size_t nstate;
     int wrap;
+    virAllocPoolPtr pool; /* arena to build the tree from, or NULL */
 };
 
 
+/* Allocate a value struct either from @pool or from the heap */
+static virJSONValuePtr
+virJSONValueNewRaw(virAllocPoolPtr pool,
+                   virJSONType type)
+{
+    virJSONValuePtr val;
+
+    if (pool) {
+        if (!(val = virAllocPoolAlloc(pool, sizeof(*val))))
+            return NULL;
+    } else if (VIR_ALLOC(val) < 0) {
+        return NULL;
+    }
+
+    val->type = type;
+    val->pool = pool;
+    return val;
+}
+
+static char *
+virJSONStrndupPool(virAllocPoolPtr pool,
+                   const char *data,
+                   size_t length)
+{
+    char *ret;
+
+    if (pool) {
+        if (!(ret = virAllocPoolAlloc(pool, length + 1)))
+            return NULL;
+        memcpy(ret, data, length);
+        return ret;
+    }
+
+    if (VIR_STRNDUP(ret, data, length) < 0)
+        return NULL;
+    return ret;
+}
+
+/* Make room for one more pair.  Arena backed objects cannot realloc,
+ * so their pairs array doubles whenever a power of two is crossed and
+ * the abandoned copy stays in the arena until the tree is freed.
+ */
+static int
+virJSONObjectPairsReserve(virJSONValuePtr object)
+{
+    size_t npairs = object->data.object.npairs;
+    virJSONObjectPairPtr newPairs;
+
+    if (!object->pool)
+        return VIR_REALLOC_N(object->data.object.pairs, npairs + 1);
+
+    if (npairs & (npairs - 1))
+        return 0; /* not at a power of two, capacity remains */
+
+    if (!(newPairs = virAllocPoolAlloc(object->pool,
+                                       sizeof(*newPairs) *
+                                       (npairs ? npairs * 2 : 1))))
+        return -1;
+    memcpy(newPairs, object->data.object.pairs,
+           sizeof(*newPairs) * npairs);
+    object->data.object.pairs = newPairs;
+    return 0;
+}
+
+static int
+virJSONArrayValuesReserve(virJSONValuePtr array)
+{
+    size_t nvalues = array->data.array.nvalues;
+    virJSONValuePtr *newValues;
+
+    if (!array->pool)
+        return VIR_REALLOC_N(array->data.array.values, nvalues + 1);
+
+    if (nvalues & (nvalues - 1))
+        return 0;
+
+    if (!(newValues = virAllocPoolAlloc(array->pool,
+                                        sizeof(*newValues) *
+                                        (nvalues ? nvalues * 2 : 1))))
+        return -1;
+    memcpy(newValues, array->data.array.values,
+           sizeof(*newValues) * nvalues);
+    array->data.array.values = newValues;
+    return 0;
+}
+
+
 /**
  * virJSONValueObjectAddVArgs:
  * @obj: JSON object to add the values to
@@ -348,6 +436,14 @@ virJSONValueFree(virJSONValuePtr value)
     if (!value || value->protect)
         return;
 
+    /* Arena backed values share their storage with the whole tree;
+     * only freeing the root releases anything */
+    if (value->pool) {
+        if (value->poolRoot)
+            virAllocPoolFree(value->pool);
+        return;
+    }
+
     switch ((virJSONType) value->type) {
     case VIR_JSON_TYPE_OBJECT:
         for (i = 0; i < value->data.object.npairs; i++) {
@@ -559,6 +655,31 @@ virJSONValueNewObject(void)
 }
 
 
+/* Append @value under @key, taking ownership of @key, which must come
+ * from the object's arena when the object is arena backed.
+ */
+static int
+virJSONValueObjectAppendKey(virJSONValuePtr object,
+                            char *key,
+                            virJSONValuePtr value)
+{
+    if (object->type != VIR_JSON_TYPE_OBJECT)
+        return -1;
+
+    if (virJSONValueObjectHasKey(object, key))
+        return -1;
+
+    if (virJSONObjectPairsReserve(object) < 0)
+        return -1;
+
+    object->data.object.pairs[object->data.object.npairs].key = key;
+    object->data.object.pairs[object->data.object.npairs].value = value;
+    object->data.object.npairs++;
+
+    return 0;
+}
+
+
 int
 virJSONValueObjectAppend(virJSONValuePtr object,
                          const char *key,
@@ -572,19 +693,15 @@ virJSONValueObjectAppend(virJSONValuePtr object,
     if (virJSONValueObjectHasKey(object, key))
         return -1;
 
-    if (VIR_STRDUP(newkey, key) < 0)
+    if (!(newkey = virJSONStrndupPool(object->pool, key, strlen(key))))
         return -1;
 
-    if (VIR_REALLOC_N(object->data.object.pairs,
-                      object->data.object.npairs + 1) < 0) {
-        VIR_FREE(newkey);
+    if (virJSONValueObjectAppendKey(object, newkey, value) < 0) {
+        if (!object->pool)
+            VIR_FREE(newkey);
         return -1;
     }
 
-    object->data.object.pairs[object->data.object.npairs].key = newkey;
-    object->data.object.pairs[object->data.object.npairs].value = value;
-    object->data.object.npairs++;
-
     return 0;
 }
 
@@ -723,8 +840,7 @@ virJSONValueArrayAppend(virJSONValuePtr array,
     if (array->type != VIR_JSON_TYPE_ARRAY)
         return -1;
 
-    if (VIR_REALLOC_N(array->data.array.values,
-                      array->data.array.nvalues + 1) < 0)
+    if (virJSONArrayValuesReserve(array) < 0)
         return -1;
 
     array->data.array.values[array->data.array.nvalues] = value;
@@ -810,7 +926,9 @@ virJSONValueObjectGetKey(virJSONValuePtr object,
 
 
 /* Remove the key-value pair tied to @key out of @object.  If @value is
- * not NULL, the dropped value object is returned instead of freed.
+ * not NULL, the dropped value object is returned instead of freed; for
+ * arena backed objects an independently owned deep copy is handed out
+ * since the original shares storage with the whole tree.
  * Returns 1 on success, 0 if no key was found, and -1 on error.  */
 int
 virJSONValueObjectRemoveKey(virJSONValuePtr object,
@@ -828,13 +946,28 @@ virJSONValueObjectRemoveKey(virJSONValuePtr object,
     for (i = 0; i < object->data.object.npairs; i++) {
         if (STREQ(object->data.object.pairs[i].key, key)) {
             if (value) {
-                *value = object->data.object.pairs[i].value;
+                if (object->data.object.pairs[i].value->pool) {
+                    if (!(*value =
+                          virJSONValueCopy(object->data.object.pairs[i].value)))
+                        return -1;
+                } else {
+                    *value = object->data.object.pairs[i].value;
+                }
                 object->data.object.pairs[i].value = NULL;
             }
-            VIR_FREE(object->data.object.pairs[i].key);
-            virJSONValueFree(object->data.object.pairs[i].value);
-            VIR_DELETE_ELEMENT(object->data.object.pairs, i,
-                               object->data.object.npairs);
+            if (object->pool) {
+                virJSONValueFree(object->data.object.pairs[i].value);
+                memmove(object->data.object.pairs + i,
+                        object->data.object.pairs + i + 1,
+                        sizeof(*object->data.object.pairs) *
+                        (object->data.object.npairs - i - 1));
+                object->data.object.npairs--;
+            } else {
+                VIR_FREE(object->data.object.pairs[i].key);
+                virJSONValueFree(object->data.object.pairs[i].value);
+                VIR_DELETE_ELEMENT(object->data.object.pairs, i,
+                                   object->data.object.npairs);
+            }
             return 1;
         }
     }
@@ -902,9 +1035,23 @@ virJSONValueArraySteal(virJSONValuePtr array,
 
     ret = array->data.array.values[element];
 
-    VIR_DELETE_ELEMENT(array->data.array.values,
-                       element,
-                       array->data.array.nvalues);
+    /* Arena backed elements share storage with the whole tree, so the
+     * caller gets an independently owned deep copy instead */
+    if (ret->pool &&
+        !(ret = virJSONValueCopy(ret)))
+        return NULL;
+
+    if (array->pool) {
+        memmove(array->data.array.values + element,
+                array->data.array.values + element + 1,
+                sizeof(*array->data.array.values) *
+                (array->data.array.nvalues - element - 1));
+        array->data.array.nvalues--;
+    } else {
+        VIR_DELETE_ELEMENT(array->data.array.values,
+                           element,
+                           array->data.array.nvalues);
+    }
 
     return ret;
 }
@@ -1304,6 +1451,17 @@ virJSONValueCopy(const virJSONValue *in)
 
 
 #if WITH_YAJL
+/* Drop a pending map key; arena allocated keys stay in the arena */
+static void
+virJSONParserClearKey(virJSONParserPtr parser,
+                      virJSONParserStatePtr state)
+{
+    if (parser->pool)
+        state->key = NULL;
+    else
+        VIR_FREE(state->key);
+}
+
 static int
 virJSONParserInsertValue(virJSONParserPtr parser,
                          virJSONValuePtr value)
@@ -1326,12 +1484,12 @@ virJSONParserInsertValue(virJSONParserPtr parser,
                 return -1;
             }
 
-            if (virJSONValueObjectAppend(state->value,
-                                         state->key,
-                                         value) < 0)
+            if (virJSONValueObjectAppendKey(state->value,
+                                            state->key,
+                                            value) < 0)
                 return -1;
 
-            VIR_FREE(state->key);
+            state->key = NULL;
         }   break;
 
         case VIR_JSON_TYPE_ARRAY: {
@@ -1359,7 +1517,8 @@ static int
 virJSONParserHandleNull(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewNull();
+    virJSONValuePtr value = virJSONValueNewRaw(parser->pool,
+                                               VIR_JSON_TYPE_NULL);
 
     VIR_DEBUG("parser=%p", parser);
 
@@ -1380,10 +1539,14 @@ virJSONParserHandleBoolean(void *ctx,
                            int boolean_)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewBoolean(boolean_);
+    virJSONValuePtr value = virJSONValueNewRaw(parser->pool,
+                                               VIR_JSON_TYPE_BOOLEAN);
 
     VIR_DEBUG("parser=%p boolean=%d", parser, boolean_);
 
+    if (value)
+        value->data.boolean = boolean_;
+
     if (!value)
         return 0;
 
@@ -1402,19 +1565,19 @@ virJSONParserHandleNumber(void *ctx,
                           yajl_size_t l)
 {
     virJSONParserPtr parser = ctx;
-    char *str;
-    virJSONValuePtr value;
-
-    if (VIR_STRNDUP(str, s, l) < 0)
-        return -1;
-    value = virJSONValueNewNumber(str);
-    VIR_FREE(str);
+    virJSONValuePtr value = virJSONValueNewRaw(parser->pool,
+                                               VIR_JSON_TYPE_NUMBER);
 
-    VIR_DEBUG("parser=%p str=%s", parser, str);
+    VIR_DEBUG("parser=%p", parser);
 
     if (!value)
         return 0;
 
+    if (!(value->data.number = virJSONStrndupPool(parser->pool, s, l))) {
+        virJSONValueFree(value);
+        return 0;
+    }
+
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
         return 0;
@@ -1430,14 +1593,21 @@ virJSONParserHandleString(void *ctx,
                           yajl_size_t stringLen)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewStringLen((const char *)stringVal,
-                                                     stringLen);
+    virJSONValuePtr value = virJSONValueNewRaw(parser->pool,
+                                               VIR_JSON_TYPE_STRING);
 
     VIR_DEBUG("parser=%p str=%p", parser, (const char *)stringVal);
 
     if (!value)
         return 0;
 
+    if (!(value->data.string = virJSONStrndupPool(parser->pool,
+                                                  (const char *)stringVal,
+                                                  stringLen))) {
+        virJSONValueFree(value);
+        return 0;
+    }
+
     if (virJSONParserInsertValue(parser, value) < 0) {
         virJSONValueFree(value);
         return 0;
@@ -1463,7 +1633,9 @@ virJSONParserHandleMapKey(void *ctx,
     state = &parser->state[parser->nstate-1];
     if (state->key)
         return 0;
-    if (VIR_STRNDUP(state->key, (const char *)stringVal, stringLen) < 0)
+    if (!(state->key = virJSONStrndupPool(parser->pool,
+                                          (const char *)stringVal,
+                                          stringLen)))
         return 0;
     return 1;
 }
@@ -1473,7 +1645,8 @@ static int
 virJSONParserHandleStartMap(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewObject();
+    virJSONValuePtr value = virJSONValueNewRaw(parser->pool,
+                                               VIR_JSON_TYPE_OBJECT);
 
     VIR_DEBUG("parser=%p", parser);
 
@@ -1511,7 +1684,7 @@ virJSONParserHandleEndMap(void *ctx)
 
     state = &(parser->state[parser->nstate-1]);
     if (state->key) {
-        VIR_FREE(state->key);
+        virJSONParserClearKey(parser, state);
         return 0;
     }
 
@@ -1525,7 +1698,8 @@ static int
 virJSONParserHandleStartArray(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewArray();
+    virJSONValuePtr value = virJSONValueNewRaw(parser->pool,
+                                               VIR_JSON_TYPE_ARRAY);
 
     VIR_DEBUG("parser=%p", parser);
 
@@ -1562,7 +1736,7 @@ virJSONParserHandleEndArray(void *ctx)
 
     state = &(parser->state[parser->nstate-1]);
     if (state->key) {
-        VIR_FREE(state->key);
+        virJSONParserClearKey(parser, state);
         return 0;
     }
 
@@ -1588,11 +1762,12 @@ static const yajl_callbacks parserCallbacks = {
 
 
 /* XXX add an incremental streaming parser - yajl trivially supports it */
-virJSONValuePtr
-virJSONValueFromString(const char *jsonstring)
+static virJSONValuePtr
+virJSONValueFromStringInternal(const char *jsonstring,
+                               virAllocPoolPtr pool)
 {
     yajl_handle hand;
-    virJSONParser parser = { NULL, NULL, 0, 0 };
+    virJSONParser parser = { NULL, NULL, 0, 0, pool };
     virJSONValuePtr ret = NULL;
     int rc;
     size_t len = strlen(jsonstring);
@@ -1672,7 +1847,7 @@ virJSONValueFromString(const char *jsonstring)
     if (parser.nstate) {
         size_t i;
         for (i = 0; i < parser.nstate; i++)
-            VIR_FREE(parser.state[i].key);
+            virJSONParserClearKey(&parser, &parser.state[i]);
         VIR_FREE(parser.state);
     }
 
@@ -1682,6 +1857,52 @@ virJSONValueFromString(const char *jsonstring)
 }
 
 
+virJSONValuePtr
+virJSONValueFromString(const char *jsonstring)
+{
+    return virJSONValueFromStringInternal(jsonstring, NULL);
+}
+
+
+/**
+ * virJSONValueFromStringArena:
+ * @jsonstring: JSON document to parse
+ *
+ * Parse @jsonstring with every value struct and string drawn from one
+ * arena, which is released in a single shot when the returned root is
+ * passed to virJSONValueFree.  This avoids the per-node malloc/free
+ * churn of virJSONValueFromString on hot paths that parse and discard
+ * many documents, e.g. the QEMU monitor.
+ *
+ * The returned tree must be treated as read-only; the only permitted
+ * mutations are virJSONValueObjectRemoveKey and virJSONValueArraySteal,
+ * which hand out independently owned deep copies of arena values.
+ *
+ * Returns the parsed tree, or NULL on failure.
+ */
+virJSONValuePtr
+virJSONValueFromStringArena(const char *jsonstring)
+{
+    virAllocPoolPtr pool;
+    virJSONValuePtr ret;
+
+    if (!(pool = virAllocPoolNew(0)))
+        return NULL;
+
+    ret = virJSONValueFromStringInternal(jsonstring, pool);
+
+    /* With older yajl the result is unwrapped via virJSONValueArraySteal,
+     * which already returns a heap copy not referencing the arena */
+    if (ret && ret->pool == pool) {
+        ret->poolRoot = true;
+        return ret;
+    }
+
+    virAllocPoolFree(pool);
+    return ret;
+}
+
+
 static int
 virJSONValueToStringOne(virJSONValuePtr object,
                         yajl_gen g)
@@ -1808,6 +2029,15 @@ virJSONValueFromString(const char *jsonstring ATTRIBUTE_UNUSED)
 }
 
 
+virJSONValuePtr
+virJSONValueFromStringArena(const char *jsonstring ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return NULL;
+}
+
+
 char *
 virJSONValueToString(virJSONValuePtr object ATTRIBUTE_UNUSED,
                      bool pretty ATTRIBUTE_UNUSED)
@@ -25,6 +25,7 @@
 # define __VIR_JSON_H_
 
 # include "internal.h"
+# include "viralloc.h"
 # include "virbitmap.h"
 
 # include <stdarg.h>
@@ -70,6 +71,8 @@ struct _virJSONArray {
 struct _virJSONValue {
     int type; /* enum virJSONType */
     bool protect; /* prevents deletion when embedded in another object */
+    bool poolRoot; /* this value owns @pool */
+    virAllocPoolPtr pool; /* arena all storage was allocated from, or NULL */
 
     union {
         virJSONObject object;
@@ -160,6 +163,7 @@ int virJSONValueObjectRemoveKey(virJSONValuePtr object, const char *key,
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 
 virJSONValuePtr virJSONValueFromString(const char *jsonstring);
+virJSONValuePtr virJSONValueFromStringArena(const char *jsonstring);
 char *virJSONValueToString(virJSONValuePtr object,
                            bool pretty);
 
@@ -95,3 +95,37 @@ for i in range(len(cols)):
             print "  " + (entry[i] or "-1") + ","
 
     print "};\n"
+
+# Direct-index tables mapping a keycode value to its table row, so
+# translating between codesets is an array lookup instead of a scan
+# over every entry. Where a value appears more than once the first
+# row wins, matching what a linear search would have found.
+for i in range(len(cols)):
+    col=cols[i]
+    name=col[0]
+    isname=col[1]
+
+    if name is None or isname:
+        continue
+
+    index = {}
+    maxvalue = 0
+    for row in range(len(keycodes)):
+        v = keycodes[row][i]
+        if not v:
+            continue
+        v = int(v, 0)
+        if v < 0:
+            continue
+        if v not in index:
+            index[v] = row
+        if v > maxvalue:
+            maxvalue = v
+
+    print "#define VIR_KEYMAP_VALUE_MAX_" + name + " " + str(maxvalue)
+    print "int virKeymapIndex_" + name + "[] = {"
+
+    for v in range(maxvalue + 1):
+        print "  " + str(index.get(v, -1)) + ","
+
+    print "};\n"
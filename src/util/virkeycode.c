@@ -19,9 +19,12 @@
 
 #include <config.h>
 #include "virkeycode.h"
+#include "virerror.h"
 #include <string.h>
 #include <stddef.h>
 
+#define VIR_FROM_THIS VIR_FROM_NONE
+
 
 #define VIRT_KEY_INTERNAL
 #include "virkeymaps.h"
@@ -74,6 +77,54 @@ static int *virKeymapValues[] = {
 };
 verify(ARRAY_CARDINALITY(virKeymapValues) == VIR_KEYCODE_SET_LAST);
 
+static int *virKeymapIndex[] = {
+    [VIR_KEYCODE_SET_LINUX] =
+      virKeymapIndex_linux,
+    [VIR_KEYCODE_SET_XT] =
+      virKeymapIndex_xt,
+    [VIR_KEYCODE_SET_ATSET1] =
+      virKeymapIndex_atset1,
+    [VIR_KEYCODE_SET_ATSET2] =
+      virKeymapIndex_atset2,
+    [VIR_KEYCODE_SET_ATSET3] =
+      virKeymapIndex_atset3,
+    [VIR_KEYCODE_SET_OSX] =
+      virKeymapIndex_os_x,
+    [VIR_KEYCODE_SET_XT_KBD] =
+      virKeymapIndex_xt_kbd,
+    [VIR_KEYCODE_SET_USB] =
+      virKeymapIndex_usb,
+    [VIR_KEYCODE_SET_WIN32] =
+      virKeymapIndex_win32,
+    [VIR_KEYCODE_SET_RFB] =
+      virKeymapIndex_rfb,
+};
+verify(ARRAY_CARDINALITY(virKeymapIndex) == VIR_KEYCODE_SET_LAST);
+
+static const int virKeymapIndexMax[] = {
+    [VIR_KEYCODE_SET_LINUX] =
+      VIR_KEYMAP_VALUE_MAX_linux,
+    [VIR_KEYCODE_SET_XT] =
+      VIR_KEYMAP_VALUE_MAX_xt,
+    [VIR_KEYCODE_SET_ATSET1] =
+      VIR_KEYMAP_VALUE_MAX_atset1,
+    [VIR_KEYCODE_SET_ATSET2] =
+      VIR_KEYMAP_VALUE_MAX_atset2,
+    [VIR_KEYCODE_SET_ATSET3] =
+      VIR_KEYMAP_VALUE_MAX_atset3,
+    [VIR_KEYCODE_SET_OSX] =
+      VIR_KEYMAP_VALUE_MAX_os_x,
+    [VIR_KEYCODE_SET_XT_KBD] =
+      VIR_KEYMAP_VALUE_MAX_xt_kbd,
+    [VIR_KEYCODE_SET_USB] =
+      VIR_KEYMAP_VALUE_MAX_usb,
+    [VIR_KEYCODE_SET_WIN32] =
+      VIR_KEYMAP_VALUE_MAX_win32,
+    [VIR_KEYCODE_SET_RFB] =
+      VIR_KEYMAP_VALUE_MAX_rfb,
+};
+verify(ARRAY_CARDINALITY(virKeymapIndexMax) == VIR_KEYCODE_SET_LAST);
+
 VIR_ENUM_IMPL(virKeycodeSet, VIR_KEYCODE_SET_LAST,
     "linux",
     "xt",
@@ -111,16 +162,54 @@ int virKeycodeValueTranslate(virKeycodeSet from_codeset,
                              virKeycodeSet to_codeset,
                              int key_value)
 {
-    size_t i;
+    int i;
 
-    if (key_value < 0)
+    if (key_value < 0 ||
+        key_value > virKeymapIndexMax[from_codeset])
         return -1;
 
+    i = virKeymapIndex[from_codeset][key_value];
+    if (i < 0)
+        return -1;
 
-    for (i = 0; i < VIR_KEYMAP_ENTRY_MAX; i++) {
-        if (virKeymapValues[from_codeset][i] == key_value)
-            return virKeymapValues[to_codeset][i];
+    return virKeymapValues[to_codeset][i];
+}
+
+
+/**
+ * virKeycodeValueTranslateMany:
+ * @from_codeset: the codeset the keycodes are in
+ * @to_codeset: the codeset to translate them to
+ * @keycodes: array of keycodes, translated in place
+ * @nkeycodes: number of entries in @keycodes
+ *
+ * Translates a whole key sequence in one call, reporting an error
+ * for the first keycode that has no mapping.
+ *
+ * Returns 0 on success, -1 on failure with the error set.
+ */
+int virKeycodeValueTranslateMany(virKeycodeSet from_codeset,
+                                 virKeycodeSet to_codeset,
+                                 unsigned int *keycodes,
+                                 size_t nkeycodes)
+{
+    size_t i;
+
+    for (i = 0; i < nkeycodes; i++) {
+        int keycode = virKeycodeValueTranslate(from_codeset, to_codeset,
+                                               keycodes[i]);
+
+        if (keycode < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("cannot translate keycode %u of %s codeset to %s keycode"),
+                           keycodes[i],
+                           virKeycodeSetTypeToString(from_codeset),
+                           virKeycodeSetTypeToString(to_codeset));
+            return -1;
+        }
+
+        keycodes[i] = keycode;
     }
 
-    return -1;
+    return 0;
 }
@@ -29,5 +29,9 @@ int virKeycodeValueFromString(virKeycodeSet codeset, const char *keyname);
 int virKeycodeValueTranslate(virKeycodeSet from_codeset,
                         virKeycodeSet to_offset,
                         int key_value);
+int virKeycodeValueTranslateMany(virKeycodeSet from_codeset,
+                        virKeycodeSet to_codeset,
+                        unsigned int *keycodes,
+                        size_t nkeycodes);
 
 #endif
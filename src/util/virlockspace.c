@@ -28,6 +28,7 @@
 #include "virutil.h"
 #include "virfile.h"
 #include "virhash.h"
+#include "virhashcode.h"
 #include "virthread.h"
 #include "virstring.h"
 
@@ -41,6 +42,12 @@ VIR_LOG_INIT("util.lockspace");
 
 #define VIR_LOCKSPACE_TABLE_SIZE 10
 
+/* Number of independent shards the resources are spread over, each
+ * with its own lock.  A resource acquisition blocked in open()/flock()
+ * on slow shared storage then only stalls acquisitions hashing onto
+ * the same shard instead of the whole lockspace. */
+#define VIR_LOCKSPACE_NSHARDS 8
+
 typedef struct _virLockSpaceResource virLockSpaceResource;
 typedef virLockSpaceResource *virLockSpaceResourcePtr;
 
@@ -54,14 +61,30 @@ struct _virLockSpaceResource {
     pid_t *owners;
 };
 
+typedef struct _virLockSpaceShard virLockSpaceShard;
+typedef virLockSpaceShard *virLockSpaceShardPtr;
+
+struct _virLockSpaceShard {
+    virMutex lock;
+    virHashTablePtr resources;
+};
+
 struct _virLockSpace {
     char *dir;
-    virMutex lock;
 
-    virHashTablePtr resources;
+    virLockSpaceShard shards[VIR_LOCKSPACE_NSHARDS];
 };
 
 
+static virLockSpaceShardPtr
+virLockSpaceGetShard(virLockSpacePtr lockspace, const char *resname)
+{
+    uint32_t code = virHashCodeGen(resname, strlen(resname), 0);
+
+    return &lockspace->shards[code % VIR_LOCKSPACE_NSHARDS];
+}
+
+
 static char *virLockSpaceGetResourcePath(virLockSpacePtr lockspace,
                                          const char *resname)
 {
@@ -239,6 +262,38 @@ static void virLockSpaceResourceDataFree(void *opaque, const void *name ATTRIBUT
 }
 
 
+/* Initializes every shard, or cleans up completely on failure so
+ * that the caller need only VIR_FREE the lockspace */
+static int virLockSpaceInitShards(virLockSpacePtr lockspace)
+{
+    size_t i, j;
+
+    for (i = 0; i < VIR_LOCKSPACE_NSHARDS; i++) {
+        if (virMutexInit(&lockspace->shards[i].lock) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to initialize lockspace mutex"));
+            goto error;
+        }
+
+        if (!(lockspace->shards[i].resources =
+              virHashCreate(VIR_LOCKSPACE_TABLE_SIZE,
+                            virLockSpaceResourceDataFree))) {
+            virMutexDestroy(&lockspace->shards[i].lock);
+            goto error;
+        }
+    }
+
+    return 0;
+
+ error:
+    for (j = 0; j < i; j++) {
+        virHashFree(lockspace->shards[j].resources);
+        virMutexDestroy(&lockspace->shards[j].lock);
+    }
+    return -1;
+}
+
+
 virLockSpacePtr virLockSpaceNew(const char *directory)
 {
     virLockSpacePtr lockspace;
@@ -248,9 +303,7 @@ virLockSpacePtr virLockSpaceNew(const char *directory)
     if (VIR_ALLOC(lockspace) < 0)
         return NULL;
 
-    if (virMutexInit(&lockspace->lock) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Unable to initialize lockspace mutex"));
+    if (virLockSpaceInitShards(lockspace) < 0) {
         VIR_FREE(lockspace);
         return NULL;
     }
@@ -258,10 +311,6 @@ virLockSpacePtr virLockSpaceNew(const char *directory)
     if (VIR_STRDUP(lockspace->dir, directory) < 0)
         goto error;
 
-    if (!(lockspace->resources = virHashCreate(VIR_LOCKSPACE_TABLE_SIZE,
-                                               virLockSpaceResourceDataFree)))
-        goto error;
-
     if (directory) {
         if (virFileExists(directory)) {
             if (!virFileIsDir(directory)) {
@@ -301,17 +350,11 @@ virLockSpacePtr virLockSpaceNewPostExecRestart(virJSONValuePtr object)
     if (VIR_ALLOC(lockspace) < 0)
         return NULL;
 
-    if (virMutexInit(&lockspace->lock) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Unable to initialize lockspace mutex"));
+    if (virLockSpaceInitShards(lockspace) < 0) {
         VIR_FREE(lockspace);
         return NULL;
     }
 
-    if (!(lockspace->resources = virHashCreate(VIR_LOCKSPACE_TABLE_SIZE,
-                                               virLockSpaceResourceDataFree)))
-        goto error;
-
     if (virJSONValueObjectHasKey(object, "directory")) {
         const char *dir = virJSONValueObjectGetString(object, "directory");
         if (VIR_STRDUP(lockspace->dir, dir) < 0)
@@ -423,7 +466,8 @@ virLockSpacePtr virLockSpaceNewPostExecRestart(virJSONValuePtr object)
             res->owners[j] = (pid_t)owner;
         }
 
-        if (virHashAddEntry(lockspace->resources, res->name, res) < 0) {
+        if (virHashAddEntry(virLockSpaceGetShard(lockspace, res->name)->resources,
+                            res->name, res) < 0) {
             virLockSpaceResourceFree(res);
             goto error;
         }
@@ -442,11 +486,14 @@ virJSONValuePtr virLockSpacePreExecRestart(virLockSpacePtr lockspace)
     virJSONValuePtr object = virJSONValueNewObject();
     virJSONValuePtr resources;
     virHashKeyValuePairPtr pairs = NULL, tmp;
+    size_t shard;
 
     if (!object)
         return NULL;
 
-    virMutexLock(&lockspace->lock);
+    /* Lock all shards in order so we serialize a consistent snapshot */
+    for (shard = 0; shard < VIR_LOCKSPACE_NSHARDS; shard++)
+        virMutexLock(&lockspace->shards[shard].lock);
 
     if (lockspace->dir &&
         virJSONValueObjectAppendString(object, "directory", lockspace->dir) < 0)
@@ -460,76 +507,84 @@ virJSONValuePtr virLockSpacePreExecRestart(virLockSpacePtr lockspace)
         goto error;
     }
 
-    tmp = pairs = virHashGetItems(lockspace->resources, NULL);
-    while (tmp && tmp->value) {
-        virLockSpaceResourcePtr res = (virLockSpaceResourcePtr)tmp->value;
-        virJSONValuePtr child = virJSONValueNewObject();
-        virJSONValuePtr owners = NULL;
-        size_t i;
+    for (shard = 0; shard < VIR_LOCKSPACE_NSHARDS; shard++) {
+        tmp = pairs = virHashGetItems(lockspace->shards[shard].resources, NULL);
+        while (tmp && tmp->value) {
+            virLockSpaceResourcePtr res = (virLockSpaceResourcePtr)tmp->value;
+            virJSONValuePtr child = virJSONValueNewObject();
+            virJSONValuePtr owners = NULL;
+            size_t i;
 
-        if (!child)
-            goto error;
-
-        if (virJSONValueArrayAppend(resources, child) < 0) {
-            virJSONValueFree(child);
-            goto error;
-        }
-
-        if (virJSONValueObjectAppendString(child, "name", res->name) < 0 ||
-            virJSONValueObjectAppendString(child, "path", res->path) < 0 ||
-            virJSONValueObjectAppendNumberInt(child, "fd", res->fd) < 0 ||
-            virJSONValueObjectAppendBoolean(child, "lockHeld", res->lockHeld) < 0 ||
-            virJSONValueObjectAppendNumberUint(child, "flags", res->flags) < 0)
-            goto error;
+            if (!child)
+                goto error;
 
-        if (virSetInherit(res->fd, true) < 0) {
-            virReportSystemError(errno, "%s",
-                                 _("Cannot disable close-on-exec flag"));
-            goto error;
-        }
+            if (virJSONValueArrayAppend(resources, child) < 0) {
+                virJSONValueFree(child);
+                goto error;
+            }
 
-        if (!(owners = virJSONValueNewArray()))
-            goto error;
+            if (virJSONValueObjectAppendString(child, "name", res->name) < 0 ||
+                virJSONValueObjectAppendString(child, "path", res->path) < 0 ||
+                virJSONValueObjectAppendNumberInt(child, "fd", res->fd) < 0 ||
+                virJSONValueObjectAppendBoolean(child, "lockHeld", res->lockHeld) < 0 ||
+                virJSONValueObjectAppendNumberUint(child, "flags", res->flags) < 0)
+                goto error;
 
-        if (virJSONValueObjectAppend(child, "owners", owners) < 0) {
-            virJSONValueFree(owners);
-            goto error;
-        }
+            if (virSetInherit(res->fd, true) < 0) {
+                virReportSystemError(errno, "%s",
+                                     _("Cannot disable close-on-exec flag"));
+                goto error;
+            }
 
-        for (i = 0; i < res->nOwners; i++) {
-            virJSONValuePtr owner = virJSONValueNewNumberUlong(res->owners[i]);
-            if (!owner)
+            if (!(owners = virJSONValueNewArray()))
                 goto error;
 
-            if (virJSONValueArrayAppend(owners, owner) < 0) {
-                virJSONValueFree(owner);
+            if (virJSONValueObjectAppend(child, "owners", owners) < 0) {
+                virJSONValueFree(owners);
                 goto error;
             }
-        }
 
-        tmp++;
+            for (i = 0; i < res->nOwners; i++) {
+                virJSONValuePtr owner = virJSONValueNewNumberUlong(res->owners[i]);
+                if (!owner)
+                    goto error;
+
+                if (virJSONValueArrayAppend(owners, owner) < 0) {
+                    virJSONValueFree(owner);
+                    goto error;
+                }
+            }
+
+            tmp++;
+        }
+        VIR_FREE(pairs);
     }
-    VIR_FREE(pairs);
 
-    virMutexUnlock(&lockspace->lock);
+    for (shard = 0; shard < VIR_LOCKSPACE_NSHARDS; shard++)
+        virMutexUnlock(&lockspace->shards[shard].lock);
     return object;
 
  error:
     VIR_FREE(pairs);
     virJSONValueFree(object);
-    virMutexUnlock(&lockspace->lock);
+    for (shard = 0; shard < VIR_LOCKSPACE_NSHARDS; shard++)
+        virMutexUnlock(&lockspace->shards[shard].lock);
     return NULL;
 }
 
 
 void virLockSpaceFree(virLockSpacePtr lockspace)
 {
+    size_t i;
+
     if (!lockspace)
         return;
 
-    virHashFree(lockspace->resources);
+    for (i = 0; i < VIR_LOCKSPACE_NSHARDS; i++) {
+        virHashFree(lockspace->shards[i].resources);
+        virMutexDestroy(&lockspace->shards[i].lock);
+    }
     VIR_FREE(lockspace->dir);
-    virMutexDestroy(&lockspace->lock);
     VIR_FREE(lockspace);
 }
 
@@ -545,12 +600,13 @@ int virLockSpaceCreateResource(virLockSpacePtr lockspace,
 {
     int ret = -1;
     char *respath = NULL;
+    virLockSpaceShardPtr shard = virLockSpaceGetShard(lockspace, resname);
 
     VIR_DEBUG("lockspace=%p resname=%s", lockspace, resname);
 
-    virMutexLock(&lockspace->lock);
+    virMutexLock(&shard->lock);
 
-    if (virHashLookup(lockspace->resources, resname) != NULL) {
+    if (virHashLookup(shard->resources, resname) != NULL) {
         virReportError(VIR_ERR_RESOURCE_BUSY,
                        _("Lockspace resource '%s' is locked"),
                        resname);
@@ -566,7 +622,7 @@ int virLockSpaceCreateResource(virLockSpacePtr lockspace,
     ret = 0;
 
  cleanup:
-    virMutexUnlock(&lockspace->lock);
+    virMutexUnlock(&shard->lock);
     VIR_FREE(respath);
     return ret;
 }
@@ -577,12 +633,13 @@ int virLockSpaceDeleteResource(virLockSpacePtr lockspace,
 {
     int ret = -1;
     char *respath = NULL;
+    virLockSpaceShardPtr shard = virLockSpaceGetShard(lockspace, resname);
 
     VIR_DEBUG("lockspace=%p resname=%s", lockspace, resname);
 
-    virMutexLock(&lockspace->lock);
+    virMutexLock(&shard->lock);
 
-    if (virHashLookup(lockspace->resources, resname) != NULL) {
+    if (virHashLookup(shard->resources, resname) != NULL) {
         virReportError(VIR_ERR_RESOURCE_BUSY,
                        _("Lockspace resource '%s' is locked"),
                        resname);
@@ -603,7 +660,7 @@ int virLockSpaceDeleteResource(virLockSpacePtr lockspace,
     ret = 0;
 
  cleanup:
-    virMutexUnlock(&lockspace->lock);
+    virMutexUnlock(&shard->lock);
     VIR_FREE(respath);
     return ret;
 }
@@ -616,6 +673,7 @@ int virLockSpaceAcquireResource(virLockSpacePtr lockspace,
 {
     int ret = -1;
     virLockSpaceResourcePtr res;
+    virLockSpaceShardPtr shard = virLockSpaceGetShard(lockspace, resname);
 
     VIR_DEBUG("lockspace=%p resname=%s flags=%x owner=%lld",
               lockspace, resname, flags, (unsigned long long)owner);
@@ -623,9 +681,9 @@ int virLockSpaceAcquireResource(virLockSpacePtr lockspace,
     virCheckFlags(VIR_LOCK_SPACE_ACQUIRE_SHARED |
                   VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE, -1);
 
-    virMutexLock(&lockspace->lock);
+    virMutexLock(&shard->lock);
 
-    if ((res = virHashLookup(lockspace->resources, resname))) {
+    if ((res = virHashLookup(shard->resources, resname))) {
         if ((res->flags & VIR_LOCK_SPACE_ACQUIRE_SHARED) &&
             (flags & VIR_LOCK_SPACE_ACQUIRE_SHARED)) {
 
@@ -644,7 +702,7 @@ int virLockSpaceAcquireResource(virLockSpacePtr lockspace,
     if (!(res = virLockSpaceResourceNew(lockspace, resname, flags, owner)))
         goto cleanup;
 
-    if (virHashAddEntry(lockspace->resources, resname, res) < 0) {
+    if (virHashAddEntry(shard->resources, resname, res) < 0) {
         virLockSpaceResourceFree(res);
         goto cleanup;
     }
@@ -653,7 +711,7 @@ int virLockSpaceAcquireResource(virLockSpacePtr lockspace,
     ret = 0;
 
  cleanup:
-    virMutexUnlock(&lockspace->lock);
+    virMutexUnlock(&shard->lock);
     return ret;
 }
 
@@ -664,14 +722,15 @@ int virLockSpaceReleaseResource(virLockSpacePtr lockspace,
 {
     int ret = -1;
     virLockSpaceResourcePtr res;
+    virLockSpaceShardPtr shard = virLockSpaceGetShard(lockspace, resname);
     size_t i;
 
     VIR_DEBUG("lockspace=%p resname=%s owner=%lld",
               lockspace, resname, (unsigned long long)owner);
 
-    virMutexLock(&lockspace->lock);
+    virMutexLock(&shard->lock);
 
-    if (!(res = virHashLookup(lockspace->resources, resname))) {
+    if (!(res = virHashLookup(shard->resources, resname))) {
         virReportError(VIR_ERR_RESOURCE_BUSY,
                        _("Lockspace resource '%s' is not locked"),
                        resname);
@@ -693,13 +752,13 @@ int virLockSpaceReleaseResource(virLockSpacePtr lockspace,
     VIR_DELETE_ELEMENT(res->owners, i, res->nOwners);
 
     if ((res->nOwners == 0) &&
-        virHashRemoveEntry(lockspace->resources, resname) < 0)
+        virHashRemoveEntry(shard->resources, resname) < 0)
         goto cleanup;
 
     ret = 0;
 
  cleanup:
-    virMutexUnlock(&lockspace->lock);
+    virMutexUnlock(&shard->lock);
     return ret;
 }
 
@@ -746,26 +805,25 @@ virLockSpaceRemoveResourcesForOwner(const void *payload,
 int virLockSpaceReleaseResourcesForOwner(virLockSpacePtr lockspace,
                                          pid_t owner)
 {
-    int ret = 0;
     struct virLockSpaceRemoveData data = {
         owner, 0
     };
+    size_t i;
 
     VIR_DEBUG("lockspace=%p owner=%lld", lockspace, (unsigned long long)owner);
 
-    virMutexLock(&lockspace->lock);
-
-    if (virHashRemoveSet(lockspace->resources,
-                         virLockSpaceRemoveResourcesForOwner,
-                         &data) < 0)
-        goto error;
+    for (i = 0; i < VIR_LOCKSPACE_NSHARDS; i++) {
+        virLockSpaceShardPtr shard = &lockspace->shards[i];
 
-    ret = data.count;
-
-    virMutexUnlock(&lockspace->lock);
-    return ret;
+        virMutexLock(&shard->lock);
+        if (virHashRemoveSet(shard->resources,
+                             virLockSpaceRemoveResourcesForOwner,
+                             &data) < 0) {
+            virMutexUnlock(&shard->lock);
+            return -1;
+        }
+        virMutexUnlock(&shard->lock);
+    }
 
- error:
-    virMutexUnlock(&lockspace->lock);
-    return -1;
+    return data.count;
 }
@@ -133,6 +133,13 @@ static void virLogOutputToFd(virLogSourcePtr src,
  */
 virMutex virLogMutex;
 
+/* Asynchronous output machinery; see the comment above the ring
+ * definition further down */
+static virMutex virLogAsyncLock;
+static virCond virLogAsyncDataCond;
+static virCond virLogAsyncSpaceCond;
+static void virLogAsyncFlush(void);
+
 void
 virLogLock(void)
 {
@@ -170,6 +177,11 @@ virLogOnceInit(void)
     if (virMutexInit(&virLogMutex) < 0)
         return -1;
 
+    if (virMutexInit(&virLogAsyncLock) < 0 ||
+        virCondInit(&virLogAsyncDataCond) < 0 ||
+        virCondInit(&virLogAsyncSpaceCond) < 0)
+        return -1;
+
     virLogLock();
     virLogDefaultPriority = VIR_LOG_DEFAULT;
 
@@ -198,6 +210,9 @@ virLogReset(void)
     if (virLogInitialize() < 0)
         return -1;
 
+    /* Pending async records still reference the old outputs */
+    virLogAsyncFlush();
+
     virLogLock();
     virLogResetFilters();
     virLogResetOutputs();
@@ -547,6 +562,459 @@ virLogSourceUpdate(virLogSourcePtr source)
     virLogUnlock();
 }
 
+static bool virLogInitMsgStderr = true;
+
+/* Emit the version and hostname banner through output callback @f */
+static void
+virLogEmitInitMessage(virLogOutputFunc f,
+                      void *data,
+                      const char *timestamp)
+{
+    const char *rawinitmsg;
+    char *hoststr = NULL;
+    char *initmsg = NULL;
+
+    if (virLogVersionString(&rawinitmsg, &initmsg) >= 0)
+        f(&virLogSelf, VIR_LOG_INFO,
+          __FILE__, __LINE__, __func__,
+          timestamp, NULL, 0, rawinitmsg, initmsg, data);
+    VIR_FREE(initmsg);
+    if (virLogHostnameString(&hoststr, &initmsg) >= 0)
+        f(&virLogSelf, VIR_LOG_INFO,
+          __FILE__, __LINE__, __func__,
+          timestamp, NULL, 0, hoststr, initmsg, data);
+    VIR_FREE(hoststr);
+    VIR_FREE(initmsg);
+}
+
+/* Push one message to all eligible outputs, or to stderr if no output
+ * was defined.  Must be called with virLogLock held.
+ */
+static void
+virLogDispatchLocked(virLogSourcePtr source,
+                     virLogPriority priority,
+                     const char *filename,
+                     int linenr,
+                     const char *funcname,
+                     const char *timestamp,
+                     virLogMetadataPtr metadata,
+                     unsigned int filterflags,
+                     const char *str,
+                     const char *msg)
+{
+    size_t i;
+
+    for (i = 0; i < virLogNbOutputs; i++) {
+        if (priority >= virLogOutputs[i]->priority) {
+            if (virLogOutputs[i]->logInitMessage) {
+                virLogEmitInitMessage(virLogOutputs[i]->f,
+                                      virLogOutputs[i]->data, timestamp);
+                virLogOutputs[i]->logInitMessage = false;
+            }
+            virLogOutputs[i]->f(source, priority,
+                               filename, linenr, funcname,
+                               timestamp, metadata, filterflags,
+                               str, msg, virLogOutputs[i]->data);
+        }
+    }
+    if (virLogNbOutputs == 0) {
+        if (virLogInitMsgStderr) {
+            virLogEmitInitMessage(virLogOutputToFd,
+                                  (void *) STDERR_FILENO, timestamp);
+            virLogInitMsgStderr = false;
+        }
+        virLogOutputToFd(source, priority,
+                         filename, linenr, funcname,
+                         timestamp, metadata, filterflags,
+                         str, msg, (void *) STDERR_FILENO);
+    }
+}
+
+
+/*
+ * Asynchronous logging.  When enabled via virLogSetAsync the emitting
+ * thread only formats the message and pushes it onto a bounded ring,
+ * which a dedicated writer thread drains in batches; consecutive
+ * records destined for the same file descriptor output are merged
+ * into a single write.  When the ring is full emitters block until
+ * the writer catches up, so no messages are ever dropped.
+ */
+typedef struct _virLogAsyncRecord virLogAsyncRecord;
+struct _virLogAsyncRecord {
+    virLogSourcePtr source;
+    virLogPriority priority;
+    const char *filename;
+    int linenr;
+    const char *funcname;
+    char timestamp[VIR_TIME_STRING_BUFLEN];
+    virLogMetadataPtr metadata;
+    unsigned int filterflags;
+    char *str;
+    char *msg;
+};
+
+#define VIR_LOG_ASYNC_RING_SIZE 1024
+#define VIR_LOG_ASYNC_BATCH 64
+
+static virLogAsyncRecord virLogAsyncRing[VIR_LOG_ASYNC_RING_SIZE];
+static size_t virLogAsyncHead; /* oldest queued record */
+static size_t virLogAsyncCount; /* number of queued records */
+static bool virLogAsyncEnabled;
+static bool virLogAsyncThreadRunning;
+static bool virLogAsyncDraining; /* writer is dispatching a batch */
+static virThread virLogAsyncThread;
+
+static void
+virLogAsyncMetadataFree(virLogMetadataPtr meta)
+{
+    size_t i;
+    char *tmp;
+
+    if (!meta)
+        return;
+
+    for (i = 0; meta[i].key; i++) {
+        tmp = (char *) meta[i].key;
+        VIR_FREE(tmp);
+        tmp = (char *) meta[i].s;
+        VIR_FREE(tmp);
+    }
+    VIR_FREE(meta);
+}
+
+/* The caller's metadata array may live on its stack, so it has to be
+ * deep copied before the message crosses over to the writer thread.
+ */
+static virLogMetadataPtr
+virLogAsyncMetadataCopy(virLogMetadataPtr meta)
+{
+    virLogMetadataPtr ret;
+    size_t n = 0;
+    size_t i;
+
+    while (meta[n].key)
+        n++;
+
+    if (VIR_ALLOC_N_QUIET(ret, n + 1) < 0)
+        return NULL;
+
+    for (i = 0; i < n; i++) {
+        char *key = NULL;
+        char *s = NULL;
+
+        if (VIR_STRDUP_QUIET(key, meta[i].key) < 0 ||
+            (meta[i].s && VIR_STRDUP_QUIET(s, meta[i].s) < 0)) {
+            VIR_FREE(key);
+            VIR_FREE(s);
+            virLogAsyncMetadataFree(ret);
+            return NULL;
+        }
+        ret[i].key = key;
+        ret[i].s = s;
+        ret[i].iv = meta[i].iv;
+    }
+    return ret;
+}
+
+/* Try to queue a formatted message for the writer thread.  Returns
+ * true if ownership of @str and @msg was taken over; false if async
+ * mode is off (or being turned off), in which case the caller must
+ * dispatch synchronously.
+ */
+static bool
+virLogAsyncEnqueue(virLogSourcePtr source,
+                   virLogPriority priority,
+                   const char *filename,
+                   int linenr,
+                   const char *funcname,
+                   const char *timestamp,
+                   virLogMetadataPtr metadata,
+                   unsigned int filterflags,
+                   char *str,
+                   char *msg)
+{
+    virLogAsyncRecord *rec;
+    virLogMetadataPtr metacopy = NULL;
+
+    if (!virLogAsyncEnabled) /* racy fast path; rechecked under lock */
+        return false;
+
+    if (metadata &&
+        !(metacopy = virLogAsyncMetadataCopy(metadata)))
+        return false;
+
+    virMutexLock(&virLogAsyncLock);
+    while (virLogAsyncCount == VIR_LOG_ASYNC_RING_SIZE &&
+           virLogAsyncEnabled && virLogAsyncThreadRunning) {
+        if (virCondWait(&virLogAsyncSpaceCond, &virLogAsyncLock) < 0)
+            break;
+    }
+    if (!virLogAsyncEnabled || !virLogAsyncThreadRunning ||
+        virLogAsyncCount == VIR_LOG_ASYNC_RING_SIZE) {
+        virMutexUnlock(&virLogAsyncLock);
+        virLogAsyncMetadataFree(metacopy);
+        return false;
+    }
+
+    rec = &virLogAsyncRing[(virLogAsyncHead + virLogAsyncCount) %
+                           VIR_LOG_ASYNC_RING_SIZE];
+    rec->source = source;
+    rec->priority = priority;
+    rec->filename = filename;
+    rec->linenr = linenr;
+    rec->funcname = funcname;
+    if (virStrcpyStatic(rec->timestamp, timestamp) == NULL)
+        rec->timestamp[0] = '\0';
+    rec->metadata = metacopy;
+    rec->filterflags = filterflags;
+    rec->str = str;
+    rec->msg = msg;
+    virLogAsyncCount++;
+
+    virCondSignal(&virLogAsyncDataCond);
+    virMutexUnlock(&virLogAsyncLock);
+    return true;
+}
+
+/* Write out a batch of drained records.  Grabs virLogLock itself. */
+static void
+virLogAsyncDispatchBatch(virLogAsyncRecord *recs, size_t nrecs)
+{
+    size_t i;
+    size_t r;
+
+    virLogLock();
+    for (i = 0; i < virLogNbOutputs; i++) {
+        virLogOutputPtr output = virLogOutputs[i];
+        bool isFd = output->f == virLogOutputToFd;
+        virBuffer fdbuf = VIR_BUFFER_INITIALIZER;
+
+        for (r = 0; r < nrecs; r++) {
+            virLogAsyncRecord *rec = &recs[r];
+
+            if (rec->priority < output->priority)
+                continue;
+
+            if (output->logInitMessage) {
+                virLogEmitInitMessage(output->f, output->data,
+                                      rec->timestamp);
+                output->logInitMessage = false;
+            }
+
+            if (isFd && !(rec->filterflags & VIR_LOG_STACK_TRACE)) {
+                /* Coalesce plain records into one write() */
+                virBufferAsprintf(&fdbuf, "%s: %s", rec->timestamp,
+                                  rec->msg);
+                continue;
+            }
+
+            if (isFd && virBufferUse(&fdbuf)) {
+                if (virBufferError(&fdbuf) == 0)
+                    ignore_value(safewrite((intptr_t) output->data,
+                                           virBufferCurrentContent(&fdbuf),
+                                           virBufferUse(&fdbuf)));
+                virBufferFreeAndReset(&fdbuf);
+            }
+
+            output->f(rec->source, rec->priority,
+                      rec->filename, rec->linenr, rec->funcname,
+                      rec->timestamp, rec->metadata, rec->filterflags,
+                      rec->str, rec->msg, output->data);
+        }
+
+        if (isFd && virBufferUse(&fdbuf) && virBufferError(&fdbuf) == 0)
+            ignore_value(safewrite((intptr_t) output->data,
+                                   virBufferCurrentContent(&fdbuf),
+                                   virBufferUse(&fdbuf)));
+        virBufferFreeAndReset(&fdbuf);
+    }
+    if (virLogNbOutputs == 0) {
+        for (r = 0; r < nrecs; r++) {
+            virLogAsyncRecord *rec = &recs[r];
+
+            if (virLogInitMsgStderr) {
+                virLogEmitInitMessage(virLogOutputToFd,
+                                      (void *) STDERR_FILENO,
+                                      rec->timestamp);
+                virLogInitMsgStderr = false;
+            }
+            virLogOutputToFd(rec->source, rec->priority,
+                             rec->filename, rec->linenr, rec->funcname,
+                             rec->timestamp, rec->metadata,
+                             rec->filterflags,
+                             rec->str, rec->msg, (void *) STDERR_FILENO);
+        }
+    }
+    virLogUnlock();
+
+    for (r = 0; r < nrecs; r++) {
+        VIR_FREE(recs[r].str);
+        VIR_FREE(recs[r].msg);
+        virLogAsyncMetadataFree(recs[r].metadata);
+    }
+}
+
+static void
+virLogAsyncWriter(void *opaque ATTRIBUTE_UNUSED)
+{
+    virLogAsyncRecord batch[VIR_LOG_ASYNC_BATCH];
+    size_t n;
+    size_t i;
+
+    virMutexLock(&virLogAsyncLock);
+    while (1) {
+        while (virLogAsyncCount == 0 && virLogAsyncEnabled) {
+            if (virCondWait(&virLogAsyncDataCond, &virLogAsyncLock) < 0)
+                goto out;
+        }
+        if (virLogAsyncCount == 0)
+            break;
+
+        n = virLogAsyncCount;
+        if (n > VIR_LOG_ASYNC_BATCH)
+            n = VIR_LOG_ASYNC_BATCH;
+        for (i = 0; i < n; i++)
+            batch[i] = virLogAsyncRing[(virLogAsyncHead + i) %
+                                       VIR_LOG_ASYNC_RING_SIZE];
+        virLogAsyncHead = (virLogAsyncHead + n) % VIR_LOG_ASYNC_RING_SIZE;
+        virLogAsyncCount -= n;
+        virLogAsyncDraining = true;
+        virCondBroadcast(&virLogAsyncSpaceCond);
+        virMutexUnlock(&virLogAsyncLock);
+
+        virLogAsyncDispatchBatch(batch, n);
+
+        virMutexLock(&virLogAsyncLock);
+        virLogAsyncDraining = false;
+        virCondBroadcast(&virLogAsyncSpaceCond);
+    }
+
+ out:
+    virLogAsyncThreadRunning = false;
+    virCondBroadcast(&virLogAsyncSpaceCond);
+    virMutexUnlock(&virLogAsyncLock);
+}
+
+/* Wait until every record queued so far has been written out */
+static void
+virLogAsyncFlush(void)
+{
+    virMutexLock(&virLogAsyncLock);
+    while (virLogAsyncThreadRunning &&
+           (virLogAsyncCount > 0 || virLogAsyncDraining)) {
+        if (virCondWait(&virLogAsyncSpaceCond, &virLogAsyncLock) < 0)
+            break;
+    }
+    virMutexUnlock(&virLogAsyncLock);
+}
+
+
+/**
+ * virLogAsyncForkLock:
+ *
+ * Acquire the async logging lock before fork(), so a child can never
+ * inherit it locked from another thread caught inside the enqueue or
+ * writer paths. Pairs with virLogAsyncForkUnlock in both parent and
+ * child, like virLogLock/virLogUnlock in virFork.
+ */
+void
+virLogAsyncForkLock(void)
+{
+    virMutexLock(&virLogAsyncLock);
+}
+
+
+void
+virLogAsyncForkUnlock(void)
+{
+    virMutexUnlock(&virLogAsyncLock);
+}
+
+
+/**
+ * virLogAsyncForkReset:
+ *
+ * Reset the async logging state in a child process right after
+ * fork(): the writer thread does not survive the fork, so anything
+ * queued in the child's copy of the ring would never be written and
+ * a flush would wait forever for a thread that is not there. Drop
+ * the inherited records and disable the mode so the child's pre-exec
+ * messages take the synchronous path.
+ */
+void
+virLogAsyncForkReset(void)
+{
+    size_t i;
+
+    virMutexLock(&virLogAsyncLock);
+    for (i = 0; i < virLogAsyncCount; i++) {
+        virLogAsyncRecord *rec = &virLogAsyncRing[(virLogAsyncHead + i) %
+                                                  VIR_LOG_ASYNC_RING_SIZE];
+
+        VIR_FREE(rec->str);
+        VIR_FREE(rec->msg);
+        virLogAsyncMetadataFree(rec->metadata);
+        rec->metadata = NULL;
+    }
+    virLogAsyncHead = 0;
+    virLogAsyncCount = 0;
+    virLogAsyncDraining = false;
+    virLogAsyncEnabled = false;
+    virLogAsyncThreadRunning = false;
+    virMutexUnlock(&virLogAsyncLock);
+}
+
+
+/**
+ * virLogSetAsync:
+ * @enabled: whether messages should be written out asynchronously
+ *
+ * Toggle asynchronous log output.  When enabled, threads emitting log
+ * messages only format them and hand them to a writer thread instead
+ * of blocking on the output file descriptors; this keeps hot paths
+ * (e.g. monitor traffic with debug filters active) from stalling on
+ * disk or journald latency.  Disabling flushes and stops the writer
+ * thread; pending messages are written out before this returns.
+ *
+ * Returns 0 on success, -1 in case of error.
+ */
+int
+virLogSetAsync(bool enabled)
+{
+    int ret = 0;
+
+    if (virLogInitialize() < 0)
+        return -1;
+
+    virMutexLock(&virLogAsyncLock);
+    if (enabled == virLogAsyncEnabled)
+        goto cleanup;
+
+    if (enabled) {
+        if (!virLogAsyncThreadRunning) {
+            if (virThreadCreate(&virLogAsyncThread, false,
+                                virLogAsyncWriter, NULL) < 0) {
+                virReportSystemError(errno, "%s",
+                                     _("Failed to create log writer thread"));
+                ret = -1;
+                goto cleanup;
+            }
+            virLogAsyncThreadRunning = true;
+        }
+        virLogAsyncEnabled = true;
+    } else {
+        virLogAsyncEnabled = false;
+        virCondBroadcast(&virLogAsyncDataCond);
+        while (virLogAsyncThreadRunning)
+            ignore_value(virCondWait(&virLogAsyncSpaceCond,
+                                     &virLogAsyncLock));
+    }
+
+ cleanup:
+    virMutexUnlock(&virLogAsyncLock);
+    return ret;
+}
+
 /**
  * virLogMessage:
  * @source: where is that message coming from
@@ -603,12 +1071,10 @@ virLogVMessage(virLogSourcePtr source,
                const char *fmt,
                va_list vargs)
 {
-    static bool logInitMessageStderr = true;
     char *str = NULL;
     char *msg = NULL;
     char timestamp[VIR_TIME_STRING_BUFLEN];
     int ret;
-    size_t i;
     int saved_errno = errno;
     unsigned int filterflags = 0;
 
@@ -645,64 +1111,20 @@ virLogVMessage(virLogSourcePtr source,
     if (virTimeStringNowRaw(timestamp) < 0)
         timestamp[0] = '\0';
 
-    virLogLock();
-
     /*
-     * Push the message to the outputs defined, if none exist then
-     * use stderr.
+     * In async mode hand the formatted message over to the writer
+     * thread; otherwise push it to the outputs defined, if none exist
+     * then use stderr.
      */
-    for (i = 0; i < virLogNbOutputs; i++) {
-        if (priority >= virLogOutputs[i]->priority) {
-            if (virLogOutputs[i]->logInitMessage) {
-                const char *rawinitmsg;
-                char *hoststr = NULL;
-                char *initmsg = NULL;
-                if (virLogVersionString(&rawinitmsg, &initmsg) >= 0)
-                    virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
-                                       __FILE__, __LINE__, __func__,
-                                       timestamp, NULL, 0, rawinitmsg, initmsg,
-                                       virLogOutputs[i]->data);
-                VIR_FREE(initmsg);
-                if (virLogHostnameString(&hoststr, &initmsg) >= 0)
-                    virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
-                                       __FILE__, __LINE__, __func__,
-                                       timestamp, NULL, 0, hoststr, initmsg,
-                                       virLogOutputs[i]->data);
-                VIR_FREE(hoststr);
-                VIR_FREE(initmsg);
-                virLogOutputs[i]->logInitMessage = false;
-            }
-            virLogOutputs[i]->f(source, priority,
-                               filename, linenr, funcname,
-                               timestamp, metadata, filterflags,
-                               str, msg, virLogOutputs[i]->data);
-        }
-    }
-    if (virLogNbOutputs == 0) {
-        if (logInitMessageStderr) {
-            const char *rawinitmsg;
-            char *hoststr = NULL;
-            char *initmsg = NULL;
-            if (virLogVersionString(&rawinitmsg, &initmsg) >= 0)
-                virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
-                                 __FILE__, __LINE__, __func__,
-                                 timestamp, NULL, 0, rawinitmsg, initmsg,
-                                 (void *) STDERR_FILENO);
-            VIR_FREE(initmsg);
-            if (virLogHostnameString(&hoststr, &initmsg) >= 0)
-                virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
-                                 __FILE__, __LINE__, __func__,
-                                 timestamp, NULL, 0, hoststr, initmsg,
-                                 (void *) STDERR_FILENO);
-            VIR_FREE(hoststr);
-            VIR_FREE(initmsg);
-            logInitMessageStderr = false;
-        }
-        virLogOutputToFd(source, priority,
-                         filename, linenr, funcname,
-                         timestamp, metadata, filterflags,
-                         str, msg, (void *) STDERR_FILENO);
+    if (virLogAsyncEnqueue(source, priority, filename, linenr, funcname,
+                           timestamp, metadata, filterflags, str, msg)) {
+        str = msg = NULL;
+        goto cleanup;
     }
+
+    virLogLock();
+    virLogDispatchLocked(source, priority, filename, linenr, funcname,
+                         timestamp, metadata, filterflags, str, msg);
     virLogUnlock();
 
  cleanup:
@@ -182,6 +182,10 @@ char *virLogGetFilters(void);
 char *virLogGetOutputs(void);
 virLogPriority virLogGetDefaultPriority(void);
 int virLogSetDefaultPriority(virLogPriority priority);
+int virLogSetAsync(bool enabled);
+void virLogAsyncForkLock(void);
+void virLogAsyncForkUnlock(void);
+void virLogAsyncForkReset(void);
 void virLogSetFromEnv(void);
 int virLogDefineFilter(const char *match,
                        virLogPriority priority,
@@ -0,0 +1,104 @@
+/*
+ * virmetrics.c: lightweight in-process performance counters
+ *
+ * Copyright (C) 2016 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "virmetrics.h"
+#include "virlog.h"
+#include "virthread.h"
+#include "virutil.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.metrics");
+
+VIR_ENUM_DECL(virMetricsSource)
+VIR_ENUM_IMPL(virMetricsSource, VIR_METRICS_LAST,
+              "rpc-dispatch",
+              "qemu-job-wait",
+              "qemu-monitor-send",
+              "event-dispatch")
+
+/* The dtrace PROBE points need external tooling, which production
+ * deployments often cannot run; these counters are the always-on
+ * fallback.  Updates take one uncontended mutex, which is noise
+ * compared to the operations being measured (RPC dispatches, monitor
+ * round trips), so recording is unconditional. */
+typedef struct _virMetricsEntry virMetricsEntry;
+struct _virMetricsEntry {
+    unsigned long long count;
+    unsigned long long totalMs;
+    unsigned long long maxMs;
+};
+
+static virMutex virMetricsLock = VIR_MUTEX_INITIALIZER;
+static virMetricsEntry virMetricsEntries[VIR_METRICS_LAST];
+
+
+/**
+ * virMetricsRecord:
+ * @source: which choke point the sample came from
+ * @ms: elapsed wall time of one operation in milliseconds
+ *
+ * Fold one latency sample into the per-source aggregate.
+ */
+void
+virMetricsRecord(virMetricsSource source,
+                 unsigned long long ms)
+{
+    virMetricsEntry *entry;
+
+    if (source < 0 || source >= VIR_METRICS_LAST)
+        return;
+
+    virMutexLock(&virMetricsLock);
+    entry = &virMetricsEntries[source];
+    entry->count++;
+    entry->totalMs += ms;
+    if (ms > entry->maxMs)
+        entry->maxMs = ms;
+    virMutexUnlock(&virMetricsLock);
+}
+
+
+/**
+ * virMetricsDump:
+ *
+ * Write every counter to the log at info level.  Wired to SIGUSR2 in
+ * libvirtd so the numbers can be extracted from a production daemon
+ * without restarting it or attaching external tooling.
+ */
+void
+virMetricsDump(void)
+{
+    size_t i;
+
+    virMutexLock(&virMetricsLock);
+    for (i = 0; i < VIR_METRICS_LAST; i++) {
+        virMetricsEntry *entry = &virMetricsEntries[i];
+
+        VIR_INFO("metric %s: count=%llu totalMs=%llu avgMs=%.1f maxMs=%llu",
+                 virMetricsSourceTypeToString(i),
+                 entry->count, entry->totalMs,
+                 entry->count ? (double)entry->totalMs / entry->count : 0.0,
+                 entry->maxMs);
+    }
+    virMutexUnlock(&virMetricsLock);
+}
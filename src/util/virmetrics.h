@@ -0,0 +1,40 @@
+/*
+ * virmetrics.h: lightweight in-process performance counters
+ *
+ * Copyright (C) 2016 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VIR_METRICS_H__
+# define __VIR_METRICS_H__
+
+# include "internal.h"
+
+typedef enum {
+    VIR_METRICS_RPC_DISPATCH = 0,  /* RPC procedure dispatch time */
+    VIR_METRICS_QEMU_JOB_WAIT,     /* wait to acquire a qemu domain job */
+    VIR_METRICS_QEMU_MONITOR_SEND, /* qemu monitor command round trip */
+    VIR_METRICS_EVENT_DISPATCH,    /* event loop dispatch phase */
+
+    VIR_METRICS_LAST
+} virMetricsSource;
+
+void virMetricsRecord(virMetricsSource source,
+                      unsigned long long ms);
+
+void virMetricsDump(void);
+
+#endif /* __VIR_METRICS_H__ */
@@ -29,9 +29,11 @@
 #include "virerror.h"
 #include "vircommand.h"
 #include "viralloc.h"
+#include "virhash.h"
 #include "virpci.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virthread.h"
 #include "virutil.h"
 
 #include <sys/ioctl.h>
@@ -1368,6 +1370,90 @@ virNetDevSysfsFile(char **pf_sysfs_device_link ATTRIBUTE_UNUSED,
 #endif /* !__linux__ */
 #if defined(__linux__) && defined(HAVE_LIBNL) && defined(IFLA_VF_MAX)
 
+/* Replacing the config of one VF requires probing its PF: an online
+ * check plus a netlink dump of the PF's whole IFLA_VFINFO_LIST.  When
+ * many VFs of the same PF are configured in a row (SR-IOV multi-device
+ * attach) this gets quadratic, so callers can bracket the sequence with
+ * virNetDevVfConfigBatchBegin/End and all VFs of a PF will share one
+ * probe.  Entries are immutable until the outermost End drops them.
+ */
+typedef struct _virNetDevVfBatchEntry virNetDevVfBatchEntry;
+typedef virNetDevVfBatchEntry *virNetDevVfBatchEntryPtr;
+struct _virNetDevVfBatchEntry {
+    bool online;
+    void *nlData;
+    struct nlattr *tb[IFLA_MAX + 1];
+};
+
+static virMutex virNetDevVfBatchLock = VIR_MUTEX_INITIALIZER;
+static size_t virNetDevVfBatchDepth;
+static virHashTablePtr virNetDevVfBatchCache;
+
+static void
+virNetDevVfBatchEntryFree(void *payload,
+                          const void *name ATTRIBUTE_UNUSED)
+{
+    virNetDevVfBatchEntryPtr entry = payload;
+
+    VIR_FREE(entry->nlData);
+    VIR_FREE(entry);
+}
+
+void
+virNetDevVfConfigBatchBegin(void)
+{
+    virMutexLock(&virNetDevVfBatchLock);
+    virNetDevVfBatchDepth++;
+    virMutexUnlock(&virNetDevVfBatchLock);
+}
+
+void
+virNetDevVfConfigBatchEnd(void)
+{
+    virMutexLock(&virNetDevVfBatchLock);
+    if (virNetDevVfBatchDepth > 0 && --virNetDevVfBatchDepth == 0) {
+        virHashFree(virNetDevVfBatchCache);
+        virNetDevVfBatchCache = NULL;
+    }
+    virMutexUnlock(&virNetDevVfBatchLock);
+}
+
+/* Returns the shared PF probe for @pflinkdev, running it on first use.
+ * Returns NULL when no batch is active or the probe failed; the caller
+ * falls back to probing the PF itself */
+static virNetDevVfBatchEntryPtr
+virNetDevVfBatchGet(const char *pflinkdev)
+{
+    virNetDevVfBatchEntryPtr entry = NULL;
+
+    virMutexLock(&virNetDevVfBatchLock);
+
+    if (virNetDevVfBatchDepth == 0)
+        goto cleanup;
+
+    if (!virNetDevVfBatchCache &&
+        !(virNetDevVfBatchCache = virHashCreate(4, virNetDevVfBatchEntryFree)))
+        goto cleanup;
+
+    if ((entry = virHashLookup(virNetDevVfBatchCache, pflinkdev)))
+        goto cleanup;
+
+    if (VIR_ALLOC(entry) < 0)
+        goto cleanup;
+
+    if (virNetDevGetOnline(pflinkdev, &entry->online) < 0 ||
+        virNetlinkDumpLink(pflinkdev, -1, &entry->nlData, entry->tb, 0, 0) < 0 ||
+        virHashAddEntry(virNetDevVfBatchCache, pflinkdev, entry) < 0) {
+        virNetDevVfBatchEntryFree(entry, NULL);
+        entry = NULL;
+        goto cleanup;
+    }
+
+ cleanup:
+    virMutexUnlock(&virNetDevVfBatchLock);
+    return entry;
+}
+
 
 static struct nla_policy ifla_vf_policy[IFLA_VF_MAX+1] = {
     [IFLA_VF_MAC]       = { .type = NLA_UNSPEC,
@@ -1595,6 +1681,7 @@ virNetDevReplaceVfConfig(const char *pflinkdev, int vf,
     char *fileData = NULL;
     int ifindex = -1;
     bool pfIsOnline;
+    virNetDevVfBatchEntryPtr batch = virNetDevVfBatchGet(pflinkdev);
 
     /* Assure that PF is online prior to twiddling with the VF.  It
      * *should* be, but if the PF isn't online the changes made to the
@@ -1605,8 +1692,11 @@ virNetDevReplaceVfConfig(const char *pflinkdev, int vf,
      * the admin expects, so we want them to explicitly enable the PF
      * in the host system network config.
      */
-    if (virNetDevGetOnline(pflinkdev, &pfIsOnline) < 0)
+    if (batch) {
+        pfIsOnline = batch->online;
+    } else if (virNetDevGetOnline(pflinkdev, &pfIsOnline) < 0) {
        goto cleanup;
+    }
     if (!pfIsOnline) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Unable to configure VF %d of PF '%s' "
@@ -1617,8 +1707,12 @@ virNetDevReplaceVfConfig(const char *pflinkdev, int vf,
         goto cleanup;
     }
 
-    if (virNetDevGetVfConfig(pflinkdev, vf, &oldmac, &oldvlanid) < 0)
+    if (batch) {
+        if (virNetDevParseVfConfig(batch->tb, vf, &oldmac, &oldvlanid) < 0)
+            goto cleanup;
+    } else if (virNetDevGetVfConfig(pflinkdev, vf, &oldmac, &oldvlanid) < 0) {
         goto cleanup;
+    }
 
     if (virAsprintf(&path, "%s/%s_vf%d",
                     stateDir, pflinkdev, vf) < 0)
@@ -1834,6 +1928,18 @@ virNetDevRestoreNetConfig(const char *linkdev ATTRIBUTE_UNUSED,
     return -1;
 }
 
+void
+virNetDevVfConfigBatchBegin(void)
+{
+    /* Nothing to batch on this platform */
+}
+
+void
+virNetDevVfConfigBatchEnd(void)
+{
+    /* Nothing to batch on this platform */
+}
+
 #endif /* defined(__linux__) && defined(HAVE_LIBNL) */
 
 VIR_ENUM_IMPL(virNetDevIfState,
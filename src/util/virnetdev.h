@@ -193,6 +193,9 @@ int virNetDevReplaceNetConfig(const char *linkdev, int vf,
 int virNetDevRestoreNetConfig(const char *linkdev, int vf, const char *stateDir)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(3);
 
+void virNetDevVfConfigBatchBegin(void);
+void virNetDevVfConfigBatchEnd(void);
+
 int virNetDevGetVirtualFunctionInfo(const char *vfname, char **pfname,
                                     int *vf)
     ATTRIBUTE_NONNULL(1);
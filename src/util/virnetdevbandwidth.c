@@ -24,6 +24,7 @@
 #include <unistd.h>
 
 #include "virnetdevbandwidth.h"
+#include "virbuffer.h"
 #include "vircommand.h"
 #include "viralloc.h"
 #include "virerror.h"
@@ -66,6 +67,22 @@ virNetDevBandwidthCmdAddOptimalQuantum(virCommandPtr cmd,
     virCommandAddArgFormat(cmd, "%llu", r2q);
 }
 
+/* Like virNetDevBandwidthCmdAddOptimalQuantum, but appending to a
+ * line of a tc batch script instead of an argv */
+static void
+virNetDevBandwidthBufAddOptimalQuantum(virBufferPtr buf,
+                                       const virNetDevBandwidthRate *rate)
+{
+    const unsigned long long mtu = 1500;
+    unsigned long long r2q;
+
+    r2q = rate->average * 1024 / 8 / mtu;
+    if (!r2q)
+        r2q = 1;
+
+    virBufferAsprintf(buf, " quantum %llu", r2q);
+}
+
 /**
  * virNetDevBandwidthManipulateFilter:
  * @ifname: interface to operate on
@@ -182,6 +199,11 @@ virNetDevBandwidthManipulateFilter(const char *ifname,
  * hierarchical class. It is used to guarantee minimal
  * throughput ('floor' attribute in NIC).
  *
+ * All the qdisc/class/filter commands are collected into one
+ * tc batch script and handed to a single tc process, so setting
+ * up a many-NIC domain doesn't fork half a dozen processes per
+ * interface.
+ *
  * Return 0 on success, -1 otherwise.
  */
 int
@@ -190,6 +212,7 @@ virNetDevBandwidthSet(const char *ifname,
                       bool hierarchical_class)
 {
     int ret = -1;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
     virCommandPtr cmd = NULL;
     char *average = NULL;
     char *peak = NULL;
@@ -227,12 +250,8 @@ virNetDevBandwidthSet(const char *ifname,
             (virAsprintf(&burst, "%llukb", bandwidth->in->burst) < 0))
             goto cleanup;
 
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname, "root",
-                             "handle", "1:", "htb", "default",
-                             hierarchical_class ? "2" : "1", NULL);
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virBufferAsprintf(&buf, "qdisc add dev %s root handle 1: htb default %s\n",
+                          ifname, hierarchical_class ? "2" : "1");
 
         /* If we are creating a hierarchical class, all non guaranteed traffic
          * goes to the 1:2 class which will adjust 'rate' dynamically as NICs
@@ -298,49 +317,33 @@ virNetDevBandwidthSet(const char *ifname,
          * it before you dig into the code.
          */
         if (hierarchical_class) {
-            virCommandFree(cmd);
-            cmd = virCommandNew(TC);
-            virCommandAddArgList(cmd, "class", "add", "dev", ifname, "parent",
-                                 "1:", "classid", "1:1", "htb", "rate", average,
-                                 "ceil", peak ? peak : average, NULL);
-            virNetDevBandwidthCmdAddOptimalQuantum(cmd, bandwidth->in);
-            if (virCommandRun(cmd, NULL) < 0)
-                goto cleanup;
+            virBufferAsprintf(&buf,
+                              "class add dev %s parent 1: classid 1:1 htb rate %s ceil %s",
+                              ifname, average, peak ? peak : average);
+            virNetDevBandwidthBufAddOptimalQuantum(&buf, bandwidth->in);
+            virBufferAddChar(&buf, '\n');
         }
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "class", "add", "dev", ifname, "parent",
-                             hierarchical_class ? "1:1" : "1:", "classid",
-                             hierarchical_class ? "1:2" : "1:1", "htb",
-                             "rate", average, NULL);
+
+        virBufferAsprintf(&buf, "class add dev %s parent %s classid %s htb rate %s",
+                          ifname,
+                          hierarchical_class ? "1:1" : "1:",
+                          hierarchical_class ? "1:2" : "1:1",
+                          average);
 
         if (peak)
-            virCommandAddArgList(cmd, "ceil", peak, NULL);
+            virBufferAsprintf(&buf, " ceil %s", peak);
         if (burst)
-            virCommandAddArgList(cmd, "burst", burst, NULL);
+            virBufferAsprintf(&buf, " burst %s", burst);
 
-        virNetDevBandwidthCmdAddOptimalQuantum(cmd, bandwidth->in);
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virNetDevBandwidthBufAddOptimalQuantum(&buf, bandwidth->in);
+        virBufferAddChar(&buf, '\n');
 
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname, "parent",
-                             hierarchical_class ? "1:2" : "1:1",
-                             "handle", "2:", "sfq", "perturb",
-                             "10", NULL);
+        virBufferAsprintf(&buf, "qdisc add dev %s parent %s handle 2: sfq perturb 10\n",
+                          ifname, hierarchical_class ? "1:2" : "1:1");
 
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "parent",
-                             "1:0", "protocol", "all", "prio", "1", "handle",
-                             "1", "fw", "flowid", "1", NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virBufferAsprintf(&buf,
+                          "filter add dev %s parent 1:0 protocol all prio 1 handle 1 fw flowid 1\n",
+                          ifname);
 
         VIR_FREE(average);
         VIR_FREE(peak);
@@ -354,22 +357,22 @@ virNetDevBandwidthSet(const char *ifname,
                         bandwidth->out->burst : bandwidth->out->average) < 0)
             goto cleanup;
 
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-            virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname,
-                                 "ingress", NULL);
+        virBufferAsprintf(&buf, "qdisc add dev %s ingress\n", ifname);
 
-        if (virCommandRun(cmd, NULL) < 0)
+        /* Set filter to match all ingress traffic */
+        virBufferAsprintf(&buf,
+                          "filter add dev %s parent ffff: protocol all u32 match u32 0 0 "
+                          "police rate %s burst %s mtu 64kb drop flowid :1\n",
+                          ifname, average, burst);
+    }
+
+    if (virBufferUse(&buf)) {
+        if (virBufferCheckError(&buf) < 0)
             goto cleanup;
 
-        virCommandFree(cmd);
         cmd = virCommandNew(TC);
-        /* Set filter to match all ingress traffic */
-        virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "parent",
-                             "ffff:", "protocol", "all", "u32", "match", "u32",
-                             "0", "0", "police", "rate", average,
-                             "burst", burst, "mtu", "64kb", "drop", "flowid",
-                             ":1", NULL);
+        virCommandAddArgList(cmd, "-batch", "-", NULL);
+        virCommandSetInputBuffer(cmd, virBufferCurrentContent(&buf));
 
         if (virCommandRun(cmd, NULL) < 0)
             goto cleanup;
@@ -378,6 +381,7 @@ virNetDevBandwidthSet(const char *ifname,
     ret = 0;
 
  cleanup:
+    virBufferFreeAndReset(&buf);
     virCommandFree(cmd);
     VIR_FREE(average);
     VIR_FREE(peak);
@@ -401,24 +405,27 @@ virNetDevBandwidthClear(const char *ifname)
     int ret = 0;
     int dummy; /* for ignoring the exit status */
     virCommandPtr cmd = NULL;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
 
     if (!ifname)
        return 0;
 
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc", "del", "dev", ifname, "root", NULL);
+    /* Either delete may fail if the default qdisc is in place;
+     * -force keeps the batch going so both get their chance */
+    virBufferAsprintf(&buf, "qdisc del dev %s root\n", ifname);
+    virBufferAsprintf(&buf, "qdisc del dev %s ingress\n", ifname);
 
-    if (virCommandRun(cmd, &dummy) < 0)
-        ret = -1;
-
-    virCommandFree(cmd);
+    if (virBufferCheckError(&buf) < 0)
+        return -1;
 
     cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc",  "del", "dev", ifname, "ingress", NULL);
+    virCommandAddArgList(cmd, "-force", "-batch", "-", NULL);
+    virCommandSetInputBuffer(cmd, virBufferCurrentContent(&buf));
 
     if (virCommandRun(cmd, &dummy) < 0)
         ret = -1;
 
+    virBufferFreeAndReset(&buf);
     virCommandFree(cmd);
 
     return ret;
@@ -36,27 +36,26 @@
 
 VIR_LOG_INIT("util.netdevopenvswitch");
 
-/**
- * virNetDevOpenvswitchAddPort:
- * @brname: the bridge name
- * @ifname: the network interface name
- * @macaddr: the mac address of the virtual interface
- * @vmuuid: the Domain UUID that has this interface
- * @ovsport: the ovs specific fields
- *
- * Add an interface to the OVS bridge
- *
- * Returns 0 in case of success or -1 in case of failure.
- */
-int virNetDevOpenvswitchAddPort(const char *brname, const char *ifname,
-                                   const virMacAddr *macaddr,
-                                   const unsigned char *vmuuid,
-                                   virNetDevVPortProfilePtr ovsport,
-                                   virNetDevVlanPtr virtVlan)
+/* A batch collects several port operations as ovs-vsctl compound
+ * commands (separated by "--") and runs them with a single fork and
+ * a single OVSDB transaction when committed. */
+struct _virNetDevOpenvswitchBatch {
+    virCommandPtr cmd;
+    size_t nops;
+};
+
+/* Append the compound commands making up a port addition to @cmd,
+ * starting with a "--" separator. */
+static int
+virNetDevOpenvswitchAddPortCompound(virCommandPtr cmd,
+                                    const char *brname, const char *ifname,
+                                    const virMacAddr *macaddr,
+                                    const unsigned char *vmuuid,
+                                    virNetDevVPortProfilePtr ovsport,
+                                    virNetDevVlanPtr virtVlan)
 {
     int ret = -1;
     size_t i = 0;
-    virCommandPtr cmd = NULL;
     char macaddrstr[VIR_MAC_STRING_BUFLEN];
     char ifuuidstr[VIR_UUID_STRING_BUFLEN];
     char vmuuidstr[VIR_UUID_STRING_BUFLEN];
@@ -85,9 +84,7 @@ int virNetDevOpenvswitchAddPort(const char *brname, const char *ifname,
             goto cleanup;
     }
 
-    cmd = virCommandNew(OVSVSCTL);
-
-    virCommandAddArgList(cmd, "--timeout=5", "--", "--if-exists", "del-port",
+    virCommandAddArgList(cmd, "--", "--if-exists", "del-port",
                          ifname, "--", "add-port", brname, ifname, NULL);
 
     if (virtVlan && virtVlan->nTags > 0) {
@@ -149,6 +146,44 @@ int virNetDevOpenvswitchAddPort(const char *brname, const char *ifname,
                         NULL);
     }
 
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(attachedmac_ex_id);
+    VIR_FREE(ifaceid_ex_id);
+    VIR_FREE(vmid_ex_id);
+    VIR_FREE(profile_ex_id);
+    return ret;
+}
+
+/**
+ * virNetDevOpenvswitchAddPort:
+ * @brname: the bridge name
+ * @ifname: the network interface name
+ * @macaddr: the mac address of the virtual interface
+ * @vmuuid: the Domain UUID that has this interface
+ * @ovsport: the ovs specific fields
+ *
+ * Add an interface to the OVS bridge
+ *
+ * Returns 0 in case of success or -1 in case of failure.
+ */
+int virNetDevOpenvswitchAddPort(const char *brname, const char *ifname,
+                                   const virMacAddr *macaddr,
+                                   const unsigned char *vmuuid,
+                                   virNetDevVPortProfilePtr ovsport,
+                                   virNetDevVlanPtr virtVlan)
+{
+    int ret = -1;
+    virCommandPtr cmd = NULL;
+
+    cmd = virCommandNew(OVSVSCTL);
+    virCommandAddArg(cmd, "--timeout=5");
+
+    if (virNetDevOpenvswitchAddPortCompound(cmd, brname, ifname, macaddr,
+                                            vmuuid, ovsport, virtVlan) < 0)
+        goto cleanup;
+
     if (virCommandRun(cmd, NULL) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Unable to add port %s to OVS bridge %s"),
@@ -158,11 +193,6 @@ int virNetDevOpenvswitchAddPort(const char *brname, const char *ifname,
 
     ret = 0;
  cleanup:
-    virBufferFreeAndReset(&buf);
-    VIR_FREE(attachedmac_ex_id);
-    VIR_FREE(ifaceid_ex_id);
-    VIR_FREE(vmid_ex_id);
-    VIR_FREE(profile_ex_id);
     virCommandFree(cmd);
     return ret;
 }
@@ -195,6 +225,116 @@ int virNetDevOpenvswitchRemovePort(const char *brname ATTRIBUTE_UNUSED, const ch
     return ret;
 }
 
+/**
+ * virNetDevOpenvswitchBatchNew:
+ *
+ * Create a new batch of port operations.  The operations queued on
+ * the batch are run by virNetDevOpenvswitchBatchCommit as compound
+ * commands of a single ovs-vsctl invocation, so that attaching or
+ * tearing down many ports costs one fork and one OVSDB transaction.
+ *
+ * Returns the new batch, or NULL on allocation failure.
+ */
+virNetDevOpenvswitchBatchPtr
+virNetDevOpenvswitchBatchNew(void)
+{
+    virNetDevOpenvswitchBatchPtr batch;
+
+    if (VIR_ALLOC(batch) < 0)
+        return NULL;
+
+    if (!(batch->cmd = virCommandNew(OVSVSCTL))) {
+        VIR_FREE(batch);
+        return NULL;
+    }
+    virCommandAddArg(batch->cmd, "--timeout=5");
+
+    return batch;
+}
+
+/**
+ * virNetDevOpenvswitchBatchAddPort:
+ *
+ * Queue the addition of an interface to an OVS bridge on @batch.
+ * Takes the same arguments as virNetDevOpenvswitchAddPort.
+ *
+ * Returns 0 in case of success or -1 in case of failure.
+ */
+int
+virNetDevOpenvswitchBatchAddPort(virNetDevOpenvswitchBatchPtr batch,
+                                 const char *brname, const char *ifname,
+                                 const virMacAddr *macaddr,
+                                 const unsigned char *vmuuid,
+                                 virNetDevVPortProfilePtr ovsport,
+                                 virNetDevVlanPtr virtVlan)
+{
+    if (virNetDevOpenvswitchAddPortCompound(batch->cmd, brname, ifname,
+                                            macaddr, vmuuid, ovsport,
+                                            virtVlan) < 0)
+        return -1;
+
+    batch->nops++;
+    return 0;
+}
+
+/**
+ * virNetDevOpenvswitchBatchRemovePort:
+ *
+ * Queue the deletion of an interface from its OVS bridge on @batch.
+ *
+ * Returns 0 in case of success or -1 in case of failure.
+ */
+int
+virNetDevOpenvswitchBatchRemovePort(virNetDevOpenvswitchBatchPtr batch,
+                                    const char *ifname)
+{
+    virCommandAddArgList(batch->cmd, "--", "--if-exists", "del-port",
+                         ifname, NULL);
+
+    batch->nops++;
+    return 0;
+}
+
+/**
+ * virNetDevOpenvswitchBatchCommit:
+ *
+ * Run all operations queued on @batch in one ovs-vsctl invocation.
+ * A batch with no queued operations is a no-op.  The batch may not
+ * be reused after committing.
+ *
+ * Returns 0 in case of success or -1 in case of failure.
+ */
+int
+virNetDevOpenvswitchBatchCommit(virNetDevOpenvswitchBatchPtr batch)
+{
+    if (batch->nops == 0)
+        return 0;
+
+    if (virCommandRun(batch->cmd, NULL) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unable to commit %zu OVS port operations"),
+                       batch->nops);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * virNetDevOpenvswitchBatchFree:
+ *
+ * Free @batch, discarding any uncommitted operations.
+ */
+void
+virNetDevOpenvswitchBatchFree(virNetDevOpenvswitchBatchPtr batch)
+{
+    if (!batch)
+        return;
+
+    virCommandFree(batch->cmd);
+    VIR_FREE(batch);
+}
+
 /**
  * virNetDevOpenvswitchGetMigrateData:
  * @migrate: a pointer to store the data into, allocated by this function
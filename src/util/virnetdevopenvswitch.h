@@ -30,6 +30,9 @@
 # include "virnetdevvlan.h"
 
 
+typedef struct _virNetDevOpenvswitchBatch virNetDevOpenvswitchBatch;
+typedef virNetDevOpenvswitchBatch *virNetDevOpenvswitchBatchPtr;
+
 int virNetDevOpenvswitchAddPort(const char *brname,
                                 const char *ifname,
                                 const virMacAddr *macaddr,
@@ -42,6 +45,27 @@ int virNetDevOpenvswitchAddPort(const char *brname,
 int virNetDevOpenvswitchRemovePort(const char *brname, const char *ifname)
     ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
 
+virNetDevOpenvswitchBatchPtr virNetDevOpenvswitchBatchNew(void);
+
+int virNetDevOpenvswitchBatchAddPort(virNetDevOpenvswitchBatchPtr batch,
+                                     const char *brname,
+                                     const char *ifname,
+                                     const virMacAddr *macaddr,
+                                     const unsigned char *vmuuid,
+                                     virNetDevVPortProfilePtr ovsport,
+                                     virNetDevVlanPtr virtVlan)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3)
+    ATTRIBUTE_NONNULL(4) ATTRIBUTE_RETURN_CHECK;
+
+int virNetDevOpenvswitchBatchRemovePort(virNetDevOpenvswitchBatchPtr batch,
+                                        const char *ifname)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
+
+int virNetDevOpenvswitchBatchCommit(virNetDevOpenvswitchBatchPtr batch)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+
+void virNetDevOpenvswitchBatchFree(virNetDevOpenvswitchBatchPtr batch);
+
 int virNetDevOpenvswitchGetMigrateData(char **migrate, const char *ifname)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
 
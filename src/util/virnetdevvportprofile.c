@@ -61,8 +61,10 @@ VIR_ENUM_IMPL(virNetDevVPortProfileOp, VIR_NETDEV_VPORT_PROFILE_OP_LAST,
 
 # include "virnetlink.h"
 # include "virfile.h"
+# include "virhash.h"
 # include "virlog.h"
 # include "virnetdev.h"
+# include "virthread.h"
 
 VIR_LOG_INIT("util.netdevvportprofile");
 
@@ -913,6 +915,207 @@ virNetDevVPortProfileGetNthParent(const char *ifname, int ifindex, unsigned int
 }
 
 
+/* The parameters of the last successful associate setlink per
+ * interface index.  When a VM is migrated or restarted on an
+ * interface whose switch port is already programmed with the same
+ * MAC/VLAN/profile tuple, one netlink status query replaces the full
+ * handshake with its multi-second status poll loop. */
+typedef struct _virNetDevVPortProfileProgrammed virNetDevVPortProfileProgrammed;
+typedef virNetDevVPortProfileProgrammed *virNetDevVPortProfileProgrammedPtr;
+struct _virNetDevVPortProfileProgrammed {
+    virMacAddr macaddr;
+    bool hasMacaddr;
+    int vlanid;
+    char *profileId;
+    struct ifla_port_vsi portVsi;
+    bool hasPortVsi;
+    unsigned char instanceId[VIR_UUID_BUFLEN];
+    bool hasInstanceId;
+    unsigned char hostUUID[VIR_UUID_BUFLEN];
+    bool hasHostUUID;
+    int32_t vf;
+    uint8_t op;
+};
+
+static virMutex virNetDevVPortProfileProgrammedLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virNetDevVPortProfileProgrammedCache;
+
+static void
+virNetDevVPortProfileProgrammedFree(void *payload,
+                                    const void *name ATTRIBUTE_UNUSED)
+{
+    virNetDevVPortProfileProgrammedPtr prog = payload;
+
+    VIR_FREE(prog->profileId);
+    VIR_FREE(prog);
+}
+
+/* Check whether the cache records @ifindex as associated with exactly
+ * the given parameters.  Must be matched against the actual state via
+ * netlink before it is trusted. */
+static bool
+virNetDevVPortProfileProgrammedMatches(int ifindex,
+                                       const virMacAddr *macaddr,
+                                       int vlanid,
+                                       const char *profileId,
+                                       struct ifla_port_vsi *portVsi,
+                                       const unsigned char *instanceId,
+                                       const unsigned char *hostUUID,
+                                       int32_t vf,
+                                       uint8_t op)
+{
+    virNetDevVPortProfileProgrammedPtr prog;
+    char key[32];
+    bool ret = false;
+
+    snprintf(key, sizeof(key), "%d", ifindex);
+
+    virMutexLock(&virNetDevVPortProfileProgrammedLock);
+
+    if (!virNetDevVPortProfileProgrammedCache ||
+        !(prog = virHashLookup(virNetDevVPortProfileProgrammedCache, key)))
+        goto cleanup;
+
+    if (prog->hasMacaddr != !!macaddr ||
+        (macaddr && virMacAddrCmp(&prog->macaddr, macaddr) != 0))
+        goto cleanup;
+    if (prog->vlanid != vlanid)
+        goto cleanup;
+    if (!!prog->profileId != !!profileId ||
+        (profileId && STRNEQ(prog->profileId, profileId)))
+        goto cleanup;
+    if (prog->hasPortVsi != !!portVsi ||
+        (portVsi && memcmp(&prog->portVsi, portVsi, sizeof(*portVsi)) != 0))
+        goto cleanup;
+    if (prog->hasInstanceId != !!instanceId ||
+        (instanceId &&
+         memcmp(prog->instanceId, instanceId, VIR_UUID_BUFLEN) != 0))
+        goto cleanup;
+    if (prog->hasHostUUID != !!hostUUID ||
+        (hostUUID && memcmp(prog->hostUUID, hostUUID, VIR_UUID_BUFLEN) != 0))
+        goto cleanup;
+    if (prog->vf != vf || prog->op != op)
+        goto cleanup;
+
+    ret = true;
+ cleanup:
+    virMutexUnlock(&virNetDevVPortProfileProgrammedLock);
+    return ret;
+}
+
+static void
+virNetDevVPortProfileProgrammedRecord(int ifindex,
+                                      const virMacAddr *macaddr,
+                                      int vlanid,
+                                      const char *profileId,
+                                      struct ifla_port_vsi *portVsi,
+                                      const unsigned char *instanceId,
+                                      const unsigned char *hostUUID,
+                                      int32_t vf,
+                                      uint8_t op)
+{
+    virNetDevVPortProfileProgrammedPtr prog = NULL;
+    char key[32];
+
+    snprintf(key, sizeof(key), "%d", ifindex);
+
+    if (VIR_ALLOC(prog) < 0)
+        return;
+
+    if ((prog->hasMacaddr = !!macaddr))
+        prog->macaddr = *macaddr;
+    prog->vlanid = vlanid;
+    if (profileId && VIR_STRDUP(prog->profileId, profileId) < 0)
+        goto error;
+    if ((prog->hasPortVsi = !!portVsi))
+        prog->portVsi = *portVsi;
+    if ((prog->hasInstanceId = !!instanceId))
+        memcpy(prog->instanceId, instanceId, VIR_UUID_BUFLEN);
+    if ((prog->hasHostUUID = !!hostUUID))
+        memcpy(prog->hostUUID, hostUUID, VIR_UUID_BUFLEN);
+    prog->vf = vf;
+    prog->op = op;
+
+    virMutexLock(&virNetDevVPortProfileProgrammedLock);
+
+    if (!virNetDevVPortProfileProgrammedCache &&
+        !(virNetDevVPortProfileProgrammedCache =
+              virHashCreate(16, virNetDevVPortProfileProgrammedFree))) {
+        virMutexUnlock(&virNetDevVPortProfileProgrammedLock);
+        goto error;
+    }
+
+    if (virHashUpdateEntry(virNetDevVPortProfileProgrammedCache,
+                           key, prog) < 0) {
+        virMutexUnlock(&virNetDevVPortProfileProgrammedLock);
+        goto error;
+    }
+
+    virMutexUnlock(&virNetDevVPortProfileProgrammedLock);
+    return;
+
+ error:
+    /* the cache is a best-effort shortcut; losing an entry only
+     * means the next associate runs the full handshake */
+    virNetDevVPortProfileProgrammedFree(prog, NULL);
+}
+
+static void
+virNetDevVPortProfileProgrammedForget(int ifindex)
+{
+    char key[32];
+
+    snprintf(key, sizeof(key), "%d", ifindex);
+
+    virMutexLock(&virNetDevVPortProfileProgrammedLock);
+    if (virNetDevVPortProfileProgrammedCache)
+        ignore_value(virHashRemoveEntry(virNetDevVPortProfileProgrammedCache,
+                                        key));
+    virMutexUnlock(&virNetDevVPortProfileProgrammedLock);
+}
+
+/* Check with a single netlink query whether the port profile status
+ * of @ifindex still reports a successful association. */
+static bool
+virNetDevVPortProfileIsAssociated(int ifindex,
+                                  bool nltarget_kernel,
+                                  const unsigned char *instanceId,
+                                  int32_t vf,
+                                  bool is8021Qbg)
+{
+    int src_pid = 0;
+    uint32_t dst_pid = 0;
+    void *nlData = NULL;
+    struct nlattr *tb[IFLA_MAX + 1] = { NULL, };
+    uint16_t status = 0;
+    bool ret = false;
+
+    if (!nltarget_kernel &&
+        (((src_pid = virNetlinkEventServiceLocalPid(NETLINK_ROUTE)) < 0) ||
+         ((dst_pid = virNetDevVPortProfileGetLldpadPid()) == 0)))
+        goto cleanup;
+
+    if (virNetlinkDumpLink(NULL, ifindex, &nlData, tb, src_pid, dst_pid) < 0)
+        goto cleanup;
+
+    if (virNetDevVPortProfileGetStatus(tb, vf, instanceId, nltarget_kernel,
+                                       is8021Qbg, &status) < 0)
+        goto cleanup;
+
+    ret = (status == PORT_PROFILE_RESPONSE_SUCCESS ||
+           status == PORT_VDP_RESPONSE_SUCCESS);
+
+ cleanup:
+    if (!ret) {
+        /* this probe is only a shortcut; do not leave its errors
+         * behind for the full handshake that follows */
+        virResetLastError();
+    }
+    VIR_FREE(nlData);
+    return ret;
+}
+
+
 /* Returns 0 on success, -1 on general failure, and -2 on timeout */
 static int
 virNetDevVPortProfileOpCommon(const char *ifname, int ifindex,
@@ -935,6 +1138,25 @@ virNetDevVPortProfileOpCommon(const char *ifname, int ifindex,
     int repeats = STATUS_POLL_TIMEOUT_USEC / STATUS_POLL_INTERVL_USEC;
     uint16_t status = 0;
     bool is8021Qbg = (profileId == NULL);
+    bool mayCache = (op != VIR_NETDEV_VPORT_PROFILE_LINK_OP_DISASSOCIATE &&
+                     !setlink_only);
+
+    if (op == VIR_NETDEV_VPORT_PROFILE_LINK_OP_DISASSOCIATE) {
+        /* whatever happens below, the port can no longer be assumed
+         * to be programmed */
+        virNetDevVPortProfileProgrammedForget(ifindex);
+    } else if (mayCache &&
+               virNetDevVPortProfileProgrammedMatches(ifindex, macaddr,
+                                                      vlanid, profileId,
+                                                      portVsi, instanceId,
+                                                      hostUUID, vf, op) &&
+               virNetDevVPortProfileIsAssociated(ifindex, nltarget_kernel,
+                                                 instanceId, vf, is8021Qbg)) {
+        VIR_DEBUG("interface %s (%d) already associated with this "
+                  "port profile, skipping setlink",
+                  NULLSTR(ifname), ifindex);
+        return 0;
+    }
 
     rc = virNetDevVPortProfileOpSetLink(ifname, ifindex,
                                         nltarget_kernel,
@@ -995,6 +1217,12 @@ virNetDevVPortProfileOpCommon(const char *ifname, int ifindex,
         rc = -2;
     }
 
+    if (rc == 0 && mayCache) {
+        virNetDevVPortProfileProgrammedRecord(ifindex, macaddr, vlanid,
+                                              profileId, portVsi, instanceId,
+                                              hostUUID, vf, op);
+    }
+
  cleanup:
     VIR_FREE(nlData);
     return rc;
@@ -37,9 +37,11 @@
 
 #include "virnetlink.h"
 #include "virnetdev.h"
+#include "virhash.h"
 #include "virlog.h"
 #include "viralloc.h"
 #include "virthread.h"
+#include "virtime.h"
 #include "virmacaddr.h"
 #include "virerror.h"
 
@@ -436,6 +438,227 @@ virNetlinkDumpLink(const char *ifname, int ifindex,
 }
 
 
+/* Interface stats fetched with a single RTM_GETLINK dump are kept in
+ * a hash table keyed by interface name for a short while, so that a
+ * stats sweep over all domains costs one netlink request rather than
+ * one /proc/net/dev parse per interface. */
+# define NETLINK_LINK_STATS_TTL_MS 1000
+
+static virMutex linkStatsLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr linkStatsCache;
+static unsigned long long linkStatsFetched;
+
+static void
+virNetlinkLinkStatsCacheDataFree(void *payload,
+                                 const void *name ATTRIBUTE_UNUSED)
+{
+    VIR_FREE(payload);
+}
+
+static int
+virNetlinkLinkStatsCacheAdd(virHashTablePtr cache,
+                            struct nlmsghdr *msg)
+{
+    struct nlattr *tb[IFLA_MAX + 1];
+    virNetlinkLinkStatsPtr entry = NULL;
+    const char *ifname;
+    int ret = -1;
+
+    if (nlmsg_parse(msg, sizeof(struct ifinfomsg), tb, IFLA_MAX, NULL) < 0)
+        return -1;
+
+    if (!tb[IFLA_IFNAME])
+        return -1;
+    ifname = nla_get_string(tb[IFLA_IFNAME]);
+
+    if (VIR_ALLOC(entry) < 0)
+        return -1;
+
+# ifdef IFLA_STATS64
+    if (tb[IFLA_STATS64]) {
+        struct rtnl_link_stats64 stats;
+
+        memcpy(&stats, nla_data(tb[IFLA_STATS64]),
+               MIN(sizeof(stats), nla_len(tb[IFLA_STATS64])));
+        entry->rx_bytes = stats.rx_bytes;
+        entry->rx_packets = stats.rx_packets;
+        entry->rx_errs = stats.rx_errors;
+        entry->rx_drop = stats.rx_dropped;
+        entry->tx_bytes = stats.tx_bytes;
+        entry->tx_packets = stats.tx_packets;
+        entry->tx_errs = stats.tx_errors;
+        entry->tx_drop = stats.tx_dropped;
+    } else
+# endif
+    if (tb[IFLA_STATS]) {
+        struct rtnl_link_stats stats;
+
+        memcpy(&stats, nla_data(tb[IFLA_STATS]),
+               MIN(sizeof(stats), nla_len(tb[IFLA_STATS])));
+        entry->rx_bytes = stats.rx_bytes;
+        entry->rx_packets = stats.rx_packets;
+        entry->rx_errs = stats.rx_errors;
+        entry->rx_drop = stats.rx_dropped;
+        entry->tx_bytes = stats.tx_bytes;
+        entry->tx_packets = stats.tx_packets;
+        entry->tx_errs = stats.tx_errors;
+        entry->tx_drop = stats.tx_dropped;
+    } else {
+        goto cleanup;
+    }
+
+    if (virHashUpdateEntry(cache, ifname, entry) < 0)
+        goto cleanup;
+    entry = NULL;
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(entry);
+    return ret;
+}
+
+/* Fetch the counters of all interfaces in one RTM_GETLINK dump and
+ * rebuild the cache from the response.  Called with linkStatsLock
+ * held. */
+static int
+virNetlinkLinkStatsRefresh(void)
+{
+    virHashTablePtr cache = NULL;
+    virNetlinkHandle *nlhandle = NULL;
+    struct sockaddr_nl nladdr = {
+            .nl_family = AF_NETLINK,
+    };
+    struct ifinfomsg ifinfo = {
+        .ifi_family = AF_UNSPEC,
+    };
+    struct nl_msg *nl_msg = NULL;
+    struct nlmsghdr *msg;
+    unsigned char *recvbuf = NULL;
+    bool done = false;
+    int len;
+    int ret = -1;
+
+    if (!(cache = virHashCreate(32, virNetlinkLinkStatsCacheDataFree)))
+        return -1;
+
+    if (!(nl_msg = nlmsg_alloc_simple(RTM_GETLINK,
+                                      NLM_F_REQUEST | NLM_F_DUMP))) {
+        virReportOOMError();
+        goto cleanup;
+    }
+
+    if (nlmsg_append(nl_msg, &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("allocated netlink buffer is too small"));
+        goto cleanup;
+    }
+
+    if (!(nlhandle = virNetlinkCreateSocket(NETLINK_ROUTE)))
+        goto cleanup;
+
+    nlmsg_hdr(nl_msg)->nlmsg_pid = getpid();
+
+    if (nl_send_auto_complete(nlhandle, nl_msg) < 0) {
+        virReportSystemError(errno,
+                             "%s", _("cannot send to netlink socket"));
+        goto cleanup;
+    }
+
+    /* a dump is a multipart response terminated by NLMSG_DONE */
+    while (!done) {
+        int remaining;
+
+        len = nl_recv(nlhandle, &nladdr, &recvbuf, NULL);
+        if (len <= 0) {
+            virReportSystemError(errno, "%s", _("nl_recv failed"));
+            goto cleanup;
+        }
+
+        remaining = len;
+        for (msg = (struct nlmsghdr *)recvbuf;
+             NLMSG_OK(msg, remaining);
+             msg = NLMSG_NEXT(msg, remaining)) {
+            if (msg->nlmsg_type == NLMSG_DONE) {
+                done = true;
+                break;
+            }
+            if (msg->nlmsg_type == NLMSG_ERROR) {
+                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                               _("malformed netlink response message"));
+                goto cleanup;
+            }
+            if (msg->nlmsg_type != RTM_NEWLINK)
+                continue;
+
+            /* skip links without usable attributes */
+            ignore_value(virNetlinkLinkStatsCacheAdd(cache, msg));
+        }
+        VIR_FREE(recvbuf);
+    }
+
+    virHashFree(linkStatsCache);
+    linkStatsCache = cache;
+    cache = NULL;
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(recvbuf);
+    virHashFree(cache);
+    nlmsg_free(nl_msg);
+    if (nlhandle) {
+        nl_close(nlhandle);
+        virNetlinkFree(nlhandle);
+    }
+    return ret;
+}
+
+/**
+ * virNetlinkGetLinkStats:
+ *
+ * @ifname: name of the interface whose counters are wanted
+ * @stats:  filled with the interface's counters, host point of view
+ *
+ * Look up the transfer statistics of an interface from a cached
+ * RTM_GETLINK dump of all interfaces, refreshing the dump when it is
+ * older than one second.
+ *
+ * Returns 0 on success, -1 on error (including the interface not
+ * being known to the kernel).
+ */
+int
+virNetlinkGetLinkStats(const char *ifname,
+                       virNetlinkLinkStatsPtr stats)
+{
+    virNetlinkLinkStatsPtr entry;
+    unsigned long long now;
+    int ret = -1;
+
+    virMutexLock(&linkStatsLock);
+
+    if (virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    if (!linkStatsCache ||
+        now - linkStatsFetched >= NETLINK_LINK_STATS_TTL_MS) {
+        if (virNetlinkLinkStatsRefresh() < 0)
+            goto cleanup;
+        linkStatsFetched = now;
+    }
+
+    if (!(entry = virHashLookup(linkStatsCache, ifname))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("interface '%s' not found"), ifname);
+        goto cleanup;
+    }
+
+    *stats = *entry;
+    ret = 0;
+ cleanup:
+    virMutexUnlock(&linkStatsLock);
+    return ret;
+}
+
+
 /**
  * virNetlinkDelLink:
  *
@@ -1057,6 +1280,15 @@ virNetlinkDumpLink(const char *ifname ATTRIBUTE_UNUSED,
 }
 
 
+int
+virNetlinkGetLinkStats(const char *ifname ATTRIBUTE_UNUSED,
+                       virNetlinkLinkStatsPtr stats ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _(unsupported));
+    return -1;
+}
+
+
 int
 virNetlinkDelLink(const char *ifname ATTRIBUTE_UNUSED,
                   virNetlinkDelLinkFallback fallback ATTRIBUTE_UNUSED)
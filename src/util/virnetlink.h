@@ -63,6 +63,24 @@ int virNetlinkDumpLink(const char *ifname, int ifindex,
                        uint32_t src_pid, uint32_t dst_pid)
     ATTRIBUTE_RETURN_CHECK;
 
+typedef struct _virNetlinkLinkStats virNetlinkLinkStats;
+typedef virNetlinkLinkStats *virNetlinkLinkStatsPtr;
+struct _virNetlinkLinkStats {
+    /* interface counters as seen from the host side */
+    unsigned long long rx_bytes;
+    unsigned long long rx_packets;
+    unsigned long long rx_errs;
+    unsigned long long rx_drop;
+    unsigned long long tx_bytes;
+    unsigned long long tx_packets;
+    unsigned long long tx_errs;
+    unsigned long long tx_drop;
+};
+
+int virNetlinkGetLinkStats(const char *ifname,
+                           virNetlinkLinkStatsPtr stats)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
+
 typedef void (*virNetlinkEventHandleCallback)(struct nlmsghdr *,
                                               unsigned int length,
                                               struct sockaddr_nl *peer,
@@ -45,6 +45,9 @@
 #include "virbitmap.h"
 #include "virstring.h"
 #include "virfile.h"
+#include "virhash.h"
+#include "virthread.h"
+#include "virtime.h"
 #include "virhostmem.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -86,6 +89,24 @@ virNumaGetAutoPlacementAdvice(unsigned short vcpus ATTRIBUTE_UNUSED,
 #endif /* !HAVE_NUMAD */
 
 #if WITH_NUMACTL
+
+/* Per-node memory sizes are re-read from sysfs by libnuma on every query;
+ * monitoring clients poll them every few seconds, so keep a short-lived
+ * cache shared by all callers.
+ */
+# define NUMA_NODE_MEM_TTL_MS 1000
+
+typedef struct _virNumaNodeMemEntry virNumaNodeMemEntry;
+typedef virNumaNodeMemEntry *virNumaNodeMemEntryPtr;
+struct _virNumaNodeMemEntry {
+    unsigned long long fetched;  /* virTimeMillisNowRaw timestamp */
+    unsigned long long memsize;
+    unsigned long long memfree;
+};
+
+static virMutex virNumaNodeMemLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virNumaNodeMemCache;
+
 int
 virNumaSetupMemoryPolicy(virDomainNumatuneMemMode mode,
                          virBitmapPtr nodeset)
@@ -214,6 +235,10 @@ virNumaGetNodeMemory(int node,
 {
     long long node_size;
     long long node_free;
+    virNumaNodeMemEntryPtr entry = NULL;
+    unsigned long long now = 0;
+    char key[32];
+    int ret = -1;
 
     if (memsize)
         *memsize = 0;
@@ -221,8 +246,44 @@ virNumaGetNodeMemory(int node,
     if (memfree)
         *memfree = 0;
 
+    snprintf(key, sizeof(key), "%d", node);
+
+    virMutexLock(&virNumaNodeMemLock);
+
+    /* The cache is best effort only; if we can't get a usable timestamp
+     * or allocate the hash, just query libnuma directly */
+    if (virTimeMillisNowRaw(&now) < 0)
+        now = 0;
+
+    if (now && !virNumaNodeMemCache)
+        virNumaNodeMemCache = virHashCreate(16, virHashValueFree);
+
+    if (now && virNumaNodeMemCache)
+        entry = virHashLookup(virNumaNodeMemCache, key);
+
+    if (entry && now - entry->fetched <= NUMA_NODE_MEM_TTL_MS) {
+        if (memsize)
+            *memsize = entry->memsize;
+        if (memfree)
+            *memfree = entry->memfree;
+        ret = 0;
+        goto cleanup;
+    }
+
     if ((node_size = numa_node_size64(node, &node_free)) < 0)
-        return -1;
+        goto cleanup;
+
+    if (now && virNumaNodeMemCache) {
+        virNumaNodeMemEntryPtr fresh;
+
+        if (VIR_ALLOC_QUIET(fresh) == 0) {
+            fresh->fetched = now;
+            fresh->memsize = node_size;
+            fresh->memfree = node_free;
+            if (virHashUpdateEntry(virNumaNodeMemCache, key, fresh) < 0)
+                VIR_FREE(fresh);
+        }
+    }
 
     if (memsize)
         *memsize = node_size;
@@ -230,7 +291,11 @@ virNumaGetNodeMemory(int node,
     if (memfree)
         *memfree = node_free;
 
-    return 0;
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virNumaNodeMemLock);
+    return ret;
 }
 
 
@@ -685,33 +750,56 @@ virNumaGetPageInfo(int node,
 }
 
 
-/**
- * virNumaGetPages:
- * @node: NUMA node id
- * @pages_size: list of pages supported on @node
- * @pages_avail: list of the pool sizes on @node
- * @pages_free: list of free pages on @node
- * @npages: the lists size
- *
- * For given NUMA node fetch info on pages. The size of pages
- * (e.g.  4K, 2M, 1G) is stored into @pages_size, the size of the
- * pool is then stored into @pages_avail and the number of free
- * pages in the pool is stored into @pages_free.
- *
- * If you're interested only in some lists, pass NULL to the
- * other ones.
- *
- * As a special case, if @node == -1, overall info is fetched
- * from the system.
- *
- * Returns 0 on success, -1 otherwise.
- */
-int
-virNumaGetPages(int node,
-                unsigned int **pages_size,
-                unsigned int **pages_avail,
-                unsigned int **pages_free,
-                size_t *npages)
+/* How long a cached per-node page pool snapshot stays valid.  Page
+ * pools change rarely (pool resizes and guest startups), while
+ * placement logic tends to query every node before each decision. */
+# define NUMA_PAGES_TTL_MS 1000
+
+typedef struct _virNumaPagesEntry virNumaPagesEntry;
+typedef virNumaPagesEntry *virNumaPagesEntryPtr;
+struct _virNumaPagesEntry {
+    unsigned long long fetched; /* ms timestamp of the sysfs walk */
+    unsigned int *size;
+    unsigned int *avail;
+    unsigned int *free;
+    size_t npages;
+};
+
+static virMutex virNumaPagesLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virNumaPagesCache;
+
+static void
+virNumaPagesEntryFree(void *payload, const void *name ATTRIBUTE_UNUSED)
+{
+    virNumaPagesEntryPtr entry = payload;
+
+    if (!entry)
+        return;
+
+    VIR_FREE(entry->size);
+    VIR_FREE(entry->avail);
+    VIR_FREE(entry->free);
+    VIR_FREE(entry);
+}
+
+/* Drop all cached page pool snapshots.  Called whenever this process
+ * resizes a pool itself; changes made behind our back are caught by
+ * the TTL. */
+static void
+virNumaPagesInvalidate(void)
+{
+    virMutexLock(&virNumaPagesLock);
+    virHashFree(virNumaPagesCache);
+    virNumaPagesCache = NULL;
+    virMutexUnlock(&virNumaPagesLock);
+}
+
+static int
+virNumaGetPagesFresh(int node,
+                     unsigned int **pages_size,
+                     unsigned int **pages_avail,
+                     unsigned int **pages_free,
+                     size_t *npages)
 {
     int ret = -1;
     char *path = NULL;
@@ -833,6 +921,111 @@ virNumaGetPages(int node,
 }
 
 
+/**
+ * virNumaGetPages:
+ * @node: NUMA node id
+ * @pages_size: list of pages supported on @node
+ * @pages_avail: list of the pool sizes on @node
+ * @pages_free: list of free pages on @node
+ * @npages: the lists size
+ *
+ * For given NUMA node fetch info on pages. The size of pages
+ * (e.g.  4K, 2M, 1G) is stored into @pages_size, the size of the
+ * pool is then stored into @pages_avail and the number of free
+ * pages in the pool is stored into @pages_free.
+ *
+ * The returned lists come from a short lived per-node cache, so
+ * callers polling every node before each placement decision share
+ * one sysfs walk instead of each triggering their own.
+ *
+ * If you're interested only in some lists, pass NULL to the
+ * other ones.
+ *
+ * As a special case, if @node == -1, overall info is fetched
+ * from the system.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+virNumaGetPages(int node,
+                unsigned int **pages_size,
+                unsigned int **pages_avail,
+                unsigned int **pages_free,
+                size_t *npages)
+{
+    virNumaPagesEntryPtr entry;
+    unsigned int *tmp_size = NULL, *tmp_avail = NULL, *tmp_free = NULL;
+    unsigned long long now;
+    char key[32];
+    int ret = -1;
+
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    snprintf(key, sizeof(key), "%d", node);
+
+    virMutexLock(&virNumaPagesLock);
+
+    if (!virNumaPagesCache &&
+        !(virNumaPagesCache = virHashCreate(16, virNumaPagesEntryFree)))
+        goto cleanup;
+
+    entry = virHashLookup(virNumaPagesCache, key);
+    if (!entry || now - entry->fetched > NUMA_PAGES_TTL_MS) {
+        virNumaPagesEntryPtr fresh;
+
+        if (VIR_ALLOC(fresh) < 0)
+            goto cleanup;
+
+        if (virNumaGetPagesFresh(node, &fresh->size, &fresh->avail,
+                                 &fresh->free, &fresh->npages) < 0 ||
+            virHashUpdateEntry(virNumaPagesCache, key, fresh) < 0) {
+            virNumaPagesEntryFree(fresh, NULL);
+            goto cleanup;
+        }
+
+        fresh->fetched = now;
+        entry = fresh;
+    }
+
+    if ((pages_size &&
+         VIR_ALLOC_N(tmp_size, entry->npages) < 0) ||
+        (pages_avail &&
+         VIR_ALLOC_N(tmp_avail, entry->npages) < 0) ||
+        (pages_free &&
+         VIR_ALLOC_N(tmp_free, entry->npages) < 0))
+        goto cleanup;
+
+    if (tmp_size)
+        memcpy(tmp_size, entry->size, entry->npages * sizeof(*tmp_size));
+    if (tmp_avail)
+        memcpy(tmp_avail, entry->avail, entry->npages * sizeof(*tmp_avail));
+    if (tmp_free)
+        memcpy(tmp_free, entry->free, entry->npages * sizeof(*tmp_free));
+
+    if (pages_size) {
+        *pages_size = tmp_size;
+        tmp_size = NULL;
+    }
+    if (pages_avail) {
+        *pages_avail = tmp_avail;
+        tmp_avail = NULL;
+    }
+    if (pages_free) {
+        *pages_free = tmp_free;
+        tmp_free = NULL;
+    }
+    *npages = entry->npages;
+    ret = 0;
+ cleanup:
+    VIR_FREE(tmp_free);
+    VIR_FREE(tmp_avail);
+    VIR_FREE(tmp_size);
+    virMutexUnlock(&virNumaPagesLock);
+    return ret;
+}
+
+
 int
 virNumaSetPagePoolSize(int node,
                        unsigned int page_size,
@@ -921,6 +1114,8 @@ virNumaSetPagePoolSize(int node,
         goto cleanup;
     }
 
+    virNumaPagesInvalidate();
+
     ret = 0;
  cleanup:
     VIR_FREE(nr_buf);
@@ -39,6 +39,13 @@ struct _virPortAllocator {
     virObjectLockable parent;
     virBitmapPtr bitmap;
 
+    /* Ports we found bound by some other process. Remembering them
+     * means subsequent acquisitions skip straight past a fragmented
+     * stretch of the range instead of re-probing it with bind();
+     * the cache is dropped and rebuilt if the range looks exhausted,
+     * so ports do come back once their foreign owner exits. */
+    virBitmapPtr foreign;
+
     char *name;
 
     unsigned short start;
@@ -55,6 +62,7 @@ virPortAllocatorDispose(void *obj)
     virPortAllocatorPtr pa = obj;
 
     virBitmapFree(pa->bitmap);
+    virBitmapFree(pa->foreign);
     VIR_FREE(pa->name);
 }
 
@@ -95,6 +103,7 @@ virPortAllocatorPtr virPortAllocatorNew(const char *name,
     pa->end = end;
 
     if (!(pa->bitmap = virBitmapNew((end-start)+1)) ||
+        !(pa->foreign = virBitmapNew((end-start)+1)) ||
         VIR_STRDUP(pa->name, name) < 0) {
         virObjectUnref(pa);
         return NULL;
@@ -172,48 +181,159 @@ static int virPortAllocatorBindToPort(bool *used,
     return ret;
 }
 
+/* Reserve the lowest port that is neither handed out already nor
+ * cached as bound by another process. Returns 0 with *port filled
+ * in, or 1 if every candidate in the range is taken. Caller must
+ * hold the allocator lock. */
+static int
+virPortAllocatorClaimNextLocked(virPortAllocatorPtr pa,
+                                unsigned short *port)
+{
+    ssize_t pos = -1;
+
+    while ((pos = virBitmapNextClearBit(pa->bitmap, pos)) >= 0) {
+        if (virBitmapIsBitSet(pa->foreign, pos))
+            continue;
+
+        ignore_value(virBitmapSetBit(pa->bitmap, pos));
+        *port = pa->start + pos;
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Ask the kernel whether anything else currently listens on @port.
+ * Runs without the allocator lock held. */
+static int
+virPortAllocatorProbePort(unsigned short port,
+                          bool *used)
+{
+    bool v6used = false;
+
+    *used = false;
+
+    if (virPortAllocatorBindToPort(&v6used, port, AF_INET6) < 0 ||
+        virPortAllocatorBindToPort(used, port, AF_INET) < 0)
+        return -1;
+
+    if (v6used)
+        *used = true;
+
+    return 0;
+}
+
+/* Give a claimed port back and remember that some other process has
+ * it bound, so the next acquisition doesn't probe it again. */
+static void
+virPortAllocatorMarkForeign(virPortAllocatorPtr pa,
+                            unsigned short port)
+{
+    virObjectLock(pa);
+    ignore_value(virBitmapClearBit(pa->bitmap, port - pa->start));
+    ignore_value(virBitmapSetBit(pa->foreign, port - pa->start));
+    virObjectUnlock(pa);
+}
+
 int virPortAllocatorAcquire(virPortAllocatorPtr pa,
                             unsigned short *port)
 {
-    int ret = -1;
-    size_t i;
+    bool retried = false;
 
     *port = 0;
-    virObjectLock(pa);
 
-    for (i = pa->start; i <= pa->end && !*port; i++) {
-        bool used = false, v6used = false;
+    for (;;) {
+        bool used = false;
+        int rc;
+
+        /* Claim a candidate first and verify afterwards, so that the
+         * bind() probes run outside the lock and parallel acquisitions
+         * don't serialize behind each other's syscalls. */
+        virObjectLock(pa);
+        rc = virPortAllocatorClaimNextLocked(pa, port);
+        if (rc > 0 && !retried) {
+            /* every remaining candidate is cached as busy; whoever
+             * owned them may be gone by now, so forget the cache and
+             * let the probes below take a fresh look */
+            virBitmapClearAll(pa->foreign);
+            rc = virPortAllocatorClaimNextLocked(pa, port);
+            retried = true;
+        }
+        virObjectUnlock(pa);
 
-        if (virBitmapIsBitSet(pa->bitmap, i - pa->start))
-            continue;
+        if (rc > 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unable to find an unused port in range '%s' (%d-%d)"),
+                           pa->name, pa->start, pa->end);
+            return -1;
+        }
 
-        if (!(pa->flags & VIR_PORT_ALLOCATOR_SKIP_BIND_CHECK)) {
-            if (virPortAllocatorBindToPort(&v6used, i, AF_INET6) < 0 ||
-                virPortAllocatorBindToPort(&used, i, AF_INET) < 0)
-                goto cleanup;
+        if (pa->flags & VIR_PORT_ALLOCATOR_SKIP_BIND_CHECK)
+            return 0;
+
+        if (virPortAllocatorProbePort(*port, &used) < 0) {
+            virPortAllocatorRelease(pa, *port);
+            *port = 0;
+            return -1;
         }
 
-        if (!used && !v6used) {
-            /* Add port to bitmap of reserved ports */
-            if (virBitmapSetBit(pa->bitmap,
-                                i - pa->start) < 0) {
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Failed to reserve port %zu"), i);
-                goto cleanup;
+        if (!used)
+            return 0;
+
+        virPortAllocatorMarkForeign(pa, *port);
+        *port = 0;
+    }
+}
+
+int virPortAllocatorAcquireGroup(virPortAllocatorPtr pa,
+                                 unsigned short *ports,
+                                 size_t nports)
+{
+    size_t i;
+    size_t claimed;
+
+    for (i = 0; i < nports; i++)
+        ports[i] = 0;
+
+    /* claim candidates for the whole group in a single pass over
+     * the bitmap rather than taking the lock once per port */
+    virObjectLock(pa);
+    for (claimed = 0; claimed < nports; claimed++) {
+        if (virPortAllocatorClaimNextLocked(pa, &ports[claimed]) != 0)
+            break;
+    }
+    virObjectUnlock(pa);
+
+    /* ports the quick pass could not satisfy, or that turn out to be
+     * bound by somebody else, fall back to the one-at-a-time path */
+    for (i = 0; i < nports; i++) {
+        bool used = false;
+
+        if (ports[i] != 0 &&
+            !(pa->flags & VIR_PORT_ALLOCATOR_SKIP_BIND_CHECK)) {
+            if (virPortAllocatorProbePort(ports[i], &used) < 0)
+                goto error;
+
+            if (used) {
+                virPortAllocatorMarkForeign(pa, ports[i]);
+                ports[i] = 0;
             }
-            *port = i;
-            ret = 0;
         }
+
+        if (ports[i] == 0 &&
+            virPortAllocatorAcquire(pa, &ports[i]) < 0)
+            goto error;
     }
 
-    if (*port == 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Unable to find an unused port in range '%s' (%d-%d)"),
-                       pa->name, pa->start, pa->end);
+    return 0;
+
+ error:
+    for (i = 0; i < nports; i++) {
+        if (ports[i])
+            virPortAllocatorRelease(pa, ports[i]);
+        ports[i] = 0;
     }
- cleanup:
-    virObjectUnlock(pa);
-    return ret;
+    return -1;
 }
 
 int virPortAllocatorRelease(virPortAllocatorPtr pa,
@@ -241,6 +361,10 @@ int virPortAllocatorRelease(virPortAllocatorPtr pa,
         goto cleanup;
     }
 
+    /* our own user of the port just went away, so there is no point
+     * keeping any record of it having been busy */
+    ignore_value(virBitmapClearBit(pa->foreign, port - pa->start));
+
     ret = 0;
  cleanup:
     virObjectUnlock(pa);
@@ -276,6 +400,7 @@ int virPortAllocatorSetUsed(virPortAllocatorPtr pa,
                            port);
             goto cleanup;
         }
+        ignore_value(virBitmapClearBit(pa->foreign, port - pa->start));
     }
 
     ret = 0;
@@ -40,6 +40,10 @@ virPortAllocatorPtr virPortAllocatorNew(const char *name,
 int virPortAllocatorAcquire(virPortAllocatorPtr pa,
                             unsigned short *port);
 
+int virPortAllocatorAcquireGroup(virPortAllocatorPtr pa,
+                                 unsigned short *ports,
+                                 size_t nports);
+
 int virPortAllocatorRelease(virPortAllocatorPtr pa,
                             unsigned short port);
 
@@ -641,6 +641,182 @@ int virProcessGetPids(pid_t pid, size_t *npids, pid_t **pids)
 }
 
 
+static int
+virProcessParseStat(const char *buf,
+                    unsigned long long *cpuTime,
+                    int *lastCpu,
+                    long *vm_rss)
+{
+    unsigned long long usertime = 0, systime = 0;
+    long rss = 0;
+    int cpu = 0;
+
+    /* See 'man proc' for information about what all these fields are. We're
+     * only interested in a very few of them */
+    if (sscanf(buf,
+               /* pid -> stime */
+               "%*d (%*[^)]) %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu"
+               /* cutime -> endcode */
+               "%*d %*d %*d %*d %*d %*d %*u %*u %ld %*u %*u %*u"
+               /* startstack -> processor */
+               "%*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*d %d",
+               &usertime, &systime, &rss, &cpu) != 4)
+        return -1;
+
+    /* We got jiffies
+     * We want nanoseconds
+     * _SC_CLK_TCK is jiffies per second
+     * So calculate thus....
+     */
+    if (cpuTime)
+        *cpuTime = 1000ull * 1000ull * 1000ull * (usertime + systime)
+            / (unsigned long long)sysconf(_SC_CLK_TCK);
+    if (lastCpu)
+        *lastCpu = cpu;
+    if (vm_rss)
+        *vm_rss = rss * virGetSystemPageSizeKB();
+
+    return 0;
+}
+
+/**
+ * virProcessGetStatInfo:
+ * @cpuTime: process CPU time in nanoseconds (may be NULL)
+ * @lastCpu: CPU the process last ran on (may be NULL)
+ * @vm_rss: resident set size in kibibytes (may be NULL)
+ * @pid: process to inspect
+ * @tid: thread of @pid to inspect instead, or 0 for the whole process
+ *
+ * Reads the relevant fields of /proc/<pid>/stat (or the stat file of
+ * @tid under its task directory). A process that cannot be parsed is
+ * logged and reported as idle rather than treated as an error.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+virProcessGetStatInfo(unsigned long long *cpuTime,
+                      int *lastCpu,
+                      long *vm_rss,
+                      pid_t pid,
+                      pid_t tid)
+{
+    char *proc = NULL;
+    char buf[1024];
+    int ret;
+
+    /* In general, we cannot assume pid_t fits in int; but /proc parsing
+     * is specific to Linux where int works fine.  */
+    if (tid)
+        ret = virAsprintf(&proc, "/proc/%d/task/%d/stat", (int)pid, (int)tid);
+    else
+        ret = virAsprintf(&proc, "/proc/%d/stat", (int)pid);
+    if (ret < 0)
+        return -1;
+
+    ret = virFileReadBufQuiet(proc, buf, sizeof(buf));
+    VIR_FREE(proc);
+
+    if (ret < 0 ||
+        virProcessParseStat(buf, cpuTime, lastCpu, vm_rss) < 0) {
+        VIR_WARN("cannot parse process status data");
+        if (cpuTime)
+            *cpuTime = 0;
+        if (lastCpu)
+            *lastCpu = 0;
+        if (vm_rss)
+            *vm_rss = 0;
+    }
+
+    VIR_DEBUG("Got status for %d/%d cpuTime=%llu lastCpu=%d",
+              (int)pid, (int)tid,
+              cpuTime ? *cpuTime : 0, lastCpu ? *lastCpu : 0);
+
+    return 0;
+}
+
+/**
+ * virProcessGetTaskStats:
+ * @pid: process whose tasks to inspect
+ * @stats: filled with an array of per-task stat records
+ * @nstats: filled with the number of records in @stats
+ *
+ * Collects the stat data of every task of @pid in a single pass over
+ * its /proc task directory, so that callers inspecting many threads
+ * (e.g. one per vCPU) don't need to re-open a stat file per thread.
+ * Tasks that exit during the scan are silently skipped. The caller is
+ * responsible for freeing @stats.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+virProcessGetTaskStats(pid_t pid,
+                       virProcessTaskStatPtr *stats,
+                       size_t *nstats)
+{
+    char *taskPath = NULL;
+    char *statPath = NULL;
+    char buf[1024];
+    DIR *dir = NULL;
+    int value;
+    struct dirent *ent;
+    int ret = -1;
+
+    *stats = NULL;
+    *nstats = 0;
+
+    if (virAsprintf(&taskPath, "/proc/%llu/task",
+                    (unsigned long long)pid) < 0)
+        goto cleanup;
+
+    if (virDirOpen(&dir, taskPath) < 0)
+        goto cleanup;
+
+    while ((value = virDirRead(dir, &ent, taskPath)) > 0) {
+        virProcessTaskStat taskstat = { 0 };
+        long long tmp;
+
+        if (virStrToLong_ll(ent->d_name, NULL, 10, &tmp) < 0)
+            goto cleanup;
+        taskstat.tid = tmp;
+
+        if (virAsprintf(&statPath, "%s/%s/stat", taskPath, ent->d_name) < 0)
+            goto cleanup;
+
+        /* The task may have exited between the directory scan and
+         * this read; just skip it */
+        if (virFileReadBufQuiet(statPath, buf, sizeof(buf)) < 0) {
+            VIR_FREE(statPath);
+            continue;
+        }
+        VIR_FREE(statPath);
+
+        if (virProcessParseStat(buf, &taskstat.cpuTime,
+                                &taskstat.lastCpu, NULL) < 0) {
+            VIR_WARN("cannot parse process status data for task %lld", tmp);
+            continue;
+        }
+
+        if (VIR_APPEND_ELEMENT(*stats, *nstats, taskstat) < 0)
+            goto cleanup;
+    }
+
+    if (value < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_DIR_CLOSE(dir);
+    VIR_FREE(taskPath);
+    VIR_FREE(statPath);
+    if (ret < 0) {
+        VIR_FREE(*stats);
+        *nstats = 0;
+    }
+    return ret;
+}
+
+
 int virProcessGetNamespaces(pid_t pid,
                             size_t *nfdlist,
                             int **fdlist)
@@ -964,9 +1140,12 @@ int virProcessGetStartTime(pid_t pid,
     char *filename = NULL;
     char *buf = NULL;
     char *tmp;
+    const char *cur;
+    virStringToken tok;
+    size_t field = 0;
+    bool found = false;
     int ret = -1;
     int len;
-    char **tokens = NULL;
 
     if (virAsprintf(&filename, "/proc/%llu/stat",
                     (unsigned long long)pid) < 0)
@@ -994,29 +1173,33 @@ int virProcessGetStartTime(pid_t pid,
         goto cleanup;
     }
 
-    tokens = virStringSplit(tmp, " ", 0);
+    /* walk the space separated fields in place; copying them all out
+     * just to look at the one we want is wasted work */
+    cur = tmp;
+    while (virStringTokenNext(&cur, ' ', &tok)) {
+        if (field++ < 19)
+            continue;
 
-    if (virStringListLength((const char * const *)tokens) < 20) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Cannot find start time in %s"),
-                       filename);
-        goto cleanup;
+        if (virStringTokenToULLong(&tok, timestamp) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Cannot parse start time %.*s in %s"),
+                           (int)tok.len, tok.start, filename);
+            goto cleanup;
+        }
+        found = true;
+        break;
     }
 
-    if (virStrToLong_ull(tokens[19],
-                         NULL,
-                         10,
-                         timestamp) < 0) {
+    if (!found) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Cannot parse start time %s in %s"),
-                       tokens[19], filename);
+                       _("Cannot find start time in %s"),
+                       filename);
         goto cleanup;
     }
 
     ret = 0;
 
  cleanup:
-    virStringFreeList(tokens);
     VIR_FREE(filename);
     VIR_FREE(buf);
     return ret;
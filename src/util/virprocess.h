@@ -62,6 +62,24 @@ virBitmapPtr virProcessGetAffinity(pid_t pid);
 
 int virProcessGetPids(pid_t pid, size_t *npids, pid_t **pids);
 
+typedef struct _virProcessTaskStat virProcessTaskStat;
+typedef virProcessTaskStat *virProcessTaskStatPtr;
+struct _virProcessTaskStat {
+    pid_t tid;
+    unsigned long long cpuTime; /* CPU time used, in nanoseconds */
+    int lastCpu;                /* CPU the task last ran on */
+};
+
+int virProcessGetStatInfo(unsigned long long *cpuTime,
+                          int *lastCpu,
+                          long *vm_rss,
+                          pid_t pid,
+                          pid_t tid);
+
+int virProcessGetTaskStats(pid_t pid,
+                           virProcessTaskStatPtr *stats,
+                           size_t *nstats);
+
 int virProcessGetStartTime(pid_t pid,
                            unsigned long long *timestamp);
 
@@ -39,6 +39,7 @@
 #include "virstats.h"
 #include "viralloc.h"
 #include "virfile.h"
+#include "virnetlink.h"
 
 #define VIR_FROM_THIS VIR_FROM_STATS_LINUX
 
@@ -56,6 +57,28 @@ virNetInterfaceStats(const char *path,
     int path_len;
     FILE *fp;
     char line[256], *colon;
+    virNetlinkLinkStats nlstats;
+
+    /* An RTM_GETLINK dump fetches the counters of every interface at
+     * once and is cached for a moment, so a stats sweep over many
+     * domains costs a single netlink request instead of re-parsing
+     * all of /proc/net/dev for each interface.
+     */
+    if (virNetlinkGetLinkStats(path, &nlstats) == 0) {
+        /* See the note below on the swapped TX/RX counters. */
+        stats->rx_bytes = nlstats.tx_bytes;
+        stats->rx_packets = nlstats.tx_packets;
+        stats->rx_errs = nlstats.tx_errs;
+        stats->rx_drop = nlstats.tx_drop;
+        stats->tx_bytes = nlstats.rx_bytes;
+        stats->tx_packets = nlstats.rx_packets;
+        stats->tx_errs = nlstats.rx_errs;
+        stats->tx_drop = nlstats.rx_drop;
+        return 0;
+    }
+
+    /* fall back to /proc/net/dev, e.g. when built without libnl */
+    virResetLastError();
 
     fp = fopen("/proc/net/dev", "r");
     if (!fp) {
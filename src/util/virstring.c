@@ -31,7 +31,9 @@
 #include "viralloc.h"
 #include "virbuffer.h"
 #include "virerror.h"
+#include "virhash.h"
 #include "virlog.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -243,6 +245,90 @@ virStringGetFirstWithPrefix(char **strings, const char *prefix)
     return NULL;
 }
 
+
+/**
+ * virStringTokenNext:
+ * @cursor: pointer to the current position within the string being
+ *     tokenized; updated to point past the consumed separator, or set
+ *     to NULL once the string is exhausted
+ * @sep: the character separating tokens
+ * @token: filled in with the start and length of the next token
+ *
+ * Splits a string into tokens without copying or modifying it. Each
+ * call yields the next @sep-delimited field as a (pointer, length)
+ * view into the original buffer; the field is not NUL-terminated, so
+ * callers must honour @token->len. Empty fields are reported, thus
+ * "a,,b" yields three tokens with a zero-length one in the middle,
+ * and the empty string yields a single zero-length token.
+ *
+ * Typical usage:
+ *
+ *     const char *cur = line;
+ *     virStringToken tok;
+ *
+ *     while (virStringTokenNext(&cur, ',', &tok))
+ *         ...inspect tok.start / tok.len...
+ *
+ * Returns true if a token was produced, false once the string is
+ * exhausted.
+ */
+bool
+virStringTokenNext(const char **cursor,
+                   char sep,
+                   virStringTokenPtr token)
+{
+    const char *cur = *cursor;
+    const char *end;
+
+    if (!cur)
+        return false;
+
+    token->start = cur;
+    if ((end = strchr(cur, sep))) {
+        token->len = end - cur;
+        *cursor = end + 1;
+    } else {
+        token->len = strlen(cur);
+        *cursor = NULL;
+    }
+
+    return true;
+}
+
+
+/**
+ * virStringTokenToULLong:
+ * @token: a token produced by virStringTokenNext()
+ * @result: location to store the parsed value
+ *
+ * Parses @token as a base-10 unsigned long long without copying it
+ * out of the underlying buffer. The whole token must form a valid
+ * number; empty tokens and trailing garbage are rejected.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+virStringTokenToULLong(const virStringToken *token,
+                       unsigned long long *result)
+{
+    unsigned long long val;
+    char *end;
+
+    if (!token->len)
+        return -1;
+
+    /* strtoull stops at the separator (or NUL) terminating the token,
+     * so parsing in place is safe; only over-short parses and leading
+     * junk need to be caught */
+    if (virStrToLong_ull(token->start, &end, 10, &val) < 0 ||
+        end != token->start + token->len)
+        return -1;
+
+    *result = val;
+    return 0;
+}
+
+
 /* Like strtol, but produce an "int" result, and check more carefully.
    Return 0 upon success;  return -1 to indicate failure.
    When END_PTR is NULL, the byte after the final valid digit must be NUL.
@@ -1110,3 +1196,124 @@ virStringEncodeBase64(const uint8_t *buf, size_t buflen)
 
     return ret;
 }
+
+
+/* Global table of interned strings; each entry owns one shared copy
+ * of the string together with a reference count */
+struct virStringInternEntry {
+    char *str;
+    size_t refs;
+};
+
+static virMutex virStringInternTableLock;
+static virHashTablePtr virStringInternTable;
+
+static void
+virStringInternEntryFree(void *payload,
+                         const void *name ATTRIBUTE_UNUSED)
+{
+    struct virStringInternEntry *entry = payload;
+
+    VIR_FREE(entry->str);
+    VIR_FREE(entry);
+}
+
+static int
+virStringInternTableOnceInit(void)
+{
+    if (virMutexInit(&virStringInternTableLock) < 0)
+        return -1;
+
+    if (!(virStringInternTable = virHashCreate(256,
+                                               virStringInternEntryFree)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virStringInternTable)
+
+/**
+ * virStringIntern:
+ * @str: string to intern
+ *
+ * Returns a shared copy of @str from a global reference counted
+ * table, deduplicating strings that occur many times (device aliases,
+ * machine type names and the like). The copy stays valid until the
+ * matching virStringInternRelease() and must not be freed any other
+ * way.
+ *
+ * Returns the shared copy, or NULL on allocation failure (with the
+ * error reported) or if @str is NULL.
+ */
+char *
+virStringIntern(const char *str)
+{
+    struct virStringInternEntry *entry;
+    char *ret = NULL;
+
+    if (!str)
+        return NULL;
+
+    if (virStringInternTableInitialize() < 0)
+        return NULL;
+
+    virMutexLock(&virStringInternTableLock);
+
+    if ((entry = virHashLookup(virStringInternTable, str))) {
+        entry->refs++;
+        ret = entry->str;
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC(entry) < 0)
+        goto cleanup;
+
+    if (VIR_STRDUP(entry->str, str) < 0 ||
+        virHashAddEntry(virStringInternTable, str, entry) < 0) {
+        VIR_FREE(entry->str);
+        VIR_FREE(entry);
+        goto cleanup;
+    }
+
+    entry->refs = 1;
+    ret = entry->str;
+
+ cleanup:
+    virMutexUnlock(&virStringInternTableLock);
+    return ret;
+}
+
+/**
+ * virStringInternRelease:
+ * @str: string previously returned by virStringIntern()
+ *
+ * Drops one reference on an interned string, freeing the shared copy
+ * once the last reference is gone. As a convenience a plain
+ * heap-allocated string is simply freed, so structures mixing
+ * interned and strdup'd members can release both the same way.
+ */
+void
+virStringInternRelease(char *str)
+{
+    struct virStringInternEntry *entry;
+
+    if (!str)
+        return;
+
+    if (virStringInternTableInitialize() < 0)
+        return;
+
+    virMutexLock(&virStringInternTableLock);
+
+    entry = virHashLookup(virStringInternTable, str);
+    if (entry && entry->str == str) {
+        if (--entry->refs == 0)
+            virHashRemoveEntry(virStringInternTable, str);
+    } else {
+        /* not one of ours; a regular copy from a fallback path */
+        VIR_FREE(str);
+    }
+
+    virMutexUnlock(&virStringInternTableLock);
+}
@@ -48,6 +48,22 @@ bool virStringArrayHasString(const char **strings, const char *needle);
 char *virStringGetFirstWithPrefix(char **strings, const char *prefix)
     ATTRIBUTE_NONNULL(2);
 
+typedef struct _virStringToken virStringToken;
+typedef virStringToken *virStringTokenPtr;
+struct _virStringToken {
+    const char *start;  /* first byte of the field within the original string */
+    size_t len;         /* length of the field; it is not NUL-terminated */
+};
+
+bool virStringTokenNext(const char **cursor,
+                        char sep,
+                        virStringTokenPtr token)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(3);
+
+int virStringTokenToULLong(const virStringToken *token,
+                           unsigned long long *result)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
+
 char *virArgvToString(const char *const *argv);
 
 int virStrToLong_i(char const *s,
@@ -280,4 +296,7 @@ bool virStringBufferIsPrintable(const uint8_t *buf, size_t buflen);
 
 char *virStringEncodeBase64(const uint8_t *buf, size_t buflen);
 
+char *virStringIntern(const char *str);
+void virStringInternRelease(char *str);
+
 #endif /* __VIR_STRING_H__ */
@@ -153,6 +153,47 @@ virSystemdAppendValidMachineName(virBufferPtr buf,
 
 #undef HOSTNAME_CHARS
 
+/* -2 = machine1 is not supported on this machine
+ * -1 = error
+ *  0 = machine1 is available
+ */
+static int virSystemdHasMachinedCachedValue = -1;
+
+/* Reset the cache to unknown, e.g. from the test suite */
+void virSystemdHasMachinedResetCachedValue(void)
+{
+    virSystemdHasMachinedCachedValue = -1;
+}
+
+/*
+ * Whether machined is available never changes while the daemon runs,
+ * so probe it once and remember the answer; the probes are two extra
+ * synchronous bus round trips that would otherwise be paid on every
+ * machine registration.
+ */
+static int
+virSystemdHasMachined(void)
+{
+    int ret;
+    int val;
+
+    val = virAtomicIntGet(&virSystemdHasMachinedCachedValue);
+    if (val != -1)
+        return val;
+
+    if ((ret = virDBusIsServiceEnabled("org.freedesktop.machine1")) < 0) {
+        if (ret == -2)
+            virAtomicIntSet(&virSystemdHasMachinedCachedValue, -2);
+        return ret;
+    }
+
+    if ((ret = virDBusIsServiceRegistered("org.freedesktop.systemd1")) == -1)
+        return ret;
+
+    virAtomicIntSet(&virSystemdHasMachinedCachedValue, ret);
+    return ret;
+}
+
 char *
 virSystemdMakeMachineName(const char *drivername,
                           int id,
@@ -190,10 +231,7 @@ virSystemdGetMachineNameByPID(pid_t pid)
     DBusMessage *reply = NULL;
     char *name = NULL, *object = NULL;
 
-    if (virDBusIsServiceEnabled("org.freedesktop.machine1") < 0)
-        goto cleanup;
-
-    if (virDBusIsServiceRegistered("org.freedesktop.systemd1") < 0)
+    if (virSystemdHasMachined() < 0)
         goto cleanup;
 
     if (!(conn = virDBusGetSystemBus()))
@@ -268,11 +306,7 @@ int virSystemdCreateMachine(const char *name,
     char *slicename = NULL;
     static int hasCreateWithNetwork = 1;
 
-    ret = virDBusIsServiceEnabled("org.freedesktop.machine1");
-    if (ret < 0)
-        return ret;
-
-    if ((ret = virDBusIsServiceRegistered("org.freedesktop.systemd1")) < 0)
+    if ((ret = virSystemdHasMachined()) < 0)
         return ret;
 
     if (!(conn = virDBusGetSystemBus()))
@@ -434,11 +468,7 @@ int virSystemdTerminateMachine(const char *name)
 
     memset(&error, 0, sizeof(error));
 
-    ret = virDBusIsServiceEnabled("org.freedesktop.machine1");
-    if (ret < 0)
-        goto cleanup;
-
-    if ((ret = virDBusIsServiceRegistered("org.freedesktop.systemd1")) < 0)
+    if ((ret = virSystemdHasMachined()) < 0)
         goto cleanup;
 
     ret = -1;
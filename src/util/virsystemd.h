@@ -56,4 +56,6 @@ int virSystemdCanHybridSleep(bool *result);
 
 char *virSystemdGetMachineNameByPID(pid_t pid);
 
+void virSystemdHasMachinedResetCachedValue(void);
+
 #endif /* __VIR_SYSTEMD_H__ */
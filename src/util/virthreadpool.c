@@ -28,19 +28,37 @@
 
 #include "virthreadpool.h"
 #include "viralloc.h"
+#include "viratomic.h"
+#include "virprocess.h"
 #include "virthread.h"
+#include "virtime.h"
+#include "virutil.h"
 #include "virerror.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+/* Number of independent queues non-priority jobs are spread over.
+ * Each worker is pinned to one home queue and steals from the others
+ * when its own queue runs dry, so an enqueue normally contends only
+ * with the workers of a single queue instead of the whole pool.
+ */
+#define VIR_THREAD_POOL_NQUEUES 4
+
+/* Queue wait (EWMA, in ms) above which the pool spawns an extra
+ * worker even though some workers claim to be idle */
+#define VIR_THREAD_POOL_WAIT_HIGH_MS 10
+
+/* How long a worker beyond minWorkers sits idle before it exits */
+#define VIR_THREAD_POOL_IDLE_TIMEOUT_MS 5000
+
 typedef struct _virThreadPoolJob virThreadPoolJob;
 typedef virThreadPoolJob *virThreadPoolJobPtr;
 
 struct _virThreadPoolJob {
     virThreadPoolJobPtr prev;
     virThreadPoolJobPtr next;
-    unsigned int priority;
 
+    unsigned long long enqueued; /* ms timestamp, 0 if unknown */
     void *data;
 };
 
@@ -50,38 +68,65 @@ typedef virThreadPoolJobList *virThreadPoolJobListPtr;
 struct _virThreadPoolJobList {
     virThreadPoolJobPtr head;
     virThreadPoolJobPtr tail;
-    virThreadPoolJobPtr firstPrio;
+};
+
+typedef struct _virThreadPoolQueue virThreadPoolQueue;
+typedef virThreadPoolQueue *virThreadPoolQueuePtr;
+
+struct _virThreadPoolQueue {
+    virMutex lock;
+    virCond cond;
+    virThreadPoolJobList jobs;
+    int nWaiters; /* atomic */
 };
 
 
 struct _virThreadPool {
-    bool quit;
+    int quit; /* atomic */
 
     virThreadPoolJobFunc jobFunc;
     const char *jobFuncName;
     void *jobOpaque;
-    virThreadPoolJobList jobList;
-    size_t jobQueueDepth;
 
+    /* Sharded queues holding the non-priority jobs */
+    virThreadPoolQueue queues[VIR_THREAD_POOL_NQUEUES];
+    int nextQueue; /* atomic, round-robin enqueue counter */
+    int jobQueueDepth; /* atomic, jobs across all queues incl. priority */
+    int jobQueueWait; /* atomic, EWMA of recent queue wait in ms */
+
+    /* Priority jobs stay on a single list under @mutex */
+    virThreadPoolJobList prioList;
+
+    /* @mutex protects worker lifecycle state below; it is never held
+     * together with a queue lock */
     virMutex mutex;
-    virCond cond;
     virCond quit_cond;
 
     size_t maxWorkers;
     size_t minWorkers;
-    size_t freeWorkers;
     size_t nWorkers;
+    size_t workerSerial;
     virThreadPtr workers;
+    int maxWorkersLive; /* atomic mirror of maxWorkers */
+    int nWorkersLive; /* atomic mirror of nWorkers */
 
     size_t maxPrioWorkers;
     size_t nPrioWorkers;
     virThreadPtr prioWorkers;
     virCond prioCond;
+
+    /* Optional CPU mask the workers pin themselves to; protected by
+     * @mutex.  Workers detect changes through the atomic generation
+     * counter and re-apply the mask from their own loop, so a new
+     * policy converges shortly after virThreadPoolSetAffinity rather
+     * than instantly */
+    virBitmapPtr affinity;
+    int affinityGen; /* atomic */
 };
 
 struct virThreadPoolWorkerData {
     virThreadPoolPtr pool;
-    virCondPtr cond;
+    size_t qidx;
     bool priority;
 };
 
@@ -93,15 +138,227 @@ static inline bool virThreadPoolWorkerQuitHelper(size_t count, size_t limit)
     return count > limit;
 }
 
+static void
+virThreadPoolJobListPush(virThreadPoolJobListPtr list,
+                         virThreadPoolJobPtr job)
+{
+    job->prev = list->tail;
+    job->next = NULL;
+    if (list->tail)
+        list->tail->next = job;
+    list->tail = job;
+    if (!list->head)
+        list->head = job;
+}
+
+static virThreadPoolJobPtr
+virThreadPoolJobListPop(virThreadPoolJobListPtr list)
+{
+    virThreadPoolJobPtr job = list->head;
+
+    if (!job)
+        return NULL;
+
+    list->head = job->next;
+    if (list->head)
+        list->head->prev = NULL;
+    else
+        list->tail = NULL;
+    return job;
+}
+
+/* Fold the queueing delay of a just dequeued job into the pool's
+ * wait estimate. The unguarded read-modify-write can lose an update
+ * under contention, but the value is only a sizing hint.
+ */
+static void
+virThreadPoolUpdateJobQueueWait(virThreadPoolPtr pool,
+                                virThreadPoolJobPtr job)
+{
+    unsigned long long now;
+    int wait = 0;
+
+    if (!job->enqueued ||
+        virTimeMillisNowRaw(&now) < 0)
+        return;
+
+    if (now > job->enqueued)
+        wait = MIN(now - job->enqueued, INT_MAX / 4);
+
+    virAtomicIntSet(&pool->jobQueueWait,
+                    (virAtomicIntGet(&pool->jobQueueWait) * 3 + wait) / 4);
+}
+
+/* Wake one idle worker, starting the scan at queue @first.  Must be
+ * called without any pool lock held.
+ */
+static void
+virThreadPoolWakeWorker(virThreadPoolPtr pool, size_t first)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_THREAD_POOL_NQUEUES; i++) {
+        virThreadPoolQueuePtr queue =
+            &pool->queues[(first + i) % VIR_THREAD_POOL_NQUEUES];
+
+        if (virAtomicIntGet(&queue->nWaiters) == 0)
+            continue;
+
+        virMutexLock(&queue->lock);
+        virCondSignal(&queue->cond);
+        virMutexUnlock(&queue->lock);
+        return;
+    }
+}
+
+/* Pin the calling worker to the pool's affinity mask if the policy
+ * changed since the worker last looked.  Pinning is best effort; a
+ * worker that cannot be moved keeps its old placement.
+ */
+static void
+virThreadPoolWorkerApplyAffinity(virThreadPoolPtr pool, int *seenGen)
+{
+    virBitmapPtr map = NULL;
+    int gen = virAtomicIntGet(&pool->affinityGen);
+
+    if (gen == *seenGen)
+        return;
+
+    *seenGen = gen;
+
+    virMutexLock(&pool->mutex);
+    if (pool->affinity)
+        map = virBitmapNewCopy(pool->affinity);
+    virMutexUnlock(&pool->mutex);
+
+    if (!map)
+        return;
+
+    if (virProcessSetAffinity(virThreadSelfID(), map) < 0)
+        virResetLastError();
+    virBitmapFree(map);
+}
+
 static void virThreadPoolWorker(void *opaque)
 {
     struct virThreadPoolWorkerData *data = opaque;
     virThreadPoolPtr pool = data->pool;
-    virCondPtr cond = data->cond;
-    bool priority = data->priority;
-    size_t *curWorkers = priority ? &pool->nPrioWorkers : &pool->nWorkers;
-    size_t *maxLimit = priority ? &pool->maxPrioWorkers : &pool->maxWorkers;
+    virThreadPoolQueuePtr queue = &pool->queues[data->qidx];
+    size_t qidx = data->qidx;
     virThreadPoolJobPtr job = NULL;
+    unsigned long long deadline;
+    int affinitySeen = 0;
+    size_t i;
+
+    VIR_FREE(data);
+
+    while (1) {
+        if (virAtomicIntGet(&pool->quit))
+            break;
+
+        virThreadPoolWorkerApplyAffinity(pool, &affinitySeen);
+
+        /* Racy over-limit hint; the authoritative check is redone
+         * under the pool mutex before the worker actually exits */
+        if (virAtomicIntGet(&pool->nWorkersLive) >
+            virAtomicIntGet(&pool->maxWorkersLive)) {
+            virMutexLock(&pool->mutex);
+            if (virThreadPoolWorkerQuitHelper(pool->nWorkers,
+                                              pool->maxWorkers))
+                goto out;
+            virMutexUnlock(&pool->mutex);
+        }
+
+        virMutexLock(&queue->lock);
+        job = virThreadPoolJobListPop(&queue->jobs);
+        virMutexUnlock(&queue->lock);
+
+        /* Steal from the other queues before going idle */
+        for (i = 1; i < VIR_THREAD_POOL_NQUEUES && !job; i++) {
+            virThreadPoolQueuePtr victim =
+                &pool->queues[(qidx + i) % VIR_THREAD_POOL_NQUEUES];
+
+            virMutexLock(&victim->lock);
+            job = virThreadPoolJobListPop(&victim->jobs);
+            virMutexUnlock(&victim->lock);
+        }
+
+        /* With all queues empty any remaining depth can only be
+         * priority jobs, which idle workers also serve */
+        if (!job && virAtomicIntGet(&pool->jobQueueDepth) > 0) {
+            virMutexLock(&pool->mutex);
+            job = virThreadPoolJobListPop(&pool->prioList);
+            virMutexUnlock(&pool->mutex);
+        }
+
+        if (job) {
+            virAtomicIntAdd(&pool->jobQueueDepth, -1);
+            virThreadPoolUpdateJobQueueWait(pool, job);
+            (pool->jobFunc)(job->data, pool->jobOpaque);
+            VIR_FREE(job);
+            continue;
+        }
+
+        virMutexLock(&queue->lock);
+        virAtomicIntInc(&queue->nWaiters);
+        /* Re-check after advertising ourselves as idle; this pairs
+         * with virThreadPoolSendJob incrementing the depth before it
+         * scans for idle workers, so a concurrent enqueue cannot slip
+         * past a worker about to block */
+        if (virAtomicIntGet(&pool->jobQueueDepth) > 0 ||
+            virAtomicIntGet(&pool->quit)) {
+            virAtomicIntAdd(&queue->nWaiters, -1);
+            virMutexUnlock(&queue->lock);
+            continue;
+        }
+        if (virTimeMillisNowRaw(&deadline) < 0)
+            deadline = 0;
+        else
+            deadline += VIR_THREAD_POOL_IDLE_TIMEOUT_MS;
+        if (virCondWaitUntil(&queue->cond, &queue->lock, deadline) < 0) {
+            virAtomicIntAdd(&queue->nWaiters, -1);
+            virMutexUnlock(&queue->lock);
+            if (errno != ETIMEDOUT)
+                break;
+            /* A signal racing the timeout is consumed without waking
+             * anyone else: the enqueuer saw our nWaiters and stopped
+             * looking. Never leave while work is pending or the job
+             * it pushed would sit in the queue until some future
+             * enqueue happens along */
+            if (virAtomicIntGet(&pool->jobQueueDepth) > 0)
+                continue;
+            /* An idle stretch with no work also means the recent
+             * wait estimate has gone stale, so age it out */
+            virAtomicIntSet(&pool->jobQueueWait,
+                            virAtomicIntGet(&pool->jobQueueWait) / 2);
+            /* Shrink the pool back towards minWorkers when there has
+             * been nothing to do for a while */
+            virMutexLock(&pool->mutex);
+            if (!virAtomicIntGet(&pool->quit) &&
+                pool->nWorkers > pool->minWorkers)
+                goto out;
+            virMutexUnlock(&pool->mutex);
+            continue;
+        }
+        virAtomicIntAdd(&queue->nWaiters, -1);
+        virMutexUnlock(&queue->lock);
+    }
+
+    virMutexLock(&pool->mutex);
+ out:
+    pool->nWorkers--;
+    virAtomicIntAdd(&pool->nWorkersLive, -1);
+    if (pool->nWorkers == 0 && pool->nPrioWorkers == 0)
+        virCondSignal(&pool->quit_cond);
+    virMutexUnlock(&pool->mutex);
+}
+
+static void virThreadPoolPrioWorker(void *opaque)
+{
+    struct virThreadPoolWorkerData *data = opaque;
+    virThreadPoolPtr pool = data->pool;
+    virThreadPoolJobPtr job = NULL;
+    int affinitySeen = 0;
 
     VIR_FREE(data);
 
@@ -114,66 +371,34 @@ static void virThreadPoolWorker(void *opaque)
          * another job (and before taking another one from the queue); and
          * free workers need to check for this right after waking up.
          */
-        if (virThreadPoolWorkerQuitHelper(*curWorkers, *maxLimit))
+        if (virThreadPoolWorkerQuitHelper(pool->nPrioWorkers,
+                                          pool->maxPrioWorkers))
             goto out;
-        while (!pool->quit &&
-               ((!priority && !pool->jobList.head) ||
-                (priority && !pool->jobList.firstPrio))) {
-            if (!priority)
-                pool->freeWorkers++;
-            if (virCondWait(cond, &pool->mutex) < 0) {
-                if (!priority)
-                    pool->freeWorkers--;
+        while (!virAtomicIntGet(&pool->quit) && !pool->prioList.head) {
+            if (virCondWait(&pool->prioCond, &pool->mutex) < 0)
                 goto out;
-            }
-            if (!priority)
-                pool->freeWorkers--;
 
-            if (virThreadPoolWorkerQuitHelper(*curWorkers, *maxLimit))
+            if (virThreadPoolWorkerQuitHelper(pool->nPrioWorkers,
+                                              pool->maxPrioWorkers))
                 goto out;
         }
 
-        if (pool->quit)
+        if (virAtomicIntGet(&pool->quit))
             break;
 
-        if (priority) {
-            job = pool->jobList.firstPrio;
-        } else {
-            job = pool->jobList.head;
-        }
-
-        if (job == pool->jobList.firstPrio) {
-            virThreadPoolJobPtr tmp = job->next;
-            while (tmp) {
-                if (tmp->priority)
-                    break;
-                tmp = tmp->next;
-            }
-            pool->jobList.firstPrio = tmp;
-        }
-
-        if (job->prev)
-            job->prev->next = job->next;
-        else
-            pool->jobList.head = job->next;
-        if (job->next)
-            job->next->prev = job->prev;
-        else
-            pool->jobList.tail = job->prev;
-
-        pool->jobQueueDepth--;
+        job = virThreadPoolJobListPop(&pool->prioList);
+        virAtomicIntAdd(&pool->jobQueueDepth, -1);
+        virThreadPoolUpdateJobQueueWait(pool, job);
 
         virMutexUnlock(&pool->mutex);
+        virThreadPoolWorkerApplyAffinity(pool, &affinitySeen);
         (pool->jobFunc)(job->data, pool->jobOpaque);
         VIR_FREE(job);
         virMutexLock(&pool->mutex);
     }
 
  out:
-    if (priority)
-        pool->nPrioWorkers--;
-    else
-        pool->nWorkers--;
+    pool->nPrioWorkers--;
     if (pool->nWorkers == 0 && pool->nPrioWorkers == 0)
         virCondSignal(&pool->quit_cond);
     virMutexUnlock(&pool->mutex);
@@ -190,16 +415,22 @@ virThreadPoolExpand(virThreadPoolPtr pool, size_t gain, bool priority)
     if (VIR_EXPAND_N(*workers, *curWorkers, gain) < 0)
         return -1;
 
+    if (!priority)
+        virAtomicIntAdd(&pool->nWorkersLive, gain);
+
     for (i = 0; i < gain; i++) {
         if (VIR_ALLOC(data) < 0)
             goto error;
 
         data->pool = pool;
-        data->cond = priority ? &pool->prioCond : &pool->cond;
         data->priority = priority;
+        if (!priority)
+            data->qidx = pool->workerSerial++ % VIR_THREAD_POOL_NQUEUES;
 
         if (virThreadCreateFull(&(*workers)[i],
                                 false,
+                                priority ?
+                                virThreadPoolPrioWorker :
                                 virThreadPoolWorker,
                                 pool->jobFuncName,
                                 true,
@@ -214,6 +445,8 @@ virThreadPoolExpand(virThreadPoolPtr pool, size_t gain, bool priority)
 
  error:
     *curWorkers -= gain - i;
+    if (!priority)
+        virAtomicIntAdd(&pool->nWorkersLive, -(int)(gain - i));
     return -1;
 }
 
@@ -226,6 +459,7 @@ virThreadPoolNewFull(size_t minWorkers,
                      void *opaque)
 {
     virThreadPoolPtr pool;
+    size_t i;
 
     if (minWorkers > maxWorkers)
         minWorkers = maxWorkers;
@@ -233,22 +467,26 @@ virThreadPoolNewFull(size_t minWorkers,
     if (VIR_ALLOC(pool) < 0)
         return NULL;
 
-    pool->jobList.tail = pool->jobList.head = NULL;
-
     pool->jobFunc = func;
     pool->jobFuncName = funcName;
     pool->jobOpaque = opaque;
 
     if (virMutexInit(&pool->mutex) < 0)
         goto error;
-    if (virCondInit(&pool->cond) < 0)
-        goto error;
     if (virCondInit(&pool->quit_cond) < 0)
         goto error;
 
+    for (i = 0; i < VIR_THREAD_POOL_NQUEUES; i++) {
+        if (virMutexInit(&pool->queues[i].lock) < 0)
+            goto error;
+        if (virCondInit(&pool->queues[i].cond) < 0)
+            goto error;
+    }
+
     pool->minWorkers = minWorkers;
     pool->maxWorkers = maxWorkers;
     pool->maxPrioWorkers = prioWorkers;
+    virAtomicIntSet(&pool->maxWorkersLive, maxWorkers);
 
     if (virThreadPoolExpand(pool, minWorkers, false) < 0)
         goto error;
@@ -273,14 +511,20 @@ void virThreadPoolFree(virThreadPoolPtr pool)
 {
     virThreadPoolJobPtr job;
     bool priority = false;
+    size_t i;
 
     if (!pool)
         return;
 
+    virAtomicIntSet(&pool->quit, 1);
+
+    for (i = 0; i < VIR_THREAD_POOL_NQUEUES; i++) {
+        virMutexLock(&pool->queues[i].lock);
+        virCondBroadcast(&pool->queues[i].cond);
+        virMutexUnlock(&pool->queues[i].lock);
+    }
+
     virMutexLock(&pool->mutex);
-    pool->quit = true;
-    if (pool->nWorkers > 0)
-        virCondBroadcast(&pool->cond);
     if (pool->nPrioWorkers > 0) {
         priority = true;
         virCondBroadcast(&pool->prioCond);
@@ -289,20 +533,24 @@ void virThreadPoolFree(virThreadPoolPtr pool)
     while (pool->nWorkers > 0 || pool->nPrioWorkers > 0)
         ignore_value(virCondWait(&pool->quit_cond, &pool->mutex));
 
-    while ((job = pool->jobList.head)) {
-        pool->jobList.head = pool->jobList.head->next;
+    while ((job = virThreadPoolJobListPop(&pool->prioList)))
         VIR_FREE(job);
-    }
 
     VIR_FREE(pool->workers);
     virMutexUnlock(&pool->mutex);
     virMutexDestroy(&pool->mutex);
     virCondDestroy(&pool->quit_cond);
-    virCondDestroy(&pool->cond);
+    for (i = 0; i < VIR_THREAD_POOL_NQUEUES; i++) {
+        while ((job = virThreadPoolJobListPop(&pool->queues[i].jobs)))
+            VIR_FREE(job);
+        virMutexDestroy(&pool->queues[i].lock);
+        virCondDestroy(&pool->queues[i].cond);
+    }
     if (priority) {
         VIR_FREE(pool->prioWorkers);
         virCondDestroy(&pool->prioCond);
     }
+    virBitmapFree(pool->affinity);
     VIR_FREE(pool);
 }
 
@@ -353,24 +601,26 @@ size_t virThreadPoolGetCurrentWorkers(virThreadPoolPtr pool)
 
 size_t virThreadPoolGetFreeWorkers(virThreadPoolPtr pool)
 {
-    size_t ret;
+    size_t ret = 0;
+    size_t i;
 
-    virMutexLock(&pool->mutex);
-    ret = pool->freeWorkers;
-    virMutexUnlock(&pool->mutex);
+    for (i = 0; i < VIR_THREAD_POOL_NQUEUES; i++)
+        ret += virAtomicIntGet(&pool->queues[i].nWaiters);
 
     return ret;
 }
 
 size_t virThreadPoolGetJobQueueDepth(virThreadPoolPtr pool)
 {
-    size_t ret;
-
-    virMutexLock(&pool->mutex);
-    ret = pool->jobQueueDepth;
-    virMutexUnlock(&pool->mutex);
+    return virAtomicIntGet(&pool->jobQueueDepth);
+}
 
-    return ret;
+/* Smoothed average of how long recent jobs sat queued before a
+ * worker picked them up, in milliseconds
+ */
+size_t virThreadPoolGetJobQueueWait(virThreadPoolPtr pool)
+{
+    return virAtomicIntGet(&pool->jobQueueWait);
 }
 
 /*
@@ -382,45 +632,107 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
                          void *jobData)
 {
     virThreadPoolJobPtr job;
+    virThreadPoolQueuePtr queue;
+    size_t qidx;
 
-    virMutexLock(&pool->mutex);
-    if (pool->quit)
-        goto error;
+    if (virAtomicIntGet(&pool->quit))
+        return -1;
 
-    if (pool->freeWorkers - pool->jobQueueDepth <= 0 &&
-        pool->nWorkers < pool->maxWorkers &&
-        virThreadPoolExpand(pool, 1, false) < 0)
-        goto error;
+    /* Grow the pool when jobs outnumber the idle workers, or when
+     * recent jobs spent long enough queued that latency is hurting
+     * despite workers claiming to be idle */
+    if ((virThreadPoolGetFreeWorkers(pool) <=
+         (size_t)virAtomicIntGet(&pool->jobQueueDepth) ||
+         virAtomicIntGet(&pool->jobQueueWait) >
+         VIR_THREAD_POOL_WAIT_HIGH_MS) &&
+        virAtomicIntGet(&pool->nWorkersLive) <
+        virAtomicIntGet(&pool->maxWorkersLive)) {
+        virMutexLock(&pool->mutex);
+        if (!virAtomicIntGet(&pool->quit) &&
+            pool->nWorkers < pool->maxWorkers &&
+            virThreadPoolExpand(pool, 1, false) < 0) {
+            virMutexUnlock(&pool->mutex);
+            return -1;
+        }
+        virMutexUnlock(&pool->mutex);
+    }
 
     if (VIR_ALLOC(job) < 0)
-        goto error;
+        return -1;
 
     job->data = jobData;
-    job->priority = priority;
+    if (virTimeMillisNowRaw(&job->enqueued) < 0)
+        job->enqueued = 0;
 
-    job->prev = pool->jobList.tail;
-    if (pool->jobList.tail)
-        pool->jobList.tail->next = job;
-    pool->jobList.tail = job;
+    if (priority) {
+        virMutexLock(&pool->mutex);
+        virThreadPoolJobListPush(&pool->prioList, job);
+        virAtomicIntInc(&pool->jobQueueDepth);
+        virCondSignal(&pool->prioCond);
+        virMutexUnlock(&pool->mutex);
 
-    if (!pool->jobList.head)
-        pool->jobList.head = job;
+        /* Idle normal workers serve priority jobs too */
+        virThreadPoolWakeWorker(pool, 0);
+        return 0;
+    }
 
-    if (priority && !pool->jobList.firstPrio)
-        pool->jobList.firstPrio = job;
+    qidx = (unsigned int)virAtomicIntInc(&pool->nextQueue) %
+        VIR_THREAD_POOL_NQUEUES;
+    queue = &pool->queues[qidx];
+
+    virMutexLock(&queue->lock);
+    virThreadPoolJobListPush(&queue->jobs, job);
+    virAtomicIntInc(&pool->jobQueueDepth);
+    if (virAtomicIntGet(&queue->nWaiters) > 0) {
+        virCondSignal(&queue->cond);
+        virMutexUnlock(&queue->lock);
+        return 0;
+    }
+    virMutexUnlock(&queue->lock);
 
-    pool->jobQueueDepth++;
+    /* The home queue has no idle worker; look for one to steal it */
+    virThreadPoolWakeWorker(pool, qidx + 1);
+    return 0;
+}
 
-    virCondSignal(&pool->cond);
-    if (priority)
-        virCondSignal(&pool->prioCond);
+/**
+ * virThreadPoolSetAffinity:
+ * @pool: the thread pool
+ * @cpumap: CPUs the workers may run on, or NULL to drop the policy
+ *
+ * Sets an optional CPU affinity policy for the pool, e.g. to keep the
+ * workers on the CPUs of one NUMA node.  Every worker (including
+ * priority workers and workers spawned later) pins itself the next
+ * time it passes through its main loop, so the placement converges
+ * shortly after this call rather than instantly.  Pinning failures of
+ * individual workers are ignored.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virThreadPoolSetAffinity(virThreadPoolPtr pool,
+                             virBitmapPtr cpumap)
+{
+    virBitmapPtr map = NULL;
+    size_t i;
 
-    virMutexUnlock(&pool->mutex);
-    return 0;
+    if (cpumap &&
+        !(map = virBitmapNewCopy(cpumap)))
+        return -1;
 
- error:
+    virMutexLock(&pool->mutex);
+    virBitmapFree(pool->affinity);
+    pool->affinity = map;
+    virAtomicIntInc(&pool->affinityGen);
     virMutexUnlock(&pool->mutex);
-    return -1;
+
+    /* Nudge idle workers so they re-apply the mask promptly */
+    for (i = 0; i < VIR_THREAD_POOL_NQUEUES; i++) {
+        virMutexLock(&pool->queues[i].lock);
+        virCondBroadcast(&pool->queues[i].cond);
+        virMutexUnlock(&pool->queues[i].lock);
+    }
+
+    return 0;
 }
 
 int
@@ -431,6 +743,7 @@ virThreadPoolSetParameters(virThreadPoolPtr pool,
 {
     size_t max;
     size_t min;
+    size_t i;
 
     virMutexLock(&pool->mutex);
 
@@ -452,11 +765,11 @@ virThreadPoolSetParameters(virThreadPoolPtr pool,
 
     if (maxWorkers >= 0) {
         pool->maxWorkers = maxWorkers;
-        virCondBroadcast(&pool->cond);
+        virAtomicIntSet(&pool->maxWorkersLive, maxWorkers);
     }
 
     if (prioWorkers >= 0) {
-        if (prioWorkers < pool->nPrioWorkers) {
+        if ((size_t) prioWorkers < pool->nPrioWorkers) {
             virCondBroadcast(&pool->prioCond);
         } else if ((size_t) prioWorkers > pool->nPrioWorkers &&
                    virThreadPoolExpand(pool, prioWorkers - pool->nPrioWorkers,
@@ -467,6 +780,18 @@ virThreadPoolSetParameters(virThreadPoolPtr pool,
     }
 
     virMutexUnlock(&pool->mutex);
+
+    /* Shrinking maxWorkers needs sleeping workers to wake up and
+     * re-check the limit; the queue locks are taken only after the
+     * pool mutex was dropped */
+    if (maxWorkers >= 0) {
+        for (i = 0; i < VIR_THREAD_POOL_NQUEUES; i++) {
+            virMutexLock(&pool->queues[i].lock);
+            virCondBroadcast(&pool->queues[i].cond);
+            virMutexUnlock(&pool->queues[i].lock);
+        }
+    }
+
     return 0;
 
  error:
@@ -98,6 +98,18 @@ int virTypedParamsReplaceString(virTypedParameterPtr *params,
                                 const char *name,
                                 const char *value);
 
+int virTypedParamsReserve(virTypedParameterPtr *params,
+                          int *nparams,
+                          int *maxparams,
+                          int add)
+    ATTRIBUTE_RETURN_CHECK;
+
+int virTypedParamsComposeField(char *buf,
+                               const char *type,
+                               ssize_t num,
+                               const char *name)
+    ATTRIBUTE_RETURN_CHECK ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
 int virTypedParamsCopy(virTypedParameterPtr *dst,
                        virTypedParameterPtr src,
                        int nparams);
@@ -36,7 +36,9 @@
 #include "virutil.h"
 #include "viralloc.h"
 #include "virfile.h"
+#include "virhash.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_XML
 
@@ -56,6 +58,78 @@ struct virParserData {
  *									*
  ************************************************************************/
 
+/* The XPath helpers below are called with a small set of literal
+ * expressions, but libxml2 re-parses the expression string on every
+ * xmlXPathEval. Keep a per-thread cache of compiled expressions so
+ * that parsing many documents (e.g. loading all domain configs at
+ * daemon startup) compiles each expression only once per thread.
+ * Prefixes in compiled expressions are resolved against the context
+ * at evaluation time, so sharing them between documents is safe. */
+
+/* There are over 500 distinct literal expressions across the various
+ * parsers; keep enough room for all of them plus some slack for
+ * dynamically built ones, since entries past the limit are compiled
+ * on every evaluation. */
+#define VIR_XPATH_COMP_CACHE_SIZE 1024
+
+static virThreadLocal virXPathCompCacheKey;
+
+static void
+virXPathCompCacheFree(void *payload)
+{
+    virHashFree(payload);
+}
+
+static int
+virXPathCompCacheOnceInit(void)
+{
+    return virThreadLocalInit(&virXPathCompCacheKey, virXPathCompCacheFree);
+}
+
+VIR_ONCE_GLOBAL_INIT(virXPathCompCache)
+
+static void
+virXPathCompExprHashFree(void *payload,
+                         const void *name ATTRIBUTE_UNUSED)
+{
+    xmlXPathFreeCompExpr(payload);
+}
+
+static xmlXPathObjectPtr
+virXPathEval(const char *xpath,
+             xmlXPathContextPtr ctxt)
+{
+    virHashTablePtr cache = NULL;
+    xmlXPathCompExprPtr comp;
+
+    if (virXPathCompCacheInitialize() >= 0 &&
+        !(cache = virThreadLocalGet(&virXPathCompCacheKey))) {
+        if ((cache = virHashCreate(61, virXPathCompExprHashFree)) &&
+            virThreadLocalSet(&virXPathCompCacheKey, cache) < 0) {
+            virHashFree(cache);
+            cache = NULL;
+        }
+    }
+
+    /* cache failures just mean we parse the expression each time */
+    if (!cache)
+        return xmlXPathEval(BAD_CAST xpath, ctxt);
+
+    if (!(comp = virHashLookup(cache, xpath))) {
+        if (!(comp = xmlXPathCompile(BAD_CAST xpath)))
+            return NULL;
+
+        if (virHashSize(cache) >= VIR_XPATH_COMP_CACHE_SIZE ||
+            virHashAddEntry(cache, xpath, comp) < 0) {
+            xmlXPathObjectPtr obj = xmlXPathCompiledEval(comp, ctxt);
+            xmlXPathFreeCompExpr(comp);
+            return obj;
+        }
+    }
+
+    return xmlXPathCompiledEval(comp, ctxt);
+}
+
 /**
  * virXPathString:
  * @xpath: the XPath string to evaluate
@@ -80,7 +154,7 @@ virXPathString(const char *xpath,
         return NULL;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_STRING) ||
         (obj->stringval == NULL) || (obj->stringval[0] == 0)) {
@@ -147,7 +221,7 @@ virXPathNumber(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_NUMBER) ||
         (isnan(obj->floatval))) {
@@ -176,7 +250,7 @@ virXPathLongBase(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -281,7 +355,7 @@ virXPathULongBase(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -397,7 +471,7 @@ virXPathULongLong(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -443,7 +517,7 @@ virXPathLongLong(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -479,6 +553,57 @@ virXMLPropString(xmlNodePtr node,
     return (char *)xmlGetProp(node, BAD_CAST name);
 }
 
+/**
+ * virXMLChildNode:
+ * @node: parent XML dom node pointer (may be NULL)
+ * @name: name of the child element to look up
+ *
+ * Convenience function to find the first child element with the given
+ * name by direct traversal, equivalent to evaluating the relative
+ * XPath expression "./name" but without the expression machinery.
+ *
+ * Returns the child node, or NULL if @node is NULL or has no such child.
+ */
+xmlNodePtr
+virXMLChildNode(xmlNodePtr node,
+                const char *name)
+{
+    xmlNodePtr cur;
+
+    if (!node)
+        return NULL;
+
+    for (cur = node->children; cur; cur = cur->next) {
+        if (cur->type == XML_ELEMENT_NODE &&
+            xmlStrEqual(cur->name, BAD_CAST name))
+            return cur;
+    }
+
+    return NULL;
+}
+
+/**
+ * virXMLChildPropString:
+ * @node: parent XML dom node pointer (may be NULL)
+ * @child: name of the child element holding the attribute
+ * @name: name of the property (attribute) to get
+ *
+ * Convenience function to return a copy of an attribute of a direct
+ * child element, equivalent to evaluating the relative XPath
+ * expression "string(./child/@name)".
+ *
+ * Returns the property (attribute) value as string, or NULL if the
+ * child or the attribute doesn't exist. The caller is responsible for
+ * freeing the returned buffer.
+ */
+char *
+virXMLChildPropString(xmlNodePtr node,
+                      const char *child,
+                      const char *name)
+{
+    return virXMLPropString(virXMLChildNode(node, child), name);
+}
+
 /**
  * virXPathBoolean:
  * @xpath: the XPath string to evaluate
@@ -502,7 +627,7 @@ virXPathBoolean(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_BOOLEAN) ||
         (obj->boolval < 0) || (obj->boolval > 1)) {
@@ -539,7 +664,7 @@ virXPathNode(const char *xpath,
         return NULL;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_NODESET) ||
         (obj->nodesetval == NULL) || (obj->nodesetval->nodeNr <= 0) ||
@@ -583,7 +708,7 @@ virXPathNodeSet(const char *xpath,
         *list = NULL;
 
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if (obj == NULL)
         return 0;
@@ -73,6 +73,11 @@ int              virXPathNodeSet(const char *xpath,
                                  xmlNodePtr **list);
 char *          virXMLPropString(xmlNodePtr node,
                                  const char *name);
+xmlNodePtr       virXMLChildNode(xmlNodePtr node,
+                                 const char *name);
+char *     virXMLChildPropString(xmlNodePtr node,
+                                 const char *child,
+                                 const char *name);
 long     virXMLChildElementCount(xmlNodePtr node);
 
 /* Internal function; prefer the macros below.  */
@@ -244,50 +244,62 @@ vmwareConnectGetVersion(virConnectPtr conn, unsigned long *version)
     return 0;
 }
 
-static int
-vmwareUpdateVMStatus(struct vmware_driver *driver, virDomainObjPtr vm)
+/* Run 'vmrun list' and return its output, or NULL on failure */
+static char *
+vmwareRunVmrunList(struct vmware_driver *driver)
 {
     virCommandPtr cmd;
     char *outbuf = NULL;
-    char *vmxAbsolutePath = NULL;
-    char *parsedVmxPath = NULL;
-    char *str;
-    char *saveptr = NULL;
-    bool found = false;
-    int oldState = virDomainObjGetState(vm, NULL);
-    int newState;
-    int ret = -1;
 
     cmd = virCommandNewArgList(driver->vmrun, "-T",
                                vmwareDriverTypeToString(driver->type),
                                "list", NULL);
     virCommandSetOutputBuffer(cmd, &outbuf);
     if (virCommandRun(cmd, NULL) < 0)
-        goto cleanup;
+        VIR_FREE(outbuf);
+
+    virCommandFree(cmd);
+    return outbuf;
+}
+
+/* Set the state of 'vm' from the output of an earlier 'vmrun list',
+ * so one invocation can answer for a whole sweep of domains */
+static int
+vmwareUpdateVMStatusFromList(virDomainObjPtr vm, const char *listOutput)
+{
+    char *vmxAbsolutePath = NULL;
+    const char *line = listOutput;
+    bool found = false;
+    int oldState = virDomainObjGetState(vm, NULL);
+    int newState;
+    int ret = -1;
 
     if (virFileResolveAllLinks(((vmwareDomainPtr) vm->privateData)->vmxPath,
                                &vmxAbsolutePath) < 0)
         goto cleanup;
 
-    for (str = outbuf; (parsedVmxPath = strtok_r(str, "\n", &saveptr)) != NULL;
-         str = NULL) {
-
-        if (parsedVmxPath[0] != '/')
-            continue;
+    while (line && *line) {
+        const char *eol = strchr(line, '\n');
+        size_t len = eol ? (size_t)(eol - line) : strlen(line);
 
-        if (STREQ(parsedVmxPath, vmxAbsolutePath)) {
+        if (line[0] == '/' &&
+            len == strlen(vmxAbsolutePath) &&
+            STREQLEN(line, vmxAbsolutePath, len)) {
             found = true;
-            /* If the vmx path is in the output, the domain is running or
-             * is paused but we have no way to detect if it is paused or not. */
-            if (oldState == VIR_DOMAIN_PAUSED)
-                newState = oldState;
-            else
-                newState = VIR_DOMAIN_RUNNING;
             break;
         }
+
+        line = eol ? eol + 1 : NULL;
     }
 
-    if (!found) {
+    if (found) {
+        /* If the vmx path is in the output, the domain is running or
+         * is paused but we have no way to detect if it is paused or not. */
+        if (oldState == VIR_DOMAIN_PAUSED)
+            newState = oldState;
+        else
+            newState = VIR_DOMAIN_RUNNING;
+    } else {
         vm->def->id = -1;
         newState = VIR_DOMAIN_SHUTOFF;
     }
@@ -297,12 +309,26 @@ vmwareUpdateVMStatus(struct vmware_driver *driver, virDomainObjPtr vm)
     ret = 0;
 
  cleanup:
-    virCommandFree(cmd);
-    VIR_FREE(outbuf);
     VIR_FREE(vmxAbsolutePath);
     return ret;
 }
 
+static int
+vmwareUpdateVMStatus(struct vmware_driver *driver, virDomainObjPtr vm)
+{
+    char *outbuf = NULL;
+    int ret = -1;
+
+    if (!(outbuf = vmwareRunVmrunList(driver)))
+        goto cleanup;
+
+    ret = vmwareUpdateVMStatusFromList(vm, outbuf);
+
+ cleanup:
+    VIR_FREE(outbuf);
+    return ret;
+}
+
 static int
 vmwareStopVM(struct vmware_driver *driver,
              virDomainObjPtr vm,
@@ -1047,9 +1073,9 @@ vmwareConnectDomainXMLFromNative(virConnectPtr conn, const char *nativeFormat,
 
 static int vmwareDomainObjListUpdateDomain(virDomainObjPtr dom, void *data)
 {
-    struct vmware_driver *driver = data;
+    const char *listOutput = data;
     virObjectLock(dom);
-    ignore_value(vmwareUpdateVMStatus(driver, dom));
+    ignore_value(vmwareUpdateVMStatusFromList(dom, listOutput));
     virObjectUnlock(dom);
     return 0;
 }
@@ -1057,7 +1083,15 @@ static int vmwareDomainObjListUpdateDomain(virDomainObjPtr dom, void *data)
 static void
 vmwareDomainObjListUpdateAll(virDomainObjListPtr doms, struct vmware_driver *driver)
 {
-    virDomainObjListForEach(doms, vmwareDomainObjListUpdateDomain, driver);
+    char *outbuf;
+
+    /* A single 'vmrun list' answers for every domain in the sweep;
+     * forking it once per domain made listing O(n) process spawns */
+    if (!(outbuf = vmwareRunVmrunList(driver)))
+        return;
+
+    virDomainObjListForEach(doms, vmwareDomainObjListUpdateDomain, outbuf);
+    VIR_FREE(outbuf);
 }
 
 static int
@@ -168,6 +168,8 @@ static void vzDriverDispose(void * obj)
         prlsdkDisconnect(driver);
     }
 
+    PrlHandle_Free(driver->srvConfig);
+
     virObjectUnref(driver->domains);
     virObjectUnref(driver->caps);
     virObjectUnref(driver->xmlopt);
@@ -337,6 +339,8 @@ vzDriverObjNew(void)
     if (!(driver = virObjectLockableNew(vzDriverClass)))
         return NULL;
 
+    driver->srvConfig = PRL_INVALID_HANDLE;
+
     vzDomainDefParserConfig.priv = &driver->vzCaps;
 
     if (!(driver->caps = vzBuildCapabilities()) ||
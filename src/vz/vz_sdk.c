@@ -4040,12 +4040,51 @@ prlsdkApplyConfig(vzDriverPtr driver,
     return ret;
 }
 
+/* Return the host hardware config, fetching it from the server on first
+ * use.  The handle is owned by the driver and must not be freed by the
+ * caller; it is invariant until the connection is torn down. */
+static PRL_HANDLE
+prlsdkGetSrvConfig(vzDriverPtr driver)
+{
+    PRL_HANDLE job;
+    PRL_HANDLE result = PRL_INVALID_HANDLE;
+    PRL_HANDLE srvconf = PRL_INVALID_HANDLE;
+    PRL_RESULT pret;
+
+    virObjectLock(driver);
+    srvconf = driver->srvConfig;
+    virObjectUnlock(driver);
+
+    if (srvconf != PRL_INVALID_HANDLE)
+        return srvconf;
+
+    job = PrlSrv_GetSrvConfig(driver->server);
+    if (PRL_FAILED(getJobResult(job, &result)))
+        return PRL_INVALID_HANDLE;
+
+    pret = PrlResult_GetParamByIndex(result, 0, &srvconf);
+    prlsdkCheckRetGoto(pret, cleanup);
+
+    virObjectLock(driver);
+    if (driver->srvConfig == PRL_INVALID_HANDLE) {
+        driver->srvConfig = srvconf;
+    } else {
+        /* lost the race against a concurrent fetch */
+        PrlHandle_Free(srvconf);
+        srvconf = driver->srvConfig;
+    }
+    virObjectUnlock(driver);
+
+ cleanup:
+    PrlHandle_Free(result);
+    return srvconf;
+}
+
 int
 prlsdkCreateVm(vzDriverPtr driver, virDomainDefPtr def)
 {
     PRL_HANDLE sdkdom = PRL_INVALID_HANDLE;
     PRL_HANDLE job = PRL_INVALID_HANDLE;
-    PRL_HANDLE result = PRL_INVALID_HANDLE;
     PRL_HANDLE srvconf = PRL_INVALID_HANDLE;
     PRL_RESULT pret;
     int ret = -1;
@@ -4053,13 +4092,9 @@ prlsdkCreateVm(vzDriverPtr driver, virDomainDefPtr def)
     pret = PrlSrv_CreateVm(driver->server, &sdkdom);
     prlsdkCheckRetGoto(pret, cleanup);
 
-    job = PrlSrv_GetSrvConfig(driver->server);
-    if (PRL_FAILED(getJobResult(job, &result)))
+    if ((srvconf = prlsdkGetSrvConfig(driver)) == PRL_INVALID_HANDLE)
         goto cleanup;
 
-    pret = PrlResult_GetParamByIndex(result, 0, &srvconf);
-    prlsdkCheckRetGoto(pret, cleanup);
-
     pret = PrlVmCfg_SetDefaultConfig(sdkdom, srvconf, PVS_GUEST_VER_LIN_REDHAT, 0);
     prlsdkCheckRetGoto(pret, cleanup);
 
@@ -4077,8 +4112,6 @@ prlsdkCreateVm(vzDriverPtr driver, virDomainDefPtr def)
 
  cleanup:
     PrlHandle_Free(sdkdom);
-    PrlHandle_Free(srvconf);
-    PrlHandle_Free(result);
 
     return ret;
 }
@@ -71,6 +71,9 @@ struct _vzDriver {
     virDomainObjListPtr domains;
     unsigned char session_uuid[VIR_UUID_BUFLEN];
     PRL_HANDLE server;
+    /* host hardware config; invariant for the life of the connection,
+     * fetched from the server on first use.  Protected by lock */
+    PRL_HANDLE srvConfig;
     virCapsPtr caps;
     virDomainXMLOptionPtr xmlopt;
     virObjectEventStatePtr domainEventState;
@@ -0,0 +1,298 @@
+/*
+ * domainxmlperftest.c: macro-benchmark for domain XML parse/format
+ *
+ * Copyright (C) 2016 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "domain_conf.h"
+#include "viralloc.h"
+#include "virbuffer.h"
+#include "virfile.h"
+#include "virstring.h"
+#include "virtime.h"
+#include "virutil.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* Runs from 'make bench', not 'make check': walks the
+ * qemuxml2argvdata corpus and reports parse+format wall time per
+ * config, then stresses synthetic configs with large device arrays
+ * which expose quadratic behaviour that the hand-written corpus
+ * files are too small to show.  Allocation counts are reported when
+ * built with --enable-test-oom; otherwise they read as zero.
+ */
+
+#define BENCH_FILE_MAX (1024 * 1024)
+#define BENCH_REPEATS 20
+#define BENCH_TOP_SLOWEST 10
+
+static virCapsPtr caps;
+static virDomainXMLOptionPtr xmlopt;
+
+typedef struct {
+    char *name;
+    double msop;
+} benchResult;
+
+static benchResult slowest[BENCH_TOP_SLOWEST];
+
+static void
+benchRecordSlowest(const char *name, double msop)
+{
+    size_t i;
+
+    for (i = 0; i < BENCH_TOP_SLOWEST; i++) {
+        if (msop > slowest[i].msop) {
+            VIR_FREE(slowest[BENCH_TOP_SLOWEST - 1].name);
+            memmove(slowest + i + 1, slowest + i,
+                    sizeof(slowest[0]) * (BENCH_TOP_SLOWEST - i - 1));
+            slowest[i].name = NULL;
+            ignore_value(VIR_STRDUP_QUIET(slowest[i].name, name));
+            slowest[i].msop = msop;
+            break;
+        }
+    }
+}
+
+/* Parse and re-format @xml BENCH_REPEATS times; returns the average
+ * wall time of one parse+format cycle in ms, or -1 if the config does
+ * not parse with the generic driver */
+static double
+benchOneConfig(const char *xml, int *nallocs)
+{
+    unsigned long long start, end;
+    size_t i;
+    int allocs0;
+
+    virAllocTestInit();
+    allocs0 = virAllocTestCount();
+
+    if (virTimeMillisNowRaw(&start) < 0)
+        return -1;
+
+    for (i = 0; i < BENCH_REPEATS; i++) {
+        virDomainDefPtr def;
+        char *out;
+
+        if (!(def = virDomainDefParseString(xml, caps, xmlopt,
+                                            VIR_DOMAIN_DEF_PARSE_INACTIVE)))
+            return -1;
+
+        out = virDomainDefFormat(def, caps, 0);
+        virDomainDefFree(def);
+        if (!out)
+            return -1;
+        VIR_FREE(out);
+    }
+
+    if (virTimeMillisNowRaw(&end) < 0)
+        return -1;
+
+    *nallocs = (virAllocTestCount() - allocs0) / BENCH_REPEATS;
+    return (double)(end - start) / BENCH_REPEATS;
+}
+
+static int
+benchCorpus(void)
+{
+    char *dirpath = NULL;
+    DIR *dir = NULL;
+    struct dirent *ent;
+    int rc;
+    size_t nconfigs = 0;
+    size_t nskipped = 0;
+    double totalms = 0;
+    int ret = -1;
+    size_t i;
+
+    if (virAsprintf(&dirpath, "%s/qemuxml2argvdata", abs_srcdir) < 0)
+        goto cleanup;
+
+    if (virDirOpen(&dir, dirpath) < 0)
+        goto cleanup;
+
+    while ((rc = virDirRead(dir, &ent, dirpath)) > 0) {
+        char *path = NULL;
+        char *xml = NULL;
+        double msop;
+        int nallocs = 0;
+
+        if (!virFileHasSuffix(ent->d_name, ".xml"))
+            continue;
+
+        if (!(path = virFileBuildPath(dirpath, ent->d_name, NULL)))
+            goto cleanup;
+
+        if (virFileReadAll(path, BENCH_FILE_MAX, &xml) < 0) {
+            VIR_FREE(path);
+            goto cleanup;
+        }
+
+        /* qemu-only constructs don't parse with the generic driver;
+         * skip those configs rather than failing the benchmark */
+        if ((msop = benchOneConfig(xml, &nallocs)) < 0) {
+            nskipped++;
+        } else {
+            nconfigs++;
+            totalms += msop;
+            benchRecordSlowest(ent->d_name, msop);
+            if (virTestGetVerbose())
+                fprintf(stderr, "%-64s %8.3f ms/op %8d allocs/op\n",
+                        ent->d_name, msop, nallocs);
+        }
+
+        VIR_FREE(xml);
+        VIR_FREE(path);
+    }
+    if (rc < 0)
+        goto cleanup;
+
+    fprintf(stderr,
+            "corpus: %zu configs parsed+formatted (%zu skipped), "
+            "%.1f ms total, %.3f ms/config\n",
+            nconfigs, nskipped, totalms,
+            nconfigs ? totalms / nconfigs : 0);
+
+    fprintf(stderr, "slowest configs:\n");
+    for (i = 0; i < BENCH_TOP_SLOWEST && slowest[i].name; i++)
+        fprintf(stderr, "  %-62s %8.3f ms/op\n",
+                slowest[i].name, slowest[i].msop);
+
+    ret = 0;
+ cleanup:
+    VIR_DIR_CLOSE(dir);
+    VIR_FREE(dirpath);
+    return ret;
+}
+
+/* Build a syntactically valid config with @ndisks disks and @nnics
+ * interfaces; device-array handling that is accidentally quadratic
+ * shows up here long before it is visible on the corpus files */
+static char *
+benchSyntheticConfig(size_t ndisks, size_t nnics)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    virBufferAddLit(&buf,
+                    "<domain type='qemu'>\n"
+                    "  <name>synthetic</name>\n"
+                    "  <memory unit='KiB'>1048576</memory>\n"
+                    "  <vcpu>4</vcpu>\n"
+                    "  <os><type arch='i686' machine='pc'>hvm</type></os>\n"
+                    "  <devices>\n"
+                    "    <emulator>/usr/bin/qemu</emulator>\n");
+
+    for (i = 0; i < ndisks; i++) {
+        char *dev = virIndexToDiskName(i, "vd");
+
+        if (!dev)
+            goto error;
+        virBufferAsprintf(&buf,
+                          "    <disk type='file' device='disk'>\n"
+                          "      <source file='/var/lib/images/%zu.img'/>\n"
+                          "      <target dev='%s' bus='virtio'/>\n"
+                          "    </disk>\n",
+                          i, dev);
+        VIR_FREE(dev);
+    }
+
+    for (i = 0; i < nnics; i++) {
+        virBufferAsprintf(&buf,
+                          "    <interface type='ethernet'>\n"
+                          "      <mac address='52:54:00:%02zx:%02zx:%02zx'/>\n"
+                          "    </interface>\n",
+                          (i >> 16) & 0x7f, (i >> 8) & 0xff, i & 0xff);
+    }
+
+    virBufferAddLit(&buf,
+                    "  </devices>\n"
+                    "</domain>\n");
+
+    if (virBufferCheckError(&buf) < 0)
+        goto error;
+
+    return virBufferContentAndReset(&buf);
+
+ error:
+    virBufferFreeAndReset(&buf);
+    return NULL;
+}
+
+static int
+benchSynthetic(size_t ndisks, size_t nnics)
+{
+    char *xml;
+    double msop;
+    int nallocs = 0;
+    int ret = -1;
+
+    if (!(xml = benchSyntheticConfig(ndisks, nnics)))
+        return -1;
+
+    if ((msop = benchOneConfig(xml, &nallocs)) < 0) {
+        fprintf(stderr, "synthetic config (%zu disks, %zu nics) "
+                "failed to parse\n", ndisks, nnics);
+        goto cleanup;
+    }
+
+    fprintf(stderr,
+            "synthetic %4zu disks %4zu nics: %8.3f ms/op %8d allocs/op\n",
+            ndisks, nnics, msop, nallocs);
+    ret = 0;
+ cleanup:
+    VIR_FREE(xml);
+    return ret;
+}
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    size_t i;
+
+    if (!(caps = virTestGenericCapsInit()))
+        return EXIT_FAILURE;
+
+    if (!(xmlopt = virTestGenericDomainXMLConfInit()))
+        return EXIT_FAILURE;
+
+    if (benchCorpus() < 0)
+        ret = -1;
+
+    /* doubling sequence makes super-linear growth obvious */
+    if (benchSynthetic(50, 20) < 0 ||
+        benchSynthetic(125, 50) < 0 ||
+        benchSynthetic(250, 100) < 0 ||
+        benchSynthetic(500, 200) < 0)
+        ret = -1;
+
+    for (i = 0; i < BENCH_TOP_SLOWEST; i++)
+        VIR_FREE(slowest[i].name);
+    virObjectUnref(caps);
+    virObjectUnref(xmlopt);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
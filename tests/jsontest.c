@@ -311,6 +311,69 @@ testJSONCopy(const void *data)
 }
 
 
+static int
+testJSONArena(const void *data)
+{
+    const struct testInfo *info = data;
+    virJSONValuePtr json = NULL;
+    virJSONValuePtr stolen = NULL;
+    char *result = NULL;
+    char *resultArena = NULL;
+    int ret = -1;
+
+    if (!(json = virJSONValueFromString(info->doc))) {
+        VIR_TEST_VERBOSE("Failed to parse %s\n", info->doc);
+        goto cleanup;
+    }
+    if (!(result = virJSONValueToString(json, false))) {
+        VIR_TEST_VERBOSE("Failed to format heap parsed JSON data\n");
+        goto cleanup;
+    }
+    virJSONValueFree(json);
+
+    if (!(json = virJSONValueFromStringArena(info->doc))) {
+        VIR_TEST_VERBOSE("Failed to arena parse %s\n", info->doc);
+        goto cleanup;
+    }
+    if (!(resultArena = virJSONValueToString(json, false))) {
+        VIR_TEST_VERBOSE("Failed to format arena parsed JSON data\n");
+        goto cleanup;
+    }
+
+    if (STRNEQ(result, resultArena)) {
+        virTestDifference(stderr, result, resultArena);
+        goto cleanup;
+    }
+
+    /* A stolen value must survive freeing the arena backed tree */
+    if (json->type == VIR_JSON_TYPE_OBJECT &&
+        json->data.object.npairs) {
+        const char *key = json->data.object.pairs[0].key;
+
+        if (virJSONValueObjectRemoveKey(json, key, &stolen) != 1) {
+            VIR_TEST_VERBOSE("Failed to remove '%s' from arena tree\n", key);
+            goto cleanup;
+        }
+        virJSONValueFree(json);
+        json = NULL;
+
+        VIR_FREE(result);
+        if (!(result = virJSONValueToString(stolen, false))) {
+            VIR_TEST_VERBOSE("Stolen arena value unusable after free\n");
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(result);
+    VIR_FREE(resultArena);
+    virJSONValueFree(json);
+    virJSONValueFree(stolen);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -399,6 +462,14 @@ mymain(void)
                  "\"query-uuid\"}, {\"name\": \"query-migrate\"}, {\"name\": "
                  "\"query-balloon\"}], \"id\": \"libvirt-2\"}", NULL, true);
 
+    DO_TEST_FULL("arena parse", Arena,
+                 "{\"return\": {\"version\": {\"qemu\": {\"micro\": 1, "
+                 "\"minor\": 6, \"major\": 2}, \"package\": \"\"}, "
+                 "\"capabilities\": [true, false, null, 1.5, \"str\"]}, "
+                 "\"id\": \"libvirt-1\"}", NULL, true);
+    DO_TEST_FULL("arena parse", Arena,
+                 "[ 1, 2, 3, {\"nested\": [\"deep\", {\"deeper\": null}]} ]",
+                 NULL, true);
 
     DO_TEST_PARSE("almost nothing", "[]");
     DO_TEST_PARSE_FAIL("nothing", "");
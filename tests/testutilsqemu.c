@@ -471,7 +471,7 @@ qemuTestParseCapabilities(const char *capsFile)
 
 void qemuTestDriverFree(virQEMUDriver *driver)
 {
-    virMutexDestroy(&driver->lock);
+    virRWLockDestroy(&driver->lock);
     virQEMUCapsCacheFree(driver->qemuCapsCache);
     virObjectUnref(driver->xmlopt);
     virObjectUnref(driver->caps);
@@ -513,7 +513,7 @@ int qemuTestDriverInit(virQEMUDriver *driver)
 
     memset(driver, 0, sizeof(*driver));
 
-    if (virMutexInit(&driver->lock) < 0)
+    if (virRWLockInit(&driver->lock) < 0)
         return -1;
 
     driver->config = virQEMUDriverConfigNew(false);
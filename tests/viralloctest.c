@@ -418,6 +418,63 @@ testDispose(const void *opaque ATTRIBUTE_UNUSED)
 }
 
 
+static int
+testAllocPool(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virAllocPoolPtr pool;
+    testDummyStruct *t;
+    testDummyStruct *t2;
+    void *big;
+    char *str;
+    size_t i;
+    int ret = -1;
+
+    if (!(pool = virAllocPoolNew(0)))
+        return -1;
+
+    if (!(t = virAllocPoolAlloc(pool, sizeof(*t))))
+        goto cleanup;
+
+    if (t->a != 0 || t->b != 0) {
+        fprintf(stderr, "Pool allocation was not zeroed\n");
+        goto cleanup;
+    }
+
+    t->a = 42;
+    virAllocPoolRecycle(pool, t, sizeof(*t));
+
+    /* recycled memory must come back zeroed */
+    if (!(t2 = virAllocPoolAlloc(pool, sizeof(*t2))))
+        goto cleanup;
+    if (t2->a != 0 || t2->b != 0) {
+        fprintf(stderr, "Recycled pool allocation was not zeroed\n");
+        goto cleanup;
+    }
+
+    /* drive the pool through several chunks */
+    for (i = 0; i < 10000; i++) {
+        if (!virAllocPoolAlloc(pool, 1 + (i % 500)))
+            goto cleanup;
+    }
+
+    /* oversize allocations bypass the size classes */
+    if (!(big = virAllocPoolAlloc(pool, 100 * 1024)))
+        goto cleanup;
+    memset(big, 0xfe, 100 * 1024);
+
+    if (!(str = virAllocPoolStrdup(pool, "test")) ||
+        STRNEQ(str, "test")) {
+        fprintf(stderr, "Pool strdup returned wrong content\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virAllocPoolFree(pool);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -435,6 +492,8 @@ mymain(void)
         ret = -1;
     if (virTestRun("insert array", testInsertArray, NULL) < 0)
         ret = -1;
+    if (virTestRun("alloc pool", testAllocPool, NULL) < 0)
+        ret = -1;
     if (virTestRun("dispose tests", testDispose, NULL) < 0)
         ret = -1;
 
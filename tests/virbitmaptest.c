@@ -662,6 +662,60 @@ test12(const void *opaque ATTRIBUTE_UNUSED)
     return ret;
 }
 
+/* test bulk bit range setters */
+static int
+test13(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virBitmapPtr map = NULL;
+    int ret = -1;
+
+    if (!(map = virBitmapNew(1024)))
+        return -1;
+
+    TEST_MAP(1024, "");
+
+    if (virBitmapSetRange(map, 17, 17) < 0)
+        goto cleanup;
+
+    TEST_MAP(1024, "17");
+
+    if (virBitmapSetRange(map, 33, 61) < 0)
+        goto cleanup;
+
+    TEST_MAP(1024, "17,33-61");
+
+    if (virBitmapSetRange(map, 60, 200) < 0)
+        goto cleanup;
+
+    TEST_MAP(1024, "17,33-200");
+
+    if (virBitmapSetRange(map, 3, 2) >= 0 ||
+        virBitmapSetRange(map, 1000, 1024) >= 0)
+        goto cleanup;
+
+    TEST_MAP(1024, "17,33-200");
+
+    virBitmapFree(map);
+    if (!(map = virBitmapNewEmpty()))
+        goto cleanup;
+
+    if (virBitmapSetRangeExpand(map, 62, 130) < 0)
+        goto cleanup;
+
+    TEST_MAP(131, "62-130");
+
+    if (virBitmapSetRangeExpand(map, 130, 129) >= 0)
+        goto cleanup;
+
+    TEST_MAP(131, "62-130");
+
+    ret = 0;
+
+ cleanup:
+    virBitmapFree(map);
+    return ret;
+}
+
 #undef TEST_MAP
 
 
@@ -710,6 +764,8 @@ mymain(void)
 
     if (virTestRun("test12", test12, NULL) < 0)
         ret = -1;
+    if (virTestRun("test13", test13, NULL) < 0)
+        ret = -1;
 
     return ret;
 }
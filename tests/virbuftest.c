@@ -304,6 +304,58 @@ static int testBufAddBuffer(const void *data ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static int testBufGrow(const void *data ATTRIBUTE_UNUSED)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *result = NULL;
+    size_t i;
+    int ret = -1;
+
+    /* Small content stays valid across the switch from the embedded
+     * storage to the heap, and the returned string is heap-allocated
+     * either way */
+    virBufferAddLit(&buf, "short");
+    if (!(result = virBufferContentAndReset(&buf)) ||
+        STRNEQ(result, "short")) {
+        VIR_TEST_DEBUG("Unexpected content from small buffer");
+        goto cleanup;
+    }
+    VIR_FREE(result);
+
+    virBufferReserve(&buf, 10000);
+    if (virBufferError(&buf)) {
+        VIR_TEST_DEBUG("Buffer had error after reserve");
+        goto cleanup;
+    }
+
+    for (i = 0; i < 1000; i++)
+        virBufferAddLit(&buf, "0123456789");
+
+    if (virBufferError(&buf)) {
+        VIR_TEST_DEBUG("Buffer had error after grow");
+        goto cleanup;
+    }
+
+    if (virBufferUse(&buf) != 10000) {
+        VIR_TEST_DEBUG("Wrong buffer size %u", virBufferUse(&buf));
+        goto cleanup;
+    }
+
+    if (!(result = virBufferContentAndReset(&buf)) ||
+        strlen(result) != 10000 ||
+        STRNEQLEN(result, "0123456789", 10)) {
+        VIR_TEST_DEBUG("Unexpected content from grown buffer");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(result);
+    return ret;
+}
+
 struct testBufAddStrData {
     const char *data;
     const char *expect;
@@ -393,6 +445,7 @@ mymain(void)
     DO_TEST("Auto-indentation", testBufAutoIndent, 0);
     DO_TEST("Trim", testBufTrim, 0);
     DO_TEST("AddBuffer", testBufAddBuffer, 0);
+    DO_TEST("Grow", testBufGrow, 0);
 
 #define DO_TEST_ADD_STR(DATA, EXPECT)                                  \
     do {                                                               \
@@ -597,6 +597,79 @@ testHashEqual(const void *data ATTRIBUTE_UNUSED)
 }
 
 
+static int
+testHashOpen(const void *data ATTRIBUTE_UNUSED)
+{
+    virHashTablePtr hash;
+    size_t i;
+    int ret = -1;
+
+    if (!(hash = virHashCreateOpen(0, NULL)))
+        return -1;
+
+    for (i = 0; i < ARRAY_CARDINALITY(uuids); i++) {
+        if (virHashAddEntry(hash, uuids[i], (void *) uuids[i]) < 0)
+            goto cleanup;
+    }
+
+    if (testHashCheckCount(hash, ARRAY_CARDINALITY(uuids)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ARRAY_CARDINALITY(uuids); i++) {
+        if (virHashLookup(hash, uuids[i]) != uuids[i]) {
+            VIR_TEST_VERBOSE("\nentry \"%s\" could not be found\n",
+                             uuids[i]);
+            goto cleanup;
+        }
+    }
+
+    if (virHashAddEntry(hash, uuids[0], NULL) == 0) {
+        VIR_TEST_VERBOSE("\nadding a duplicate entry succeeded\n");
+        goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(uuids_subset); i++) {
+        if (virHashUpdateEntry(hash, uuids_subset[i], (void *) 1) < 0) {
+            VIR_TEST_VERBOSE("\nentry \"%s\" could not be updated\n",
+                             uuids_subset[i]);
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(uuids_subset); i++) {
+        if (virHashRemoveEntry(hash, uuids_subset[i]) < 0) {
+            VIR_TEST_VERBOSE("\nentry \"%s\" could not be removed\n",
+                             uuids_subset[i]);
+            goto cleanup;
+        }
+    }
+
+    if (testHashCheckCount(hash,
+                           ARRAY_CARDINALITY(uuids) -
+                           ARRAY_CARDINALITY(uuids_subset)) < 0)
+        goto cleanup;
+
+    /* removed keys must be re-addable over their tombstones */
+    for (i = 0; i < ARRAY_CARDINALITY(uuids_subset); i++) {
+        if (virHashAddEntry(hash, uuids_subset[i],
+                            (void *) uuids_subset[i]) < 0) {
+            VIR_TEST_VERBOSE("\nentry \"%s\" could not be re-added\n",
+                             uuids_subset[i]);
+            goto cleanup;
+        }
+    }
+
+    if (testHashCheckCount(hash, ARRAY_CARDINALITY(uuids)) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virHashFree(hash);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -635,6 +708,7 @@ mymain(void)
     DO_TEST("Search", Search);
     DO_TEST("GetItems", GetItems);
     DO_TEST("Equal", Equal);
+    DO_TEST("Open addressing", Open);
 
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
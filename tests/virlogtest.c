@@ -21,7 +21,14 @@
 
 #include "testutils.h"
 
+#include "viralloc.h"
+#include "virfile.h"
 #include "virlog.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.logtest");
 
 struct testLogData {
     const char *str;
@@ -105,6 +112,67 @@ testLogParseFilters(const void *opaque)
     return ret;
 }
 
+#define TEST_ASYNC_RECORDS 2000
+#define TEST_ASYNC_MARKER "async log record"
+
+static int
+testLogAsync(const void *opaque ATTRIBUTE_UNUSED)
+{
+    char tmpl[] = abs_builddir "/virlogtest-async-XXXXXX";
+    char *output = NULL;
+    char *buf = NULL;
+    const char *cur;
+    size_t count = 0;
+    size_t i;
+    int fd = -1;
+    int ret = -1;
+
+    if ((fd = mkstemp(tmpl)) < 0)
+        return -1;
+
+    virLogSetDefaultPriority(VIR_LOG_INFO);
+    if (virAsprintf(&output, "1:file:%s", tmpl) < 0 ||
+        virLogParseOutputs(output) < 0)
+        goto cleanup;
+
+    if (virLogSetAsync(true) < 0)
+        goto cleanup;
+
+    /* more records than the ring holds, so emitters must block for
+     * the writer to catch up rather than dropping messages */
+    for (i = 0; i < TEST_ASYNC_RECORDS; i++)
+        VIR_INFO(TEST_ASYNC_MARKER " %zu", i);
+
+    /* disabling drains the ring and joins the writer thread */
+    if (virLogSetAsync(false) < 0)
+        goto cleanup;
+
+    if (virFileReadAll(tmpl, 4 * 1024 * 1024, &buf) < 0)
+        goto cleanup;
+
+    cur = buf;
+    while ((cur = strstr(cur, TEST_ASYNC_MARKER))) {
+        count++;
+        cur++;
+    }
+
+    if (count != TEST_ASYNC_RECORDS) {
+        VIR_TEST_DEBUG("Expected %d flushed records, but found %zu\n",
+                       TEST_ASYNC_RECORDS, count);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    ignore_value(virLogSetAsync(false));
+    virLogReset();
+    unlink(tmpl);
+    VIR_FORCE_CLOSE(fd);
+    VIR_FREE(buf);
+    VIR_FREE(output);
+    return ret;
+}
+
 static int
 mymain(void)
 {
@@ -149,6 +217,9 @@ mymain(void)
     TEST_PARSE_FILTERS_FAIL(":foo", 1);
     TEST_PARSE_FILTERS_FAIL("1:+", 1);
 
+    if (virTestRun("testLogAsync", testLogAsync, NULL) < 0)
+        ret = -1;
+
     return ret;
 }
 
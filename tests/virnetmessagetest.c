@@ -104,8 +104,7 @@ static int testMessageHeaderDecode(const void *args ATTRIBUTE_UNUSED)
     if (!msg)
         return -1;
 
-    msg->bufferLength = 4;
-    if (VIR_ALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    if (virNetMessageSetBufferSize(msg, 4) < 0)
         goto cleanup;
     memcpy(msg->buffer, input_buf, msg->bufferLength);
 
@@ -334,8 +333,7 @@ static int testMessagePayloadDecode(const void *args ATTRIBUTE_UNUSED)
     if (!msg)
         return -1;
 
-    msg->bufferLength = 4;
-    if (VIR_ALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    if (virNetMessageSetBufferSize(msg, 4) < 0)
         goto cleanup;
     memcpy(msg->buffer, input_buffer, msg->bufferLength);
 
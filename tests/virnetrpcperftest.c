@@ -0,0 +1,241 @@
+/*
+ * virnetrpcperftest.c: RPC message and socket round-trip benchmark
+ *
+ * Copyright (C) 2016 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "viralloc.h"
+#include "virnetmessage.h"
+#include "virnetsocket.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+/* Runs from 'make bench', not 'make check'.  Measures the two costs
+ * that matter when sizing max_workers/max_clients: the CPU cost of
+ * encoding/decoding virNetMessage packets, and the round-trip latency
+ * and request rate over a loopback virNetSocket against an echo peer
+ * in a forked child.  TLS and SASL wrapping are not exercised: both
+ * need session/credential scaffolding (see virnettlscontexttest) that
+ * would dwarf the harness, and their per-message overhead is mostly
+ * spent in the external libraries anyway.
+ */
+
+#define BENCH_ROUNDTRIPS 10000
+
+static unsigned long long
+benchNowUS(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000ull + tv.tv_usec;
+}
+
+static int
+benchCompareUS(const void *a, const void *b)
+{
+    const unsigned long long *ua = a;
+    const unsigned long long *ub = b;
+
+    if (*ua < *ub)
+        return -1;
+    return *ua > *ub;
+}
+
+
+/* Encode+decode cost of one message of @payload bytes, no I/O */
+static int
+benchMessageCodec(size_t payload)
+{
+    virNetMessagePtr msg = NULL;
+    char *data = NULL;
+    unsigned long long start, end;
+    size_t iters = 100000;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(data, payload) < 0)
+        return -1;
+
+    start = benchNowUS();
+    for (i = 0; i < iters; i++) {
+        if (!(msg = virNetMessageNew(false)))
+            goto cleanup;
+
+        msg->header.prog = 0x11223344;
+        msg->header.vers = 1;
+        msg->header.proc = 1;
+        msg->header.type = VIR_NET_CALL;
+        msg->header.serial = i;
+        msg->header.status = VIR_NET_OK;
+
+        if (virNetMessageEncodeHeader(msg) < 0 ||
+            virNetMessageEncodePayloadRaw(msg, data, payload) < 0 ||
+            virNetMessageDecodeHeader(msg) < 0)
+            goto cleanup;
+
+        virNetMessageFree(msg);
+        msg = NULL;
+    }
+    end = benchNowUS();
+
+    fprintf(stderr, "codec %7zuB payload: %8.1f ns/op\n",
+            payload, (double)(end - start) * 1000 / iters);
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    VIR_FREE(data);
+    return ret;
+}
+
+
+/* Child end: echo every @msgsize block straight back over raw fd */
+static void
+benchEchoChild(int fd, size_t msgsize)
+{
+    char *buf;
+
+    if (VIR_ALLOC_N_QUIET(buf, msgsize) < 0)
+        _exit(EXIT_FAILURE);
+
+    for (;;) {
+        size_t got = 0;
+
+        while (got < msgsize) {
+            ssize_t rc = read(fd, buf + got, msgsize - got);
+
+            if (rc <= 0)
+                _exit(rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+            got += rc;
+        }
+        if (safewrite(fd, buf, msgsize) != (ssize_t)msgsize)
+            _exit(EXIT_FAILURE);
+    }
+}
+
+
+static int
+benchRoundtrip(size_t msgsize)
+{
+    virNetSocketPtr sock = NULL;
+    int sv[2] = { -1, -1 };
+    pid_t child = -1;
+    char *buf = NULL;
+    unsigned long long *lat = NULL;
+    unsigned long long total;
+    size_t i;
+    int ret = -1;
+
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        return -1;
+    }
+
+    if ((child = fork()) < 0)
+        goto cleanup;
+
+    if (child == 0) {
+        VIR_FORCE_CLOSE(sv[0]);
+        benchEchoChild(sv[1], msgsize);
+        _exit(EXIT_SUCCESS);
+    }
+
+    VIR_FORCE_CLOSE(sv[1]);
+
+    if (virNetSocketNewConnectSockFD(sv[0], &sock) < 0)
+        goto cleanup;
+    sv[0] = -1;
+
+    if (VIR_ALLOC_N(buf, msgsize) < 0 ||
+        VIR_ALLOC_N(lat, BENCH_ROUNDTRIPS) < 0)
+        goto cleanup;
+
+    total = benchNowUS();
+    for (i = 0; i < BENCH_ROUNDTRIPS; i++) {
+        unsigned long long start = benchNowUS();
+        size_t done = 0;
+
+        if (virNetSocketWrite(sock, buf, msgsize) != (ssize_t)msgsize)
+            goto cleanup;
+
+        while (done < msgsize) {
+            ssize_t rc = virNetSocketRead(sock, buf + done, msgsize - done);
+
+            if (rc <= 0)
+                goto cleanup;
+            done += rc;
+        }
+        lat[i] = benchNowUS() - start;
+    }
+    total = benchNowUS() - total;
+
+    qsort(lat, BENCH_ROUNDTRIPS, sizeof(*lat), benchCompareUS);
+
+    fprintf(stderr,
+            "echo %7zuB msgs: %8.0f req/s  p50 %6lluus  p99 %6lluus\n",
+            msgsize,
+            (double)BENCH_ROUNDTRIPS * 1000000 / total,
+            lat[BENCH_ROUNDTRIPS / 2],
+            lat[(size_t)(BENCH_ROUNDTRIPS * 0.99)]);
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(sock);
+    VIR_FORCE_CLOSE(sv[0]);
+    VIR_FORCE_CLOSE(sv[1]);
+    if (child > 0) {
+        kill(child, SIGTERM);
+        waitpid(child, NULL, 0);
+    }
+    VIR_FREE(buf);
+    VIR_FREE(lat);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (benchMessageCodec(256) < 0 ||
+        benchMessageCodec(4 * 1024) < 0 ||
+        benchMessageCodec(64 * 1024) < 0)
+        ret = -1;
+
+    if (benchRoundtrip(256) < 0 ||
+        benchRoundtrip(4 * 1024) < 0 ||
+        benchRoundtrip(64 * 1024) < 0 ||
+        benchRoundtrip(256 * 1024) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
@@ -0,0 +1,266 @@
+/*
+ * virperftest.c: microbenchmarks for util primitives
+ *
+ * Copyright (C) 2016 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "internal.h"
+#include "testutils.h"
+#include "viralloc.h"
+#include "virbitmap.h"
+#include "virbuffer.h"
+#include "virfile.h"
+#include "virhash.h"
+#include "virjson.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "virtime.h"
+#include "virutil.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.perftest");
+
+/* Not run from 'make check'; invoke via 'make bench' (or directly) to
+ * get ns/op figures for hot util primitives.  Each benchmark body is
+ * re-run with a growing iteration count until it has consumed at least
+ * BENCH_MIN_RUN_MS, so the reported figure is calibrated rather than
+ * being dominated by timer resolution.
+ *
+ * Set VIR_PERF_BASELINE to a file of "name ns/op" lines (the program's
+ * own output is accepted) to get a percentage comparison per benchmark.
+ */
+
+#define BENCH_MIN_RUN_MS 200
+#define BENCH_MAX_ITERS (128 * 1024 * 1024)
+
+typedef int (*benchFunc)(size_t iters);
+
+static FILE *baselineFile;
+
+static double
+benchBaselineLookup(const char *name)
+{
+    char line[256];
+    double val = -1;
+
+    if (!baselineFile)
+        return -1;
+
+    rewind(baselineFile);
+    while (fgets(line, sizeof(line), baselineFile)) {
+        char *sep = strchr(line, ' ');
+
+        if (!sep)
+            continue;
+        *sep = '\0';
+        if (STRNEQ(line, name))
+            continue;
+        if (virStrToDouble(sep + 1, NULL, &val) < 0)
+            val = -1;
+        break;
+    }
+    return val;
+}
+
+static int
+benchRun(const char *name, benchFunc func)
+{
+    size_t iters = 1024;
+    unsigned long long start, end;
+    double nsop;
+    double base;
+
+    for (;;) {
+        if (virTimeMillisNowRaw(&start) < 0)
+            return -1;
+        if (func(iters) < 0)
+            return -1;
+        if (virTimeMillisNowRaw(&end) < 0)
+            return -1;
+
+        if (end - start >= BENCH_MIN_RUN_MS ||
+            iters >= BENCH_MAX_ITERS)
+            break;
+        iters *= 4;
+    }
+
+    nsop = (double)(end - start) * 1000000.0 / iters;
+
+    if ((base = benchBaselineLookup(name)) > 0) {
+        fprintf(stderr, "%-24s %12.1f ns/op  (baseline %.1f, %+.1f%%)\n",
+                name, nsop, base, (nsop - base) * 100.0 / base);
+    } else {
+        fprintf(stderr, "%-24s %12.1f ns/op\n", name, nsop);
+    }
+    return 0;
+}
+
+
+static int
+benchHashLookup(size_t iters)
+{
+    virHashTablePtr hash;
+    char keys[256][VIR_UUID_STRING_BUFLEN];
+    size_t i;
+    int ret = -1;
+
+    if (!(hash = virHashCreate(64, NULL)))
+        return -1;
+
+    for (i = 0; i < ARRAY_CARDINALITY(keys); i++) {
+        snprintf(keys[i], sizeof(keys[i]), "key-%zu-abcdefghijklmnop", i);
+        if (virHashAddEntry(hash, keys[i], keys[i]) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < iters; i++) {
+        if (!virHashLookup(hash, keys[i % ARRAY_CARDINALITY(keys)]))
+            goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virHashFree(hash);
+    return ret;
+}
+
+
+static int
+benchBufferFormat(size_t iters)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    for (i = 0; i < iters; i++) {
+        virBufferAsprintf(&buf, "<element attr='%zu'>text</element>\n", i);
+        /* keep memory use flat */
+        if (virBufferUse(&buf) > 64 * 1024)
+            virBufferFreeAndReset(&buf);
+    }
+
+    if (virBufferCheckError(&buf) < 0)
+        return -1;
+    virBufferFreeAndReset(&buf);
+    return 0;
+}
+
+
+static int
+benchJSONParse(size_t iters)
+{
+    const char *doc =
+        "{\"mac\": \"52:54:00:12:34:56\","
+        " \"ip-address\": \"192.168.122.205\","
+        " \"hostname\": \"some-guest-name\","
+        " \"expiry-time\": 1453224103,"
+        " \"nested\": {\"a\": [1, 2, 3, 4], \"b\": true}}";
+    size_t i;
+
+    for (i = 0; i < iters; i++) {
+        virJSONValuePtr json = virJSONValueFromString(doc);
+
+        if (!json)
+            return -1;
+        virJSONValueFree(json);
+    }
+    return 0;
+}
+
+
+static int
+benchBitmapOps(size_t iters)
+{
+    virBitmapPtr map;
+    size_t i;
+    int ret = -1;
+
+    if (!(map = virBitmapNew(4096)))
+        return -1;
+
+    for (i = 0; i < 4096; i += 3)
+        ignore_value(virBitmapSetBit(map, i));
+
+    for (i = 0; i < iters; i++) {
+        ssize_t bit = virBitmapNextSetBit(map, (i * 67) % 4095);
+
+        if (bit < 0 &&
+            virBitmapCountBits(map) == 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virBitmapFree(map);
+    return ret;
+}
+
+
+static int
+benchAllocGrow(size_t iters)
+{
+    size_t i;
+
+    for (i = 0; i < iters; i++) {
+        int *vals = NULL;
+        size_t nvals = 0;
+        size_t j;
+
+        for (j = 0; j < 64; j++) {
+            if (VIR_EXPAND_N(vals, nvals, 1) < 0)
+                return -1;
+            vals[j] = j;
+        }
+        VIR_FREE(vals);
+    }
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    const char *baseline = virGetEnvAllowSUID("VIR_PERF_BASELINE");
+
+    if (baseline &&
+        !(baselineFile = fopen(baseline, "r"))) {
+        fprintf(stderr, "cannot open baseline file %s\n", baseline);
+        return EXIT_FAILURE;
+    }
+
+    if (benchRun("hash-lookup", benchHashLookup) < 0)
+        ret = -1;
+    if (benchRun("buffer-format", benchBufferFormat) < 0)
+        ret = -1;
+    if (benchRun("json-parse", benchJSONParse) < 0)
+        ret = -1;
+    if (benchRun("bitmap-ops", benchBitmapOps) < 0)
+        ret = -1;
+    if (benchRun("alloc-grow", benchAllocGrow) < 0)
+        ret = -1;
+
+    VIR_FORCE_FCLOSE(baselineFile);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIRT_TEST_MAIN(mymain)
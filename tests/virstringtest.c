@@ -122,6 +122,79 @@ static int testJoin(const void *args)
     return ret;
 }
 
+
+struct testTokenizeData {
+    const char *string;
+    char sep;
+    const char **tokens;
+};
+
+static int testTokenize(const void *args)
+{
+    const struct testTokenizeData *data = args;
+    const char *cur = data->string;
+    const char **expect = data->tokens;
+    virStringToken tok;
+
+    while (virStringTokenNext(&cur, data->sep, &tok)) {
+        if (!*expect) {
+            virFilePrintf(stderr, "Too many tokens returned\n");
+            return -1;
+        }
+        if (tok.len != strlen(*expect) ||
+            memcmp(tok.start, *expect, tok.len) != 0) {
+            virFilePrintf(stderr, "Mismatch '%.*s' vs '%s'\n",
+                          (int)tok.len, tok.start, *expect);
+            return -1;
+        }
+        expect++;
+    }
+    if (*expect) {
+        virFilePrintf(stderr, "Too few tokens returned\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int testTokenToULLong(const void *args ATTRIBUTE_UNUSED)
+{
+    const char *cur = "0 18446744073709551615 x9 12y ";
+    unsigned long long val;
+    virStringToken tok;
+
+    if (!virStringTokenNext(&cur, ' ', &tok) ||
+        virStringTokenToULLong(&tok, &val) < 0 ||
+        val != 0)
+        return -1;
+
+    if (!virStringTokenNext(&cur, ' ', &tok) ||
+        virStringTokenToULLong(&tok, &val) < 0 ||
+        val != 18446744073709551615ULL)
+        return -1;
+
+    /* leading junk, trailing junk and an empty token must be refused */
+    if (!virStringTokenNext(&cur, ' ', &tok) ||
+        virStringTokenToULLong(&tok, &val) == 0)
+        return -1;
+
+    if (!virStringTokenNext(&cur, ' ', &tok) ||
+        virStringTokenToULLong(&tok, &val) == 0)
+        return -1;
+
+    if (!virStringTokenNext(&cur, ' ', &tok) ||
+        virStringTokenToULLong(&tok, &val) == 0)
+        return -1;
+
+    if (virStringTokenNext(&cur, ' ', &tok)) {
+        virFilePrintf(stderr, "Too many tokens returned\n");
+        return -1;
+    }
+
+    return 0;
+}
+
 static bool fail;
 
 static const char *
@@ -620,6 +693,32 @@ mymain(void)
     const char *tokens8[] = { "gluster", "rdma", NULL };
     TEST_SPLIT("gluster+rdma", "+", 2, tokens8);
 
+#define TEST_TOKENIZE(str, s, toks)                                     \
+    do {                                                                \
+        struct testTokenizeData tokenizeData = {                        \
+            .string = str,                                              \
+            .sep = s,                                                   \
+            .tokens = toks,                                             \
+        };                                                              \
+        if (virTestRun("Tokenize " #str, testTokenize, &tokenizeData) < 0) \
+            ret = -1;                                                   \
+    } while (0)
+
+    const char *views1[] = { "", NULL };
+    TEST_TOKENIZE("", ' ', views1);
+
+    const char *views2[] = { "", "", NULL };
+    TEST_TOKENIZE(" ", ' ', views2);
+
+    const char *views3[] = { "The", "quick", "brown", "fox", NULL };
+    TEST_TOKENIZE("The quick brown fox", ' ', views3);
+
+    const char *views4[] = { "a", "", "b", "", NULL };
+    TEST_TOKENIZE("a,,b,", ',', views4);
+
+    if (virTestRun("Token to ULLong", testTokenToULLong, NULL) < 0)
+        ret = -1;
+
     if (virTestRun("strdup", testStrdup, NULL) < 0)
         ret = -1;
 
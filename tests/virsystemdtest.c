@@ -234,6 +234,7 @@ static int testCreateNoSystemd(const void *opaque ATTRIBUTE_UNUSED)
     int rv;
 
     setenv("FAIL_NO_SERVICE", "1", 1);
+    virSystemdHasMachinedResetCachedValue();
 
     if ((rv = virSystemdCreateMachine("demo",
                                       "qemu",
@@ -268,6 +269,7 @@ static int testCreateSystemdNotRunning(const void *opaque ATTRIBUTE_UNUSED)
     int rv;
 
     setenv("FAIL_NOT_REGISTERED", "1", 1);
+    virSystemdHasMachinedResetCachedValue();
 
     if ((rv = virSystemdCreateMachine("demo",
                                       "qemu",
@@ -302,6 +304,7 @@ static int testCreateBadSystemd(const void *opaque ATTRIBUTE_UNUSED)
     int rv;
 
     setenv("FAIL_BAD_SERVICE", "1", 1);
+    virSystemdHasMachinedResetCachedValue();
 
     if ((rv = virSystemdCreateMachine("demo",
                                       "qemu",
@@ -151,6 +151,38 @@ testTypedParamsAddStringList(const void *opaque ATTRIBUTE_UNUSED)
     return rv;
 }
 
+static int
+testTypedParamsComposeField(const void *opaque ATTRIBUTE_UNUSED)
+{
+    char buf[VIR_TYPED_PARAM_FIELD_LENGTH];
+    char longname[VIR_TYPED_PARAM_FIELD_LENGTH + 1];
+
+    if (virTypedParamsComposeField(buf, "block", 12, "rd.reqs") < 0 ||
+        STRNEQ(buf, "block.12.rd.reqs"))
+        return -1;
+
+    if (virTypedParamsComposeField(buf, "net", -1, "count") < 0 ||
+        STRNEQ(buf, "net.count"))
+        return -1;
+
+    if (virTypedParamsComposeField(buf, "vcpu", 0, "state") < 0 ||
+        STRNEQ(buf, "vcpu.0.state"))
+        return -1;
+
+    if (virTypedParamsComposeField(buf, "perf", -1, NULL) < 0 ||
+        STRNEQ(buf, "perf"))
+        return -1;
+
+    /* a name hitting the field length limit must be refused */
+    memset(longname, 'x', sizeof(longname) - 1);
+    longname[sizeof(longname) - 1] = '\0';
+    if (virTypedParamsComposeField(buf, "block", 0, longname) == 0)
+        return -1;
+    virResetLastError();
+
+    return 0;
+}
+
 static int
 testTypedParamsGetStringList(const void *opaque ATTRIBUTE_UNUSED)
 {
@@ -302,6 +334,9 @@ mymain(void)
     if (virTestRun("Add string list", testTypedParamsAddStringList, NULL) < 0)
         rv = -1;
 
+    if (virTestRun("Compose field", testTypedParamsComposeField, NULL) < 0)
+        rv = -1;
+
     if (rv < 0)
         return EXIT_FAILURE;
     return EXIT_SUCCESS;
@@ -70,6 +70,9 @@ do {                                                            \
 
 #define LEASEDIR LOCALSTATEDIR "/lib/libvirt/dnsmasq/"
 
+/* Upper bound on a lease file read, matching virlease.c */
+#define LEASE_FILE_SIZE_MAX (32 * 1024 * 1024)
+
 #define LIBVIRT_ALIGN(x) (((x) + __SIZEOF_POINTER__ - 1) & ~(__SIZEOF_POINTER__ - 1))
 #define FAMILY_ADDRESS_SIZE(family) ((family) == AF_INET6 ? 16 : 4)
 
@@ -138,6 +141,7 @@ findLease(const char *name,
     DEBUG("Dir: %s", leaseDir);
     while ((ret = virDirRead(dir, &entry, leaseDir)) > 0) {
         char *path;
+        char *content = NULL;
 
         if (!virFileHasSuffix(entry->d_name, ".status"))
             continue;
@@ -147,6 +151,21 @@ findLease(const char *name,
 
         DEBUG("Processing %s", path);
 
+        /* A lease for @name must contain the name verbatim in the
+         * JSON text.  A plain substring scan is much cheaper than a
+         * full JSON parse, so use it to skip the networks which
+         * cannot possibly hold a matching lease. */
+        if (virFileReadAllQuiet(path, LEASE_FILE_SIZE_MAX, &content) >= 0) {
+            bool miss = !strstr(content, name);
+
+            VIR_FREE(content);
+            if (miss) {
+                DEBUG("Skipping %s, no occurrence of %s", path, name);
+                VIR_FREE(path);
+                continue;
+            }
+        }
+
         if (virLeaseReadCustomLeaseFile(leases_array, path, NULL, NULL) < 0) {
             ERROR("Unable to parse %s", path);
             VIR_FREE(path);
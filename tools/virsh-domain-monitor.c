@@ -1812,12 +1812,17 @@ cmdList(vshControl *ctl, const vshCmd *cmd)
     bool optUUID = vshCommandOptBool(cmd, "uuid");
     bool optName = vshCommandOptBool(cmd, "name");
     size_t i;
+    size_t j;
     char *title;
     char uuid[VIR_UUID_STRING_BUFLEN];
     int state;
     bool ret = false;
     virshDomainListPtr list = NULL;
     virDomainPtr dom;
+    virDomainPtr *statedoms = NULL;
+    virDomainStatsRecordPtr *staterecords = NULL;
+    size_t nstaterecords = 0;
+    int nstats;
     char id_buf[INT_BUFSIZE_BOUND(unsigned int)];
     unsigned int id;
     unsigned int flags = VIR_CONNECT_LIST_DOMAINS_ACTIVE;
@@ -1857,6 +1862,28 @@ cmdList(vshControl *ctl, const vshCmd *cmd)
     if (!(list = virshDomainListCollect(ctl, flags)))
         goto cleanup;
 
+    /* Fetch the state of every listed domain with a single bulk call
+     * rather than one virDomainGetState RPC per table row, which adds a
+     * full round trip per domain on remote connections.  Older servers
+     * lack the bulk stats API; fall back to per-domain queries below. */
+    if (optTable && list->ndomains) {
+        statedoms = vshMalloc(ctl, sizeof(virDomainPtr) *
+                              (list->ndomains + 1));
+        memcpy(statedoms, list->domains,
+               sizeof(virDomainPtr) * list->ndomains);
+        statedoms[list->ndomains] = NULL;
+
+        nstats = virDomainListGetStats(statedoms,
+                                       VIR_DOMAIN_STATS_STATE,
+                                       &staterecords, 0);
+        if (nstats >= 0) {
+            nstaterecords = nstats;
+        } else {
+            vshResetLibvirtError();
+            staterecords = NULL;
+        }
+    }
+
     /* print table header in legacy mode */
     if (optTable) {
         if (optTitle)
@@ -1880,7 +1907,29 @@ cmdList(vshControl *ctl, const vshCmd *cmd)
             ignore_value(virStrcpyStatic(id_buf, "-"));
 
         if (optTable) {
-            state = virshDomainState(ctl, dom, NULL);
+            state = -1;
+
+            /* Look up the prefetched state first; records are normally
+             * returned in the order the domains were requested, so start
+             * the search at the current row.  Records reference their
+             * own virDomainPtr, hence the match is done by name. */
+            for (j = 0; j < nstaterecords; j++) {
+                virDomainStatsRecordPtr rec =
+                    staterecords[(i + j) % nstaterecords];
+                int recstate;
+
+                if (STRNEQ(virDomainGetName(rec->dom),
+                           virDomainGetName(dom)))
+                    continue;
+
+                if (virTypedParamsGetInt(rec->params, rec->nparams,
+                                         "state.state", &recstate) > 0)
+                    state = recstate;
+                break;
+            }
+
+            if (state < 0)
+                state = virshDomainState(ctl, dom, NULL);
 
             /* Domain could've been removed in the meantime */
             if (state < 0)
@@ -1926,6 +1975,8 @@ cmdList(vshControl *ctl, const vshCmd *cmd)
 
     ret = true;
  cleanup:
+    virDomainStatsRecordListFree(staterecords);
+    VIR_FREE(statedoms);
     virshDomainListFree(list);
     return ret;
 }
@@ -1973,6 +2024,10 @@ static const vshCmdOptDef opts_domstats[] = {
      .type = VSH_OT_BOOL,
      .help = N_("report domain perf event statistics"),
     },
+    {.name = "info",
+     .type = VSH_OT_BOOL,
+     .help = N_("report basic domain information"),
+    },
     {.name = "list-active",
      .type = VSH_OT_BOOL,
      .help = N_("list only active domains"),
@@ -2017,6 +2072,10 @@ static const vshCmdOptDef opts_domstats[] = {
      .type = VSH_OT_BOOL,
      .help = N_("add backing chain information to block stats"),
     },
+    {.name = "nowait",
+     .type = VSH_OT_BOOL,
+     .help = N_("report only stats that are accessible instantly"),
+    },
     {.name = "domain",
      .type = VSH_OT_ARGV,
      .flags = VSH_OFLAG_NONE,
@@ -2087,6 +2146,9 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptBool(cmd, "perf"))
         stats |= VIR_DOMAIN_STATS_PERF;
 
+    if (vshCommandOptBool(cmd, "info"))
+        stats |= VIR_DOMAIN_STATS_INFO;
+
     if (vshCommandOptBool(cmd, "list-active"))
         flags |= VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE;
 
@@ -2117,6 +2179,9 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptBool(cmd, "backing"))
         flags |= VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING;
 
+    if (vshCommandOptBool(cmd, "nowait"))
+        flags |= VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT;
+
     if (vshCommandOptBool(cmd, "domain")) {
         if (VIR_ALLOC_N(domlist, 1) < 0)
             goto cleanup;
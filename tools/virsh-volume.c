@@ -659,6 +659,10 @@ static const vshCmdOptDef opts_vol_upload[] = {
      .type = VSH_OT_INT,
      .help = N_("amount of data to upload")
     },
+    {.name = "sparse",
+     .type = VSH_OT_BOOL,
+     .help = N_("preserve sparseness of volume")
+    },
     {.name = NULL}
 };
 
@@ -671,6 +675,27 @@ cmdVolUploadSource(virStreamPtr st ATTRIBUTE_UNUSED,
     return saferead(*fd, bytes, nbytes);
 }
 
+static int
+cmdVolUploadSkip(virStreamPtr st ATTRIBUTE_UNUSED,
+                 long long offset, void *opaque)
+{
+    int *fd = opaque;
+
+    if (lseek(*fd, offset, SEEK_CUR) == (off_t) -1)
+        return -1;
+
+    return 0;
+}
+
+static int
+cmdVolUploadInData(virStreamPtr st ATTRIBUTE_UNUSED,
+                   int *inData, long long *offset, void *opaque)
+{
+    int *fd = opaque;
+
+    return virFileInData(*fd, inData, offset);
+}
+
 static bool
 cmdVolUpload(vshControl *ctl, const vshCmd *cmd)
 {
@@ -682,6 +707,8 @@ cmdVolUpload(vshControl *ctl, const vshCmd *cmd)
     const char *name = NULL;
     unsigned long long offset = 0, length = 0;
     virshControlPtr priv = ctl->privData;
+    unsigned int flags = 0;
+    int rv;
 
     if (vshCommandOptULongLong(ctl, cmd, "offset", &offset) < 0)
         return false;
@@ -692,6 +719,9 @@ cmdVolUpload(vshControl *ctl, const vshCmd *cmd)
     if (!(vol = virshCommandOptVol(ctl, cmd, "vol", "pool", &name)))
         return false;
 
+    if (vshCommandOptBool(cmd, "sparse"))
+        flags |= VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM;
+
     if (vshCommandOptStringReq(ctl, cmd, "file", &file) < 0)
         goto cleanup;
 
@@ -705,12 +735,19 @@ cmdVolUpload(vshControl *ctl, const vshCmd *cmd)
         goto cleanup;
     }
 
-    if (virStorageVolUpload(vol, st, offset, length, 0) < 0) {
+    if (virStorageVolUpload(vol, st, offset, length, flags) < 0) {
         vshError(ctl, _("cannot upload to volume %s"), name);
         goto cleanup;
     }
 
-    if (virStreamSendAll(st, cmdVolUploadSource, &fd) < 0) {
+    if (flags & VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM)
+        rv = virStreamSparseSendAll(st, cmdVolUploadSource,
+                                    cmdVolUploadInData,
+                                    cmdVolUploadSkip, &fd);
+    else
+        rv = virStreamSendAll(st, cmdVolUploadSource, &fd);
+
+    if (rv < 0) {
         vshError(ctl, _("cannot send data to volume %s"), name);
         goto cleanup;
     }
@@ -762,6 +799,10 @@ static const vshCmdOptDef opts_vol_download[] = {
      .type = VSH_OT_INT,
      .help = N_("amount of data to download")
     },
+    {.name = "sparse",
+     .type = VSH_OT_BOOL,
+     .help = N_("preserve sparseness of volume")
+    },
     {.name = NULL}
 };
 
@@ -777,6 +818,8 @@ cmdVolDownload(vshControl *ctl, const vshCmd *cmd)
     unsigned long long offset = 0, length = 0;
     bool created = false;
     virshControlPtr priv = ctl->privData;
+    unsigned int flags = 0;
+    int rv;
 
     if (vshCommandOptULongLong(ctl, cmd, "offset", &offset) < 0)
         return false;
@@ -787,6 +830,9 @@ cmdVolDownload(vshControl *ctl, const vshCmd *cmd)
     if (!(vol = virshCommandOptVol(ctl, cmd, "vol", "pool", &name)))
         return false;
 
+    if (vshCommandOptBool(cmd, "sparse"))
+        flags |= VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM;
+
     if (vshCommandOptStringReq(ctl, cmd, "file", &file) < 0)
         goto cleanup;
 
@@ -805,12 +851,18 @@ cmdVolDownload(vshControl *ctl, const vshCmd *cmd)
         goto cleanup;
     }
 
-    if (virStorageVolDownload(vol, st, offset, length, 0) < 0) {
+    if (virStorageVolDownload(vol, st, offset, length, flags) < 0) {
         vshError(ctl, _("cannot download from volume %s"), name);
         goto cleanup;
     }
 
-    if (virStreamRecvAll(st, virshStreamSink, &fd) < 0) {
+    if (flags & VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM)
+        rv = virStreamSparseRecvAll(st, virshStreamSink,
+                                    virshStreamSkip, &fd);
+    else
+        rv = virStreamRecvAll(st, virshStreamSink, &fd);
+
+    if (rv < 0) {
         vshError(ctl, _("cannot receive data from volume %s"), name);
         goto cleanup;
     }
@@ -265,6 +265,21 @@ int virshStreamSink(virStreamPtr st ATTRIBUTE_UNUSED,
     return safewrite(*fd, bytes, nbytes);
 }
 
+int virshStreamSkip(virStreamPtr st ATTRIBUTE_UNUSED,
+                    long long offset, void *opaque)
+{
+    int *fd = opaque;
+    off_t cur;
+
+    if ((cur = lseek(*fd, offset, SEEK_CUR)) == (off_t) -1)
+        return -1;
+
+    if (ftruncate(*fd, cur) < 0)
+        return -1;
+
+    return 0;
+}
+
 /* ---------------
  * Command Connect
  * ---------------
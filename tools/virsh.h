@@ -149,5 +149,6 @@ int virshDomainState(vshControl *ctl, virDomainPtr dom, int *reason);
 
 int virshStreamSink(virStreamPtr st, const char *bytes, size_t nbytes,
                     void *opaque);
+int virshStreamSkip(virStreamPtr st, long long offset, void *opaque);
 
 #endif /* VIRSH_H */